@@ -88,8 +88,13 @@
 #include <vector>
 #ifndef __EMX__
 #include <sched.h>
+#ifdef __linux__
+#include <sys/syscall.h>
 #endif
 #endif
+#endif
+
+#include <algorithm>
 
 #include "app_ipc.h"
 #include "common_defs.h"
@@ -97,6 +102,7 @@
 #include "error_numbers.h"
 #include "filesys.h"
 #include "mem_usage.h"
+#include "mfile.h"
 #include "parse.h"
 #include "proc_control.h"
 #include "shmem.h"
@@ -127,6 +133,20 @@ APP_CLIENT_SHM* app_client_shm = 0;
 static volatile int time_until_checkpoint;
     // time until enable checkpoint
 static volatile double fraction_done;
+
+// per-thread progress counters (see boinc_thread_progress()).
+// Each is padded to a cache line, so threads updating their own
+// counters don't contend; the timer thread adds them up.
+//
+#define PROGRESS_SLOT_SIZE  64
+struct PROGRESS_SLOT {
+    volatile double units_done;
+    char pad[PROGRESS_SLOT_SIZE - sizeof(double)];
+};
+static PROGRESS_SLOT progress_slots[BOINC_MAX_PROGRESS_THREADS];
+static volatile int nprogress_slots = 0;
+    // 1 + highest slot used
+static volatile double progress_total_units = 0;
 static volatile double last_checkpoint_cpu_time;
 static volatile bool ready_to_checkpoint = false;
 static volatile int in_critical_section = 0;
@@ -293,6 +313,10 @@ static int setup_shared_mem() {
 #endif
 #endif  // ! _WIN32
     if (app_client_shm == NULL) return -1;
+    if (aid.shmem_ring_version >= MSG_RING_VERSION) {
+        app_client_shm->use_rings = true;
+        app_client_shm->shm->app_ring_version = MSG_RING_VERSION;
+    }
     return 0;
 }
 
@@ -377,9 +401,10 @@ static bool update_app_progress(double cpu_t, double cp_cpu_t) {
     if (want_network) {
         strlcat(msg_buf, "<want_network>1</want_network>\n", sizeof(msg_buf));
     }
-    if (fraction_done >= 0) {
+    double f = boinc_get_fraction_done();
+    if (f >= 0) {
         double range = aid.fraction_done_end - aid.fraction_done_start;
-        double fdone = aid.fraction_done_start + fraction_done*range;
+        double fdone = aid.fraction_done_start + f*range;
         sprintf(buf, "<fraction_done>%e</fraction_done>\n", fdone);
         strlcat(msg_buf, buf, sizeof(msg_buf));
     }
@@ -465,7 +490,7 @@ static void parallel_master(int child_pid) {
         interrupt_count++;
         if (app_client_shm) {
             handle_heartbeat_msg();
-            if (app_client_shm->shm->process_control_request.get_msg(buf)) {
+            if (app_client_shm->get_process_control_msg(buf)) {
                 if (match_tag(buf, "<suspend/>")) {
                     kill(child_pid, SIGSTOP);
                 } else if (match_tag(buf, "<resume/>")) {
@@ -629,6 +654,10 @@ int boinc_init_options_general(BOINC_OPTIONS& opt) {
     //
     initial_wu_cpu_time = aid.wu_cpu_time;
 
+    // don't read the soft link files each time a name is resolved
+    //
+    if (!standalone) boinc_resolve_cache_init();
+
     fraction_done = -1;
     time_until_checkpoint = min_checkpoint_period();
     last_checkpoint_cpu_time = aid.wu_cpu_time;
@@ -1027,11 +1056,13 @@ static void handle_trickle_down_msg() {
 //
 static bool suspend_request = false;
 
-// runs in timer thread
+// runs in timer thread.
+// Handle all pending messages
+// (there may be several if the client uses a MSG_RING)
 //
 static void handle_process_control_msg() {
     char buf[MSG_CHANNEL_SIZE];
-    if (app_client_shm->shm->process_control_request.get_msg(buf)) {
+    while (app_client_shm->get_process_control_msg(buf)) {
         acquire_mutex();
 #ifdef DEBUG_BOINC_API
         char log_buf[256];
@@ -1100,7 +1131,10 @@ static void handle_process_control_msg() {
 
 // timer handler; runs in the timer thread
 //
-static void timer_handler() {
+// nticks is the number of TIMER_PERIODs since the last call;
+// it may be zero if we were woken up by a message
+//
+static void timer_handler(int nticks=1) {
     char buf[512];
 #ifdef DEBUG_BOINC_API
     fprintf(stderr, "%s timer handler: disabled %s; in critical section %s; finishing %s\n",
@@ -1120,9 +1154,9 @@ static void timer_handler() {
         boinc_disable_timer_thread = true;
         return;
     }
-    interrupt_count++;
+    interrupt_count += nticks;
     if (!boinc_status.suspended) {
-        running_interrupt_count++;
+        running_interrupt_count += nticks;
     }
     // handle messages from the core client
     //
@@ -1137,7 +1171,7 @@ static void timer_handler() {
             handle_process_control_msg();
         }
     }
-    if (interrupt_count % TIMERS_PER_SEC) return;
+    if (!nticks || interrupt_count % TIMERS_PER_SEC) return;
 
 #ifdef DEBUG_BOINC_API
     fprintf(stderr, "%s 1 sec elapsed - doing slow actions\n", boinc_msg_prefix(buf, sizeof(buf)));
@@ -1222,8 +1256,66 @@ DWORD WINAPI timer_thread(void *) {
 
 #else
 
+#ifdef __linux__
+// use syscall(); clock_gettime() needs -lrt on older systems
+//
+static double monotonic_time() {
+    struct timespec ts;
+    syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// If the client supports MSG_RING, the timer thread doesn't wake up
+// every TIMER_PERIOD; it sleeps until the next one-second boundary,
+// and the client wakes it up (see MSG_RING::wait_msg())
+// when it sends a process control message,
+// so suspend/resume/quit latency is unchanged.
+//
+// interrupt_count etc. are still in units of TIMER_PERIOD.
+// We measure the time actually slept with CLOCK_MONOTONIC,
+// and never count more than the ticks we asked for
+// (e.g. if the process was stopped),
+// so we land exactly on each one-second boundary.
+//
+static void adaptive_timer_loop() {
+    MSG_RING& ring = app_client_shm->shm->process_control_ring;
+    double t0, t1, slept = 0;
+
+    t0 = monotonic_time();
+    while (1) {
+        int n = TIMERS_PER_SEC - interrupt_count%TIMERS_PER_SEC;
+        double dt = n*TIMER_PERIOD - slept;
+        if (boinc_disable_timer_thread) {
+            // timer_handler() won't read messages; don't spin
+            //
+            boinc_sleep(dt);
+        } else {
+            ring.wait_msg(dt);
+        }
+        t1 = monotonic_time();
+        slept += t1 - t0;
+        t0 = t1;
+        int nticks = (int)(slept/TIMER_PERIOD + 1e-6);
+        if (nticks >= n) {
+            nticks = n;
+            slept = 0;
+        } else {
+            slept -= nticks*TIMER_PERIOD;
+        }
+        timer_handler(nticks);
+    }
+}
+#endif
+
 static void* timer_thread(void*) {
     block_sigalrm();
+#ifdef __linux__
+    if (app_client_shm && app_client_shm->use_rings
+        && options.handle_process_control
+    ) {
+        adaptive_timer_loop();
+    }
+#endif
     while(1) {
         boinc_sleep(TIMER_PERIOD);
         timer_handler();
@@ -1361,8 +1453,12 @@ int boinc_time_to_checkpoint() {
     return 0;
 }
 
+// output of write-behind MFILEs must be on disk
+// before the checkpoint counts
+//
 int boinc_checkpoint_completed() {
     double cur_cpu;
+    int retval = mfile_sync_all();
     cur_cpu = boinc_worker_thread_cpu_time();
     last_wu_cpu_time = cur_cpu + aid.wu_cpu_time;
     last_checkpoint_cpu_time = last_wu_cpu_time;
@@ -1370,7 +1466,7 @@ int boinc_checkpoint_completed() {
     boinc_end_critical_section();
     ready_to_checkpoint = false;
 
-    return 0;
+    return retval;
 }
 
 void boinc_begin_critical_section() {
@@ -1427,6 +1523,25 @@ int boinc_fraction_done(double x) {
     return 0;
 }
 
+int boinc_thread_progress_total(double total_units) {
+    progress_total_units = total_units;
+    return 0;
+}
+
+// No locks: each slot is written only by its thread.
+// The timer thread may see a slightly stale sum, which is fine.
+//
+int boinc_thread_progress(int slot, double units_done) {
+    if (slot < 0 || slot >= BOINC_MAX_PROGRESS_THREADS) {
+        return ERR_INVALID_PARAM;
+    }
+    progress_slots[slot].units_done = units_done;
+    if (slot >= nprogress_slots) {
+        nprogress_slots = slot+1;
+    }
+    return 0;
+}
+
 int boinc_receive_trickle_down(char* buf, int len) {
     std::string filename;
     char path[MAXPATHLEN];
@@ -1501,8 +1616,23 @@ void boinc_register_timer_callback(FUNC_PTR p) {
     timer_callback = p;
 }
 
+// if the app uses per-thread counters, the fraction done
+// is their sum over the total, or what was passed to
+// boinc_fraction_done() if that's more (e.g. 1 at the end)
+//
 double boinc_get_fraction_done() {
-    return fraction_done;
+    double f = fraction_done;
+    if (progress_total_units > 0) {
+        double sum = 0;
+        int n = nprogress_slots;
+        for (int i=0; i<n; i++) {
+            sum += progress_slots[i].units_done;
+        }
+        double x = sum/progress_total_units;
+        if (x > 1) x = 1;
+        if (x > f) f = x;
+    }
+    return f;
 }
 
 double boinc_elapsed_time() {
@@ -1520,3 +1650,334 @@ void boinc_remote_desktop_addr(char* addr) {
     strlcpy(remote_desktop_addr, addr, sizeof(remote_desktop_addr));
     send_remote_desktop_addr = true;
 }
+
+////////// incremental checkpointing
+//
+// Each registered region is kept in a file boinc_ckpt_NAME
+// in the slot dir.
+// boinc_ckpt_write() copies the dirty ranges of all regions
+// (so the app can go on changing them) and starts a thread that
+// 1) writes the ranges to boinc_ckpt_journal_tmp and syncs it;
+// 2) renames it to boinc_ckpt_journal; this is the commit point;
+// 3) writes the ranges into the region files, syncs them,
+//    and deletes the journal.
+// boinc_ckpt_restore() replays a committed journal, if any,
+// before reading the region files,
+// so a crash at any point leaves the last committed checkpoint.
+
+#define CKPT_JOURNAL        "boinc_ckpt_journal"
+#define CKPT_JOURNAL_TEMP   "boinc_ckpt_journal_tmp"
+#define CKPT_MAGIC          0x424b4350
+
+struct CKPT_RANGE {
+    size_t offset;
+    size_t nbytes;
+};
+
+struct CKPT_REGION {
+    char name[256];
+    char* addr;
+    size_t nbytes;
+    vector<CKPT_RANGE> dirty;
+};
+
+// a copied range, owned by the writer thread
+//
+struct CKPT_CHUNK {
+    int region;
+    size_t offset;
+    size_t nbytes;
+    char* data;
+};
+
+// journal record header
+//
+struct CKPT_REC {
+    int magic;
+    int region;
+    double offset;
+    double nbytes;
+};
+
+static vector<CKPT_REGION> ckpt_regions;
+static vector<CKPT_CHUNK> ckpt_chunks;
+static volatile bool ckpt_busy = false;
+static volatile int ckpt_retval = 0;
+static volatile double ckpt_cpu_time;
+    // CPU time as of the snapshot being written
+
+static void ckpt_filename(int i, char* path, int len) {
+    snprintf(path, len, "boinc_ckpt_%s", ckpt_regions[i].name);
+}
+
+static int ckpt_sync(FILE* f) {
+    if (fflush(f)) return ERR_FFLUSH;
+#ifdef _WIN32
+    if (_commit(_fileno(f))) return ERR_FSYNC;
+#else
+    if (fsync(fileno(f))) return ERR_FSYNC;
+#endif
+    return 0;
+}
+
+static int ckpt_seek(FILE* f, size_t offset) {
+#ifdef _WIN32
+    return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// write a range into a region file, creating it if needed
+//
+static int ckpt_write_range(int region, size_t offset, size_t nbytes, char* data) {
+    char path[MAXPATHLEN];
+    ckpt_filename(region, path, sizeof(path));
+    FILE* f = boinc_fopen(path, "r+b");
+    if (!f) f = boinc_fopen(path, "wb");
+    if (!f) return ERR_FOPEN;
+    int retval = 0;
+    if (ckpt_seek(f, offset)) {
+        retval = ERR_WRITE;
+    } else if (fwrite(data, 1, nbytes, f) != nbytes) {
+        retval = ERR_FWRITE;
+    } else {
+        retval = ckpt_sync(f);
+    }
+    fclose(f);
+    return retval;
+}
+
+static int ckpt_write_journal() {
+    unsigned int i;
+    FILE* f = boinc_fopen(CKPT_JOURNAL_TEMP, "wb");
+    if (!f) return ERR_FOPEN;
+    for (i=0; i<ckpt_chunks.size(); i++) {
+        CKPT_CHUNK& c = ckpt_chunks[i];
+        CKPT_REC rec;
+        rec.magic = CKPT_MAGIC;
+        rec.region = c.region;
+        rec.offset = (double)c.offset;
+        rec.nbytes = (double)c.nbytes;
+        if (fwrite(&rec, sizeof(rec), 1, f) != 1
+            || fwrite(c.data, 1, c.nbytes, f) != c.nbytes
+        ) {
+            fclose(f);
+            return ERR_FWRITE;
+        }
+    }
+    int retval = ckpt_sync(f);
+    fclose(f);
+    if (retval) return retval;
+    return boinc_rename(CKPT_JOURNAL_TEMP, CKPT_JOURNAL);
+}
+
+static int ckpt_do_write() {
+    unsigned int i;
+    int retval = ckpt_write_journal();
+    if (retval) return retval;
+    for (i=0; i<ckpt_chunks.size(); i++) {
+        CKPT_CHUNK& c = ckpt_chunks[i];
+        retval = ckpt_write_range(c.region, c.offset, c.nbytes, c.data);
+        if (retval) return retval;
+            // the journal is committed; restore will replay it
+    }
+    boinc_delete_file(CKPT_JOURNAL);
+    return 0;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI ckpt_thread(LPVOID) {
+#else
+static void* ckpt_thread(void*) {
+    block_sigalrm();
+#endif
+    int retval = ckpt_do_write();
+    for (unsigned int i=0; i<ckpt_chunks.size(); i++) {
+        free(ckpt_chunks[i].data);
+    }
+    ckpt_chunks.clear();
+    ckpt_retval = retval;
+    if (!retval) {
+        last_checkpoint_cpu_time = ckpt_cpu_time;
+    }
+    ckpt_busy = false;
+    return 0;
+}
+
+// replay a committed journal
+//
+static int ckpt_replay_journal() {
+    CKPT_REC rec;
+    int retval = 0;
+
+    FILE* f = boinc_fopen(CKPT_JOURNAL, "rb");
+    if (!f) return 0;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (rec.magic != CKPT_MAGIC
+            || rec.region < 0 || rec.region >= (int)ckpt_regions.size()
+        ) {
+            retval = ERR_XML_PARSE;
+            break;
+        }
+        size_t nbytes = (size_t)rec.nbytes;
+        char* data = (char*)malloc(nbytes);
+        if (!data) {
+            retval = ERR_MALLOC;
+            break;
+        }
+        if (fread(data, 1, nbytes, f) != nbytes) {
+            free(data);
+            retval = ERR_FREAD;
+            break;
+        }
+        retval = ckpt_write_range(rec.region, (size_t)rec.offset, nbytes, data);
+        free(data);
+        if (retval) break;
+    }
+    fclose(f);
+    if (!retval) boinc_delete_file(CKPT_JOURNAL);
+    return retval;
+}
+
+int boinc_ckpt_register(const char* name, void* addr, size_t nbytes) {
+    CKPT_REGION r;
+    CKPT_RANGE range;
+    if (ckpt_busy) return ERR_IN_PROGRESS;
+    strlcpy(r.name, name, sizeof(r.name));
+    r.addr = (char*)addr;
+    r.nbytes = nbytes;
+    range.offset = 0;
+    range.nbytes = nbytes;
+    r.dirty.push_back(range);
+    ckpt_regions.push_back(r);
+    return (int)ckpt_regions.size() - 1;
+}
+
+int boinc_ckpt_dirty(int id, size_t offset, size_t nbytes) {
+    if (id < 0 || id >= (int)ckpt_regions.size()) return ERR_NOT_FOUND;
+    CKPT_REGION& r = ckpt_regions[id];
+    if (offset >= r.nbytes) return ERR_INVALID_PARAM;
+    if (nbytes > r.nbytes - offset) nbytes = r.nbytes - offset;
+
+    // extend the last range if this one touches it;
+    // the common case is a sequential sweep
+    //
+    if (r.dirty.size()) {
+        CKPT_RANGE& last = r.dirty.back();
+        if (offset >= last.offset && offset <= last.offset + last.nbytes) {
+            if (offset + nbytes > last.offset + last.nbytes) {
+                last.nbytes = offset + nbytes - last.offset;
+            }
+            return 0;
+        }
+    }
+    CKPT_RANGE range;
+    range.offset = offset;
+    range.nbytes = nbytes;
+    r.dirty.push_back(range);
+    return 0;
+}
+
+static bool range_less(const CKPT_RANGE& a, const CKPT_RANGE& b) {
+    return a.offset < b.offset;
+}
+
+int boinc_ckpt_restore() {
+    char path[MAXPATHLEN];
+    unsigned int i;
+    bool found = false;
+
+    int retval = ckpt_replay_journal();
+    if (retval) return retval;
+    for (i=0; i<ckpt_regions.size(); i++) {
+        CKPT_REGION& r = ckpt_regions[i];
+        ckpt_filename(i, path, sizeof(path));
+        FILE* f = boinc_fopen(path, "rb");
+        if (!f) continue;
+        size_t n = fread(r.addr, 1, r.nbytes, f);
+        fclose(f);
+        if (n != r.nbytes) return ERR_FREAD;
+        r.dirty.clear();
+        found = true;
+    }
+    return found?0:ERR_NOT_FOUND;
+}
+
+int boinc_ckpt_write() {
+    unsigned int i, j;
+
+    if (ckpt_busy) {
+        // the last one isn't done; skip this one
+        //
+        time_until_checkpoint = min_checkpoint_period();
+        boinc_end_critical_section();
+        ready_to_checkpoint = false;
+        return ERR_IN_PROGRESS;
+    }
+
+    // copy the dirty ranges, merging overlaps
+    //
+    for (i=0; i<ckpt_regions.size(); i++) {
+        CKPT_REGION& r = ckpt_regions[i];
+        std::sort(r.dirty.begin(), r.dirty.end(), range_less);
+        for (j=0; j<r.dirty.size(); ) {
+            size_t start = r.dirty[j].offset;
+            size_t end = start + r.dirty[j].nbytes;
+            for (j++; j<r.dirty.size() && r.dirty[j].offset <= end; j++) {
+                size_t e = r.dirty[j].offset + r.dirty[j].nbytes;
+                if (e > end) end = e;
+            }
+            CKPT_CHUNK c;
+            c.region = i;
+            c.offset = start;
+            c.nbytes = end - start;
+            c.data = (char*)malloc(c.nbytes);
+            if (!c.data) {
+                for (j=0; j<ckpt_chunks.size(); j++) {
+                    free(ckpt_chunks[j].data);
+                }
+                ckpt_chunks.clear();
+                return ERR_MALLOC;
+                    // still in the critical section;
+                    // the app can write synchronously and call
+                    // boinc_checkpoint_completed()
+            }
+            memcpy(c.data, r.addr + start, c.nbytes);
+            ckpt_chunks.push_back(c);
+        }
+        r.dirty.clear();
+    }
+
+    ckpt_cpu_time = boinc_worker_thread_cpu_time() + aid.wu_cpu_time;
+    last_wu_cpu_time = ckpt_cpu_time;
+    time_until_checkpoint = min_checkpoint_period();
+    boinc_end_critical_section();
+    ready_to_checkpoint = false;
+
+    ckpt_busy = true;
+#ifdef _WIN32
+    DWORD id;
+    HANDLE h = CreateThread(NULL, 0, ckpt_thread, 0, 0, &id);
+    if (h) {
+        CloseHandle(h);
+        return 0;
+    }
+#else
+    pthread_t thread;
+    pthread_attr_t attrs;
+    pthread_attr_init(&attrs);
+    pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+    int retval = pthread_create(&thread, &attrs, ckpt_thread, NULL);
+    pthread_attr_destroy(&attrs);
+    if (!retval) return 0;
+#endif
+    // no thread; write it here
+    //
+    ckpt_thread(NULL);
+    return ckpt_retval;
+}
+
+int boinc_ckpt_busy() {
+    return ckpt_busy?1:0;
+}
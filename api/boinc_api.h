@@ -92,6 +92,14 @@ extern int boinc_send_trickle_up(char* variety, char* text);
 extern int boinc_set_min_checkpoint_period(int);
 extern int boinc_checkpoint_completed(void);
 extern int boinc_fraction_done(double);
+
+// For multithreaded apps: each worker thread reports its own progress,
+// with no locking, in a slot of its own (0 .. BOINC_MAX_PROGRESS_THREADS-1).
+// The fraction done is the sum over slots divided by the total.
+//
+#define BOINC_MAX_PROGRESS_THREADS 256
+extern int boinc_thread_progress_total(double total_units);
+extern int boinc_thread_progress(int slot, double units_done);
 extern int boinc_suspend_other_activities(void);
 extern int boinc_resume_other_activities(void);
 extern int boinc_report_app_status(
@@ -119,6 +127,29 @@ extern int boinc_init_parallel();
 extern void boinc_web_graphics_url(char*);
 extern void boinc_remote_desktop_addr(char*);
 
+// incremental checkpointing of registered memory regions.
+// Typical use:
+//   id = boinc_ckpt_register("grid", p, n);   (for each region)
+//   boinc_ckpt_restore();                     (0 if state was restored)
+//   loop:
+//     ... modify p[i..j], call boinc_ckpt_dirty(id, i, j-i+1) ...
+//     if (boinc_time_to_checkpoint()) boinc_ckpt_write();
+//
+extern int boinc_ckpt_register(const char* name, void* addr, size_t nbytes);
+    // returns a region ID (>= 0) or an error code.
+    // The whole region is dirty initially
+extern int boinc_ckpt_dirty(int id, size_t offset, size_t nbytes);
+extern int boinc_ckpt_restore(void);
+    // read regions from the last committed checkpoint.
+    // Returns ERR_NOT_FOUND if there isn't one
+extern int boinc_ckpt_write(void);
+    // use in place of boinc_checkpoint_completed().
+    // Copies the dirty ranges and returns;
+    // they're written in the background, and the checkpoint
+    // is reported to the client once it's committed.
+extern int boinc_ckpt_busy(void);
+    // nonzero if a background write is in progress
+
 #ifdef __APPLE__
 extern int setMacPList(void);
 extern int setMacIcon(char *filename, char *iconData, long iconSize);
@@ -32,11 +32,15 @@
 #include "win_util.h"
 #else
 #include <string>
+#include <unistd.h>
 #endif
 
 #include "error_numbers.h"
 #include "coproc.h"
+#include "filesys.h"
+#include "md5_file.h"
 #include "str_replace.h"
+#include "util.h"
 #include "boinc_api.h"
 
 #include "boinc_opencl.h"
@@ -80,6 +84,47 @@ int get_vendor(cl_device_id device_id, char* vendor, int len) {
 }
 
 
+// If the client told us which platform the device is on,
+// look only at that platform's GPUs.
+// On hosts with many GPUs this avoids enumerating (and on some drivers
+// initializing) every device on every platform.
+// returns an OpenCL error num or zero
+//
+static int get_opencl_ids_direct(
+    char* type, int platform_index, int opencl_device_index,
+    cl_device_id* device, cl_platform_id* platform
+) {
+    cl_platform_id platforms[MAX_OPENCL_PLATFORMS];
+    cl_uint num_platforms, num_devices;
+    cl_device_id devices[MAX_COPROC_INSTANCES];
+    char vendor[256];
+    int retval;
+
+    if (platform_index < 0 || opencl_device_index < 0) {
+        return CL_DEVICE_NOT_FOUND;
+    }
+    retval = clGetPlatformIDs(MAX_OPENCL_PLATFORMS, platforms, &num_platforms);
+    if (retval != CL_SUCCESS) return retval;
+    if (platform_index >= (int)num_platforms) return CL_DEVICE_NOT_FOUND;
+
+    retval = clGetDeviceIDs(
+        platforms[platform_index], CL_DEVICE_TYPE_GPU,
+        MAX_COPROC_INSTANCES, devices, &num_devices
+    );
+    if (retval != CL_SUCCESS) return retval;
+    if (opencl_device_index >= (int)num_devices) return CL_DEVICE_NOT_FOUND;
+
+    // make sure the platform order hasn't changed since the client scanned
+    //
+    retval = get_vendor(devices[opencl_device_index], vendor, sizeof(vendor));
+    if (retval != CL_SUCCESS) return retval;
+    if (strcmp(vendor, type)) return CL_DEVICE_NOT_FOUND;
+
+    *device = devices[opencl_device_index];
+    *platform = platforms[platform_index];
+    return 0;
+}
+
 // returns an OpenCL error num or zero
 //
 int boinc_get_opencl_ids_aux(
@@ -219,6 +264,12 @@ int boinc_get_opencl_ids(
         return ERR_NOT_FOUND;
     }
 
+    retval = get_opencl_ids_direct(
+        gpu_type, aid.gpu_opencl_platform_index, aid.gpu_opencl_dev_index,
+        device, platform
+    );
+    if (!retval) return 0;
+
     retval = boinc_get_opencl_ids_aux(
         gpu_type, aid.gpu_opencl_dev_index, gpu_device_num, device, platform
     );
@@ -254,9 +305,220 @@ int boinc_get_opencl_ids(cl_device_id* device, cl_platform_id* platform) {
         return ERR_NOT_FOUND;
     }
 
+    retval = get_opencl_ids_direct(
+        aid.gpu_type, aid.gpu_opencl_platform_index, aid.gpu_opencl_dev_index,
+        device, platform
+    );
+    if (!retval) return 0;
+
     retval = boinc_get_opencl_ids_aux(
         aid.gpu_type, aid.gpu_opencl_dev_index, aid.gpu_device_num, device, platform
     );
 
     return retval;
 }
+
+
+// Compiled program binaries are cached in the project's
+// opencl_cache/ directory, so they're shared by all tasks
+// (in any slot) of the project's apps.
+// The filename contains the program name and app version,
+// and the MD5 of the source, build options, device name and driver version.
+// A driver update, a new app version or new options give a new name,
+// so stale binaries are never loaded.
+//
+// Binaries are written to a temp file and renamed into place,
+// so readers never see a partial file.
+// While one task compiles a program, others wanting the same one
+// wait for it (up to OPENCL_CACHE_WAIT seconds) rather than
+// compiling it themselves.
+//
+#define OPENCL_CACHE_DIR    "opencl_cache"
+#define OPENCL_CACHE_WAIT   600
+
+static int program_cache_path(
+    cl_device_id device, const char* name, const char* source,
+    const char* options, char* path, int len
+) {
+    APP_INIT_DATA aid;
+    char dir[MAXPATHLEN], dev_name[256], driver_version[256], md5[64];
+    std::string key;
+
+    boinc_get_init_data(aid);
+    snprintf(dir, sizeof(dir), "%s/%s",
+        strlen(aid.project_dir)?aid.project_dir:".", OPENCL_CACHE_DIR
+    );
+    if (!is_dir(dir)) {
+        boinc_mkdir(dir);
+        if (!is_dir(dir)) return ERR_MKDIR;
+    }
+    strcpy(dev_name, "");
+    strcpy(driver_version, "");
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(dev_name), dev_name, NULL);
+    clGetDeviceInfo(
+        device, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, NULL
+    );
+    key = source;
+    key += '\n';
+    key += options?options:"";
+    key += '\n';
+    key += dev_name;
+    key += '\n';
+    key += driver_version;
+    md5_block((const unsigned char*)key.c_str(), (int)key.size(), md5);
+    snprintf(path, len, "%s/%s_%d_%s.bin", dir, name, aid.app_version, md5);
+    return 0;
+}
+
+// returns zero if a usable binary was found
+//
+static int load_cached_program(
+    cl_context context, cl_device_id device, const char* path,
+    const char* options, cl_program* program
+) {
+    size_t size;
+    cl_int status;
+    double dsize;
+
+    if (file_size(path, dsize)) return ERR_NOT_FOUND;
+    size = (size_t)dsize;
+    if (!size) return ERR_NOT_FOUND;
+    unsigned char* buf = (unsigned char*)malloc(size);
+    if (!buf) return ERR_MALLOC;
+    FILE* f = boinc_fopen(path, "rb");
+    if (!f) {
+        free(buf);
+        return ERR_FOPEN;
+    }
+    size_t n = fread(buf, 1, size, f);
+    fclose(f);
+    if (n != size) {
+        free(buf);
+        return ERR_FREAD;
+    }
+    const unsigned char* bufp = buf;
+    cl_program p = clCreateProgramWithBinary(
+        context, 1, &device, &size, &bufp, &status, NULL
+    );
+    free(buf);
+    if (p && status == CL_SUCCESS
+        && clBuildProgram(p, 1, &device, options, NULL, NULL) == CL_SUCCESS
+    ) {
+        *program = p;
+        return 0;
+    }
+
+    // the driver rejected it; remove it so it gets rebuilt
+    //
+    if (p) clReleaseProgram(p);
+    fprintf(stderr, "Discarding unusable OpenCL binary %s\n", path);
+    boinc_delete_file(path);
+    return ERR_NOT_FOUND;
+}
+
+static void save_cached_program(
+    cl_program program, const char* path
+) {
+    size_t size = 0;
+    char tmp_path[MAXPATHLEN];
+
+    if (clGetProgramInfo(
+        program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL
+    ) != CL_SUCCESS) return;
+    if (!size) return;
+    unsigned char* buf = (unsigned char*)malloc(size);
+    if (!buf) return;
+    if (clGetProgramInfo(
+        program, CL_PROGRAM_BINARIES, sizeof(buf), &buf, NULL
+    ) != CL_SUCCESS) {
+        free(buf);
+        return;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp%d", path, getpid());
+    FILE* f = boinc_fopen(tmp_path, "wb");
+    if (f) {
+        size_t n = fwrite(buf, 1, size, f);
+        if (fclose(f) || n != size || boinc_rename(tmp_path, path)) {
+            boinc_delete_file(tmp_path);
+        }
+    }
+    free(buf);
+}
+
+static int build_from_source(
+    cl_context context, cl_device_id device, const char* source,
+    const char* options, cl_program* program
+) {
+    cl_int status;
+
+    cl_program p = clCreateProgramWithSource(
+        context, 1, &source, NULL, &status
+    );
+    if (!p) return status;
+    status = clBuildProgram(p, 1, &device, options, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        clReleaseProgram(p);
+        return status;
+    }
+    *program = p;
+    return 0;
+}
+
+// Build an OpenCL program for a single device,
+// using a binary cached by a previous task if there is one.
+// name identifies the program within the app;
+// it's used in the cache filename, so it should be a plain word.
+//
+// returns
+// - 0 if success
+// - an OpenCL error number if the program couldn't be built from source
+//
+int boinc_opencl_build_program(
+    cl_context context, cl_device_id device, const char* name,
+    const char* source, const char* options, cl_program* program
+) {
+    char path[MAXPATHLEN], lock_path[MAXPATHLEN];
+    FILE_LOCK file_lock;
+    int retval;
+
+    if (program_cache_path(device, name, source, options, path, sizeof(path))) {
+        return build_from_source(context, device, source, options, program);
+    }
+    if (!load_cached_program(context, device, path, options, program)) {
+        return 0;
+    }
+
+    // If another task is compiling this program, wait for its binary.
+    //
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    for (int i=0; i<OPENCL_CACHE_WAIT; i++) {
+        if (!file_lock.lock(lock_path)) break;
+
+        // if we couldn't even create the lock file, don't wait
+        //
+        if (!boinc_file_exists(lock_path)) break;
+        boinc_sleep(1);
+        if (!load_cached_program(context, device, path, options, program)) {
+            return 0;
+        }
+    }
+
+    // Check again: the other task may have finished
+    // between our first look and getting the lock.
+    //
+    if (file_lock.locked
+        && !load_cached_program(context, device, path, options, program)
+    ) {
+        file_lock.unlock(lock_path);
+        return 0;
+    }
+    retval = build_from_source(context, device, source, options, program);
+    if (!retval) {
+        save_cached_program(*program, path);
+    }
+    if (file_lock.locked) {
+        file_lock.unlock(lock_path);
+    }
+    return retval;
+}
@@ -33,3 +33,14 @@ int boinc_get_opencl_ids(
 // doesn't work w/ pre-7 clients; use the above
 //
 int boinc_get_opencl_ids(cl_device_id* device, cl_platform_id* platform);
+
+// Build a program from source for the given device,
+// reusing a binary cached in the project's opencl_cache/ directory
+// by an earlier task if the app version, device name, driver version,
+// source and options all match.
+// Safe to call from several slots at once.
+//
+int boinc_opencl_build_program(
+    cl_context context, cl_device_id device, const char* name,
+    const char* source, const char* options, cl_program* program
+);
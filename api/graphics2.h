@@ -36,6 +36,37 @@ extern void* boinc_graphics_get_shmem(const char*);
 extern void boinc_set_windows_icon(const char* icon16,const char* icon48);
 extern void boinc_close_window_and_quit(const char*);
 
+// Buffered shared memory: the main app publishes snapshots
+// of a fixed-size struct; the graphics app reads the latest one.
+// Publishing never blocks, and readers always get a consistent copy.
+// The segment holds several copies, each with a sequence counter
+// that's odd while the copy is being written (a "seqlock").
+// There must be only one publishing thread.
+//
+// main app:
+//    void* p = boinc_graphics_make_buffered_shmem("myapp", sizeof(MY_DATA));
+//    ...
+//    boinc_graphics_publish(p, &my_data);
+// graphics app:
+//    void* p = boinc_graphics_get_buffered_shmem("myapp", sizeof(MY_DATA));
+//    ...
+//    if (!boinc_graphics_read(p, &my_data, generation)) ...
+//
+// boinc_graphics_get_buffered_shmem() returns NULL if the segment
+// doesn't exist or hasn't been set up yet; try again later.
+// boinc_graphics_read() returns ERR_NOT_FOUND if nothing
+// has been published yet, and ERR_RETRY if the data changed
+// too fast to get a consistent copy.
+// "generation" is incremented on each publish;
+// use it to tell whether a new snapshot is available.
+//
+extern void* boinc_graphics_make_buffered_shmem(const char*, int size);
+extern void* boinc_graphics_get_buffered_shmem(const char*, int size);
+extern int boinc_graphics_publish(void* shmem, const void* data);
+extern int boinc_graphics_read(
+    void* shmem, void* data, unsigned int& generation
+);
+
 // Implementation stuff
 //
 extern double boinc_max_fps;
@@ -28,6 +28,7 @@
 
 #include <cstring>
 #include "shmem.h"
+#include "error_numbers.h"
 #include "filesys.h"
 #include "app_ipc.h"
 #include "boinc_api.h"
@@ -108,3 +109,105 @@ void* boinc_graphics_get_shmem(const char* prog_name) {
     return p;
 }
 #endif
+
+// buffered shared memory; see graphics2.h
+
+#define GFX_SHMEM_MAGIC     0x62676678
+#define GFX_SHMEM_NBUFS     3
+#define GFX_SHMEM_HDR_SIZE  128
+#define GFX_READ_TRIES      100
+
+struct GFX_SHMEM_HDR {
+    int magic;      // set last, once the rest is initialized
+    int size;       // size of the data
+    int stride;     // distance between copies
+    volatile int latest;
+        // index of the most recently published copy; -1 if none
+    volatile unsigned int seq[GFX_SHMEM_NBUFS];
+        // odd while the copy is being written
+    volatile unsigned int generation[GFX_SHMEM_NBUFS];
+        // publish count as of each copy
+};
+
+static inline void gfx_memory_barrier() {
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+static inline char* gfx_buf(GFX_SHMEM_HDR* hp, int i) {
+    return (char*)hp + GFX_SHMEM_HDR_SIZE + i*hp->stride;
+}
+
+// round copies up to 8 bytes so each is aligned
+//
+static inline int gfx_buf_size(int size) {
+    return (size + 7) & ~7;
+}
+
+void* boinc_graphics_make_buffered_shmem(const char* prog_name, int size) {
+    int stride = gfx_buf_size(size);
+    GFX_SHMEM_HDR* hp = (GFX_SHMEM_HDR*)boinc_graphics_make_shmem(
+        prog_name, GFX_SHMEM_HDR_SIZE + GFX_SHMEM_NBUFS*stride
+    );
+    if (!hp) return 0;
+    memset(hp, 0, GFX_SHMEM_HDR_SIZE);
+    hp->size = size;
+    hp->stride = stride;
+    hp->latest = -1;
+    gfx_memory_barrier();
+    hp->magic = GFX_SHMEM_MAGIC;
+    return hp;
+}
+
+void* boinc_graphics_get_buffered_shmem(const char* prog_name, int size) {
+    GFX_SHMEM_HDR* hp = (GFX_SHMEM_HDR*)boinc_graphics_get_shmem(prog_name);
+    if (!hp) return 0;
+    if (hp->magic != GFX_SHMEM_MAGIC) return 0;
+    gfx_memory_barrier();
+    if (hp->size != size) return 0;
+    return hp;
+}
+
+// Write the copy after the latest one, so that a reader of the latest
+// copy is disturbed only if we publish twice during its read.
+//
+int boinc_graphics_publish(void* shmem, const void* data) {
+    GFX_SHMEM_HDR* hp = (GFX_SHMEM_HDR*)shmem;
+    int latest = hp->latest;
+    int i = (latest + 1) % GFX_SHMEM_NBUFS;
+    unsigned int gen = (latest < 0)?1:hp->generation[latest]+1;
+
+    hp->seq[i]++;
+    gfx_memory_barrier();
+    memcpy(gfx_buf(hp, i), data, hp->size);
+    hp->generation[i] = gen;
+    gfx_memory_barrier();
+    hp->seq[i]++;
+    gfx_memory_barrier();
+    hp->latest = i;
+    return 0;
+}
+
+int boinc_graphics_read(void* shmem, void* data, unsigned int& generation) {
+    GFX_SHMEM_HDR* hp = (GFX_SHMEM_HDR*)shmem;
+    unsigned int seq, gen;
+
+    for (int tries=0; tries<GFX_READ_TRIES; tries++) {
+        int i = hp->latest;
+        if (i < 0) return ERR_NOT_FOUND;
+        gfx_memory_barrier();
+        seq = hp->seq[i];
+        if (seq & 1) continue;
+        gfx_memory_barrier();
+        memcpy(data, gfx_buf(hp, i), hp->size);
+        gen = hp->generation[i];
+        gfx_memory_barrier();
+        if (hp->seq[i] != seq) continue;
+        generation = gen;
+        return 0;
+    }
+    return ERR_RETRY;
+}
@@ -35,6 +35,21 @@
 //     then draw the graph as vertical lines.
 //     If reduced in one dimension, draw vertical rectangles.
 //     Otherwise draw quadrilaterals.
+//
+// To pass the reduced array from the main app to the graphics app,
+// the main app calls make_shmem() once, and then
+// publish() after reducing an array (or part of one).
+// The graphics app gets it with boinc_graphics_get_buffered_shmem()
+// and boinc_graphics_read() (see graphics2.h)
+// into a REDUCED_ARRAY_DATA (e.g. a REDUCED_ARRAY_RENDER).
+// Reducing costs CPU time; to do it only as often as the graphics
+// can show it, reduce and publish only when publish_due() is true:
+//
+//     if (rag.publish_due()) {
+//         rag.init_data(nx, ny);
+//         for (i=0; i<ny; i++) rag.add_source_row(data+i*nx);
+//         rag.publish();
+//     }
 
 #ifndef REDUCE_H
 #define REDUCE_H
@@ -70,6 +85,9 @@ struct REDUCED_ARRAY_GEN: REDUCED_ARRAY_DATA {
     int last_ry_count;          // number of source rows accumulated so far
     int nvalid_rows;            // number of valid rows in reduced array
 	int reduce_method;			// Which method to use for data row reduction
+    void* shmem;                // buffered graphics shmem, if any
+    double publish_interval;
+    double last_publish_time;
 
     void init_data(int, int);
     void reduce_source_row(float*, float*);
@@ -77,6 +95,14 @@ struct REDUCED_ARRAY_GEN: REDUCED_ARRAY_DATA {
     bool full();
     void reset();
     void update_max(int row);
+
+    int make_shmem(const char* name, double max_fps=30);
+        // create buffered graphics shmem for the reduced array;
+        // publish at most max_fps times a second
+    bool publish_due();
+        // shmem exists and it's time to publish
+    int publish();
+        // copy the reduced array to shmem
 };
 
 // THE PART RELEVANT TO RENDERING FOLLOWS
@@ -36,8 +36,257 @@
 #include <algorithm>
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REDUCE_X86
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define REDUCE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "error_numbers.h"
+#include "graphics2.h"
+#include "util.h"
+
 #include "reduce.h"
 
+// Kernels for the inner loops:
+// the sum, min or max of a range of floats, and adding one row to another.
+// Each source row is reduced by applying these to the ranges
+// of source elements that go into each reduced element,
+// so they run over long contiguous ranges.
+// There are SSE, AVX and NEON versions;
+// the best one the CPU supports is chosen at run time.
+
+static float range_sum_scalar(const float* p, int n) {
+    float x = 0;
+    for (int i=0; i<n; i++) x += p[i];
+    return x;
+}
+
+static float range_min_scalar(const float* p, int n) {
+    float x = p[0];
+    for (int i=1; i<n; i++) if (p[i] < x) x = p[i];
+    return x;
+}
+
+static float range_max_scalar(const float* p, int n) {
+    float x = p[0];
+    for (int i=1; i<n; i++) if (p[i] > x) x = p[i];
+    return x;
+}
+
+static void add_row_scalar(float* dst, const float* src, int n) {
+    for (int i=0; i<n; i++) dst[i] += src[i];
+}
+
+#ifdef REDUCE_X86
+__attribute__((target("sse")))
+static float hsum_sse(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse")))
+static float range_sum_sse(const float* p, int n) {
+    __m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+    int i;
+    for (i=0; i+8<=n; i+=8) {
+        a = _mm_add_ps(a, _mm_loadu_ps(p+i));
+        b = _mm_add_ps(b, _mm_loadu_ps(p+i+4));
+    }
+    float x = hsum_sse(_mm_add_ps(a, b));
+    for (; i<n; i++) x += p[i];
+    return x;
+}
+
+__attribute__((target("sse")))
+static float range_min_sse(const float* p, int n) {
+    if (n < 4) return range_min_scalar(p, n);
+    __m128 a = _mm_loadu_ps(p);
+    int i;
+    for (i=4; i+4<=n; i+=4) {
+        a = _mm_min_ps(a, _mm_loadu_ps(p+i));
+    }
+    a = _mm_min_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_min_ss(a, _mm_shuffle_ps(a, a, 1));
+    float x = _mm_cvtss_f32(a);
+    for (; i<n; i++) if (p[i] < x) x = p[i];
+    return x;
+}
+
+__attribute__((target("sse")))
+static float range_max_sse(const float* p, int n) {
+    if (n < 4) return range_max_scalar(p, n);
+    __m128 a = _mm_loadu_ps(p);
+    int i;
+    for (i=4; i+4<=n; i+=4) {
+        a = _mm_max_ps(a, _mm_loadu_ps(p+i));
+    }
+    a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_max_ss(a, _mm_shuffle_ps(a, a, 1));
+    float x = _mm_cvtss_f32(a);
+    for (; i<n; i++) if (p[i] > x) x = p[i];
+    return x;
+}
+
+__attribute__((target("sse")))
+static void add_row_sse(float* dst, const float* src, int n) {
+    int i;
+    for (i=0; i+4<=n; i+=4) {
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i), _mm_loadu_ps(src+i)));
+    }
+    for (; i<n; i++) dst[i] += src[i];
+}
+
+__attribute__((target("avx")))
+static float range_sum_avx(const float* p, int n) {
+    __m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+    int i;
+    for (i=0; i+16<=n; i+=16) {
+        a = _mm256_add_ps(a, _mm256_loadu_ps(p+i));
+        b = _mm256_add_ps(b, _mm256_loadu_ps(p+i+8));
+    }
+    a = _mm256_add_ps(a, b);
+    __m128 v = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    float x = _mm_cvtss_f32(v);
+    for (; i<n; i++) x += p[i];
+    return x;
+}
+
+__attribute__((target("avx")))
+static float range_min_avx(const float* p, int n) {
+    if (n < 8) return range_min_sse(p, n);
+    __m256 a = _mm256_loadu_ps(p);
+    int i;
+    for (i=8; i+8<=n; i+=8) {
+        a = _mm256_min_ps(a, _mm256_loadu_ps(p+i));
+    }
+    __m128 v = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+    float x = _mm_cvtss_f32(v);
+    for (; i<n; i++) if (p[i] < x) x = p[i];
+    return x;
+}
+
+__attribute__((target("avx")))
+static float range_max_avx(const float* p, int n) {
+    if (n < 8) return range_max_sse(p, n);
+    __m256 a = _mm256_loadu_ps(p);
+    int i;
+    for (i=8; i+8<=n; i+=8) {
+        a = _mm256_max_ps(a, _mm256_loadu_ps(p+i));
+    }
+    __m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    float x = _mm_cvtss_f32(v);
+    for (; i<n; i++) if (p[i] > x) x = p[i];
+    return x;
+}
+
+__attribute__((target("avx")))
+static void add_row_avx(float* dst, const float* src, int n) {
+    int i;
+    for (i=0; i+8<=n; i+=8) {
+        _mm256_storeu_ps(dst+i,
+            _mm256_add_ps(_mm256_loadu_ps(dst+i), _mm256_loadu_ps(src+i))
+        );
+    }
+    for (; i<n; i++) dst[i] += src[i];
+}
+#endif
+
+#ifdef REDUCE_NEON
+static float range_sum_neon(const float* p, int n) {
+    float32x4_t a = vdupq_n_f32(0), b = vdupq_n_f32(0);
+    int i;
+    for (i=0; i+8<=n; i+=8) {
+        a = vaddq_f32(a, vld1q_f32(p+i));
+        b = vaddq_f32(b, vld1q_f32(p+i+4));
+    }
+    float x = vaddvq_f32(vaddq_f32(a, b));
+    for (; i<n; i++) x += p[i];
+    return x;
+}
+
+static float range_min_neon(const float* p, int n) {
+    if (n < 4) return range_min_scalar(p, n);
+    float32x4_t a = vld1q_f32(p);
+    int i;
+    for (i=4; i+4<=n; i+=4) {
+        a = vminq_f32(a, vld1q_f32(p+i));
+    }
+    float x = vminvq_f32(a);
+    for (; i<n; i++) if (p[i] < x) x = p[i];
+    return x;
+}
+
+static float range_max_neon(const float* p, int n) {
+    if (n < 4) return range_max_scalar(p, n);
+    float32x4_t a = vld1q_f32(p);
+    int i;
+    for (i=4; i+4<=n; i+=4) {
+        a = vmaxq_f32(a, vld1q_f32(p+i));
+    }
+    float x = vmaxvq_f32(a);
+    for (; i<n; i++) if (p[i] > x) x = p[i];
+    return x;
+}
+
+static void add_row_neon(float* dst, const float* src, int n) {
+    int i;
+    for (i=0; i+4<=n; i+=4) {
+        vst1q_f32(dst+i, vaddq_f32(vld1q_f32(dst+i), vld1q_f32(src+i)));
+    }
+    for (; i<n; i++) dst[i] += src[i];
+}
+#endif
+
+static float (*range_sum)(const float*, int);
+static float (*range_min)(const float*, int);
+static float (*range_max)(const float*, int);
+static void (*add_row)(float*, const float*, int);
+
+// choose the kernels.
+// It doesn't matter if two threads do this at once
+//
+static void choose_kernels() {
+    if (range_sum) return;
+    range_min = range_min_scalar;
+    range_max = range_max_scalar;
+    add_row = add_row_scalar;
+#ifdef REDUCE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        range_min = range_min_avx;
+        range_max = range_max_avx;
+        add_row = add_row_avx;
+        range_sum = range_sum_avx;
+        return;
+    } else if (__builtin_cpu_supports("sse")) {
+        range_min = range_min_sse;
+        range_max = range_max_sse;
+        add_row = add_row_sse;
+        range_sum = range_sum_sse;
+        return;
+    }
+#endif
+#ifdef REDUCE_NEON
+    range_min = range_min_neon;
+    range_max = range_max_neon;
+    add_row = add_row_neon;
+    range_sum = range_sum_neon;
+    return;
+#endif
+    range_sum = range_sum_scalar;
+}
+
 // Prepare to receive a source array.
 // (sx, sy) are dimensions of source array
 //
@@ -58,6 +307,7 @@ void REDUCED_ARRAY_GEN::init_data(int sx, int sy) {
     last_ry_count = 0;
     rdata_max = 0;
     rdata_min = (float)1e20;
+    choose_kernels();
 }
 
 bool REDUCED_ARRAY_GEN::full() {
@@ -76,45 +326,45 @@ void REDUCED_ARRAY_GEN::reset() {
 
 
 // reduce a single row.  This is called only if sdimx > rdimx;
+// Source element i goes into reduced element (i*rdimx)/sdimx,
+// so reduced element ri gets the range starting at
+// ceil(ri*sdimx/rdimx).
 //
 void REDUCED_ARRAY_GEN::reduce_source_row(float* in, float* out) {
-    int i, ri;
+    int ri, start, end, n;
 
-    memset(out, 0, rdimx*sizeof(float));
-    memset(itemp, 0, rdimx*sizeof(int));
-    for (i=0; i<sdimx; i++) {
-        ri = (i*rdimx)/sdimx;
+    start = 0;
+    for (ri=0; ri<rdimx; ri++) {
+        end = (int)(((long long)(ri+1)*sdimx + rdimx - 1)/rdimx);
+        n = end - start;
         switch (reduce_method) {
         case REDUCE_METHOD_AVG:
-            out[ri] += in[i];
-            itemp[ri]++;
+            out[ri] = range_sum(in+start, n)/n;
             break;
         case REDUCE_METHOD_SUM:
-            out[ri] += in[i];
+            out[ri] = range_sum(in+start, n);
             break;
         case REDUCE_METHOD_MIN:
-            out[ri] = std::min(out[ri], in[i]);
+            out[ri] = range_min(in+start, n);
             break;
         case REDUCE_METHOD_MAX:
-            out[ri] = std::max(out[ri], in[i]);
+            out[ri] = range_max(in+start, n);
             break;
+        default:
+            out[ri] = 0;
         }
-    }
-    if (reduce_method==REDUCE_METHOD_AVG) {
-        for (i=0; i<rdimx; i++) {
-            if (itemp[i] > 1) out[i] /= itemp[i];
-        }
+        start = end;
     }
 }
 
 void REDUCED_ARRAY_GEN::update_max(int row) {
-    int i;
     float* p = rrow(row);
+    float x;
 
-    for (i=0; i<rdimx; i++) {
-        if (p[i] > rdata_max) rdata_max = p[i];
-        if (p[i] < rdata_min) rdata_min = p[i];
-    }
+    x = range_max(p, rdimx);
+    if (x > rdata_max) rdata_max = x;
+    x = range_min(p, rdimx);
+    if (x < rdata_min) rdata_min = x;
 }
 
 // Add a row of data from the source array
@@ -161,14 +411,10 @@ void REDUCED_ARRAY_GEN::add_source_row(float* in) {
         last_ry_count++;
         p = rrow(ry);
         if (rdimx == sdimx) {
-            for (i=0; i<sdimx; i++) {
-                p[i] += in[i];
-            }
+            add_row(p, in, sdimx);
         } else {
             reduce_source_row(in, ftemp);
-            for (i=0; i<rdimx; i++) {
-                p[i] += ftemp[i];
-            }
+            add_row(p, ftemp, rdimx);
         }
 
         // if this is last row, finish up
@@ -187,3 +433,25 @@ void REDUCED_ARRAY_GEN::add_source_row(float* in) {
     scury++;
 }
 
+int REDUCED_ARRAY_GEN::make_shmem(const char* name, double max_fps) {
+    shmem = boinc_graphics_make_buffered_shmem(
+        name, sizeof(REDUCED_ARRAY_DATA)
+    );
+    if (!shmem) return ERR_SHMGET;
+    publish_interval = max_fps>0?1/max_fps:0;
+    last_publish_time = 0;
+    return 0;
+}
+
+bool REDUCED_ARRAY_GEN::publish_due() {
+    if (!shmem) return false;
+    return dtime() - last_publish_time >= publish_interval;
+}
+
+int REDUCED_ARRAY_GEN::publish() {
+    if (!shmem) return ERR_NULL;
+    last_publish_time = dtime();
+    return boinc_graphics_publish(
+        shmem, static_cast<REDUCED_ARRAY_DATA*>(this)
+    );
+}
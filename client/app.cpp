@@ -65,6 +65,7 @@
 #include "async_file.h"
 #include "client_msgs.h"
 #include "client_state.h"
+#include "cs_trickle.h"
 #include "procinfo.h"
 #include "result.h"
 #include "sandbox.h"
@@ -133,6 +134,15 @@ ACTIVE_TASK::ACTIVE_TASK() {
     strcpy(remote_desktop_addr, "");
     async_copy = NULL;
     finish_file_time = 0;
+    restart_time = 0;
+    restart_nbytes = 0;
+    restart_cpu_time = 0;
+    restart_fraction_done = 0;
+    first_time = false;
+    slot_nbytes = 0;
+#ifdef __linux__
+    affinity_applied = false;
+#endif
 }
 
 // preempt this task;
@@ -232,6 +242,9 @@ void ACTIVE_TASK::cleanup_task() {
         app_client_shm.shm = NULL;
         gstate.retry_shmem_time = 0;
     }
+#ifdef __linux__
+    cgroup.remove();
+#endif
 #endif
 
     if (config.exit_after_finish) {
@@ -298,11 +311,31 @@ void procinfo_show(PROCINFO& pi, PROC_MAP& pm) {
 }
 #endif
 
+#ifdef __linux__
+// On Linux we can usually avoid scanning all processes,
+// which is expensive on hosts with thousands of them.
+// We need the full scan if we have to look for exclusive apps,
+// or if there's a VM app (the VirtualBox service processes
+// aren't our descendants, but we don't count them as non-BOINC).
+//
+static bool need_full_proc_scan(vector<ACTIVE_TASK*>& tasks) {
+    if (config.exclusive_apps.size()) return true;
+    if (config.exclusive_gpu_apps.size()) return true;
+    for (unsigned int i=0; i<tasks.size(); i++) {
+        if (tasks[i]->app_version->is_vm_app) return true;
+    }
+    return false;
+}
+#endif
+
 // scan the set of all processes to
 // 1) get the working-set size of active tasks
 // 2) see if exclusive apps are running
 // 3) get CPU time of non-BOINC processes
 //
+// On Linux, if possible, scan only the client and its descendants
+// (plus other_pids), and get the non-BOINC CPU time from /proc/stat.
+//
 void ACTIVE_TASK_SET::get_memory_usage() {
     static double last_mem_time=0;
     unsigned int i;
@@ -325,6 +358,27 @@ void ACTIVE_TASK_SET::get_memory_usage() {
 
     last_mem_time = gstate.now;
     PROC_MAP pm;
+#ifdef __linux__
+    static bool last_tasks_only = false;
+    bool tasks_only = false;
+    if (!need_full_proc_scan(active_tasks)) {
+        vector<int> pids;
+        pids.push_back(getpid());
+        for (i=0; i<active_tasks.size(); i++) {
+            ACTIVE_TASK* atp = active_tasks[i];
+            for (unsigned int j=0; j<atp->other_pids.size(); j++) {
+                pids.push_back(atp->other_pids[j]);
+            }
+        }
+        retval = procinfo_setup_tasks(pm, pids);
+        if (retval == ERR_NOT_FOUND) {
+            pm.clear();
+        } else {
+            tasks_only = true;
+        }
+    }
+    if (!tasks_only)
+#endif
     retval = procinfo_setup(pm);
     if (retval) {
         if (log_flags.mem_usage_debug) {
@@ -355,6 +409,12 @@ void ACTIVE_TASK_SET::get_memory_usage() {
             v = &(atp->other_pids);
         }
         procinfo_app(pi, v, pm, atp->app_version->graphics_exec_file);
+#ifdef __linux__
+        double mem;
+        if (tasks_only && !procinfo_cgroup_memory(atp->pid, pm, mem)) {
+            pi.working_set_size = mem;
+        }
+#endif
         if (atp->app_version->is_vm_app) {
             // the memory of virtual machine apps is not reported correctly,
             // at least on Windows.  Use the VM size instead.
@@ -403,6 +463,11 @@ void ACTIVE_TASK_SET::get_memory_usage() {
     //
     PROCINFO pi;
     //procinfo_show(pi, pm);
+#ifdef __linux__
+    if (tasks_only) {
+        procinfo_non_boinc_tasks(pi, pm);
+    } else
+#endif
     procinfo_non_boinc(pi, pm);
     if (log_flags.mem_usage_debug) {
         msg_printf(NULL, MSG_INFO,
@@ -412,6 +477,14 @@ void ACTIVE_TASK_SET::get_memory_usage() {
         );
     }
     double new_cpu_time = pi.user_time + pi.kernel_time;
+#ifdef __linux__
+    // the two ways of getting non-BOINC CPU time aren't comparable
+    //
+    if (tasks_only != last_tasks_only) {
+        last_tasks_only = tasks_only;
+        first = true;
+    }
+#endif
     if (!first) {
         non_boinc_cpu_usage = (new_cpu_time - last_cpu_time)/(diff*gstate.host_info.p_ncpus);
         // processes might have exited in the last 10 sec,
@@ -430,26 +503,21 @@ void ACTIVE_TASK_SET::get_memory_usage() {
 #endif
 
 // There's a new trickle file.
-// Move it from slot dir to project dir
+// Add it to the project's trickle spool, and remove it from the slot dir
 //
 int ACTIVE_TASK::move_trickle_file() {
-    char new_path[MAXPATHLEN], old_path[MAXPATHLEN];
+    char path[MAXPATHLEN];
+    char* msg;
     int retval;
 
-    sprintf(old_path, "%s/trickle_up.xml", slot_dir);
-    sprintf(new_path,
-        "%s/trickle_up_%s_%d.xml",
-        result->project->project_dir(), result->name, (int)time(0)
-    );
-    retval = boinc_rename(old_path, new_path);
-
-    // if can't move it, remove
-    //
-    if (retval) {
-        delete_project_owned_file(old_path, true);
-        return ERR_RENAME;
+    sprintf(path, "%s/trickle_up.xml", slot_dir);
+    retval = read_file_malloc(path, msg);
+    if (!retval) {
+        retval = add_trickle_up(result->project, result->name, (int)time(0), msg);
+        free(msg);
     }
-    return 0;
+    delete_project_owned_file(path, true);
+    return retval;
 }
 
 // size of output files and files in slot dir
@@ -461,7 +529,7 @@ int ACTIVE_TASK::current_disk_usage(double& size) {
     FILE_INFO* fip;
     char path[MAXPATHLEN];
 
-    retval = dir_size(slot_dir, size);
+    retval = slot_watch.get_size(slot_dir, size);
     if (retval) return retval;
     for (i=0; i<result->output_files.size(); i++) {
         fip = result->output_files[i].file_info;
@@ -578,6 +646,7 @@ int ACTIVE_TASK::write(MIOFILE& fout) {
         procinfo.working_set_size_smoothed,
         procinfo.page_fault_rate
     );
+    perf_counts.write(fout);
     fout.printf("</active_task>\n");
     return 0;
 }
@@ -618,6 +687,7 @@ int ACTIVE_TASK::write_gui(MIOFILE& fout) {
         too_large?"   <too_large/>\n":"",
         needs_shmem?"   <needs_shmem/>\n":""
     );
+    perf_counts.write(fout, true);
     if (strlen(app_version->graphics_exec_path)) {
         fout.printf(
             "   <graphics_exec_path>%s</graphics_exec_path>\n"
@@ -747,6 +817,10 @@ int ACTIVE_TASK::parse(XML_PARSER& xp) {
         else if (xp.parse_double("working_set_size_smoothed", procinfo.working_set_size_smoothed)) continue;
         else if (xp.parse_double("page_fault_rate", procinfo.page_fault_rate)) continue;
         else if (xp.parse_double("current_cpu_time", x)) continue;
+        else if (perf_counts.parse(xp)) {
+            perf.base = perf_counts;
+            continue;
+        }
         else {
             if (log_flags.unparsed_xml) {
                 msg_printf(project, MSG_INFO,
@@ -816,8 +890,18 @@ void MSG_QUEUE::init(char* n) {
     msgs.clear();
 }
 
-void MSG_QUEUE::msg_queue_send(const char* msg, MSG_CHANNEL& channel) {
-    if ((msgs.size()==0) && channel.send_msg(msg)) {
+void MSG_QUEUE::msg_queue_send(
+    const char* msg, MSG_CHANNEL& channel, MSG_RING* ring
+) {
+    bool sent;
+    if (msgs.size()) {
+        sent = false;
+    } else if (ring) {
+        sent = ring->send_msg(msg);
+    } else {
+        sent = channel.send_msg(msg);
+    }
+    if (sent) {
         if (log_flags.app_msg_send) {
             msg_printf(NULL, MSG_INFO,
                 "[app_msg_send] sent %s to %s", msg, name
@@ -835,7 +919,10 @@ void MSG_QUEUE::msg_queue_send(const char* msg, MSG_CHANNEL& channel) {
     if (!last_block) last_block = gstate.now;
 }
 
-void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
+// With a ring, send as many queued messages as will fit;
+// with a channel, just one.
+//
+void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel, MSG_RING* ring) {
     if (msgs.empty()) return;
     if (log_flags.app_msg_send) {
         msg_printf(NULL, MSG_INFO,
@@ -843,7 +930,14 @@ void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
             (int)msgs.size(), name
         );
     }
-    if (channel.send_msg(msgs[0].c_str())) {
+    while (msgs.size()) {
+        bool sent;
+        if (ring) {
+            sent = ring->send_msg(msgs[0].c_str());
+        } else {
+            sent = channel.send_msg(msgs[0].c_str());
+        }
+        if (!sent) break;
         if (log_flags.app_msg_send) {
             msg_printf(NULL, MSG_INFO,
                 "[app_msg_send] poll: delayed sent %s", msgs[0].c_str()
@@ -851,6 +945,7 @@ void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
         }
         msgs.erase(msgs.begin());
         last_block = 0;
+        if (!ring) break;
     }
     for (unsigned int i=0; i<msgs.size(); i++) {
         if (log_flags.app_msg_send) {
@@ -931,7 +1026,9 @@ int ACTIVE_TASK::handle_upload_files() {
                     fip->status = retval;
                 } else {
                     fip->status = FILE_PRESENT;
+                    fip->project->add_project_dir_size(fip->nbytes);
                 }
+                gstate.set_poll_flags(POLL_FLAG_PFX);
             } else {
                 msg_printf(wup->project, MSG_INTERNAL_ERROR,
                     "Can't find uploadable file %s", p
@@ -28,6 +28,12 @@
 #include "procinfo.h"
 
 #include "client_types.h"
+#include "dir_watch.h"
+#include "perf_counters.h"
+#ifdef __linux__
+#include "cgroup.h"
+#include "cpu_affinity.h"
+#endif
 
 #define ABORT_TIMEOUT   15
     // if we send app <abort> request, wait this long before killing it.
@@ -36,6 +42,24 @@
 #define QUIT_TIMEOUT    15
     // Same, for <quit>.
 
+// Restarting a task from a checkpoint means reading its slot dir
+// (checkpoint and temp files, possibly GBs).
+// After a reboot, many tasks restart at once, and they all wait for disk.
+// So we limit the bytes being read by restarting tasks
+// to what the disk can read in RESTART_WINDOW seconds,
+// at the rate measured from earlier restarts.
+//
+#define RESTART_WINDOW          10
+#define RESTART_DEFAULT_RATE    100e6
+    // bytes/sec, until we've measured it
+#define RESTART_DONE_CPU        2
+    // a restarting task is done reading when it's used this much CPU time
+    // (or its fraction done has increased)
+#define RESTART_MAX_TIME        300
+    // or when it's been this long
+#define RESTART_MIN_NBYTES      10e6
+    // use only restarts at least this big to measure the rate
+
 // values for preempt_type
 //
 #define REMOVE_NEVER        0
@@ -91,6 +115,8 @@ struct ACTIVE_TASK {
     double current_cpu_time;
         // most recent CPU time reported by app
     bool once_ran_edf;
+    PERF_COUNTS perf_counts;
+        // hardware event counts, if <perf_counters>
 
     // END OF ITEMS SAVED IN STATE FILE
 
@@ -159,6 +185,31 @@ struct ACTIVE_TASK {
     double finish_file_time;
         // time when we saw finish file in slot dir.
         // Used to kill apps that hang after writing finished file
+    DIR_WATCH slot_watch;
+        // the size of the slot dir, rescanned only if it changes
+    PERF_COUNTERS perf;
+        // counters of the running process
+    double restart_time;
+        // if nonzero, the task was restarted from a checkpoint then,
+        // and may still be reading it
+    double restart_nbytes;
+        // the size of its slot dir then
+    double restart_cpu_time;
+    double restart_fraction_done;
+        // its CPU time and fraction done then
+
+    // temporaries used in enforce_run_list()
+    bool first_time;
+    double slot_nbytes;
+#ifdef __linux__
+    TASK_CGROUP cgroup;
+        // if active, used to suspend, throttle and limit the task
+        // instead of process-control messages
+    std::vector<int> affinity;
+        // the CPUs the task is placed on (empty: any)
+    bool affinity_applied;
+        // affinity has been set for the task's processes
+#endif
 
     void set_task_state(int, const char*);
     inline int task_state() {
@@ -274,6 +325,16 @@ class ACTIVE_TASK_SET {
 public:
     typedef std::vector<ACTIVE_TASK*> active_tasks_v;
     active_tasks_v active_tasks;
+    double restart_disk_rate;
+        // bytes/sec read by restarting tasks, from earlier restarts;
+        // 0 if not measured yet
+    bool restart_deferred;
+        // a restart was deferred; reschedule when one finishes
+
+    ACTIVE_TASK_SET() {
+        restart_disk_rate = 0;
+        restart_deferred = false;
+    }
     ACTIVE_TASK* lookup_pid(int);
     ACTIVE_TASK* lookup_result(RESULT*);
     void init();
@@ -289,7 +350,15 @@ public:
     void get_msgs();
     bool check_app_exited();
     bool check_rsc_limits_exceeded();
+    void update_perf_counts();
+#ifdef __linux__
+    void update_cgroups();
+    void update_affinity();
+#endif
     bool check_quit_timeout_exceeded();
+    bool restart_ok(double nbytes);
+    void note_restart(ACTIVE_TASK*);
+    void check_restarts();
     bool is_slot_in_use(int);
     bool is_slot_dir_in_use(char*);
     void send_heartbeats();
@@ -37,6 +37,11 @@ int APP_CONFIG::parse(XML_PARSER& xp, PROJECT* p) {
             if (max_concurrent) have_max_concurrent = true;
             continue;
         }
+        bool btemp;
+        if (xp.parse_bool("mem_heavy", btemp)) {
+            mem_heavy = btemp?1:-1;
+            continue;
+        }
         if (xp.match_tag("gpu_versions")) {
             while (!xp.get_tag()) {
                 if (xp.match_tag("/gpu_versions")) break;
@@ -133,6 +138,7 @@ void APP_CONFIGS::config_app_versions(PROJECT* p, bool show_warnings) {
             continue;
         }
         app->max_concurrent = ac.max_concurrent;
+        app->mem_heavy = ac.mem_heavy;
         if (!ac.gpu_gpu_usage || !ac.gpu_cpu_usage) continue;
         for (unsigned int j=0; j<gstate.app_versions.size(); j++) {
             APP_VERSION* avp = gstate.app_versions[j];
@@ -173,7 +179,7 @@ void max_concurrent_init() {
 }
 
 // undo the effects of an app_config.xml that no longer exists
-// NOTE: all we can do here is to clear APP::max_concurrent;
+// NOTE: all we can do here is to clear APP::max_concurrent and mem_heavy;
 // we can't restore device usage info because we don't have it.
 // It will be restored on next scheduler RPC.
 //
@@ -182,6 +188,7 @@ static void clear_app_config(PROJECT* p) {
         APP* app = gstate.apps[i];
         if (app->project != p) continue;
         app->max_concurrent = 0;
+        app->mem_heavy = 0;
     }
 }
 
@@ -30,6 +30,8 @@ struct RESULT;
 struct APP_CONFIG {
     char name[256];
     int max_concurrent;
+    int mem_heavy;
+        // see APP::mem_heavy
     double gpu_gpu_usage;
     double gpu_cpu_usage;
 
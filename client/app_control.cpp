@@ -68,6 +68,7 @@ using std::vector;
 #include "str_util.h"
 #include "util.h"
 
+#include "async_file.h"
 #include "client_msgs.h"
 #include "client_state.h"
 #include "file_names.h"
@@ -94,7 +95,15 @@ bool ACTIVE_TASK_SET::poll() {
     send_trickle_downs();
     process_control_poll();
     action |= check_rsc_limits_exceeded();
+    if (config.perf_counters) {
+        update_perf_counts();
+    }
+#ifdef __linux__
+    update_cgroups();
+    update_affinity();
+#endif
     get_msgs();
+    check_restarts();
     for (i=0; i<active_tasks.size(); i++) {
         ACTIVE_TASK* atp = active_tasks[i];
         if (atp->task_state() == PROCESS_ABORT_PENDING) {
@@ -141,7 +150,7 @@ bool ACTIVE_TASK_SET::poll() {
         }
     }
     if (action) {
-        gstate.set_client_state_dirty("ACTIVE_TASK_SET::poll");
+        gstate.set_client_state_dirty("ACTIVE_TASK_SET::poll", true);
     }
 
     return action;
@@ -182,10 +191,14 @@ bool ACTIVE_TASK::kill_all_children() {
 // Send a quit message, start timer, get descendants
 //
 int ACTIVE_TASK::request_exit() {
+#ifdef __linux__
+    if (cgroup.frozen) cgroup.freeze(false);
+#endif
     if (app_client_shm.shm) {
         process_control_queue.msg_queue_send(
             "<quit/>",
-            app_client_shm.shm->process_control_request
+            app_client_shm.shm->process_control_request,
+            app_client_shm.process_control_ring()
         );
     }
     set_task_state(PROCESS_QUIT_PENDING, "request_exit()");
@@ -197,10 +210,14 @@ int ACTIVE_TASK::request_exit() {
 // Send an abort message, start timer, get descendants
 //
 int ACTIVE_TASK::request_abort() {
+#ifdef __linux__
+    if (cgroup.frozen) cgroup.freeze(false);
+#endif
     if (app_client_shm.shm) {
         process_control_queue.msg_queue_send(
             "<abort/>",
-            app_client_shm.shm->process_control_request
+            app_client_shm.shm->process_control_request,
+            app_client_shm.process_control_ring()
         );
     }
     set_task_state(PROCESS_ABORT_PENDING, "request_abort");
@@ -374,7 +391,7 @@ void ACTIVE_TASK::handle_temporary_exit(
         }
         will_restart = true;
         result->schedule_backoff = gstate.now + backoff;
-        safe_strcpy(result->schedule_backoff_reason, reason);
+        result->schedule_backoff_reason = reason;
         set_task_state(PROCESS_UNINITIALIZED, "handle_temporary_exit");
     }
 }
@@ -408,6 +425,9 @@ void ACTIVE_TASK::handle_exited_app(int stat) {
     get_trickle_up_msg();
     result->final_cpu_time = current_cpu_time;
     result->final_elapsed_time = elapsed_time;
+    perf.close();
+    perf.read(perf_counts);
+    result->perf_counts = perf_counts;
 
     // if an abort or quit is pending,
     // the process may have exited itself, or we may have killed it.
@@ -489,7 +509,7 @@ void ACTIVE_TASK::handle_exited_app(int stat) {
                 set_task_state(PROCESS_UNINITIALIZED, "temporary exit");
                 will_restart = true;
                 result->schedule_backoff = gstate.now + x;
-                safe_strcpy(result->schedule_backoff_reason, buf);
+                result->schedule_backoff_reason = buf;
             } else {
                 if (log_flags.task_debug) {
                     msg_printf(result->project, MSG_INFO,
@@ -568,7 +588,7 @@ void ACTIVE_TASK::handle_exited_app(int stat) {
                 "read_stderr_file(): %s", boincerror(retval)
             );
         }
-        client_clean_out_dir(slot_dir, "handle_exited_app()");
+        async_delete_dir(slot_dir, "handle_exited_app()");
         clear_schedule_backoffs(this);
             // clear scheduling backoffs of jobs waiting for GPU
     }
@@ -680,7 +700,8 @@ void ACTIVE_TASK_SET::process_control_poll() {
             atp->kill_task(true);
         } else {
             atp->process_control_queue.msg_queue_poll(
-                atp->app_client_shm.shm->process_control_request
+                atp->app_client_shm.shm->process_control_request,
+                atp->app_client_shm.process_control_ring()
             );
         }
     }
@@ -772,6 +793,74 @@ bool ACTIVE_TASK::check_max_disk_exceeded() {
     return false;
 }
 
+// can we restart a task whose slot dir has the given size?
+// Yes if no restarts are in progress, or if the bytes they and it
+// are reading can be read in RESTART_WINDOW seconds.
+//
+bool ACTIVE_TASK_SET::restart_ok(double nbytes) {
+    double in_progress = 0;
+    bool any = false;
+    for (unsigned int i=0; i<active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = active_tasks[i];
+        if (!atp->restart_time) continue;
+        in_progress += atp->restart_nbytes;
+        any = true;
+    }
+    if (!any) return true;
+    double rate = restart_disk_rate?restart_disk_rate:RESTART_DEFAULT_RATE;
+    return in_progress + nbytes <= rate*RESTART_WINDOW;
+}
+
+void ACTIVE_TASK_SET::note_restart(ACTIVE_TASK* atp) {
+    atp->restart_time = gstate.now;
+    atp->restart_nbytes = atp->slot_nbytes;
+    atp->restart_cpu_time = atp->current_cpu_time;
+    atp->restart_fraction_done = atp->fraction_done;
+}
+
+// see which restarting tasks are done reading their checkpoints,
+// and update the measured disk rate
+//
+void ACTIVE_TASK_SET::check_restarts() {
+    bool done_any = false;
+    for (unsigned int i=0; i<active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = active_tasks[i];
+        if (!atp->restart_time) continue;
+        double dt = gstate.now - atp->restart_time;
+        bool measured = false;
+        if (atp->task_state() == PROCESS_EXECUTING) {
+            if (atp->current_cpu_time - atp->restart_cpu_time >= RESTART_DONE_CPU
+                || atp->fraction_done > atp->restart_fraction_done
+            ) {
+                measured = true;
+            } else if (dt < RESTART_MAX_TIME) {
+                continue;
+            }
+        }
+        if (measured && atp->restart_nbytes >= RESTART_MIN_NBYTES && dt > 0) {
+            double rate = atp->restart_nbytes/dt;
+            if (restart_disk_rate) {
+                restart_disk_rate = .7*restart_disk_rate + .3*rate;
+            } else {
+                restart_disk_rate = rate;
+            }
+        }
+        if (log_flags.cpu_sched_debug) {
+            msg_printf(atp->result->project, MSG_INFO,
+                "[cpu_sched_debug] %s restarted (%.2f MB in %.1f sec); disk rate %.2f MB/sec",
+                atp->result->name, atp->restart_nbytes/MEGA, dt,
+                restart_disk_rate/MEGA
+            );
+        }
+        atp->restart_time = 0;
+        done_any = true;
+    }
+    if (done_any && restart_deferred) {
+        restart_deferred = false;
+        gstate.request_schedule_cpus("task restart done");
+    }
+}
+
 // Check if any of the active tasks have exceeded their
 // resource limits on disk, CPU time or memory
 //
@@ -832,6 +921,52 @@ bool ACTIVE_TASK_SET::check_rsc_limits_exceeded() {
     return did_anything;
 }
 
+// read the hardware counters of running tasks,
+// and update the memory traffic estimates of their app versions
+//
+#define MEM_BW_MIN_CPU_TIME 60
+
+void ACTIVE_TASK_SET::update_perf_counts() {
+    for (unsigned int i=0; i<active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = active_tasks[i];
+        if (!atp->process_exists()) continue;
+        atp->perf.read(atp->perf_counts);
+        if (atp->task_state() != PROCESS_EXECUTING) continue;
+        if (atp->current_cpu_time < MEM_BW_MIN_CPU_TIME) continue;
+        double x = atp->perf_counts.mem_bytes()/atp->current_cpu_time;
+        if (!x) continue;
+        APP_VERSION* avp = atp->app_version;
+        avp->mem_bw = avp->mem_bw?(.99*avp->mem_bw + .01*x):x;
+    }
+}
+
+#ifdef __linux__
+// Set the CPU and memory limits of tasks with cgroups.
+// This only writes to the cgroup files if a limit has changed.
+//
+void ACTIVE_TASK_SET::update_cgroups() {
+    if (!cgroup_enabled()) return;
+    double max_ram = gstate.max_available_ram();
+    double limit = gstate.global_prefs.cpu_usage_limit;
+    for (unsigned int i=0; i<active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = active_tasks[i];
+        if (!atp->cgroup.active()) continue;
+
+        // same exceptions as throttling in suspend_all()
+        //
+        double ncpus = 0;
+        if (limit < 99.99
+            && !atp->result->dont_throttle()
+            && atp->app_version->avg_ncpus >= .5
+        ) {
+            ncpus = atp->app_version->avg_ncpus*limit/100;
+        }
+        atp->cgroup.set_cpu_limit(ncpus);
+        atp->cgroup.set_memory_high(max_ram);
+    }
+}
+#endif
+
 // If process is running, send it an "abort" message,
 // Set a flag so that if it doesn't exit within 5 seconds,
 // kill it by OS-specific mechanism (e.g. KILL signal).
@@ -927,7 +1062,8 @@ int ACTIVE_TASK::request_reread_app_info() {
     if (retval) return retval;
     process_control_queue.msg_queue_send(
         "<reread_app_info/>",
-        app_client_shm.shm->process_control_request
+        app_client_shm.shm->process_control_request,
+        app_client_shm.process_control_ring()
     );
     return 0;
 }
@@ -1066,6 +1202,12 @@ void ACTIVE_TASK_SET::suspend_all(int reason) {
             //
             if (atp->app_version->avg_ncpus < .5) continue;
 
+#ifdef __linux__
+            // tasks with a cgroup are throttled with cpu.max;
+            // see update_cgroups()
+            //
+            if (atp->cgroup.active()) continue;
+#endif
             atp->preempt(REMOVE_NEVER);
             continue;;
         }
@@ -1185,11 +1327,18 @@ int ACTIVE_TASK::suspend() {
             result->name
         );
     }
+#ifdef __linux__
+    if (cgroup.active() && !cgroup.freeze(true)) {
+        set_task_state(PROCESS_SUSPENDED, "suspend");
+        return 0;
+    }
+#endif
     int n = process_control_queue.msg_queue_purge("<resume/>");
     if (n == 0) {
         process_control_queue.msg_queue_send(
             "<suspend/>",
-            app_client_shm.shm->process_control_request
+            app_client_shm.shm->process_control_request,
+            app_client_shm.process_control_ring()
         );
     }
     set_task_state(PROCESS_SUSPENDED, "suspend");
@@ -1210,11 +1359,19 @@ int ACTIVE_TASK::unsuspend() {
             "[cpu_sched] Resuming %s", result->name
         );
     }
+#ifdef __linux__
+    if (cgroup.frozen) {
+        cgroup.freeze(false);
+        set_task_state(PROCESS_EXECUTING, "unsuspend");
+        return 0;
+    }
+#endif
     int n = process_control_queue.msg_queue_purge("<suspend/>");
     if (n == 0) {
         process_control_queue.msg_queue_send(
             "<resume/>",
-            app_client_shm.shm->process_control_request
+            app_client_shm.shm->process_control_request,
+            app_client_shm.process_control_ring()
         );
     }
     set_task_state(PROCESS_EXECUTING, "unsuspend");
@@ -1225,7 +1382,8 @@ void ACTIVE_TASK::send_network_available() {
     if (!app_client_shm.shm) return;
     process_control_queue.msg_queue_send(
         "<network_available/>",
-        app_client_shm.shm->process_control_request
+        app_client_shm.shm->process_control_request,
+        app_client_shm.process_control_ring()
     );
     return;
 }
@@ -1416,27 +1574,43 @@ void ACTIVE_TASK_SET::get_msgs() {
 }
 
 // write checkpoint state to a file in the slot dir
-// (this avoids rewriting the state file on each checkpoint)
+// (this avoids rewriting the state file on each checkpoint).
+// The file is a fixed-size record, padded with spaces,
+// overwritten in place; on hosts with many tasks this avoids
+// truncating and reallocating a file on each checkpoint.
 //
+#define TASK_STATE_FILE_SIZE    2048
+
 void ACTIVE_TASK::write_task_state_file() {
-    char path[MAXPATHLEN];
+    char path[MAXPATHLEN], buf[TASK_STATE_FILE_SIZE];
     sprintf(path, "%s/%s", slot_dir, TASK_STATE_FILENAME);
-    FILE* f = fopen(path, "w");
-    if (!f) return;
-    fprintf(f,
+    FILE* f = boinc_fopen(path, "r+");
+    if (!f) {
+        f = boinc_fopen(path, "w");
+        if (!f) return;
+    }
+    int n = snprintf(buf, sizeof(buf),
         "<active_task>\n"
         "    <project_master_url>%s</project_master_url>\n"
         "    <result_name>%s</result_name>\n"
         "    <checkpoint_cpu_time>%f</checkpoint_cpu_time>\n"
         "    <checkpoint_elapsed_time>%f</checkpoint_elapsed_time>\n"
+        "    <checkpoint_fraction_done>%f</checkpoint_fraction_done>\n"
+        "    <checkpoint_fraction_done_elapsed_time>%f</checkpoint_fraction_done_elapsed_time>\n"
         "    <fraction_done>%f</fraction_done>\n"
         "</active_task>\n",
         result->project->master_url,
         result->name,
         checkpoint_cpu_time,
         checkpoint_elapsed_time,
+        checkpoint_fraction_done,
+        checkpoint_fraction_done_elapsed_time,
         fraction_done
     );
+    if (n < 0 || n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    memset(buf+n, ' ', sizeof(buf)-n);
+    buf[sizeof(buf)-1] = '\n';
+    fwrite(buf, 1, sizeof(buf), f);
     fclose(f);
 }
 
@@ -1487,6 +1661,17 @@ void ACTIVE_TASK::read_task_state_file() {
     if (parse_double(buf, "<checkpoint_elapsed_time>", x)) {
         if (x > checkpoint_elapsed_time) {
             checkpoint_elapsed_time = x;
+
+            // the fraction done is from the same checkpoint
+            //
+            if (parse_double(buf, "<checkpoint_fraction_done>", x)) {
+                checkpoint_fraction_done = x;
+                fraction_done = x;
+            }
+            if (parse_double(buf, "<checkpoint_fraction_done_elapsed_time>", x)) {
+                checkpoint_fraction_done_elapsed_time = x;
+                fraction_done_elapsed_time = x;
+            }
         }
     }
 }
@@ -46,7 +46,12 @@
 #include <sys/wait.h>
 #endif
 #include <unistd.h>
+#if HAVE_VFORK_H
+#include <vfork.h>
+#endif
 #include <cerrno>
+#include <csignal>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <string>
 #endif
@@ -117,6 +122,170 @@ static void debug_print_argv(char** argv) {
 }
 #endif
 
+#if !defined(_WIN32) && !defined(__EMX__)
+extern char** environ;
+
+// prepend dirs to a path variable (e.g. LD_LIBRARY_PATH) in env
+//
+static void prepend_env_path(
+    vector<string>& env, const char* name, const char* dirs
+) {
+    string prefix = string(name) + "=";
+    for (unsigned int i=0; i<env.size(); i++) {
+        if (!env[i].compare(0, prefix.size(), prefix)) {
+            env[i] = prefix + dirs + ":" + env[i].substr(prefix.size());
+            return;
+        }
+    }
+    env.push_back(prefix + dirs);
+}
+
+// Make the environment for an app: ours, with the library path prepended by
+// - the project dir (../../projects/X)
+// - the slot dir (.)
+// - the BOINC dir (../..)
+// (Mac) /usr/local/cuda/lib/
+// We use relative paths in case higher-level dirs
+// are not readable to the account under which app runs.
+// app_envp points into app_env, and is null-terminated.
+// These are static so that we don't allocate them for each start.
+//
+static vector<string> app_env;
+static vector<char*> app_envp;
+
+static void make_app_env(const char* project_dir) {
+    char newlibs[256];
+    snprintf(newlibs, sizeof(newlibs), "../../%s:.:../..", project_dir);
+#ifdef __APPLE__
+    safe_strcat(newlibs, ":/usr/local/cuda/lib/");
+#endif
+    app_env.clear();
+    for (char** p = environ; *p; p++) {
+        app_env.push_back(*p);
+    }
+    prepend_env_path(app_env, "LD_LIBRARY_PATH", newlibs);
+#ifdef __APPLE__
+    prepend_env_path(app_env, "DYLD_LIBRARY_PATH", newlibs);
+#endif
+    app_envp.clear();
+    for (unsigned int i=0; i<app_env.size(); i++) {
+        app_envp.push_back(const_cast<char*>(app_env[i].c_str()));
+    }
+    app_envp.push_back(NULL);
+}
+
+// write a message to stderr in a vfork()ed child
+//
+static void child_error(const char* msg) {
+    ssize_t n = write(STDERR_FILENO, msg, strlen(msg));
+    (void) n;
+}
+
+// what the vfork()ed child needs; filled in by the parent beforehand
+//
+struct CHILD_ARGS {
+    const char* dir;
+    const char* path;
+    char** argv;
+    char** envp;
+    bool sandbox;
+    bool set_priority;
+    bool high_priority;
+    sigset_t sigmask;
+    const char* exec_failed_msg;
+};
+
+// The child side of vfork(); doesn't return.
+// It shares the parent's memory until it execs,
+// so it uses only async-signal-safe system calls,
+// reads only *ca, and writes only its own locals.
+//
+static void exec_child(const CHILD_ARGS* ca) {
+    struct sigaction sa;
+    int fd, sig;
+
+    // our signal handlers would run in the parent's memory
+    //
+    for (sig=1; sig<NSIG; sig++) {
+        if (sigaction(sig, NULL, &sa)) continue;
+        if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL) continue;
+        sa.sa_handler = SIG_DFL;
+        sa.sa_flags = 0;
+        sigaction(sig, &sa, NULL);
+    }
+    sigprocmask(SIG_SETMASK, &ca->sigmask, NULL);
+
+    // don't pass stdout to the app
+    //
+    fd = open("/dev/null", O_RDWR);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+
+    if (chdir(ca->dir)) {
+        child_error("chdir failed\n");
+        _exit(errno);
+    }
+
+#if 0
+    // set stack size limit to the max.
+    // Some BOINC apps have reported problems with exceeding
+    // small stack limits (e.g. 8 MB)
+    // and it seems like the best thing to raise it as high as possible
+    //
+    struct rlimit rlim;
+#define MIN_STACK_LIMIT 64000000
+    getrlimit(RLIMIT_STACK, &rlim);
+    if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur <= MIN_STACK_LIMIT) {
+        if (rlim.rlim_max == RLIM_INFINITY || rlim.rlim_max > MIN_STACK_LIMIT) {
+            rlim.rlim_cur = MIN_STACK_LIMIT;
+        } else {
+            rlim.rlim_cur = rlim.rlim_max;
+        }
+        setrlimit(RLIMIT_STACK, &rlim);
+    }
+#endif
+
+    // hook up stderr to a specially-named file
+    //
+    fd = open(STDERR_FILE, O_WRONLY|O_CREAT|O_APPEND, 0666);
+    if (fd >= 0) {
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    if (ca->set_priority) {
+#if HAVE_SETPRIORITY
+        if (setpriority(PRIO_PROCESS, 0,
+            ca->high_priority?PROCESS_MEDIUM_PRIORITY:PROCESS_IDLE_PRIORITY)
+        ) {
+            child_error("setpriority failed\n");
+        }
+#endif
+#if HAVE_SCHED_SETSCHEDULER && defined(SCHED_BATCH) && defined (__linux__)
+        if (!ca->high_priority) {
+            struct sched_param sp;
+            sp.sched_priority = 0;
+            if (sched_setscheduler(0, SCHED_BATCH, &sp)) {
+                child_error("sched_setscheduler failed\n");
+            }
+        }
+#endif
+    }
+    if (ca->sandbox) {
+        // Files written by projects have user boinc_project
+        // and group boinc_project,
+        // so they must be world-readable so BOINC CLient can read them
+        //
+        umask(2);
+    }
+    execve(ca->path, ca->argv, ca->envp);
+    child_error(ca->exec_failed_msg);
+    _exit(errno);
+}
+#endif
+
 // For apps that use coprocessors, append "--device x" to the command line.
 // NOTE: this is deprecated.  Use app_init_data instead.
 //
@@ -263,15 +432,33 @@ void ACTIVE_TASK::init_app_init_data(APP_INIT_DATA& aid) {
         }
         aid.gpu_device_num = cp.device_nums[k];
         aid.gpu_opencl_dev_index = cp.opencl_device_indexes[k];
+        aid.gpu_opencl_platform_index = -1;
+        if (k < cp.opencl_device_count) {
+            aid.gpu_opencl_platform_index = cp.opencl_platform_indexes[k];
+        }
+        if (cp.pci_infos[k].present) {
+            aid.gpu_pci_domain_id = cp.pci_infos[k].domain_id;
+            aid.gpu_pci_bus_id = cp.pci_infos[k].bus_id;
+            aid.gpu_pci_device_id = cp.pci_infos[k].device_id;
+        } else {
+            aid.gpu_pci_domain_id = -1;
+            aid.gpu_pci_bus_id = -1;
+            aid.gpu_pci_device_id = -1;
+        }
         aid.gpu_usage = app_version->gpu_usage.usage;
     } else {
         strcpy(aid.gpu_type, "");
         aid.gpu_device_num = -1;
         aid.gpu_opencl_dev_index = -1;
+        aid.gpu_opencl_platform_index = -1;
+        aid.gpu_pci_domain_id = -1;
+        aid.gpu_pci_bus_id = -1;
+        aid.gpu_pci_device_id = -1;
         aid.gpu_usage = 0;
     }
     aid.ncpus = app_version->avg_ncpus;
     aid.vbox_window = config.vbox_window;
+    aid.shmem_ring_version = MSG_RING_VERSION;
     aid.checkpoint_period = gstate.global_prefs.disk_interval;
     aid.fraction_done_start = 0;
     aid.fraction_done_end = 1;
@@ -358,6 +545,7 @@ bool ACTIVE_TASK::must_copy_file(FILE_REF& fref, bool is_io_file) {
 // set up a file reference, given a slot dir and project dir.
 // This means:
 // 1) copy the file to slot dir, if reference is by copy
+//    (or clone or hard-link it, if possible)
 // 2) else make a soft link
 //
 int ACTIVE_TASK::setup_file(
@@ -395,6 +583,16 @@ int ACTIVE_TASK::setup_file(
             if (boinc_file_exists(link_path)) {
                 return 0;
             }
+
+            // if the filesystem can clone the file, or (for app files,
+            // which apps don't change) hard-link it,
+            // we don't need to copy it
+            //
+            if (!boinc_clone_file(file_path, link_path)
+                || (!is_io_file && !hard_link_file(file_path, link_path))
+            ) {
+                return fip->set_permissions(link_path);
+            }
             if (fip->nbytes > ASYNC_FILE_THRESHOLD) {
                 ASYNC_COPY* ac = new ASYNC_COPY;
                 retval = ac->init(this, fip, file_path, link_path);
@@ -934,147 +1132,114 @@ int ACTIVE_TASK::start(bool test) {
         set_task_state(PROCESS_EXECUTING, "start");
         return 0;
     }
-    pid = fork();
-    if (pid == -1) {
-        sprintf(buf, "fork() failed: %s", strerror(errno));
-        retval = ERR_FORK;
-        goto error;
+#ifdef __linux__
+    if (cgroup_enabled()) {
+        retval = cgroup.create(slot);
+        if (retval) {
+            msg_printf(wup->project, MSG_INFO,
+                "Can't create cgroup for %s: %s",
+                result->name, boincerror(retval)
+            );
+        }
+    }
+#endif
+
+    // Do everything that allocates memory or uses stdio here, before vfork().
+    // The child shares our memory until it execs,
+    // so it does only system calls: no setenv(), freopen() etc.
+    //
+    if (test) {
+        strcpy(buf, exec_path);
+    } else {
+        sprintf(buf, "../../%s", exec_path);
+    }
+    char exec_failed_msg[512];
+    snprintf(exec_failed_msg, sizeof(exec_failed_msg),
+        "Process creation (%s) failed\n", buf
+    );
+    char switcher_path[MAXPATHLEN];
+    if (g_use_sandbox) {
+        sprintf(switcher_path, "../../%s/%s",
+            SWITCHER_DIR, SWITCHER_FILE_NAME
+        );
+        argv[0] = const_cast<char*>(SWITCHER_FILE_NAME);
+        argv[1] = buf;
+        argv[2] = exec_name;
+        parse_command_line(cmdline, argv+3);
+    } else {
+        argv[0] = buf;
+        parse_command_line(cmdline, argv+1);
     }
+    if (log_flags.task_debug) {
+        debug_print_argv(argv);
+    }
+    make_app_env(wup->project->project_dir());
+
+    CHILD_ARGS ca;
+    ca.dir = slot_dir;
+    ca.path = g_use_sandbox?switcher_path:buf;
+    ca.argv = argv;
+    ca.envp = &app_envp[0];
+    ca.sandbox = g_use_sandbox;
+    ca.set_priority = !config.no_priority_change;
+    ca.high_priority = high_priority;
+    ca.exec_failed_msg = exec_failed_msg;
+
+    // block signals so that our handlers don't run in the child
+    // (which shares our memory); the child resets them
+    //
+    sigset_t all_sigs, old_sigs;
+    sigfillset(&all_sigs);
+    pthread_sigmask(SIG_BLOCK, &all_sigs, &old_sigs);
+    ca.sigmask = old_sigs;
+
+    pid = vfork();
     if (pid == 0) {
         // from here on we're running in a new process.
         // If an error happens,
         // exit nonzero so that the client knows there was a problem.
-
-        // don't pass stdout to the app
         //
-        int fd = open("/dev/null", O_RDWR);
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
-
-        // prepend to library path:
-        // - the project dir (../../projects/X)
-        // - the slot dir (.)
-        // - the BOINC dir (../..)
-        // (Mac) /usr/local/cuda/lib/
-        // We use relative paths in case higher-level dirs
-        // are not readable to the account under which app runs
-        //
-        char libpath[8192];
-        char newlibs[256];
-        sprintf(newlibs, "../../%s:.:../..", wup->project->project_dir());
-#ifdef __APPLE__
-        strcat(newlibs, ":/usr/local/cuda/lib/");
-#endif
-        char* p = getenv("LD_LIBRARY_PATH");
-        if (p) {
-            sprintf(libpath, "%s:%s", newlibs, p);
-        } else {
-            safe_strcpy(libpath, newlibs);
-        }
-        setenv("LD_LIBRARY_PATH", libpath, 1);
-
-        // On the Mac, do the same for DYLD_LIBRARY_PATH
-        //
-#ifdef __APPLE__
-        p = getenv("DYLD_LIBRARY_PATH");
-        if (p) {
-            sprintf(libpath, "%s:%s", newlibs, p);
-        } else {
-            safe_strcpy(libpath, newlibs);
-        }
-        setenv("DYLD_LIBRARY_PATH", libpath, 1);
-#endif
-
-        retval = chdir(slot_dir);
-        if (retval) {
-            perror("chdir");
-            fflush(NULL);
-            _exit(errno);
-        }
-
-#if 0
-        // set stack size limit to the max.
-        // Some BOINC apps have reported problems with exceeding
-        // small stack limits (e.g. 8 MB)
-        // and it seems like the best thing to raise it as high as possible
-        //
-        struct rlimit rlim;
-#define MIN_STACK_LIMIT 64000000
-        getrlimit(RLIMIT_STACK, &rlim);
-        if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur <= MIN_STACK_LIMIT) {
-            if (rlim.rlim_max == RLIM_INFINITY || rlim.rlim_max > MIN_STACK_LIMIT) {
-                rlim.rlim_cur = MIN_STACK_LIMIT;
-            } else {
-                rlim.rlim_cur = rlim.rlim_max;
-            }
-            setrlimit(RLIMIT_STACK, &rlim);
-        }
-#endif
+        exec_child(&ca);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);     // doesn't set errno
+    if (pid == -1) {
+        sprintf(buf, "fork() failed: %s", strerror(errno));
+        retval = ERR_FORK;
+        goto error;
+    }
 
-        // hook up stderr to a specially-named file
-        //
-        (void) freopen(STDERR_FILE, "a", stderr);
+    if (log_flags.task_debug) {
+        msg_printf(wup->project, MSG_INFO,
+            "[task] ACTIVE_TASK::start(): forked process: pid %d\n", pid
+        );
+    }
 
-        if (!config.no_priority_change) {
-#if HAVE_SETPRIORITY
-            if (setpriority(PRIO_PROCESS, 0,
-                high_priority?PROCESS_MEDIUM_PRIORITY:PROCESS_IDLE_PRIORITY)
-            ) {
-                perror("setpriority");
-            }
-#endif
-#if HAVE_SCHED_SETSCHEDULER && defined(SCHED_BATCH) && defined (__linux__)
-            if (!high_priority) {
-                struct sched_param sp;
-                sp.sched_priority = 0;
-                if (sched_setscheduler(0, SCHED_BATCH, &sp)) {
-                    perror("sched_setscheduler");
-                }
-            }
-#endif
-        }
-        if (test) {
-            strcpy(buf, exec_path);
-        } else {
-            sprintf(buf, "../../%s", exec_path);
-        }
-        if (g_use_sandbox) {
-            char switcher_path[MAXPATHLEN];
-            sprintf(switcher_path, "../../%s/%s",
-                SWITCHER_DIR, SWITCHER_FILE_NAME
+    // start counting before the app gets far,
+    // so that the counters are inherited by its child processes
+    //
+    if (config.perf_counters && perf.open(pid)) {
+        if (log_flags.task_debug) {
+            msg_printf(wup->project, MSG_INFO,
+                "[task] can't open performance counters for %s",
+                result->name
             );
-            argv[0] = const_cast<char*>(SWITCHER_FILE_NAME);
-            argv[1] = buf;
-            argv[2] = exec_name;
-            parse_command_line(cmdline, argv+3);
-            if (log_flags.task_debug) {
-                debug_print_argv(argv);
-            }
-            // Files written by projects have user boinc_project
-            // and group boinc_project,
-            // so they must be world-readable so BOINC CLient can read them
-            //
-            umask(2);
-            retval = execv(switcher_path, argv);
-        } else {
-            argv[0] = buf;
-            parse_command_line(cmdline, argv+1);
-            retval = execv(buf, argv);
         }
-        fprintf(stderr,
-            "Process creation (%s) failed: %s, errno=%d\n",
-            buf, boincerror(retval), errno
-        );
-        perror("execv");
-        fflush(NULL);
-        _exit(errno);
     }
 
-    if (log_flags.task_debug) {
+#ifdef __linux__
+    // Put the app in its cgroup.
+    // We do this here rather than in the child,
+    // which can't use the stdio in TASK_CGROUP::enter().
+    // If it fails, fall back to process-control messages.
+    //
+    if (cgroup.active() && cgroup.enter(pid)) {
         msg_printf(wup->project, MSG_INFO,
-            "[task] ACTIVE_TASK::start(): forked process: pid %d\n", pid
+            "Can't put %s in cgroup; not using cgroups for it",
+            result->name
         );
+        cgroup.remove();
     }
+#endif
 
 #endif
     set_task_state(PROCESS_EXECUTING, "start");
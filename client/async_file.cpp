@@ -23,25 +23,115 @@
 
 #include "crypt.h"
 #include "error_numbers.h"
+#include "file_names.h"
 #include "filesys.h"
 #include "md5_file.h"
 #include "str_replace.h"
+#include "util.h"
 
 #include "app.h"
 #include "client_msgs.h"
 #include "client_state.h"
 #include "project.h"
 #include "sandbox.h"
+#include "thread.h"
 
 #include "async_file.h"
 
+using std::string;
 using std::vector;
 
 vector<ASYNC_VERIFY*> async_verifies;
 vector<ASYNC_COPY*> async_copies;
+vector<ASYNC_DELETE*> async_deletes;
+vector<ASYNC_FILE_OP*> async_misc_ops;
 
 #define BUFSIZE 64*1024
 
+// the worker thread, which does the I/O of the op at the head
+// of async_copies or (if none) async_verifies
+// or (if none) async_misc_ops or (if none) async_deletes.
+// async_file_lock protects these vectors and async_file_busy.
+//
+static THREAD async_file_thread;
+static THREAD_LOCK async_file_lock;
+static bool async_file_thread_running = false;
+static ASYNC_FILE_OP* volatile async_file_busy = NULL;
+    // the op the worker thread is doing I/O for
+
+#ifdef _WIN32
+static DWORD WINAPI async_file_worker(LPVOID) {
+#else
+static void* async_file_worker(void*) {
+#endif
+    while (1) {
+        ASYNC_FILE_OP* op = NULL;
+        async_file_lock.lock();
+        if (async_copies.size() && !async_copies[0]->io_done) {
+            op = async_copies[0];
+        } else if (!async_copies.size()
+            && async_verifies.size() && !async_verifies[0]->io_done
+        ) {
+            op = async_verifies[0];
+        } else if (!async_copies.size() && !async_verifies.size()
+            && async_misc_ops.size() && !async_misc_ops[0]->io_done
+        ) {
+            op = async_misc_ops[0];
+        } else if (!async_copies.size() && !async_verifies.size()
+            && !async_misc_ops.size()
+            && async_deletes.size() && !async_deletes[0]->io_done
+        ) {
+            op = async_deletes[0];
+        }
+        async_file_busy = op;
+        async_file_lock.unlock();
+        if (!op) {
+            boinc_sleep(0.1);
+            continue;
+        }
+        int retval = 0;
+        while (!op->io_cancel) {
+            retval = op->do_chunk();
+            if (retval) break;
+            if (op->yields()) break;
+        }
+        async_file_lock.lock();
+        if (!retval && !op->io_cancel) {
+            // op yielded; pick again
+            //
+            async_file_busy = NULL;
+            async_file_lock.unlock();
+            continue;
+        }
+        op->io_retval = (retval == 1)?0:retval;
+        op->io_done = true;
+        async_file_busy = NULL;
+        async_file_lock.unlock();
+    }
+    return 0;
+}
+
+static void start_async_file_thread() {
+    if (async_file_thread_running) return;
+    if (config.no_async_file_thread) return;
+    async_file_thread.run(async_file_worker, NULL);
+    async_file_thread_running = true;
+}
+
+// if the worker thread is doing I/O for the given op, stop it
+// and wait until it's done; the caller then removes the op.
+// Returns with async_file_lock held.
+//
+static void cancel_async_file_io(ASYNC_FILE_OP* op) {
+    async_file_lock.lock();
+    while (async_file_busy == op) {
+        op->io_cancel = true;
+        async_file_lock.unlock();
+        boinc_sleep(0.01);
+        async_file_lock.lock();
+    }
+}
+
 int ASYNC_COPY::init(
     ACTIVE_TASK* _atp, FILE_INFO* _fip,
     const char* from_path, const char* _to_path
@@ -70,7 +160,10 @@ int ASYNC_COPY::init(
         return ERR_FOPEN;
     }
     atp->async_copy = this;
+    start_async_file_thread();
+    async_file_lock.lock();
     async_copies.push_back(this);
+    async_file_lock.unlock();
     return 0;
 }
 
@@ -89,51 +182,64 @@ ASYNC_COPY::~ASYNC_COPY() {
 }
 
 // copy a 64KB chunk.
-// return nonzero if we're done (success or fail)
+// return 1 if we're done, or an error code
 //
-int ASYNC_COPY::copy_chunk() {
+int ASYNC_COPY::do_chunk() {
     unsigned char buf[BUFSIZE];
-    int retval;
 
     size_t n = fread(buf, 1, BUFSIZE, in);
-    if (n == 0) {
-        // copy done.  rename temp file
-        //
-        fclose(in);
-        fclose(out);
-        in = out = NULL;
-        retval = boinc_rename(temp_path, to_path);
+    if (n == 0) return 1;
+    size_t m = fwrite(buf, 1, n, out);
+    if (m != n) return ERR_FWRITE;
+    return 0;
+}
+
+// copy a chunk in the main thread.
+// return nonzero if we're done (success or fail)
+//
+int ASYNC_COPY::copy_chunk() {
+    int retval = do_chunk();
+    if (!retval) return 0;
+    done((retval == 1)?0:retval);
+    return 1;
+}
+
+// the I/O is done; finish up
+//
+void ASYNC_COPY::done(int retval) {
+    if (retval) {
+        error(retval);
+        return;
+    }
+
+    // copy done.  rename temp file
+    //
+    fclose(in);
+    fclose(out);
+    in = out = NULL;
+    retval = boinc_rename(temp_path, to_path);
+    if (retval) {
+        error(retval);
+        return;
+    }
+
+    if (log_flags.async_file_debug) {
+        msg_printf(atp->wup->project, MSG_INFO,
+            "[async] async copy of %s finished", to_path
+        );
+    }
+
+    atp->async_copy = NULL;
+    fip->set_permissions(to_path);
+
+    // If task is still scheduled, start it.
+    //
+    if (atp->scheduler_state == CPU_SCHED_SCHEDULED) {
+        retval = atp->start();
         if (retval) {
             error(retval);
-            return 1;
-        }
-
-        if (log_flags.async_file_debug) {
-            msg_printf(atp->wup->project, MSG_INFO,
-                "[async] async copy of %s finished", to_path
-            );
-        }
-    
-        atp->async_copy = NULL;
-        fip->set_permissions(to_path);
-
-        // If task is still scheduled, start it.
-        //
-        if (atp->scheduler_state == CPU_SCHED_SCHEDULED) {
-            retval = atp->start();
-            if (retval) {
-                error(retval);
-            }
-        }
-        return 1;       // tell caller we're done
-    } else {
-        size_t m = fwrite(buf, 1, n, out);
-        if (m != n) {
-            error(ERR_FWRITE);
-            return 1;
         }
     }
-    return 0;
 }
 
 // handle the failure of a copy; error out the result
@@ -147,6 +253,7 @@ void ASYNC_COPY::error(int retval) {
 }
 
 void remove_async_copy(ASYNC_COPY* acp) {
+    cancel_async_file_io(acp);
     vector<ASYNC_COPY*>::iterator i = async_copies.begin();
     while (i != async_copies.end()) {
         if (*i == acp) {
@@ -155,12 +262,13 @@ void remove_async_copy(ASYNC_COPY* acp) {
         }
         i++;
     }
+    async_file_lock.unlock();
     delete acp;
 }
 
 int ASYNC_VERIFY::init(FILE_INFO* _fip) {
     fip = _fip;
-    md5_init(&md5_state);
+    md5_state.init();
     get_pathname(fip, inpath, sizeof(inpath));
 
     if (log_flags.async_file_debug) {
@@ -190,26 +298,24 @@ int ASYNC_VERIFY::init(FILE_INFO* _fip) {
         in = fopen(inpath, "rb");
         if (!in) return ERR_FOPEN;
     }
-    async_verifies.push_back(this);
     fip->async_verify = this;
+    start_async_file_thread();
+    async_file_lock.lock();
+    async_verifies.push_back(this);
+    async_file_lock.unlock();
     return 0;
 }
 
 // the MD5 has been computed.  Finish up.
 //
 void ASYNC_VERIFY::finish() {
-    unsigned char binout[16];
     char md5_buf[64];
     int retval;
 
-    md5_finish(&md5_state, binout);
-    for (int i=0; i<16; i++) {
-        sprintf(md5_buf+2*i, "%02x", binout[i]);
-    }
-    md5_buf[32] = 0;
+    md5_state.finish(md5_buf);
     if (fip->signature_required) {
         bool verified;
-        retval = check_file_signature2(md5_buf, fip->file_signature,
+        retval = check_file_signature2(md5_buf, fip->file_signature.c_str(),
             fip->project->code_sign_key, verified
         );
         if (retval) {
@@ -233,7 +339,9 @@ void ASYNC_VERIFY::finish() {
     }
     fip->async_verify = NULL;
     fip->status = FILE_PRESENT;
+    fip->project->add_project_dir_size(fip->nbytes);
     fip->set_permissions();
+    gstate.set_poll_flags();
 }
 
 void ASYNC_VERIFY::error(int retval) {
@@ -245,46 +353,63 @@ void ASYNC_VERIFY::error(int retval) {
     }
     fip->async_verify = NULL;
     fip->status = retval;
+    gstate.set_poll_flags();
 }
 
-int ASYNC_VERIFY::verify_chunk() {
+// read (and uncompress, if needed) a 64KB chunk, and hash it.
+// return 1 if we're done, or an error code.
+// fip is used only for its (constant) download_gzipped
+//
+int ASYNC_VERIFY::do_chunk() {
     int n;
     unsigned char buf[BUFSIZE];
     if (fip->download_gzipped) {
         n = gzread(gzin, buf, BUFSIZE);
-        if (n <=0) {
-            // done
+        if (n <= 0) return 1;
+        int m = (int)fwrite(buf, 1, n, out);
+        if (m != n) {
+            // write failed
             //
-            gzclose(gzin);
-            fclose(out);
-            delete_project_owned_file(inpath, true);
-            boinc_rename(temp_path, outpath);
-            finish();
-            return 1;
-        } else {
-            int m = (int)fwrite(buf, 1, n, out);
-            if (m != n) {
-                // write failed
-                //
-                error(ERR_FWRITE);
-                return 1;
-            }
-            md5_append(&md5_state, buf, n);
+            return ERR_FWRITE;
         }
     } else {
-        n = fread(buf, 1, BUFSIZE, in);
-        if (n <= 0) {
-            fclose(in);
-            finish();
-            return 1;
-        } else {
-            md5_append(&md5_state, buf, n);
-        }
+        n = (int)fread(buf, 1, BUFSIZE, in);
+        if (n <= 0) return 1;
     }
+    md5_state.append(buf, n);
     return 0;
 }
 
+// verify a chunk in the main thread.
+// return nonzero if we're done (success or fail)
+//
+int ASYNC_VERIFY::verify_chunk() {
+    int retval = do_chunk();
+    if (!retval) return 0;
+    done((retval == 1)?0:retval);
+    return 1;
+}
+
+// the I/O is done; finish up
+//
+void ASYNC_VERIFY::done(int retval) {
+    if (retval) {
+        error(retval);
+        return;
+    }
+    if (fip->download_gzipped) {
+        gzclose(gzin);
+        fclose(out);
+        delete_project_owned_file(inpath, true);
+        boinc_rename(temp_path, outpath);
+    } else {
+        fclose(in);
+    }
+    finish();
+}
+
 void remove_async_verify(ASYNC_VERIFY* avp) {
+    cancel_async_file_io(avp);
     vector<ASYNC_VERIFY*>::iterator i = async_verifies.begin();
     while (i != async_verifies.end()) {
         if (*i == avp) {
@@ -293,16 +418,201 @@ void remove_async_verify(ASYNC_VERIFY* avp) {
         }
         i++;
     }
+    async_file_lock.unlock();
     delete avp;
 }
 
-// If there are any async file operations,
-// do a 64KB chunk of the first one and return true.
+ASYNC_DELETE::ASYNC_DELETE() {
+    strcpy(path, "");
+    nfiles = 0;
+    final_retval = 0;
+}
+
+ASYNC_DELETE::~ASYNC_DELETE() {
+    for (unsigned int i=0; i<dirps.size(); i++) {
+        if (dirps[i]) dir_close(dirps[i]);
+    }
+}
+
+int ASYNC_DELETE::init(const char* _path) {
+    safe_strcpy(path, _path);
+    dirs.push_back(string(path));
+    dirps.push_back(NULL);
+    start_async_file_thread();
+    async_file_lock.lock();
+    async_deletes.push_back(this);
+    async_file_lock.unlock();
+    return 0;
+}
+
+// delete one file, or finish one directory.
+// Like client_clean_out_dir(), keep going after errors.
+// Return 1 when the tree is gone, or an error code
+// if anything couldn't be deleted.
+// This runs in the worker thread, so no messages here.
+//
+int ASYNC_DELETE::do_chunk() {
+    char filename[MAXPATHLEN], fpath[MAXPATHLEN];
+    int retval;
+
+    if (dirs.empty()) {
+        return final_retval?final_retval:1;
+    }
+    const char* dir = dirs.back().c_str();
+    if (!dirps.back()) {
+        dirps.back() = dir_open(dir);
+        if (!dirps.back()) {
+            // may be owned by boinc_projects;
+            // remove_project_owned_dir() knows what to do
+            //
+            retval = remove_project_owned_dir(dir);
+            if (retval) final_retval = ERR_RMDIR;
+            dirs.pop_back();
+            dirps.pop_back();
+            return 0;
+        }
+    }
+    strcpy(filename, "");
+    if (dir_scan(filename, dirps.back(), sizeof(filename))) {
+        dir_close(dirps.back());
+        retval = remove_project_owned_dir(dir);
+        if (retval) final_retval = ERR_RMDIR;
+        dirs.pop_back();
+        dirps.pop_back();
+        return 0;
+    }
+    snprintf(fpath, sizeof(fpath), "%s/%s", dir, filename);
+    if (is_dir(fpath)) {
+        dirs.push_back(string(fpath));
+        dirps.push_back(NULL);
+        return 0;
+    }
+    retval = delete_project_owned_file_aux(fpath);
+    if (retval) {
+        final_retval = ERR_UNLINK;
+    } else {
+        nfiles++;
+    }
+    return 0;
+}
+
+void ASYNC_DELETE::done(int retval) {
+    if (retval) {
+        msg_printf(0, MSG_INTERNAL_ERROR,
+            "Couldn't delete everything in %s: %s", path, boincerror(retval)
+        );
+        return;
+    }
+    if (log_flags.async_file_debug || log_flags.slot_debug) {
+        msg_printf(0, MSG_INFO,
+            "[async] deleted %s (%d files)", path, nfiles
+        );
+    }
+}
+
+// Delete a directory and its contents.
+// Rename it into the slots dir, so that the name can be reused
+// right away (and so delete_old_slot_dirs() gets it if we exit first),
+// then delete the renamed tree asynchronously.
+// If the rename fails (e.g. an open file on Windows),
+// clean it out synchronously, as before.
+//
+int async_delete_dir(const char* dir, const char* reason) {
+    char new_path[MAXPATHLEN];
+    static int count = 0;
+
+    if (!boinc_file_exists(dir)) return 0;
+    boinc_mkdir(SLOTS_DIR);
+    do {
+        snprintf(new_path, sizeof(new_path),
+            "%s/deleting_%d_%d", SLOTS_DIR, (int)gstate.now, count++
+        );
+    } while (boinc_file_exists(new_path));
+    if (rename(dir, new_path)) {
+        int retval = client_clean_out_dir(dir, reason);
+        if (retval) return retval;
+        return remove_project_owned_dir(dir);
+    }
+    if (log_flags.slot_debug) {
+        msg_printf(0, MSG_INFO,
+            "[slot] deleting %s (%s) asynchronously as %s",
+            dir, reason, new_path
+        );
+    }
+    ASYNC_DELETE* adp = new ASYNC_DELETE;
+    adp->init(new_path);
+    return 0;
+}
+
+// queue an op for async_misc_ops
+//
+void add_async_op(ASYNC_FILE_OP* op) {
+    start_async_file_thread();
+    async_file_lock.lock();
+    async_misc_ops.push_back(op);
+    async_file_lock.unlock();
+}
+
+// for GUI RPC: # of trees waiting to be deleted,
+// and # of files deleted so far from the current one
+//
+void get_async_delete_status(int& ndirs, int& nfiles) {
+    async_file_lock.lock();
+    ndirs = (int)async_deletes.size();
+    nfiles = ndirs?async_deletes[0]->nfiles:0;
+    async_file_lock.unlock();
+}
+
+// If there are any async file operations:
+// if we have a worker thread, finish the ops whose I/O it's done;
+// otherwise do a 64KB chunk of the first one.
+// Return true if we did something.
 //
 // Note: if there are lots of pending operations,
 // it's better to finish the oldest one before starting the rest
 //
 bool do_async_file_ops() {
+    if (async_file_thread_running) {
+        ASYNC_COPY* acp = NULL;
+        ASYNC_VERIFY* avp = NULL;
+        ASYNC_DELETE* adp = NULL;
+        ASYNC_FILE_OP* op = NULL;
+        async_file_lock.lock();
+        if (async_copies.size() && async_copies[0]->io_done) {
+            acp = async_copies[0];
+            async_copies.erase(async_copies.begin());
+        } else if (async_verifies.size() && async_verifies[0]->io_done) {
+            avp = async_verifies[0];
+            async_verifies.erase(async_verifies.begin());
+        } else if (async_misc_ops.size() && async_misc_ops[0]->io_done) {
+            op = async_misc_ops[0];
+            async_misc_ops.erase(async_misc_ops.begin());
+        } else if (async_deletes.size() && async_deletes[0]->io_done) {
+            adp = async_deletes[0];
+            async_deletes.erase(async_deletes.begin());
+        }
+        async_file_lock.unlock();
+        if (acp) {
+            acp->done(acp->io_retval);
+            delete acp;
+            return true;
+        }
+        if (avp) {
+            avp->done(avp->io_retval);
+            return true;
+        }
+        if (op) {
+            op->done(op->io_retval);
+            delete op;
+            return true;
+        }
+        if (adp) {
+            adp->done(adp->io_retval);
+            delete adp;
+            return true;
+        }
+        return false;
+    }
     if (async_copies.size()) {
         ASYNC_COPY* acp = async_copies[0];
         if (acp->copy_chunk()) {
@@ -317,6 +627,26 @@ bool do_async_file_ops() {
         }
         return true;
     }
+    if (async_misc_ops.size()) {
+        ASYNC_FILE_OP* op = async_misc_ops[0];
+        int retval = op->do_chunk();
+        if (retval) {
+            async_misc_ops.erase(async_misc_ops.begin());
+            op->done((retval == 1)?0:retval);
+            delete op;
+        }
+        return true;
+    }
+    if (async_deletes.size()) {
+        ASYNC_DELETE* adp = async_deletes[0];
+        int retval = adp->do_chunk();
+        if (retval) {
+            async_deletes.erase(async_deletes.begin());
+            adp->done((retval == 1)?0:retval);
+            delete adp;
+        }
+        return true;
+    }
     return false;
 }
 
@@ -21,6 +21,7 @@
 #ifndef _ASYNC_FILE_
 #define _ASYNC_FILE_
 
+#include <string>
 #include <vector>
 
 #ifdef _WIN32
@@ -30,7 +31,7 @@
 #endif
 
 #include "filesys.h"
-#include "md5.h"
+#include "md5_file.h"
 
 struct FILE_INFO;
 struct ACTIVE_TASK;
@@ -38,10 +39,40 @@ struct ACTIVE_TASK;
 #define ASYNC_FILE_THRESHOLD    1e7
     // use async ops for files exceeding this size
 
+// The I/O of async ops (reading, writing, hashing, uncompressing)
+// is done by a worker thread, if we have one;
+// otherwise it's done in 64KB chunks by do_async_file_ops().
+// Either way the rest (renaming files, changing client state)
+// is done in the main thread, by do_async_file_ops().
+// The worker thread doesn't touch client data structures.
+//
+struct ASYNC_FILE_OP {
+    volatile bool io_done;
+        // set by the worker thread when it's done the I/O
+    volatile bool io_cancel;
+        // tells the worker thread to stop
+    int io_retval;
+        // for worker thread: 0 if the I/O succeeded
+
+    ASYNC_FILE_OP() {
+        io_done = false;
+        io_cancel = false;
+        io_retval = 0;
+    }
+    virtual ~ASYNC_FILE_OP(){}
+    virtual int do_chunk() = 0;
+        // do a chunk of I/O.
+        // return 0 if more to do, 1 if done, or an error code
+    virtual bool yields() {return false;}
+        // if true, the worker thread looks for other ops after each chunk
+    virtual void done(int) {}
+        // called in the main thread when the I/O is finished
+};
+
 // Used to copy a file from project dir to slot dir;
 // when done, start the task again.
 //
-struct ASYNC_COPY {
+struct ASYNC_COPY : ASYNC_FILE_OP {
     ACTIVE_TASK* atp;
     FILE_INFO* fip;
     FILE* in, *out;
@@ -53,7 +84,9 @@ struct ASYNC_COPY {
     int init(
         ACTIVE_TASK*, FILE_INFO*, const char* from_path, const char* _to_path
     );
+    int do_chunk();
     int copy_chunk();
+    void done(int);
     void error(int);
 };
 
@@ -61,9 +94,9 @@ struct ASYNC_COPY {
 // after it has been downloaded.
 // When done, mark it as present.
 //
-struct ASYNC_VERIFY {
+struct ASYNC_VERIFY : ASYNC_FILE_OP {
     FILE_INFO* fip;
-    md5_state_t md5_state;
+    MD5_STATE md5_state;
     FILE* in, *out;
     gzFile gzin;
     char inpath[MAXPATHLEN], temp_path[MAXPATHLEN], outpath[MAXPATHLEN];
@@ -72,16 +105,49 @@ struct ASYNC_VERIFY {
     ~ASYNC_VERIFY(){};
 
     int init(FILE_INFO*);
+    int do_chunk();
     int verify_chunk();
+    void done(int);
     void finish();
     void error(int);
 };
 
+// Used to delete a directory tree (e.g. the slot dir of a finished job)
+// one entry per chunk.
+// The dir has already been renamed, so its old name can be reused.
+// Copies and verifies go first.
+//
+struct ASYNC_DELETE : ASYNC_FILE_OP {
+    char path[MAXPATHLEN];
+    std::vector<std::string> dirs;
+    std::vector<DIRREF> dirps;
+        // the dirs we're in, and their scan handles
+    volatile int nfiles;
+        // files deleted so far
+    int final_retval;
+
+    ASYNC_DELETE();
+    ~ASYNC_DELETE();
+
+    int init(const char* path);
+    int do_chunk();
+    bool yields() {return true;}
+    void done(int);
+};
+
 extern std::vector<ASYNC_VERIFY*> async_verifies;
 extern std::vector<ASYNC_COPY*> async_copies;
+extern std::vector<ASYNC_DELETE*> async_deletes;
+extern std::vector<ASYNC_FILE_OP*> async_misc_ops;
+    // other ops, e.g. reading and writing notice files.
+    // These are done after copies and verifies, before deletes,
+    // and are deleted after their done() is called.
 
 extern void remove_async_copy(ASYNC_COPY*);
 extern void remove_async_verify(ASYNC_VERIFY*);
+extern void add_async_op(ASYNC_FILE_OP*);
+extern int async_delete_dir(const char* dir, const char* reason);
+extern void get_async_delete_status(int& ndirs, int& nfiles);
 extern bool do_async_file_ops();
 
 #endif
@@ -19,6 +19,7 @@
 // using GUI RPCs.
 //
 // usage: boinccmd [--host hostname] [--passwd passwd] command
+//    or: boinccmd --hosts file [--passwd passwd] [--max_connections N] command
 
 #if defined(_WIN32) && !defined(__STDWX_H__) && !defined(_BOINC_WIN_) && !defined(_AFX_STDAFX_H_)
 #include "boinc_win.h"
@@ -39,6 +40,7 @@ using std::vector;
 using std::string;
 
 #include "gui_rpc_client.h"
+#include "gui_rpc_multi.h"
 #include "error_numbers.h"
 #include "util.h"
 #include "str_util.h"
@@ -54,7 +56,10 @@ void version(){
 
 void usage() {
     fprintf(stderr, "\n\
-usage: boinccmd [--host hostname] [--passwd passwd] command\n\n\
+usage: boinccmd [--host hostname] [--passwd passwd] command\n\
+   or: boinccmd --hosts file [--passwd passwd] [--max_connections N] command\n\
+   (run command on the hosts listed in file, one per line:\n\
+   hostname[:port] [passwd]; output is a line of JSON per host)\n\n\
 Commands:\n\
  --create_account URL email passwd name\n\
  --file_transfer URL filename op    file transfer operation\n\
@@ -63,6 +68,7 @@ Commands:\n\
  --get_daily_xfer_history           show network traffic history\n\
  --get_disk_usage                   show disk usage\n\
  --get_file_transfers               show file transfers\n\
+ --get_gpu_telemetry                show GPU utilization, memory etc.\n\
  --get_host_info\n\
  --get_message_count                show largest message seqno\n\
  --get_messages [ seqno ]           show messages > seqno\n\
@@ -119,13 +125,241 @@ const char* prio_name(int prio) {
     return "unknown";
 }
 
+// --hosts mode: run a command on many hosts at once,
+// using RPC_MULTI, with at most max_connections open at a time.
+// Only commands that are a single RPC are supported.
+// The output for each host is a line of JSON:
+// {"host": "name", "retval": 0, "error": "...", "reply": "..."}
+// error is present if retval is nonzero;
+// reply (the client's XML reply) for commands that get information.
+//
+struct FLEET_RPC : ASYNC_RPC {
+    string name;
+        // hostname[:port], as in the hosts file
+    string passwd;
+    RPC_HOST* host;
+        // while it's in the RPC_MULTI
+    bool is_op;
+        // the reply is just success or failure
+    bool done;
+    int retval;
+
+    FLEET_RPC(const char* req) : ASYNC_RPC(req) {
+        host = NULL;
+        is_op = false;
+        done = false;
+        retval = 0;
+    }
+    void handle_reply(int rpc_retval, char* reply) {
+        string out = "{\"host\": \"";
+        char buf[256];
+
+        retval = rpc_retval;
+        if (!retval && strstr(reply, "<unauthorized")) {
+            retval = ERR_AUTHENTICATOR;
+        }
+        if (!retval && is_op) {
+            RPC rpc(NULL);
+            rpc.fin.init_buf_read(reply);
+            retval = rpc.parse_reply();
+        }
+        json_escape(name.c_str(), out);
+        sprintf(buf, "\", \"retval\": %d", retval);
+        out += buf;
+        if (retval) {
+            out += ", \"error\": \"";
+            json_escape(boincerror(retval), out);
+            out += "\"";
+        } else if (!is_op) {
+            out += ", \"reply\": \"";
+            json_escape(reply, out);
+            out += "\"";
+        }
+        out += "}";
+        printf("%s\n", out.c_str());
+        fflush(stdout);
+        done = true;
+    }
+};
+
+static const char* fleet_mode_name(const char* op) {
+    if (!strcmp(op, "always")) return "<always/>";
+    if (!strcmp(op, "auto")) return "<auto/>";
+    if (!strcmp(op, "never")) return "<never/>";
+    fprintf(stderr, "Unknown op %s\n", op);
+    exit(1);
+}
+
+// the RPC request for a command; exit if not supported
+//
+static void fleet_request(
+    const char* cmd, int argc, char** argv, int& i, string& req, bool& is_op
+) {
+    char buf[1024];
+    is_op = false;
+    if (!strcmp(cmd, "--get_state")) {
+        req = "<get_state/>\n";
+    } else if (!strcmp(cmd, "--get_tasks")) {
+        req = "<get_results>\n<active_only>0</active_only>\n</get_results>\n";
+    } else if (!strcmp(cmd, "--get_old_tasks")) {
+        req = "<get_old_results/>\n";
+    } else if (!strcmp(cmd, "--get_file_transfers")) {
+        req = "<get_file_transfers/>\n";
+    } else if (!strcmp(cmd, "--get_daily_xfer_history")) {
+        req = "<get_daily_xfer_history/>\n";
+    } else if (!strcmp(cmd, "--get_gpu_telemetry")) {
+        req = "<get_gpu_telemetry/>\n";
+    } else if (!strcmp(cmd, "--get_project_status")) {
+        req = "<get_project_status/>\n";
+    } else if (!strcmp(cmd, "--get_simple_gui_info")) {
+        req = "<get_simple_gui_info/>\n";
+    } else if (!strcmp(cmd, "--get_disk_usage")) {
+        req = "<get_disk_usage/>\n";
+    } else if (!strcmp(cmd, "--get_host_info")) {
+        req = "<get_host_info/>\n";
+    } else if (!strcmp(cmd, "--get_cc_status")) {
+        req = "<get_cc_status/>\n";
+    } else if (!strcmp(cmd, "--get_proxy_settings")) {
+        req = "<get_proxy_settings/>\n";
+    } else if (!strcmp(cmd, "--get_message_count")) {
+        req = "<get_message_count/>\n";
+    } else if (!strcmp(cmd, "--get_messages")) {
+        int seqno = (i == argc)?0:atoi(next_arg(argc, argv, i));
+        sprintf(buf, "<get_messages>\n<seqno>%d</seqno>\n</get_messages>\n", seqno);
+        req = buf;
+    } else if (!strcmp(cmd, "--get_notices")) {
+        int seqno = (i == argc)?0:atoi(next_arg(argc, argv, i));
+        sprintf(buf, "<get_notices>\n<seqno>%d</seqno>\n</get_notices>\n", seqno);
+        req = buf;
+    } else if (!strcmp(cmd, "--project")) {
+        char url[256];
+        safe_strcpy(url, next_arg(argc, argv, i));
+        canonicalize_master_url(url, sizeof(url));
+        char* op = next_arg(argc, argv, i);
+        if (strcmp(op, "reset") && strcmp(op, "detach") && strcmp(op, "update")
+            && strcmp(op, "suspend") && strcmp(op, "resume")
+            && strcmp(op, "nomorework") && strcmp(op, "allowmorework")
+            && strcmp(op, "detach_when_done") && strcmp(op, "dont_detach_when_done")
+        ) {
+            fprintf(stderr, "Unknown op %s\n", op);
+            exit(1);
+        }
+        snprintf(buf, sizeof(buf),
+            "<project_%s>\n  <project_url>%s</project_url>\n</project_%s>\n",
+            op, url, op
+        );
+        req = buf;
+        is_op = true;
+    } else if (!strcmp(cmd, "--set_run_mode")
+        || !strcmp(cmd, "--set_gpu_mode")
+        || !strcmp(cmd, "--set_network_mode")
+    ) {
+        char* op = next_arg(argc, argv, i);
+        double duration = 0;
+        if (i < argc && argv[i][0] != '-') {
+            duration = atof(next_arg(argc, argv, i));
+        }
+        sprintf(buf, "<%s>\n%s\n  <duration>%f</duration>\n</%s>\n",
+            cmd+2, fleet_mode_name(op), duration, cmd+2
+        );
+        req = buf;
+        is_op = true;
+    } else if (!strcmp(cmd, "--network_available")) {
+        req = "<network_available/>\n";
+        is_op = true;
+    } else if (!strcmp(cmd, "--run_benchmarks")) {
+        req = "<run_benchmarks/>\n";
+        is_op = true;
+    } else if (!strcmp(cmd, "--read_cc_config")) {
+        req = "<read_cc_config/>\n";
+        is_op = true;
+    } else if (!strcmp(cmd, "--read_global_prefs_override")) {
+        req = "<read_global_prefs_override/>\n";
+        is_op = true;
+    } else if (!strcmp(cmd, "--quit")) {
+        req = "<quit/>\n";
+        is_op = true;
+    } else {
+        fprintf(stderr, "%s isn't supported with --hosts\n", cmd);
+        exit(1);
+    }
+}
+
+static int fleet_main(
+    const char* hosts_file, const char* passwd, int max_connections,
+    int argc, char** argv, int& i
+) {
+    char buf[1024], name[256], host_passwd[256], *p;
+    vector<FLEET_RPC*> rpcs;
+    unsigned int j, next=0;
+    int n, port, nactive=0, nfailed=0;
+    string req;
+    bool is_op;
+    RPC_MULTI multi;
+
+    char* cmd = next_arg(argc, argv, i);
+    fleet_request(cmd, argc, argv, i, req, is_op);
+
+    FILE* f = fopen(hosts_file, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", hosts_file);
+        return ERR_FOPEN;
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        strip_whitespace(buf);
+        if (!strlen(buf) || buf[0] == '#') continue;
+        n = sscanf(buf, "%255s %255s", name, host_passwd);
+        if (n < 1) continue;
+        FLEET_RPC* rp = new FLEET_RPC(req.c_str());
+        rp->name = name;
+        rp->passwd = (n < 2)?passwd:host_passwd;
+        rp->is_op = is_op;
+        rpcs.push_back(rp);
+    }
+    fclose(f);
+
+    // hosts are added to the RPC_MULTI as others finish,
+    // so that at most max_connections are open
+    //
+    while (1) {
+        while (nactive < max_connections && next < rpcs.size()) {
+            FLEET_RPC* rp = rpcs[next++];
+            safe_strcpy(name, rp->name.c_str());
+            port = GUI_RPC_PORT;
+            p = strchr(name, ':');
+            if (p) {
+                port = atoi(p+1);
+                *p = 0;
+            }
+            rp->host = multi.add_host(name, port, rp->passwd.c_str());
+            rp->host->request(rp);
+            nactive++;
+        }
+        if (!nactive) break;
+        multi.poll(1);
+        for (j=0; j<next; j++) {
+            FLEET_RPC* rp = rpcs[j];
+            if (!rp->done || !rp->host) continue;
+            multi.remove_host(rp->host);
+            rp->host = NULL;
+            nactive--;
+            if (rp->retval) nfailed++;
+        }
+    }
+    for (j=0; j<rpcs.size(); j++) {
+        delete rpcs[j];
+    }
+    return nfailed?1:0;
+}
+
 int main(int argc, char** argv) {
     RPC_CLIENT rpc;
     int i, retval, port=0;
     MESSAGES messages;
     NOTICES notices;
     char passwd_buf[256], hostname_buf[256], *hostname=0;
-    char* passwd = passwd_buf, *p;
+    char* passwd = passwd_buf, *p, *hosts_file=0;
+    int max_connections = 100;
 
 #ifdef _WIN32
     chdir_to_data_dir();
@@ -148,7 +382,11 @@ int main(int argc, char** argv) {
     if (!strcmp(argv[i], "--version")) version();
     if (!strcmp(argv[i], "-V"))     version();
 
-    if (!strcmp(argv[i], "--host")) {
+    if (!strcmp(argv[i], "--hosts")) {
+        if (++i == argc) usage();
+        hosts_file = argv[i];
+        i++;
+    } else if (!strcmp(argv[i], "--host")) {
         if (++i == argc) usage();
         strlcpy(hostname_buf, argv[i], sizeof(hostname_buf));
         hostname = hostname_buf;
@@ -164,6 +402,21 @@ int main(int argc, char** argv) {
         passwd = argv[i];
         i++;
     }
+    if (hosts_file) {
+        if ((i<argc) && !strcmp(argv[i], "--max_connections")) {
+            if (++i == argc) usage();
+            max_connections = atoi(argv[i]);
+            if (max_connections < 1) max_connections = 1;
+            i++;
+        }
+        retval = fleet_main(
+            hosts_file, passwd, max_connections, argc, argv, i
+        );
+#if defined(_WIN32) && defined(USE_WINSOCK)
+        WSACleanup();
+#endif
+        exit(retval);
+    }
 
     // change the following to debug GUI RPC's asynchronous connection mechanism
     //
@@ -223,6 +476,10 @@ int main(int argc, char** argv) {
         DAILY_XFER_HISTORY dxh;
         retval = rpc.get_daily_xfer_history(dxh);
         if (!retval) dxh.print();
+    } else if (!strcmp(cmd, "--get_gpu_telemetry")) {
+        GPU_TELEMETRY_INFO gti;
+        retval = rpc.get_gpu_telemetry(gti);
+        if (!retval) gti.print();
     } else if (!strcmp(cmd, "--get_project_status")) {
         PROJECTS ps;
         retval = rpc.get_project_status(ps);
@@ -0,0 +1,218 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linux: if <use_cgroups> is set in cc_config.xml,
+// run each task in its own cgroup (v2).  Then
+// - suspend/resume uses cgroup.freeze
+//   rather than process-control messages;
+// - CPU throttling uses cpu.max
+//   rather than suspending and resuming tasks every second;
+// - memory.high is set to the RAM limit, so the kernel
+//   reclaims a task's memory rather than letting it exceed the limit.
+//
+// A cgroup that has controllers enabled for its children
+// can't contain processes, so the client moves itself
+// into a child "boinc_client" of its cgroup,
+// and tasks get siblings "boinc_slot_N".
+// This requires that the client's cgroup be delegated to it
+// (e.g. Delegate=yes in the systemd unit).
+// If setup fails, we don't use cgroups.
+
+#ifdef __linux__
+
+#include "config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "error_numbers.h"
+#include "str_util.h"
+#include "str_replace.h"
+
+#include "client_msgs.h"
+
+#include "cgroup.h"
+
+static char cgroup_base[MAXPATHLEN];
+    // the client's original cgroup dir; empty if not using cgroups
+static bool have_cpu, have_memory, have_cpuset;
+    // whether these controllers are enabled for tasks
+
+// Use write() rather than stdio;
+// the kernel reports errors at write time.
+//
+static int write_cgroup_file(
+    const char* dir, const char* name, const char* val
+) {
+    char path[MAXPATHLEN];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return ERR_FOPEN;
+    int n = (int)strlen(val);
+    int retval = (write(fd, val, n) == n)?0:ERR_WRITE;
+    close(fd);
+    return retval;
+}
+
+static int make_cgroup_dir(const char* dir) {
+    if (mkdir(dir, 0755) && errno != EEXIST) return ERR_MKDIR;
+    return 0;
+}
+
+bool cgroup_init() {
+    char line[MAXPATHLEN], dir[MAXPATHLEN];
+    int retval;
+
+    FILE* f = fopen("/proc/self/cgroup", "r");
+    if (!f) {
+        msg_printf(NULL, MSG_INFO, "cgroups not available");
+        return false;
+    }
+    bool found = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3)) continue;
+        strip_whitespace(line);
+        snprintf(cgroup_base, sizeof(cgroup_base),
+            "/sys/fs/cgroup%s", line+3
+        );
+        found = true;
+        break;
+    }
+    fclose(f);
+    if (!found) {
+        msg_printf(NULL, MSG_INFO, "cgroup v2 not available");
+        return false;
+    }
+
+    snprintf(dir, sizeof(dir), "%s/boinc_client", cgroup_base);
+    retval = make_cgroup_dir(dir);
+    if (!retval) retval = write_cgroup_file(dir, "cgroup.procs", "0");
+    if (retval) {
+        msg_printf(NULL, MSG_INFO,
+            "Can't use cgroup %s: %s", cgroup_base, boincerror(retval)
+        );
+        cgroup_base[0] = 0;
+        return false;
+    }
+
+    // the controllers are optional; freezing doesn't need one
+    //
+    have_cpu = !write_cgroup_file(cgroup_base, "cgroup.subtree_control", "+cpu");
+    have_memory = !write_cgroup_file(cgroup_base, "cgroup.subtree_control", "+memory");
+    have_cpuset = !write_cgroup_file(cgroup_base, "cgroup.subtree_control", "+cpuset");
+    msg_printf(NULL, MSG_INFO,
+        "Using cgroup %s for tasks (CPU limit %s, memory limit %s, cpuset %s)",
+        cgroup_base, have_cpu?"yes":"no", have_memory?"yes":"no",
+        have_cpuset?"yes":"no"
+    );
+    return true;
+}
+
+bool cgroup_enabled() {
+    return cgroup_base[0] != 0;
+}
+
+int TASK_CGROUP::create(int slot) {
+    int retval;
+
+    clear();
+    if (!cgroup_enabled()) return ERR_NOT_FOUND;
+    snprintf(dir, sizeof(dir), "%s/boinc_slot_%d", cgroup_base, slot);
+    retval = make_cgroup_dir(dir);
+    if (retval) {
+        dir[0] = 0;
+        return retval;
+    }
+
+    // the dir may be left from an earlier run
+    //
+    write_cgroup_file(dir, "cgroup.freeze", "0");
+    if (have_cpu) write_cgroup_file(dir, "cpu.max", "max");
+    if (have_memory) write_cgroup_file(dir, "memory.high", "max");
+    if (have_cpuset) write_cgroup_file(dir, "cpuset.cpus", "\n");
+    return 0;
+}
+
+int TASK_CGROUP::enter(int pid) {
+    char buf[64];
+    sprintf(buf, "%d", pid);
+    return write_cgroup_file(dir, "cgroup.procs", buf);
+}
+
+int TASK_CGROUP::freeze(bool f) {
+    int retval = write_cgroup_file(dir, "cgroup.freeze", f?"1":"0");
+    if (!retval) frozen = f;
+    return retval;
+}
+
+int TASK_CGROUP::set_cpu_limit(double ncpus) {
+    char buf[64];
+    if (!have_cpu) return 0;
+    int quota = -1;
+    if (ncpus > 0) {
+        quota = (int)(ncpus*CGROUP_CPU_PERIOD);
+        if (quota < 1000) quota = 1000;     // kernel minimum
+    }
+    if (quota == cpu_quota) return 0;
+    if (quota < 0) {
+        sprintf(buf, "max %d", CGROUP_CPU_PERIOD);
+    } else {
+        sprintf(buf, "%d %d", quota, CGROUP_CPU_PERIOD);
+    }
+    int retval = write_cgroup_file(dir, "cpu.max", buf);
+    if (!retval) cpu_quota = quota;
+    return retval;
+}
+
+int TASK_CGROUP::set_memory_high(double x) {
+    char buf[64];
+    if (!have_memory) return 0;
+    if (x == memory_high) return 0;
+    if (x > 0) {
+        sprintf(buf, "%.0f", x);
+    } else {
+        strcpy(buf, "max");
+    }
+    int retval = write_cgroup_file(dir, "memory.high", buf);
+    if (!retval) memory_high = x;
+    return retval;
+}
+
+int TASK_CGROUP::set_cpus(const char* cpus) {
+    if (!have_cpuset) return ERR_NOT_IMPLEMENTED;
+
+    // an empty value (i.e. the parent's CPUs) must be written as a newline
+    //
+    return write_cgroup_file(dir, "cpuset.cpus", strlen(cpus)?cpus:"\n");
+}
+
+// called when the task has exited.
+// This fails if any of its descendants are still around;
+// in that case we'll reuse the dir.
+//
+void TASK_CGROUP::remove() {
+    if (!active()) return;
+    if (frozen) freeze(false);
+    rmdir(dir);
+    clear();
+}
+
+#endif
@@ -0,0 +1,67 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linux: control tasks through cgroups (v2); see cgroup.cpp
+
+#ifndef _CGROUP_
+#define _CGROUP_
+
+#include <sys/param.h>
+
+#define CGROUP_CPU_PERIOD   100000
+    // cpu.max period, usec
+
+struct TASK_CGROUP {
+    char dir[MAXPATHLEN];
+        // the task's cgroup dir; empty if none
+    bool frozen;
+    int cpu_quota;
+        // last values written; -1 means "max"
+    double memory_high;
+
+    TASK_CGROUP() {
+        clear();
+    }
+    void clear() {
+        dir[0] = 0;
+        frozen = false;
+        cpu_quota = -1;
+        memory_high = 0;
+    }
+    inline bool active() {
+        return dir[0] != 0;
+    }
+    int create(int slot);
+    int enter(int pid);
+        // move a process into the cgroup; 0 means the caller.
+        // Uses stdio, so don't call it in a vfork()ed child.
+    int freeze(bool);
+    int set_cpu_limit(double ncpus);
+        // limit to the given number of CPUs; <= 0 means no limit
+    int set_memory_high(double);
+        // 0 means no limit
+    int set_cpus(const char*);
+        // cpuset.cpus (e.g. "0-3,8"); "" means all.
+        // Returns ERR_NOT_IMPLEMENTED if there's no cpuset controller
+    void remove();
+};
+
+extern bool cgroup_init();
+    // see if we can use cgroups; if so, set up the client's cgroup
+extern bool cgroup_enabled();
+
+#endif
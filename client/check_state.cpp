@@ -206,6 +206,7 @@ void CLIENT_STATE::free_mem() {
         delete app;
     }
 
+    file_info_index.clear();
     fi_iter = file_infos.begin();
     while (fi_iter != file_infos.end()) {
         fi = file_infos[0];
@@ -220,6 +221,7 @@ void CLIENT_STATE::free_mem() {
         delete av;
     }
 
+    workunit_index.clear();
     wu_iter = workunits.begin();
     while (wu_iter != workunits.end()) {
         wu = workunits[0];
@@ -227,6 +229,7 @@ void CLIENT_STATE::free_mem() {
         delete wu;
     }
 
+    result_index.clear();
     res_iter = results.begin();
     while (res_iter != results.end()) {
         res = results[0];
@@ -240,7 +243,7 @@ void CLIENT_STATE::free_mem() {
     delete http_ops;
     delete file_xfers;
     delete pers_file_xfers;
-    delete scheduler_op;
+    delete scheduler_ops;
 
     notices.clear();
     rss_feeds.clear();
@@ -170,49 +170,52 @@ void msg_printf_notice(PROJ_AM *p, bool is_html, const char* link, const char *f
 // If high priority, create a notice.
 //
 void MESSAGE_DESCS::insert(PROJ_AM* p, int priority, int now, char* message) {
-    MESSAGE_DESC* mdp = new MESSAGE_DESC;
     static int seqno = 1;
+    const char* name = "";
     if (p) {
-        strlcpy(
-            mdp->project_name, p->get_project_name(), sizeof(mdp->project_name)
-        );
-    } else {
-        strcpy(mdp->project_name, "");
+        name = project_names.insert(string(p->get_project_name())).first->c_str();
     }
-    mdp->priority = (priority==MSG_SCHEDULER_ALERT)?MSG_USER_ALERT:priority;
-    mdp->timestamp = now;
-    mdp->seqno = seqno++;
-    mdp->message = message;
-    while (msgs.size() > MAX_SAVED_MESSAGES) {
-        delete msgs.back();
-        msgs.pop_back();
+    msgs.push_back(MESSAGE_DESC());
+    MESSAGE_DESC& md = msgs.back();
+    md.project_name = name;
+    md.priority = (priority==MSG_SCHEDULER_ALERT)?MSG_USER_ALERT:priority;
+    md.timestamp = now;
+    md.seqno = seqno++;
+    md.message = message;
+    nbytes += md.message.size();
+
+    // always keep the newest message
+    //
+    while (nbytes > MAX_SAVED_MESSAGE_BYTES && msgs.size() > 1) {
+        nbytes -= msgs.front().message.size();
+        msgs.pop_front();
     }
-    msgs.push_front(mdp);
 }
 
-void MESSAGE_DESCS::write(int seqno, MIOFILE& fout, bool translatable) {
-    int i, j;
-    unsigned int k;
-    MESSAGE_DESC* mdp;
+void MESSAGE_DESCS::write(
+    int seqno, MIOFILE& fout, bool translatable,
+    int limit, const char* project
+) {
+    size_t i, j;
+    int n=0;
     char buf[1024];
 
-    // messages are stored in descreasing seqno,
-    // i.e. newer ones are at the head of the vector.
+    // messages are stored in increasing (consecutive) seqno.
     // compute j = index of first message to return
     //
-    j = (int)msgs.size()-1;
-    for (k=0; k<msgs.size(); k++) {
-        mdp = msgs[k];
-        if (mdp->seqno <= seqno) {
-            j = k-1;
-            break;
-        }
+    j = 0;
+    if (msgs.size() && seqno >= msgs.front().seqno) {
+        j = seqno - msgs.front().seqno + 1;
     }
 
     fout.printf("<msgs>\n");
-    for (i=j; i>=0; i--) {
-        mdp = msgs[i];
-        safe_strcpy(buf, mdp->message.c_str());
+    for (i=j; i<msgs.size(); i++) {
+        MESSAGE_DESC& md = msgs[i];
+        if (project && strlen(project) && strcmp(project, md.project_name)) {
+            continue;
+        }
+        if (limit && n++ >= limit) break;
+        safe_strcpy(buf, md.message.c_str());
         if (!translatable) {
             strip_translation(buf);
         }
@@ -223,11 +226,11 @@ void MESSAGE_DESCS::write(int seqno, MIOFILE& fout, bool translatable) {
             " <seqno>%d</seqno>\n"
             " <body>\n%s\n</body>\n"
             " <time>%d</time>\n",
-            mdp->project_name,
-            mdp->priority,
-            mdp->seqno,
+            md.project_name,
+            md.priority,
+            md.seqno,
             buf,
-            mdp->timestamp
+            md.timestamp
         );
         fout.printf("</msg>\n");
     }
@@ -235,15 +238,14 @@ void MESSAGE_DESCS::write(int seqno, MIOFILE& fout, bool translatable) {
 }
 
 int MESSAGE_DESCS::highest_seqno() {
-    if (msgs.size()) return msgs[0]->seqno;
+    if (msgs.size()) return msgs.back().seqno;
     return 0;
 }
 
 void MESSAGE_DESCS::cleanup() {
-    for (unsigned int i=0; i<msgs.size(); i++) {
-        delete msgs[i];
-    }
     msgs.clear();
+    project_names.clear();
+    nbytes = 0;
 }
 
 string app_list_string(PROJECT* p) {
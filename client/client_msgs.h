@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <deque>
+#include <set>
 #include <string>
 #include <string.h>
 
@@ -29,22 +30,41 @@
 // stores a message in memory, where it can be retrieved via RPC
 
 struct MESSAGE_DESC {
-    char project_name[256];
+    const char* project_name;
+        // interned (see MESSAGE_DESCS::project_names); "" if none
     int priority;
     int timestamp;
     int seqno;
     std::string message;
 };
 
-#define MAX_SAVED_MESSAGES 2000
+// how much message text to keep
+//
+#define MAX_SAVED_MESSAGE_BYTES (1024*1024)
 
-// a cache of MAX_SAVED_MESSAGES most recent messages,
-// stored in newest-first order
+// a cache of the most recent messages
+// (up to MAX_SAVED_MESSAGE_BYTES of text), oldest first.
+// Seqnos are consecutive, so the message with a given seqno
+// is found by subtracting the first one's seqno.
 //
 struct MESSAGE_DESCS {
-    std::deque<MESSAGE_DESC*> msgs;
+    std::deque<MESSAGE_DESC> msgs;
+    size_t nbytes;
+        // total length of the messages in msgs
+    std::set<std::string> project_names;
+        // each project name is stored once
+
+    MESSAGE_DESCS() {
+        nbytes = 0;
+    }
     void insert(PROJ_AM *p, int priority, int now, char* msg);
-    void write(int seqno, class MIOFILE&, bool translatable);
+    void write(
+        int seqno, class MIOFILE&, bool translatable,
+        int limit=0, const char* project=NULL
+    );
+        // write messages after seqno, oldest first;
+        // if limit is nonzero, at most that many;
+        // if project is nonempty, only that project's
     int highest_seqno();
     void cleanup();
 };
@@ -55,6 +55,7 @@
 #include "cs_proxy.h"
 #include "cs_trickle.h"
 #include "file_names.h"
+#include "gpu_telemetry.h"
 #include "hostinfo.h"
 #include "hostinfo_network.h"
 #include "http_curl.h"
@@ -85,11 +86,11 @@ CLIENT_STATE::CLIENT_STATE()
     http_ops = new HTTP_OP_SET();
     file_xfers = new FILE_XFER_SET(http_ops);
     pers_file_xfers = new PERS_FILE_XFER_SET(file_xfers);
-#ifndef SIM
-    scheduler_op = new SCHEDULER_OP(http_ops);
-#endif
+    scheduler_ops = new SCHEDULER_OP_SET(http_ops);
     client_state_dirty = false;
+    state_file_deferred_write_time = 0;
     clock_change = false;
+    poll_flags = POLL_FLAG_ALL;
     check_all_logins = false;
     cmdline_gui_rpc_port = 0;
     run_cpu_benchmarks = false;
@@ -314,7 +315,7 @@ int CLIENT_STATE::init() {
 
     srand((unsigned int)time(0));
     now = dtime();
-    scheduler_op->url_random = drand();
+    scheduler_ops->url_random = drand();
 
     notices.init();
     daily_xfer_history.init();
@@ -589,6 +590,9 @@ int CLIENT_STATE::init() {
     delete_old_slot_dirs();
     retval = make_project_dirs();
     if (retval) return retval;
+    for (i=0; i<projects.size(); i++) {
+        init_trickle_spool(projects[i]);
+    }
 
     active_tasks.init();
     active_tasks.report_overdue();
@@ -673,6 +677,15 @@ int CLIENT_STATE::init() {
     //
     project_priority_init(false);
 
+#ifdef __linux__
+    if (config.use_cgroups) {
+        cgroup_init();
+    }
+    if (config.task_affinity) {
+        affinity_init();
+    }
+#endif
+
 #ifdef NEW_CPU_THROTTLE
     client_mutex.lock();
     throttle_thread.run(throttler, NULL);
@@ -707,7 +720,7 @@ void CLIENT_STATE::do_io_or_sleep(double x) {
         http_ops->get_fdset(curl_fds);
         all_fds = curl_fds;
         gui_rpcs.get_fdset(gui_rpc_fds, all_fds);
-        double_to_timeval(action?0:x, tv);
+        double_to_timeval(action?0:http_ops->max_select_timeout(x), tv);
 #ifdef NEW_CPU_THROTTLE
         client_mutex.unlock();
 #endif
@@ -725,6 +738,8 @@ void CLIENT_STATE::do_io_or_sleep(double x) {
         // (called from net_xfers->got_select())
         // called pretty often, even if no descriptors are enabled.
         // So do the "if (n==0) break" AFTER the got_selects().
+        // (With the event loop, got_select() calls curl only
+        // for ready sockets and expired timeouts.)
 
         http_ops->got_select(all_fds, x);
         gui_rpcs.got_select(all_fds);
@@ -855,6 +870,7 @@ bool CLIENT_STATE::poll_slow_events() {
     //
     active_tasks.get_memory_usage();
     suspend_reason = check_suspend_processing();
+    gpu_telemetry.poll();
 
     // suspend or resume activities (but only if already did startup)
     //
@@ -865,6 +881,9 @@ bool CLIENT_STATE::poll_slow_events() {
                 if (!tasks_throttled) {
                     active_tasks.suspend_all(suspend_reason);
                 }
+                if (suspend_reason != SUSPEND_REASON_CPU_THROTTLE) {
+                    set_poll_flags(POLL_FLAG_RR_SIM);
+                }
             }
             last_suspend_reason = suspend_reason;
         } else {
@@ -1042,23 +1061,15 @@ APP* CLIENT_STATE::lookup_app(PROJECT* p, const char* name) {
 }
 
 RESULT* CLIENT_STATE::lookup_result(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<results.size(); i++) {
-        RESULT* rp = results[i];
-        if (rp->project == p && !strcmp(name, rp->name)) return rp;
-    }
-    return 0;
+    return result_index.lookup(p, name);
 }
 
 WORKUNIT* CLIENT_STATE::lookup_workunit(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<workunits.size(); i++) {
-        WORKUNIT* wup = workunits[i];
-        if (wup->project == p && !strcmp(name, wup->name)) return wup;
-    }
-    return 0;
+    return workunit_index.lookup(p, name);
 }
 
 APP_VERSION* CLIENT_STATE::lookup_app_version(
-    APP* app, char* platform, int version_num, char* plan_class
+    APP* app, const char* platform, int version_num, const char* plan_class
 ) {
     for (unsigned int i=0; i<app_versions.size(); i++) {
         APP_VERSION* avp = app_versions[i];
@@ -1072,13 +1083,7 @@ APP_VERSION* CLIENT_STATE::lookup_app_version(
 }
 
 FILE_INFO* CLIENT_STATE::lookup_file_info(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<file_infos.size(); i++) {
-        FILE_INFO* fip = file_infos[i];
-        if (fip->project == p && !strcmp(fip->name, name)) {
-            return fip;
-        }
-    }
-    return 0;
+    return file_info_index.lookup(p, name);
 }
 
 // functions to create links between state objects
@@ -1292,16 +1297,41 @@ bool CLIENT_STATE::abort_unstarted_late_jobs() {
     return action;
 }
 
+// Decide whether a periodic scan should be done:
+// if its period has passed and its flag is set,
+// or if POLL_BACKSTOP_PERIOD has passed.
+// The scans look at all results or files,
+// so on hosts with lots of them we want to avoid needless ones.
+// Things that change the relevant state call set_poll_flags().
+//
+bool CLIENT_STATE::poll_due(int flag, double& last_time, double period) {
+    if (!clock_change) {
+        double dt = now - last_time;
+        if (dt < period) return false;
+        if (!(poll_flags & flag) && dt < POLL_BACKSTOP_PERIOD) return false;
+    }
+    poll_flags &= ~flag;
+    last_time = now;
+    return true;
+}
+
 bool CLIENT_STATE::garbage_collect() {
     bool action;
     static double last_time=0;
-    if (!clock_change && now - last_time < GARBAGE_COLLECT_PERIOD) return false;
-    last_time = gstate.now;
+    if (!poll_due(POLL_FLAG_GC, last_time, GARBAGE_COLLECT_PERIOD)) return false;
 
+    // if we do something, look again next time
+    //
     action = abort_unstarted_late_jobs();
-    if (action) return true;
+    if (action) {
+        set_poll_flags(POLL_FLAG_GC);
+        return true;
+    }
     action = garbage_collect_always();
-    if (action) return true;
+    if (action) {
+        set_poll_flags(POLL_FLAG_GC);
+        return true;
+    }
 
 #ifndef SIM
     // Detach projects that are marked for detach when done
@@ -1408,6 +1438,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                     );
                 }
                 add_old_result(*rp);
+                result_index.erase(rp);
                 delete rp;
                 result_iter = results.erase(result_iter);
                 action = true;
@@ -1484,6 +1515,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                     wup->name
                 );
             }
+            workunit_index.erase(wup);
             delete wup;
             wu_iter = workunits.erase(wu_iter);
             action = true;
@@ -1577,6 +1609,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                     fip->name
                 );
             }
+            file_info_index.erase(fip);
             delete fip;
             fi_iter = file_infos.erase(fi_iter);
             action = true;
@@ -1604,8 +1637,7 @@ bool CLIENT_STATE::update_results() {
     static double last_time=0;
     int retval;
 
-    if (!clock_change && now - last_time < UPDATE_RESULTS_PERIOD) return false;
-    last_time = now;
+    if (!poll_due(POLL_FLAG_RESULTS, last_time, UPDATE_RESULTS_PERIOD)) return false;
 
     result_iter = results.begin();
     while (result_iter != results.end()) {
@@ -1734,7 +1766,7 @@ int CLIENT_STATE::report_result_error(RESULT& res, const char* format, ...) {
 
     sprintf(buf, "Unrecoverable error for task %s", res.name);
 #ifndef SIM
-    scheduler_op->project_rpc_backoff(res.project, buf);
+    SCHEDULER_OP::project_rpc_backoff(res.project, buf);
 #endif
 
     sprintf( buf, "<message>\n%s\n</message>\n", err_msg);
@@ -1841,7 +1873,7 @@ int CLIENT_STATE::reset_project(PROJECT* project, bool detaching) {
 
     // if we're in the middle of a scheduler op to the project, abort it
     //
-    scheduler_op->abort(project);
+    scheduler_ops->abort(project);
 
     // abort other HTTP operations
     //
@@ -1939,6 +1971,7 @@ int CLIENT_STATE::detach_project(PROJECT* project) {
         fip = *fi_iter;
         if (fip->project == project) {
             fi_iter = file_infos.erase(fi_iter);
+            file_info_index.erase(fip);
             delete fip;
         } else {
             fi_iter++;
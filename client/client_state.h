@@ -21,6 +21,7 @@
 #define NEW_CPU_THROTTLE
 
 #ifndef _WIN32
+#include <map>
 #include <string>
 #include <vector>
 #include <ctime>
@@ -69,6 +70,46 @@ using std::vector;
     // project: no downloading or runnable results
     // overall: at least one idle CPU
 
+#define WORK_BUF_MIN_HYSTERESIS     0.25
+    // see CLIENT_STATE::work_fetch_buf_total()
+
+// An index of RESULTs, WORKUNITs or FILE_INFOs by (project, name),
+// used by the lookup functions.
+// Code that adds to or removes from results, workunits or file_infos
+// must update the corresponding index.
+// As with the previous linear search, the first object inserted
+// under a given name is the one found.
+//
+template <class T> struct NAME_INDEX {
+    typedef std::pair<PROJECT*, string> KEY;
+    typedef typename std::map<KEY, T*>::iterator ITER;
+    std::map<KEY, T*> items;
+
+    void insert(T* p) {
+        items.insert(std::make_pair(KEY(p->project, p->name), p));
+    }
+    void erase(T* p) {
+        ITER i = items.find(KEY(p->project, p->name));
+        if (i != items.end() && i->second == p) items.erase(i);
+    }
+    T* lookup(PROJECT* proj, const char* name) {
+        ITER i = items.find(KEY(proj, name));
+        if (i == items.end()) return 0;
+        return i->second;
+    }
+    void clear() {items.clear();}
+};
+
+#define POLL_FLAG_RESULTS   1
+    // update_results()
+#define POLL_FLAG_GC        2
+    // garbage_collect()
+#define POLL_FLAG_PFX       4
+    // create_and_delete_pers_file_xfers()
+#define POLL_FLAG_RR_SIM    8
+    // rr_simulation()
+#define POLL_FLAG_ALL       15
+
 // encapsulates the global variables of the core client.
 // If you add anything here, initialize it in the constructor
 //
@@ -81,6 +122,9 @@ struct CLIENT_STATE {
     vector<WORKUNIT*> workunits;
     vector<RESULT*> results;
         // list of jobs, ordered by increasing arrival time
+    NAME_INDEX<FILE_INFO> file_info_index;
+    NAME_INDEX<WORKUNIT> workunit_index;
+    NAME_INDEX<RESULT> result_index;
 
     PERS_FILE_XFER_SET* pers_file_xfers;
     HTTP_OP_SET* http_ops;
@@ -204,6 +248,12 @@ struct CLIENT_STATE {
     bool run_by_updater;
     double now;
     bool clock_change;      // system clock was recently decreased
+    int poll_flags;
+        // POLL_FLAG_* bits: state has changed in a way that
+        // a periodic scan (update_results() etc.) needs to look at.
+        // See poll_due()
+    void set_poll_flags(int f=POLL_FLAG_ALL) {poll_flags |= f;}
+    bool poll_due(int flag, double& last_time, double period);
     double last_wakeup_time;
     bool initialized;
     bool cant_write_state_file;
@@ -213,6 +263,9 @@ struct CLIENT_STATE {
         // so that the Manager can tell the user what the problem is
 
     bool client_state_dirty;
+    double state_file_deferred_write_time;
+        // if nonzero, there are deferred changes (see
+        // <state_file_write_interval>); write the state file then
     int old_major_version;
     int old_minor_version;
     int old_release;
@@ -256,7 +309,7 @@ struct CLIENT_STATE {
     RESULT* lookup_result(PROJECT*, const char*);
     WORKUNIT* lookup_workunit(PROJECT*, const char*);
     APP_VERSION* lookup_app_version(
-        APP*, char* platform, int ver, char* plan_class
+        APP*, const char* platform, int ver, const char* plan_class
     );
     int detach_project(PROJECT*);
     int report_result_error(RESULT&, const char *format, ...);
@@ -320,6 +373,7 @@ struct CLIENT_STATE {
         if (x < 1) x = 1;
         return x;
     }
+    double work_fetch_buf_total();
 
     void request_schedule_cpus(const char*);
         // Reschedule CPUs ASAP.
@@ -356,7 +410,7 @@ struct CLIENT_STATE {
         // - type <ncpus>N</ncpus> in the config file
         // - type the max_ncpus_pct pref
 
-    int latest_version(APP*, char*);
+    int latest_version(APP*, const char*);
     int app_finished(ACTIVE_TASK&);
     bool start_apps();
     bool handle_finished_apps();
@@ -429,7 +483,7 @@ struct CLIENT_STATE {
         // - result suspend/abort GUI RPC
     int make_scheduler_request(PROJECT*);
     int handle_scheduler_reply(PROJECT*, char* scheduler_url);
-    SCHEDULER_OP* scheduler_op;
+    SCHEDULER_OP_SET* scheduler_ops;
     PROJECT* next_project_master_pending();
     PROJECT* next_project_sched_rpc_pending();
     PROJECT* next_project_trickle_up_pending();
@@ -438,7 +492,7 @@ struct CLIENT_STATE {
     bool scheduler_rpc_poll();
 
 // --------------- cs_statefile.cpp:
-    void set_client_state_dirty(const char*);
+    void set_client_state_dirty(const char*, bool can_defer=false);
     int parse_state_file();
     int parse_state_file_aux(const char*);
     int write_state(MIOFILE&);
@@ -532,6 +586,10 @@ extern THREAD throttle_thread;
 #define GARBAGE_COLLECT_PERIOD  10
     // how often to garbage collect
 
+#define POLL_BACKSTOP_PERIOD    60
+    // do the scans at least this often even if no flag is set,
+    // in case of changes we don't flag (e.g. deadlines passing)
+
 #define TASK_POLL_PERIOD    1.0
 
 #define UPDATE_RESULTS_PERIOD   1.0
@@ -39,6 +39,7 @@
 
 #include "error_numbers.h"
 #include "filesys.h"
+#include "gzip_util.h"
 #include "log_flags.h"
 #include "md5.h"
 #include "parse.h"
@@ -179,6 +180,8 @@ int APP::write(MIOFILE& out) {
 FILE_INFO::FILE_INFO() {
     strcpy(name, "");
     strcpy(md5_cksum, "");
+    strcpy(download_md5, "");
+    download_md5_nbytes = 0;
     max_nbytes = 0;
     nbytes = 0;
     gzipped_nbytes = 0;
@@ -199,10 +202,12 @@ FILE_INFO::FILE_INFO() {
     project = NULL;
     download_urls.clear();
     upload_urls.clear();
-    strcpy(xml_signature, "");
-    strcpy(file_signature, "");
+    xml_signature.clear();
+    file_signature.clear();
     cert_sigs = 0;
     async_verify = NULL;
+    strcpy(verified_md5, "");
+    verified_time = 0;
 }
 
 FILE_INFO::~FILE_INFO() {
@@ -300,10 +305,9 @@ int FILE_INFO::parse(XML_PARSER& xp) {
         }
         if (xp.match_tag("xml_signature")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</xml_signature>",
-                xml_signature,
-                sizeof(xml_signature)
+                xml_signature
             );
             if (retval) return retval;
             strip_whitespace(xml_signature);
@@ -311,10 +315,9 @@ int FILE_INFO::parse(XML_PARSER& xp) {
         }
         if (xp.match_tag("file_signature")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</file_signature>",
-                file_signature,
-                sizeof(file_signature)
+                file_signature
             );
             if (retval) return retval;
             strip_whitespace(file_signature);
@@ -367,6 +370,9 @@ int FILE_INFO::parse(XML_PARSER& xp) {
         if (xp.parse_bool("sticky", sticky)) continue;
         if (xp.parse_bool("gzip_when_done", gzip_when_done)) continue;
         if (xp.parse_bool("download_gzipped", download_gzipped)) continue;
+        if (xp.parse_string("download_md5_state", download_md5_state)) continue;
+        if (xp.parse_double("download_md5_nbytes", download_md5_nbytes)) continue;
+        if (xp.parse_string("download_segments", download_segments)) continue;
         if (xp.parse_bool("signature_required", signature_required)) continue;
         if (xp.parse_bool("is_project_file", is_project_file)) continue;
         if (xp.parse_bool("no_delete", btemp)) continue;
@@ -392,7 +398,7 @@ int FILE_INFO::parse(XML_PARSER& xp) {
         }
         if (xp.match_tag("error_msg")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</error_msg>", buf2, sizeof(buf2)
             );
             if (retval) return retval;
@@ -445,9 +451,14 @@ int FILE_INFO::write(MIOFILE& out, bool to_server) {
             out.printf("    <download_gzipped/>\n");
             out.printf("    <gzipped_nbytes>%.0f</gzipped_nbytes>\n", gzipped_nbytes);
         }
+        if (download_segments.size()) {
+            out.printf("    <download_segments>%s</download_segments>\n",
+                download_segments.c_str()
+            );
+        }
         if (signature_required) out.printf("    <signature_required/>\n");
         if (is_user_file) out.printf("    <is_user_file/>\n");
-        if (strlen(file_signature)) out.printf("    <file_signature>\n%s\n</file_signature>\n", file_signature);
+        if (!file_signature.empty()) out.printf("    <file_signature>\n%s\n</file_signature>\n", file_signature.c_str());
     }
     for (i=0; i<download_urls.urls.size(); i++) {
         xml_escape(download_urls.urls[i].c_str(), buf, sizeof(buf));
@@ -458,14 +469,22 @@ int FILE_INFO::write(MIOFILE& out, bool to_server) {
         out.printf("    <upload_url>%s</upload_url>\n", buf);
     }
     if (!to_server && pers_file_xfer) {
+        pers_file_xfer->checkpoint_md5();
         retval = pers_file_xfer->write(out);
         if (retval) return retval;
     }
+    if (!to_server && download_md5_state.size()) {
+        out.printf(
+            "    <download_md5_state>%s</download_md5_state>\n"
+            "    <download_md5_nbytes>%.0f</download_md5_nbytes>\n",
+            download_md5_state.c_str(), download_md5_nbytes
+        );
+    }
     if (!to_server) {
-        if (strlen(xml_signature)) {
+        if (!xml_signature.empty()) {
             out.printf(
                 "    <xml_signature>\n%s    </xml_signature>\n",
-                xml_signature
+                xml_signature.c_str()
             );
         }
     }
@@ -516,8 +535,12 @@ int FILE_INFO::write_gui(MIOFILE& out) {
 //
 int FILE_INFO::delete_file() {
     char path[MAXPATHLEN];
+    double size;
 
     get_pathname(this, path, sizeof(path));
+    if (!file_size(path, size)) {
+        project->add_project_dir_size(-size);
+    }
     int retval = delete_project_owned_file(path, true);
 
     // files with download_gzipped set may exist
@@ -528,6 +551,16 @@ int FILE_INFO::delete_file() {
     strcat(path, "t");
     delete_project_owned_file(path, true);
 
+    // and a segmented download may be in progress
+    //
+    download_md5_state.clear();
+    if (download_segments.size()) {
+        get_pathname(this, path, sizeof(path));
+        strcat(path, ".seg");
+        delete_project_owned_file(path, true);
+        download_segments.clear();
+    }
+
     if (retval && status != FILE_NOT_PRESENT) {
         msg_printf(project, MSG_INTERNAL_ERROR, "Couldn't delete file %s", path);
     }
@@ -595,11 +628,11 @@ int FILE_INFO::merge_info(FILE_INFO& new_info) {
 
     // replace signatures
     //
-    if (strlen(new_info.file_signature)) {
-        safe_strcpy(file_signature, new_info.file_signature);
+    if (!new_info.file_signature.empty()) {
+        file_signature = new_info.file_signature;
     }
-    if (strlen(new_info.xml_signature)) {
-        safe_strcpy(xml_signature, new_info.xml_signature);
+    if (!new_info.xml_signature.empty()) {
+        xml_signature = new_info.xml_signature;
     }
 
     // If the file is supposed to be executable and is PRESENT,
@@ -655,28 +688,17 @@ void FILE_INFO::failure_message(string& s) {
 }
 
 #define BUFSIZE 16384
+
 int FILE_INFO::gzip() {
-    char buf[BUFSIZE];
     char inpath[MAXPATHLEN], outpath[MAXPATHLEN];
 
     get_pathname(this, inpath, sizeof(inpath));
     safe_strcpy(outpath, inpath);
     safe_strcat(outpath, ".gz");
-    FILE* in = boinc_fopen(inpath, "rb");
-    if (!in) return ERR_FOPEN;
-    gzFile out = gzopen(outpath, "wb");
-    while (1) {
-        int n = (int)fread(buf, 1, BUFSIZE, in);
-        if (n <= 0) break;
-        int m = gzwrite(out, buf, n);
-        if (m != n) {
-            fclose(in);
-            gzclose(out);
-            return ERR_WRITE;
-        }
-    }
-    fclose(in);
-    gzclose(out);
+    int retval = gzip_file(
+        inpath, outpath, Z_DEFAULT_COMPRESSION, gstate.ncpus
+    );
+    if (retval) return retval;
     delete_project_owned_file(inpath, true);
     boinc_rename(outpath, inpath);
     return 0;
@@ -741,6 +763,9 @@ void APP_VERSION::init() {
     app = NULL;
     project = NULL;
     flops = gstate.host_info.p_fpops;
+    dcf = 1;
+    dcf_njobs = 0;
+    mem_bw = 0;
     missing_coproc = false;
     strcpy(missing_coproc_name, "");
     dont_throttle = false;
@@ -820,6 +845,9 @@ int APP_VERSION::parse(XML_PARSER& xp) {
             }
             continue;
         }
+        if (xp.parse_double("dcf", dcf)) continue;
+        if (xp.parse_int("dcf_njobs", dcf_njobs)) continue;
+        if (xp.parse_double("mem_bw", mem_bw)) continue;
         if (xp.parse_str("cmdline", cmdline, sizeof(cmdline))) continue;
         if (xp.parse_str("file_prefix", file_prefix, sizeof(file_prefix))) continue;
         if (xp.parse_double("gpu_ram", gpu_ram)) continue;
@@ -889,6 +917,16 @@ int APP_VERSION::write(MIOFILE& out, bool write_file_info) {
     if (strlen(file_prefix)) {
         out.printf("    <file_prefix>%s</file_prefix>\n", file_prefix);
     }
+    if (dcf_njobs) {
+        out.printf(
+            "    <dcf>%f</dcf>\n"
+            "    <dcf_njobs>%d</dcf_njobs>\n",
+            dcf, dcf_njobs
+        );
+    }
+    if (mem_bw) {
+        out.printf("    <mem_bw>%f</mem_bw>\n", mem_bw);
+    }
     if (write_file_info) {
         for (i=0; i<app_files.size(); i++) {
             retval = app_files[i].write(out);
@@ -981,6 +1019,13 @@ void APP_VERSION::clear_errors() {
     }
 }
 
+// use this version's own DCF once it has some history
+//
+double APP_VERSION::duration_correction_factor() {
+    if (dcf_njobs) return dcf;
+    return project->duration_correction_factor;
+}
+
 int APP_VERSION::api_major_version() {
     int v, n;
     n = sscanf(api_version, "%d", &v);
@@ -1041,9 +1086,10 @@ int FILE_REF::write(MIOFILE& out) {
 int WORKUNIT::parse(XML_PARSER& xp) {
     FILE_REF file_ref;
     double dtemp;
+    char buf[256];
 
     strcpy(name, "");
-    strcpy(app_name, "");
+    app_name = "";
     version_num = 0;
     command_line = "";
     //strcpy(env_vars, "");
@@ -1058,7 +1104,10 @@ int WORKUNIT::parse(XML_PARSER& xp) {
     while (!xp.get_tag()) {
         if (xp.match_tag("/workunit")) return 0;
         if (xp.parse_str("name", name, sizeof(name))) continue;
-        if (xp.parse_str("app_name", app_name, sizeof(app_name))) continue;
+        if (xp.parse_str("app_name", buf, sizeof(buf))) {
+            app_name = intern_string(buf);
+            continue;
+        }
         if (xp.parse_int("version_num", version_num)) continue;
         if (xp.parse_string("command_line", command_line)) {
             strip_whitespace(command_line);
@@ -39,6 +39,7 @@
 #include "hostinfo.h"
 #include "md5_file.h"
 #include "miofile.h"
+#include "obj_pool.h"
 
 #include "cs_notice.h"
 #include "cs_trickle.h"
@@ -56,6 +57,10 @@
 #define MAX_COPROCS_PER_JOB 8
     // max # of instances of a GPU that a job can use
 
+#define MEM_HEAVY_BW        1e9
+    // a task whose memory traffic (bytes per CPU second)
+    // exceeds this is memory-heavy
+
 extern int rsc_index(const char*);
 extern const char* rsc_name(int);
 extern COPROCS coprocs;
@@ -93,6 +98,27 @@ struct URL_LIST {
     }
 };
 
+// a file's metadata, used to tell if it may have changed
+//
+struct FILE_STAMP {
+    double ino;
+    double size;
+    double mtime;
+    double mtime_ns;
+    double ctime;
+
+    FILE_STAMP() {clear();}
+    void clear() {ino = size = mtime = mtime_ns = ctime = 0;}
+    int get(const char* path);
+    bool operator==(const FILE_STAMP& s) const {
+        return ino == s.ino && size == s.size && mtime == s.mtime
+            && mtime_ns == s.mtime_ns && ctime == s.ctime;
+    }
+};
+
+#define VERIFY_CACHE_PERIOD     86400
+    // see FILE_INFO::verified_md5
+
 struct FILE_INFO {
     char name[256];
     char md5_cksum[MD5_LEN];
@@ -121,18 +147,44 @@ struct FILE_INFO {
     URL_LIST upload_urls;
     bool download_gzipped;
         // if set, download NAME.gz and gunzip it to NAME
-    char xml_signature[MAX_SIGNATURE_LEN];
+    std::string xml_signature;
         // the upload signature
-    char file_signature[MAX_SIGNATURE_LEN];
+    std::string file_signature;
         // if the file itself is signed (for executable files)
-        // this is the signature
+        // this is the signature.
+        // Strings, since most files have neither
     std::string error_msg;
         // if permanent error occurs during file xfer, it's recorded here
     CERT_SIGS* cert_sigs;
     ASYNC_VERIFY* async_verify;
+    char download_md5[MD5_LEN];
+        // MD5 of the file, computed while it was downloaded;
+        // used (and cleared) by verify_file()
+    std::string download_md5_state;
+    double download_md5_nbytes;
+        // for a partial download: MD5 state (see MD5_STATE::save())
+        // after the first download_md5_nbytes bytes,
+        // so the MD5 can be computed incrementally when it resumes
+    std::string download_segments;
+        // for a segmented download in progress (see file_xfer.cpp)
+        // one char per segment, '1' if it's done
+    char verified_md5[MD5_LEN];
+    FILE_STAMP verified_stamp;
+    double verified_time;
+        // the file's MD5 when verify_file() last checked its contents,
+        // its metadata then, and when that was (not saved in state file).
+        // If the metadata hasn't changed, verify_file() uses this MD5
+        // rather than reading the file again,
+        // for up to VERIFY_CACHE_PERIOD seconds.
 
     FILE_INFO();
     ~FILE_INFO();
+    static void* operator new(size_t n) {
+        return OBJ_POOL<FILE_INFO>::alloc(n);
+    }
+    static void operator delete(void* p, size_t n) {
+        OBJ_POOL<FILE_INFO>::free(p, n);
+    }
     void reset();
     int set_permissions(const char* path=0);
     int parse(XML_PARSER&);
@@ -250,6 +302,9 @@ struct APP {
         // Can also specify in client_state.xml (for client emulator)
     int n_concurrent;
         // temp during job scheduling, to enforce max_concurrent
+    int mem_heavy;
+        // from app_config.xml: 1 if the app's jobs are memory-heavy,
+        // -1 if not, 0 to classify by measurement
     int non_excluded_instances[MAX_RSC];
         // for each resource type, bitmap of the non-excluded instances
 #ifdef SIM
@@ -283,6 +338,13 @@ struct APP_VERSION {
     GPU_USAGE gpu_usage;    // can only use 1 GPUtype
     double gpu_ram;
     double flops;
+    double dcf;
+        // duration correction factor for this app version's jobs.
+        // Used instead of the project's DCF once dcf_njobs > 0,
+        // since a project's CPU and GPU versions may be way off
+        // in different directions.
+    int dcf_njobs;
+        // number of completed jobs that have contributed to dcf
     char cmdline[256];
         // additional cmdline args
     char file_prefix[256];
@@ -302,6 +364,9 @@ struct APP_VERSION {
         // to use this much RAM,
         // so that we don't run a long sequence of jobs,
         // each of which turns out not to fit in available RAM
+    double mem_bw;
+        // memory traffic of tasks using this app version,
+        // in bytes per CPU second (from hardware counters); 0 if unknown
     bool missing_coproc;
     double missing_coproc_usage;
     char missing_coproc_name[256];
@@ -325,17 +390,23 @@ struct APP_VERSION {
     void get_file_errors(std::string&);
     void clear_errors();
     int api_major_version();
+    inline bool is_mem_heavy() {
+        if (app && app->mem_heavy) return app->mem_heavy > 0;
+        return mem_bw > MEM_HEAVY_BW;
+    }
     inline bool uses_coproc(int rt) {
         return (gpu_usage.rsc_type == rt);
     }
     inline int rsc_type() {
         return gpu_usage.rsc_type;
     }
+    double duration_correction_factor();
 };
 
 struct WORKUNIT {
     char name[256];
-    char app_name[256];
+    const char* app_name;
+        // interned (see intern_string())
     int version_num;
         // Deprecated, but need to keep around to let people revert
         // to versions before multi-platform support
@@ -349,8 +420,16 @@ struct WORKUNIT {
     double rsc_memory_bound;
     double rsc_disk_bound;
 
-    WORKUNIT(){}
+    WORKUNIT() {
+        app_name = "";
+    }
     ~WORKUNIT(){}
+    static void* operator new(size_t n) {
+        return OBJ_POOL<WORKUNIT>::alloc(n);
+    }
+    static void operator delete(void* p, size_t n) {
+        OBJ_POOL<WORKUNIT>::free(p, n);
+    }
     int parse(XML_PARSER&);
     int write(MIOFILE&);
     bool had_download_failure(int& failnum);
@@ -0,0 +1,467 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linux: if <task_affinity> is set in cc_config.xml,
+// place running tasks on CPUs, so that the kernel doesn't move them
+// between caches and NUMA nodes.
+//
+// The topology (NUMA nodes, last-level caches, cores)
+// is read from /sys at startup.
+// Each running CPU task gets its own set of round(avg_ncpus) CPUs,
+// if possible sharing a last-level cache, or else on one NUMA node.
+// Within a cache, different cores are used before hardware threads.
+// Tasks keep their CPUs as long as they run.
+// GPU tasks get the CPUs of their GPU's NUMA node (not exclusively).
+// If there aren't enough free CPUs, a task isn't restricted.
+//
+// The CPUs are set with the task's cgroup (cpuset.cpus) if it has one,
+// and otherwise with sched_setaffinity() on each thread
+// of the task's processes.
+
+#ifdef __linux__
+
+#include "config.h"
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <dirent.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "proc_control.h"
+#include "str_replace.h"
+
+#include "app.h"
+#include "client_msgs.h"
+#include "client_state.h"
+#include "log_flags.h"
+#include "result.h"
+
+#include "cpu_affinity.h"
+
+using std::vector;
+
+static vector<CPU_TOPO> topo;
+    // online CPUs, in placement order
+static int max_cpu_id = -1;
+
+// parse a list like "0-3,8,10-11"
+//
+static void parse_cpu_list(const char* p, vector<int>& cpus) {
+    cpus.clear();
+    while (*p) {
+        char* end;
+        long a = strtol(p, &end, 10);
+        if (end == p) break;
+        long b = a;
+        p = end;
+        if (*p == '-') {
+            b = strtol(p+1, &end, 10);
+            p = end;
+        }
+        for (long i=a; i<=b; i++) {
+            cpus.push_back((int)i);
+        }
+        if (*p != ',') break;
+        p++;
+    }
+}
+
+static int read_cpu_list(const char* path, vector<int>& cpus) {
+    char buf[4096];
+    cpus.clear();
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    if (!fgets(buf, sizeof(buf), f)) buf[0] = 0;
+    fclose(f);
+    parse_cpu_list(buf, cpus);
+    return cpus.empty()?ERR_NOT_FOUND:0;
+}
+
+static bool topo_order(const CPU_TOPO& a, const CPU_TOPO& b) {
+    if (a.node != b.node) return a.node < b.node;
+    if (a.cache != b.cache) return a.cache < b.cache;
+    if (a.thread != b.thread) return a.thread < b.thread;
+    return a.core < b.core;
+}
+
+void cpu_list_string(vector<int>& cpus, char* buf, int len) {
+    vector<int> c = cpus;
+    std::sort(c.begin(), c.end());
+    char* p = buf;
+    buf[0] = 0;
+    for (unsigned int i=0; i<c.size(); ) {
+        unsigned int j = i;
+        while (j+1 < c.size() && c[j+1] == c[j]+1) j++;
+        int n;
+        if (j == i) {
+            n = snprintf(p, len-(p-buf), "%s%d", (p==buf)?"":",", c[i]);
+        } else {
+            n = snprintf(p, len-(p-buf), "%s%d-%d", (p==buf)?"":",", c[i], c[j]);
+        }
+        if (n < 0 || n >= len-(p-buf)) break;
+        p += n;
+        i = j+1;
+    }
+}
+
+bool affinity_init() {
+    char path[MAXPATHLEN];
+    vector<int> online, list;
+    std::map<int, int> cpu_node;
+    int retval;
+
+    retval = read_cpu_list("/sys/devices/system/cpu/online", online);
+    if (retval) {
+        msg_printf(NULL, MSG_INFO, "Task placement: can't read CPU list");
+        return false;
+    }
+
+    // NUMA nodes; none on a non-NUMA kernel
+    //
+    int nnodes = 0;
+    DIRREF d = dir_open("/sys/devices/system/node");
+    if (d) {
+        char name[256];
+        while (!dir_scan(name, d, sizeof(name))) {
+            int node;
+            if (sscanf(name, "node%d", &node) != 1) continue;
+            snprintf(path, sizeof(path),
+                "/sys/devices/system/node/%s/cpulist", name
+            );
+            if (read_cpu_list(path, list)) continue;
+            for (unsigned int i=0; i<list.size(); i++) {
+                cpu_node[list[i]] = node;
+            }
+            nnodes++;
+        }
+        dir_close(d);
+    }
+
+    std::map<int, bool> caches;
+    topo.clear();
+    for (unsigned int i=0; i<online.size(); i++) {
+        CPU_TOPO ct;
+        ct.id = online[i];
+        ct.node = cpu_node.count(ct.id)?cpu_node[ct.id]:0;
+
+        ct.core = ct.id;
+        ct.thread = 0;
+        snprintf(path, sizeof(path),
+            "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+            ct.id
+        );
+        if (!read_cpu_list(path, list)) {
+            ct.core = list[0];
+            for (unsigned int j=0; j<list.size(); j++) {
+                if (list[j] == ct.id) ct.thread = j;
+            }
+        }
+
+        // the highest-level cache
+        //
+        ct.cache = -1;
+        int level = 0;
+        for (int j=0; ; j++) {
+            snprintf(path, sizeof(path),
+                "/sys/devices/system/cpu/cpu%d/cache/index%d/level", ct.id, j
+            );
+            FILE* f = fopen(path, "r");
+            if (!f) break;
+            int lev = 0;
+            int n = fscanf(f, "%d", &lev);
+            fclose(f);
+            if (n != 1 || lev < level) continue;
+            snprintf(path, sizeof(path),
+                "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+                ct.id, j
+            );
+            if (read_cpu_list(path, list)) continue;
+            level = lev;
+            ct.cache = list[0];
+        }
+        if (ct.cache < 0) ct.cache = ct.node;
+        caches[ct.cache] = true;
+
+        topo.push_back(ct);
+        if (ct.id > max_cpu_id) max_cpu_id = ct.id;
+    }
+    std::sort(topo.begin(), topo.end(), topo_order);
+
+    msg_printf(NULL, MSG_INFO,
+        "Task placement: %d CPUs, %d shared caches, %d NUMA nodes",
+        (int)topo.size(), (int)caches.size(), nnodes?nnodes:1
+    );
+    return true;
+}
+
+bool affinity_enabled() {
+    return !topo.empty();
+}
+
+int numa_node_count() {
+    static int n = 0;
+    if (!n) {
+        vector<int> nodes;
+        read_cpu_list("/sys/devices/system/node/online", nodes);
+        n = nodes.empty()?1:(int)nodes.size();
+    }
+    return n;
+}
+
+int gpu_numa_node(int domain, int bus, int device) {
+    char path[MAXPATHLEN];
+    int node = -1;
+    snprintf(path, sizeof(path),
+        "/sys/bus/pci/devices/%04x:%02x:%02x.0/numa_node",
+        domain, bus, device
+    );
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    if (fscanf(f, "%d", &node) != 1) node = -1;
+    fclose(f);
+    return node;
+}
+
+// set the affinity of every thread of the given process
+//
+static void set_process_affinity(int pid, cpu_set_t& set) {
+    char path[MAXPATHLEN], name[256];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIRREF d = dir_open(path);
+    if (!d) return;
+    while (!dir_scan(name, d, sizeof(name))) {
+        int tid = atoi(name);
+        if (tid) sched_setaffinity(tid, sizeof(set), &set);
+    }
+    dir_close(d);
+}
+
+// restrict the task to the given CPUs (empty means all)
+//
+static void set_task_affinity(ACTIVE_TASK* atp, vector<int>& cpus) {
+    char buf[1024];
+
+    if (atp->affinity_applied && cpus == atp->affinity) return;
+    atp->affinity = cpus;
+    atp->affinity_applied = true;
+
+    cpu_list_string(cpus, buf, sizeof(buf));
+    if (log_flags.cpu_sched_debug) {
+        msg_printf(atp->result->project, MSG_INFO,
+            "[cpu_sched_debug] %s placed on CPUs %s",
+            atp->result->name, strlen(buf)?buf:"(any)"
+        );
+    }
+    if (atp->cgroup.active() && !atp->cgroup.set_cpus(buf)) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    unsigned int i;
+    if (cpus.empty()) {
+        for (i=0; i<topo.size(); i++) CPU_SET(topo[i].id, &set);
+    } else {
+        for (i=0; i<cpus.size(); i++) CPU_SET(cpus[i], &set);
+    }
+    vector<int> pids;
+    get_descendants(atp->pid, pids);
+    pids.push_back(atp->pid);
+    for (i=0; i<pids.size(); i++) {
+        set_process_affinity(pids[i], set);
+    }
+}
+
+// choose n free CPUs: in one cache, or else on one node,
+// or else anywhere (best fit in each case).
+// If node >= 0, only on that node.
+//
+static void choose_cpus(
+    int n, int node, vector<bool>& used, vector<int>& cpus
+) {
+    std::map<int, int> cache_free, node_free;
+    unsigned int i;
+    int nfree = 0;
+
+    cpus.clear();
+    for (i=0; i<topo.size(); i++) {
+        if (used[topo[i].id]) continue;
+        if (node >= 0 && topo[i].node != node) continue;
+        cache_free[topo[i].cache]++;
+        node_free[topo[i].node]++;
+        nfree++;
+    }
+    if (nfree < n) return;
+
+    int best_cache = -1, best_node = -1;
+    int best_cache_free = 0, best_node_free = 0;
+    for (i=0; i<topo.size(); i++) {
+        CPU_TOPO& ct = topo[i];
+        if (node >= 0 && ct.node != node) continue;
+        int x = cache_free[ct.cache];
+        if (x >= n && (best_cache < 0 || x < best_cache_free)) {
+            best_cache = ct.cache;
+            best_cache_free = x;
+        }
+    }
+    for (i=0; i<topo.size(); i++) {
+        CPU_TOPO& ct = topo[i];
+        if (node >= 0 && ct.node != node) continue;
+        int x = node_free[ct.node];
+        if (x >= n && (best_node < 0 || x < best_node_free)) {
+            best_node = ct.node;
+            best_node_free = x;
+        }
+    }
+    for (i=0; i<topo.size() && (int)cpus.size() < n; i++) {
+        CPU_TOPO& ct = topo[i];
+        if (used[ct.id]) continue;
+        if (node >= 0 && ct.node != node) continue;
+        if (best_cache >= 0) {
+            if (ct.cache != best_cache) continue;
+        } else if (best_node >= 0) {
+            if (ct.node != best_node) continue;
+        }
+        cpus.push_back(ct.id);
+    }
+    for (i=0; i<cpus.size(); i++) {
+        used[cpus[i]] = true;
+    }
+}
+
+static int cpu_node(int id) {
+    for (unsigned int i=0; i<topo.size(); i++) {
+        if (topo[i].id == id) return topo[i].node;
+    }
+    return 0;
+}
+
+static inline bool more_cpus(ACTIVE_TASK* a, ACTIVE_TASK* b) {
+    return a->app_version->avg_ncpus > b->app_version->avg_ncpus;
+}
+
+// place running tasks; called periodically.
+//
+void ACTIVE_TASK_SET::update_affinity() {
+    unsigned int i, j;
+    vector<bool> used(max_cpu_id+1, false);
+    vector<ACTIVE_TASK*> cpu_tasks, unplaced;
+    vector<int> cpus;
+    std::map<int, int> heavy_per_node;
+
+    if (!affinity_enabled()) return;
+
+    for (i=0; i<active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = active_tasks[i];
+        if (atp->task_state() != PROCESS_EXECUTING) {
+            atp->affinity.clear();
+            atp->affinity_applied = false;
+            continue;
+        }
+        RESULT* rp = atp->result;
+        if (rp->uses_coprocs()) {
+            cpus.clear();
+            int rt = rp->avp->gpu_usage.rsc_type;
+            COPROC& cp = coprocs.coprocs[rt];
+            int k = rp->coproc_indices[0];
+            if (k >= 0 && k < cp.count && cp.pci_infos[k].present) {
+                int node = gpu_numa_node(
+                    cp.pci_infos[k].domain_id, cp.pci_infos[k].bus_id,
+                    cp.pci_infos[k].device_id
+                );
+                for (j=0; node >= 0 && j<topo.size(); j++) {
+                    if (topo[j].node == node) cpus.push_back(topo[j].id);
+                }
+            }
+            set_task_affinity(atp, cpus);
+            continue;
+        }
+        if (rp->non_cpu_intensive()) {
+            cpus.clear();
+            set_task_affinity(atp, cpus);
+            continue;
+        }
+        cpu_tasks.push_back(atp);
+    }
+
+    // tasks keep their CPUs if they're still free
+    //
+    for (i=0; i<cpu_tasks.size(); i++) {
+        ACTIVE_TASK* atp = cpu_tasks[i];
+        bool ok = atp->affinity_applied && !atp->affinity.empty();
+        for (j=0; ok && j<atp->affinity.size(); j++) {
+            int c = atp->affinity[j];
+            if (c > max_cpu_id || used[c]) ok = false;
+        }
+        if (ok) {
+            for (j=0; j<atp->affinity.size(); j++) {
+                used[atp->affinity[j]] = true;
+            }
+            if (atp->app_version->is_mem_heavy()) {
+                heavy_per_node[cpu_node(atp->affinity[0])]++;
+            }
+        } else {
+            unplaced.push_back(atp);
+        }
+    }
+
+    // place the others, largest first.
+    // Spread memory-heavy tasks over NUMA nodes:
+    // put each on the node with the fewest such tasks that has room.
+    //
+    std::stable_sort(unplaced.begin(), unplaced.end(), more_cpus);
+    for (i=0; i<unplaced.size(); i++) {
+        ACTIVE_TASK* atp = unplaced[i];
+        int n = (int)(atp->app_version->avg_ncpus + .5);
+        if (n < 1) n = 1;
+        if (n > (int)topo.size()) n = (int)topo.size();
+        cpus.clear();
+        if (atp->app_version->is_mem_heavy()) {
+            vector<bool> tried(max_cpu_id+1, false);
+            while (cpus.empty()) {
+                int node = -1;
+                for (j=0; j<topo.size(); j++) {
+                    int k = topo[j].node;
+                    if (tried[topo[j].id]) continue;
+                    if (node < 0 || heavy_per_node[k] < heavy_per_node[node]) {
+                        node = k;
+                    }
+                }
+                if (node < 0) break;
+                for (j=0; j<topo.size(); j++) {
+                    if (topo[j].node == node) tried[topo[j].id] = true;
+                }
+                choose_cpus(n, node, used, cpus);
+                if (!cpus.empty()) heavy_per_node[node]++;
+            }
+        }
+        if (cpus.empty()) {
+            choose_cpus(n, -1, used, cpus);
+        }
+        set_task_affinity(atp, cpus);
+    }
+}
+
+#endif
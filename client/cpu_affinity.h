@@ -0,0 +1,50 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linux: placement of running tasks on CPUs; see cpu_affinity.cpp
+
+#ifndef _CPU_AFFINITY_
+#define _CPU_AFFINITY_
+
+#include <vector>
+
+// a logical CPU, as described in /sys
+//
+struct CPU_TOPO {
+    int id;
+    int node;
+        // NUMA node
+    int cache;
+        // the lowest-numbered CPU sharing this one's last-level cache
+        // (e.g. an AMD CCX)
+    int core;
+        // the lowest-numbered CPU in this one's physical core
+    int thread;
+        // index among the core's hardware threads
+};
+
+extern bool affinity_init();
+    // read the topology; return false if we can't do placement
+extern bool affinity_enabled();
+extern int numa_node_count();
+    // from /sys; 1 if not NUMA
+extern int gpu_numa_node(int domain, int bus, int device);
+    // NUMA node of a PCI device, or -1 if unknown
+extern void cpu_list_string(std::vector<int>& cpus, char* buf, int len);
+    // e.g. "0-3,8"
+
+#endif
@@ -58,9 +58,12 @@
 #include "win_util.h"
 #else
 #include "config.h"
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <list>
+#include <map>
+#include <set>
 #endif
 
 
@@ -74,6 +77,7 @@
 #include "app_config.h"
 #include "client_msgs.h"
 #include "client_state.h"
+#include "gpu_telemetry.h"
 #include "log_flags.h"
 #include "project.h"
 #include "result.h"
@@ -84,6 +88,36 @@ using std::list;
 
 static double rec_sum;
 
+// Limit on memory-heavy CPU jobs (<max_mem_heavy_tasks_per_node>).
+// Running many jobs that saturate memory bandwidth together
+// can be slower than mixing them with compute-bound jobs.
+// A multi-thread job counts once per CPU.
+//
+static int n_mem_heavy;
+    // temp during job scheduling
+
+static inline int mem_heavy_cpus(RESULT* rp) {
+    if (!config.max_mem_heavy_tasks_per_node) return 0;
+    if (rp->uses_coprocs()) return 0;
+    if (!rp->avp->is_mem_heavy()) return 0;
+    int n = (int)(rp->avp->avg_ncpus + .5);
+    return n?n:1;
+}
+
+static inline bool mem_heavy_exceeded(RESULT* rp) {
+    int n = mem_heavy_cpus(rp);
+    if (!n || !n_mem_heavy) return false;
+    int nnodes = 1;
+#if defined(__linux__) && !defined(SIM)
+    nnodes = numa_node_count();
+#endif
+    return n_mem_heavy + n > config.max_mem_heavy_tasks_per_node*nnodes;
+}
+
+static inline void mem_heavy_inc(RESULT* rp) {
+    n_mem_heavy += mem_heavy_cpus(rp);
+}
+
 // used in make_run_list() to keep track of resources used
 // by jobs tentatively scheduled so far
 //
@@ -104,6 +138,7 @@ struct PROC_RESOURCES {
         if (have_max_concurrent) {
             max_concurrent_init();
         }
+        n_mem_heavy = 0;
     }
 
     // should we stop scanning jobs?
@@ -126,6 +161,7 @@ struct PROC_RESOURCES {
     bool can_schedule(RESULT* rp, ACTIVE_TASK* atp) {
         double wss;
         if (max_concurrent_exceeded(rp)) return false;
+        if (mem_heavy_exceeded(rp)) return false;
         if (atp) {
             if (gstate.retry_shmem_time > gstate.now) {
                 if (atp->app_client_shm.shm == NULL) {
@@ -207,6 +243,7 @@ struct PROC_RESOURCES {
 
         adjust_rec_sched(rp);
         max_concurrent_inc(rp);
+        mem_heavy_inc(rp);
     }
 
     bool sufficient_coprocs(RESULT& r) {
@@ -307,6 +344,146 @@ static inline bool finished_time_slice(ACTIVE_TASK* atp) {
     return (running_beyond_sched_period && checkpointed);
 }
 
+// Candidate jobs for make_run_list().
+// These are computed once per call, by init_job_queues(),
+// so that choosing each job doesn't involve a scan of all results;
+// with lots of queued jobs that made make_run_list()
+// O(#jobs * #instances).
+//
+// The orders of jobs within the lists don't change during make_run_list().
+// Project scheduling priorities do (see adjust_rec_sched())
+// so jobs chosen by project priority are kept in per-project lists,
+// and we choose among projects each time.
+// Chosen jobs are marked as already_selected;
+// they're skipped rather than removed.
+//
+struct JOB_QUEUE {
+    vector<RESULT*> jobs;
+    unsigned int next;
+        // jobs before this one are already selected
+
+    void clear() {
+        jobs.clear();
+        next = 0;
+    }
+    RESULT* first() {
+        while (next < jobs.size()) {
+            RESULT* rp = jobs[next];
+            if (!rp->already_selected) return rp;
+            next++;
+        }
+        return NULL;
+    }
+};
+
+struct PROJECT_JOB_QUEUES {
+    JOB_QUEUE fifo[MAX_RSC];
+        // for GPUs: jobs in first_coproc_result() order
+        // for CPU: jobs without an active task, in arrival order
+    vector<ACTIVE_TASK*> cpu_tasks;
+        // CPU jobs with a runnable active task
+};
+
+static JOB_QUEUE edf_queues[MAX_RSC];
+    // jobs in earliest_deadline_result() order
+static std::map<PROJECT*, PROJECT_JOB_QUEUES> project_queues;
+
+static bool job_is_candidate(RESULT* rp) {
+    if (!rp->runnable()) return false;
+    if (rp->non_cpu_intensive()) return false;
+    return true;
+}
+
+// EDF order: earliest deadline, then (if tie)
+// started job, then least remaining time, then arrival
+//
+struct EDF_ENTRY {
+    RESULT* rp;
+    bool started;
+    double remaining;
+};
+
+static bool edf_compare(const EDF_ENTRY& e1, const EDF_ENTRY& e2) {
+    if (e1.rp->report_deadline != e2.rp->report_deadline) {
+        return e1.rp->report_deadline < e2.rp->report_deadline;
+    }
+    if (e1.started != e2.started) return e1.started;
+    return e1.remaining < e2.remaining;
+}
+
+// FIFO order within a project: already-started job, then arrival
+//
+static bool fifo_compare(RESULT* r1, RESULT* r2) {
+    bool s1 = !r1->not_started;
+    bool s2 = !r2->not_started;
+    if (s1 != s2) return s1;
+    return r1->index < r2->index;
+}
+
+// Build the job queues.
+// Call this after setting already_selected and not_started.
+//
+static void init_job_queues() {
+    unsigned int i;
+    int j;
+    vector<EDF_ENTRY> edf[MAX_RSC];
+
+    project_queues.clear();
+    for (j=0; j<coprocs.n_rsc; j++) {
+        edf_queues[j].clear();
+    }
+    for (i=0; i<gstate.projects.size(); i++) {
+        project_queues[gstate.projects[i]];
+    }
+
+    for (i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        if (!job_is_candidate(rp)) continue;
+        int rt = rp->resource_type();
+        ACTIVE_TASK* atp = gstate.lookup_active_task_by_result(rp);
+        PROJECT_JOB_QUEUES& pq = project_queues[rp->project];
+
+        EDF_ENTRY e;
+        e.rp = rp;
+        e.started = (atp != NULL);
+        e.remaining = rp->estimated_runtime_remaining();
+        edf[rt].push_back(e);
+
+        if (rt) {
+            pq.fifo[rt].jobs.push_back(rp);
+        } else if (!atp) {
+            pq.fifo[0].jobs.push_back(rp);
+        }
+    }
+
+    // in results order, so that stable_sort() keeps that order for ties
+    //
+    for (j=0; j<coprocs.n_rsc; j++) {
+        std::stable_sort(edf[j].begin(), edf[j].end(), edf_compare);
+        for (i=0; i<edf[j].size(); i++) {
+            edf_queues[j].jobs.push_back(edf[j][i].rp);
+        }
+    }
+    std::map<PROJECT*, PROJECT_JOB_QUEUES>::iterator iter;
+    for (iter = project_queues.begin(); iter != project_queues.end(); iter++) {
+        PROJECT_JOB_QUEUES& pq = iter->second;
+        for (j=1; j<coprocs.n_rsc; j++) {
+            std::stable_sort(
+                pq.fifo[j].jobs.begin(), pq.fifo[j].jobs.end(), fifo_compare
+            );
+        }
+    }
+
+    for (i=0; i<gstate.active_tasks.active_tasks.size(); i++) {
+        ACTIVE_TASK *atp = gstate.active_tasks.active_tasks[i];
+        if (!atp->runnable()) continue;
+        RESULT* rp = atp->result;
+        if (rp->uses_coprocs()) continue;
+        if (!rp->runnable()) continue;
+        project_queues[rp->project].cpu_tasks.push_back(atp);
+    }
+}
+
 // Choose a "best" runnable CPU job for each project
 //
 // Values are returned in project->next_runnable_result
@@ -321,66 +498,56 @@ static inline bool finished_time_slice(ACTIVE_TASK* atp) {
 // 3. results with active tasks that have no process
 // 4. results with no active task
 //
-// TODO: this is called in a loop over NCPUs, which is silly.
-// Should call it once, and have it make an ordered list per project.
+// This is called in a loop over NCPUs;
+// it uses the lists made by init_job_queues(),
+// so it looks only at the jobs of projects that need one.
 //
 void CLIENT_STATE::assign_results_to_projects() {
-    unsigned int i;
+    unsigned int i, k;
     RESULT* rp;
     PROJECT* project;
 
-    // scan results with an ACTIVE_TASK
-    //
-    for (i=0; i<active_tasks.active_tasks.size(); i++) {
-        ACTIVE_TASK *atp = active_tasks.active_tasks[i];
-        if (!atp->runnable()) continue;
-        rp = atp->result;
-        if (rp->already_selected) continue;
-        if (rp->uses_coprocs()) continue;
-        if (!rp->runnable()) continue;
-        project = rp->project;
-        if (!project->next_runnable_result) {
-            project->next_runnable_result = rp;
-            continue;
-        }
+    for (i=0; i<projects.size(); i++) {
+        project = projects[i];
+        if (project->next_runnable_result) continue;
+        PROJECT_JOB_QUEUES& pq = project_queues[project];
 
-        // see if this task is "better" than the one currently
-        // selected for this project
+        // look at results with an ACTIVE_TASK
         //
-        ACTIVE_TASK *next_atp = lookup_active_task_by_result(
-            project->next_runnable_result
-        );
+        ACTIVE_TASK* next_atp = NULL;
+        for (k=0; k<pq.cpu_tasks.size(); k++) {
+            ACTIVE_TASK *atp = pq.cpu_tasks[k];
+            if (atp->result->already_selected) continue;
+            if (!next_atp) {
+                next_atp = atp;
+                continue;
+            }
 
-        if ((next_atp->task_state() == PROCESS_UNINITIALIZED && atp->process_exists())
-            || (next_atp->scheduler_state == CPU_SCHED_PREEMPTED
-            && atp->scheduler_state == CPU_SCHED_SCHEDULED)
-        ) {
-            project->next_runnable_result = atp->result;
+            // see if this task is "better" than the one currently
+            // selected for this project
+            //
+            if ((next_atp->task_state() == PROCESS_UNINITIALIZED && atp->process_exists())
+                || (next_atp->scheduler_state == CPU_SCHED_PREEMPTED
+                && atp->scheduler_state == CPU_SCHED_SCHEDULED)
+            ) {
+                next_atp = atp;
+            }
         }
-    }
 
-    // Now consider results that don't have an active task
-    //
-    for (i=0; i<results.size(); i++) {
-        rp = results[i];
-        if (rp->already_selected) continue;
-        if (rp->uses_coprocs()) continue;
-        if (lookup_active_task_by_result(rp)) continue;
-        if (!rp->runnable()) continue;
+        // if none, consider results that don't have an active task
+        //
+        if (next_atp) {
+            rp = next_atp->result;
+        } else {
+            rp = pq.fifo[0].first();
+        }
+        if (!rp) continue;
 
-        project = rp->project;
-        if (project->next_runnable_result) continue;
+        // mark selected results, so CPU scheduler won't try to consider
+        // a result more than once
+        //
         project->next_runnable_result = rp;
-    }
-
-    // mark selected results, so CPU scheduler won't try to consider
-    // a result more than once
-    //
-    for (i=0; i<projects.size(); i++) {
-        project = projects[i];
-        if (project->next_runnable_result) {
-            project->next_runnable_result->already_selected = true;
-        }
+        rp->already_selected = true;
     }
 }
 
@@ -423,17 +590,18 @@ RESULT* CLIENT_STATE::highest_prio_project_best_result() {
 // - a later job finishes downloading and starts
 // - an earlier finishes downloading and preempts
 //
+// Each project's jobs are already in this order (see init_job_queues())
+// so we just compare the first job of each project.
+//
 RESULT* first_coproc_result(int rsc_type) {
     unsigned int i;
     RESULT* best = NULL;
     double best_prio=0, prio;
-    for (i=0; i<gstate.results.size(); i++) {
-        RESULT* rp = gstate.results[i];
-        if (rp->resource_type() != rsc_type) continue;
-        if (!rp->runnable()) continue;
-        if (rp->non_cpu_intensive()) continue;
-        if (rp->already_selected) continue;
-        prio = rp->project->sched_priority;
+    for (i=0; i<gstate.projects.size(); i++) {
+        PROJECT* p = gstate.projects[i];
+        RESULT* rp = project_queues[p].fifo[rsc_type].first();
+        if (!rp) continue;
+        prio = p->sched_priority;
         if (!best) {
             best = rp;
             best_prio = prio;
@@ -443,26 +611,7 @@ RESULT* first_coproc_result(int rsc_type) {
         if (prio < best_prio) {
             continue;
         }
-        if (prio > best_prio) {
-            best = rp;
-            best_prio = prio;
-            continue;
-        }
-
-        bool bs = !best->not_started;
-        bool rs = !rp->not_started;
-        if (rs && !bs) {
-            best = rp;
-            best_prio = prio;
-            continue;
-        }
-        if (!rs && bs) {
-            continue;
-        }
-
-        // else used "arrived first" order
-        //
-        if (rp->index < best->index) {
+        if (prio > best_prio || fifo_compare(rp, best)) {
             best = rp;
             best_prio = prio;
         }
@@ -476,55 +625,37 @@ RESULT* first_coproc_result(int rsc_type) {
 //
 static RESULT* earliest_deadline_result(int rsc_type) {
     RESULT *best_result = NULL;
-    ACTIVE_TASK* best_atp = NULL;
-    unsigned int i;
+    JOB_QUEUE& q = edf_queues[rsc_type];
 
-    for (i=0; i<gstate.results.size(); i++) {
-        RESULT* rp = gstate.results[i];
-        if (rp->resource_type() != rsc_type) continue;
-        if (rp->already_selected) continue;
-        if (!rp->runnable()) continue;
-        if (rp->non_cpu_intensive()) continue;
-        PROJECT* p = rp->project;
-
-        // Skip this job if the project's deadline-miss count is zero.
-        // If the project's DCF is > 90 (and we're not ignoring it)
-        // treat all jobs as deadline misses
-        //
-        if (p->dont_use_dcf || p->duration_correction_factor < 90.0) {
-            if (p->rsc_pwf[rsc_type].deadlines_missed_copy <= 0) {
-                continue;
-            }
-        }
-
-        bool new_best = false;
-        if (best_result) {
-            if (rp->report_deadline < best_result->report_deadline) {
-                new_best = true;
-            }
+    // The queue is in EDF order.
+    // Skip jobs already selected, and jobs from projects
+    // with no deadline misses left;
+    // since the deadline-miss counts only decrease,
+    // both can be skipped permanently if they're at the front
+    //
+    for (unsigned int i=q.next; i<q.jobs.size(); i++) {
+        RESULT* rp = q.jobs[i];
+        bool skip = false;
+        if (rp->already_selected) {
+            skip = true;
         } else {
-            new_best = true;
-        }
-        if (new_best) {
-            best_result = rp;
-            best_atp = gstate.lookup_active_task_by_result(rp);
-            continue;
+            // Skip this job if the project's deadline-miss count is zero.
+            // If the project's DCF is > 90 (and we're not ignoring it)
+            // treat all jobs as deadline misses
+            //
+            PROJECT* p = rp->project;
+            if (p->dont_use_dcf || p->duration_correction_factor < 90.0) {
+                if (p->rsc_pwf[rsc_type].deadlines_missed_copy <= 0) {
+                    skip = true;
+                }
+            }
         }
-        if (rp->report_deadline > best_result->report_deadline) {
+        if (skip) {
+            if (i == q.next) q.next++;
             continue;
         }
-
-        // If there's a tie, pick the job with the least remaining time
-        // (but don't pick an unstarted job over one that's started)
-        //
-        ACTIVE_TASK* atp = gstate.lookup_active_task_by_result(rp);
-        if (best_atp && !atp) continue;
-        if (rp->estimated_runtime_remaining() < best_result->estimated_runtime_remaining()
-            || (!best_atp && atp)
-        ) {
-            best_result = rp;
-            best_atp = atp;
-        }
+        best_result = rp;
+        break;
     }
     if (!best_result) return NULL;
 
@@ -896,6 +1027,7 @@ void CLIENT_STATE::make_run_list(vector<RESULT*>& run_list) {
         }
         atp->result->not_started = false;
     }
+    init_job_queues();
 
     // first, add GPU jobs
 
@@ -1022,6 +1154,23 @@ static inline bool more_important(RESULT* r0, RESULT* r1) {
     return (r0 < r1);
 }
 
+// order in which to start scheduled tasks.
+// Restarts from a checkpoint go last, since they may be throttled.
+// Among those, GPU jobs go first (they take less time to get going),
+// then earlier deadlines, then smaller slot dirs
+//
+static bool start_before(ACTIVE_TASK* a0, ACTIVE_TASK* a1) {
+    bool r0 = !a0->first_time && a0->task_state() == PROCESS_UNINITIALIZED;
+    bool r1 = !a1->first_time && a1->task_state() == PROCESS_UNINITIALIZED;
+    if (r0 != r1) return r1;
+    if (!r0) return false;
+    bool g0 = a0->result->uses_coprocs(), g1 = a1->result->uses_coprocs();
+    if (g0 != g1) return g0;
+    double d0 = a0->result->report_deadline, d1 = a1->result->report_deadline;
+    if (d0 != d1) return d0 < d1;
+    return a0->slot_nbytes < a1->slot_nbytes;
+}
+
 static void print_job_list(vector<RESULT*>& jobs) {
     for (unsigned int i=0; i<jobs.size(); i++) {
         RESULT* rp = jobs[i];
@@ -1084,17 +1233,69 @@ void CLIENT_STATE::append_unfinished_time_slice(vector<RESULT*> &run_list) {
 //                 prune J
 //         else
 //             if J.usage is fractional
-//                look for an instance that's already fractionally assigned
+//                look for an instance that's already fractionally assigned,
+//                    preferring one with jobs of the same app,
+//                    then the fullest one
 //                if that fails, look for a free instance
 //                if that fails, prune J
 //             else
 //                if there are enough instances with usage=0
+//                    if J uses more than one, and enough of them
+//                        are on one NUMA node, use only those
 //                    assign instances with pending_usage = usage = 0
 //                        (avoid preempting running jobs)
 //                    if need more, assign instances with usage = 0
+//                    (in each case in order of PCI bus ID)
 //                else
 //                    prune J
 
+// the apps with fractional jobs on each instance
+//
+static std::set<APP*> instance_apps[MAX_RSC][MAX_COPROC_INSTANCES];
+
+static void note_fractional_usage(RESULT* rp, double usage) {
+    if (usage >= 1) return;
+    int rt = rp->avp->gpu_usage.rsc_type;
+    instance_apps[rt][rp->coproc_indices[0]].insert(rp->app);
+}
+
+// the NUMA node of each instance (-1 if not known, -2 if not looked up yet)
+//
+static int instance_nodes[MAX_RSC][MAX_COPROC_INSTANCES];
+static bool instance_nodes_init = false;
+
+static int instance_node(COPROC* cp, int i) {
+    int rt = cp - coprocs.coprocs;
+    if (!instance_nodes_init) {
+        for (int j=0; j<MAX_RSC; j++) {
+            for (int k=0; k<MAX_COPROC_INSTANCES; k++) {
+                instance_nodes[j][k] = -2;
+            }
+        }
+        instance_nodes_init = true;
+    }
+    int& node = instance_nodes[rt][i];
+    if (node == -2) {
+        node = -1;
+#if defined(__linux__) && !defined(SIM)
+        PCI_INFO& pi = cp->pci_infos[i];
+        if (pi.present) {
+            node = gpu_numa_node(pi.domain_id, pi.bus_id, pi.device_id);
+        }
+#endif
+    }
+    return node;
+}
+
+// is something other than BOINC using the instance?
+// We know this only if it has no BOINC jobs, and we have telemetry
+//
+static inline bool instance_busy(COPROC* cp, int i) {
+    if (cp->usage[i] || cp->pending_usage[i]) return false;
+    GPU_SAMPLE* s = gpu_telemetry.get(cp - coprocs.coprocs, i);
+    return s && s->utilization >= GPU_BUSY_UTILIZATION;
+}
+
 static inline void increment_pending_usage(
     RESULT* rp, double usage, COPROC* cp
 ) {
@@ -1152,9 +1353,7 @@ static inline void confirm_current_assignment(
                 cp->type, j, rp->name
             );
         }
-#if DEFER_ON_GPU_AVAIL_RAM
         cp->available_ram_temp[j] -= rp->avp->gpu_ram;
-#endif
     }
 }
 
@@ -1163,60 +1362,83 @@ static inline bool get_fractional_assignment(
 ) {
     int i;
     defer_sched = false;
+    int rt = rp->avp->gpu_usage.rsc_type;
 
-    // try to assign an instance that's already fractionally assigned
+    // try to assign an instance that's already fractionally assigned.
+    // Pack jobs of the same app onto one instance;
+    // otherwise use the fullest instance.
     //
+    int best = -1;
+    bool best_same = false;
+    double best_used = 0;
     for (i=0; i<cp->count; i++) {
         if (gpu_excluded(rp->app, *cp, i)) {
             continue;
         }
-        if ((cp->usage[i] || cp->pending_usage[i])
-            && (cp->usage[i] + cp->pending_usage[i] + usage <= 1)
-        ) {
-#if DEFER_ON_GPU_AVAIL_RAM
+        double used = cp->usage[i] + cp->pending_usage[i];
+        if (used && (used + usage <= 1)) {
             if (rp->avp->gpu_ram > cp->available_ram_temp[i]) {
                 defer_sched = true;
                 continue;
             }
-            cp->available_ram_temp[i] -= rp->avp->gpu_ram;
-#endif
-            rp->coproc_indices[0] = i;
-            cp->usage[i] += usage;
-            if (log_flags.coproc_debug) {
-                msg_printf(rp->project, MSG_INFO,
-                    "[coproc] Assigning %f of %s instance %d to %s",
-                    usage, cp->type, i, rp->name
-                );
+            bool same = instance_apps[rt][i].count(rp->app) > 0;
+            if (best < 0
+                || (same && !best_same)
+                || (same == best_same && used > best_used)
+            ) {
+                best = i;
+                best_same = same;
+                best_used = used;
             }
-            return true;
         }
     }
+    if (best >= 0) {
+        i = best;
+        cp->available_ram_temp[i] -= rp->avp->gpu_ram;
+        rp->coproc_indices[0] = i;
+        cp->usage[i] += usage;
+        note_fractional_usage(rp, usage);
+        if (log_flags.coproc_debug) {
+            msg_printf(rp->project, MSG_INFO,
+                "[coproc] Assigning %f of %s instance %d to %s",
+                usage, cp->type, i, rp->name
+            );
+        }
+        return true;
+    }
 
-    // failing that, assign an unreserved instance
+    // failing that, assign an unreserved instance,
+    // preferring one that nothing else is using
     //
+    best = -1;
     for (i=0; i<cp->count; i++) {
         if (gpu_excluded(rp->app, *cp, i)) {
             continue;
         }
         if (!cp->usage[i]) {
-#if DEFER_ON_GPU_AVAIL_RAM
             if (rp->avp->gpu_ram > cp->available_ram_temp[i]) {
                 defer_sched = true;
                 continue;
             }
-            cp->available_ram_temp[i] -= rp->avp->gpu_ram;
-#endif
-            rp->coproc_indices[0] = i;
-            cp->usage[i] += usage;
-            if (log_flags.coproc_debug) {
-                msg_printf(rp->project, MSG_INFO,
-                    "[coproc] Assigning %f of %s free instance %d to %s",
-                    usage, cp->type, i, rp->name
-                );
+            if (best < 0 || (instance_busy(cp, best) && !instance_busy(cp, i))) {
+                best = i;
             }
-            return true;
         }
     }
+    if (best >= 0) {
+        i = best;
+        cp->available_ram_temp[i] -= rp->avp->gpu_ram;
+        rp->coproc_indices[0] = i;
+        cp->usage[i] += usage;
+        note_fractional_usage(rp, usage);
+        if (log_flags.coproc_debug) {
+            msg_printf(rp->project, MSG_INFO,
+                "[coproc] Assigning %f of %s free instance %d to %s",
+                usage, cp->type, i, rp->name
+            );
+        }
+        return true;
+    }
     if (log_flags.coproc_debug) {
         msg_printf(rp->project, MSG_INFO,
             "[coproc] Insufficient %s for %s: need %f",
@@ -1227,6 +1449,37 @@ static inline bool get_fractional_assignment(
     return false;
 }
 
+// can the instance be given to the (integer-usage) job?
+//
+static inline bool instance_free(RESULT* rp, COPROC* cp, int i) {
+    if (gpu_excluded(rp->app, *cp, i)) return false;
+    if (cp->usage[i]) return false;
+    if (rp->avp->gpu_ram > cp->available_ram_temp[i]) return false;
+    return true;
+}
+
+struct PCI_ORDER {
+    COPROC* cp;
+    PCI_ORDER(COPROC* c) : cp(c) {}
+    bool operator()(int a, int b) const {
+        PCI_INFO& pa = cp->pci_infos[a];
+        PCI_INFO& pb = cp->pci_infos[b];
+        if (pa.present != pb.present) return pa.present;
+        if (!pa.present) return a < b;
+        if (pa.domain_id != pb.domain_id) return pa.domain_id < pb.domain_id;
+        if (pa.bus_id != pb.bus_id) return pa.bus_id < pb.bus_id;
+        return pa.device_id < pb.device_id;
+    }
+};
+
+struct NOT_BUSY {
+    COPROC* cp;
+    NOT_BUSY(COPROC* c) : cp(c) {}
+    bool operator()(int i) const {
+        return !instance_busy(cp, i);
+    }
+};
+
 static inline bool get_integer_assignment(
     RESULT* rp, double usage, COPROC* cp, bool& defer_sched
 ) {
@@ -1241,7 +1494,6 @@ static inline bool get_integer_assignment(
             continue;
         }
         if (!cp->usage[i]) {
-#if DEFER_ON_GPU_AVAIL_RAM
             if (rp->avp->gpu_ram > cp->available_ram_temp[i]) {
                 defer_sched = true;
                 if (log_flags.coproc_debug) {
@@ -1251,8 +1503,7 @@ static inline bool get_integer_assignment(
                     );
                 }
                 continue;
-            };
-#endif
+            }
             nfree++;
         }
     }
@@ -1272,23 +1523,47 @@ static inline bool get_integer_assignment(
     }
 
     int n = 0;
+    int node = -1;
 
-    // assign non-pending instances first
+    // if the job uses more than one instance,
+    // use instances on one NUMA node if it has enough free ones
+    //
+    if (usage > 1) {
+        std::map<int, int> node_free;
+        for (i=0; i<cp->count; i++) {
+            if (instance_free(rp, cp, i)) node_free[instance_node(cp, i)]++;
+        }
+        std::map<int, int>::iterator it;
+        int best_free = 0;
+        for (it = node_free.begin(); it != node_free.end(); it++) {
+            if (it->first < 0 || it->second < usage) continue;
+            if (node < 0 || it->second < best_free) {
+                node = it->first;
+                best_free = it->second;
+            }
+        }
+    }
 
+    // instances in PCI order, so multi-GPU jobs get neighboring devices
+    //
+    vector<int> order;
     for (i=0; i<cp->count; i++) {
-        if (gpu_excluded(rp->app, *cp, i)) {
-            continue;
-        }
-        if (!cp->usage[i]
-            && !cp->pending_usage[i]
-#if DEFER_ON_GPU_AVAIL_RAM
-            && (rp->avp->gpu_ram <= cp->available_ram_temp[i])
-#endif
-        ) {
+        if (node >= 0 && instance_node(cp, i) != node) continue;
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), PCI_ORDER(cp));
+
+    // put instances that something else is using last
+    //
+    std::stable_partition(order.begin(), order.end(), NOT_BUSY(cp));
+
+    // assign non-pending instances first
+
+    for (unsigned int k=0; k<order.size(); k++) {
+        i = order[k];
+        if (instance_free(rp, cp, i) && !cp->pending_usage[i]) {
             cp->usage[i] = 1;
-#if DEFER_ON_GPU_AVAIL_RAM
             cp->available_ram_temp[i] -= rp->avp->gpu_ram;
-#endif
             rp->coproc_indices[n++] = i;
             if (log_flags.coproc_debug) {
                 msg_printf(rp->project, MSG_INFO,
@@ -1302,19 +1577,11 @@ static inline bool get_integer_assignment(
 
     // if needed, assign pending instances
 
-    for (i=0; i<cp->count; i++) {
-        if (gpu_excluded(rp->app, *cp, i)) {
-            continue;
-        }
-        if (!cp->usage[i]
-#if DEFER_ON_GPU_AVAIL_RAM
-            && (rp->avp->gpu_ram <= cp->available_ram_temp[i])
-#endif
-        ) {
+    for (unsigned int k=0; k<order.size(); k++) {
+        i = order[k];
+        if (instance_free(rp, cp, i)) {
             cp->usage[i] = 1;
-#if DEFER_ON_GPU_AVAIL_RAM
             cp->available_ram_temp[i] -= rp->avp->gpu_ram;
-#endif
             rp->coproc_indices[n++] = i;
             if (log_flags.coproc_debug) {
                 msg_printf(rp->project, MSG_INFO,
@@ -1354,12 +1621,34 @@ static void copy_available_ram(COPROC& cp, const char* name) {
 }
 #endif
 
-static inline void assign_coprocs(vector<RESULT*>& jobs) {
-    unsigned int i;
-    COPROC* cp;
-    double usage;
+#define GPU_RAM_UNLIMITED   1e30
 
-    coprocs.clear_usage();
+// set the RAM available to jobs on each GPU instance.
+// If we have telemetry, it's the free RAM
+// plus what running jobs use, as given by their app versions;
+// those that keep running are charged for it again
+// in confirm_current_assignment().
+// If a running job's usage isn't known, don't limit its instance.
+//
+static void init_available_ram() {
+    unsigned int i;
+    int rt, j;
+
+    for (rt=1; rt<coprocs.n_rsc; rt++) {
+        COPROC& cp = coprocs.coprocs[rt];
+        for (j=0; j<cp.count; j++) {
+            GPU_SAMPLE* s = gpu_telemetry.get(rt, j);
+            if (s) {
+                cp.available_ram_temp[j] = s->mem_free;
+            } else {
+#if DEFER_ON_GPU_AVAIL_RAM
+                cp.available_ram_temp[j] = cp.available_ram;
+#else
+                cp.available_ram_temp[j] = GPU_RAM_UNLIMITED;
+#endif
+            }
+        }
+    }
 #if DEFER_ON_GPU_AVAIL_RAM
     if (coprocs.have_nvidia()) {
         copy_available_ram(coprocs.nvidia, GPU_TYPE_NVIDIA);
@@ -1371,6 +1660,38 @@ static inline void assign_coprocs(vector<RESULT*>& jobs) {
         copy_available_ram(coprocs.intel_gpu, GPU_TYPE_INTEL);
     }
 #endif
+    for (i=0; i<gstate.active_tasks.active_tasks.size(); i++) {
+        ACTIVE_TASK* atp = gstate.active_tasks.active_tasks[i];
+        if (atp->task_state() != PROCESS_EXECUTING) continue;
+        RESULT* rp = atp->result;
+        APP_VERSION* avp = rp->avp;
+        rt = avp->gpu_usage.rsc_type;
+        if (!rt) continue;
+        COPROC& cp = coprocs.coprocs[rt];
+        for (j=0; j<avp->gpu_usage.usage; j++) {
+            int k = rp->coproc_indices[j];
+            if (!gpu_telemetry.get(rt, k)) continue;
+            if (avp->gpu_ram) {
+                cp.available_ram_temp[k] += avp->gpu_ram;
+            } else {
+                cp.available_ram_temp[k] = GPU_RAM_UNLIMITED;
+            }
+        }
+    }
+}
+
+static inline void assign_coprocs(vector<RESULT*>& jobs) {
+    unsigned int i;
+    COPROC* cp;
+    double usage;
+
+    coprocs.clear_usage();
+    for (int j=0; j<MAX_RSC; j++) {
+        for (int k=0; k<MAX_COPROC_INSTANCES; k++) {
+            instance_apps[j][k].clear();
+        }
+    }
+    init_available_ram();
 
     // fill in pending usage
     //
@@ -1388,6 +1709,7 @@ static inline void assign_coprocs(vector<RESULT*>& jobs) {
         if (!atp) continue;
         if (atp->task_state() != PROCESS_EXECUTING) continue;
         increment_pending_usage(rp, usage, cp);
+        note_fractional_usage(rp, usage);
     }
 
     vector<RESULT*>::iterator job_iter;
@@ -1495,6 +1817,7 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
     bool action = false;
 
     if (have_max_concurrent) max_concurrent_init();
+    n_mem_heavy = 0;
 
 #ifndef SIM
     // check whether GPUs are usable
@@ -1614,6 +1937,15 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
             }
             continue;
         }
+        if (mem_heavy_exceeded(rp)) {
+            if (log_flags.cpu_sched_debug) {
+                msg_printf(rp->project, MSG_INFO,
+                    "[cpu_sched_debug] skipping %s; memory-heavy task limit reached",
+                    rp->name
+                );
+            }
+            continue;
+        }
 
         atp = lookup_active_task_by_result(rp);
 
@@ -1705,6 +2037,7 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
         atp->next_scheduler_state = CPU_SCHED_SCHEDULED;
         ram_left -= wss;
         max_concurrent_inc(rp);
+        mem_heavy_inc(rp);
     }
 
     if (log_flags.cpu_sched_debug && ncpus_used < ncpus) {
@@ -1776,10 +2109,36 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
         }
     }
 
-    bool coproc_start_deferred = false;
+    // see which tasks would be started from scratch.
+    // GPU tasks can get suspended before they're ever run,
+    // so the only safe way of telling whether this is the
+    // first time the app is run is to check
+    // whether the slot dir is empty
+    //
+    vector<ACTIVE_TASK*> start_list;
     for (i=0; i<active_tasks.active_tasks.size(); i++) {
         atp = active_tasks.active_tasks[i];
         if (atp->next_scheduler_state != CPU_SCHED_SCHEDULED) continue;
+        atp->slot_nbytes = 0;
+        if (atp->task_state() == PROCESS_UNINITIALIZED) {
+#ifdef SIM
+            atp->first_time = atp->scheduler_state == CPU_SCHED_UNINITIALIZED;
+#else
+            atp->first_time = is_dir_empty(atp->slot_dir);
+            if (!atp->first_time) {
+                atp->slot_watch.get_size(atp->slot_dir, atp->slot_nbytes);
+            }
+#endif
+        } else {
+            atp->first_time = false;
+        }
+        start_list.push_back(atp);
+    }
+    std::stable_sort(start_list.begin(), start_list.end(), start_before);
+
+    bool coproc_start_deferred = false;
+    for (i=0; i<start_list.size(); i++) {
+        atp = start_list[i];
         int ts = atp->task_state();
         if (ts == PROCESS_UNINITIALIZED || ts == PROCESS_SUSPENDED) {
             // If there's a quit pending for a coproc job,
@@ -1790,20 +2149,28 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
                 coproc_start_deferred = true;
                 continue;
             }
-            action = true;
 
-            bool first_time;
-            // GPU tasks can get suspended before they're ever run,
-            // so the only safe way of telling whether this is the
-            // first time the app is run is to check
-            // whether the slot dir is empty
+            // if it's restarting from a checkpoint,
+            // and other restarts are reading enough, wait for them
             //
-#ifdef SIM
-            first_time = atp->scheduler_state == CPU_SCHED_UNINITIALIZED;
-#else
-            first_time = is_dir_empty(atp->slot_dir);
+            bool restart = (ts == PROCESS_UNINITIALIZED && !atp->first_time);
+#ifndef SIM
+            if (restart && !config.no_restart_throttle
+                && !active_tasks.restart_ok(atp->slot_nbytes)
+            ) {
+                if (log_flags.cpu_sched_debug) {
+                    msg_printf(atp->result->project, MSG_INFO,
+                        "[cpu_sched_debug] deferring restart of %s (%.2f MB)",
+                        atp->result->name, atp->slot_nbytes/MEGA
+                    );
+                }
+                active_tasks.restart_deferred = true;
+                continue;
+            }
 #endif
-            retval = atp->resume_or_start(first_time);
+            action = true;
+
+            retval = atp->resume_or_start(atp->first_time);
             if ((retval == ERR_SHMGET) || (retval == ERR_SHMAT)) {
                 // Assume no additional shared memory segs
                 // will be available in the next 10 seconds
@@ -1822,6 +2189,11 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
                 request_schedule_cpus("start failed");
                 continue;
             }
+#ifndef SIM
+            if (restart) {
+                active_tasks.note_restart(atp);
+            }
+#endif
             if (atp->result->rr_sim_misses_deadline) {
                 atp->once_ran_edf = true;
             }
@@ -1831,7 +2203,7 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
         if (log_flags.cpu_sched_status) {
             msg_printf(atp->result->project, MSG_INFO,
                 "[css] running %s (%s)",
-                atp->result->name, atp->result->resources
+                atp->result->name, atp->result->resources.c_str()
             );
         }
         atp->scheduler_state = CPU_SCHED_SCHEDULED;
@@ -1855,7 +2227,7 @@ bool CLIENT_STATE::enforce_run_list(vector<RESULT*>& run_list) {
 
     }
     if (action) {
-        set_client_state_dirty("enforce_cpu_schedule");
+        set_client_state_dirty("enforce_cpu_schedule", true);
     }
     if (log_flags.cpu_sched_debug) {
         msg_printf(0, MSG_INFO, "[cpu_sched_debug] enforce_schedule: end");
@@ -1882,6 +2254,7 @@ void CLIENT_STATE::request_schedule_cpus(const char* where) {
         msg_printf(0, MSG_INFO, "[cpu_sched_debug] Request CPU reschedule: %s", where);
     }
     must_schedule_cpus = true;
+    set_poll_flags(POLL_FLAG_RR_SIM);
 }
 
 // Find the active task for a given result
@@ -2011,16 +2384,11 @@ void CLIENT_STATE::set_ncpus() {
     }
 }
 
-// The given result has just completed successfully.
-// Update the correction factor used to predict
-// completion time for this project's results
+// update a duration correction factor, given a completed job's
+// ratio of elapsed time to its uncorrected estimate
 //
-void PROJECT::update_duration_correction_factor(ACTIVE_TASK* atp) {
-    if (dont_use_dcf) return;
-    RESULT* rp = atp->result;
-    double raw_ratio = atp->elapsed_time/rp->estimated_runtime_uncorrected();
-    double adj_ratio = atp->elapsed_time/rp->estimated_runtime();
-    double old_dcf = duration_correction_factor;
+static void update_dcf(double& dcf, double raw_ratio) {
+    double adj_ratio = raw_ratio/dcf;
 
     // it's OK to overestimate completion time,
     // but bad to underestimate it.
@@ -2028,26 +2396,53 @@ void PROJECT::update_duration_correction_factor(ACTIVE_TASK* atp) {
     // but decrease it with caution
     //
     if (adj_ratio > 1.1) {
-        duration_correction_factor = raw_ratio;
+        dcf = raw_ratio;
     } else {
         // in particular, don't give much weight to results
         // that completed a lot earlier than expected
         //
         if (adj_ratio < 0.1) {
-            duration_correction_factor = duration_correction_factor*0.99 + 0.01*raw_ratio;
+            dcf = dcf*0.99 + 0.01*raw_ratio;
         } else {
-            duration_correction_factor = duration_correction_factor*0.9 + 0.1*raw_ratio;
+            dcf = dcf*0.9 + 0.1*raw_ratio;
         }
     }
     // limit to [.01 .. 100]
     //
-    if (duration_correction_factor > 100) duration_correction_factor = 100;
-    if (duration_correction_factor < 0.01) duration_correction_factor = 0.01;
+    if (dcf > 100) dcf = 100;
+    if (dcf < 0.01) dcf = 0.01;
+}
+
+// The given result has just completed successfully.
+// Update the correction factors used to predict
+// completion time for this project's results,
+// and for results using the same app version.
+//
+void PROJECT::update_duration_correction_factor(ACTIVE_TASK* atp) {
+    if (dont_use_dcf) return;
+    RESULT* rp = atp->result;
+    APP_VERSION* avp = rp->avp;
+    double raw_ratio = atp->elapsed_time/rp->estimated_runtime_uncorrected();
+    double old_dcf = duration_correction_factor;
+    double old_av_dcf = avp->duration_correction_factor();
+
+    update_dcf(duration_correction_factor, raw_ratio);
+
+    // a new app version starts from the project's DCF
+    //
+    if (!avp->dcf_njobs) avp->dcf = old_dcf;
+    update_dcf(avp->dcf, raw_ratio);
+    avp->dcf_njobs++;
 
     if (log_flags.dcf_debug) {
         msg_printf(this, MSG_INFO,
             "[dcf] DCF: %f->%f, raw_ratio %f, adj_ratio %f",
-            old_dcf, duration_correction_factor, raw_ratio, adj_ratio
+            old_dcf, duration_correction_factor, raw_ratio, raw_ratio/old_dcf
+        );
+        msg_printf(this, MSG_INFO,
+            "[dcf] %s %d %s: DCF %f->%f (%d jobs)",
+            avp->app_name, avp->version_num, avp->plan_class,
+            old_av_dcf, avp->dcf, avp->dcf_njobs
         );
     }
 }
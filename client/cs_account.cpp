@@ -123,7 +123,7 @@ int PROJECT::parse_account(FILE* in) {
             return 0;
         } else if (xp.match_tag("venue")) {
             std::string devnull;
-            retval = copy_element_contents(xp.f->f, "</venue>", devnull);
+            retval = copy_element_contents(*xp.f, "</venue>", devnull);
             if (retval) return retval;
             continue;
         } else if (xp.parse_str("master_url", master_url, sizeof(master_url))) {
@@ -157,13 +157,13 @@ int PROJECT::parse_account(FILE* in) {
         else if (xp.parse_str("project_name", project_name, sizeof(project_name))) continue;
         else if (xp.match_tag("gui_urls")) {
             string foo;
-            retval = copy_element_contents(xp.f->f, "</gui_urls>", foo);
+            retval = copy_element_contents(*xp.f, "</gui_urls>", foo);
             if (retval) return retval;
             gui_urls = "<gui_urls>\n"+foo+"</gui_urls>\n";
             continue;
         } else if (xp.match_tag("project_specific")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</project_specific>",
                 project_specific_prefs
             );
@@ -229,7 +229,7 @@ int PROJECT::parse_account_file_venue() {
             continue;
         } else if (xp.match_tag("project_specific")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</project_specific>",
                 project_specific_prefs
             );
@@ -24,7 +24,9 @@
 // - after FP_START seconds it creates a file "do_fp"
 // - after FP_END seconds it deletes do_fp
 // - after INT_START seconds it creates do_int
-// - after INT_END seconds it deletes do_int and starts waiting for processes
+// - after INT_END seconds it deletes do_int
+// - after MEM_START seconds it creates do_mem
+// - after MEM_END seconds it deletes do_mem and starts waiting for processes
 // Each thread/process checks for the relevant file before
 //  starting or stopping each benchmark
 
@@ -76,7 +78,9 @@
 #define FP_END      12
 #define INT_START   17
 #define INT_END     27
-#define OVERALL_END 30
+#define MEM_START   32
+#define MEM_END     42
+#define OVERALL_END 45
 
 #define MIN_CPU_TIME  2
     // if the CPU time accumulated during one of the 10-sec segments
@@ -86,8 +90,10 @@
 #define BM_FP       1
 #define BM_INT_INIT 2
 #define BM_INT      3
-#define BM_SLEEP    4
-#define BM_DONE     5
+#define BM_MEM_INIT 4
+#define BM_MEM      5
+#define BM_SLEEP    6
+#define BM_DONE     7
 static int bm_state;
 
 static bool did_benchmarks = false;
@@ -122,7 +128,7 @@ static int bm_ncpus;
     // user might change ncpus during benchmarks.
     // store starting value here.
 
-const char *file_names[2] = {"do_fp", "do_int"};
+const char *file_names[3] = {"do_fp", "do_int", "do_mem"};
 
 static void remove_benchmark_file(int which) {
     boinc_delete_file(file_names[which]);
@@ -209,9 +215,18 @@ int cpu_benchmarks(BENCHMARK_DESC* bdp) {
         return 0;
     }
     host_info.p_iops = vax_mips*1e6;
-    host_info.p_membw = 1e9;
 #ifdef _WIN32
     }
+#endif
+    // memory bandwidth is measured on all CPUs at once;
+    // if it fails, use the default rather than discarding the others
+    //
+    double mem_time;
+    retval = mem_bandwidth(host_info.p_membw, mem_time, MIN_CPU_TIME);
+    if (retval) {
+        host_info.p_membw = DEFAULT_MEMBW;
+    }
+#ifdef _WIN32
     bdp->host_info = host_info;
     bdp->int_loops = int_loops;
     bdp->int_time = int_time;
@@ -257,6 +272,7 @@ void CLIENT_STATE::start_cpu_benchmarks() {
     bm_state = BM_FP_INIT;
     remove_benchmark_file(BM_TYPE_FP);
     remove_benchmark_file(BM_TYPE_INT);
+    remove_benchmark_file(BM_TYPE_MEM);
     cpu_benchmarks_start = dtime();
 
     if (benchmark_descs) {
@@ -438,6 +454,28 @@ bool CLIENT_STATE::cpu_benchmarks_poll() {
                 );
             }
             remove_benchmark_file(BM_TYPE_INT);
+            bm_state = BM_MEM_INIT;
+        }
+        return false;
+    case BM_MEM_INIT:
+        if (now - cpu_benchmarks_start > MEM_START) {
+            if (log_flags.benchmark_debug) {
+                msg_printf(0, MSG_INFO,
+                    "[benchmark] Starting memory bandwidth benchmark"
+                );
+            }
+            make_benchmark_file(BM_TYPE_MEM);
+            bm_state = BM_MEM;
+        }
+        return false;
+    case BM_MEM:
+        if (now - cpu_benchmarks_start > MEM_END) {
+            if (log_flags.benchmark_debug) {
+                msg_printf(0, MSG_INFO,
+                    "[benchmark] Ended memory bandwidth benchmark"
+                );
+            }
+            remove_benchmark_file(BM_TYPE_MEM);
             bm_state = BM_SLEEP;
         }
         return false;
@@ -500,9 +538,10 @@ bool CLIENT_STATE::cpu_benchmarks_poll() {
             for (i=0; i<bm_ncpus; i++) {
                 if (log_flags.benchmark_debug) {
                     msg_printf(0, MSG_INFO,
-                        "[benchmark] CPU %d: fp %f int %f intloops %f inttime %f",
+                        "[benchmark] CPU %d: fp %f int %f membw %f intloops %f inttime %f",
                         i, benchmark_descs[i].host_info.p_fpops,
                         benchmark_descs[i].host_info.p_iops,
+                        benchmark_descs[i].host_info.p_membw,
                         benchmark_descs[i].int_loops,
                         benchmark_descs[i].int_time
                     );
@@ -541,6 +580,10 @@ bool CLIENT_STATE::cpu_benchmarks_poll() {
         host_info.p_calculated = now;
         benchmarks_running = false;
         set_client_state_dirty("CPU benchmarks");
+
+        // job runtime estimates have changed
+        //
+        set_poll_flags(POLL_FLAG_RR_SIM);
     }
     return false;
 }
@@ -556,12 +599,10 @@ void CLIENT_STATE::print_benchmark_results() {
         NULL, MSG_INFO, "   %.0f integer MIPS (Dhrystone) per CPU",
         host_info.p_iops/1e6
     );
-#if 0
     msg_printf(
-        NULL, MSG_INFO, "Benchmark results: %.0f million bytes/sec memory bandwidth%s",
-        host_info.p_membw/1e6, (host_info.p_membw_err?" [ERROR]":"")
+        NULL, MSG_INFO, "   %.0f million bytes/sec memory bandwidth per CPU",
+        host_info.p_membw/1e6
     );
-#endif
 }
 
 bool CLIENT_STATE::cpu_benchmarks_done() {
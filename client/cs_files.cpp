@@ -26,6 +26,8 @@
 #else
 #include "config.h"
 #include <cassert>
+#include <map>
+#include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
 #endif
@@ -46,6 +48,8 @@
 #include "project.h"
 #include "sandbox.h"
 
+using std::map;
+using std::string;
 using std::vector;
 
 // Decide whether to consider starting a new file transfer
@@ -63,6 +67,7 @@ bool CLIENT_STATE::start_new_file_xfer(PERS_FILE_XFER& pfx) {
     //
     for (i=0; i<file_xfers->file_xfers.size(); i++) {
         FILE_XFER* fxp = file_xfers->file_xfers[i];
+        if (fxp->batch_leader) continue;
         if (pfx.is_upload == fxp->is_upload) {
             ntotal++;
             if (pfx.fip->project == fxp->fip->project) {
@@ -153,6 +158,26 @@ bool FILE_INFO::verify_file_certs() {
 // This will cause the app_version or workunit that used the file to error out
 // (via APP_VERSION::had_download_failure() or WORKUNIT::had_download_failure())
 //
+int FILE_STAMP::get(const char* path) {
+#if defined(_WIN32) && !defined(__CYGWIN32__) && !defined(__MINGW32__)
+    struct __stat64 sbuf;
+    if (_stat64(path, &sbuf)) return ERR_NOT_FOUND;
+#else
+    struct stat sbuf;
+    if (stat(path, &sbuf)) return ERR_NOT_FOUND;
+#endif
+    ino = (double)sbuf.st_ino;
+    size = (double)sbuf.st_size;
+    mtime = (double)sbuf.st_mtime;
+#ifdef __linux__
+    mtime_ns = (double)sbuf.st_mtim.tv_nsec;
+#else
+    mtime_ns = 0;
+#endif
+    ctime = (double)sbuf.st_ctime;
+    return 0;
+}
+
 int FILE_INFO::verify_file(
     bool verify_contents, bool show_errors, bool allow_async
 ) {
@@ -229,8 +254,30 @@ int FILE_INFO::verify_file(
 
     if (!verify_contents) return 0;
 
+    // get the file's metadata before reading it,
+    // so that a change while we read it is noticed next time
+    //
+    FILE_STAMP stamp;
+    bool have_stamp = (stamp.get(pathname) == 0);
+    bool cached_md5 = false;
+
+    // use the MD5 computed during download, if there is one.
+    // Otherwise, if the file hasn't changed since we last computed its MD5
+    // (recently), use that.
+    //
+    if (strlen(download_md5)) {
+        strcpy(cksum, download_md5);
+        strcpy(download_md5, "");
+    } else if (have_stamp && strlen(verified_md5)
+        && stamp == verified_stamp
+        && gstate.now - verified_time < VERIFY_CACHE_PERIOD
+    ) {
+        strcpy(cksum, verified_md5);
+        cached_md5 = true;
+    }
+
     if (signature_required) {
-        if (!strlen(file_signature) && !cert_sigs) {
+        if (file_signature.empty() && !cert_sigs) {
             msg_printf(project, MSG_INTERNAL_ERROR,
                 "Application file %s missing signature", name
             );
@@ -253,7 +300,7 @@ int FILE_INFO::verify_file(
             );
             return ERR_NO_SIGNATURE;
         }
-        if (allow_async && nbytes > ASYNC_FILE_THRESHOLD) {
+        if (allow_async && nbytes > ASYNC_FILE_THRESHOLD && !strlen(cksum)) {
             ASYNC_VERIFY* avp = new ASYNC_VERIFY();
             retval = avp->init(this);
             if (retval) {
@@ -276,7 +323,7 @@ int FILE_INFO::verify_file(
             }
         }
         retval = check_file_signature2(
-            cksum, file_signature, project->code_sign_key, verified
+            cksum, file_signature.c_str(), project->code_sign_key, verified
         );
         if (retval) {
             msg_printf(project, MSG_INTERNAL_ERROR,
@@ -333,9 +380,116 @@ int FILE_INFO::verify_file(
             return ERR_MD5_FAILED;
         }
     }
+
+    // remember the MD5 we computed, so we needn't read the file again
+    //
+    if (strlen(cksum) && !cached_md5) {
+        if (have_stamp) {
+            strcpy(verified_md5, cksum);
+            verified_stamp = stamp;
+            verified_time = gstate.now;
+        } else {
+            strcpy(verified_md5, "");
+        }
+    }
     return 0;
 }
 
+// files are identical if they have the same MD5 and size
+//
+static string content_key(FILE_INFO* fip) {
+    char buf[256];
+    sprintf(buf, "%s %.0f", fip->md5_cksum, fip->nbytes);
+    return string(buf);
+}
+
+static bool can_share(FILE_INFO* fip) {
+    return strlen(fip->md5_cksum) && fip->nbytes > 0 && !fip->uploadable();
+}
+
+// Projects, and app versions within a project, often use identical files
+// (runtime libraries, wrappers, reference data).
+// Before downloading a file, see if a file with the same MD5 and size
+// is present, in this or another project.
+// If so, make the file from it:
+// clone it if the filesystem can (see boinc_clone_file()),
+// else hard-link it if both are app files (which apps don't change),
+// else copy it if it's small.
+// The result is verified like a download; if it fails, we download.
+// Return true if we made the file.
+//
+static bool make_from_identical_file(FILE_INFO* fip, FILE_INFO* src) {
+    char path[MAXPATHLEN], src_path[MAXPATHLEN];
+    int retval;
+    FILE_STAMP stamp;
+
+    get_pathname(fip, path, sizeof(path));
+    get_pathname(src, src_path, sizeof(src_path));
+
+    // if there's a partial download, resume it
+    //
+    if (boinc_file_exists(path)) return false;
+
+    // If src's contents were checked recently and it hasn't changed since,
+    // we know the MD5; else we'll have to read the file,
+    // which we do only for small files (large files are verified
+    // asynchronously, and if that failed we couldn't fall back
+    // to downloading)
+    //
+    bool known_md5 = !stamp.get(src_path)
+        && stamp == src->verified_stamp
+        && !strcmp(src->verified_md5, src->md5_cksum);
+    if (!known_md5 && fip->nbytes > ASYNC_FILE_THRESHOLD) {
+        return false;
+    }
+
+    const char* how = "Cloned";
+    if (boinc_clone_file(src_path, path)) {
+        how = "Linked";
+        retval = ERR_NOT_IMPLEMENTED;
+        if (fip->signature_required && src->signature_required) {
+            retval = hard_link_file(src_path, path);
+        }
+        if (retval) {
+            if (fip->nbytes > ASYNC_FILE_THRESHOLD) return false;
+            how = "Copied";
+            retval = boinc_copy(src_path, path);
+            if (retval) {
+                boinc_delete_file(path);
+                return false;
+            }
+        }
+    }
+    if (known_md5) {
+        strcpy(fip->download_md5, src->md5_cksum);
+    }
+    retval = fip->verify_file(true, false, false);
+    if (retval) {
+        boinc_delete_file(path);
+        strcpy(fip->download_md5, "");
+        fip->error_msg = "";
+        fip->status = FILE_NOT_PRESENT;
+        return false;
+    }
+    if (log_flags.file_xfer) {
+        msg_printf(fip->project, MSG_INFO,
+            "%s %s from identical file %s (%s); not downloading",
+            how, fip->name, src->name, src->project->get_project_name()
+        );
+    }
+    fip->set_permissions();
+    fip->status = FILE_PRESENT;
+    fip->project->add_project_dir_size(fip->nbytes);
+    if (fip->is_user_file) {
+        gstate.active_tasks.request_reread_prefs(fip->project);
+    }
+    if (fip->is_project_file) {
+        fip->project->write_symlink_for_project_file(fip);
+        fip->project->update_project_files_downloaded_time();
+    }
+    return true;
+}
+
 // scan FILE_INFOs and create PERS_FILE_XFERs as needed.
 // NOTE: this doesn't start the file transfers
 // scan PERS_FILE_XFERs and delete finished ones.
@@ -347,9 +501,13 @@ bool CLIENT_STATE::create_and_delete_pers_file_xfers() {
     bool action = false;
     int retval;
     static double last_time;
+    map<string, FILE_INFO*> present;
+        // present files by MD5 and size; made when first needed
+    bool have_present = false;
 
-    if (!clock_change && now - last_time < PERS_FILE_XFER_START_PERIOD) return false;
-    last_time = now;
+    if (!poll_due(POLL_FLAG_PFX, last_time, PERS_FILE_XFER_START_PERIOD)) {
+        return false;
+    }
 
     // Look for FILE_INFOs for which we should start a transfer,
     // and make PERS_FILE_XFERs for them
@@ -359,6 +517,24 @@ bool CLIENT_STATE::create_and_delete_pers_file_xfers() {
         pfx = fip->pers_file_xfer;
         if (pfx) continue;
         if (fip->downloadable() && fip->status == FILE_NOT_PRESENT) {
+            if (can_share(fip)) {
+                if (!have_present) {
+                    for (unsigned int j=0; j<file_infos.size(); j++) {
+                        FILE_INFO* f = file_infos[j];
+                        if (f->status != FILE_PRESENT) continue;
+                        if (!can_share(f)) continue;
+                        present[content_key(f)] = f;
+                    }
+                    have_present = true;
+                }
+                map<string, FILE_INFO*>::iterator mi = present.find(content_key(fip));
+                if (mi != present.end()
+                    && make_from_identical_file(fip, mi->second)
+                ) {
+                    action = true;
+                    continue;
+                }
+            }
             pfx = new PERS_FILE_XFER;
             pfx->init(fip, false);
             fip->pers_file_xfer = pfx;
@@ -424,6 +600,7 @@ bool CLIENT_STATE::create_and_delete_pers_file_xfers() {
                     //
                     retval = fip->set_permissions();
                     fip->status = FILE_PRESENT;
+                    fip->project->add_project_dir_size(fip->nbytes);
                 }
 
                 // if it's a user file, tell running apps to reread prefs
@@ -24,6 +24,8 @@
 #include <string>
 #endif
 
+#include "error_numbers.h"
+#include "mfile.h"
 #include "parse.h"
 #include "url.h"
 #include "filesys.h"
@@ -257,6 +259,7 @@ void NOTICES::init_rss() {
     for (unsigned int i=0; i<n; i++) {
         notices[i].seqno = (int)(n - i);
     }
+    make_index();
 }
 
 // return true if strings are the same after discarding digits.
@@ -291,6 +294,73 @@ static inline bool same_text(NOTICE& n1, NOTICE& n2) {
     return true;
 }
 
+// hash (FNV-1a) of the title and the description without digits;
+// notices with the same_text() have the same hash
+//
+static unsigned int text_hash(NOTICE& n) {
+    unsigned int h = 2166136261u;
+    const char* p;
+    for (p = n.title; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    h = (h ^ 0) * 16777619u;
+    for (p = n.description.c_str(); *p; p++) {
+        if (isascii(*p) && isdigit(*p)) continue;
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    return h;
+}
+
+static inline bool seqno_desc(const NOTICE& n, int seqno) {
+    return n.seqno > seqno;
+}
+
+// return the first notice with seqno <= the given one
+// (notices are in decreasing seqno order)
+//
+deque<NOTICE>::iterator NOTICES::lookup_seqno(int seqno) {
+    return std::lower_bound(notices.begin(), notices.end(), seqno, seqno_desc);
+}
+
+void NOTICES::add_to_index(NOTICE& n) {
+    if (strlen(n.guid)) {
+        guid_index[string(n.guid)] = n.seqno;
+    }
+    text_index.insert(std::pair<unsigned int, int>(text_hash(n), n.seqno));
+}
+
+void NOTICES::make_index() {
+    guid_index.clear();
+    text_index.clear();
+    for (unsigned int i=0; i<notices.size(); i++) {
+        add_to_index(notices[i]);
+    }
+}
+
+// remove a notice and its index entries;
+// return the iterator of the next one
+//
+deque<NOTICE>::iterator NOTICES::erase(deque<NOTICE>::iterator i) {
+    NOTICE& n = *i;
+    if (strlen(n.guid)) {
+        std::map<string, int>::iterator gi = guid_index.find(string(n.guid));
+        if (gi != guid_index.end() && gi->second == n.seqno) {
+            guid_index.erase(gi);
+        }
+    }
+    std::pair<
+        std::multimap<unsigned int, int>::iterator,
+        std::multimap<unsigned int, int>::iterator
+    > r = text_index.equal_range(text_hash(n));
+    for (std::multimap<unsigned int, int>::iterator ti = r.first; ti != r.second; ++ti) {
+        if (ti->second == n.seqno) {
+            text_index.erase(ti);
+            break;
+        }
+    }
+    return notices.erase(i);
+}
+
 void NOTICES::clear_keep() {
     deque<NOTICE>::iterator i = notices.begin();
     while (i != notices.end()) {
@@ -306,7 +376,7 @@ void NOTICES::unkeep(const char* url) {
     while (i != notices.end()) {
         NOTICE& n = *i;
         if (!strcmp(url, n.feed_url) && !n.keep) {
-            i = notices.erase(i);
+            i = erase(i);
             removed_something = true;
         } else {
             i++;
@@ -319,54 +389,98 @@ void NOTICES::unkeep(const char* url) {
 #endif
 }
 
-static inline bool same_guid(NOTICE& n1, NOTICE& n2) {
-    if (!strlen(n1.guid)) return false;
-    return !strcmp(n1.guid, n2.guid);
+// remove notices older than 30 days.
+// This scans all notices, so do it at most once an hour.
+//
+void NOTICES::remove_old() {
+    if (gstate.now < last_expire_time + 3600) return;
+    last_expire_time = gstate.now;
+
+    deque<NOTICE>::iterator i = notices.begin();
+    bool removed_something = false;
+    double min_time = gstate.now - 30*86400;
+    while (i != notices.end()) {
+        NOTICE& n = *i;
+        if (n.arrival_time < min_time
+            || (n.create_time && n.create_time < min_time)
+        ) {
+            i = erase(i);
+            removed_something = true;
+        } else {
+            ++i;
+        }
+    }
+#ifndef SIM
+    if (removed_something) {
+        gstate.gui_rpcs.set_notice_refresh();
+    }
+#endif
 }
 
 // we're considering adding a notice n.
-// If there's already an identical message n2
+// If there's already a message n2 with the same GUID
 //     return false (don't add n)
 // If there's a message n2 with same title and text,
 //      and n is significantly newer than n2,
 //      delete n2
 //
+// Existing messages are found with guid_index and text_index,
+// so this doesn't depend on the number of notices.
 // Also remove notices older than 30 days
 //
 bool NOTICES::remove_dups(NOTICE& n) {
-    deque<NOTICE>::iterator i = notices.begin();
+    deque<NOTICE>::iterator i;
     bool removed_something = false;
     bool retval = true;
     double min_time = gstate.now - 30*86400;
-    while (i != notices.end()) {
-        NOTICE& n2 = *i;
-        if (n2.arrival_time < min_time
-            || (n2.create_time && n2.create_time < min_time)
-        ) {
-            i = notices.erase(i);
-            removed_something = true;
-        } else if (same_guid(n, n2)) {
-            n2.keep = true;
-            return false;
-        } else if (same_text(n, n2)) {
-            int min_diff = 0;
 
-            // show a given scheduler notice at most once a week
-            //
-            if (!strcmp(n.category, "scheduler")) {
-                min_diff = 7*86400;
-            }
+    remove_old();
+    if (n.arrival_time < min_time
+        || (n.create_time && n.create_time < min_time)
+    ) {
+        return false;
+    }
 
-            if (n.create_time > n2.create_time + min_diff) {
-                i = notices.erase(i);
-                removed_something = true;
-            } else {
-                n2.keep = true;
-                retval = false;
-                ++i;
+    if (strlen(n.guid)) {
+        std::map<string, int>::iterator gi = guid_index.find(string(n.guid));
+        if (gi != guid_index.end()) {
+            i = lookup_seqno(gi->second);
+            if (i != notices.end() && i->seqno == gi->second) {
+                i->keep = true;
+                return false;
             }
+        }
+    }
+
+    // get the seqnos first; erase() changes text_index
+    //
+    vector<int> seqnos;
+    std::pair<
+        std::multimap<unsigned int, int>::iterator,
+        std::multimap<unsigned int, int>::iterator
+    > r = text_index.equal_range(text_hash(n));
+    for (std::multimap<unsigned int, int>::iterator ti = r.first; ti != r.second; ++ti) {
+        seqnos.push_back(ti->second);
+    }
+    for (unsigned int j=0; j<seqnos.size(); j++) {
+        i = lookup_seqno(seqnos[j]);
+        if (i == notices.end() || i->seqno != seqnos[j]) continue;
+        NOTICE& n2 = *i;
+        if (!same_text(n, n2)) continue;
+        int min_diff = 0;
+
+        // show a given scheduler notice at most once a week
+        //
+        if (!strcmp(n.category, "scheduler")) {
+            min_diff = 7*86400;
+        }
+
+        if (n.create_time > n2.create_time + min_diff) {
+            erase(i);
+            removed_something = true;
         } else {
-            ++i;
+            n2.keep = true;
+            retval = false;
         }
     }
 #ifndef SIM
@@ -395,6 +509,7 @@ bool NOTICES::append(NOTICE& n) {
         );
     }
     notices.push_front(n);
+    add_to_index(notices.front());
 #if 0
     if (!strlen(n.feed_url)) {
         write_archive(NULL);
@@ -453,22 +568,23 @@ int NOTICES::read_archive_file(const char* path, RSS_FEED* rfp) {
 }
 
 // write archive file for the given RSS feed
-// (or, if NULL, non-RSS notices)
+// (or, if NULL, non-RSS notices).
+// The XML is generated here; the file is written by the worker thread.
 //
 void NOTICES::write_archive(RSS_FEED* rfp) {
     char path[MAXPATHLEN];
+    MFILE mf;
+    MIOFILE fout;
+    char* buf;
+    int len;
 
     if (rfp) {
         rfp->archive_file_name(path);
     } else {
         safe_strcpy(path, NOTICES_DIR"/archive.xml");
     }
-    FILE* f = fopen(path, "w");
-    if (!f) return;
-    MIOFILE fout;
-    fout.init_file(f);
+    fout.init_mfile(&mf);
     fout.printf("<notices>\n");
-    if (!f) return;
     for (unsigned int i=0; i<notices.size(); i++) {
         NOTICE& n = notices[i];
         if (rfp) {
@@ -479,7 +595,15 @@ void NOTICES::write_archive(RSS_FEED* rfp) {
         n.write(fout, false);
     }
     fout.printf("</notices>\n");
-    fclose(f);
+    NOTICE_FILE_OP* op = new NOTICE_FILE_OP(
+        NOTICE_FILE_WRITE_ARCHIVE, rfp?rfp->url:"", path
+    );
+    mf.get_buf(buf, len);
+    if (buf) {
+        op->text.assign(buf, len);
+        free(buf);
+    }
+    add_async_op(op);
 }
 
 // Remove "need network access" notices
@@ -489,7 +613,7 @@ void NOTICES::remove_network_msg() {
     while (i != notices.end()) {
         NOTICE& n = *i;
         if (!strcmp(n.description.c_str(), NEED_NETWORK_MSG)) {
-            i = notices.erase(i);
+            i = erase(i);
 #ifndef SIM
             gstate.gui_rpcs.set_notice_refresh();
 #endif
@@ -513,7 +637,7 @@ void NOTICES::remove_scheduler_notices(PROJECT* p) {
         if (!strcmp(n.project_name, p->get_project_name())
             && !strcmp(n.category, "scheduler")
         ) {
-            i = notices.erase(i);
+            i = erase(i);
 #ifndef SIM
             gstate.gui_rpcs.set_notice_refresh();
 #endif
@@ -553,10 +677,7 @@ void NOTICES::write(int seqno, GUI_RPC_CONN& grc, bool public_only) {
             msg_printf(0, MSG_INFO, "NOTICES::write: sending -1 seqno notice");
         }
     } else {
-        for (i=0; i<notices.size(); i++) {
-            NOTICE& n = notices[i];
-            if (n.seqno <= seqno) break;
-        }
+        i = lookup_seqno(seqno) - notices.begin();
     }
     for (; i>0; i--) {
         NOTICE& n = notices[i-1];
@@ -643,73 +764,172 @@ static inline bool create_time_asc(NOTICE n1, NOTICE n2) {
     return n1.create_time < n2.create_time;
 }
 
-// parse the actual RSS feed.
+// add the items of a fetched feed (from NOTICE_FILE_OP::read_feed())
+// to the notices, and remove notices no longer in the feed.
+// Return the number added.
 //
-int RSS_FEED::parse_items(XML_PARSER& xp, int& nitems) {
-    nitems = 0;
-    int ntotal = 0, nerror = 0;
-    int retval, func_ret = ERR_XML_PARSE;
+int RSS_FEED::add_items(vector<NOTICE>& items) {
+    int nitems = 0;
     vector<NOTICE> new_notices;
 
     notices.clear_keep();
 
-    while (!xp.get_tag()) {
-        if (!xp.is_tag) continue;
-        if (xp.match_tag("/rss")) {
+    for (unsigned int i=0; i<items.size(); i++) {
+        NOTICE& n = items[i];
+        if (n.create_time < gstate.now - 30*86400) {
             if (log_flags.notice_debug) {
                 msg_printf(0, MSG_INFO,
-                    "[notice] parsed RSS feed: total %d error %d added %d",
-                    ntotal, nerror, nitems
+                    "[notice] item is older than 30 days: %s",
+                    n.title
                 );
             }
-            func_ret = 0;
+            continue;
+        }
+        n.arrival_time = gstate.now;
+        n.keep = true;
+        safe_strcpy(n.feed_url, url);
+        safe_strcpy(n.project_name, project_name);
+        new_notices.push_back(n);
+    }
+
+    //  sort new notices by increasing create time, and append them
+    //
+    std::sort(new_notices.begin(), new_notices.end(), create_time_asc);
+    for (unsigned int i=0; i<new_notices.size(); i++) {
+        NOTICE& n = new_notices[i];
+        if (notices.append(n)) {
+            nitems++;
+        }
+    }
+    notices.unkeep(url);
+    return nitems;
+}
+
+///////////// NOTICE_FILE_OP ////////////////
+
+NOTICE_FILE_OP::NOTICE_FILE_OP(
+    int _type, const char* _url, const char* _path
+) {
+    type = _type;
+    safe_strcpy(url, _url);
+    safe_strcpy(path, _path);
+    ntotal = 0;
+    nerror = 0;
+    error_num = 0;
+    got_error_num = false;
+}
+
+// This runs in the worker thread,
+// so it doesn't look at client state or write messages.
+//
+int NOTICE_FILE_OP::do_chunk() {
+    int retval;
+    if (type == NOTICE_FILE_READ_FEED) {
+        retval = read_feed();
+    } else {
+        retval = write_archive();
+    }
+    return retval?retval:1;
+}
+
+// parse the actual RSS feed.
+// If the file is truncated, return ERR_XML_PARSE
+// but keep the items parsed so far.
+//
+int NOTICE_FILE_OP::read_feed() {
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    MIOFILE fin;
+    fin.init_file(f);
+    XML_PARSER xp(&fin);
+    int retval = ERR_XML_PARSE;
+    while (!xp.get_tag()) {
+        if (!xp.is_tag) continue;
+        if (xp.match_tag("/rss")) {
+            retval = 0;
             break;
         }
         if (xp.match_tag("item")) {
             NOTICE n;
             ntotal++;
-            retval = n.parse_rss(xp);
-            if (retval) {
+            if (n.parse_rss(xp)) {
                 nerror++;
-            } else if (n.create_time < gstate.now - 30*86400) {
-                if (log_flags.notice_debug) {
-                    msg_printf(0, MSG_INFO,
-                        "[notice] item is older than 30 days: %s",
-                        n.title
-                    );
-                }
             } else {
-                n.arrival_time = gstate.now;
-                n.keep = true;
-                safe_strcpy(n.feed_url, url);
-                safe_strcpy(n.project_name, project_name);
-                new_notices.push_back(n);
+                items.push_back(n);
             }
             continue;
         }
-        if (xp.parse_int("error_num", retval)) {
-            if (log_flags.notice_debug) {
-                msg_printf(0,MSG_INFO,
-                    "[notice] RSS fetch returned error %d (%s)",
-                    retval,
-                    boincerror(retval)
-                );
-            }
-            return retval;
+        if (xp.parse_int("error_num", error_num)) {
+            got_error_num = true;
+            items.clear();
+            retval = 0;
+            break;
         }
     }
+    fclose(f);
+    return retval;
+}
+
+// write to a temp file and rename it,
+// so that a partly-written archive is never read
+//
+int NOTICE_FILE_OP::write_archive() {
+    char tmp_path[MAXPATHLEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "w");
+    if (!f) return ERR_FOPEN;
+    size_t n = fwrite(text.c_str(), 1, text.size(), f);
+    if (fclose(f) || n != text.size()) {
+        boinc_delete_file(tmp_path);
+        return ERR_FWRITE;
+    }
+    return boinc_rename(tmp_path, path);
+}
 
-    //  sort new notices by increasing create time, and append them
+void NOTICE_FILE_OP::done(int retval) {
+    if (type == NOTICE_FILE_WRITE_ARCHIVE) {
+        if (retval && log_flags.notice_debug) {
+            msg_printf(0, MSG_INFO,
+                "[notice] can't write %s: %s", path, boincerror(retval)
+            );
+        }
+        return;
+    }
+    if (retval == ERR_FOPEN) {
+        msg_printf(0, MSG_INTERNAL_ERROR,
+            "RSS feed file '%s' not found", path
+        );
+        return;
+    }
+    if (got_error_num) {
+        if (log_flags.notice_debug) {
+            msg_printf(0,MSG_INFO,
+                "[notice] RSS fetch returned error %d (%s)",
+                error_num,
+                boincerror(error_num)
+            );
+        }
+        return;
+    }
+
+    // the feed may have been removed while we were reading it
     //
-    std::sort(new_notices.begin(), new_notices.end(), create_time_asc);
-    for (unsigned int i=0; i<new_notices.size(); i++) {
-        NOTICE& n = new_notices[i];
-        if (notices.append(n)) {
-            nitems++;
+    RSS_FEED* rfp = rss_feeds.lookup_url(url);
+    if (!rfp) return;
+    int nitems = rfp->add_items(items);
+    if (retval) {
+        if (log_flags.notice_debug) {
+            msg_printf(0, MSG_INFO,
+                "[notice] RSS parse error: %d", retval
+            );
         }
+    } else if (log_flags.notice_debug) {
+        msg_printf(0, MSG_INFO,
+            "[notice] parsed RSS feed: total %d error %d added %d",
+            ntotal, nerror, nitems
+        );
     }
-    notices.unkeep(url);
-    return func_ret;
+    notices.write_archive(rfp);
 }
 
 ///////////// RSS_FEED_OP ////////////////
@@ -750,7 +970,6 @@ bool RSS_FEED_OP::poll() {
 //
 void RSS_FEED_OP::handle_reply(int http_op_retval) {
     char filename[256];
-    int nitems;
 
     if (!rfp) return;   // op was canceled
 
@@ -769,28 +988,12 @@ void RSS_FEED_OP::handle_reply(int http_op_retval) {
         );
     }
 
+    // read the file, and write the archive, in the worker thread
+    //
     rfp->feed_file_name(filename);
-    FILE* f = fopen(filename, "r");
-    if (!f) {
-        msg_printf(0, MSG_INTERNAL_ERROR,
-            "RSS feed file '%s' not found", filename
-        );
-        return;
-    }
-    MIOFILE fin;
-    fin.init_file(f);
-    XML_PARSER xp(&fin);
-    int retval = rfp->parse_items(xp, nitems);
-    if (retval) {
-        if (log_flags.notice_debug) {
-            msg_printf(0, MSG_INFO,
-                "[notice] RSS parse error: %d", retval
-            );
-        }
-    }
-    fclose(f);
-
-    notices.write_archive(rfp);
+    add_async_op(
+        new NOTICE_FILE_OP(NOTICE_FILE_READ_FEED, rfp->url, filename)
+    );
 }
 
 ///////////// RSS_FEEDS ////////////////
@@ -49,12 +49,19 @@
 // notices/feeds_PROJ_URL.xml       list of project feeds
 // notices/RSS_URL.xml              result of last fetch for a feed
 // notices/archive_RSS_URL.xml      archive for a feed
+//
+// Reading a fetched feed file and writing archive files
+// is done by the async file worker thread (NOTICE_FILE_OP).
 
 #include <deque>
+#include <map>
+#include <string>
 #include <vector>
 
 #include "miofile.h"
 
+#include "async_file.h"
+
 #include "gui_http.h"
 #include "client_types.h"
 #include "gui_rpc_server.h"
@@ -64,6 +71,20 @@
 struct NOTICES {
     std::deque<NOTICE> notices;
         // stored newest (i.e. highest seqno) message first
+    std::map<std::string, int> guid_index;
+        // GUID -> seqno
+    std::multimap<unsigned int, int> text_index;
+        // hash of title and description (ignoring digits) -> seqno
+    double last_expire_time;
+
+    NOTICES() {
+        last_expire_time = 0;
+    }
+    std::deque<NOTICE>::iterator lookup_seqno(int seqno);
+    std::deque<NOTICE>::iterator erase(std::deque<NOTICE>::iterator);
+    void add_to_index(NOTICE&);
+    void make_index();
+    void remove_old();
     void write(int seqno, GUI_RPC_CONN&, bool public_only);
     bool append(NOTICE&);
     void init();
@@ -81,6 +102,8 @@ struct NOTICES {
         // to remove notices that weren't in the feed.
     void clear() {
         notices.clear();
+        guid_index.clear();
+        text_index.clear();
     }
 };
 
@@ -100,7 +123,7 @@ struct RSS_FEED {
 
     void write(MIOFILE&);
     int parse_desc(XML_PARSER&);
-    int parse_items(XML_PARSER&, int&);
+    int add_items(std::vector<NOTICE>&);
     void feed_file_name(char*);
     void archive_file_name(char*);
     int read_archive_file();
@@ -118,6 +141,32 @@ struct RSS_FEED_OP: public GUI_HTTP_OP {
 
 extern RSS_FEED_OP rss_feed_op;
 
+// read a fetched RSS feed file, or write an archive file,
+// in the async file worker thread
+//
+#define NOTICE_FILE_READ_FEED      1
+#define NOTICE_FILE_WRITE_ARCHIVE  2
+
+struct NOTICE_FILE_OP : ASYNC_FILE_OP {
+    int type;
+    char url[256];
+        // feed URL
+    char path[MAXPATHLEN];
+    std::string text;
+        // archive contents, for write
+    std::vector<NOTICE> items;
+        // parsed items, for read
+    int ntotal, nerror, error_num;
+    bool got_error_num;
+        // the feed server returned an error instead of a feed
+
+    NOTICE_FILE_OP(int _type, const char* _url, const char* _path);
+    int do_chunk();
+    int read_feed();
+    int write_archive();
+    void done(int);
+};
+
 struct RSS_FEEDS {
     std::vector<RSS_FEED> feeds;
     void init();
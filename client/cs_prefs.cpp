@@ -73,11 +73,21 @@ double CLIENT_STATE::allowed_disk_usage(double boinc_total) {
 
 #ifndef SIM
 
+#define DISK_USAGE_SCAN_PERIOD  3600
+    // rescan project dirs this often
+
 // populate:
 // PROJECT::disk_usage for all projects
 // GLOBAL_STATE::client_disk_usage
 // GLOBAL_STATE::total_disk_usage
 //
+// Project dirs can have many files, so we don't scan them each time.
+// The client adjusts PROJECT::project_dir_size as it adds
+// and deletes files (see FILE_INFO::delete_file());
+// other changes are picked up by a scan every DISK_USAGE_SCAN_PERIOD.
+// Slot dirs are tracked incrementally: only changed files are stat()ed
+// (see DIR_WATCH).
+//
 int CLIENT_STATE::get_disk_usages() {
     unsigned int i;
     double size;
@@ -89,15 +99,23 @@ int CLIENT_STATE::get_disk_usages() {
     total_disk_usage = 0;
     for (i=0; i<projects.size(); i++) {
         p = projects[i];
-        p->disk_usage = 0;
-        retval = dir_size(p->project_dir(), size);
-        if (!retval) p->disk_usage = size;
+        if (!p->project_dir_scan_time
+            || now > p->project_dir_scan_time + DISK_USAGE_SCAN_PERIOD
+            || now < p->project_dir_scan_time
+        ) {
+            retval = dir_size(p->project_dir(), size);
+            if (!retval) {
+                p->project_dir_size = size;
+                p->project_dir_scan_time = now;
+            }
+        }
+        p->disk_usage = p->project_dir_size;
     }
 
     for (i=0; i<active_tasks.active_tasks.size(); i++) {
         ACTIVE_TASK* atp = active_tasks.active_tasks[i];
         get_slot_dir(atp->slot, buf, sizeof(buf));
-        retval = dir_size(buf, size);
+        retval = atp->slot_watch.get_size(buf, size);
         if (retval) continue;
         atp->wup->project->disk_usage += size;
     }
@@ -552,6 +570,7 @@ int PROJECT::parse_preferences_for_user_files() {
             safe_strcpy(fip->name, filename.c_str());
             fip->is_user_file = true;
             gstate.file_infos.push_back(fip);
+            gstate.file_info_index.insert(fip);
         }
 
         fr.file_info = fip;
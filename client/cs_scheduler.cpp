@@ -38,6 +38,7 @@
 #include "error_numbers.h"
 #include "file_names.h"
 #include "filesys.h"
+#include "gzip_util.h"
 #include "parse.h"
 #include "str_util.h"
 #include "str_replace.h"
@@ -392,6 +393,20 @@ int CLIENT_STATE::make_scheduler_request(PROJECT* p) {
     fprintf(f, "</scheduler_request>\n");
 
     fclose(f);
+
+    // sticky file lists and in-progress job lists compress well;
+    // send the request gzipped if the scheduler has said it can take it.
+    // If compression fails, send it as is.
+    //
+    if (p->gzip_sched_request) {
+        char path[MAXPATHLEN];
+        snprintf(path, sizeof(path), "%s.gz", buf);
+        if (!gzip_file(buf, path, -1, 1)) {
+            boinc_rename(path, buf);
+        } else {
+            boinc_delete_file(path);
+        }
+    }
     return 0;
 }
 
@@ -426,6 +441,17 @@ static inline bool idle_request() {
     return found;
 }
 
+// We're going to contact a project for a reason other than work fetch.
+// Ask for work too, unless another RPC in progress is asking for work
+//
+static void piggyback_work_request(PROJECT* p) {
+    if (gstate.scheduler_ops->requesting_work()) {
+        work_fetch.clear_request();
+    } else {
+        work_fetch.piggyback_work_request(p);
+    }
+}
+
 // Called once/sec.
 // Initiate scheduler RPC activity if needed and possible
 //
@@ -435,15 +461,18 @@ bool CLIENT_STATE::scheduler_rpc_poll() {
     static double last_work_fetch_time = 0;
     double elapsed_time;
 
-    // are we currently doing a scheduler RPC?
-    // If so, see if it's finished
+    // see if any RPCs in progress have finished
     //
-    if (scheduler_op->state != SCHEDULER_OP_STATE_IDLE) {
+    if (scheduler_ops->poll()) {
         last_time = now;
-        scheduler_op->poll();
-        return (scheduler_op->state == SCHEDULER_OP_STATE_IDLE);
+        return true;
     }
 
+    // is there room for another?
+    //
+    SCHEDULER_OP* scheduler_op = scheduler_ops->get_idle_op();
+    if (!scheduler_op) return false;
+
     if (network_suspended) return false;
 
     // check only every 5 sec
@@ -479,13 +508,13 @@ bool CLIENT_STATE::scheduler_rpc_poll() {
                 p->rsc_pwf[i].clear_backoff();
             }
         }
-        work_fetch.piggyback_work_request(p);
+        piggyback_work_request(p);
         scheduler_op->init_op_project(p, p->sched_rpc_pending);
         return true;
     }
     p = next_project_trickle_up_pending();
     if (p) {
-        work_fetch.piggyback_work_request(p);
+        piggyback_work_request(p);
         scheduler_op->init_op_project(p, RPC_REASON_TRICKLE_UP);
         return true;
     }
@@ -508,7 +537,7 @@ bool CLIENT_STATE::scheduler_rpc_poll() {
     suspend_soon |= global_prefs.cpu_times.suspended(now + 1800);
     p = find_project_with_overdue_results(suspend_soon);
     if (p) {
-        work_fetch.piggyback_work_request(p);
+        piggyback_work_request(p);
         scheduler_op->init_op_project(p, RPC_REASON_RESULTS_DUE);
         return true;
     }
@@ -526,6 +555,9 @@ bool CLIENT_STATE::scheduler_rpc_poll() {
     if (config.fetch_minimal_work && had_or_requested_work) {
         return false;
     }
+    if (scheduler_ops->requesting_work()) {
+        return false;
+    }
 
     p = work_fetch.choose_project();
     if (p) {
@@ -563,6 +595,10 @@ int CLIENT_STATE::handle_scheduler_reply(
 
     project->last_rpc_time = now;
 
+    // the reply may add or acknowledge results and files
+    //
+    set_poll_flags();
+
     if (work_fetch.requested_work()) {
         had_or_requested_work = true;
     }
@@ -816,6 +852,7 @@ int CLIENT_STATE::handle_scheduler_reply(
                 delete fip;
             } else {
                 file_infos.push_back(fip);
+                file_info_index.insert(fip);
             }
         }
     }
@@ -909,6 +946,7 @@ int CLIENT_STATE::handle_scheduler_reply(
         }
         wup->clear_errors();
         workunits.push_back(wup);
+        workunit_index.insert(wup);
     }
     double est_rsc_runtime[MAX_RSC];
     for (int j=0; j<coprocs.n_rsc; j++) {
@@ -932,7 +970,7 @@ int CLIENT_STATE::handle_scheduler_reply(
             continue;
         }
         if (strlen(rp->platform) == 0) {
-            safe_strcpy(rp->platform, get_primary_platform());
+            rp->platform = intern_string(get_primary_platform());
             rp->version_num = latest_version(rp->wup->app, rp->platform);
         }
         rp->avp = lookup_app_version(
@@ -966,6 +1004,7 @@ int CLIENT_STATE::handle_scheduler_reply(
         rp->received_time = now;
         new_results.push_back(rp);
         results.push_back(rp);
+        result_index.insert(rp);
     }
     sort_results();
 
@@ -1043,6 +1082,7 @@ int CLIENT_STATE::handle_scheduler_reply(
         project->send_full_workload = true;
     }
     project->dont_use_dcf = sr.dont_use_dcf;
+    project->gzip_sched_request = sr.gzip_request;
     project->send_time_stats_log = sr.send_time_stats_log;
     project->send_job_log = sr.send_job_log;
     project->trickle_up_pending = false;
@@ -1156,6 +1196,7 @@ PROJECT* CLIENT_STATE::next_project_master_pending() {
         p = projects[i];
         if (p->waiting_until_min_rpc_time()) continue;
         if (p->suspended_via_gui) continue;
+        if (scheduler_ops->lookup(p)) continue;
         if (p->master_url_fetch_pending) {
             return p;
         }
@@ -1178,6 +1219,8 @@ PROJECT* CLIENT_STATE::next_project_sched_rpc_pending() {
         bool honor_backoff = true;
         bool honor_suspend = true;
 
+        if (scheduler_ops->lookup(p)) continue;
+
         // is a scheduler-requested RPC due?
         //
         if (!p->sched_rpc_pending && p->next_rpc_time && p->next_rpc_time<now) {
@@ -1226,6 +1269,7 @@ PROJECT* CLIENT_STATE::next_project_trickle_up_pending() {
         p = projects[i];
         if (p->waiting_until_min_rpc_time()) continue;
         if (p->suspended_via_gui) continue;
+        if (scheduler_ops->lookup(p)) continue;
         if (p->trickle_up_pending) {
             return p;
         }
@@ -1257,6 +1301,7 @@ PROJECT* CLIENT_STATE::find_project_with_overdue_results(
         p->dont_contact = false;
         if (p->waiting_until_min_rpc_time()) p->dont_contact = true;
         if (p->suspended_via_gui) p->dont_contact = true;
+        if (scheduler_ops->lookup(p)) p->dont_contact = true;
 #ifndef SIM
         if (actively_uploading(p)) p->dont_contact = true;
 #endif
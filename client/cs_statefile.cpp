@@ -41,9 +41,24 @@
 
 #define MAX_STATE_FILE_WRITE_ATTEMPTS 2
 
-void CLIENT_STATE::set_client_state_dirty(const char* source) {
+// If can_defer is set, the change is routine
+// (it's OK to lose it if the client crashes)
+// and if <state_file_write_interval> is set,
+// writing the state file can wait up to that long.
+// This cuts writes on hosts with many running tasks.
+//
+void CLIENT_STATE::set_client_state_dirty(const char* source, bool can_defer) {
     if (log_flags.statefile_debug) {
-        msg_printf(0, MSG_INFO, "[statefile] set dirty: %s\n", source);
+        msg_printf(0, MSG_INFO, "[statefile] set dirty: %s%s\n",
+            source, can_defer?" (can defer)":""
+        );
+    }
+    if (can_defer && config.state_file_write_interval > 0) {
+        if (!state_file_deferred_write_time) {
+            state_file_deferred_write_time =
+                now + config.state_file_write_interval;
+        }
+        return;
     }
     client_state_dirty = true;
 }
@@ -113,6 +128,17 @@ int CLIENT_STATE::parse_state_file() {
     return parse_state_file_aux(fname);
 }
 
+// remove CRs, as reading the file in text mode would on Windows
+//
+static void strip_cr(char* p) {
+    char* q = p;
+    while (*p) {
+        if (*p != '\r') *q++ = *p;
+        p++;
+    }
+    *q = 0;
+}
+
 int CLIENT_STATE::parse_state_file_aux(const char* fname) {
     PROJECT *project=NULL;
     int retval=0;
@@ -120,11 +146,18 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
     bool btemp;
     string stemp;
 
-    FILE* f = fopen(fname, "r");
-    if (!f) return ERR_FOPEN;
+    // read the file into memory and parse it from there;
+    // this is much faster than parsing from a FILE
+    // (the state file can be tens of MB)
+    //
+    char* state_buf;
+    retval = read_file_malloc(fname, state_buf);
+    if (retval) return ERR_FOPEN;
+    strip_cr(state_buf);
     MIOFILE mf;
     XML_PARSER xp(&mf);
-    mf.init_file(f);
+    mf.init_buf_read(state_buf);
+    retval = 0;
     while (!xp.get_tag()) {
         if (xp.match_tag("/client_state")) {
             break;
@@ -221,6 +254,7 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 continue;
             }
             file_infos.push_back(fip);
+            file_info_index.insert(fip);
 #ifndef SIM
             // If the file had a failure before,
             // don't start another file transfer
@@ -329,6 +363,7 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 continue;
             }
             workunits.push_back(wup);
+            workunit_index.insert(wup);
             continue;
         }
         if (xp.match_tag("result")) {
@@ -362,7 +397,7 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
             // skip for anon platform
             if (!project->anonymous_platform) {
                 if (!strlen(rp->platform) || !is_supported_platform(rp->platform)) {
-                    safe_strcpy(rp->platform, get_primary_platform());
+                    rp->platform = intern_string(get_primary_platform());
                     rp->version_num = latest_version(rp->wup->app, rp->platform);
                 }
             }
@@ -385,6 +420,7 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
             }
             rp->wup->version_num = rp->version_num;
             results.push_back(rp);
+            result_index.insert(rp);
             continue;
         }
         if (xp.match_tag("project_files")) {
@@ -524,7 +560,7 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
         xp.skip_unexpected();
     }
     sort_results();
-    fclose(f);
+    free(state_buf);
     
     // if total resource share is zero, set all shares to 1
     //
@@ -580,6 +616,10 @@ int CLIENT_STATE::write_state_file() {
     char win_error_msg[4096];
 #endif
 
+    // this write includes any deferred changes
+    //
+    state_file_deferred_write_time = 0;
+
     for (attempt=1; attempt<=MAX_STATE_FILE_WRITE_ATTEMPTS; attempt++) {
         if (attempt > 1) boinc_sleep(1.0);
             
@@ -603,6 +643,10 @@ int CLIENT_STATE::write_state_file() {
             if (attempt < MAX_STATE_FILE_WRITE_ATTEMPTS) continue;
             return ERR_FOPEN;
         }
+        // we write to a temp file and rename it,
+        // so there's no need to hold the whole thing in memory
+        //
+        mf.set_flush_size(1024*1024);
         MIOFILE miof;
         miof.init_mfile(&mf);
         ret1 = write_state(miof);
@@ -689,14 +733,15 @@ int CLIENT_STATE::write_state_file() {
     return 0;
 }
 
+#endif // ifndef SIM
+
+// The simulator doesn't write client_state.xml;
+// it uses this only to time it (see sim_bench.cpp)
+//
 int CLIENT_STATE::write_state(MIOFILE& f) {
     unsigned int i, j;
     int retval;
 
-#ifdef SIM
-    fprintf(stderr, "simulator shouldn't write state file\n");
-    exit(1);
-#endif
     f.printf("<client_state>\n");
     retval = host_info.write(f, true, true);
     if (retval) return retval;
@@ -784,11 +829,16 @@ int CLIENT_STATE::write_state(MIOFILE& f) {
     return 0;
 }
 
+#ifndef SIM
+
 // Write the client_state.xml file if necessary
 // TODO: write no more often than X seconds
 //
 int CLIENT_STATE::write_state_file_if_needed() {
     int retval;
+    if (state_file_deferred_write_time && now >= state_file_deferred_write_time) {
+        client_state_dirty = true;
+    }
     if (client_state_dirty) {
         client_state_dirty = false;
         retval = write_state_file();
@@ -875,6 +925,7 @@ int CLIENT_STATE::parse_app_info(PROJECT* p, FILE* in) {
             fip->status = FILE_PRESENT;
             fip->anonymous_platform_file = true;
             file_infos.push_back(fip);
+            file_info_index.insert(fip);
             continue;
         }
         if (xp.match_tag("app")) {
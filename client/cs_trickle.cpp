@@ -41,77 +41,304 @@
 #include "sandbox.h"
 
 using std::string;
+using std::vector;
 
-// Scan project dir for file names of the form trickle_up_X_Y
+// Trickle-up messages from a project's apps are kept in a spool file
+// in the project dir.
+// Each entry is the <msg_from_host> element for the scheduler request,
+// so a request includes all of them with one read.
+// An index file has a line per entry: start and end offsets,
+// time, and result name.
+// Entries are appended to the spool, then to the index.
+// When the project acks a request,
+// the entries it included are removed from the front of the spool.
+//
+// If the files don't agree (e.g. the client crashed while changing them)
+// the index is rebuilt from the spool.
+
+#define TRICKLE_ENTRY_END   "\n  </msg_from_host>\n"
+
+static void trickle_entry_header(const char* result_name, int t, string& s) {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+        "  <msg_from_host>\n"
+        "      <result_name>%s</result_name>\n"
+        "      <time>%d</time>\n",
+        result_name, t
+    );
+    s = buf;
+}
+
+static void trickle_spool_path(PROJECT* p, char* path) {
+    sprintf(path, "%s/%s", p->project_dir(), TRICKLE_SPOOL_FILENAME);
+}
+
+static void trickle_index_path(PROJECT* p, char* path) {
+    sprintf(path, "%s/%s", p->project_dir(), TRICKLE_INDEX_FILENAME);
+}
+
+static int read_trickle_spool(PROJECT* p, string& spool) {
+    char path[MAXPATHLEN];
+    char* buf;
+    double size;
+
+    spool.clear();
+    trickle_spool_path(p, path);
+    if (file_size(path, size)) return 0;
+    int retval = read_file_malloc(path, buf);
+    if (retval) return retval;
+    spool.assign(buf, (size_t)size);
+    free(buf);
+    return 0;
+}
+
+static int write_trickle_index(PROJECT* p) {
+    char path[MAXPATHLEN], tmp_path[MAXPATHLEN];
+
+    trickle_index_path(p, path);
+    if (p->trickle_up_index.empty()) {
+        delete_project_owned_file(path, true);
+        return 0;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE* f = boinc_fopen(tmp_path, "w");
+    if (!f) return ERR_FOPEN;
+    for (unsigned int i=0; i<p->trickle_up_index.size(); i++) {
+        TRICKLE_UP_ENTRY& e = p->trickle_up_index[i];
+        fprintf(f, "%.0f %.0f %d %s\n",
+            e.start, e.end, e.time, e.result_name.c_str()
+        );
+    }
+    if (fclose(f)) return ERR_FWRITE;
+    return boinc_rename(tmp_path, path);
+}
+
+// do the index entries match the spool?
+//
+static bool trickle_index_ok(PROJECT* p, string& spool) {
+    string header;
+    double start = 0;
+
+    for (unsigned int i=0; i<p->trickle_up_index.size(); i++) {
+        TRICKLE_UP_ENTRY& e = p->trickle_up_index[i];
+        if (e.start != start || e.end > spool.size()) return false;
+        trickle_entry_header(e.result_name.c_str(), e.time, header);
+        if (spool.compare((size_t)e.start, header.size(), header)) return false;
+        start = e.end;
+    }
+    return true;
+}
+
+// make the index from the spool.
+// Stop at an incomplete entry
+//
+static void rebuild_trickle_index(PROJECT* p, string& spool) {
+    char result_name[256];
+    int t;
+    size_t start = 0, end;
+
+    p->trickle_up_index.clear();
+    while (start < spool.size()) {
+        end = spool.find(TRICKLE_ENTRY_END, start);
+        if (end == string::npos) break;
+        end += strlen(TRICKLE_ENTRY_END);
+        string s = spool.substr(start, end-start);
+        if (!starts_with(s, "  <msg_from_host>")) break;
+        if (!parse_str(s.c_str(), "<result_name>", result_name, sizeof(result_name))) break;
+        if (!parse_int(s.c_str(), "<time>", t)) break;
+        TRICKLE_UP_ENTRY e;
+        e.start = start;
+        e.end = end;
+        e.time = t;
+        e.result_name = result_name;
+        p->trickle_up_index.push_back(e);
+        start = end;
+    }
+}
+
+// add a message to the project's spool
+//
+int add_trickle_up(PROJECT* p, const char* result_name, int t, const char* msg) {
+    char path[MAXPATHLEN];
+    string s;
+
+    trickle_entry_header(result_name, t, s);
+    s += msg;
+    s += TRICKLE_ENTRY_END;
+
+    TRICKLE_UP_ENTRY e;
+    e.start = p->trickle_up_index.empty()?0:p->trickle_up_index.back().end;
+    e.end = e.start + s.size();
+    e.time = t;
+    e.result_name = result_name;
+
+    trickle_spool_path(p, path);
+    FILE* f = boinc_fopen(path, "ab");
+    if (!f) return ERR_FOPEN;
+    size_t n = fwrite(s.data(), 1, s.size(), f);
+    if (fclose(f) || n != s.size()) {
+        boinc_truncate(path, e.start);
+        return ERR_FWRITE;
+    }
+    p->trickle_up_index.push_back(e);
+
+    trickle_index_path(p, path);
+    f = boinc_fopen(path, "a");
+    if (f) {
+        fprintf(f, "%.0f %.0f %d %s\n",
+            e.start, e.end, e.time, e.result_name.c_str()
+        );
+        fclose(f);
+    }
+    return 0;
+}
+
+// On startup, read the project's trickle index and check it.
+// Also add trickle-up files left by earlier versions,
+// of the form trickle_up_X_Y[.sent]
 // where X is a result name and Y is a timestamp.
-// Convert them to XML (for sched request message)
 //
-int CLIENT_STATE::read_trickle_files(PROJECT* project, FILE* f) {
-    char *p, *q, result_name[256], fname[256];
-    char* file_contents, path[MAXPATHLEN], newpath[MAXPATHLEN];
-    string fn;
-    time_t t;
-    int retval;
+void init_trickle_spool(PROJECT* p) {
+    char path[MAXPATHLEN], fname[256], buf[512], result_name[256];
+    char *q, *r, *file_contents;
+    string spool, fn;
+    double start, end;
+    int t, retval;
 
-    DirScanner ds(project->project_dir());
+    p->trickle_up_index.clear();
+    p->trickle_up_nsent = 0;
+    trickle_index_path(p, path);
+    FILE* f = boinc_fopen(path, "r");
+    if (f) {
+        while (fgets(buf, sizeof(buf), f)) {
+            if (sscanf(buf, "%lf %lf %d %255s", &start, &end, &t, result_name) != 4) {
+                break;
+            }
+            TRICKLE_UP_ENTRY e;
+            e.start = start;
+            e.end = end;
+            e.time = t;
+            e.result_name = result_name;
+            p->trickle_up_index.push_back(e);
+        }
+        fclose(f);
+    }
+    read_trickle_spool(p, spool);
+    if (!trickle_index_ok(p, spool)) {
+        rebuild_trickle_index(p, spool);
+        write_trickle_index(p);
+    }
 
-    // trickle-up filenames are of the form trickle_up_RESULTNAME_TIME[.sent]
+    // remove a partly-written entry
     //
+    end = p->trickle_up_index.empty()?0:p->trickle_up_index.back().end;
+    if (spool.size() > end) {
+        trickle_spool_path(p, path);
+        boinc_truncate(path, end);
+    }
+    if (!p->trickle_up_index.empty()) {
+        p->trickle_up_pending = true;
+    }
+
+    DirScanner ds(p->project_dir());
     while (ds.scan(fn)) {
         safe_strcpy(fname, fn.c_str());
         if (strstr(fname, "trickle_up_") != fname) continue;
         q = fname + strlen("trickle_up_");
-        p = strrchr(fname, '_');
-        if (p <= q) continue;
-        *p = 0;
+        r = strrchr(fname, '_');
+        if (r <= q) continue;
+        *r = 0;
         safe_strcpy(result_name, q);
-        *p = '_';
-        t = atoi(p+1);
+        *r = '_';
+        t = atoi(r+1);
 
-        sprintf(path, "%s/%s", project->project_dir(), fname);
+        sprintf(path, "%s/%s", p->project_dir(), fname);
         retval = read_file_malloc(path, file_contents);
         if (retval) continue;
-        fprintf(f,
-            "  <msg_from_host>\n"
-            "      <result_name>%s</result_name>\n"
-            "      <time>%d</time>\n"
-            "%s\n"
-            "  </msg_from_host>\n",
-            result_name,
-            (int)t,
-            file_contents
-        );
-        send_replicated_trickles(project, file_contents, result_name, t);
+        retval = add_trickle_up(p, result_name, t, file_contents);
         free(file_contents);
+        if (retval) continue;
+        delete_project_owned_file(path, true);
+        p->trickle_up_pending = true;
+    }
+}
 
-        // append .sent to filename, so we'll know which ones to delete later
+// Copy the project's spool to a scheduler request
+//
+int CLIENT_STATE::read_trickle_files(PROJECT* project, FILE* f) {
+    string spool, header;
+    char result_name[256];
+    unsigned int i;
+    int retval;
+
+    project->trickle_up_nsent = 0;
+    if (project->trickle_up_index.empty()) return 0;
+    retval = read_trickle_spool(project, spool);
+    if (retval) return retval;
+    if (spool.size() < project->trickle_up_index.back().end) {
+        // the spool was changed by something else
         //
-        if (!ends_with(fname, ".sent")) {
-            sprintf(newpath, "%s/%s.sent", project->project_dir(), fname);
-            boinc_rename(path, newpath);
-        }
+        rebuild_trickle_index(project, spool);
+        write_trickle_index(project);
+        if (project->trickle_up_index.empty()) return 0;
+    }
+    double end = project->trickle_up_index.back().end;
+    fwrite(spool.data(), 1, (size_t)end, f);
+    project->trickle_up_nsent = (int)project->trickle_up_index.size();
+
+    if (project->trickle_up_ops.empty()) return 0;
+    for (i=0; i<project->trickle_up_index.size(); i++) {
+        TRICKLE_UP_ENTRY& e = project->trickle_up_index[i];
+        trickle_entry_header(e.result_name.c_str(), e.time, header);
+        size_t body_start = (size_t)e.start + header.size();
+        size_t body_end = (size_t)e.end - strlen(TRICKLE_ENTRY_END);
+        string msg = spool.substr(body_start, body_end - body_start);
+        safe_strcpy(result_name, e.result_name.c_str());
+        send_replicated_trickles(project, msg.c_str(), result_name, e.time);
     }
     return 0;
 }
 
-// Remove files when ack has been received.
-// Remove only those ending with ".sent"
-// (others arrived from application while RPC was happening)
+// The project acked the request;
+// remove the entries it included from the spool.
+// Others arrived from applications while the RPC was happening.
 //
 int CLIENT_STATE::remove_trickle_files(PROJECT* project) {
-    char path[MAXPATHLEN], fname[256];
-    string fn;
-
-    DirScanner ds(project->project_dir());
+    char path[MAXPATHLEN], tmp_path[MAXPATHLEN];
+    vector<TRICKLE_UP_ENTRY>& index = project->trickle_up_index;
+    string spool;
+    unsigned int i;
+    int retval;
 
-    while (ds.scan(fn)) {
-        safe_strcpy(fname, fn.c_str());
-        if (!starts_with(fname, "trickle_up")) continue;
-        if (!ends_with(fname, ".sent")) continue;
-        sprintf(path, "%s/%s", project->project_dir(), fname);
+    unsigned int n = project->trickle_up_nsent;
+    project->trickle_up_nsent = 0;
+    if (!n) return 0;
+    trickle_spool_path(project, path);
+    if (n >= index.size()) {
+        index.clear();
         delete_project_owned_file(path, true);
+        return write_trickle_index(project);
     }
-    return 0;
+
+    retval = read_trickle_spool(project, spool);
+    if (retval) return retval;
+    double start = index[n].start;
+    double end = index.back().end;
+    if (spool.size() < end) return ERR_READ;
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE* f = boinc_fopen(tmp_path, "wb");
+    if (!f) return ERR_FOPEN;
+    size_t nw = fwrite(spool.data() + (size_t)start, 1, (size_t)(end-start), f);
+    if (fclose(f) || nw != (size_t)(end-start)) return ERR_FWRITE;
+    retval = boinc_rename(tmp_path, path);
+    if (retval) return retval;
+
+    index.erase(index.begin(), index.begin()+n);
+    for (i=0; i<index.size(); i++) {
+        index[i].start -= start;
+        index[i].end -= start;
+    }
+    return write_trickle_index(project);
 }
 
 // parse a trickle-down message in a scheduler reply.
@@ -43,5 +43,7 @@ extern bool trickle_up_poll();
 extern int parse_trickle_up_urls(XML_PARSER&, std::vector<std::string>&);
 extern void update_trickle_up_urls(PROJECT* p, std::vector<std::string> &urls);
 extern void send_replicated_trickles(PROJECT* p, const char* msg, char* result_name, int t);
+extern int add_trickle_up(PROJECT*, const char* result_name, int t, const char* msg);
+extern void init_trickle_spool(PROJECT*);
 
 #endif
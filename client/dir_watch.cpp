@@ -0,0 +1,277 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+#include "boinc_win.h"
+#else
+#include "config.h"
+#include <cstring>
+#include <map>
+#include <set>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "error_numbers.h"
+#include "filesys.h"
+
+#include "dir_watch.h"
+
+using std::string;
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define WATCH_MASK (IN_CREATE|IN_DELETE|IN_MODIFY|IN_MOVED_FROM|IN_MOVED_TO \
+    |IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB)
+
+#define MAX_DIRTY   10000
+    // if more paths than this have changed, rescan everything
+
+// one inotify instance for all watches; -1 if it couldn't be created
+//
+static int inotify_fd = -2;
+static std::map<int, DIR_WATCH*> watches;
+    // watch descriptor -> its DIR_WATCH
+
+static bool inotify_init_once() {
+    if (inotify_fd == -2) {
+        inotify_fd = inotify_init();
+        if (inotify_fd >= 0) {
+            fcntl(inotify_fd, F_SETFL, fcntl(inotify_fd, F_GETFL) | O_NONBLOCK);
+            fcntl(inotify_fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    return inotify_fd >= 0;
+}
+
+// read pending events, and pass them to the DIR_WATCHes they're for
+//
+static void read_events() {
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    std::map<int, DIR_WATCH*>::iterator i;
+
+    while (1) {
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        char* p = buf;
+        while (p < buf + n) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (i=watches.begin(); i!=watches.end(); i++) {
+                    i->second->valid = false;
+                }
+                continue;
+            }
+            i = watches.find(ev->wd);
+            if (i == watches.end()) continue;
+            DIR_WATCH* dwp = i->second;
+
+            // the kernel has removed this watch; its number may be reused
+            //
+            if (ev->mask & IN_IGNORED) {
+                dwp->wd_dirs.erase(ev->wd);
+                watches.erase(i);
+                continue;
+            }
+            dwp->note_event(ev->wd, ev->mask, ev->len?ev->name:"");
+        }
+    }
+}
+
+// Record an event.  Events on a dir itself (no name) are also
+// reported, with the name, to its parent, except for the top dir.
+//
+void DIR_WATCH::note_event(int wd, unsigned int mask, const char* name) {
+    if (!valid) return;
+    std::map<int, string>::iterator i = wd_dirs.find(wd);
+    if (i == wd_dirs.end()) return;
+    const string& wd_dir = i->second;
+    if (!strlen(name)) {
+        if ((mask & (IN_DELETE_SELF|IN_MOVE_SELF)) && wd_dir == dir) {
+            valid = false;
+        }
+        return;
+    }
+    string path = wd_dir + "/" + name;
+    if (mask & IN_ISDIR) {
+        if (mask & (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO)) {
+            dirty_dirs.insert(path);
+        }
+    } else {
+        dirty_files.insert(path);
+    }
+    if (dirty_files.size() + dirty_dirs.size() > MAX_DIRTY) {
+        valid = false;
+    }
+}
+
+void DIR_WATCH::set_file_size(const string& path, double x) {
+    std::map<string, double>::iterator i = file_sizes.find(path);
+    if (i != file_sizes.end()) {
+        size -= i->second;
+        if (x < 0) {
+            file_sizes.erase(i);
+        } else {
+            i->second = x;
+        }
+    } else {
+        if (x < 0) return;
+        file_sizes[path] = x;
+    }
+    if (x > 0) size += x;
+}
+
+// forget about the files and watches in a subdir
+//
+void DIR_WATCH::remove_subtree(const string& path) {
+    string prefix = path + "/";
+    set_file_size(path, -1);
+    std::map<string, double>::iterator i = file_sizes.lower_bound(prefix);
+    while (i != file_sizes.end() && !i->first.compare(0, prefix.size(), prefix)) {
+        size -= i->second;
+        file_sizes.erase(i++);
+    }
+    std::map<int, string>::iterator j = wd_dirs.begin();
+    while (j != wd_dirs.end()) {
+        if (j->second == path || !j->second.compare(0, prefix.size(), prefix)) {
+            inotify_rm_watch(inotify_fd, j->first);
+            watches.erase(j->first);
+            wd_dirs.erase(j++);
+        } else {
+            j++;
+        }
+    }
+}
+
+// add watches for dir and its subdirs, and record the sizes of its files.
+// The watch goes on before the dir is read.
+//
+int DIR_WATCH::scan(const char* path) {
+    char filename[MAXPATHLEN], subpath[MAXPATHLEN];
+    double x;
+    int retval;
+
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_MASK);
+    if (wd < 0) return ERR_OPENDIR;
+    wd_dirs[wd] = path;
+    watches[wd] = this;
+
+    DIRREF dirp = dir_open(path);
+    if (!dirp) return ERR_OPENDIR;
+    while (1) {
+        retval = dir_scan(filename, dirp, sizeof(filename));
+        if (retval) break;
+        snprintf(subpath, sizeof(subpath), "%s/%s", path, filename);
+        if (is_dir(subpath)) {
+            retval = scan(subpath);
+            if (retval) {
+                dir_close(dirp);
+                return retval;
+            }
+        } else if (is_file(subpath)) {
+            if (!file_size(subpath, x)) set_file_size(subpath, x);
+        }
+    }
+    dir_close(dirp);
+    return 0;
+}
+
+// apply the changes noted since the last call:
+// rescan changed subdirs, and stat changed files
+//
+int DIR_WATCH::update() {
+    std::set<string>::iterator i;
+    double x;
+    int retval;
+
+    for (i=dirty_dirs.begin(); i!=dirty_dirs.end(); i++) {
+        remove_subtree(*i);
+        if (is_dir(i->c_str())) {
+            retval = scan(i->c_str());
+            if (retval) return retval;
+        }
+    }
+    dirty_dirs.clear();
+    for (i=dirty_files.begin(); i!=dirty_files.end(); i++) {
+        const char* path = i->c_str();
+        if (is_file(path) && !file_size(path, x)) {
+            set_file_size(*i, x);
+        } else {
+            set_file_size(*i, -1);
+        }
+    }
+    dirty_files.clear();
+    return 0;
+}
+
+int DIR_WATCH::get_size(const char* path, double& dsize) {
+    int retval;
+
+    if (!inotify_init_once()) {
+        return dir_size(path, dsize);
+    }
+    read_events();
+    if (valid && dir == path) {
+        retval = update();
+        if (!retval) {
+            dsize = size;
+            return 0;
+        }
+    }
+    stop();
+    dir = path;
+    valid = true;
+    retval = scan(path);
+    if (retval) {
+        // e.g. out of watches; scan without them next time too
+        //
+        stop();
+        return dir_size(path, dsize);
+    }
+    dsize = size;
+    return 0;
+}
+
+void DIR_WATCH::stop() {
+    std::map<int, string>::iterator i;
+    for (i=wd_dirs.begin(); i!=wd_dirs.end(); i++) {
+        inotify_rm_watch(inotify_fd, i->first);
+        watches.erase(i->first);
+    }
+    wd_dirs.clear();
+    file_sizes.clear();
+    dirty_files.clear();
+    dirty_dirs.clear();
+    size = 0;
+    valid = false;
+}
+
+#else
+
+int DIR_WATCH::get_size(const char* path, double& dsize) {
+    return dir_size(path, dsize);
+}
+
+void DIR_WATCH::stop() {
+}
+
+#endif
@@ -0,0 +1,68 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// DIR_WATCH: the size of a directory tree (e.g. a slot dir),
+// kept up to date incrementally.
+// On Linux this uses inotify: we remember the size of each file,
+// and when a file changes we stat just that file;
+// when a subdir is created, removed or renamed we rescan just it.
+// The watches are set up during the scan,
+// so changes made while scanning are noticed.
+// If events are lost (queue overflow) or the dir itself goes away,
+// the whole tree is rescanned.
+// Elsewhere (or if inotify fails) every call scans.
+
+#ifndef _DIR_WATCH_
+#define _DIR_WATCH_
+
+#include <map>
+#include <set>
+#include <string>
+
+struct DIR_WATCH {
+    std::string dir;
+    std::map<int, std::string> wd_dirs;
+        // inotify watch descriptor -> dir (dir and its subdirs)
+    std::map<std::string, double> file_sizes;
+    std::set<std::string> dirty_files, dirty_dirs;
+        // paths with events since the last get_size()
+    bool valid;
+        // if false, rescan the whole tree
+    double size;
+        // sum of file_sizes
+
+    DIR_WATCH() {
+        valid = false;
+        size = 0;
+    }
+    ~DIR_WATCH() {
+        stop();
+    }
+    int get_size(const char* dir, double& size);
+    void stop();
+    void note_event(int wd, unsigned int mask, const char* name);
+
+private:
+    DIR_WATCH(const DIR_WATCH&);
+    DIR_WATCH& operator=(const DIR_WATCH&);
+    int scan(const char* dir);
+    int update();
+    void set_file_size(const std::string& path, double x);
+    void remove_subtree(const std::string& path);
+};
+
+#endif
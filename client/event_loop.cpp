@@ -0,0 +1,144 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// epoll/kqueue socket sets; see event_loop.h
+
+#include "event_loop.h"
+
+#ifdef USE_EVENT_LOOP
+
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include "error_numbers.h"
+
+EVENT_LOOP::EVENT_LOOP() {
+    fd = -1;
+}
+
+EVENT_LOOP::~EVENT_LOOP() {
+    if (fd >= 0) close(fd);
+}
+
+int EVENT_LOOP::init() {
+#ifdef HAVE_SYS_EPOLL_H
+    fd = epoll_create(64);
+#else
+    fd = kqueue();
+#endif
+    if (fd < 0) return ERR_SOCKET;
+
+    // apps shouldn't inherit it
+    //
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+int EVENT_LOOP::watch(int sock, int events, int old_events) {
+    struct epoll_event ev;
+    int op;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = sock;
+    if (events & EVENT_READ) ev.events |= EPOLLIN;
+    if (events & EVENT_WRITE) ev.events |= EPOLLOUT;
+    if (!events) {
+        op = EPOLL_CTL_DEL;
+    } else if (old_events) {
+        op = EPOLL_CTL_MOD;
+    } else {
+        op = EPOLL_CTL_ADD;
+    }
+    if (epoll_ctl(fd, op, sock, &ev)) {
+        // curl may have closed the socket already
+        //
+        if (!events) return 0;
+        return ERR_SOCKET;
+    }
+    return 0;
+}
+
+int EVENT_LOOP::get_events(EVENT_LOOP_EVENT* events, int max) {
+    struct epoll_event evs[64];
+    if (max > 64) max = 64;
+    int n = epoll_wait(fd, evs, max, 0);
+    for (int i=0; i<n; i++) {
+        events[i].sock = evs[i].data.fd;
+        events[i].events = 0;
+        if (evs[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) {
+            events[i].events |= EVENT_READ;
+        }
+        if (evs[i].events & (EPOLLOUT|EPOLLERR)) {
+            events[i].events |= EVENT_WRITE;
+        }
+    }
+    return n;
+}
+
+#else
+
+// kqueue has separate read and write filters
+//
+int EVENT_LOOP::watch(int sock, int events, int old_events) {
+    struct kevent kev[2];
+    int n = 0;
+
+    if ((events ^ old_events) & EVENT_READ) {
+        EV_SET(&kev[n++], sock, EVFILT_READ,
+            (events & EVENT_READ)?EV_ADD:EV_DELETE, 0, 0, NULL
+        );
+    }
+    if ((events ^ old_events) & EVENT_WRITE) {
+        EV_SET(&kev[n++], sock, EVFILT_WRITE,
+            (events & EVENT_WRITE)?EV_ADD:EV_DELETE, 0, 0, NULL
+        );
+    }
+    if (n && kevent(fd, kev, n, NULL, 0, NULL) < 0) {
+        if (!events) return 0;
+        return ERR_SOCKET;
+    }
+    return 0;
+}
+
+int EVENT_LOOP::get_events(EVENT_LOOP_EVENT* events, int max) {
+    struct kevent kev[64];
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 0;
+    if (max > 64) max = 64;
+    int n = kevent(fd, NULL, 0, kev, max, &ts);
+    for (int i=0; i<n; i++) {
+        events[i].sock = (int)kev[i].ident;
+        events[i].events = (kev[i].filter == EVFILT_READ)?EVENT_READ:EVENT_WRITE;
+    }
+    return n;
+}
+
+#endif
+
+#endif
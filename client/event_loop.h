@@ -0,0 +1,70 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A set of sockets watched with epoll (Linux) or kqueue (BSD, Mac).
+// The client uses one for libcurl's sockets,
+// using curl's socket API rather than curl_multi_fdset(),
+// so the number of transfers isn't limited by FD_SETSIZE
+// and idle transfers don't cost a scan per loop.
+//
+// The epoll/kqueue descriptor itself is readable when any
+// watched socket is ready, so it can go in the main select().
+//
+// USE_EVENT_LOOP is defined if available.
+
+#ifndef _EVENT_LOOP_
+#define _EVENT_LOOP_
+
+#ifndef _WIN32
+#include "config.h"
+#endif
+
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_SYS_EVENT_H)
+#define USE_EVENT_LOOP
+#endif
+
+#ifdef USE_EVENT_LOOP
+
+#define EVENT_READ  1
+#define EVENT_WRITE 2
+
+struct EVENT_LOOP_EVENT {
+    int sock;
+    int events;     // EVENT_READ|EVENT_WRITE
+};
+
+struct EVENT_LOOP {
+    int fd;         // epoll or kqueue descriptor; -1 if none
+
+    EVENT_LOOP();
+    ~EVENT_LOOP();
+    int init();
+
+    // watch sock for the given events (replacing earlier ones).
+    // events==0 means stop watching it
+    //
+    int watch(int sock, int events, int old_events);
+
+    // return ready sockets, without waiting.
+    // Return # of events, or -1 if error
+    //
+    int get_events(EVENT_LOOP_EVENT* events, int max);
+};
+
+#endif
+
+#endif
@@ -40,6 +40,7 @@
 #include "url.h"
 #include "util.h"
 
+#include "async_file.h"
 #include "client_msgs.h"
 #include "client_state.h"
 #include "project.h"
@@ -165,12 +166,13 @@ int make_project_dir(PROJECT& p) {
 int remove_project_dir(PROJECT& p) {
     int retval;
 
-    retval = client_clean_out_dir(p.project_dir(), "remove project dir");
+    retval = async_delete_dir(p.project_dir(), "remove project dir");
+    p.project_dir_scan_time = 0;
     if (retval) {
         msg_printf(&p, MSG_INTERNAL_ERROR, "Can't delete file %s", boinc_failed_file);
         return retval;
     }
-    return remove_project_owned_dir(p.project_dir());
+    return 0;
 }
 
 // Create the slot directory for the specified slot #
@@ -65,6 +65,7 @@ extern void send_log_after(const char* filename, double t, MIOFILE& mf);
 #define CLIENT_OPAQUE_FILENAME      "client_opaque.txt"
 #define CONFIG_FILE                 "cc_config.xml"
 #define COPROC_INFO_FILENAME        "coproc_info.xml"
+#define COPROC_INFO_KEY_FILENAME    "coproc_info_key.txt"
 #define CPU_BENCHMARKS_FILE_NAME    "cpu_benchmarks"
 #define CREATE_ACCOUNT_FILENAME     "create_account.xml"
 #define DAILY_XFER_HISTORY_FILENAME "daily_xfer_history.xml"
@@ -97,5 +98,8 @@ extern void send_log_after(const char* filename, double t, MIOFILE& mf);
 #define TEMP_STATS_FILE_NAME        "temp_stats.xml"
 #define TEMP_TIME_STATS_FILE_NAME   "temp_time_stats.xml"
 #define TIME_STATS_LOG              "time_stats_log"
+#define TRICKLE_SPOOL_FILENAME      "trickle_spool.xml"
+#define TRICKLE_INDEX_FILENAME      "trickle_spool_index.txt"
+    // in project dirs
 
 #endif
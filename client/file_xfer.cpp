@@ -21,6 +21,8 @@
 #include "boinc_win.h"
 #else
 #include "config.h"
+#include <algorithm>
+#include <cmath>
 #endif
 
 #include "error_numbers.h"
@@ -34,6 +36,7 @@
 #include "file_xfer.h"
 #include "project.h"
 
+using std::string;
 using std::vector;
 
 FILE_XFER::FILE_XFER() {
@@ -43,18 +46,58 @@ FILE_XFER::FILE_XFER() {
     strcpy(pathname, "");
     strcpy(header, "");
     file_size_query = false;
+    batch_leader = NULL;
+    strcpy(batch_path, "");
+    segmented = false;
+    segment = -1;
+    segment_leader = NULL;
 }
 
 FILE_XFER::~FILE_XFER() {
-    if (fip && fip->pers_file_xfer) {
+    if (fip && fip->pers_file_xfer && !segment_leader) {
         fip->pers_file_xfer->fxp = NULL;
     }
+    for (unsigned int i=0; i<segment_xfers.size(); i++) {
+        gstate.http_ops->remove(segment_xfers[i]);
+        delete segment_xfers[i];
+    }
+    if (batch_leader) {
+        vector<FILE_XFER*>& v = batch_leader->batch;
+        for (unsigned int i=0; i<v.size(); i++) {
+            if (v[i] == this) {
+                v.erase(v.begin()+i);
+                break;
+            }
+        }
+    }
+    finish_batch(ERR_UPLOAD_TRANSIENT);
+    for (unsigned int i=0; i<batch.size(); i++) {
+        batch[i]->batch_leader = NULL;
+    }
+    if (strlen(batch_path)) {
+        boinc_delete_file(batch_path);
+    }
 }
 
 int FILE_XFER::init_download(FILE_INFO& file_info) {
     is_upload = false;
     fip = &file_info;
     get_pathname(fip, pathname, sizeof(pathname));
+    if (config.max_download_segments > 1
+        && !fip->download_gzipped
+        && !fip->project->no_segmented_download
+        && fip->nbytes >= 2*DOWNLOAD_SEGMENT_SIZE
+    ) {
+        return init_segmented_download();
+    }
+    if (fip->download_segments.size()) {
+        // we were doing a segmented download; discard it
+        //
+        char path[MAXPATHLEN];
+        sprintf(path, "%s.seg", pathname);
+        boinc_delete_file(path);
+        fip->download_segments.clear();
+    }
     if (fip->download_gzipped) {
         strcat(pathname, ".gzt");
     }
@@ -69,9 +112,262 @@ int FILE_XFER::init_download(FILE_INFO& file_info) {
 
     const char* url = fip->download_urls.get_current_url(file_info);
     if (!url) return ERR_INVALID_URL;
-    return HTTP_OP::init_get(
+    int retval = HTTP_OP::init_get(
         file_info.project, url, pathname, false, starting_size, file_info.nbytes
     );
+    if (retval) return retval;
+
+    // Compute the file's MD5 as it arrives,
+    // so that verifying it doesn't mean reading it again.
+    // If we're resuming, continue from the saved MD5 state.
+    // Compressed files are verified after they're uncompressed.
+    //
+    strcpy(fip->download_md5, "");
+    if (!fip->download_gzipped) {
+        if (!starting_size) {
+            hash_download = true;
+            download_md5.init();
+            fip->download_md5_state.clear();
+        } else {
+            resume_md5();
+        }
+    }
+    return 0;
+}
+
+// Restore the MD5 state saved by checkpoint_md5(),
+// and hash the part of the file written after the checkpoint.
+// If there's no usable state, the MD5 is computed when
+// the file is verified.
+//
+void FILE_XFER::resume_md5() {
+    double nbytes = fip->download_md5_nbytes;
+    if (fip->download_md5_state.empty()) return;
+    if (nbytes > starting_size
+        || !download_md5.restore(fip->download_md5_state.c_str())
+    ) {
+        fip->download_md5_state.clear();
+        return;
+    }
+    FILE* f = boinc_fopen(pathname, "rb");
+    if (!f) return;
+#ifdef _WIN32
+    int retval = _fseeki64(f, (__int64)nbytes, SEEK_SET);
+#else
+    int retval = fseeko(f, (off_t)nbytes, SEEK_SET);
+#endif
+    if (retval) {
+        fclose(f);
+        return;
+    }
+    unsigned char buf[16384];
+    while (nbytes < starting_size) {
+        size_t n = sizeof(buf);
+        if (starting_size - nbytes < n) n = (size_t)(starting_size - nbytes);
+        if (fread(buf, 1, n, f) != n) {
+            fclose(f);
+            return;
+        }
+        download_md5.append(buf, (int)n);
+        nbytes += n;
+    }
+    fclose(f);
+    hash_download = true;
+    hashed_nbytes = nbytes;
+}
+
+// Save the MD5 state of a download in progress in its FILE_INFO,
+// so that the hash can be resumed if the transfer is interrupted.
+// The state file is written after this,
+// so flush what we've hashed to the file first.
+//
+void FILE_XFER::checkpoint_md5() {
+    if (is_upload || !hash_download) return;
+    if (fileOut) fflush(fileOut);
+    fip->download_md5_state = download_md5.save();
+    fip->download_md5_nbytes = hashed_nbytes;
+}
+
+// Segmented downloads.
+// A large file is downloaded in segments of DOWNLOAD_SEGMENT_SIZE
+// with up to config.max_download_segments requests at once,
+// each writing at its own offset in PATH.seg;
+// when all segments are done, PATH.seg is renamed to PATH
+// and verified in the usual way.
+// FILE_INFO::download_segments (saved in the state file)
+// says which segments are done, so a retry or restart
+// resumes with the others.
+//
+// When a request finishes its segment it starts on the next one.
+// If a request fails, no new ones are started,
+// and when the rest finish the transfer fails.
+// If the server ignores the Range: header, we stop segmenting
+// downloads from this project.
+//
+int FILE_XFER::init_segmented_download() {
+    int retval;
+
+    segmented = true;
+    starting_size = 0;
+    strcat(pathname, ".seg");
+    int nsegs = (int)ceil(fip->nbytes/DOWNLOAD_SEGMENT_SIZE);
+    if ((int)fip->download_segments.size() != nsegs
+        || fip->download_segments.find('0') == string::npos
+        || !boinc_file_exists(pathname)
+    ) {
+        fip->download_segments = string(nsegs, '0');
+        FILE* f = boinc_fopen(pathname, "wb");
+        if (!f) return ERR_FOPEN;
+        fclose(f);
+#ifdef _WIN32
+        boinc_allocate_file(pathname, fip->nbytes);
+#endif
+    }
+    retval = start_segment(this);
+    if (retval) return retval;
+    for (int i=1; i<config.max_download_segments; i++) {
+        FILE_XFER* fxp = new FILE_XFER;
+        fxp->segment_leader = this;
+        fxp->fip = fip;
+        fxp->is_upload = false;
+        fxp->segmented = true;
+        strcpy(fxp->pathname, pathname);
+        if (start_segment(fxp)) {
+            delete fxp;
+            break;
+        }
+        segment_xfers.push_back(fxp);
+        gstate.http_ops->insert(fxp);
+    }
+    if (log_flags.file_xfer_debug) {
+        msg_printf(fip->project, MSG_INFO,
+            "[file_xfer] segmented download of %s: %d of %d segments left, %d requests",
+            fip->name,
+            (int)std::count(
+                fip->download_segments.begin(), fip->download_segments.end(), '0'
+            ),
+            nsegs, (int)segment_xfers.size()+1
+        );
+    }
+    return 0;
+}
+
+// start the given op (this or a helper) on the next segment
+// that's not done or in progress.
+// Return ERR_NOT_FOUND if there is none.
+//
+int FILE_XFER::start_segment(FILE_XFER* fxp) {
+    unsigned int i, j;
+
+    fxp->segment = -1;
+    for (i=0; i<fip->download_segments.size(); i++) {
+        if (fip->download_segments[i] != '0') continue;
+        if (segment == (int)i) continue;
+        for (j=0; j<segment_xfers.size(); j++) {
+            if (segment_xfers[j]->segment == (int)i) break;
+        }
+        if (j < segment_xfers.size()) continue;
+        break;
+    }
+    if (i == fip->download_segments.size()) return ERR_NOT_FOUND;
+
+    const char* url = fip->download_urls.get_current_url(*fip);
+    if (!url) return ERR_INVALID_URL;
+    double start = i*DOWNLOAD_SEGMENT_SIZE;
+    double end = start + DOWNLOAD_SEGMENT_SIZE;
+    if (end > fip->nbytes) end = fip->nbytes;
+    fxp->segment = i;
+    int retval = fxp->init_get_range(fip->project, url, pathname, start, end);
+    if (retval) fxp->segment = -1;
+    return retval;
+}
+
+// Check the requests of a segmented download.
+// Return true if the transfer is finished
+// (file_xfer_done and file_xfer_retval are set)
+//
+bool FILE_XFER::poll_segments() {
+    bool active = false, started = false;
+    int retval;
+
+    vector<FILE_XFER*> ops = segment_xfers;
+    ops.push_back(this);
+    for (unsigned int i=0; i<ops.size(); i++) {
+        FILE_XFER* fxp = ops[i];
+        if (fxp->segment < 0) continue;
+        if (!fxp->http_op_done()) {
+            active = true;
+            continue;
+        }
+        int seg = fxp->segment;
+        fxp->segment = -1;
+        if (fxp->http_op_retval) {
+            retval = fxp->http_op_retval;
+        } else if (fxp->response != HTTP_STATUS_PARTIAL_CONTENT) {
+            msg_printf(fip->project, MSG_INFO,
+                "Data server doesn't support segmented downloads"
+            );
+            fip->project->no_segmented_download = true;
+            retval = ERR_HTTP_TRANSIENT;
+        } else if (fxp->bytes_xferred < fxp->range_end) {
+            retval = ERR_HTTP_TRANSIENT;
+        } else {
+            retval = 0;
+            fip->download_segments[seg] = '1';
+            gstate.set_client_state_dirty("download segment done", true);
+        }
+        if (retval) {
+            if (log_flags.file_xfer_debug) {
+                msg_printf(fip->project, MSG_INFO,
+                    "[file_xfer] segment %d of %s failed: %s",
+                    seg, fip->name, boincerror(retval)
+                );
+            }
+            if (!file_xfer_retval) file_xfer_retval = retval;
+            continue;
+        }
+        if (file_xfer_retval) continue;
+        if (!start_segment(fxp)) {
+            active = true;
+            started = true;
+        }
+    }
+    if (started) {
+        gstate.file_xfers->set_bandwidth_limits(false);
+    }
+    if (active) return false;
+
+    file_xfer_done = true;
+    if (!file_xfer_retval) {
+        char path[MAXPATHLEN];
+        get_pathname(fip, path, sizeof(path));
+        fip->download_segments.clear();
+        if (boinc_rename(pathname, path)) {
+            file_xfer_retval = ERR_RENAME;
+        }
+        gstate.set_client_state_dirty("segmented download done");
+    }
+    return true;
+}
+
+// bytes downloaded so far, for the GUI
+//
+double FILE_XFER::segments_bytes_xferred() {
+    double x = 0;
+    unsigned int i;
+    for (i=0; i<fip->download_segments.size(); i++) {
+        if (fip->download_segments[i] == '0') continue;
+        double start = i*DOWNLOAD_SEGMENT_SIZE;
+        x += std::min(DOWNLOAD_SEGMENT_SIZE, fip->nbytes - start);
+    }
+    vector<FILE_XFER*> ops = segment_xfers;
+    ops.push_back(this);
+    for (i=0; i<ops.size(); i++) {
+        FILE_XFER* fxp = ops[i];
+        if (fxp->segment < 0) continue;
+        x += fxp->bytes_xferred - fxp->segment*DOWNLOAD_SEGMENT_SIZE;
+    }
+    return x;
 }
 
 // for uploads, we need to build a header with xml_signature etc.
@@ -140,7 +436,7 @@ int FILE_XFER::init_upload(FILE_INFO& file_info) {
             "<data>\n",
             BOINC_MAJOR_VERSION, BOINC_MINOR_VERSION, BOINC_RELEASE,
             file_info.name,
-            file_info.xml_signature,
+            file_info.xml_signature.c_str(),
             file_info.max_nbytes,
             file_info.nbytes,
             file_info.md5_cksum,
@@ -156,6 +452,193 @@ int FILE_XFER::init_upload(FILE_INFO& file_info) {
     }
 }
 
+// write the part of a multi-file upload request for one file
+//
+static int write_upload_segment(FILE* f, FILE_INFO& fi) {
+    char path[256];
+
+    get_pathname(&fi, path, sizeof(path));
+    FILE* in = boinc_fopen(path, "rb");
+    if (!in) return ERR_FOPEN;
+    fprintf(f,
+        "<file_upload>\n"
+        "<file_info>\n"
+        "<name>%s</name>\n"
+        "<xml_signature>\n"
+        "%s"
+        "</xml_signature>\n"
+        "<max_nbytes>%.0f</max_nbytes>\n"
+        "</file_info>\n"
+        "<nbytes>%.0f</nbytes>\n"
+        "<md5_cksum>%s</md5_cksum>\n"
+        "<offset>%.0f</offset>\n"
+        "<data>\n",
+        fi.name,
+        fi.xml_signature.c_str(),
+        fi.max_nbytes,
+        fi.nbytes,
+        fi.md5_cksum,
+        fi.upload_offset
+    );
+    if (fi.upload_offset > 0) {
+        fseek(in, (long)fi.upload_offset, SEEK_SET);
+    }
+    int retval = copy_stream(in, f);
+    fclose(in);
+    if (retval) return retval;
+    fprintf(f, "\n</file_upload>\n");
+    return 0;
+}
+
+// Start an upload of file_info together with the files in "others",
+// whose FILE_XFERs have fip set.
+// The request body is written to a file in the project directory.
+// The caller checks that the files are small and have the right size.
+//
+int FILE_XFER::init_multi_upload(
+    FILE_INFO& file_info, vector<FILE_XFER*>& others
+) {
+    unsigned int i;
+    int retval;
+
+    fip = &file_info;
+    get_pathname(fip, pathname, sizeof(pathname));
+    is_upload = true;
+    file_size_query = false;
+    fip->upload_offset = 0;
+    batch = others;
+    for (i=0; i<batch.size(); i++) {
+        batch[i]->batch_leader = this;
+        batch[i]->is_upload = true;
+        batch[i]->fip->upload_offset = 0;
+    }
+
+    sprintf(batch_path, "%s/upload_batch_%s",
+        fip->project->project_dir(), fip->name
+    );
+    FILE* f = boinc_fopen(batch_path, "wb");
+    if (!f) return ERR_FOPEN;
+    retval = write_upload_segment(f, *fip);
+    for (i=0; i<batch.size() && !retval; i++) {
+        retval = write_upload_segment(f, *batch[i]->fip);
+    }
+    fprintf(f,
+        "</multi_file_upload>\n"
+        "</data_server_request>\n"
+    );
+    if (fclose(f)) retval = ERR_FWRITE;
+    if (retval) return retval;
+
+    if (log_flags.file_xfer_debug) {
+        msg_printf(file_info.project, MSG_INFO,
+            "[fxd] starting upload of %s with %d other files",
+            fip->name, (int)batch.size()
+        );
+    }
+    sprintf(header,
+        "<data_server_request>\n"
+        "    <core_client_major_version>%d</core_client_major_version>\n"
+        "    <core_client_minor_version>%d</core_client_minor_version>\n"
+        "    <core_client_release>%d</core_client_release>\n"
+        "<multi_file_upload>\n",
+        BOINC_MAJOR_VERSION, BOINC_MINOR_VERSION, BOINC_RELEASE
+    );
+    const char* url = fip->upload_urls.get_current_url(file_info);
+    if (!url) return ERR_INVALID_URL;
+    return HTTP_OP::init_post2(
+        file_info.project, url, header, sizeof(header), batch_path, 0
+    );
+}
+
+// Parse the reply to a multi-file upload, which has a
+// <file_upload_reply> for each file the server handled.
+// Set the status of the other files in the batch,
+// and return the status of our own.
+// A server that doesn't know about multi-file uploads
+// handles only the first file and sends an ordinary reply;
+// in that case don't send batches to this project again.
+//
+int FILE_XFER::parse_multi_upload_response() {
+    char name[256], buf[256];
+    int x, status = ERR_UPLOAD_TRANSIENT;
+    unsigned int i;
+    bool found = false;
+    double nbytes;
+
+    const char* p = req1;
+    while ((p = strstr(p, "<file_upload_reply>"))) {
+        const char* q = strstr(p, "</file_upload_reply>");
+        if (!q) break;
+        string s(p, q-p);
+        p = q;
+        found = true;
+        if (!parse_str(s.c_str(), "<name>", name, sizeof(name))) continue;
+        if (!parse_int(s.c_str(), "<status>", x)) continue;
+        int retval;
+        switch (x) {
+        case -1: retval = ERR_UPLOAD_PERMANENT; break;
+        case 0: retval = 0; break;
+        default: retval = ERR_UPLOAD_TRANSIENT; break;
+        }
+        if (parse_str(s.c_str(), "<message>", buf, sizeof(buf))) {
+            msg_printf(fip->project, MSG_INTERNAL_ERROR,
+                "Error reported by file upload server for %s: %s", name, buf
+            );
+        }
+        if (!strcmp(name, fip->name)) {
+            status = retval;
+            continue;
+        }
+        for (i=0; i<batch.size(); i++) {
+            FILE_XFER* fxp = batch[i];
+            if (strcmp(name, fxp->fip->name)) continue;
+            fxp->file_xfer_done = true;
+            fxp->file_xfer_retval = retval;
+            break;
+        }
+    }
+    if (!found) {
+        if (log_flags.file_xfer) {
+            msg_printf(fip->project, MSG_INFO,
+                "File upload server doesn't support multi-file uploads"
+            );
+        }
+        fip->project->no_multi_upload = true;
+        status = parse_upload_response(nbytes);
+    }
+    if (log_flags.file_xfer_debug) {
+        msg_printf(fip->project, MSG_INFO,
+            "[file_xfer] parsing multi-file upload response: %s", req1
+        );
+    }
+    return status;
+}
+
+// The leader of a multi-file upload is done (or going away).
+// Files that didn't get a status from the reply get this one.
+//
+void FILE_XFER::finish_batch(int retval) {
+    for (unsigned int i=0; i<batch.size(); i++) {
+        FILE_XFER* fxp = batch[i];
+        if (fxp->file_xfer_done) continue;
+        fxp->file_xfer_done = true;
+        fxp->file_xfer_retval = retval;
+    }
+}
+
+// The leader of a multi-file upload couldn't be started.
+// Delete the other FILE_XFERs; their PERS_FILE_XFERs will
+// start again as if nothing had happened.
+//
+void FILE_XFER::cancel_batch() {
+    vector<FILE_XFER*> v = batch;
+    batch.clear();
+    for (unsigned int i=0; i<v.size(); i++) {
+        v[i]->batch_leader = NULL;
+        delete v[i];
+    }
+}
+
 // Parse the file upload handler response in req1
 //
 int FILE_XFER::parse_upload_response(double &nbytes) {
@@ -204,7 +687,9 @@ FILE_XFER_SET::FILE_XFER_SET(HTTP_OP_SET* p) {
 // If successful, add to the set
 //
 int FILE_XFER_SET::insert(FILE_XFER* fxp) {
-    http_ops->insert(fxp);
+    if (!fxp->batch_leader) {
+        http_ops->insert(fxp);
+    }
     file_xfers.push_back(fxp);
     set_bandwidth_limits(fxp->is_upload);
     return 0;
@@ -248,6 +733,13 @@ bool FILE_XFER_SET::poll() {
 
     for (i=0; i<file_xfers.size(); i++) {
         fxp = file_xfers[i];
+        if (fxp->batch_leader) continue;
+        if (fxp->segmented) {
+            if (!fxp->file_xfer_done && fxp->poll_segments()) {
+                action = true;
+            }
+            continue;
+        }
         if (!fxp->http_op_done()) continue;
 
         action = true;
@@ -259,7 +751,10 @@ bool FILE_XFER_SET::poll() {
             );
         }
         fxp->file_xfer_retval = fxp->http_op_retval;
-        if (fxp->file_xfer_retval == 0) {
+        if (fxp->file_xfer_retval == 0 && strlen(fxp->batch_path)) {
+            fxp->file_xfer_retval = fxp->parse_multi_upload_response();
+            fxp->finish_batch(ERR_UPLOAD_TRANSIENT);
+        } else if (fxp->file_xfer_retval == 0) {
             if (fxp->is_upload) {
                 fxp->file_xfer_retval = fxp->parse_upload_response(
                     fxp->fip->upload_offset
@@ -305,12 +800,27 @@ bool FILE_XFER_SET::poll() {
         } else if (fxp->file_xfer_retval == HTTP_STATUS_RANGE_REQUEST_ERROR) {
             fxp->fip->error_msg = "Local copy is at least as large as server copy";
         }
+        fxp->finish_batch(fxp->file_xfer_retval);
 
         // deal with various error cases for downloads
         //
         if (!fxp->is_upload) {
             get_pathname(fxp->fip, pathname, sizeof(pathname));
             if (file_size(pathname, size)) continue;
+            if (fxp->hash_download && fxp->http_op_retval == 0
+                && size == fxp->hashed_nbytes
+                && (!fxp->starting_size
+                    || fxp->response == HTTP_STATUS_PARTIAL_CONTENT
+                )
+            ) {
+                fxp->download_md5.finish(fxp->fip->download_md5);
+                fxp->fip->download_md5_state.clear();
+            } else {
+                // save the state before any truncation below;
+                // if the file ends up shorter, it won't be used
+                //
+                fxp->checkpoint_md5();
+            }
             double diff = size - fxp->starting_size;
             if (fxp->http_op_retval == 0) {
                 // If no HTTP error,
@@ -404,7 +914,18 @@ void FILE_XFER_SET::check_active(bool& up, bool& down) {
     down_active = false;
 }
 
-// adjust bandwidth limits
+// the bandwidth weight of a transfer; see PERS_FILE_XFER_SET::set_priorities()
+//
+static double bw_weight(FILE_XFER* fxp) {
+    if (fxp->segment_leader) fxp = fxp->segment_leader;
+    PERS_FILE_XFER* pfx = fxp->fip->pers_file_xfer;
+    if (!pfx) return 1;
+    return pfx->bw_weight;
+}
+
+// adjust bandwidth limits.
+// Divide the limit among active transfers in proportion to their weights,
+// so that urgent transfers get more of it.
 //
 void FILE_XFER_SET::set_bandwidth_limits(bool is_upload) {
     double max_bytes_sec;
@@ -417,29 +938,30 @@ void FILE_XFER_SET::set_bandwidth_limits(bool is_upload) {
         max_bytes_sec = gstate.global_prefs.max_bytes_sec_down;
     }
     if (!max_bytes_sec) return;
-    int n = 0;
+
+    // include the helpers of segmented downloads
+    //
+    vector<FILE_XFER*> v;
     for (i=0; i<file_xfers.size(); i++) {
         fxp = file_xfers[i];
+        v.push_back(fxp);
+        v.insert(v.end(), fxp->segment_xfers.begin(), fxp->segment_xfers.end());
+    }
+    double total_weight = 0;
+    for (i=0; i<v.size(); i++) {
+        fxp = v[i];
         if (!fxp->is_active()) continue;
-        if (is_upload) {
-            if (!fxp->is_upload) continue;
-        } else {
-            if (fxp->is_upload) continue;
-        }
-        n++;
+        if (is_upload != fxp->is_upload) continue;
+        total_weight += bw_weight(fxp);
     }
-    if (!n) return;
-    max_bytes_sec /= n;
-    for (i=0; i<file_xfers.size(); i++) {
-        fxp = file_xfers[i];
+    if (!total_weight) return;
+    for (i=0; i<v.size(); i++) {
+        fxp = v[i];
         if (!fxp->is_active()) continue;
-        if (is_upload) {
-            if (!fxp->is_upload) continue;
-            fxp->set_speed_limit(true, max_bytes_sec);
-        } else {
-            if (fxp->is_upload) continue;
-            fxp->set_speed_limit(false, max_bytes_sec);
-        }
+        if (is_upload != fxp->is_upload) continue;
+        fxp->set_speed_limit(
+            is_upload, max_bytes_sec*bw_weight(fxp)/total_weight
+        );
     }
 }
 
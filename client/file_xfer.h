@@ -29,6 +29,12 @@
 #define MIN_DOWNLOAD_INCREMENT  5000
 #define FILE_SIZE_CHECK_THRESHOLD   8192
     // upload: skip file size check if file is smaller than this
+#define MAX_UPLOAD_BATCH    16
+    // upload: max number of small files sent in one request
+#define DOWNLOAD_SEGMENT_SIZE   67108864.
+    // download: segment size for segmented downloads (64 MB);
+    // files at least twice this big are segmented
+    // if config.max_download_segments > 1
 
 class FILE_XFER : public HTTP_OP {
 public:
@@ -45,12 +51,48 @@ public:
         // 2) lets us recover when server ignored Range request
         // and sent us whole file
 
+
+    // A multi-file upload sends several small files in one request.
+    // One FILE_XFER (the leader) does the HTTP transaction;
+    // the others are placeholders for their PERS_FILE_XFERs,
+    // and get their status from the leader's reply.
+    //
+    FILE_XFER* batch_leader;
+        // if set, this upload is part of the leader's request
+    std::vector<FILE_XFER*> batch;
+        // for a leader: the other uploads in the request
+    char batch_path[256];
+        // for a leader: the file containing the request body
+
+    // A segmented download (see file_xfer.cpp) has several
+    // requests at once, each for a segment of the file.
+    // This FILE_XFER (the leader) does one of them;
+    // the others (helpers) are in the HTTP_OP_SET but not the FILE_XFER_SET.
+    //
+    bool segmented;
+    int segment;
+        // segment being downloaded by this op, or -1
+    FILE_XFER* segment_leader;
+        // for a helper: the leader
+    std::vector<FILE_XFER*> segment_xfers;
+        // for a leader: the helpers
+
     FILE_XFER();
     ~FILE_XFER();
 
     int parse_upload_response(double &offset);
     int init_download(FILE_INFO&);
     int init_upload(FILE_INFO&);
+    int init_multi_upload(FILE_INFO&, std::vector<FILE_XFER*>&);
+    int parse_multi_upload_response();
+    void finish_batch(int retval);
+    void cancel_batch();
+    int init_segmented_download();
+    int start_segment(FILE_XFER*);
+    bool poll_segments();
+    double segments_bytes_xferred();
+    void resume_md5();
+    void checkpoint_md5();
     bool file_xfer_done;
     int file_xfer_retval;
 };
@@ -34,6 +34,7 @@
 #include "config.h"
 #include <setjmp.h>
 #include <signal.h>
+#include <sys/stat.h>
 #endif
 
 #include "coproc.h"
@@ -65,6 +66,113 @@ vector<OPENCL_CPU_PROP> cpu_opencls;
 static char* client_path;
 static char client_dir[MAXPATHLEN];
 
+#if USE_CHILD_PROCESS_TO_DETECT_GPUS
+
+static void add_file_info(string& key, const char* path) {
+    struct stat sbuf;
+    char buf[MAXPATHLEN+64];
+    if (!path || stat(path, &sbuf)) return;
+    snprintf(buf, sizeof(buf), "%s %.0f %.0f\n",
+        path, (double)sbuf.st_mtime, (double)sbuf.st_size
+    );
+    key += buf;
+}
+
+#ifdef __linux__
+static void add_file_contents(string& key, const char* path) {
+    string s;
+    if (read_file_string(path, s, 4096)) return;
+    key += path;
+    key += " ";
+    key += s;
+}
+#endif
+
+// Get a string that changes if the GPUs or their drivers change;
+// if it's the same as last time, use the coproc_info.xml from then
+// rather than running GPU detection, which can take a long time.
+// Return false if we don't know how to do this on this platform.
+//
+// It includes:
+// - the client executable (which does the detection) and cc_config.xml
+// - Linux:
+//      display-class PCI devices;
+//      version info of GPU kernel modules;
+//      OpenCL ICD files
+// - Windows: the display adapters' driver info from the registry
+//
+static bool get_gpu_key(string& key) {
+    key = "";
+    add_file_info(key, client_path);
+    add_file_info(key, CONFIG_FILE);
+#if defined(__linux__)
+    char path[MAXPATHLEN];
+    string name;
+    DirScanner pci("/sys/bus/pci/devices");
+    while (pci.scan(name)) {
+        string cls;
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/class", name.c_str());
+        if (read_file_string(path, cls, 64)) continue;
+        if (cls.find("0x03") != 0) continue;
+        key += name + " ";
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor", name.c_str());
+        add_file_contents(key, path);
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/device", name.c_str());
+        add_file_contents(key, path);
+    }
+    const char* modules[] = {"nvidia", "fglrx", "amdgpu", "radeon", "i915", NULL};
+    for (int i=0; modules[i]; i++) {
+        snprintf(path, sizeof(path), "/sys/module/%s/version", modules[i]);
+        add_file_contents(key, path);
+        snprintf(path, sizeof(path), "/sys/module/%s/srcversion", modules[i]);
+        add_file_contents(key, path);
+    }
+    add_file_contents(key, "/proc/driver/nvidia/version");
+    DirScanner icd("/etc/OpenCL/vendors");
+    while (icd.scan(name)) {
+        snprintf(path, sizeof(path), "/etc/OpenCL/vendors/%s", name.c_str());
+        add_file_info(key, path);
+    }
+    return true;
+#elif defined(_WIN32)
+    HKEY hkey;
+    const char* class_key =
+        "SYSTEM\\CurrentControlSet\\Control\\Class\\{4d36e968-e325-11ce-bfc1-08002be10318}";
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, class_key, 0, KEY_READ, &hkey) != ERROR_SUCCESS) {
+        return false;
+    }
+    char subkey_name[256];
+    for (DWORD i=0; ; i++) {
+        DWORD len = sizeof(subkey_name);
+        if (RegEnumKeyExA(hkey, i, subkey_name, &len, NULL, NULL, NULL, NULL) != ERROR_SUCCESS) {
+            break;
+        }
+        HKEY hsub;
+        if (RegOpenKeyExA(hkey, subkey_name, 0, KEY_READ, &hsub) != ERROR_SUCCESS) {
+            continue;
+        }
+        const char* values[] = {"MatchingDeviceId", "DriverVersion", "DriverDate", NULL};
+        for (int j=0; values[j]; j++) {
+            char buf[256];
+            DWORD type, size = sizeof(buf)-1;
+            if (RegQueryValueExA(hsub, values[j], NULL, &type, (LPBYTE)buf, &size) == ERROR_SUCCESS
+                && type == REG_SZ
+            ) {
+                buf[size] = 0;
+                key += string(subkey_name) + " " + buf + "\n";
+            }
+        }
+        RegCloseKey(hsub);
+    }
+    RegCloseKey(hkey);
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif
+
 void COPROCS::get(
     bool use_all, vector<string>&descs, vector<string>&warnings,
     IGNORE_GPU_INSTANCE& ignore_gpu_instance
@@ -72,6 +180,25 @@ void COPROCS::get(
 #if USE_CHILD_PROCESS_TO_DETECT_GPUS
     int retval = 0;
     char buf[256];
+    string key, old_key;
+    bool have_key = get_gpu_key(key);
+
+    // if nothing has changed since the last detection, use its results
+    //
+    if (have_key
+        && !read_file_string(COPROC_INFO_KEY_FILENAME, old_key)
+        && key == old_key
+        && !read_coproc_info_file(warnings)
+    ) {
+        if (log_flags.coproc_debug) {
+            msg_printf(0, MSG_INFO,
+                "[coproc] GPUs and drivers unchanged; using previous detection results"
+            );
+        }
+        correlate_gpus(use_all, descs, ignore_gpu_instance);
+        return;
+    }
+    boinc_delete_file(COPROC_INFO_KEY_FILENAME);
 
     retval = launch_child_process_to_detect_gpus();
     if (retval) {
@@ -81,14 +208,26 @@ void COPROCS::get(
         );
         warnings.push_back(buf);
     }
-    retval = read_coproc_info_file(warnings);
-    if (retval) {
+    int retval2 = read_coproc_info_file(warnings);
+    if (retval2) {
         snprintf(buf, sizeof(buf),
             "read_coproc_info_file() returned error %d",
-            retval
+            retval2
         );
         warnings.push_back(buf);
     }
+    // Save the key only if we found a GPU;
+    // detection can fail transiently (e.g. before the driver is loaded)
+    //
+    if (have_key && !retval && !retval2
+        && (nvidia_gpus.size() || ati_gpus.size() || intel_gpus.size())
+    ) {
+        FILE* f = boinc_fopen(COPROC_INFO_KEY_FILENAME, "w");
+        if (f) {
+            fputs(key.c_str(), f);
+            fclose(f);
+        }
+    }
 #else
     detect_gpus(warnings);
 #endif
@@ -361,8 +361,8 @@ void COPROCS::get_opencl(
                 prop.opencl_platform_version, platform_version,
                 sizeof(prop.opencl_platform_version)-1
             );
+            prop.opencl_platform_index = platform_index;
 
-//TODO: Should we store the platform(s) for each GPU found?
 //TODO: Must we check if multiple platforms found the same GPU and merge the records?
             ciErrNum = get_opencl_info(prop, device_index, warnings);
             if (ciErrNum != CL_SUCCESS) continue;
@@ -823,6 +823,7 @@ void COPROC::merge_opencl(
             if (device_nums[i] == opencls[j].device_num) {
                 opencls[j].is_used = COPROC_USED;
                 opencl_device_indexes[opencl_device_count] = opencls[j].opencl_device_index;
+                opencl_platform_indexes[opencl_device_count] = opencls[j].opencl_platform_index;
                 opencl_device_ids[opencl_device_count++] = opencls[j].device_id;
             }
         }
@@ -875,6 +876,7 @@ void COPROC::find_best_opencls(
         if (use_all || !opencl_compare(opencls[i], opencl_prop, true)) {
             device_nums[count++] = opencls[i].device_num;
             opencl_device_indexes[opencl_device_count] = opencls[i].opencl_device_index;
+            opencl_platform_indexes[opencl_device_count] = opencls[i].opencl_platform_index;
             opencl_device_ids[opencl_device_count++] = opencls[i].device_id;
             opencls[i].is_used = COPROC_USED;
         }
@@ -0,0 +1,262 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// GPU telemetry; see gpu_telemetry.h
+
+#ifdef _WIN32
+#include "boinc_win.h"
+#else
+#include "config.h"
+#include <cstdio>
+#include <cstring>
+#ifndef __APPLE__
+#include <dlfcn.h>
+#endif
+#endif
+
+#include "str_util.h"
+#include "util.h"
+
+#include "client_msgs.h"
+#include "client_state.h"
+#include "client_types.h"
+#include "log_flags.h"
+
+#include "gpu_telemetry.h"
+
+GPU_TELEMETRY gpu_telemetry;
+
+// NVML, loaded at run time.
+// These are the parts of nvml.h we use.
+//
+typedef void* NVML_DEVICE;
+
+struct NVML_UTILIZATION {
+    unsigned int gpu;
+    unsigned int memory;
+};
+
+struct NVML_MEMORY {
+    unsigned long long total;
+    unsigned long long free;
+    unsigned long long used;
+};
+
+#define NVML_SUCCESS            0
+#define NVML_TEMPERATURE_GPU    0
+#define NVML_CLOCK_SM           1
+#define NVML_CLOCK_MEM          2
+
+typedef int (*NVML_INIT)();
+typedef int (*NVML_GET_COUNT)(unsigned int*);
+typedef int (*NVML_GET_HANDLE_BY_INDEX)(unsigned int, NVML_DEVICE*);
+typedef int (*NVML_GET_HANDLE_BY_PCI)(const char*, NVML_DEVICE*);
+typedef int (*NVML_GET_UTILIZATION)(NVML_DEVICE, NVML_UTILIZATION*);
+typedef int (*NVML_GET_MEMORY)(NVML_DEVICE, NVML_MEMORY*);
+typedef int (*NVML_GET_TEMPERATURE)(NVML_DEVICE, int, unsigned int*);
+typedef int (*NVML_GET_CLOCK)(NVML_DEVICE, int, unsigned int*);
+
+static NVML_INIT __nvmlInit = NULL;
+static NVML_GET_COUNT __nvmlDeviceGetCount = NULL;
+static NVML_GET_HANDLE_BY_INDEX __nvmlDeviceGetHandleByIndex = NULL;
+static NVML_GET_HANDLE_BY_PCI __nvmlDeviceGetHandleByPciBusId = NULL;
+static NVML_GET_UTILIZATION __nvmlDeviceGetUtilizationRates = NULL;
+static NVML_GET_MEMORY __nvmlDeviceGetMemoryInfo = NULL;
+static NVML_GET_TEMPERATURE __nvmlDeviceGetTemperature = NULL;
+static NVML_GET_CLOCK __nvmlDeviceGetClockInfo = NULL;
+
+static NVML_DEVICE nvml_devices[MAX_COPROC_INSTANCES];
+    // NVML device of each NVIDIA instance, or NULL
+
+#if defined(SIM) || defined(__APPLE__)
+static bool nvml_load() {
+    return false;
+}
+#else
+#ifdef _WIN32
+#define NVML_SYM(lib, name) GetProcAddress(lib, name)
+#else
+#define NVML_SYM(lib, name) dlsym(lib, name)
+#endif
+
+static bool nvml_load() {
+#ifdef _WIN32
+    HMODULE lib = LoadLibrary("nvml.dll");
+#else
+    void* lib = dlopen("libnvidia-ml.so.1", RTLD_NOW);
+#endif
+    if (!lib) return false;
+    __nvmlInit = (NVML_INIT)NVML_SYM(lib, "nvmlInit_v2");
+    __nvmlDeviceGetCount = (NVML_GET_COUNT)NVML_SYM(lib, "nvmlDeviceGetCount_v2");
+    __nvmlDeviceGetHandleByIndex = (NVML_GET_HANDLE_BY_INDEX)NVML_SYM(lib, "nvmlDeviceGetHandleByIndex_v2");
+    __nvmlDeviceGetHandleByPciBusId = (NVML_GET_HANDLE_BY_PCI)NVML_SYM(lib, "nvmlDeviceGetHandleByPciBusId_v2");
+    __nvmlDeviceGetUtilizationRates = (NVML_GET_UTILIZATION)NVML_SYM(lib, "nvmlDeviceGetUtilizationRates");
+    __nvmlDeviceGetMemoryInfo = (NVML_GET_MEMORY)NVML_SYM(lib, "nvmlDeviceGetMemoryInfo");
+    __nvmlDeviceGetTemperature = (NVML_GET_TEMPERATURE)NVML_SYM(lib, "nvmlDeviceGetTemperature");
+    __nvmlDeviceGetClockInfo = (NVML_GET_CLOCK)NVML_SYM(lib, "nvmlDeviceGetClockInfo");
+    if (!__nvmlInit || !__nvmlDeviceGetCount || !__nvmlDeviceGetHandleByIndex
+        || !__nvmlDeviceGetHandleByPciBusId || !__nvmlDeviceGetUtilizationRates
+        || !__nvmlDeviceGetMemoryInfo || !__nvmlDeviceGetTemperature
+        || !__nvmlDeviceGetClockInfo
+    ) {
+        return false;
+    }
+    return (*__nvmlInit)() == NVML_SUCCESS;
+}
+#endif
+
+// find the NVML device of each NVIDIA instance.
+// NVML and CUDA number devices differently,
+// so match them by PCI address.
+// If that's not known, we can only match a single GPU.
+//
+static int nvml_find_devices(COPROC& cp) {
+    unsigned int i, ndevs = 0;
+    char buf[256];
+    int n = 0;
+
+    (*__nvmlDeviceGetCount)(&ndevs);
+    for (i=0; i<(unsigned int)cp.count; i++) {
+        nvml_devices[i] = NULL;
+        PCI_INFO& pi = cp.pci_infos[i];
+        if (pi.present) {
+            snprintf(buf, sizeof(buf), "%08x:%02x:%02x.0",
+                pi.domain_id, pi.bus_id, pi.device_id
+            );
+            (*__nvmlDeviceGetHandleByPciBusId)(buf, &nvml_devices[i]);
+        } else if (ndevs == 1 && cp.count == 1) {
+            (*__nvmlDeviceGetHandleByIndex)(0, &nvml_devices[i]);
+        }
+        if (nvml_devices[i]) n++;
+    }
+    return n;
+}
+
+static void nvml_sample(NVML_DEVICE dev, GPU_SAMPLE& s) {
+    NVML_UTILIZATION u;
+    NVML_MEMORY m;
+    unsigned int x;
+
+    s.clear();
+    if ((*__nvmlDeviceGetMemoryInfo)(dev, &m) != NVML_SUCCESS) return;
+    s.mem_total = (double)m.total;
+    s.mem_free = (double)m.free;
+    if ((*__nvmlDeviceGetUtilizationRates)(dev, &u) == NVML_SUCCESS) {
+        s.utilization = u.gpu;
+        s.mem_utilization = u.memory;
+    }
+    if ((*__nvmlDeviceGetTemperature)(dev, NVML_TEMPERATURE_GPU, &x) == NVML_SUCCESS) {
+        s.temperature = x;
+    }
+    if ((*__nvmlDeviceGetClockInfo)(dev, NVML_CLOCK_SM, &x) == NVML_SUCCESS) {
+        s.clock_sm = x;
+    }
+    if ((*__nvmlDeviceGetClockInfo)(dev, NVML_CLOCK_MEM, &x) == NVML_SUCCESS) {
+        s.clock_mem = x;
+    }
+    s.time = gstate.now;
+    s.valid = true;
+}
+
+GPU_TELEMETRY::GPU_TELEMETRY() {
+    initialized = false;
+    available = false;
+    last_poll = 0;
+    for (int i=0; i<MAX_RSC; i++) {
+        for (int j=0; j<MAX_COPROC_INSTANCES; j++) {
+            samples[i][j].clear();
+        }
+    }
+}
+
+void GPU_TELEMETRY::poll() {
+    int rt, i;
+
+    if (config.no_gpu_telemetry) return;
+    if (gstate.now < last_poll + GPU_TELEMETRY_PERIOD) return;
+    last_poll = gstate.now;
+
+    int nvidia_rt = coprocs.have_nvidia()?rsc_index(GPU_TYPE_NVIDIA):-1;
+    if (!initialized) {
+        initialized = true;
+        if (nvidia_rt <= 0) return;
+        if (!nvml_load()) return;
+        int n = nvml_find_devices(coprocs.coprocs[nvidia_rt]);
+        if (!n) return;
+        available = true;
+        msg_printf(NULL, MSG_INFO,
+            "Reading status of %d NVIDIA GPU%s with NVML", n, n>1?"s":""
+        );
+    }
+    if (!available) return;
+
+    rt = nvidia_rt;
+    COPROC& cp = coprocs.coprocs[rt];
+    for (i=0; i<cp.count; i++) {
+        GPU_SAMPLE& s = samples[rt][i];
+        if (!nvml_devices[i]) continue;
+        nvml_sample(nvml_devices[i], s);
+        if (log_flags.coproc_debug && s.valid) {
+            msg_printf(NULL, MSG_INFO,
+                "[coproc] %s %d: %.0f%% busy, %.0f/%.0fMB free, %.0fC, %.0f/%.0f MHz",
+                cp.type, cp.device_nums[i], s.utilization,
+                s.mem_free/MEGA, s.mem_total/MEGA, s.temperature,
+                s.clock_sm, s.clock_mem
+            );
+        }
+    }
+}
+
+GPU_SAMPLE* GPU_TELEMETRY::get(int rt, int instance) {
+    if (!available) return NULL;
+    if (rt <= 0 || rt >= MAX_RSC) return NULL;
+    if (instance < 0 || instance >= MAX_COPROC_INSTANCES) return NULL;
+    GPU_SAMPLE& s = samples[rt][instance];
+    if (!s.valid) return NULL;
+    if (gstate.now - s.time > GPU_TELEMETRY_MAX_AGE) return NULL;
+    return &s;
+}
+
+void GPU_TELEMETRY::write(MIOFILE& out) {
+    out.printf("<gpu_telemetry>\n");
+    for (int rt=1; rt<coprocs.n_rsc; rt++) {
+        COPROC& cp = coprocs.coprocs[rt];
+        for (int i=0; i<cp.count; i++) {
+            GPU_SAMPLE* s = get(rt, i);
+            if (!s) continue;
+            out.printf(
+                "    <gpu>\n"
+                "        <type>%s</type>\n"
+                "        <device_num>%d</device_num>\n"
+                "        <time>%f</time>\n"
+                "        <utilization>%f</utilization>\n"
+                "        <mem_utilization>%f</mem_utilization>\n"
+                "        <mem_total>%f</mem_total>\n"
+                "        <mem_free>%f</mem_free>\n"
+                "        <temperature>%f</temperature>\n"
+                "        <clock_sm>%f</clock_sm>\n"
+                "        <clock_mem>%f</clock_mem>\n"
+                "    </gpu>\n",
+                cp.type, cp.device_nums[i], s->time,
+                s->utilization, s->mem_utilization,
+                s->mem_total, s->mem_free, s->temperature,
+                s->clock_sm, s->clock_mem
+            );
+        }
+    }
+    out.printf("</gpu_telemetry>\n");
+}
@@ -0,0 +1,86 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Live status of GPUs (utilization, free memory, temperature, clocks),
+// read every GPU_TELEMETRY_PERIOD seconds from the vendor's
+// management library.
+// Currently NVIDIA only (NVML, which comes with the driver).
+//
+// The job scheduler (assign_coprocs()) uses it:
+// - a job isn't started on an instance
+//   unless the instance has the job's gpu_ram free;
+// - a new job is put on an idle instance rather than one
+//   that something other than BOINC is using.
+//
+// Disabled by <no_gpu_telemetry> in cc_config.xml.
+
+#ifndef _GPU_TELEMETRY_
+#define _GPU_TELEMETRY_
+
+#include "coproc.h"
+#include "miofile.h"
+
+#define GPU_TELEMETRY_PERIOD    10
+#define GPU_TELEMETRY_MAX_AGE   60
+    // don't use samples older than this
+#define GPU_BUSY_UTILIZATION    50
+    // an instance with no BOINC jobs and at least this utilization (%)
+    // is being used by something else
+
+struct GPU_SAMPLE {
+    bool valid;
+    double time;
+    double utilization;     // percent
+    double mem_utilization; // percent of time memory was read or written
+    double mem_total;
+    double mem_free;
+    double temperature;     // Celsius
+    double clock_sm;        // MHz
+    double clock_mem;       // MHz
+
+    void clear() {
+        valid = false;
+        time = 0;
+        utilization = 0;
+        mem_utilization = 0;
+        mem_total = 0;
+        mem_free = 0;
+        temperature = 0;
+        clock_sm = 0;
+        clock_mem = 0;
+    }
+};
+
+struct GPU_TELEMETRY {
+    bool initialized;
+    bool available;
+        // a management library was loaded
+    double last_poll;
+    GPU_SAMPLE samples[MAX_RSC][MAX_COPROC_INSTANCES];
+        // indexed by resource type and instance
+
+    GPU_TELEMETRY();
+    void poll();
+    GPU_SAMPLE* get(int rt, int instance);
+        // a recent sample for the instance, or NULL
+    void write(MIOFILE&);
+        // for GUI RPC
+};
+
+extern GPU_TELEMETRY gpu_telemetry;
+
+#endif
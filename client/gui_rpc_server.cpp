@@ -87,22 +87,53 @@ GUI_RPC_CONN::GUI_RPC_CONN(int s) :
     sent_unauthorized = false;
     notice_refresh = false;
     request_nbytes = 0;
+    subscribed = false;
+    transfer_event_interval = 10;
+    last_transfer_event_time = 0;
+    transfer_event_pending = false;
 }
 
 GUI_RPC_CONN::~GUI_RPC_CONN() {
     boinc_close_socket(sock);
 }
 
+// send an event message to a subscribed connection.
+// Like replies, these end with \003; the root tag is
+// <boinc_gui_rpc_event> so they can be told apart from replies
+//
+void GUI_RPC_CONN::send_event(const char* body) {
+    string s = string("<boinc_gui_rpc_event>\n") + body + "</boinc_gui_rpc_event>\n\003";
+    send(sock, s.c_str(), (int)s.size(), 0);
+    if (log_flags.gui_rpc_debug) {
+        msg_printf(0, MSG_INFO,
+            "[gui_rpc] sent event: '%s'", body
+        );
+    }
+}
+
 GUI_RPC_CONN_SET::GUI_RPC_CONN_SET() {
     lsock = -1;
     time_of_last_rpc_needing_network = 0;
+    event_state_valid = false;
+    last_event_check_time = 0;
+    event_msg_seqno = 0;
+    event_notice_seqno = 0;
+    event_task_mode = event_gpu_mode = event_network_mode = 0;
+    event_xfer_bytes = 0;
+    event_nxfers = 0;
 }
 
 bool GUI_RPC_CONN_SET::poll() {
     unsigned int i;
     bool action = false;
+    bool any_subscribed = false;
     for (i=0; i<gui_rpcs.size(); i++) {
         action |= gui_rpcs[i]->gui_http.poll();
+        if (gui_rpcs[i]->subscribed) any_subscribed = true;
+    }
+    if (any_subscribed && gstate.now > last_event_check_time + 1) {
+        last_event_check_time = gstate.now;
+        check_events();
     }
     return action;
 }
@@ -18,6 +18,9 @@
 #ifndef _GUI_RPC_SERVER_
 #define _GUI_RPC_SERVER_
 
+#include <map>
+#include <string>
+
 #include "network.h"
 #include "acct_setup.h"
 
@@ -63,6 +66,11 @@ public:
     bool quit_flag;
     int au_ss_state;
     int au_mgr_state;
+    bool subscribed;
+        // got a <subscribe>; send events (see gui_rpc_server_ops.cpp)
+    double transfer_event_interval;
+    double last_transfer_event_time;
+    bool transfer_event_pending;
     GUI_HTTP gui_http;
     GET_PROJECT_CONFIG_OP get_project_config_op;
     LOOKUP_ACCOUNT_OP lookup_account_op;
@@ -84,6 +92,8 @@ public:
     GUI_RPC_CONN(int);
     ~GUI_RPC_CONN();
     int handle_rpc();
+    int handle_request(bool http_request);
+    void send_event(const char*);
     void handle_auth1(MIOFILE&);
     int handle_auth2(char*, MIOFILE&);
 };
@@ -100,6 +110,18 @@ class GUI_RPC_CONN_SET {
     int insert(GUI_RPC_CONN*);
     bool check_allowed_list(sockaddr_storage& ip_addr);
     bool remote_hosts_file_exists;
+
+    // what we last told subscribers about
+    //
+    bool event_state_valid;
+    double last_event_check_time;
+    int event_msg_seqno;
+    int event_notice_seqno;
+    int event_task_mode, event_gpu_mode, event_network_mode;
+    std::map<std::string, int> event_task_states;
+    double event_xfer_bytes;
+    int event_nxfers;
+    void check_events();
 public:
     int lsock;
     double time_of_last_rpc_needing_network;
@@ -38,6 +38,8 @@
 #include <sys/un.h>
 #endif
 #include <vector>
+#include <deque>
+#include <map>
 #include <cstring>
 #if HAVE_NETINET_IN_H
 #include <netinet/in.h>
@@ -59,15 +61,19 @@
 #include "url.h"
 #include "util.h"
 
+#include "async_file.h"
 #include "client_state.h"
 #include "client_msgs.h"
 #include "client_state.h"
 #include "cs_proxy.h"
 #include "cs_notice.h"
 #include "file_names.h"
+#include "gpu_telemetry.h"
 #include "project.h"
 #include "result.h"
 
+using std::deque;
+using std::map;
 using std::string;
 using std::vector;
 
@@ -105,6 +111,7 @@ static void handle_exchange_versions(GUI_RPC_CONN& grc) {
         "   <major>%d</major>\n"
         "   <minor>%d</minor>\n"
         "   <release>%d</release>\n"
+        "   <pipelined_requests/>\n"
         "</server_version>\n",
         BOINC_MAJOR_VERSION,
         BOINC_MINOR_VERSION,
@@ -339,6 +346,7 @@ static void handle_set_run_mode(GUI_RPC_CONN& grc) {
         return;
     }
     gstate.cpu_run_mode.set(mode, duration);
+    gstate.set_poll_flags(POLL_FLAG_RR_SIM);
     grc.mfout.printf("<success/>\n");
 }
 
@@ -455,16 +463,24 @@ static void handle_get_proxy_settings(GUI_RPC_CONN& grc) {
 // params:
 // [ <seqno>n</seqno> ]
 //    return only msgs with seqno > n; if absent or zero, return all
+// [ <limit>n</limit> ]
+//    return at most n msgs (the oldest ones)
+// [ <project>name</project> ]
+//    return only msgs for the project with this name
 //
 static void handle_get_messages(GUI_RPC_CONN& grc) {
-    int seqno=0;
+    int seqno=0, limit=0;
     bool translatable = false;
+    char project[256];
 
+    strcpy(project, "");
     while (!grc.xp.get_tag()) {
         if (grc.xp.parse_int("seqno", seqno)) continue;
         if (grc.xp.parse_bool("translatable", translatable)) continue;
+        if (grc.xp.parse_int("limit", limit)) continue;
+        if (grc.xp.parse_str("project", project, sizeof(project))) continue;
     }
-    message_descs.write(seqno, grc.mfout, translatable);
+    message_descs.write(seqno, grc.mfout, translatable, limit, project);
 }
 
 static void handle_get_message_count(GUI_RPC_CONN& grc) {
@@ -589,6 +605,10 @@ static void handle_get_host_info(GUI_RPC_CONN& grc) {
     gstate.host_info.write(grc.mfout, true, true);
 }
 
+static void handle_get_gpu_telemetry(GUI_RPC_CONN& grc) {
+    gpu_telemetry.write(grc.mfout);
+}
+
 static void handle_get_screensaver_tasks(GUI_RPC_CONN& grc) {
     unsigned int i;
     ACTIVE_TASK* atp;
@@ -683,6 +703,15 @@ static void handle_get_cc_status(GUI_RPC_CONN& grc) {
         config.simple_gui_only?1:0,
         config.max_event_log_lines
     );
+    int ndirs, nfiles;
+    get_async_delete_status(ndirs, nfiles);
+    if (ndirs) {
+        grc.mfout.printf(
+            "   <async_deletes>%d</async_deletes>\n"
+            "   <async_delete_nfiles>%d</async_delete_nfiles>\n",
+            ndirs, nfiles
+        );
+    }
     if (grc.au_mgr_state == AU_MGR_QUIT_REQ) {
         grc.mfout.printf(
             "   <manager_must_quit>1</manager_must_quit>\n"
@@ -1100,16 +1129,350 @@ static void handle_get_old_results(GUI_RPC_CONN& grc) {
     print_old_results(grc.mfout);
 }
 
+// Delta updates for get_results.
+// If the request has <seqno>n</seqno> and <epoch>e</epoch>
+// from the previous reply, the reply has only the results
+// that changed since then, and the names of those that were deleted,
+// so that a manager polling lots of hosts doesn't have to
+// get and parse all the results each time.
+//
+// We find changes by comparing each result's GUI XML
+// with what it was the last time we looked.
+// This is shared by all connections, so seqnos are global.
+// The epoch changes when the client restarts.
+//
+struct GUI_RESULT_INFO {
+    string project_url;
+    string name;
+    string xml;
+    int seqno;          // when it last changed
+    bool present;
+
+    GUI_RESULT_INFO() {
+        seqno = 0;
+        present = false;
+    }
+};
+
+#define MAX_GUI_DELETED_RESULTS 1000
+
+static map<string, GUI_RESULT_INFO> gui_results;
+    // keyed by project URL and name
+static deque<GUI_RESULT_INFO> gui_deleted_results;
+static int gui_results_seqno = 0;
+static int gui_deleted_min_seqno = 0;
+    // we know about deletions after this seqno
+static int gui_results_epoch = 0;
+
+static void update_gui_results() {
+    map<string, GUI_RESULT_INFO>::iterator it;
+    unsigned int i;
+
+    if (!gui_results_epoch) gui_results_epoch = (int)time(0);
+    for (it = gui_results.begin(); it != gui_results.end(); it++) {
+        it->second.present = false;
+    }
+    for (i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        MFILE mf;
+        MIOFILE mof;
+        char* p;
+        int n;
+
+        mof.init_mfile(&mf);
+        rp->write_gui(mof);
+        mf.get_buf(p, n);
+        string key = string(rp->project->master_url) + " " + rp->name;
+        GUI_RESULT_INFO& ri = gui_results[key];
+        if (!ri.seqno || ri.xml != p) {
+            ri.project_url = rp->project->master_url;
+            ri.name = rp->name;
+            ri.xml = p;
+            ri.seqno = ++gui_results_seqno;
+        }
+        ri.present = true;
+        free(p);
+    }
+    it = gui_results.begin();
+    while (it != gui_results.end()) {
+        if (it->second.present) {
+            it++;
+            continue;
+        }
+        GUI_RESULT_INFO ri = it->second;
+        ri.xml.clear();
+        ri.seqno = ++gui_results_seqno;
+        gui_deleted_results.push_back(ri);
+        gui_results.erase(it++);
+    }
+    while (gui_deleted_results.size() > MAX_GUI_DELETED_RESULTS) {
+        gui_deleted_min_seqno = gui_deleted_results.front().seqno;
+        gui_deleted_results.pop_front();
+    }
+}
+
+static void write_results_delta(GUI_RPC_CONN& grc, int seqno, int epoch) {
+    unsigned int i;
+
+    update_gui_results();
+    bool full = (epoch != gui_results_epoch)
+        || (seqno < gui_deleted_min_seqno)
+        || (seqno > gui_results_seqno);
+    grc.mfout.printf(
+        "<seqno>%d</seqno>\n"
+        "<epoch>%d</epoch>\n",
+        gui_results_seqno, gui_results_epoch
+    );
+    if (full) {
+        grc.mfout.printf("<full/>\n");
+        seqno = 0;
+    }
+    for (i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        string key = string(rp->project->master_url) + " " + rp->name;
+        GUI_RESULT_INFO& ri = gui_results[key];
+        if (ri.seqno > seqno) {
+            grc.mfout.printf("%s", ri.xml.c_str());
+        }
+    }
+    if (full) return;
+    for (i=0; i<gui_deleted_results.size(); i++) {
+        GUI_RESULT_INFO& ri = gui_deleted_results[i];
+        if (ri.seqno <= seqno) continue;
+        grc.mfout.printf(
+            "<deleted_result>\n"
+            "    <project_url>%s</project_url>\n"
+            "    <name>%s</name>\n"
+            "</deleted_result>\n",
+            ri.project_url.c_str(), ri.name.c_str()
+        );
+    }
+}
+
+// Filtering and paging for get_results, for GUIs that show
+// only part of a long list of results.
+// All are optional:
+// <project_url>   only results for this project
+// <state>         only results in this state (RESULT_*)
+// <resource>      only results that use this resource ("CPU" or a GPU type)
+// <active_only/>  only results with an active task
+// <offset>, <limit>
+//      of the results that match, skip offset and return at most limit.
+//      The reply includes <nmatched>, the number that match.
+//
+struct GUI_RESULT_FILTER {
+    char project_url[256];
+    int state;
+    char resource[256];
+    bool active_only;
+    int offset;
+    int limit;
+
+    GUI_RESULT_FILTER() {
+        strcpy(project_url, "");
+        state = -1;
+        strcpy(resource, "");
+        active_only = false;
+        offset = 0;
+        limit = 0;
+    }
+    bool any() {
+        return strlen(project_url) || state >= 0 || strlen(resource)
+            || offset || limit;
+    }
+    bool match(RESULT* rp) {
+        if (strlen(project_url)
+            && rp->project != gstate.lookup_project(project_url)
+        ) {
+            return false;
+        }
+        if (state >= 0 && rp->state() != state) return false;
+        if (strlen(resource) && strcmp(resource, rsc_name(rp->resource_type()))) {
+            return false;
+        }
+        if (active_only && !gstate.active_tasks.lookup_result(rp)) return false;
+        return true;
+    }
+};
+
+static void write_results_filtered(GUI_RPC_CONN& grc, GUI_RESULT_FILTER& f) {
+    int n = 0, nwritten = 0;
+    for (unsigned int i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        if (!f.match(rp)) continue;
+        if (n++ < f.offset) continue;
+        if (f.limit && nwritten >= f.limit) continue;
+        rp->write_gui(grc.mfout);
+        nwritten++;
+    }
+    grc.mfout.printf("<nmatched>%d</nmatched>\n", n);
+}
+
 static void handle_get_results(GUI_RPC_CONN& grc) {
-    bool active_only = false;
+    GUI_RESULT_FILTER f;
+    int seqno = -1, epoch = 0;
     while (!grc.xp.get_tag()) {
-        if (grc.xp.parse_bool("active_only", active_only)) continue;
+        if (grc.xp.parse_bool("active_only", f.active_only)) continue;
+        if (grc.xp.parse_int("seqno", seqno)) continue;
+        if (grc.xp.parse_int("epoch", epoch)) continue;
+        if (grc.xp.parse_str("project_url", f.project_url, sizeof(f.project_url))) continue;
+        if (grc.xp.parse_int("state", f.state)) continue;
+        if (grc.xp.parse_str("resource", f.resource, sizeof(f.resource))) continue;
+        if (grc.xp.parse_int("offset", f.offset)) continue;
+        if (grc.xp.parse_int("limit", f.limit)) continue;
     }
     grc.mfout.printf("<results>\n");
-    gstate.write_tasks_gui(grc.mfout, active_only);
+    if (f.any()) {
+        write_results_filtered(grc, f);
+    } else if (seqno >= 0 && !f.active_only) {
+        write_results_delta(grc, seqno, epoch);
+    } else {
+        gstate.write_tasks_gui(grc.mfout, f.active_only);
+    }
     grc.mfout.printf("</results>\n");
 }
 
+// Event subscription.
+// After a <subscribe> request, the connection gets
+// <boinc_gui_rpc_event> messages (ending with \003, like replies)
+// saying what has changed, so that a manager can wait for these
+// rather than polling, and do the RPCs to get the details.
+// An event can contain:
+// <task> (project_url, name, state, active_task_state, or deleted)
+//      for a task whose state changed
+// <msg_seqno>, <notice_seqno>: there are new messages or notices
+// <run_mode> (task_mode, gpu_mode, network_mode): run modes changed
+// <file_transfers/>: file transfers progressed;
+//      at most every <transfer_interval> seconds (default 10)
+// We check for changes once a second.
+// The connection can still be used for other RPCs.
+//
+static void handle_subscribe(GUI_RPC_CONN& grc) {
+    double x;
+    while (!grc.xp.get_tag()) {
+        if (grc.xp.parse_double("transfer_interval", x)) {
+            if (x > 0) grc.transfer_event_interval = x;
+            continue;
+        }
+    }
+    grc.subscribed = true;
+    grc.mfout.printf("<success/>\n");
+}
+
+static void handle_unsubscribe(GUI_RPC_CONN& grc) {
+    grc.subscribed = false;
+    grc.mfout.printf("<success/>\n");
+}
+
+void GUI_RPC_CONN_SET::check_events() {
+    char buf[1024];
+    string events;
+    unsigned int i;
+    bool first = !event_state_valid;
+    event_state_valid = true;
+
+    int n = message_descs.highest_seqno();
+    if (n != event_msg_seqno) {
+        event_msg_seqno = n;
+        sprintf(buf, "<msg_seqno>%d</msg_seqno>\n", n);
+        events += buf;
+    }
+    n = notices.notices.empty()?0:notices.notices.front().seqno;
+    if (n != event_notice_seqno) {
+        event_notice_seqno = n;
+        sprintf(buf, "<notice_seqno>%d</notice_seqno>\n", n);
+        events += buf;
+    }
+
+    int tm = gstate.cpu_run_mode.get_current();
+    int gm = gstate.gpu_run_mode.get_current();
+    int nm = gstate.network_run_mode.get_current();
+    if (tm != event_task_mode || gm != event_gpu_mode || nm != event_network_mode) {
+        event_task_mode = tm;
+        event_gpu_mode = gm;
+        event_network_mode = nm;
+        sprintf(buf,
+            "<run_mode>\n"
+            "    <task_mode>%d</task_mode>\n"
+            "    <gpu_mode>%d</gpu_mode>\n"
+            "    <network_mode>%d</network_mode>\n"
+            "</run_mode>\n",
+            tm, gm, nm
+        );
+        events += buf;
+    }
+
+    // task states; the value is the result state and
+    // (if there's an active task) its state
+    //
+    map<string, int> states;
+    for (i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        ACTIVE_TASK* atp = gstate.active_tasks.lookup_result(rp);
+        int s = rp->state()*1000 + (atp?atp->task_state()+1:0);
+        string key = string(rp->project->master_url) + " " + rp->name;
+        states[key] = s;
+        map<string, int>::iterator it = event_task_states.find(key);
+        if (it != event_task_states.end() && it->second == s) continue;
+        sprintf(buf,
+            "<task>\n"
+            "    <project_url>%s</project_url>\n"
+            "    <name>%s</name>\n"
+            "    <state>%d</state>\n",
+            rp->project->master_url, rp->name, rp->state()
+        );
+        events += buf;
+        if (atp) {
+            sprintf(buf,
+                "    <active_task_state>%d</active_task_state>\n",
+                atp->task_state()
+            );
+            events += buf;
+        }
+        events += "</task>\n";
+    }
+    map<string, int>::iterator it;
+    for (it = event_task_states.begin(); it != event_task_states.end(); it++) {
+        if (states.find(it->first) != states.end()) continue;
+        size_t k = it->first.find(' ');
+        events += "<task>\n    <project_url>" + it->first.substr(0, k)
+            + "</project_url>\n    <name>" + it->first.substr(k+1)
+            + "</name>\n    <deleted/>\n</task>\n";
+    }
+    event_task_states = states;
+
+    // file transfers: the number of them and the bytes transferred
+    //
+    double x = 0;
+    vector<PERS_FILE_XFER*>& pfxs = gstate.pers_file_xfers->pers_file_xfers;
+    for (i=0; i<pfxs.size(); i++) {
+        x += pfxs[i]->last_bytes_xferred;
+    }
+    bool xfer_change = (x != event_xfer_bytes || (int)pfxs.size() != event_nxfers);
+    event_xfer_bytes = x;
+    event_nxfers = (int)pfxs.size();
+
+    // the first time, just record the state
+    //
+    if (first) return;
+
+    for (i=0; i<gui_rpcs.size(); i++) {
+        GUI_RPC_CONN* gr = gui_rpcs[i];
+        if (!gr->subscribed) continue;
+        string s = events;
+        if (xfer_change) gr->transfer_event_pending = true;
+        if (gr->transfer_event_pending
+            && gstate.now >= gr->last_transfer_event_time + gr->transfer_event_interval
+        ) {
+            s += "<file_transfers/>\n";
+            gr->transfer_event_pending = false;
+            gr->last_transfer_event_time = gstate.now;
+        }
+        if (s.empty()) continue;
+        gr->send_event(s.c_str());
+    }
+}
+
 static void handle_get_all_projects_list(GUI_RPC_CONN& grc) {
     read_all_projects_list_file(grc);
 }
@@ -1268,6 +1631,7 @@ GUI_RPC gui_rpcs[] = {
     GUI_RPC("get_daily_xfer_history", handle_get_daily_xfer_history,
                                                                     false,  false,  true),
     GUI_RPC("get_file_transfers", handle_get_file_transfers,        false,  false,  true),
+    GUI_RPC("get_gpu_telemetry", handle_get_gpu_telemetry,          false,  false,  true),
     GUI_RPC("get_host_info", handle_get_host_info,                  false,  false,  true),
     GUI_RPC("get_messages", handle_get_messages,                    false,  false,  true),
     GUI_RPC("get_message_count", handle_get_message_count,          false,  false,  true),
@@ -1280,6 +1644,8 @@ GUI_RPC gui_rpcs[] = {
     GUI_RPC("get_simple_gui_info", handle_get_simple_gui_info,      false,  false,  true),
     GUI_RPC("get_state", handle_get_state,                          false,  false,  true),
     GUI_RPC("get_statistics", handle_get_statistics,                false,  false,  true),
+    GUI_RPC("subscribe", handle_subscribe,                          false,  false,  true),
+    GUI_RPC("unsubscribe", handle_unsubscribe,                      false,  false,  true),
 
     // ops requiring local auth start here
 
@@ -1415,24 +1781,47 @@ int GUI_RPC_CONN::handle_rpc() {
         }
         return 0;
     }
-    bool http_request;
-    if (complete_post_request(request_msg)) {
-        http_request = true;
-    } else {
-        p = strchr(request_msg, 3);
-        if (p) {
-            *p = 0;
-            http_request = false;
+
+    // A client may send several requests without waiting for the replies
+    // (we say so in the exchange_versions reply),
+    // so the buffer may have more than one; handle each complete one
+    //
+    while (request_nbytes) {
+        bool http_request;
+        int len;
+        if (complete_post_request(request_msg)) {
+            http_request = true;
+            len = request_nbytes;
         } else {
-            if (log_flags.gui_rpc_debug) {
-                msg_printf(0, MSG_INFO,
-                    "[gui_rpc] partial GUI RPC Command = '%s'\n", request_msg
-                );
+            p = strchr(request_msg, 3);
+            if (p) {
+                *p = 0;
+                http_request = false;
+                len = (int)(p - request_msg) + 1;
+            } else {
+                if (log_flags.gui_rpc_debug) {
+                    msg_printf(0, MSG_INFO,
+                        "[gui_rpc] partial GUI RPC Command = '%s'\n", request_msg
+                    );
+                }
+                return 0;
             }
-            return 0;
         }
+        retval = handle_request(http_request);
+        request_nbytes -= len;
+        memmove(request_msg, request_msg+len, request_nbytes);
+        request_msg[request_nbytes] = 0;
+        if (retval) return retval;
     }
-    request_nbytes = 0;
+    return 0;
+}
+
+// handle the request at the start of request_msg, and send the reply.
+// Return nonzero if we need to close the connection
+//
+int GUI_RPC_CONN::handle_request(bool http_request) {
+    int n, retval=0;
+    char* p;
 
     if (log_flags.gui_rpc_debug) {
         msg_printf(0, MSG_INFO,
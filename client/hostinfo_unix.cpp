@@ -1230,6 +1230,20 @@ int HOST_INFO::get_virtualbox_version() {
     }
 #endif
 
+    // Running VBoxManage can take a few seconds,
+    // so do it only if it's changed since last time
+    //
+    static char cached_version[256] = "";
+    static double cached_mtime = -1, cached_size = -1;
+    struct stat sbuf;
+    if (stat(path, &sbuf)) return 0;
+    if ((double)sbuf.st_mtime == cached_mtime
+        && (double)sbuf.st_size == cached_size
+    ) {
+        safe_strcpy(virtualbox_version, cached_version);
+        return 0;
+    }
+
     if (boinc_file_exists(path)) {
 #if LINUX_LIKE_SYSTEM
         if (access(path, X_OK)) {
@@ -1252,12 +1266,45 @@ int HOST_INFO::get_virtualbox_version() {
             }
             pclose(fd);
         }
+        safe_strcpy(cached_version, virtualbox_version);
+        cached_mtime = (double)sbuf.st_mtime;
+        cached_size = (double)sbuf.st_size;
     }
 
     return 0;
 }
 
 
+#if LINUX_LIKE_SYSTEM
+// /proc/cpuinfo doesn't change except when CPUs go on- or offline,
+// and it takes a while to parse on hosts with lots of CPUs.
+// get_host_info() is called before each scheduler RPC,
+// so parse it only the first time or if the number of CPUs changes.
+//
+static void get_cpuinfo_linux(HOST_INFO& host) {
+    static bool cached = false;
+    static long ncpus = 0;
+    static char vendor[256], model[256], features[1024];
+    static double cache;
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cached && n == ncpus) {
+        safe_strcpy(host.p_vendor, vendor);
+        safe_strcpy(host.p_model, model);
+        safe_strcpy(host.p_features, features);
+        host.m_cache = cache;
+        return;
+    }
+    parse_cpuinfo_linux(host);
+    safe_strcpy(vendor, host.p_vendor);
+    safe_strcpy(model, host.p_model);
+    safe_strcpy(features, host.p_features);
+    cache = host.m_cache;
+    ncpus = n;
+    cached = true;
+}
+#endif
+
 // Rules:
 // - Keep code in the right place
 // - only one level of #if
@@ -1273,7 +1320,7 @@ int HOST_INFO::get_host_info() {
 
 ///////////// p_vendor, p_model, p_features /////////////////
 #if LINUX_LIKE_SYSTEM
-    parse_cpuinfo_linux(*this);
+    get_cpuinfo_linux(*this);
 #elif defined( __APPLE__)
     int mib[2];
     size_t len;
@@ -54,12 +54,58 @@
 #include "net_stats.h"
 #include "project.h"
 
+#include "event_loop.h"
 #include "http_curl.h"
 
 using std::min;
 using std::vector;
 
 static CURLM* g_curlMulti = NULL;
+
+// Connections are cached in the multi handle, so transfers to the
+// same server reuse them.  The share handle adds a common DNS cache
+// and SSL session cache, so a new connection to a server we've
+// talked to recently skips the full TLS handshake.
+// We use libcurl from one thread only, so no locking is needed.
+//
+static CURLSH* g_curlShare = NULL;
+
+// If we have epoll or kqueue, use curl's socket API:
+// curl tells us (via handle_curl_socket()) which sockets to watch
+// and (via handle_curl_timer()) when to call it if nothing happens,
+// and we call curl_multi_socket_action() only for ready sockets.
+// Otherwise use curl_multi_fdset() and select().
+//
+#if defined(USE_EVENT_LOOP) && LIBCURL_VERSION_NUM >= 0x071000
+#define USE_CURL_SOCKETS
+static EVENT_LOOP curl_event_loop;
+static bool use_curl_sockets = false;
+static double curl_timeout_time = 0;
+    // when curl wants to be called; 0 if no timeout pending
+
+static int handle_curl_socket(
+    CURL*, curl_socket_t s, int what, void*, void* socketp
+) {
+    int old_events = (int)(long)socketp;
+    int events = 0;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) events |= EVENT_READ;
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) events |= EVENT_WRITE;
+    curl_event_loop.watch(s, events, old_events);
+    if (what != CURL_POLL_REMOVE) {
+        curl_multi_assign(g_curlMulti, s, (void*)(long)events);
+    }
+    return 0;
+}
+
+static int handle_curl_timer(CURLM*, long timeout_ms, void*) {
+    if (timeout_ms < 0) {
+        curl_timeout_time = 0;
+    } else {
+        curl_timeout_time = dtime() + timeout_ms/1000.;
+    }
+    return 0;
+}
+#endif
 static char g_user_agent_string[256] = {""};
 static const char g_content_type[] = {"Content-Type: application/x-www-form-urlencoded"};
 static unsigned int g_trace_count = 0;
@@ -72,12 +118,49 @@ char* get_user_agent_string() {
     return (char*)&g_user_agent_string;
 }
 
+// seek to a file offset that may be more than 2GB
+//
+static int seek_file(FILE* f, double offset) {
+#ifdef _WIN32
+    return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// write part of a range request (see init_get_range()).
+// Write only a 206 response (i.e. one that honors the range);
+// if the server sent something else, discard it
+// and let the caller look at the response code.
+//
+static size_t write_range(void *ptr, size_t n, HTTP_OP* phop) {
+    long code = 0;
+    curl_easy_getinfo(phop->curlEasy, CURLINFO_RESPONSE_CODE, &code);
+    if (code != HTTP_STATUS_PARTIAL_CONTENT) return n;
+    double left = phop->range_end - phop->bytes_xferred;
+    size_t m = n;
+    if (left < (double)m) m = (left > 0)?(size_t)left:0;
+    size_t stWrite = fwrite(ptr, 1, m, phop->fileOut);
+    phop->bytes_xferred += (double)(stWrite);
+    phop->update_speed();
+    daily_xfer_history.add(stWrite, false);
+    return (stWrite == m)?n:stWrite;
+}
+
 size_t libcurl_write(void *ptr, size_t size, size_t nmemb, HTTP_OP* phop) {
+    if (phop->range_end > 0) {
+        return write_range(ptr, size*nmemb, phop);
+    }
+
     // take the stream param as a FILE* and write to disk
     // TODO: maybe assert stRead == size*nmemb,
     // add exception handling on phop members
     //
     size_t stWrite = fwrite(ptr, size, nmemb, phop->fileOut);
+    if (phop->hash_download) {
+        phop->download_md5.append((const unsigned char*)ptr, (int)stWrite);
+        phop->hashed_nbytes += (double)stWrite;
+    }
     if (log_flags.http_xfer_debug) {
         msg_printf(NULL, MSG_INFO,
             "[http_xfer] [ID#%d] HTTP: wrote %d bytes", phop->trace_id, (int)stWrite
@@ -239,6 +322,9 @@ void HTTP_OP::reset() {
     connect_error = 0;
     bytes_xferred = 0;
     bSentHeader = false;
+    hash_download = false;
+    hashed_nbytes = 0;
+    range_end = 0;
     project = 0;
     close_socket();
 }
@@ -296,6 +382,30 @@ int HTTP_OP::init_get(
     return HTTP_OP::libcurl_exec(url, NULL, out, off, size, false);
 }
 
+// Initialize HTTP GET of bytes [start, end) of a file,
+// written at the same offset in the (existing) output file.
+// Used for segmented downloads.
+//
+int HTTP_OP::init_get_range(
+    PROJECT* p, const char* url, const char* out, double start, double end
+) {
+    req1 = NULL;
+    file_offset = start;
+    HTTP_OP::init(p);
+    range_end = end;
+    bytes_xferred = start;
+    start_bytes_xferred = start;
+    http_op_type = HTTP_OP_GET;
+    http_op_state = HTTP_STATE_CONNECTING;
+    if (log_flags.http_debug) {
+        msg_printf(project, MSG_INFO,
+            "[http] HTTP_OP::init_get_range(): %s bytes %.0f-%.0f",
+            url, start, end-1
+        );
+    }
+    return HTTP_OP::libcurl_exec(url, NULL, out, start, end-start, false);
+}
+
 // Initialize HTTP POST operation where
 // the input is a file, and the output is a file,
 // and both are read/written from the beginning (no resumption of partial ops)
@@ -559,6 +669,23 @@ int HTTP_OP::libcurl_exec(
     //
     if (config.http_1_0 || (config.force_auth == "ntlm")) {
         curl_easy_setopt(curlEasy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+    } else {
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        // use HTTP/2 for https: URLs if the server supports it,
+        // so that concurrent transfers to a project's server
+        // are multiplexed over one connection
+        //
+        curl_easy_setopt(curlEasy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        // if a connection to the server is being set up,
+        // wait to see if it can be multiplexed rather than opening another
+        //
+        curl_easy_setopt(curlEasy, CURLOPT_PIPEWAIT, 1L);
+#endif
+    }
+    if (g_curlShare) {
+        curl_easy_setopt(curlEasy, CURLOPT_SHARE, g_curlShare);
     }
     curl_easy_setopt(curlEasy, CURLOPT_MAXREDIRS, 50L);
     curl_easy_setopt(curlEasy, CURLOPT_AUTOREFERER, 1L);
@@ -572,7 +699,9 @@ int HTTP_OP::libcurl_exec(
     //
     // Per: http://curl.haxx.se/dev/readme-encoding.html
     // NULL disables, empty string accepts all.
-    if (out) {
+    if (range_end > 0) {
+        curl_easy_setopt(curlEasy, CURLOPT_ENCODING, NULL);
+    } else if (out) {
         if (ends_with(out, ".gzt")) {
             curl_easy_setopt(curlEasy, CURLOPT_ENCODING, NULL);
         } else if (!ends_with(out, ".gz")) {
@@ -593,7 +722,10 @@ int HTTP_OP::libcurl_exec(
 
     // set the file offset for resumable downloads
     //
-    if (!is_post && offset>0.0f) {
+    if (!is_post && range_end > 0) {
+        sprintf(strTmp, "Range: bytes=%.0f-%.0f", offset, range_end-1);
+        pcurlList = curl_slist_append(pcurlList, strTmp);
+    } else if (!is_post && offset>0.0f) {
         file_offset = offset;
         sprintf(strTmp, "Range: bytes=%.0f-", offset);
         pcurlList = curl_slist_append(pcurlList, strTmp);
@@ -602,7 +734,13 @@ int HTTP_OP::libcurl_exec(
     // set up an output file for the reply
     //
     if (strlen(outfile)) {
-        if (file_offset > 0) {
+        if (range_end > 0) {
+            fileOut = boinc_fopen(outfile, "r+b");
+            if (fileOut && seek_file(fileOut, file_offset)) {
+                fclose(fileOut);
+                fileOut = NULL;
+            }
+        } else if (file_offset > 0) {
             fileOut = boinc_fopen(outfile, "ab+");
         } else {
 #ifdef _WIN32
@@ -889,13 +1027,34 @@ fd_set read_fds, write_fds, error_fds;
 int curl_init() {
     curl_global_init(CURL_GLOBAL_ALL);
     g_curlMulti = curl_multi_init();
-    return (int)(g_curlMulti == NULL);
+    if (!g_curlMulti) return 1;
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_multi_setopt(g_curlMulti, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    g_curlShare = curl_share_init();
+    if (g_curlShare) {
+        curl_share_setopt(g_curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+        curl_share_setopt(g_curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#endif
+    }
+#ifdef USE_CURL_SOCKETS
+    if (!curl_event_loop.init()) {
+        curl_multi_setopt(g_curlMulti, CURLMOPT_SOCKETFUNCTION, handle_curl_socket);
+        curl_multi_setopt(g_curlMulti, CURLMOPT_TIMERFUNCTION, handle_curl_timer);
+        use_curl_sockets = true;
+    }
+#endif
+    return 0;
 }
 
 int curl_cleanup() {
     if (g_curlMulti) {
         curl_multi_cleanup(g_curlMulti);
     }
+    if (g_curlShare) {
+        curl_share_cleanup(g_curlShare);
+    }
     curl_global_cleanup();
     return 0;
 }
@@ -935,6 +1094,14 @@ void HTTP_OP::close_file() {
 }
 
 void HTTP_OP_SET::get_fdset(FDSET_GROUP& fg) {
+#ifdef USE_CURL_SOCKETS
+    if (use_curl_sockets) {
+        int fd = curl_event_loop.fd;
+        FD_SET(fd, &fg.read_fds);
+        if (fd > fg.max_fd) fg.max_fd = fd;
+        return;
+    }
+#endif
     curl_multi_fdset(
         g_curlMulti, &fg.read_fds, &fg.write_fds, &fg.exc_fds, &fg.max_fd
     );
@@ -1081,7 +1248,18 @@ void HTTP_OP::handle_messages(CURLMsg *pcurlMsg) {
     }
 }
 
-void HTTP_OP_SET::got_select(FDSET_GROUP&, double timeout) {
+double HTTP_OP_SET::max_select_timeout(double x) {
+#ifdef USE_CURL_SOCKETS
+    if (use_curl_sockets && curl_timeout_time) {
+        double t = curl_timeout_time - dtime();
+        if (t < 0) t = 0;
+        if (t < x) x = t;
+    }
+#endif
+    return x;
+}
+
+void HTTP_OP_SET::got_select(FDSET_GROUP& fg, double timeout) {
     int iNumMsg;
     HTTP_OP* hop = NULL;
     CURLMsg *pcurlMsg = NULL;
@@ -1089,6 +1267,30 @@ void HTTP_OP_SET::got_select(FDSET_GROUP&, double timeout) {
     int iRunning = 0;  // curl flags for max # of fds & # running queries
     CURLMcode curlMErr;
 
+#ifdef USE_CURL_SOCKETS
+    if (use_curl_sockets) {
+        // tell curl about ready sockets, and expired timeouts
+        //
+        EVENT_LOOP_EVENT events[64];
+        if (FD_ISSET(curl_event_loop.fd, &fg.read_fds)) {
+            int n = curl_event_loop.get_events(events, 64);
+            for (int i=0; i<n; i++) {
+                int mask = 0;
+                if (events[i].events & EVENT_READ) mask |= CURL_CSELECT_IN;
+                if (events[i].events & EVENT_WRITE) mask |= CURL_CSELECT_OUT;
+                curl_multi_socket_action(
+                    g_curlMulti, events[i].sock, mask, &iRunning
+                );
+            }
+        }
+        if (curl_timeout_time && dtime() >= curl_timeout_time) {
+            curl_timeout_time = 0;
+            curl_multi_socket_action(
+                g_curlMulti, CURL_SOCKET_TIMEOUT, 0, &iRunning
+            );
+        }
+    } else
+#endif
     // get the data waiting for transfer in or out
     // use timeout value so that we don't hog CPU in this loop
     //
@@ -26,6 +26,7 @@
 
 #include <curl/curl.h>
 
+#include "md5_file.h"
 #include "network.h"
 #include "proxy_info.h"
 
@@ -89,6 +90,9 @@ public:
         // then (is nonempty) this file
     double file_offset;
         // starting at this offset
+    double range_end;
+        // if nonzero, a GET of bytes [file_offset, range_end)
+        // written in place into the existing outfile
 
     // reply message stuff
     //
@@ -131,6 +135,10 @@ public:
     double xfer_speed;
         // tranfer rate based on elapsed time and bytes_xferred
         // (hence doesn't reflect compression; used only for GUI)
+    bool hash_download;
+        // compute the MD5 of the downloaded data as it arrives
+    MD5_STATE download_md5;
+    double hashed_nbytes;
     int http_op_state;      // values above
     int http_op_type;
         // HTTP_OP_* (see above)
@@ -160,6 +168,10 @@ public:
         PROJECT*, const char* url, const char* outfile,
         bool del_old_file, double offset, double size
     );
+    int init_get_range(
+        PROJECT*, const char* url, const char* outfile,
+        double start, double end
+    );
     int init_post(
         PROJECT*, const char* url, const char* infile, const char* outfile
     );
@@ -200,6 +212,9 @@ public:
 
     void get_fdset(FDSET_GROUP&);
     void got_select(FDSET_GROUP&, double);
+    double max_select_timeout(double);
+        // with the event loop, the longest we can wait
+        // before curl needs attention
     HTTP_OP* lookup_curl(CURL* pcurl);
         // lookup by easycurl handle
     void cleanup_temp_files();
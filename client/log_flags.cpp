@@ -159,6 +159,9 @@ void CONFIG::show() {
     if (no_gpus) {
         msg_printf(NULL, MSG_INFO, "Config: don't use coprocessors");
     }
+    if (no_gpu_telemetry) {
+        msg_printf(NULL, MSG_INFO, "Config: don't read GPU status");
+    }
     if (no_info_fetch) {
         msg_printf(NULL, MSG_INFO, "Config: don't fetch project list or client version info");
     }
@@ -174,6 +177,9 @@ void CONFIG::show() {
     if (fetch_minimal_work) {
         msg_printf(NULL, MSG_INFO, "Config: fetch minimal work");
     }
+    if (fetch_hysteresis) {
+        msg_printf(NULL, MSG_INFO, "Config: fetch work with hysteresis");
+    }
     if (max_event_log_lines != DEFAULT_MAX_EVENT_LOG_LINES) {
         if (max_event_log_lines) {
             msg_printf(NULL, MSG_INFO,
@@ -225,6 +231,27 @@ void CONFIG::show() {
         }
         fclose(f);
     }
+    if (use_cgroups) {
+        msg_printf(NULL, MSG_INFO,
+            "Config: use cgroups to control tasks"
+        );
+    }
+    if (max_mem_heavy_tasks_per_node) {
+        msg_printf(NULL, MSG_INFO,
+            "Config: run at most %d memory-heavy tasks per NUMA node",
+            max_mem_heavy_tasks_per_node
+        );
+    }
+    if (perf_counters) {
+        msg_printf(NULL, MSG_INFO,
+            "Config: count hardware events of tasks"
+        );
+    }
+    if (task_affinity) {
+        msg_printf(NULL, MSG_INFO,
+            "Config: place tasks on CPUs"
+        );
+    }
     if (vbox_window) {
         msg_printf(NULL, MSG_INFO,
             "Config: open console window for VirtualBox applications"
@@ -350,6 +377,7 @@ int CONFIG::parse_options_client(XML_PARSER& xp) {
             }
             continue;
         }
+        if (xp.parse_bool("fetch_hysteresis", fetch_hysteresis)) continue;
         if (xp.parse_bool("fetch_minimal_work", fetch_minimal_work)) continue;
         if (xp.parse_bool("fetch_on_update", fetch_on_update)) continue;
         if (xp.parse_string("force_auth", force_auth)) {
@@ -372,10 +400,13 @@ int CONFIG::parse_options_client(XML_PARSER& xp) {
             continue;
         }
         if (xp.parse_int("max_event_log_lines", max_event_log_lines)) continue;
+        if (xp.parse_int("max_download_segments", max_download_segments)) continue;
         if (xp.parse_int("max_file_xfers", max_file_xfers)) continue;
         if (xp.parse_int("max_file_xfers_per_project", max_file_xfers_per_project)) continue;
         if (xp.parse_int("max_stderr_file_size", max_stderr_file_size)) continue;
         if (xp.parse_int("max_stdout_file_size", max_stdout_file_size)) continue;
+        if (xp.parse_int("max_mem_heavy_tasks_per_node", max_mem_heavy_tasks_per_node)) continue;
+        if (xp.parse_int("max_sched_rpcs", max_sched_rpcs)) continue;
         if (xp.parse_int("max_tasks_reported", max_tasks_reported)) continue;
         if (xp.parse_int("ncpus", ncpus)) continue;
         if (xp.parse_string("network_test_url", network_test_url)) {
@@ -383,10 +414,14 @@ int CONFIG::parse_options_client(XML_PARSER& xp) {
             continue;
         }
         if (xp.parse_bool("no_alt_platform", no_alt_platform)) continue;
+        if (xp.parse_bool("no_async_file_thread", no_async_file_thread)) continue;
         if (xp.parse_bool("no_gpus", no_gpus)) continue;
+        if (xp.parse_bool("no_gpu_telemetry", no_gpu_telemetry)) continue;
         if (xp.parse_bool("no_info_fetch", no_info_fetch)) continue;
         if (xp.parse_bool("no_priority_change", no_priority_change)) continue;
+        if (xp.parse_bool("no_restart_throttle", no_restart_throttle)) continue;
         if (xp.parse_bool("os_random_only", os_random_only)) continue;
+        if (xp.parse_bool("perf_counters", perf_counters)) continue;
 #ifndef SIM
         if (xp.match_tag("proxy_info")) {
             retval = proxy_info.parse_config(xp);
@@ -409,12 +444,15 @@ int CONFIG::parse_options_client(XML_PARSER& xp) {
         if (xp.parse_bool("simple_gui_only", simple_gui_only)) continue;
         if (xp.parse_bool("skip_cpu_benchmarks", skip_cpu_benchmarks)) continue;
         if (xp.parse_double("start_delay", start_delay)) continue;
+        if (xp.parse_int("state_file_write_interval", state_file_write_interval)) continue;
         if (xp.parse_bool("stderr_head", stderr_head)) continue;
         if (xp.parse_bool("suppress_net_info", suppress_net_info)) continue;
+        if (xp.parse_bool("task_affinity", task_affinity)) continue;
         if (xp.parse_bool("unsigned_apps_ok", unsigned_apps_ok)) continue;
         if (xp.parse_bool("use_all_gpus", use_all_gpus)) continue;
         if (xp.parse_bool("use_certs", use_certs)) continue;
         if (xp.parse_bool("use_certs_only", use_certs_only)) continue;
+        if (xp.parse_bool("use_cgroups", use_cgroups)) continue;
         if (xp.parse_bool("vbox_window", vbox_window)) continue;
 
         msg_printf_notice(NULL, false,
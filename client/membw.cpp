@@ -0,0 +1,86 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Memory bandwidth benchmark: the STREAM "triad" kernel a = b + s*c
+// on arrays that are too big to fit in cache.
+// Like the other benchmarks it runs on all CPUs at once,
+// so the result is roughly each CPU's share of the memory bandwidth.
+
+#include "cpp.h"
+
+#ifdef _WIN32
+#include "boinc_win.h"
+#else
+#include "config.h"
+#include <stdlib.h>
+#endif
+
+#include "util.h"
+#include "cpu_benchmark.h"
+
+#define MEMBW_ARRAY_SIZE    (1<<20)
+    // doubles per array; 3 arrays, so 24 MB per CPU
+
+volatile double membw_sink;
+    // keep the compiler from optimizing the loop away
+
+// return an error if CPU time is less than min_cpu_time
+//
+int mem_bandwidth(double& bw, double& cpu_time, double min_cpu_time) {
+    double startsec, finisec, s = 3;
+    double npasses = 0;
+    int i;
+
+    double* a = (double*)malloc(3*MEMBW_ARRAY_SIZE*sizeof(double));
+    benchmark_wait_to_start(BM_TYPE_MEM);
+    if (!a) {
+        while (!benchmark_time_to_stop(BM_TYPE_MEM)) {
+            boinc_sleep(0.1);
+        }
+        cpu_time = 0;
+        return -1;
+    }
+    double* b = a + MEMBW_ARRAY_SIZE;
+    double* c = b + MEMBW_ARRAY_SIZE;
+    for (i=0; i<MEMBW_ARRAY_SIZE; i++) {
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
+    }
+
+    boinc_calling_thread_cpu_time(startsec);
+    do {
+        for (i=0; i<MEMBW_ARRAY_SIZE; i++) {
+            a[i] = b[i] + s*c[i];
+        }
+        npasses++;
+    } while (!benchmark_time_to_stop(BM_TYPE_MEM));
+    boinc_calling_thread_cpu_time(finisec);
+
+    membw_sink = a[MEMBW_ARRAY_SIZE/2];
+    free(a);
+
+    cpu_time = finisec - startsec;
+    if (cpu_time < min_cpu_time) {
+        return -1;
+    }
+
+    // each element reads b and c and writes a
+    //
+    bw = npasses*3*MEMBW_ARRAY_SIZE*sizeof(double)/cpu_time;
+    return 0;
+}
@@ -0,0 +1,139 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+#include "boinc_win.h"
+#else
+#include "config.h"
+#include <cstring>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "error_numbers.h"
+
+#include "perf_counters.h"
+
+void PERF_COUNTS::write(MIOFILE& out, bool gui) {
+    if (!nonzero()) return;
+    out.printf(
+        "    <perf_cycles>%f</perf_cycles>\n"
+        "    <perf_instructions>%f</perf_instructions>\n"
+        "    <perf_llc_misses>%f</perf_llc_misses>\n",
+        cycles, instructions, llc_misses
+    );
+    if (gui) {
+        out.printf(
+            "    <perf_mem_bytes>%f</perf_mem_bytes>\n", mem_bytes()
+        );
+    }
+}
+
+bool PERF_COUNTS::parse(XML_PARSER& xp) {
+    if (xp.parse_double("perf_cycles", cycles)) return true;
+    if (xp.parse_double("perf_instructions", instructions)) return true;
+    if (xp.parse_double("perf_llc_misses", llc_misses)) return true;
+    return false;
+}
+
+PERF_COUNTERS::PERF_COUNTERS() {
+    for (int i=0; i<PERF_NCOUNTERS; i++) {
+        fds[i] = -1;
+    }
+}
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+// in the order of PERF_COUNTS
+//
+static const unsigned long long perf_events[PERF_NCOUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+// The counters are in one group, so they're scheduled together.
+// They're read separately: inherited counters can't be read as a group.
+//
+int PERF_COUNTERS::open(int pid) {
+    close();
+    for (int i=0; i<PERF_NCOUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = perf_events[i];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[i] = (int)syscall(
+            __NR_perf_event_open, &attr, pid, -1, i?fds[0]:-1,
+            PERF_FLAG_FD_CLOEXEC
+        );
+        if (fds[0] < 0) return ERR_OPEN;
+
+        // some counters (e.g. LLC misses in VMs) may not exist
+    }
+    return 0;
+}
+
+// the count, scaled up if the counter was multiplexed
+//
+static double read_counter(int fd) {
+    unsigned long long v[3];
+    if (fd < 0) return 0;
+    if (::read(fd, v, sizeof(v)) != sizeof(v)) return 0;
+    if (!v[2]) return 0;
+    if (v[2] < v[1]) return (double)v[0]*v[1]/v[2];
+    return (double)v[0];
+}
+
+void PERF_COUNTERS::read(PERF_COUNTS& pc) {
+    pc = base;
+    pc.cycles += read_counter(fds[0]);
+    pc.instructions += read_counter(fds[1]);
+    pc.llc_misses += read_counter(fds[2]);
+}
+
+void PERF_COUNTERS::close() {
+    if (fds[0] < 0) return;
+    read(base);
+    for (int i=PERF_NCOUNTERS-1; i>=0; i--) {
+        if (fds[i] >= 0) ::close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+#else
+
+int PERF_COUNTERS::open(int) {
+    return ERR_NOT_IMPLEMENTED;
+}
+
+void PERF_COUNTERS::read(PERF_COUNTS& pc) {
+    pc = base;
+}
+
+void PERF_COUNTERS::close() {
+}
+
+#endif
@@ -0,0 +1,82 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Hardware performance counters of tasks (Linux perf_event),
+// enabled by <perf_counters> in cc_config.xml.
+// Counts are user-mode only, and cover the task's processes
+// and the processes they start.
+
+#ifndef _PERF_COUNTERS_
+#define _PERF_COUNTERS_
+
+#include "miofile.h"
+#include "parse.h"
+
+// the counts for a task, summed over its runs
+//
+struct PERF_COUNTS {
+    double cycles;
+    double instructions;
+    double llc_misses;
+        // last-level cache misses
+
+    PERF_COUNTS() {
+        clear();
+    }
+    void clear() {
+        cycles = 0;
+        instructions = 0;
+        llc_misses = 0;
+    }
+    inline bool nonzero() {
+        return cycles || instructions || llc_misses;
+    }
+    inline double mem_bytes() {
+        // estimated memory traffic: a cache line per LLC miss
+        return llc_misses*64;
+    }
+    void write(MIOFILE&, bool gui=false);
+    bool parse(XML_PARSER&);
+        // return true if the tag was one of ours
+};
+
+#define PERF_NCOUNTERS  3
+
+// the counters of a running task
+//
+struct PERF_COUNTERS {
+    int fds[PERF_NCOUNTERS];
+    PERF_COUNTS base;
+        // counts from previous runs
+
+    PERF_COUNTERS();
+    ~PERF_COUNTERS() {
+        close();
+    }
+    int open(int pid);
+        // start counting the process (and its future children)
+    void read(PERF_COUNTS&);
+        // base plus the current counts
+    void close();
+        // stop counting; the counts so far are added to base
+
+private:
+    PERF_COUNTERS(const PERF_COUNTERS&);
+    PERF_COUNTERS& operator=(const PERF_COUNTERS&);
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "boinc_win.h"
 #else
 #include "config.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #endif
@@ -38,6 +39,7 @@
 #include "file_names.h"
 #include "log_flags.h"
 #include "project.h"
+#include "result.h"
 
 using std::vector;
 
@@ -52,6 +54,10 @@ PERS_FILE_XFER::PERS_FILE_XFER() {
     pers_xfer_done = false;
     fxp = NULL;
     fip = NULL;
+    unblocks_idle = false;
+    deadline = 0;
+    start_order = 0;
+    bw_weight = 1;
 }
 
 PERS_FILE_XFER::~PERS_FILE_XFER() {
@@ -79,12 +85,56 @@ int PERS_FILE_XFER::start_xfer() {
         if (gstate.exit_before_upload) {
             exit(0);
         }
+        vector<FILE_XFER*> batch;
+        get_upload_batch(batch);
+        if (batch.size()) {
+            return fxp->init_multi_upload(*fip, batch);
+        }
         return fxp->init_upload(*fip);
     } else {
         return fxp->init_download(*fip);
     }
 }
 
+// If this is a small upload, find other small uploads
+// to the same upload handler that are ready to start,
+// and create FILE_XFERs for them, to be sent in the same request.
+//
+void PERS_FILE_XFER::get_upload_batch(vector<FILE_XFER*>& batch) {
+    char path[256];
+    double size;
+    unsigned int i;
+
+    if (fip->project->no_multi_upload) return;
+    if (fip->nbytes >= FILE_SIZE_CHECK_THRESHOLD) return;
+    get_pathname(fip, path, sizeof(path));
+    if (file_size(path, size) || size != fip->nbytes) return;
+    const char* url = fip->upload_urls.get_current_url(*fip);
+    if (!url) return;
+
+    vector<PERS_FILE_XFER*>& pfxs = gstate.pers_file_xfers->pers_file_xfers;
+    for (i=0; i<pfxs.size(); i++) {
+        if (batch.size() >= MAX_UPLOAD_BATCH-1) break;
+        PERS_FILE_XFER* pfx = pfxs[i];
+        if (pfx == this || !pfx->is_upload) continue;
+        if (pfx->fxp || pfx->pers_xfer_done) continue;
+        if (gstate.now < pfx->next_request_time) continue;
+        FILE_INFO* fip2 = pfx->fip;
+        if (fip2->project != fip->project) continue;
+        if (fip2->nbytes >= FILE_SIZE_CHECK_THRESHOLD) continue;
+        const char* url2 = fip2->upload_urls.get_current_url(*fip2);
+        if (!url2 || strcmp(url, url2)) continue;
+        get_pathname(fip2, path, sizeof(path));
+        if (file_size(path, size) || size != fip2->nbytes) continue;
+
+        FILE_XFER* fxp2 = new FILE_XFER;
+        fxp2->fip = fip2;
+        pfx->fxp = fxp2;
+        pfx->last_time = gstate.now;
+        batch.push_back(fxp2);
+    }
+}
+
 // Possibly create and start a file transfer
 //
 int PERS_FILE_XFER::create_xfer() {
@@ -102,6 +152,7 @@ int PERS_FILE_XFER::create_xfer() {
             retval = fip->set_permissions();
             fip->status = FILE_PRESENT;
             pers_xfer_done = true;
+            gstate.set_poll_flags();
 
             if (log_flags.file_xfer) {
                 msg_printf(
@@ -113,6 +164,7 @@ int PERS_FILE_XFER::create_xfer() {
             return 0;
         } else if (retval == ERR_IN_PROGRESS) {
             pers_xfer_done = true;
+            gstate.set_poll_flags();
             return ERR_IN_PROGRESS;
         } else {
             // Mark file as not present but don't delete it.
@@ -146,6 +198,7 @@ int PERS_FILE_XFER::create_xfer() {
         }
 
         fxp->file_xfer_retval = retval;
+        fxp->cancel_batch();
         if (retval == ERR_HTTP_PERMANENT) {
             permanent_failure(retval);
         } else {
@@ -161,6 +214,16 @@ int PERS_FILE_XFER::create_xfer() {
             (is_upload ? "upload" : "download"), fip->name
         );
     }
+    for (unsigned int i=0; i<fxp->batch.size(); i++) {
+        FILE_XFER* fxp2 = fxp->batch[i];
+        gstate.file_xfers->insert(fxp2);
+        if (log_flags.file_xfer) {
+            msg_printf(
+                fip->project, MSG_INFO, "Started upload of %s (with %s)",
+                fxp2->fip->name, fip->name
+            );
+        }
+    }
     if (log_flags.file_xfer_debug) {
         msg_printf(fip->project, MSG_INFO,
             "[file_xfer] URL: %s\n",
@@ -209,7 +272,11 @@ bool PERS_FILE_XFER::poll() {
 
     // copy bytes_xferred for use in GUI
     //
-    last_bytes_xferred = fxp->bytes_xferred;
+    if (fxp->segmented) {
+        last_bytes_xferred = fxp->segments_bytes_xferred();
+    } else {
+        last_bytes_xferred = fxp->bytes_xferred;
+    }
     if (is_upload) {
         last_bytes_xferred += fxp->file_offset;
     }
@@ -249,6 +316,7 @@ bool PERS_FILE_XFER::poll() {
                 }
             }
             pers_xfer_done = true;
+            gstate.set_poll_flags();
             break;
         case ERR_UPLOAD_PERMANENT:
             permanent_failure(fxp->file_xfer_retval);
@@ -312,6 +380,7 @@ void PERS_FILE_XFER::permanent_failure(int retval) {
     fxp = NULL;
     fip->status = retval;
     pers_xfer_done = true;
+    gstate.set_poll_flags();
     if (log_flags.file_xfer) {
         msg_printf(
             fip->project, MSG_INFO, "Giving up on %s of %s: %s",
@@ -389,6 +458,7 @@ void PERS_FILE_XFER::abort() {
     fip->status = ERR_ABORTED_VIA_GUI;
     fip->error_msg = "user requested transfer abort";
     pers_xfer_done = true;
+    gstate.set_poll_flags();
 }
 
 // Parse XML information about a persistent file transfer
@@ -420,6 +490,12 @@ int PERS_FILE_XFER::parse(XML_PARSER& xp) {
 
 // Write XML information about a persistent file transfer
 //
+// called before the state file is written
+//
+void PERS_FILE_XFER::checkpoint_md5() {
+    if (fxp && !is_upload) fxp->checkpoint_md5();
+}
+
 int PERS_FILE_XFER::write(MIOFILE& fout) {
     fout.printf(
         "    <persistent_file_xfer>\n"
@@ -474,8 +550,98 @@ PERS_FILE_XFER_SET::PERS_FILE_XFER_SET(FILE_XFER_SET* p) {
     file_xfers = p;
 }
 
+// note that the given job depends on a transfer
+//
+static void note_job(PERS_FILE_XFER* pfx, RESULT* rp, bool idle) {
+    if (!pfx || pfx->pers_xfer_done) return;
+    if (!pfx->deadline || rp->report_deadline < pfx->deadline) {
+        pfx->deadline = rp->report_deadline;
+    }
+    if (pfx->is_upload) return;
+    if (!pfx->start_order || rp->received_time < pfx->start_order) {
+        pfx->start_order = rp->received_time;
+    }
+    if (idle) pfx->unblocks_idle = true;
+}
+
+// the order in which to start transfers:
+// - downloads that let an idle resource start a job
+// - earlier deadline of the jobs that need the file
+// - for downloads, jobs received earlier (they'll start first)
+// - partly-done transfers
+//
+static bool xfer_before(PERS_FILE_XFER* a, PERS_FILE_XFER* b) {
+    if (a->unblocks_idle != b->unblocks_idle) return a->unblocks_idle;
+    if (a->deadline != b->deadline) {
+        if (!b->deadline) return true;
+        if (!a->deadline) return false;
+        return a->deadline < b->deadline;
+    }
+    if (a->start_order != b->start_order) {
+        if (!b->start_order) return true;
+        if (!a->start_order) return false;
+        return a->start_order < b->start_order;
+    }
+    return a->last_bytes_xferred && !b->last_bytes_xferred;
+}
+
+// Find the jobs that depend on each transfer,
+// sort the transfers into the order in which to start them,
+// and give each a bandwidth weight by rank
+// (uploads and downloads separately; both are rate-limited separately).
+// If the weights change, redo the bandwidth limits.
+//
+void PERS_FILE_XFER_SET::set_priorities() {
+    unsigned int i, j;
+    PERS_FILE_XFER* pfx;
+
+    for (i=0; i<pers_file_xfers.size(); i++) {
+        pfx = pers_file_xfers[i];
+        pfx->unblocks_idle = false;
+        pfx->deadline = 0;
+        pfx->start_order = 0;
+    }
+    for (i=0; i<gstate.results.size(); i++) {
+        RESULT* rp = gstate.results[i];
+        if (rp->state() < RESULT_FILES_DOWNLOADED) {
+            bool idle = rsc_work_fetch[rp->resource_type()].nidle_now > 0;
+            for (j=0; j<rp->wup->input_files.size(); j++) {
+                note_job(rp->wup->input_files[j].file_info->pers_file_xfer, rp, idle);
+            }
+            for (j=0; j<rp->avp->app_files.size(); j++) {
+                note_job(rp->avp->app_files[j].file_info->pers_file_xfer, rp, idle);
+            }
+        } else {
+            for (j=0; j<rp->output_files.size(); j++) {
+                note_job(rp->output_files[j].file_info->pers_file_xfer, rp, false);
+            }
+        }
+    }
+
+    std::stable_sort(pers_file_xfers.begin(), pers_file_xfers.end(), xfer_before);
+
+    int nup = 0, ndown = 0;
+    for (i=0; i<pers_file_xfers.size(); i++) {
+        pers_file_xfers[i]->is_upload?nup++:ndown++;
+    }
+    bool up_changed = false, down_changed = false;
+    for (i=0; i<pers_file_xfers.size(); i++) {
+        pfx = pers_file_xfers[i];
+        double w = pfx->is_upload?nup--:ndown--;
+        if (w == pfx->bw_weight) continue;
+        pfx->bw_weight = w;
+        if (pfx->fxp) {
+            pfx->is_upload?up_changed=true:down_changed=true;
+        }
+    }
+    if (up_changed) file_xfers->set_bandwidth_limits(true);
+    if (down_changed) file_xfers->set_bandwidth_limits(false);
+}
+
 // Run through the set, starting any transfers that need to be
-// started and deleting any that have finished
+// started and deleting any that have finished.
+// Transfers are started in priority order (see above),
+// so they get the slots allowed by max_file_xfers first.
 //
 bool PERS_FILE_XFER_SET::poll() {
     unsigned int i;
@@ -485,18 +651,13 @@ bool PERS_FILE_XFER_SET::poll() {
     if (!gstate.clock_change && gstate.now - last_time < PERS_FILE_XFER_POLL_PERIOD) return false;
     last_time = gstate.now;
 
-    // try to finish ones we've already started
-    //
-    for (i=0; i<pers_file_xfers.size(); i++) {
-        if (!pers_file_xfers[i]->last_bytes_xferred) continue;
-        action |= pers_file_xfers[i]->poll();
-    }
+    set_priorities();
+
     for (i=0; i<pers_file_xfers.size(); i++) {
-        if (pers_file_xfers[i]->last_bytes_xferred) continue;
         action |= pers_file_xfers[i]->poll();
     }
 
-    if (action) gstate.set_client_state_dirty("pers_file_xfer_set poll");
+    if (action) gstate.set_client_state_dirty("pers_file_xfer_set poll", true);
 
     return action;
 }
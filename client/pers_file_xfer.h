@@ -103,6 +103,17 @@ public:
         // nonzero if file xfer in progress
     FILE_INFO* fip;
 
+    // transfer scheduling; see PERS_FILE_XFER_SET::set_priorities()
+    //
+    bool unblocks_idle;
+        // a download needed by a job whose processing resource is idle
+    double deadline;
+        // earliest report deadline of the jobs that need this; 0 if none
+    double start_order;
+        // for downloads: when we got the earliest-received such job
+    double bw_weight;
+        // share of the bandwidth limit relative to other transfers
+
     PERS_FILE_XFER();
     ~PERS_FILE_XFER();
     int init(FILE_INFO*, bool is_file_upload);
@@ -111,9 +122,11 @@ public:
     void permanent_failure(int);
     void abort();
     int write(MIOFILE& fout);
+    void checkpoint_md5();
     int parse(XML_PARSER&);
     int create_xfer();
     int start_xfer();
+    void get_upload_batch(std::vector<FILE_XFER*>&);
     void suspend();
 };
 
@@ -126,6 +139,7 @@ public:
     int insert(PERS_FILE_XFER*);
     int remove(PERS_FILE_XFER*);
     bool poll();
+    void set_priorities();
     void suspend();
     void add_random_delay(double);
 };
@@ -41,6 +41,8 @@ void PROJECT::init() {
     gui_urls = "";
     resource_share = 100;
     desired_disk_usage = 0;
+    project_dir_size = 0;
+    project_dir_scan_time = 0;
     for (int i=0; i<MAX_RSC; i++) {
         no_rsc_pref[i] = false;
         no_rsc_config[i] = false;
@@ -78,6 +80,8 @@ void PROJECT::init() {
     next_rpc_time = 0;
     last_rpc_time = 0;
     trickle_up_pending = false;
+    trickle_up_index.clear();
+    trickle_up_nsent = 0;
     anonymous_platform = false;
     non_cpu_intensive = false;
     verify_files_on_app_start = false;
@@ -86,6 +90,7 @@ void PROJECT::init() {
     send_job_log = 0;
     send_full_workload = false;
     dont_use_dcf = false;
+    gzip_sched_request = false;
     suspended_via_gui = false;
     dont_request_more_work = false;
     detach_when_done = false;
@@ -101,6 +106,8 @@ void PROJECT::init() {
     possibly_backed_off = false;
     nuploading_results = 0;
     too_many_uploading_results = false;
+    no_multi_upload = false;
+    no_segmented_download = false;
 
 #ifdef SIM
     idle_time = 0;
@@ -198,7 +205,7 @@ int PROJECT::parse_state(XML_PARSER& xp) {
         if (xp.parse_double("host_create_time", host_create_time)) continue;
         if (xp.match_tag("code_sign_key")) {
             retval = copy_element_contents(
-                xp.f->f,
+                *xp.f,
                 "</code_sign_key>",
                 code_sign_key,
                 sizeof(code_sign_key)
@@ -218,6 +225,7 @@ int PROJECT::parse_state(XML_PARSER& xp) {
         if (xp.parse_int("send_job_log", send_job_log)) continue;
         if (xp.parse_bool("send_full_workload", send_full_workload)) continue;
         if (xp.parse_bool("dont_use_dcf", dont_use_dcf)) continue;
+        if (xp.parse_bool("gzip_sched_request", gzip_sched_request)) continue;
         if (xp.parse_bool("non_cpu_intensive", non_cpu_intensive)) continue;
         if (xp.parse_bool("verify_files_on_app_start", verify_files_on_app_start)) continue;
         if (xp.parse_bool("suspended_via_gui", suspended_via_gui)) continue;
@@ -413,9 +421,12 @@ int PROJECT::write_state(MIOFILE& out, bool gui_rpc) {
         detach_when_done?"    <detach_when_done/>\n":"",
         ended?"    <ended/>\n":"",
         attached_via_acct_mgr?"    <attached_via_acct_mgr/>\n":"",
-        (this == gstate.scheduler_op->cur_proj)?"   <scheduler_rpc_in_progress/>\n":"",
+        gstate.scheduler_ops->lookup(this)?"   <scheduler_rpc_in_progress/>\n":"",
         use_symlinks?"    <use_symlinks/>\n":""
     );
+    if (gzip_sched_request) {
+        out.printf("    <gzip_sched_request/>\n");
+    }
     for (int j=0; j<coprocs.n_rsc; j++) {
         out.printf(
             "    <rsc_backoff_time>\n"
@@ -539,6 +550,7 @@ void PROJECT::copy_state_fields(PROJECT& p) {
     pwf = p.pwf;
     send_full_workload = p.send_full_workload;
     dont_use_dcf = p.dont_use_dcf;
+    gzip_sched_request = p.gzip_sched_request;
     send_time_stats_log = p.send_time_stats_log;
     send_job_log = p.send_job_log;
     non_cpu_intensive = p.non_cpu_intensive;
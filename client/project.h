@@ -21,6 +21,16 @@
 #include "app_config.h"
 #include "client_types.h"
 
+// an entry in a project's trickle-up spool
+//
+struct TRICKLE_UP_ENTRY {
+    double start;
+    double end;
+        // offsets in the spool file
+    int time;
+    std::string result_name;
+};
+
 struct PROJECT : PROJ_AM {
     char _project_dir[MAXPATHLEN];
     char _project_dir_absolute[MAXPATHLEN];
@@ -157,6 +167,16 @@ struct PROJECT : PROJ_AM {
     bool use_symlinks;
     double disk_usage;
         // computed by get_disk_usages()
+    double project_dir_size;
+        // size of the project dir as of the last scan,
+        // adjusted for files added and deleted since then
+    double project_dir_scan_time;
+        // when the project dir was last scanned; 0 if never
+    void add_project_dir_size(double x) {
+        if (!project_dir_scan_time) return;
+        project_dir_size += x;
+        if (project_dir_size < 0) project_dir_size = 0;
+    }
     double disk_share;
         // computed by get_disk_shares();
 
@@ -169,6 +189,8 @@ struct PROJECT : PROJ_AM {
         // if nonzero, send this project's job log from that point on
     bool send_full_workload;
     bool dont_use_dcf;
+    bool gzip_sched_request;
+        // the project's scheduler accepts gzip-compressed requests
 
     bool suspended_via_gui;
     bool dont_request_more_work; 
@@ -284,11 +306,22 @@ struct PROJECT : PROJ_AM {
     inline FILE_XFER_BACKOFF& file_xfer_backoff(bool is_upload) {
         return is_upload?upload_backoff:download_backoff;
     }
+    bool no_multi_upload;
+        // the project's upload handler doesn't support multi-file uploads
+    bool no_segmented_download;
+        // the project's data server ignored a Range: request
+        // for a segmented download
 
     // support for replicated trickle-ups
     //
     std::vector<TRICKLE_UP_OP*> trickle_up_ops;
 
+    // the project's trickle-up spool (see cs_trickle.cpp)
+    //
+    std::vector<TRICKLE_UP_ENTRY> trickle_up_index;
+    int trickle_up_nsent;
+        // # of entries in the last scheduler request
+
     // app config stuff
     //
     APP_CONFIGS app_configs;
@@ -45,8 +45,8 @@ void RESULT::clear() {
     received_time = 0;
     report_deadline = 0;
     version_num = 0;
-    strcpy(plan_class, "");
-    strcpy(platform, "");
+    plan_class = "";
+    platform = "";
     avp = NULL;
     output_files.clear();
     ready_to_report = false;
@@ -54,6 +54,7 @@ void RESULT::clear() {
     got_server_ack = false;
     final_cpu_time = 0;
     final_elapsed_time = 0;
+    perf_counts.clear();
 #ifdef SIM
     peak_flop_count = 0;
 #endif
@@ -71,16 +72,17 @@ void RESULT::clear() {
     app = NULL;
     wup = NULL;
     project = NULL;
-    strcpy(resources, "");
+    resources.clear();
     report_immediately = false;
     schedule_backoff = 0;
-    strcpy(schedule_backoff_reason, "");
+    schedule_backoff_reason.clear();
 }
 
 // parse a <result> element from scheduling server.
 //
 int RESULT::parse_server(XML_PARSER& xp) {
     FILE_REF file_ref;
+    char buf[256];
 
     clear();
     while (!xp.get_tag()) {
@@ -88,8 +90,14 @@ int RESULT::parse_server(XML_PARSER& xp) {
         if (xp.parse_str("name", name, sizeof(name))) continue;
         if (xp.parse_str("wu_name", wu_name, sizeof(wu_name))) continue;
         if (xp.parse_double("report_deadline", report_deadline)) continue;
-        if (xp.parse_str("platform", platform, sizeof(platform))) continue;
-        if (xp.parse_str("plan_class", plan_class, sizeof(plan_class))) continue;
+        if (xp.parse_str("platform", buf, sizeof(buf))) {
+            platform = intern_string(buf);
+            continue;
+        }
+        if (xp.parse_str("plan_class", buf, sizeof(buf))) {
+            plan_class = intern_string(buf);
+            continue;
+        }
         if (xp.parse_int("version_num", version_num)) continue;
         if (xp.match_tag("file_ref")) {
             file_ref.parse(xp);
@@ -112,6 +120,7 @@ int RESULT::parse_server(XML_PARSER& xp) {
 //
 int RESULT::parse_state(XML_PARSER& xp) {
     FILE_REF file_ref;
+    char buf[256];
 
     clear();
     while (!xp.get_tag()) {
@@ -145,6 +154,7 @@ int RESULT::parse_state(XML_PARSER& xp) {
         }
         if (xp.parse_double("final_cpu_time", final_cpu_time)) continue;
         if (xp.parse_double("final_elapsed_time", final_elapsed_time)) continue;
+        if (perf_counts.parse(xp)) continue;
         if (xp.parse_int("exit_status", exit_status)) continue;
         if (xp.parse_bool("got_server_ack", got_server_ack)) continue;
         if (xp.parse_bool("ready_to_report", ready_to_report)) continue;
@@ -157,8 +167,14 @@ int RESULT::parse_state(XML_PARSER& xp) {
         if (xp.parse_double("fpops_cumulative", fpops_cumulative)) continue;
         if (xp.parse_double("intops_per_cpu_sec", intops_per_cpu_sec)) continue;
         if (xp.parse_double("intops_cumulative", intops_cumulative)) continue;
-        if (xp.parse_str("platform", platform, sizeof(platform))) continue;
-        if (xp.parse_str("plan_class", plan_class, sizeof(plan_class))) continue;
+        if (xp.parse_str("platform", buf, sizeof(buf))) {
+            platform = intern_string(buf);
+            continue;
+        }
+        if (xp.parse_str("plan_class", buf, sizeof(buf))) {
+            plan_class = intern_string(buf);
+            continue;
+        }
         if (xp.parse_int("version_num", version_num)) continue;
         if (log_flags.unparsed_xml) {
             msg_printf(0, MSG_INFO,
@@ -208,6 +224,7 @@ int RESULT::write(MIOFILE& out, bool to_server) {
     if (intops_cumulative) {
         out.printf("    <intops_cumulative>%f</intops_cumulative>\n", intops_cumulative);
     }
+    perf_counts.write(out);
     if (to_server) {
         out.printf(
             "    <app_version_num>%d</app_version_num>\n",
@@ -310,10 +327,10 @@ int RESULT::write_gui(MIOFILE& out) {
     if (coproc_missing) out.printf("    <coproc_missing/>\n");
     if (schedule_backoff > gstate.now) {
         out.printf("    <scheduler_wait/>\n");
-        if (strlen(schedule_backoff_reason)) {
+        if (!schedule_backoff_reason.empty()) {
             out.printf(
                 "    <scheduler_wait_reason>%s</scheduler_wait_reason>\n",
-                schedule_backoff_reason
+                schedule_backoff_reason.c_str()
             );
         }
     }
@@ -321,19 +338,22 @@ int RESULT::write_gui(MIOFILE& out) {
     ACTIVE_TASK* atp = gstate.active_tasks.lookup_result(this);
     if (atp) {
         atp->write_gui(out);
+    } else {
+        perf_counts.write(out, true);
     }
-    if (!strlen(resources)) {
+    if (resources.empty()) {
         // only need to compute this string once
         //
+        char rbuf[256];
         if (avp->gpu_usage.rsc_type) {
             if (avp->gpu_usage.usage == 1) {
-                sprintf(resources,
+                snprintf(rbuf, sizeof(rbuf),
                     "%.3g CPUs + 1 %s GPU",
                     avp->avg_ncpus,
                     rsc_name(avp->gpu_usage.rsc_type)
                 );
             } else {
-                sprintf(resources,
+                snprintf(rbuf, sizeof(rbuf),
                     "%.3g CPUs + %.3g %s GPUs",
                     avp->avg_ncpus,
                     avp->gpu_usage.usage,
@@ -341,16 +361,17 @@ int RESULT::write_gui(MIOFILE& out) {
                 );
             }
         } else if (avp->missing_coproc) {
-            sprintf(resources, "%.3g CPUs + %s GPU (missing)",
+            snprintf(rbuf, sizeof(rbuf), "%.3g CPUs + %s GPU (missing)",
                 avp->avg_ncpus, avp->missing_coproc_name
             );
         } else if (!project->non_cpu_intensive && (avp->avg_ncpus != 1)) {
-            sprintf(resources, "%.3g CPUs", avp->avg_ncpus);
+            snprintf(rbuf, sizeof(rbuf), "%.3g CPUs", avp->avg_ncpus);
         } else {
-            strcpy(resources, " ");
+            strcpy(rbuf, " ");
         }
+        resources = rbuf;
     }
-    if (strlen(resources)>1) {
+    if (resources.size()>1) {
         char buf[256];
         strcpy(buf, "");
         if (atp && atp->task_state() == PROCESS_EXECUTING) {
@@ -364,7 +385,7 @@ int RESULT::write_gui(MIOFILE& out) {
             }
         }
         out.printf(
-            "    <resources>%s%s</resources>\n", resources, buf
+            "    <resources>%s%s</resources>\n", resources.c_str(), buf
         );
     }
     out.printf("</result>\n");
@@ -537,7 +558,7 @@ double RESULT::estimated_runtime_uncorrected() {
 double RESULT::estimated_runtime() {
     double x = estimated_runtime_uncorrected();
     if (!project->dont_use_dcf) {
-        x *= project->duration_correction_factor;
+        x *= avp->duration_correction_factor();
     }
     return x;
 }
@@ -591,6 +612,7 @@ static const char* result_state_name(int val) {
 
 void RESULT::set_state(int val, const char* where) {
     _state = val;
+    gstate.set_poll_flags();
     if (log_flags.task_debug) {
         msg_printf(project, MSG_INFO,
             "[task] result state=%s for %s from %s",
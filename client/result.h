@@ -18,6 +18,7 @@
 #ifndef _RESULT_
 #define _RESULT_
 
+#include "perf_counters.h"
 #include "project.h"
 
 struct RESULT {
@@ -26,8 +27,10 @@ struct RESULT {
     double received_time;   // when we got this from server
     double report_deadline;
     int version_num;        // identifies the app used
-    char plan_class[64];
-    char platform[256];
+    const char* plan_class;
+    const char* platform;
+        // these are interned (see intern_string());
+        // there are many results, and few distinct values
     APP_VERSION* avp;
     std::vector<FILE_REF> output_files;
     bool ready_to_report;
@@ -40,6 +43,8 @@ struct RESULT {
         // we've received the ack for this result from the server
     double final_cpu_time;
     double final_elapsed_time;
+    PERF_COUNTS perf_counts;
+        // hardware event counts of the task, if <perf_counters>
 #ifdef SIM
     double peak_flop_count;
     double sim_flops_left;
@@ -89,8 +94,17 @@ struct RESULT {
     WORKUNIT* wup;
     PROJECT* project;
 
-    RESULT(){}
+    RESULT() {
+        plan_class = "";
+        platform = "";
+    }
     ~RESULT(){}
+    static void* operator new(size_t n) {
+        return OBJ_POOL<RESULT>::alloc(n);
+    }
+    static void operator delete(void* p, size_t n) {
+        OBJ_POOL<RESULT>::free(p, n);
+    }
     void clear();
     int parse_server(XML_PARSER&);
     int parse_state(XML_PARSER&);
@@ -175,12 +189,12 @@ struct RESULT {
 
     int coproc_indices[MAX_COPROCS_PER_JOB];
         // keep track of coprocessor reservations
-    char resources[256];
+    std::string resources;
         // textual description of resources used
     double schedule_backoff;
         // don't try to schedule until this time
         // (wait for free GPU RAM)
-    char schedule_backoff_reason[256];
+    std::string schedule_backoff_reason;
 };
 
 inline bool max_concurrent_exceeded(RESULT* rp) {
@@ -384,7 +384,9 @@ void RR_SIM::simulate() {
 
     // Simulation loop.  Keep going until all jobs done
     //
-    double buf_end = gstate.now + gstate.work_buf_total();
+    // the shortfall and saturated time are for work fetch
+    //
+    double buf_end = gstate.now + gstate.work_fetch_buf_total();
     double sim_now = gstate.now;
     bool first = true;
     while (1) {
@@ -546,7 +548,30 @@ void RR_SIM::simulate() {
     }
 }
 
+// This is called by both the CPU scheduler and work fetch,
+// often in the same pass through the main loop.
+// If nothing it depends on has changed since the last run,
+// the outputs of that run are still valid, so skip it.
+// Anything that changes the simulation's inputs must set POLL_FLAG_RR_SIM:
+// - job state changes (RESULT::set_state(), via set_poll_flags())
+//   including completion and abort, and new jobs from scheduler replies
+// - request_schedule_cpus(), which is called when a task exits,
+//   files finish downloading, a project or task is suspended or resumed,
+//   prefs or cc_config change, or the usable CPUs or GPUs change
+// - run mode changes, suspension of computing, and new benchmarks
+// Jobs' progress changes their remaining-time estimates continuously;
+// poll_due() reruns the simulation every POLL_BACKSTOP_PERIOD for that.
+//
 void rr_simulation() {
+    static double last_time = 0;
+    if (!gstate.poll_due(POLL_FLAG_RR_SIM, last_time, 0)) {
+        if (log_flags.rr_simulation) {
+            msg_printf(0, MSG_INFO,
+                "[rr_sim] no changes since last simulation; using its results"
+            );
+        }
+        return;
+    }
     RR_SIM rr_sim;
     rr_sim.simulate();
 }
@@ -22,7 +22,9 @@
 #else
 #include "config.h"
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <errno.h>
 #endif
@@ -36,6 +38,7 @@
 #include "parse.h"
 #include "client_msgs.h"
 #include "client_state.h"
+#include "thread.h"
 
 #include "sandbox.h"
 
@@ -51,6 +54,137 @@ static int lookup_group(const char* name, gid_t& gid) {
 }
 #endif
 
+#ifndef SIM
+
+// The switcher helper: a "switcher --helper" process,
+// started when first needed and kept running.
+// It runs as boinc_project and does signals and deletions for us,
+// saving the fork and exec of switcher for each one.
+// We talk to it over a Unix socket (a socketpair):
+// we send a command line, it replies with 0 or an errno.
+// Commands may come from the async file thread, hence the lock.
+// If the helper can't be started or dies,
+// we fall back to running switcher for each operation.
+//
+static int helper_fd = -1;
+static int helper_pid = 0;
+static bool helper_failed = false;
+    // couldn't start it, or it exited without ever replying
+static bool helper_replied = false;
+static THREAD_LOCK helper_lock;
+
+static void stop_helper() {
+    close(helper_fd);
+    helper_fd = -1;
+    waitpid(helper_pid, 0, WNOHANG);
+    helper_pid = 0;
+}
+
+static int start_helper() {
+    char util_path[MAXPATHLEN];
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) return ERR_SOCKET;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    sprintf(util_path, "%s/%s", SWITCHER_DIR, SWITCHER_FILE_NAME);
+    int pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return ERR_FORK;
+    }
+    if (pid == 0) {
+        dup2(fds[1], 0);
+        dup2(fds[1], 1);
+        for (int i=3; i<1024; i++) close(i);
+        execl(util_path, SWITCHER_FILE_NAME, "--helper", (char*)0);
+        _exit(EXIT_CHILD_FAILED);
+    }
+    close(fds[1]);
+    helper_fd = fds[0];
+    helper_pid = pid;
+    return 0;
+}
+
+// send a command to the helper and get its reply.
+// Return nonzero if we couldn't;
+// otherwise set status to what it returned
+//
+static int helper_command(const char* cmd, int& status) {
+    char buf[64];
+    int flags = 0, n = 0, len = 0;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+
+    if (helper_failed) return ERR_NOT_IMPLEMENTED;
+    helper_lock.lock();
+    if (helper_fd < 0) {
+        if (start_helper()) {
+            helper_failed = true;
+            helper_lock.unlock();
+            return ERR_EXEC;
+        }
+    }
+    int cmd_len = (int)strlen(cmd);
+    if (send(helper_fd, cmd, cmd_len, flags) != cmd_len) {
+        if (!helper_replied) helper_failed = true;
+        stop_helper();
+        helper_lock.unlock();
+        return ERR_WRITE;
+    }
+    while (len < (int)sizeof(buf)-1) {
+        n = (int)recv(helper_fd, buf+len, 1, 0);
+        if (n <= 0 || buf[len] == '\n') break;
+        len++;
+    }
+    if (n <= 0 || len == (int)sizeof(buf)-1) {
+        // the helper exited (e.g. it couldn't be run).
+        // If it never replied, don't try again
+        //
+        if (!helper_replied) helper_failed = true;
+        stop_helper();
+        helper_lock.unlock();
+        return ERR_READ;
+    }
+    buf[len] = 0;
+    status = atoi(buf);
+    helper_replied = true;
+    helper_lock.unlock();
+    return 0;
+}
+
+// the following return nonzero if we couldn't use the helper
+//
+static int helper_kill(int pid, int sig, int& status) {
+    char cmd[256];
+    sprintf(cmd, "kill %d %d\n", pid, sig);
+    return helper_command(cmd, status);
+}
+
+static int helper_delete(const char* path, int& status) {
+    char cmd[MAXPATHLEN+16];
+    if (strchr(path, '\n')) return ERR_NOT_IMPLEMENTED;
+    snprintf(cmd, sizeof(cmd), "rm %s\n", path);
+    return helper_command(cmd, status);
+}
+
+#else
+
+static int helper_kill(int, int, int&) {
+    return ERR_NOT_IMPLEMENTED;
+}
+
+static int helper_delete(const char*, int&) {
+    return ERR_NOT_IMPLEMENTED;
+}
+
+#endif // SIM
+
 int kill_via_switcher(int pid) {
     char cmd[1024];
     
@@ -60,6 +194,10 @@ int kill_via_switcher(int pid) {
     // client is running as user boinc_master,
     // we cannot send a signal directly, so use switcher.
     //
+    int status;
+    if (!helper_kill(pid, SIGKILL, status)) {
+        return status?ERR_SIGNAL_OP:0;
+    }
     sprintf(cmd, "/bin/kill kill -s KILL %d", pid);
     return switcher_exec(SWITCHER_FILE_NAME, cmd);
 }
@@ -119,6 +257,10 @@ int remove_project_owned_file_or_dir(const char* path) {
     char cmd[1024];
 
     if (g_use_sandbox) {
+        int status;
+        if (!helper_delete(path, status)) {
+            return status?ERR_UNLINK:0;
+        }
         sprintf(cmd, "/bin/rm rm -fR \"%s\"", path);
         if (switcher_exec(SWITCHER_FILE_NAME, cmd)) {
             return ERR_UNLINK;
@@ -131,7 +273,10 @@ int remove_project_owned_file_or_dir(const char* path) {
 
 #endif // ! _WIN32
 
-static int delete_project_owned_file_aux(const char* path) {
+// delete a file; no retries or messages
+// (so this can be called from the async file thread)
+//
+int delete_project_owned_file_aux(const char* path) {
 #ifdef _WIN32
     if (DeleteFile(path)) return 0;
     int error = GetLastError();
@@ -238,3 +383,17 @@ int remove_project_owned_dir(const char* name) {
     return retval;
 #endif
 }
+
+// make a hard link to a file.
+// Not done with sandboxing, since the ownership and permissions
+// set on one name would also apply to the other
+//
+int hard_link_file(const char* file_path, const char* link_path) {
+    if (g_use_sandbox) return ERR_NOT_IMPLEMENTED;
+#ifdef _WIN32
+    if (!CreateHardLinkA(link_path, file_path, NULL)) return GetLastError();
+    return 0;
+#else
+    return link(file_path, link_path);
+#endif
+}
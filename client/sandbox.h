@@ -21,9 +21,11 @@ extern int set_to_project_group(const char* path);
 extern int switcher_exec(const char* util_filename, const char* cmdline);
 extern int client_clean_out_dir(const char*, const char* reason);
 extern int delete_project_owned_file(const char* path, bool retry);
+extern int delete_project_owned_file_aux(const char* path);
 extern int remove_project_owned_dir(const char* name);
 extern int remove_project_owned_file_or_dir(const char* path);
 extern int check_security(int use_sandbox, int isManager, char* path_to_error, int len);
+extern int hard_link_file(const char* file_path, const char* link_path);
 
 #define BOINC_PROJECT_GROUP_NAME "boinc_project"
 
@@ -51,6 +51,19 @@ SCHEDULER_OP::SCHEDULER_OP(HTTP_OP_SET* h) {
     state = SCHEDULER_OP_STATE_IDLE;
     http_op.http_op_state = HTTP_STATE_IDLE;
     http_ops = h;
+    url_random = 0;
+    for (int i=0; i<MAX_RSC; i++) {
+        req_secs[i] = 0;
+        req_instances[i] = 0;
+    }
+}
+
+bool SCHEDULER_OP::requesting_work() {
+    if (state != SCHEDULER_OP_STATE_RPC) return false;
+    for (int i=0; i<coprocs.n_rsc; i++) {
+        if (req_secs[i]) return true;
+    }
+    return false;
 }
 
 // See if there's a pending master file fetch.
@@ -115,6 +128,10 @@ int SCHEDULER_OP::init_op_project(PROJECT* p, int r) {
     url_index = 0;
     retval = gstate.make_scheduler_request(p);
     if (!retval) {
+        for (int i=0; i<coprocs.n_rsc; i++) {
+            req_secs[i] = rsc_work_fetch[i].req_secs;
+            req_instances[i] = rsc_work_fetch[i].req_instances;
+        }
         retval = start_rpc(p);
     }
     if (retval) {
@@ -210,11 +227,11 @@ void SCHEDULER_OP::rpc_failed(const char* msg) {
     cur_proj = 0;
 }
 
-static void request_string(char* buf) {
+static void request_string(char* buf, double* req_secs) {
     bool first = true;
     strcpy(buf, "");
     for (int i=0; i<coprocs.n_rsc; i++) {
-        if (rsc_work_fetch[i].req_secs) {
+        if (req_secs[i]) {
             if (!first) strcat(buf, " and ");
             strcat(buf, rsc_name(i));
             first = false;
@@ -243,7 +260,7 @@ int SCHEDULER_OP::start_rpc(PROJECT* p) {
                 "Reporting %d completed tasks", p->nresults_returned
             );
         }
-        request_string(buf);
+        request_string(buf, req_secs);
         if (strlen(buf)) {
             msg_printf(p, MSG_INFO, "Requesting new tasks for %s", buf);
         } else {
@@ -261,9 +278,7 @@ int SCHEDULER_OP::start_rpc(PROJECT* p) {
         for (int i=0; i<coprocs.n_rsc; i++) {
             msg_printf(p, MSG_INFO,
                 "[sched_op] %s work request: %.2f seconds; %.2f devices",
-                rsc_name(i),
-                rsc_work_fetch[i].req_secs,
-                rsc_work_fetch[i].req_instances
+                rsc_name(i), req_secs[i], req_instances[i]
             );
         }
     }
@@ -283,7 +298,6 @@ int SCHEDULER_OP::start_rpc(PROJECT* p) {
         return retval;
     }
     http_ops->insert(&http_op);
-    p->rpc_seqno++;
     state = SCHEDULER_OP_STATE_RPC;
     return 0;
 }
@@ -495,6 +509,15 @@ bool SCHEDULER_OP::poll() {
                     rpc_failed("Scheduler request failed");
                 }
             } else {
+                // increment the seqno only when we get a reply;
+                // if the RPC fails, the retry has the same seqno,
+                // and the scheduler can send the reply it sent before
+                //
+                cur_proj->rpc_seqno++;
+                for (int i=0; i<coprocs.n_rsc; i++) {
+                    rsc_work_fetch[i].req_secs = req_secs[i];
+                    rsc_work_fetch[i].req_instances = req_instances[i];
+                }
                 retval = gstate.handle_scheduler_reply(cur_proj, scheduler_url);
                 switch (retval) {
                 case 0:
@@ -528,6 +551,65 @@ void SCHEDULER_OP::abort(PROJECT* p) {
     }
 }
 
+SCHEDULER_OP_SET::SCHEDULER_OP_SET(HTTP_OP_SET* h) {
+    http_ops = h;
+    url_random = 0;
+}
+
+SCHEDULER_OP_SET::~SCHEDULER_OP_SET() {
+    for (unsigned int i=0; i<ops.size(); i++) {
+        delete ops[i];
+    }
+}
+
+bool SCHEDULER_OP_SET::poll() {
+    bool action = false;
+    for (unsigned int i=0; i<ops.size(); i++) {
+        SCHEDULER_OP* sop = ops[i];
+        if (sop->state == SCHEDULER_OP_STATE_IDLE) continue;
+        sop->poll();
+        if (sop->state == SCHEDULER_OP_STATE_IDLE) action = true;
+    }
+    return action;
+}
+
+SCHEDULER_OP* SCHEDULER_OP_SET::get_idle_op() {
+    unsigned int i;
+    for (i=0; i<ops.size(); i++) {
+        if (ops[i]->state == SCHEDULER_OP_STATE_IDLE) return ops[i];
+    }
+    int n = config.max_sched_rpcs;
+    if (n < 1) n = 1;
+    if ((int)ops.size() >= n) return NULL;
+    SCHEDULER_OP* sop = new SCHEDULER_OP(http_ops);
+    sop->url_random = url_random;
+    ops.push_back(sop);
+    return sop;
+}
+
+SCHEDULER_OP* SCHEDULER_OP_SET::lookup(PROJECT* p) {
+    for (unsigned int i=0; i<ops.size(); i++) {
+        SCHEDULER_OP* sop = ops[i];
+        if (sop->state != SCHEDULER_OP_STATE_IDLE && sop->cur_proj == p) {
+            return sop;
+        }
+    }
+    return NULL;
+}
+
+bool SCHEDULER_OP_SET::requesting_work() {
+    for (unsigned int i=0; i<ops.size(); i++) {
+        if (ops[i]->requesting_work()) return true;
+    }
+    return false;
+}
+
+void SCHEDULER_OP_SET::abort(PROJECT* p) {
+    for (unsigned int i=0; i<ops.size(); i++) {
+        ops[i]->abort(p);
+    }
+}
+
 void SCHEDULER_REPLY::clear() {
     hostid = 0;
     request_delay = 0;
@@ -543,6 +625,7 @@ void SCHEDULER_REPLY::clear() {
     project_is_down = false;
     send_full_workload = false;
     dont_use_dcf = false;
+    gzip_request = false;
     send_time_stats_log = 0;
     send_job_log = 0;
     messages.clear();
@@ -685,7 +768,7 @@ int SCHEDULER_REPLY::parse(FILE* in, PROJECT* project) {
             }
         } else if (xp.match_tag("gui_urls")) {
             std::string foo;
-            retval = copy_element_contents(xp.f->f, "</gui_urls>", foo);
+            retval = copy_element_contents(*xp.f, "</gui_urls>", foo);
             if (retval) {
                 msg_printf(project, MSG_INTERNAL_ERROR,
                     "Can't parse GUI URLs in scheduler reply: %s",
@@ -866,6 +949,8 @@ int SCHEDULER_REPLY::parse(FILE* in, PROJECT* project) {
             continue;
         } else if (xp.parse_bool("dont_use_dcf", dont_use_dcf)) {
             continue;
+        } else if (xp.parse_bool("gzip_request", gzip_request)) {
+            continue;
         } else if (xp.parse_int("send_time_stats_log", send_time_stats_log)){
             continue;
         } else if (xp.parse_int("send_job_log", send_job_log)) {
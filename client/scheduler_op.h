@@ -52,7 +52,8 @@
 // SCHEDULER_OP encapsulates the mechanism for
 // 1) fetching master files
 // 2) communicating with scheduling servers
-// Only one such operation can be in progress at once.
+// Each SCHEDULER_OP does one such operation at a time;
+// see SCHEDULER_OP_SET.
 
 class SCHEDULER_OP {
 private:
@@ -62,6 +63,12 @@ private:
     char scheduler_url[256];
     int url_index;
         // index within project's URL list
+    double req_secs[MAX_RSC];
+    double req_instances[MAX_RSC];
+        // the work request in this RPC.
+        // rsc_work_fetch may be changed by other RPCs
+        // while this one is in progress;
+        // it's restored from these before the reply is handled.
 public:
     PROJECT* cur_proj;
         // project we're currently contacting
@@ -76,9 +83,10 @@ public:
     int init_op_project(PROJECT*, int);
     int init_master_fetch(PROJECT*);
     bool check_master_fetch_start();
-    void project_rpc_backoff(PROJECT* p, const char *error_msg);
+    static void project_rpc_backoff(PROJECT* p, const char *error_msg);
     void abort(PROJECT*);
         // if we're doing an op to this project, abort it
+    bool requesting_work();
 private:
     bool update_urls(PROJECT*, std::vector<std::string> &urls);
     int start_op(PROJECT*);
@@ -87,6 +95,34 @@ private:
     int parse_master_file(PROJECT*, std::vector<std::string>&);
 };
 
+// The scheduler ops.
+// Up to <max_sched_rpcs> (cc_config.xml) ops can be in progress,
+// each to a different project, so that e.g. reporting results
+// to several projects doesn't wait for each RPC in turn.
+// Replies are handled in poll(), one at a time.
+// Work requests are computed from global state (rsc_work_fetch),
+// so at most one RPC in progress asks for work
+// (except the initial RPC to a new project).
+//
+class SCHEDULER_OP_SET {
+    std::vector<SCHEDULER_OP*> ops;
+    HTTP_OP_SET* http_ops;
+public:
+    double url_random;
+        // used to randomize order
+
+    SCHEDULER_OP_SET(HTTP_OP_SET*);
+    ~SCHEDULER_OP_SET();
+    bool poll();
+        // return true if an op finished
+    SCHEDULER_OP* get_idle_op();
+        // an idle op (created if needed), or NULL if at the limit
+    SCHEDULER_OP* lookup(PROJECT*);
+        // the op in progress for the project, if any
+    bool requesting_work();
+    void abort(PROJECT*);
+};
+
 struct USER_MESSAGE {
     std::string message;
     std::string priority;
@@ -123,6 +159,8 @@ struct SCHEDULER_REPLY {
     bool project_is_down;
     bool send_file_list;      
     bool send_full_workload;      
+    bool gzip_request;
+        // scheduler can take a gzip-compressed request
     bool dont_use_dcf;      
     int send_time_stats_log;
     int send_job_log;
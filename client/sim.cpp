@@ -54,8 +54,31 @@
 //      use only RR scheduling
 //  [--rec_half_life X]
 //      half-life of recent est credit
+//
+//  Batch mode (Unix only):
+//  [--batch F]
+//      F lists input directories, one per line.
+//      Simulate each of these scenarios, with the other options as given.
+//      Each runs in a separate process; its outputs go in its directory,
+//      except for the timeline and graphs, which aren't generated.
+//  [--nprocs N]
+//      run up to N scenarios at once (default 1)
+//  [--batch_out F]
+//      write a CSV file of each scenario's figures of merit
+//      (default batch_results.csv)
+//
+//  Benchmark mode (Unix only):
+//  [--bench N1,N2,...]
+//      Time the client's scheduling code (see sim_bench.cpp)
+//      with the state file's jobs replicated to N1, N2, ... jobs.
+//  [--bench_time X]
+//      time each function for at least X seconds (default 1)
 
 #include <cmath>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "error_numbers.h"
 #include "str_util.h"
@@ -85,6 +108,7 @@ const char* outfile_prefix = "./";
 #define RESULTS_TXT_FNAME "results.txt"
 #define SUMMARY_FNAME "summary.txt"
 #define REC_FNAME "rec.dat"
+#define RESULTS_CSV_FNAME "results.csv"
 
 bool user_active;
 double duration = 86400, delta = 60;
@@ -102,6 +126,9 @@ bool server_uses_workload = false;
 bool cpu_sched_rr_only = false;
 bool existing_jobs_only = false;
 bool include_empty_projects;
+bool batch_mode = false;
+    // this is one of the scenarios of a --batch run;
+    // skip timeline and graph output
 
 RANDOM_PROCESS on_proc;
 RANDOM_PROCESS active_proc;
@@ -126,7 +153,9 @@ void usage(char* prog) {
         "[--delta X]\n"
         "[--server_uses_workload]\n"
         "[--cpu_sched_rr_only]\n"
-        "[--rec_half_life X]\n",
+        "[--rec_half_life X]\n"
+        "[--batch F [--nprocs N] [--batch_out F]]\n"
+        "[--bench N1,N2,... [--bench_time X]]\n",
         prog
     );
     exit(1);
@@ -238,7 +267,7 @@ void make_job(
     wup->rsc_fpops_est = app->fpops_est;
     rp->sim_flops_left = rp->wup->rsc_fpops_est;
     safe_strcpy(wup->name, rp->name);
-    safe_strcpy(wup->app_name, app->name);
+    wup->app_name = intern_string(app->name);
     wup->app = app;
     double ops = app->fpops.sample();
     if (ops < 0) ops = 0;
@@ -278,6 +307,7 @@ void CLIENT_STATE::handle_completed_results(PROJECT* p) {
                 spp->project_results.nresults_met_deadline++;
             }
             html_msg += buf;
+            result_index.erase(rp);
             delete rp;
             result_iter = results.erase(result_iter);
         } else {
@@ -342,6 +372,7 @@ double get_estimated_delay(RESULT* rp) {
 bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
     char buf[256], buf2[256];
     vector<IP_RESULT> ip_results;
+    EDF_MODEL edf;
     int infeasible_count = 0;
     vector<RESULT*> new_results;
 
@@ -357,7 +388,7 @@ bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
         sprintf(buf, "RPC to %s skipped - project down<br>", p->project_name);
         html_msg += buf;
         msg_printf(p, MSG_INFO, "RPC skipped: project down");
-        gstate.scheduler_op->project_rpc_backoff(p, "project down");
+        SCHEDULER_OP::project_rpc_backoff(p, "project down");
         p->master_url_fetch_pending = false;
         return false;
     }
@@ -395,6 +426,7 @@ bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
 
     if (server_uses_workload) {
         get_workload(ip_results);
+        edf.init(ncpus, ip_results);
     }
 
     bool sent_something = false;
@@ -409,8 +441,8 @@ bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
         double et = wup->rsc_fpops_est / rp->avp->flops;
         if (server_uses_workload) {
             IP_RESULT c(rp->name, rp->report_deadline-now, et);
-            if (check_candidate(c, ncpus, ip_results)) {
-                ip_results.push_back(c);
+            if (edf.check_candidate(c)) {
+                edf.add(c);
             } else {
                 msg_printf(p, MSG_INFO, "job for %s misses deadline sim\n", rp->app->name);
                 APP_VERSION* avp = rp->avp;
@@ -438,6 +470,7 @@ bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
         sent_something = true;
         rp->set_state(RESULT_FILES_DOWNLOADED, "simulate_rpc");
         results.push_back(rp);
+        result_index.insert(rp);
         new_results.push_back(rp);
 #if 0
         sprintf(buf, "got job %s: CPU time %.2f, deadline %s<br>",
@@ -737,6 +770,15 @@ void SIM_RESULTS::print(FILE* f, bool human_readable) {
     }
 }
 
+#define CSV_HEADER "scenario,idle_frac,wasted_frac,share_violation,monotony,nresults_met_deadline,nresults_missed_deadline,nrpcs\n"
+
+void SIM_RESULTS::print_csv(FILE* f, const char* scenario) {
+    fprintf(f, "%s,%f,%f,%f,%f,%d,%d,%d\n",
+        scenario, idle_frac, wasted_frac, share_violation, monotony,
+        nresults_met_deadline, nresults_missed_deadline, nrpcs
+    );
+}
+
 void SIM_RESULTS::parse(FILE* f) {
     fscanf(f, "wasted_frac %lf idle_frac %lf share_violation %lf monotony %lf",
         &wasted_frac, &idle_frac, &share_violation, &monotony
@@ -1062,7 +1104,7 @@ void simulate() {
     bool action;
     double start = START_TIME;
     gstate.now = start;
-    html_start();
+    if (!batch_mode) html_start();
     fprintf(summary_file,
         "Hardware summary\n   %d CPUs, %.1f GFLOPS\n",
         gstate.host_info.p_ncpus, gstate.host_info.p_fpops/1e9
@@ -1150,12 +1192,16 @@ void simulate() {
                 atp->elapsed_time += delta;
             }
         }
-        html_rec();
-        write_recs();
+        if (batch_mode) {
+            html_msg = "";
+        } else {
+            html_rec();
+            write_recs();
+        }
         gstate.now += delta;
         if (gstate.now > start + duration) break;
     }
-    html_end();
+    if (!batch_mode) html_end();
 }
 
 void show_app(APP* app) {
@@ -1368,6 +1414,7 @@ void cull_projects() {
     while (ri != gstate.results.end()) {
         RESULT* rp = *ri;
         if (rp->project->ignore) {
+            gstate.result_index.erase(rp);
             ri = gstate.results.erase(ri);
         } else {
             ri++;
@@ -1385,7 +1432,9 @@ void cull_projects() {
     }
 }
 
-void do_client_simulation() {
+// read the input files and set up the client's state for simulation
+//
+void init_sim_state() {
     char buf[256], buf2[256];
     int retval;
     FILE* f;
@@ -1435,12 +1484,6 @@ void do_client_simulation() {
     sprintf(buf, "%s%s", infile_prefix, GLOBAL_PREFS_FILE_NAME);
     sprintf(buf2, "%s%s", infile_prefix, GLOBAL_PREFS_OVERRIDE_FILE);
     gstate.read_global_prefs(buf, buf2);
-    fprintf(index_file,
-        "<h3>Output files</h3>\n"
-        "<a href=%s>Summary</a>\n"
-        "<br><a href=%s>Log file</a>\n",
-        SUMMARY_FNAME, LOG_FNAME
-    );
 
     // fill in GPU device nums
     //
@@ -1468,6 +1511,19 @@ void do_client_simulation() {
     gstate.log_show_projects();
     gstate.set_ncpus();
     work_fetch.init();
+}
+
+void do_client_simulation() {
+    char buf[256];
+    FILE* f;
+
+    init_sim_state();
+    fprintf(index_file,
+        "<h3>Output files</h3>\n"
+        "<a href=%s>Summary</a>\n"
+        "<br><a href=%s>Log file</a>\n",
+        SUMMARY_FNAME, LOG_FNAME
+    );
 
     //set_initial_rec();
 
@@ -1508,6 +1564,15 @@ void do_client_simulation() {
     );
     print_project_results(summary_file);
 
+    if (batch_mode) {
+        sprintf(buf, "%s%s", outfile_prefix, RESULTS_CSV_FNAME);
+        f = fopen(buf, "w");
+        if (f) {
+            sim_results.print_csv(f, infile_prefix);
+            fclose(f);
+        }
+        return;
+    }
     fclose(rec_file);
     make_graph("REC", "rec", 0);
 }
@@ -1520,10 +1585,119 @@ char* next_arg(int argc, char** argv, int& i) {
     return argv[i++];
 }
 
-int main(int argc, char** argv) {
-    int i, retval;
+void open_output_files() {
     char buf[256];
 
+    sprintf(buf, "%s%s", outfile_prefix, "index.html");
+    index_file = fopen(buf, "w");
+
+    sprintf(log_filename, "%s%s", outfile_prefix, LOG_FNAME);
+    logfile = fopen(log_filename, "w");
+    if (!logfile) {
+        fprintf(stderr, "Can't open %s\n", log_filename);
+        exit(1);
+    }
+    setbuf(logfile, 0);
+
+    if (!batch_mode) {
+        sprintf(buf, "%s%s", outfile_prefix, REC_FNAME);
+        rec_file = fopen(buf, "w");
+    }
+
+    sprintf(buf, "%s%s", outfile_prefix, SUMMARY_FNAME);
+    summary_file = fopen(buf, "w");
+}
+
+#ifndef _WIN32
+// Simulate each of the scenarios (input directories) listed in batch_file,
+// up to nprocs at once.
+// Each is simulated in a child process, so that it gets
+// its own copy of the client's global state.
+// Then gather their results.csv files into one CSV file.
+//
+static int run_batch(const char* batch_file, int nprocs, const char* out_file) {
+    char buf[1024];
+    vector<string> dirs;
+    unsigned int i;
+    int nrunning = 0, status;
+
+    FILE* f = fopen(batch_file, "r");
+    if (!f) {
+        fprintf(stderr, "Can't open %s\n", batch_file);
+        return ERR_FOPEN;
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        strip_whitespace(buf);
+        if (!strlen(buf) || buf[0] == '#') continue;
+        string dir = buf;
+        if (dir[dir.size()-1] != '/') dir += "/";
+        dirs.push_back(dir);
+    }
+    fclose(f);
+
+    for (i=0; i<dirs.size(); i++) {
+        if (nrunning == nprocs) {
+            wait(&status);
+            nrunning--;
+        }
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return ERR_FORK;
+        }
+        if (pid == 0) {
+            batch_mode = true;
+            infile_prefix = dirs[i].c_str();
+            outfile_prefix = dirs[i].c_str();
+            sprintf(buf, "%s%s", outfile_prefix, RESULTS_CSV_FNAME);
+            boinc_delete_file(buf);
+            open_output_files();
+            srand(1);
+            do_client_simulation();
+            exit(0);
+        }
+        nrunning++;
+    }
+    while (nrunning > 0) {
+        wait(&status);
+        nrunning--;
+    }
+
+    FILE* out = fopen(out_file, "w");
+    if (!out) {
+        fprintf(stderr, "Can't open %s\n", out_file);
+        return ERR_FOPEN;
+    }
+    fputs(CSV_HEADER, out);
+    int nfailed = 0;
+    for (i=0; i<dirs.size(); i++) {
+        sprintf(buf, "%s%s", dirs[i].c_str(), RESULTS_CSV_FNAME);
+        f = fopen(buf, "r");
+        if (f && fgets(buf, sizeof(buf), f)) {
+            fputs(buf, out);
+        } else {
+            fprintf(stderr, "Simulation of %s failed\n", dirs[i].c_str());
+            nfailed++;
+        }
+        if (f) fclose(f);
+    }
+    fclose(out);
+    fprintf(stderr, "%d scenarios simulated, %d failed; results in %s\n",
+        (int)dirs.size(), nfailed, out_file
+    );
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+    int i;
+    const char* batch_file = NULL;
+    const char* batch_out = "batch_results.csv";
+    int nprocs = 1;
+    const char* bench_sizes = NULL;
+    double bench_time = 1;
+
     sim_results.clear();
     for (i=1; i<argc;) {
         char* opt = argv[i++];
@@ -1545,6 +1719,16 @@ int main(int argc, char** argv) {
             include_empty_projects = true;
         } else if (!strcmp(opt, "--rec_half_life")) {
             config.rec_half_life = atof(argv[i++]);
+        } else if (!strcmp(opt, "--batch")) {
+            batch_file = next_arg(argc, argv, i);
+        } else if (!strcmp(opt, "--nprocs")) {
+            nprocs = atoi(next_arg(argc, argv, i));
+        } else if (!strcmp(opt, "--batch_out")) {
+            batch_out = next_arg(argc, argv, i);
+        } else if (!strcmp(opt, "--bench")) {
+            bench_sizes = next_arg(argc, argv, i);
+        } else if (!strcmp(opt, "--bench_time")) {
+            bench_time = atof(next_arg(argc, argv, i));
         } else {
             usage(argv[0]);
         }
@@ -1559,23 +1743,25 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    sprintf(buf, "%s%s", outfile_prefix, "index.html");
-    index_file = fopen(buf, "w");
-
-    sprintf(log_filename, "%s%s", outfile_prefix, LOG_FNAME);
-    logfile = fopen(log_filename, "w");
-    if (!logfile) {
-        fprintf(stderr, "Can't open %s\n", buf);
+    if (batch_file) {
+#ifdef _WIN32
+        fprintf(stderr, "--batch isn't supported on Windows\n");
         exit(1);
+#else
+        if (nprocs < 1) nprocs = 1;
+        exit(run_batch(batch_file, nprocs, batch_out)?1:0);
+#endif
+    }
+    if (bench_sizes) {
+#ifdef _WIN32
+        fprintf(stderr, "--bench isn't supported on Windows\n");
+        exit(1);
+#else
+        exit(run_sched_bench(bench_sizes, bench_time)?1:0);
+#endif
     }
-    setbuf(logfile, 0);
-
-    sprintf(buf, "%s%s", outfile_prefix, REC_FNAME);
-    rec_file = fopen(buf, "w");
-
-    sprintf(buf, "%s%s", outfile_prefix, SUMMARY_FNAME);
-    summary_file = fopen(buf, "w");
 
+    open_output_files();
     srand(1);       // make it deterministic
     do_client_simulation();
 }
@@ -36,6 +36,7 @@ struct SIM_RESULTS {
 
     void compute_figures_of_merit();
     void print(FILE* f, bool human_readable=false);
+    void print_csv(FILE* f, const char* scenario);
     void parse(FILE* f);
     void add(SIM_RESULTS& r);
     void divide(int);
@@ -92,6 +93,9 @@ extern double calculate_exponential_backoff(
     int n, double MIN, double MAX
 );
 extern char* sim_time_string(int t);
+extern void init_sim_state();
+extern void open_output_files();
+extern int run_sched_bench(const char* sizes, double min_time);
 
 extern bool dcf_dont_use;
 extern bool dcf_stats;
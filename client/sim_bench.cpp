@@ -0,0 +1,245 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Benchmark of the client's scheduling code (sim --bench N1,N2,...).
+//
+// The simulator's input state (client_state.xml etc.) is read,
+// and its jobs are replicated until there are N of them.
+// Then we time:
+//  rr_simulation()
+//  CLIENT_STATE::make_run_list()
+//      (with the result of the last rr_simulation(), as in the client
+//      when nothing has changed since then)
+//  WORK_FETCH::choose_project()
+//      (same)
+//  CLIENT_STATE::write_state(), to a file bench_state_N.xml
+//  CLIENT_STATE::parse_state_file_aux(), of that file
+// and print the time per call.
+// Each N is done in a separate process, one at a time.
+//
+// The replicated jobs are like those the simulator makes:
+// they have the app version and workunit of the original,
+// but no output files.
+// Use a state file from a host with the GPUs and projects of interest;
+// the host's coprocessors are taken from it.
+
+#ifndef _WIN32
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "error_numbers.h"
+#include "mfile.h"
+#include "str_util.h"
+#include "util.h"
+
+#include "client_state.h"
+#include "project.h"
+#include "result.h"
+#include "rr_sim.h"
+#include "work_fetch.h"
+
+#include "sim.h"
+
+extern const char* outfile_prefix;
+
+static double bench_min_time;
+
+// replicate the state's jobs until there are n
+//
+static void add_jobs(int n) {
+    char buf[256];
+    int i, n0 = (int)gstate.results.size();
+
+    for (i=0; (int)gstate.results.size() < n; i++) {
+        RESULT* rp0 = gstate.results[i % n0];
+
+        WORKUNIT* wup = new WORKUNIT;
+        *wup = *rp0->wup;
+        snprintf(buf, sizeof(buf), "%s_bench_%d", rp0->wup->name, i);
+        safe_strcpy(wup->name, buf);
+        wup->ref_cnt = 1;
+        gstate.workunits.push_back(wup);
+        gstate.workunit_index.insert(wup);
+
+        RESULT* rp = new RESULT;
+        *rp = *rp0;
+        snprintf(buf, sizeof(buf), "%s_bench_%d", rp0->name, i);
+        safe_strcpy(rp->name, buf);
+        safe_strcpy(rp->wu_name, wup->name);
+        rp->wup = wup;
+        rp->output_files.clear();
+        rp->index = (int)gstate.results.size();
+        gstate.results.push_back(rp);
+        gstate.result_index.insert(rp);
+    }
+}
+
+// delete the state, so that it can be parsed again
+//
+static void clear_state() {
+    unsigned int i;
+
+    for (i=0; i<gstate.results.size(); i++) delete gstate.results[i];
+    for (i=0; i<gstate.workunits.size(); i++) delete gstate.workunits[i];
+    for (i=0; i<gstate.app_versions.size(); i++) delete gstate.app_versions[i];
+    for (i=0; i<gstate.file_infos.size(); i++) delete gstate.file_infos[i];
+    for (i=0; i<gstate.apps.size(); i++) delete gstate.apps[i];
+    for (i=0; i<gstate.projects.size(); i++) delete gstate.projects[i];
+    gstate.results.clear();
+    gstate.workunits.clear();
+    gstate.app_versions.clear();
+    gstate.file_infos.clear();
+    gstate.apps.clear();
+    gstate.projects.clear();
+    gstate.result_index.clear();
+    gstate.workunit_index.clear();
+    gstate.file_info_index.clear();
+}
+
+static void do_rr_simulation() {
+    gstate.set_poll_flags(POLL_FLAG_RR_SIM);
+    rr_simulation();
+}
+
+static void do_make_run_list() {
+    vector<RESULT*> run_list;
+    gstate.make_run_list(run_list);
+}
+
+static void do_choose_project() {
+    work_fetch.choose_project();
+}
+
+static char state_path[256];
+
+static void do_write_state() {
+    MFILE mf;
+    MIOFILE miof;
+
+    if (mf.open(state_path, "w")) {
+        fprintf(stderr, "can't open %s\n", state_path);
+        exit(1);
+    }
+    mf.set_flush_size(1024*1024);
+    miof.init_mfile(&mf);
+    gstate.write_state(miof);
+    mf.close();
+}
+
+static void report(int n, const char* name, int ncalls, double elapsed) {
+    printf("%8d %-20s %8d %14.1f\n",
+        n, name, ncalls, elapsed*1e6/ncalls
+    );
+    fflush(stdout);
+}
+
+// call f until bench_min_time has passed (at least 3 times)
+//
+static void time_func(int n, const char* name, void (*f)()) {
+    int ncalls = 0;
+    double start = dtime(), elapsed;
+
+    do {
+        f();
+        ncalls++;
+        elapsed = dtime() - start;
+    } while (ncalls < 3 || elapsed < bench_min_time);
+    report(n, name, ncalls, elapsed);
+}
+
+// parse the state file; only the parse is timed
+//
+static void time_parse(int n) {
+    int ncalls = 0, retval;
+    double elapsed = 0, start, begin = dtime();
+
+    do {
+        clear_state();
+        start = dtime();
+        retval = gstate.parse_state_file_aux(state_path);
+        elapsed += dtime() - start;
+        if (retval) {
+            fprintf(stderr, "can't parse %s: %s\n", state_path, boincerror(retval));
+            exit(1);
+        }
+        ncalls++;
+    } while (ncalls < 3 || dtime() - begin < bench_min_time);
+    report(n, "parse_state_file", ncalls, elapsed);
+}
+
+static void bench(int n) {
+    open_output_files();
+    srand(1);
+    init_sim_state();
+    if (gstate.results.empty()) {
+        fprintf(stderr, "state file has no jobs\n");
+        exit(1);
+    }
+    if ((int)gstate.results.size() > n) {
+        fprintf(stderr, "skipping %d: state file has %d jobs\n",
+            n, (int)gstate.results.size()
+        );
+        exit(0);
+    }
+    add_jobs(n);
+    gstate.request_work_fetch("bench");
+    snprintf(state_path, sizeof(state_path), "%sbench_state_%d.xml",
+        outfile_prefix, n
+    );
+
+    time_func(n, "rr_simulation", do_rr_simulation);
+    time_func(n, "make_run_list", do_make_run_list);
+    time_func(n, "choose_project", do_choose_project);
+    time_func(n, "write_state", do_write_state);
+    time_parse(n);
+}
+
+int run_sched_bench(const char* sizes, double min_time) {
+    const char* p = sizes;
+    char* end;
+    int status;
+
+    bench_min_time = min_time;
+    printf("%8s %-20s %8s %14s\n", "jobs", "function", "calls", "usec/call");
+    for (; *p; p = *end ? end+1 : end) {
+        int n = (int)strtol(p, &end, 10);
+        if (end == p) {
+            fprintf(stderr, "bad --bench list: %s\n", sizes);
+            return ERR_INVALID_PARAM;
+        }
+        if (n <= 0) continue;
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return ERR_FORK;
+        }
+        if (pid == 0) {
+            bench(n);
+            exit(0);
+        }
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "benchmark of %d jobs failed\n", n);
+            return ERR_EXEC;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -43,6 +43,7 @@
 #include "str_util.h"
 #include "util.h"
 
+#include "async_file.h"
 #include "client_msgs.h"
 #include "client_state.h"
 #include "log_flags.h"
@@ -103,6 +104,7 @@ void show_message(PROJ_AM *p, char* msg, int priority, bool, const char*) {
 APP_CLIENT_SHM::APP_CLIENT_SHM() {}
 GRAPHICS_MSG::GRAPHICS_MSG() {}
 int FILE_INFO::verify_file(bool, bool, bool) {return 0;}
+int async_delete_dir(const char*, const char*) {return 0;}
 
 
 //////////////// FUNCTIONS WE NEED TO IMPLEMENT /////////////
@@ -22,11 +22,25 @@
 // runs program at Full-Path with args X1. ... Xn
 // note that the executable name nust be specified twice:
 //  once as part of the Full_Path and again as just the name
+//
+// When run as
+// switcher --helper
+// reads commands from stdin and writes a reply line
+// (0 or an errno) for each to stdout, until EOF.
+// The client runs it this way over a socket (see sandbox.cpp)
+// to avoid running switcher for each kill or delete.
+// Commands:
+// kill pid signal
+// rm path      (like rm -fR)
 
 #include <unistd.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
+#include <csignal>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <pwd.h>    // getpwuid
 #include <grp.h>
 
@@ -36,6 +50,58 @@
 
 using std::strcpy;
 
+// delete a file, or a directory and its contents.
+// Don't follow symbolic links.
+//
+static int delete_tree(const char* path) {
+    struct stat sbuf;
+    char subpath[MAXPATHLEN];
+    int retval = 0;
+
+    if (lstat(path, &sbuf)) {
+        return (errno == ENOENT)?0:errno;
+    }
+    if (!S_ISDIR(sbuf.st_mode)) {
+        return unlink(path)?errno:0;
+    }
+    DIR* dirp = opendir(path);
+    if (!dirp) return errno;
+    while (struct dirent* dp = readdir(dirp)) {
+        if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+        snprintf(subpath, sizeof(subpath), "%s/%s", path, dp->d_name);
+        int x = delete_tree(subpath);
+        if (x) retval = x;
+    }
+    closedir(dirp);
+    if (rmdir(path) && !retval) retval = errno;
+    return retval;
+}
+
+static void run_helper() {
+    char buf[MAXPATHLEN+64];
+    int pid, sig, retval;
+
+    while (fgets(buf, sizeof(buf), stdin)) {
+        char* p = strchr(buf, '\n');
+        if (p) *p = 0;
+        if (!strncmp(buf, "kill ", 5)) {
+            // pid must be positive: 0 or -1 would signal groups
+            //
+            if (sscanf(buf+5, "%d %d", &pid, &sig) == 2 && pid > 0) {
+                retval = kill(pid, sig)?errno:0;
+            } else {
+                retval = EINVAL;
+            }
+        } else if (!strncmp(buf, "rm ", 3)) {
+            retval = delete_tree(buf+3);
+        } else {
+            retval = EINVAL;
+        }
+        printf("%d\n", retval);
+        fflush(stdout);
+    }
+}
+
 int main(int /*argc*/, char** argv) {
     passwd          *pw;
     group           *grp;
@@ -87,6 +153,11 @@ int main(int /*argc*/, char** argv) {
         (void) setuid(pw->pw_uid);
     }
 
+    if (argv[1] && !strcmp(argv[1], "--helper")) {
+        run_helper();
+        return 0;
+    }
+
     // For unknown reasons, the LD_LIBRARY_PATH and DYLD_LIBRARY_PATH
     // environment variables are not passed in to switcher, though all
     // other environment variables do get propagated.  So we recreate
@@ -259,7 +259,7 @@ void RSC_WORK_FETCH::set_request_excluded(PROJECT* p) {
     if (p->resource_share == 0 || config.fetch_minimal_work) {
         req_secs = 1;
     } else {
-        req_secs = n*gstate.work_buf_total();
+        req_secs = n*gstate.work_fetch_buf_total();
     }
 }
 
@@ -315,6 +315,7 @@ int PROJECT_WORK_FETCH::compute_cant_fetch_work_reason(PROJECT* p) {
     if (p->some_download_stalled()) return CANT_FETCH_WORK_DOWNLOAD_STALLED;
     if (p->some_result_suspended()) return CANT_FETCH_WORK_RESULT_SUSPENDED;
     if (p->too_many_uploading_results) return CANT_FETCH_WORK_TOO_MANY_UPLOADS;
+    if (gstate.scheduler_ops->lookup(p)) return CANT_FETCH_WORK_RPC_IN_PROGRESS;
 
     // this goes last
     //
@@ -392,7 +393,7 @@ void WORK_FETCH::set_all_requests_hyst(PROJECT* p, int rsc_type) {
         } else {
             // don't fetch work for a resource if the buffer is above max
             //
-            if (rsc_work_fetch[i].saturated_time > gstate.work_buf_total()) {
+            if (rsc_work_fetch[i].saturated_time > gstate.work_fetch_buf_total()) {
                 continue;
             }
             
@@ -512,7 +513,7 @@ void WORK_FETCH::piggyback_work_request(PROJECT* p) {
             DEBUG(msg_printf(p, MSG_INFO, "piggyback: can't fetch %s", rsc_name(i));)
             continue;
         }
-        bool buffer_low = (rwf.saturated_time < gstate.work_buf_total());
+        bool buffer_low = (rwf.saturated_time < gstate.work_fetch_buf_total());
         bool need_work = buffer_low;
         if (rwf.has_exclusions && rwf.uses_starved_excluded_instances(p)) {
             need_work = true;
@@ -774,7 +775,7 @@ PROJECT* WORK_FETCH::choose_project() {
                         DEBUG(msg_printf(p, MSG_INFO, "%s not high prio proj", rsc_name(i));)
                         continue;
                     }
-                    buffer_low = (rwf.saturated_time < gstate.work_buf_total());
+                    buffer_low = (rwf.saturated_time < gstate.work_fetch_buf_total());
                     bool need_work = buffer_low;
                     if (rwf.has_exclusions && rwf.uses_starved_excluded_instances(p)) {
                         need_work = true;
@@ -1085,6 +1086,21 @@ double CLIENT_STATE::overall_cpu_and_network_frac() {
     return x;
 }
 
+// Work fetch starts when a resource's buffer is below work_buf_min
+// and fills it to this.
+// If the gap is tiny, there's an RPC every time a job finishes;
+// with <fetch_hysteresis>, make it at least
+// WORK_BUF_MIN_HYSTERESIS*work_buf_min
+//
+double CLIENT_STATE::work_fetch_buf_total() {
+    double x = work_buf_total();
+    if (config.fetch_hysteresis) {
+        double y = (1+WORK_BUF_MIN_HYSTERESIS)*work_buf_min();
+        if (x < y) x = y;
+    }
+    return x;
+}
+
 // called when benchmarks change
 //
 void CLIENT_STATE::scale_duration_correction_factors(double factor) {
@@ -1094,6 +1110,11 @@ void CLIENT_STATE::scale_duration_correction_factors(double factor) {
         if (p->dont_use_dcf) continue;
         p->duration_correction_factor *= factor;
     }
+    for (unsigned int i=0; i<app_versions.size(); i++) {
+        APP_VERSION* avp = app_versions[i];
+        if (avp->project->dont_use_dcf) continue;
+        avp->dcf *= factor;
+    }
     if (log_flags.dcf_debug) {
         msg_printf(NULL, MSG_INFO,
             "[dcf] scaling all duration correction factors by %f",
@@ -40,6 +40,7 @@
 #define CANT_FETCH_WORK_NOT_HIGHEST_PRIORITY        9
 #define CANT_FETCH_WORK_DONT_NEED                   10
 #define CANT_FETCH_WORK_TOO_MANY_RUNNABLE           11
+#define CANT_FETCH_WORK_RPC_IN_PROGRESS             12
 
 inline const char* cant_fetch_work_string(int reason) {
     switch (reason) {
@@ -65,6 +66,8 @@ inline const char* cant_fetch_work_string(int reason) {
         return "don't need";
     case CANT_FETCH_WORK_TOO_MANY_RUNNABLE:
         return "too many runnable tasks";
+    case CANT_FETCH_WORK_RPC_IN_PROGRESS:
+        return "scheduler request in progress";
     }
     return "";
 }
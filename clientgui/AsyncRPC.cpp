@@ -464,6 +464,12 @@ int RPCThread::ProcessRPCRequest() {
 
 // TODO: combine RPC requests for different buffers, then just copy the buffer.
 
+// is this queued request the one the RPC thread is doing?
+//
+bool CMainDocument::IsActiveRequest(ASYNC_RPC_REQUEST& request) {
+    return current_rpc_request.isActive && request.isSameAs(current_rpc_request);
+}
+
 int CMainDocument::RequestRPC(ASYNC_RPC_REQUEST& request, bool hasPriority) {
     std::vector<ASYNC_RPC_REQUEST>::iterator iter;
     int retval = 0;
@@ -490,22 +496,38 @@ int CMainDocument::RequestRPC(ASYNC_RPC_REQUEST& request, bool hasPriority) {
         }
     }
     
-    // Check if a duplicate request is already on the queue
+    // Check if a duplicate request is already on the queue.
+    // For periodic refreshes (those with a completionTime)
+    // a queued request that updates the same cache is a duplicate,
+    // even if its other args differ.
     for (iter=RPC_requests.begin(); iter!=RPC_requests.end(); iter++) {
         if (iter->isSameAs(request)) {
             return 0;
         }
+        if (request.completionTime
+            && (iter->completionTime == request.completionTime)
+            && (iter->which_rpc == request.which_rpc)
+            && !IsActiveRequest(*iter)
+        ) {
+            return 0;
+        }
     }
 
     if ((request.rpcType == RPC_TYPE_WAIT_FOR_COMPLETION) && (request.resultPtr == NULL)) {
         request.resultPtr = &retval;
     }
     
-    if (hasPriority) {
-        // We may want to set hasPriority for some user-initiated events. 
-        // Since the user is waiting, insert this at head of request queue.
-        // As of 8/14/08, hasPriority is never set true, so hasn't been tested.
-        iter = RPC_requests.insert(RPC_requests.begin(), request);
+    if (hasPriority || (request.rpcType == RPC_TYPE_WAIT_FOR_COMPLETION)) {
+        // The user is waiting, so put this ahead of queued periodic
+        // refreshes, but behind the request in progress and other
+        // non-periodic requests (so those are still done in order).
+        size_t i, pos = 0;
+        for (i=0; i<RPC_requests.size(); i++) {
+            if (IsActiveRequest(RPC_requests[i]) || !RPC_requests[i].completionTime) {
+                pos = i+1;
+            }
+        }
+        iter = RPC_requests.insert(RPC_requests.begin()+pos, request);
     } else {
            RPC_requests.push_back(request);
     }
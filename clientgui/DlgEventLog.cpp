@@ -37,6 +37,8 @@
 #include "DlgEventLog.h"
 #include "AdvancedFrame.h"
 #include <wx/display.h>
+#include <algorithm>
+#include <iterator>
 
 
 ////@begin includes
@@ -119,7 +121,7 @@ CDlgEventLog::~CDlgEventLog() {
         m_pMessageErrorGrayAttr = NULL;
     }
 
-    m_iFilteredIndexes.Clear();
+    m_iFilteredSeqNums.clear();
 
     wxGetApp().OnEventLogClose();
 
@@ -149,7 +151,8 @@ bool CDlgEventLog::Create( wxWindow* parent, wxWindowID id, const wxString& capt
     if (!s_bIsFiltered) {
         s_strFilteredProjectName.clear();
     }
-    m_iFilteredIndexes.Clear();
+    m_iFilteredSeqNums.clear();
+    ResetMessageIndex();
 	m_bProcessingRefreshEvent = false;
     m_bWasConnected = false;
     m_bEventLogIsOpen = true;
@@ -431,10 +434,12 @@ void CDlgEventLog::OnMessagesFilter( wxCommandEvent& WXUNUSED(event) ) {
 
     wxInt32 iIndex = -1;
     MESSAGE* message;
+    CMainDocument* pDoc     = wxGetApp().GetDocument();
+    wxASSERT(pDoc);
     
     wxASSERT(m_pList);
 
-    m_iFilteredIndexes.Clear();
+    m_iFilteredSeqNums.clear();
     s_strFilteredProjectName.clear();
     m_iTotalDeletedFilterRows = 0;
 
@@ -444,18 +449,24 @@ void CDlgEventLog::OnMessagesFilter( wxCommandEvent& WXUNUSED(event) ) {
     } else {
         iIndex = m_pList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
         if (iIndex >= 0) {
-             message = wxGetApp().GetDocument()->message(iIndex);
-             if ((message->project).size() > 0) {
+             message = pDoc->message(iIndex);
+             if (message && (message->project).size() > 0) {
                 s_strFilteredProjectName = message->project;
                 s_bIsFiltered = true;
-                for (iIndex = 0; iIndex < m_iTotalDocCount; iIndex++) {
-                    message = wxGetApp().GetDocument()->message(iIndex);
-                    if (message->project.empty() || (message->project == s_strFilteredProjectName)) {
-                        m_iFilteredIndexes.Add(iIndex);
-                    }
 
-                }
-                m_iFilteredDocCount = (int)(m_iFilteredIndexes.GetCount());
+                // merge the project's messages with the general ones,
+                // up to the last one GetDocCount() has seen
+                std::vector<int>& proj = m_ProjectSeqNums[s_strFilteredProjectName];
+                std::vector<int>& general = m_ProjectSeqNums[""];
+                int first = pDoc->GetFirstMsgSeqNum();
+                std::merge(
+                    std::lower_bound(proj.begin(), proj.end(), first),
+                    std::upper_bound(proj.begin(), proj.end(), m_iPreviousLastMsgSeqNum),
+                    std::lower_bound(general.begin(), general.end(), first),
+                    std::upper_bound(general.begin(), general.end(), m_iPreviousLastMsgSeqNum),
+                    std::back_inserter(m_iFilteredSeqNums)
+                );
+                m_iFilteredDocCount = (int)(m_iFilteredSeqNums.size());
            }
         }
     }
@@ -473,11 +484,60 @@ void CDlgEventLog::OnMessagesFilter( wxCommandEvent& WXUNUSED(event) ) {
 
 
 wxInt32 CDlgEventLog::GetFilteredMessageIndex( wxInt32 iRow) const {
-    if (s_bIsFiltered) return m_iFilteredIndexes[iRow];
+    if (s_bIsFiltered) {
+        if ((iRow < 0) || (iRow >= (int)m_iFilteredSeqNums.size())) return -1;
+        return m_iFilteredSeqNums[iRow] - wxGetApp().GetDocument()->GetFirstMsgSeqNum();
+    }
     return iRow;
 }
 
 
+void CDlgEventLog::ResetMessageIndex() {
+    m_ProjectSeqNums.clear();
+    m_iIndexedSeqNum = 0;
+    m_RowCache.clear();
+}
+
+
+// Add new messages to the index of messages by project,
+// so that changing the filter doesn't have to look at every message.
+// Start over if the Manager's messages were reset
+// (e.g. the client was restarted).
+//
+void CDlgEventLog::UpdateMessageIndex() {
+    CMainDocument* pDoc     = wxGetApp().GetDocument();
+    int i, first = pDoc->GetFirstMsgSeqNum();
+    std::map<std::string, std::vector<int> >::iterator it;
+
+    if (m_iTotalDocCount <= 0) {
+        ResetMessageIndex();
+        return;
+    }
+    if ((pDoc->GetLastMsgSeqNum() < m_iIndexedSeqNum) || (first > m_iIndexedSeqNum + 1)) {
+        ResetMessageIndex();
+    }
+    i = m_iIndexedSeqNum + 1 - first;
+    if (i < 0) i = 0;
+    for (; i < m_iTotalDocCount; i++) {
+        MESSAGE* message = pDoc->message(i);
+        if (!message) break;
+        m_ProjectSeqNums[message->project].push_back(message->seqno);
+        m_iIndexedSeqNum = message->seqno;
+    }
+
+    // remove deleted messages once they're half of a project's list,
+    // so this takes constant time per message
+    //
+    for (it = m_ProjectSeqNums.begin(); it != m_ProjectSeqNums.end(); it++) {
+        std::vector<int>& v = it->second;
+        std::vector<int>::iterator end = std::lower_bound(v.begin(), v.end(), first);
+        if ((end - v.begin()) * 2 > (int)v.size()) {
+            v.erase(v.begin(), end);
+        }
+    }
+}
+
+
 // NOTE: this function is designed to be called only
 // from CDlgEventLog::OnRefresh().  If you need to call it
 // from other routines, it will need modification.
@@ -498,32 +558,32 @@ wxInt32 CDlgEventLog::GetDocCount() {
     }
     m_iNumDeletedFilteredRows = 0;
 
+    UpdateMessageIndex();
+
     if (s_bIsFiltered) {
         if (numDeletedRows > 0) {
-            // Remove any deleted messages from our filtered list
-            while (m_iFilteredIndexes.GetCount() > 0) {
-                if (m_iFilteredIndexes[0] >= numDeletedRows) break;
-                m_iFilteredIndexes.RemoveAt(0);
-                m_iNumDeletedFilteredRows++;
-                m_iTotalDeletedFilterRows++;
-            }
-            
-            // Adjust the remaining indexes
-            for (i = m_iFilteredIndexes.GetCount()-1; i >= 0; i--) {
-                m_iFilteredIndexes[i] -= numDeletedRows;
-            }
+            // Remove any deleted messages from our filtered list.
+            // It has sequence numbers, so the others don't change
+            std::vector<int>::iterator it = std::lower_bound(
+                m_iFilteredSeqNums.begin(), m_iFilteredSeqNums.end(),
+                pDoc->GetFirstMsgSeqNum()
+            );
+            j = (int)(it - m_iFilteredSeqNums.begin());
+            m_iFilteredSeqNums.erase(m_iFilteredSeqNums.begin(), it);
+            m_iNumDeletedFilteredRows += j;
+            m_iTotalDeletedFilterRows += j;
         }
         
-        // Add indexes of new messages to filtered list as appropriate
+        // Add new messages to filtered list as appropriate
         i = m_iTotalDocCount - (pDoc->GetLastMsgSeqNum() - m_iPreviousLastMsgSeqNum);
         if (i < 0) i = 0;
         for (; i < m_iTotalDocCount; i++) {
             MESSAGE* message = pDoc->message(i);
             if (message->project.empty() || (message->project == s_strFilteredProjectName)) {
-                m_iFilteredIndexes.Add(i);
+                m_iFilteredSeqNums.push_back(message->seqno);
             }
         }
-        m_iFilteredDocCount = (int)(m_iFilteredIndexes.GetCount());
+        m_iFilteredDocCount = (int)(m_iFilteredSeqNums.size());
     } else {
         m_iFilteredDocCount = m_iTotalDocCount;
         m_iNumDeletedFilteredRows = numDeletedRows;
@@ -578,6 +638,7 @@ void CDlgEventLog::OnRefresh() {
         if (0 >= iRowCount) {
             m_pList->DeleteAllItems();
             ResetMessageFiltering();
+            ResetMessageIndex();
             m_iPreviousFirstMsgSeqNum = 0;
             m_iPreviousLastMsgSeqNum = 0;
         } else {
@@ -589,6 +650,7 @@ void CDlgEventLog::OnRefresh() {
                     strLastMachineName = strNewMachineName;
                     m_bWasConnected = false;
                     ResetMessageFiltering();
+                    ResetMessageIndex();
                     m_iPreviousFirstMsgSeqNum = pDoc->GetFirstMsgSeqNum();
                     m_iPreviousLastMsgSeqNum = m_iPreviousFirstMsgSeqNum - 1;
                     iRowCount = m_iTotalDocCount;   // In case we had filtering set
@@ -895,7 +957,7 @@ void CDlgEventLog::OnColResize( wxListEvent& ) {
 void CDlgEventLog::ResetMessageFiltering() {
     s_bIsFiltered = false;
     s_strFilteredProjectName.clear();
-    m_iFilteredIndexes.Clear();
+    m_iFilteredSeqNums.clear();
     SetFilterButtonText();
     m_iTotalDeletedFilterRows = 0;
 }
@@ -913,7 +975,7 @@ void CDlgEventLog::UpdateButtons() {
         if ((n == 1) && (! s_bIsFiltered)) {
             n = m_pList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
             MESSAGE* message = wxGetApp().GetDocument()->message(n);
-            if ((message->project).size() > 0) {
+            if (message && (message->project).size() > 0) {
                 enableFilterButton = true;
             }
         }
@@ -923,19 +985,42 @@ void CDlgEventLog::UpdateButtons() {
 }
 
 
+// The list is virtual, so rows are formatted only when shown;
+// keep them, since the visible rows are redrawn for each new message
+//
+const EVENT_LOG_ROW* CDlgEventLog::GetRow(long item) const {
+    wxInt32         index       = GetFilteredMessageIndex(item);
+    MESSAGE*        message     = wxGetApp().GetDocument()->message(index);
+
+    if (!message) return NULL;
+    std::map<int, EVENT_LOG_ROW>::iterator it = m_RowCache.find(message->seqno);
+    if (it != m_RowCache.end()) return &(it->second);
+
+    if (m_RowCache.size() >= EVENT_LOG_ROW_CACHE_SIZE) {
+        m_RowCache.clear();
+    }
+    EVENT_LOG_ROW& row = m_RowCache[message->seqno];
+    FormatProjectName(index, row.project);
+    FormatTime(index, row.time);
+    FormatMessage(index, row.message);
+    return &row;
+}
+
+
 wxString CDlgEventLog::OnListGetItemText(long item, long column) const {
     wxString        strBuffer   = wxEmptyString;
-    wxInt32         index       = GetFilteredMessageIndex(item);
+    const EVENT_LOG_ROW* row    = GetRow(item);
 
+    if (!row) return strBuffer;
     switch(column) {
     case COLUMN_PROJECT:
-        FormatProjectName(index, strBuffer);
+        strBuffer = row->project;
         break;
     case COLUMN_TIME:
-        FormatTime(index, strBuffer);
+        strBuffer = row->time;
         break;
     case COLUMN_MESSAGE:
-        FormatMessage(index, strBuffer);
+        strBuffer = row->message;
         break;
     }
 
@@ -39,6 +39,9 @@
 
 ////@begin includes
 ////@end includes
+#include <map>
+#include <string>
+#include <vector>
 
 /*!
  * Forward declarations
@@ -74,6 +77,15 @@ class CDlgEventLogListCtrl;
 #define wxFIXED_MINSIZE 0
 #endif
 
+// formatted rows are kept for repainting; start over past this many
+#define EVENT_LOG_ROW_CACHE_SIZE 1000
+
+struct EVENT_LOG_ROW {
+    wxString project;
+    wxString time;
+    wxString message;
+};
+
 class CDlgEventLog : public wxDialog
 {
     DECLARE_DYNAMIC_CLASS( CDlgEventLog )
@@ -147,7 +159,15 @@ private:
     wxInt32                 m_iPreviousDocCount;
 
     CDlgEventLogListCtrl*   m_pList;
-    wxArrayInt              m_iFilteredIndexes;
+    std::vector<int>        m_iFilteredSeqNums;
+        // sequence numbers of the messages shown when filtered,
+        // so they stay valid as old messages are deleted
+    std::map<std::string, std::vector<int> > m_ProjectSeqNums;
+        // sequence numbers of messages by project ("" for general ones)
+    wxInt32                 m_iIndexedSeqNum;
+        // the last message added to m_ProjectSeqNums
+    mutable std::map<int, EVENT_LOG_ROW> m_RowCache;
+        // formatted rows by sequence number
     wxInt32                 m_iTotalDocCount;
     wxInt32                 m_iFilteredDocCount;
     wxInt32                 m_iPreviousFirstMsgSeqNum;
@@ -179,6 +199,9 @@ private:
     void                    OnMouseUp(wxMouseEvent& event);
 
     void                    ResetMessageFiltering();    
+    void                    ResetMessageIndex();
+    void                    UpdateMessageIndex();
+    const EVENT_LOG_ROW*    GetRow( long item ) const;
     
     bool                    EnsureLastItemVisible();
     wxInt32                 FormatProjectName( wxInt32 item, wxString& strBuffer ) const;
@@ -188,6 +188,7 @@ public:
     //
 public:
     int                         RequestRPC(ASYNC_RPC_REQUEST& request, bool hasPriority = false);
+    bool                        IsActiveRequest(ASYNC_RPC_REQUEST& request);
     void                        OnRPCComplete(CRPCFinishedEvent& event);
     ASYNC_RPC_REQUEST*          GetCurrentRPCRequest() { return &current_rpc_request; }
     bool                        WaitingForRPC() { return m_bWaitingForRPC; }
@@ -889,17 +889,25 @@ bool CViewWork::SynchronizeCacheItem(wxInt32 iRowIndex, wxInt32 iColumnIndex) {
     float       fDocumentFloat = 0.0;
     time_t      tDocumentTime = (time_t)0;
     CWork*      work;
+    std::string key;
 
     strDocumentText.Empty();
 
      if (GetWorkCacheAtIndex(work, m_iSortedIndexes[iRowIndex])) {
         return false;
     }
+    RESULT* result = wxGetApp().GetDocument()->result(m_iSortedIndexes[iRowIndex]);
         
    switch (iColumnIndex) {
         case COLUMN_PROJECT:
+            if (result) {
+                key = result->project_url;
+                if (key == work->m_sProjectNameKey) break;
+            }
             GetDocProjectName(m_iSortedIndexes[iRowIndex], strDocumentText);
             GetDocProjectURL(m_iSortedIndexes[iRowIndex], strDocumentText2);
+            // if the lookup failed, try again next time
+            work->m_sProjectNameKey = strDocumentText.IsEmpty()?"":key;
             if (!strDocumentText.IsSameAs(work->m_strProjectName) || !strDocumentText2.IsSameAs(work->m_strProjectURL)) {
                 work->m_strProjectName = strDocumentText;
                 work->m_strProjectURL = strDocumentText2;
@@ -907,7 +915,12 @@ bool CViewWork::SynchronizeCacheItem(wxInt32 iRowIndex, wxInt32 iColumnIndex) {
             }
             break;
         case COLUMN_APPLICATION:
+            if (result) {
+                key = std::string(result->project_url) + " " + result->name;
+                if (key == work->m_sApplicationNameKey) break;
+            }
             GetDocApplicationName(m_iSortedIndexes[iRowIndex], strDocumentText);
+            work->m_sApplicationNameKey = strDocumentText.IsEmpty()?"":key;
             if (!strDocumentText.IsSameAs(work->m_strApplicationName)) {
                 work->m_strApplicationName = strDocumentText;
                 return true;
@@ -953,8 +966,6 @@ bool CViewWork::SynchronizeCacheItem(wxInt32 iRowIndex, wxInt32 iColumnIndex) {
             }
             break;
         case COLUMN_STATUS:
-            int i = m_iSortedIndexes[iRowIndex];
-            RESULT* result = wxGetApp().GetDocument()->result(i);
             strDocumentText = result_description(result);
             if (!strDocumentText.IsSameAs(work->m_strStatus)) {
                 work->m_strStatus = strDocumentText;
@@ -45,6 +45,14 @@ public:
     wxString m_strProgress;
     wxString m_strTimeToCompletion;
     wxString m_strReportDeadline;
+
+    // The project and application names come from lookups in the state,
+    // which are slow with lots of results.
+    // These say what the names were looked up for
+    // (project URL; project URL and result name)
+    // so we can skip the lookups if the row shows the same result
+    std::string m_sProjectNameKey;
+    std::string m_sApplicationNameKey;
 };
 
 
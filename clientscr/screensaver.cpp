@@ -406,6 +406,12 @@ DataMgmtProcType CScreensaver::DataManagementProc() {
     bool            switch_to_default_gfx       = false;
     bool            killing_default_gfx         = false;
     int             exit_status                 = 0;
+    // get the task list when events say tasks have changed,
+    // rather than every second
+    bool            need_tasks                  = true;
+    double          last_tasks_time             = 0.0;
+    double          next_subscribe_time         = 0.0;
+    std::vector<std::string> events;
     
     char*           default_ss_dir_path         = NULL;
     char            full_path[1024];
@@ -513,14 +519,46 @@ DataMgmtProcType CScreensaver::DataManagementProc() {
                     m_bResetCoreState = false;
                 }
             }
+
+            // The subscription is lost if the connection was reopened
+            //
+            if (!rpc->subscribed && dtime() > next_subscribe_time) {
+                if (rpc->subscribe()) {
+                    next_subscribe_time = dtime() + SS_SUBSCRIBE_RETRY_PERIOD;
+                }
+                need_tasks = true;
+            }
+            if (rpc->subscribed) {
+                retval = rpc->get_events(events);
+                if (retval) {
+                    HandleRPCError();
+                    m_bResetCoreState = true;
+                    continue;
+                }
+                for (unsigned int j=0; j<events.size(); j++) {
+                    // task started, stopped or suspended, or run mode changed
+                    if (strstr(events[j].c_str(), "<task>") || strstr(events[j].c_str(), "<run_mode>")) {
+                        need_tasks = true;
+                    }
+                }
+                if (dtime() > last_tasks_time + SS_TASKS_REFRESH_PERIOD) {
+                    need_tasks = true;
+                }
+            } else {
+                need_tasks = true;
+            }
     
             // Update our task list
-            retval = rpc->get_screensaver_tasks(suspend_reason, results);
-            if (retval) {
-                // rpc call returned error
-                HandleRPCError();
-                m_bResetCoreState = true;
-                continue;
+            if (need_tasks) {
+                retval = rpc->get_screensaver_tasks(suspend_reason, results);
+                if (retval) {
+                    // rpc call returned error
+                    HandleRPCError();
+                    m_bResetCoreState = true;
+                    continue;
+                }
+                need_tasks = false;
+                last_tasks_time = dtime();
             }
         } else {
             results.clear();
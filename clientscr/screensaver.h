@@ -25,6 +25,12 @@
 #define GFX_SCIENCE_PERIOD 600 /* Display various science graphics apps for 10 minutes */
 #define GFX_CHANGE_PERIOD 300  /* if > 1 CPUs, change screensaver every 5 minutes */
 
+// If the client sends events, get the task list when they say
+// tasks have changed, and at least this often (seconds)
+#define SS_TASKS_REFRESH_PERIOD 60
+// If it doesn't (older client), ask again after this long
+#define SS_SUBSCRIBE_RETRY_PERIOD 600
+
 enum SS_PHASE {
     DEFAULT_SS_PHASE,
     SCIENCE_SS_PHASE
@@ -76,7 +76,30 @@ void MSG_TO_HOST::clear() {memset(this, 0, sizeof(*this));}
 void ASSIGNMENT::clear() {memset(this, 0, sizeof(*this));}
 void TRANSITIONER_ITEM::clear() {memset(this, 0, sizeof(*this));}
 void VALIDATOR_ITEM::clear() {memset(this, 0, sizeof(*this));}
-void SCHED_RESULT_ITEM::clear() {memset(this, 0, sizeof(*this));}
+void SCHED_RESULT_ITEM::clear() {
+    strcpy(queried_name, "");
+    id = 0;
+    strcpy(name, "");
+    workunitid = 0;
+    appid = 0;
+    server_state = 0;
+    client_state = 0;
+    validate_state = 0;
+    outcome = 0;
+    hostid = 0;
+    userid = 0;
+    teamid = 0;
+    sent_time = 0;
+    received_time = 0;
+    cpu_time = 0;
+    xml_doc_out.clear();
+    stderr_out.clear();
+    app_version_num = 0;
+    exit_status = 0;
+    file_delete_state = 0;
+    elapsed_time = 0;
+    app_version_id = 0;
+}
 void HOST_APP_VERSION::clear() {memset(this, 0, sizeof(*this));}
 void USER_SUBMIT::clear() {memset(this, 0, sizeof(*this));}
 void STATE_COUNTS::clear() {memset(this, 0, sizeof(*this));}
@@ -126,13 +149,17 @@ DB_USER_SUBMIT::DB_USER_SUBMIT(DB_CONN* dc) :
 DB_STATE_COUNTS::DB_STATE_COUNTS(DB_CONN* dc) :
     DB_BASE("state_counts", dc?dc:&boinc_db){}
 DB_TRANSITIONER_ITEM_SET::DB_TRANSITIONER_ITEM_SET(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:&boinc_db){
+    batch_size = 1;
+}
 DB_VALIDATOR_ITEM_SET::DB_VALIDATOR_ITEM_SET(DB_CONN* dc) :
     DB_BASE_SPECIAL(dc?dc:&boinc_db){}
 DB_WORK_ITEM::DB_WORK_ITEM(DB_CONN* dc) :
     DB_BASE_SPECIAL(dc?dc:&boinc_db
 ){
     start_id = 0;
+    start_priority = 0;
+    keyset_started = false;
 }
 DB_IN_PROGRESS_RESULT::DB_IN_PROGRESS_RESULT(DB_CONN* dc) :
     DB_BASE_SPECIAL(dc?dc:&boinc_db){}
@@ -572,6 +599,7 @@ void DB_HOST::db_parse(MYSQL_ROW &r) {
     _max_results_day = atoi(r[i++]);
     _error_rate = atof(r[i++]);
     strcpy2(product_name, r[i++]);
+    msgs_pending = atoi(r[i++]);
 }
 
 int DB_HOST::update_diff_validator(HOST& h) {
@@ -833,6 +861,51 @@ int DB_HOST::fpops_stddev(double& stddev) {
     return get_double(query, stddev);
 }
 
+// helpers for update_diff() functions:
+// append "name=value," to updates if the value has changed
+//
+static void diff_int(string& updates, const char* name, int x, int y) {
+    char buf[256];
+    if (x == y) return;
+    sprintf(buf, " %s=%d,", name, x);
+    updates += buf;
+}
+
+static void diff_double(string& updates, const char* name, double x, double y) {
+    char buf[256];
+    if (x == y) return;
+    sprintf(buf, " %s=%.15e,", name, x);
+    updates += buf;
+}
+
+static void diff_str(
+    string& updates, const char* name, const char* x, const char* y
+) {
+    if (!strcmp(x, y)) return;
+    int len = 2*strlen(x) + 3;
+    char* buf = (char*)malloc(len);
+    strcpy(buf, x);
+    escape_string(buf, len);
+    updates += " ";
+    updates += name;
+    updates += "='";
+    updates += buf;
+    updates += "',";
+    free(buf);
+}
+
+static int update_diff_query(
+    DB_CONN* db, const char* table, int id, string& updates
+) {
+    char buf[256];
+    if (updates.empty()) return 0;
+    updates.erase(updates.size()-1);    // trim the final comma
+    sprintf(buf, " where id=%d", id);
+    string query = string("update ") + table + " set" + updates + buf;
+    return db->do_query(query.c_str());
+}
+
+
 void DB_WORKUNIT::db_print(char* buf){
     sprintf(buf,
         "create_time=%d, appid=%d, "
@@ -876,6 +949,39 @@ void DB_WORKUNIT::db_print(char* buf){
     );
 }
 
+// a value list, for insert_batch()
+//
+void DB_WORKUNIT::db_print_values(char* buf){
+    sprintf(buf,
+        "(0, %d, %d, "
+        "'%s', '%s', %d, "
+        "%.15e, %.15e, %.15e, %.15e, "
+        "%d, "
+        "%u, %.15e, "
+        "%d, %d, "
+        "%d, %d, %d, "
+        "%d, %.15e, "
+        "%d, %d, %d, "
+        "%d, %d, "
+        "'%s', "
+        "%d, NOW(), %.15e, "
+        "%d, %d, %d, %d)",
+        create_time, appid,
+        name, xml_doc, batch,
+        rsc_fpops_est, rsc_fpops_bound, rsc_memory_bound, rsc_disk_bound,
+        need_validate,
+        canonical_resultid, canonical_credit,
+        transition_time, delay_bound,
+        error_mask, file_delete_state, assimilate_state,
+        hr_class, opaque,
+        min_quorum, target_nresults, max_error_results,
+        max_total_results, max_success_results,
+        result_template_file,
+        priority, rsc_bandwidth_bound,
+        fileset_id, app_version_id, transitioner_flags, size_class
+    );
+}
+
 void DB_WORKUNIT::db_parse(MYSQL_ROW &r) {
     int i=0;
     clear();
@@ -914,6 +1020,46 @@ void DB_WORKUNIT::db_parse(MYSQL_ROW &r) {
     size_class = atoi(r[i++]);
 }
 
+// Update the fields that differ from the argument
+// (typically a copy of the record made when it was read).
+// An unchanged xml_doc isn't sent to the DB.
+//
+int DB_WORKUNIT::update_diff(WORKUNIT& w) {
+    string updates;
+    diff_int(updates, "create_time", create_time, w.create_time);
+    diff_int(updates, "appid", appid, w.appid);
+    diff_str(updates, "name", name, w.name);
+    diff_str(updates, "xml_doc", xml_doc, w.xml_doc);
+    diff_int(updates, "batch", batch, w.batch);
+    diff_double(updates, "rsc_fpops_est", rsc_fpops_est, w.rsc_fpops_est);
+    diff_double(updates, "rsc_fpops_bound", rsc_fpops_bound, w.rsc_fpops_bound);
+    diff_double(updates, "rsc_memory_bound", rsc_memory_bound, w.rsc_memory_bound);
+    diff_double(updates, "rsc_disk_bound", rsc_disk_bound, w.rsc_disk_bound);
+    diff_int(updates, "need_validate", need_validate, w.need_validate);
+    diff_int(updates, "canonical_resultid", canonical_resultid, w.canonical_resultid);
+    diff_double(updates, "canonical_credit", canonical_credit, w.canonical_credit);
+    diff_int(updates, "transition_time", transition_time, w.transition_time);
+    diff_int(updates, "delay_bound", delay_bound, w.delay_bound);
+    diff_int(updates, "error_mask", error_mask, w.error_mask);
+    diff_int(updates, "file_delete_state", file_delete_state, w.file_delete_state);
+    diff_int(updates, "assimilate_state", assimilate_state, w.assimilate_state);
+    diff_int(updates, "hr_class", hr_class, w.hr_class);
+    diff_double(updates, "opaque", opaque, w.opaque);
+    diff_int(updates, "min_quorum", min_quorum, w.min_quorum);
+    diff_int(updates, "target_nresults", target_nresults, w.target_nresults);
+    diff_int(updates, "max_error_results", max_error_results, w.max_error_results);
+    diff_int(updates, "max_total_results", max_total_results, w.max_total_results);
+    diff_int(updates, "max_success_results", max_success_results, w.max_success_results);
+    diff_str(updates, "result_template_file", result_template_file, w.result_template_file);
+    diff_int(updates, "priority", priority, w.priority);
+    diff_double(updates, "rsc_bandwidth_bound", rsc_bandwidth_bound, w.rsc_bandwidth_bound);
+    diff_int(updates, "fileset_id", fileset_id, w.fileset_id);
+    diff_int(updates, "app_version_id", app_version_id, w.app_version_id);
+    diff_int(updates, "transitioner_flags", transitioner_flags, w.transitioner_flags);
+    diff_int(updates, "size_class", size_class, w.size_class);
+    return update_diff_query(db, "workunit", id, updates);
+}
+
 void DB_CREDITED_JOB::db_print(char* buf){
     sprintf(buf,
         "userid=%d, workunitid=%f",
@@ -1015,6 +1161,7 @@ int DB_RESULT::mark_as_sent(int old_server_state, int report_grace_period) {
     retval = db->do_query(query);
     if (retval) return retval;
     if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
+    state_count_deltas.note(appid, old_server_state, server_state);
     return 0;
 }
 
@@ -1057,6 +1204,47 @@ void DB_RESULT::db_parse(MYSQL_ROW &r) {
     size_class = atoi(r[i++]);
 }
 
+// Update the fields that differ from the argument
+// (typically a copy of the record made when it was read).
+// Unchanged blobs aren't sent to the DB.
+//
+int DB_RESULT::update_diff(RESULT& r) {
+    string updates;
+    diff_int(updates, "create_time", create_time, r.create_time);
+    diff_int(updates, "workunitid", workunitid, r.workunitid);
+    diff_int(updates, "server_state", server_state, r.server_state);
+    diff_int(updates, "outcome", outcome, r.outcome);
+    diff_int(updates, "client_state", client_state, r.client_state);
+    diff_int(updates, "hostid", hostid, r.hostid);
+    diff_int(updates, "userid", userid, r.userid);
+    diff_int(updates, "report_deadline", report_deadline, r.report_deadline);
+    diff_int(updates, "sent_time", sent_time, r.sent_time);
+    diff_int(updates, "received_time", received_time, r.received_time);
+    diff_str(updates, "name", name, r.name);
+    diff_double(updates, "cpu_time", cpu_time, r.cpu_time);
+    diff_str(updates, "xml_doc_in", xml_doc_in, r.xml_doc_in);
+    diff_str(updates, "xml_doc_out", xml_doc_out, r.xml_doc_out);
+    diff_str(updates, "stderr_out", stderr_out, r.stderr_out);
+    diff_int(updates, "batch", batch, r.batch);
+    diff_int(updates, "file_delete_state", file_delete_state, r.file_delete_state);
+    diff_int(updates, "validate_state", validate_state, r.validate_state);
+    diff_double(updates, "claimed_credit", claimed_credit, r.claimed_credit);
+    diff_double(updates, "granted_credit", granted_credit, r.granted_credit);
+    diff_double(updates, "opaque", opaque, r.opaque);
+    diff_int(updates, "random", random, r.random);
+    diff_int(updates, "app_version_num", app_version_num, r.app_version_num);
+    diff_int(updates, "appid", appid, r.appid);
+    diff_int(updates, "exit_status", exit_status, r.exit_status);
+    diff_int(updates, "teamid", teamid, r.teamid);
+    diff_int(updates, "priority", priority, r.priority);
+    diff_double(updates, "elapsed_time", elapsed_time, r.elapsed_time);
+    diff_double(updates, "flops_estimate", flops_estimate, r.flops_estimate);
+    diff_int(updates, "app_version_id", app_version_id, r.app_version_id);
+    diff_int(updates, "runtime_outlier", runtime_outlier?1:0, r.runtime_outlier?1:0);
+    diff_int(updates, "size_class", size_class, r.size_class);
+    return update_diff_query(db, "result", id, updates);
+}
+
 int DB_RESULT::get_unsent_counts(APP& app, int* unsent_count) {
     char query[1024];
     MYSQL_RES *rp;
@@ -1151,6 +1339,17 @@ void DB_MSG_TO_HOST::db_print(char* buf) {
     UNESCAPE(variety);
 }
 
+// The scheduler looks for messages only for hosts with msgs_pending set,
+// so set it after inserting the message
+//
+int DB_MSG_TO_HOST::insert() {
+    char buf[256];
+    int retval = DB_BASE::insert();
+    if (retval) return retval;
+    sprintf(buf, "update host set msgs_pending=1 where id=%d", hostid);
+    return db->do_query(buf);
+}
+
 void DB_MSG_TO_HOST::db_parse(MYSQL_ROW& r) {
     int i=0;
     clear();
@@ -1191,13 +1390,16 @@ void DB_ASSIGNMENT::db_parse(MYSQL_ROW& r) {
     _resultid = atoi(r[i++]);
 }
 
+bool DB_HOST_APP_VERSION::scheduler_fields_changed(DB_HOST_APP_VERSION& orig) {
+    return consecutive_valid != orig.consecutive_valid
+        || max_jobs_per_day != orig.max_jobs_per_day
+        || n_jobs_today != orig.n_jobs_today;
+}
+
 int DB_HOST_APP_VERSION::update_scheduler(DB_HOST_APP_VERSION& orig) {
     char query[1024], clause[512];
 
-    if (consecutive_valid == orig.consecutive_valid
-        && max_jobs_per_day == orig.max_jobs_per_day
-        && n_jobs_today == orig.n_jobs_today
-    ) {
+    if (!scheduler_fields_changed(orig)) {
         return 0;
     }
     sprintf(query,
@@ -1296,6 +1498,43 @@ void DB_HOST_APP_VERSION::db_print(char* buf) {
     );
 }
 
+void DB_HOST_APP_VERSION::db_print_values(char* buf) {
+    sprintf(buf,
+        "(%d, %d, %.15e, %.15e, %.15e, %.15e, %.15e, %.15e, %d, %d, "
+        "%.15e, %.15e, %.15e, %.15e, %d)",
+        host_id,
+        app_version_id,
+        pfc.n,
+        pfc.avg,
+        et.n,
+        et.avg,
+        et.var,
+        et.q,
+        max_jobs_per_day,
+        n_jobs_today,
+        turnaround.n,
+        turnaround.avg,
+        turnaround.var,
+        turnaround.q,
+        consecutive_valid
+    );
+}
+
+// Write several records (a list of db_print_values() outputs)
+// in one statement.
+// New records are inserted;
+// for existing ones, the fields the scheduler changes are updated.
+//
+int DB_HOST_APP_VERSION::insert_or_update_scheduler(std::string& values) {
+    std::string query =
+        "insert into host_app_version values " + values
+        + " on duplicate key update"
+        " consecutive_valid=values(consecutive_valid),"
+        " max_jobs_per_day=values(max_jobs_per_day),"
+        " n_jobs_today=values(n_jobs_today)";
+    return db->do_query(query.c_str());
+}
+
 void DB_HOST_APP_VERSION::db_parse(MYSQL_ROW& r) {
     int i=0;
     clear();
@@ -1384,6 +1623,79 @@ void DB_STATE_COUNTS::db_parse(MYSQL_ROW& r) {
     workunit_file_delete_state_2 = atoi(r[i++]);
 }
 
+STATE_COUNT_DELTAS state_count_deltas;
+
+void STATE_COUNT_DELTAS::note(
+    int appid, int old_server_state, int new_server_state
+) {
+    if (old_server_state == new_server_state) return;
+    std::pair<int, int>& d = deltas[appid];
+    switch (old_server_state) {
+    case RESULT_SERVER_STATE_INACTIVE:
+    case RESULT_SERVER_STATE_UNSENT:
+        d.first--;
+        break;
+    case RESULT_SERVER_STATE_IN_PROGRESS:
+        d.second--;
+        break;
+    }
+    switch (new_server_state) {
+    case RESULT_SERVER_STATE_INACTIVE:
+    case RESULT_SERVER_STATE_UNSENT:
+        d.first++;
+        break;
+    case RESULT_SERVER_STATE_IN_PROGRESS:
+        d.second++;
+        break;
+    }
+}
+
+// If an app has no state_counts row, its changes are dropped;
+// the row is created when the app's results are counted.
+//
+int STATE_COUNT_DELTAS::flush() {
+    char query[256];
+    int retval = 0;
+    std::map<int, std::pair<int, int> >::iterator i;
+
+    for (i=deltas.begin(); i!=deltas.end(); i++) {
+        if (!i->second.first && !i->second.second) continue;
+        sprintf(query,
+            "update state_counts set result_server_state_2=result_server_state_2+%d, result_server_state_4=result_server_state_4+%d where appid=%d",
+            i->second.first, i->second.second, i->first
+        );
+        int r = boinc_db.do_query(query);
+        if (r) retval = r;
+    }
+    deltas.clear();
+    return retval;
+}
+
+// Get a list of IDs (e.g. "3,5,8") from a query that selects only IDs;
+// n is the number of IDs.
+// This is used to get the IDs of WUs to process from an index
+// before getting their rows.
+//
+static int get_id_list(DB_CONN* db, const char* query, string& ids, int& n) {
+    MYSQL_RES* rp;
+    MYSQL_ROW row;
+    int retval;
+
+    ids.clear();
+    n = 0;
+    retval = db->do_query(query);
+    if (retval) return mysql_errno(db->mysql);
+    rp = mysql_store_result(db->mysql);
+    if (!rp) return mysql_errno(db->mysql);
+    while ((row = mysql_fetch_row(rp))) {
+        if (n) ids += ",";
+        ids += row[0];
+        n++;
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
 void TRANSITIONER_ITEM::parse(MYSQL_ROW& r) {
     int i=0;
     clear();
@@ -1425,7 +1737,7 @@ void TRANSITIONER_ITEM::parse(MYSQL_ROW& r) {
 }
 
 int DB_TRANSITIONER_ITEM_SET::enumerate(
-    int transition_time, int nresult_limit,
+    int transition_time, int nwu_limit,
     int wu_id_modulus, int wu_id_remainder,
     std::vector<TRANSITIONER_ITEM>& items
 ) {
@@ -1434,18 +1746,35 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
     char mod_clause[256];;
     MYSQL_ROW row;
     TRANSITIONER_ITEM new_item;
+    string ids;
 
     if (!cursor.active) {
         if (wu_id_modulus) {
             sprintf(mod_clause,
-                " and wu.id %% %d = %d ",
+                " and id %% %d = %d ",
                 wu_id_modulus, wu_id_remainder
             );
         } else {
             strcpy(mod_clause, "");
         }
 
+        // first get the IDs of up to nwu_limit WUs
+        // from the (transition_time, transitioner_flags) index,
+        // without reading their rows
+        //
+        sprintf(query,
+            "SELECT id FROM workunit "
+            "WHERE transition_time < %d %s %s and transitioner_flags<>%d "
+            "LIMIT %d",
+            transition_time, mod_clause, id_clause.c_str(), TRANSITION_NONE,
+            nwu_limit
+        );
+        retval = get_id_list(db, query, ids, nitems_this_query);
+        if (retval) return retval;
+        if (!nitems_this_query) return ERR_DB_NOT_FOUND;
 
+        // then get those WUs and their results, grouped by WU
+        //
         sprintf(query,
             "SELECT "
             "   wu.id, "
@@ -1484,10 +1813,10 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
             "   workunit AS wu "
             "       LEFT JOIN result AS res ON wu.id = res.workunitid "
             "WHERE "
-            "   wu.transition_time < %d %s and transitioner_flags<>%d "
-            "LIMIT "
-            "   %d ",
-            transition_time, mod_clause, TRANSITION_NONE, nresult_limit
+            "   wu.id in (%s) "
+            "ORDER BY "
+            "   wu.id ",
+            ids.c_str()
         );
 
         retval = db->do_query(query);
@@ -1508,7 +1837,6 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
             return ERR_DB_NOT_FOUND;
         }
         last_item.parse(row);
-        nitems_this_query = 1;
     }
 
     items.clear();
@@ -1519,16 +1847,17 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
             mysql_free_result(cursor.rp);
             cursor.active = false;
 
-            // if got fewer rows than requested, last group is complete
+            // if got fewer WUs than requested, this pass is done.
+            // Otherwise end the pass here, as when results were limited;
+            // the last group is done in the next pass.
             //
-            if (nitems_this_query < nresult_limit) {
+            if (nitems_this_query < nwu_limit) {
                 return 0;
             } else {
                 return ERR_DB_NOT_FOUND;
             }
         }
         new_item.parse(row);
-        nitems_this_query++;
         if (new_item.id != last_item.id) {
             last_item = new_item;
             return 0;
@@ -1542,6 +1871,30 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
 int DB_TRANSITIONER_ITEM_SET::update_result(TRANSITIONER_ITEM& ti) {
     char query[MAX_QUERY_LEN];
 
+    if (batch_size > 1) {
+        RESULT_UPDATE ru;
+        ru.id = ti.res_id;
+        ru.server_state = ti.res_server_state;
+        ru.outcome = ti.res_outcome;
+        ru.validate_state = ti.res_validate_state;
+        ru.file_delete_state = ti.res_file_delete_state;
+
+        // a result may be updated twice in one handle_wu();
+        // keep only the last update
+        //
+        for (unsigned int i=0; i<pending_results.size(); i++) {
+            if (pending_results[i].id == ru.id) {
+                pending_results[i] = ru;
+                return 0;
+            }
+        }
+        pending_results.push_back(ru);
+        if ((int)pending_results.size() >= batch_size) {
+            return flush_result_updates();
+        }
+        return 0;
+    }
+
     sprintf(query,
         "update result set server_state=%d, outcome=%d, "
         "validate_state=%d, file_delete_state=%d where id=%u",
@@ -1556,6 +1909,42 @@ int DB_TRANSITIONER_ITEM_SET::update_result(TRANSITIONER_ITEM& ti) {
     return retval;
 }
 
+// do queued result updates as a single query of the form
+// update result set server_state = case id when x then y ... end, ...
+// where id in (...)
+//
+int DB_TRANSITIONER_ITEM_SET::flush_result_updates() {
+    string server_state, outcome, validate_state, file_delete_state, ids;
+    char buf[256];
+    unsigned int i, n = pending_results.size();
+
+    if (!n) return 0;
+    for (i=0; i<n; i++) {
+        RESULT_UPDATE& ru = pending_results[i];
+        sprintf(buf, " when %u then %d", ru.id, ru.server_state);
+        server_state += buf;
+        sprintf(buf, " when %u then %d", ru.id, ru.outcome);
+        outcome += buf;
+        sprintf(buf, " when %u then %d", ru.id, ru.validate_state);
+        validate_state += buf;
+        sprintf(buf, " when %u then %d", ru.id, ru.file_delete_state);
+        file_delete_state += buf;
+        sprintf(buf, "%s%u", i?",":"", ru.id);
+        ids += buf;
+    }
+    pending_results.clear();
+
+    string query = "update result set server_state = case id"
+        + server_state + " end, outcome = case id"
+        + outcome + " end, validate_state = case id"
+        + validate_state + " end, file_delete_state = case id"
+        + file_delete_state + " end where id in (" + ids + ")";
+    int retval = db->do_query(query.c_str());
+    if (retval) return retval;
+    if (db->affected_rows() != (int)n) return ERR_DB_NOT_FOUND;
+    return 0;
+}
+
 int DB_TRANSITIONER_ITEM_SET::update_workunit(
     TRANSITIONER_ITEM& ti, TRANSITIONER_ITEM& ti_original
 ) {
@@ -1650,7 +2039,7 @@ void VALIDATOR_ITEM::parse(MYSQL_ROW& r) {
 }
 
 int DB_VALIDATOR_ITEM_SET::enumerate(
-    int appid, int nresult_limit,
+    int appid, int nwu_limit,
     int wu_id_modulus, int wu_id_remainder,
     std::vector<VALIDATOR_ITEM>& items
 ) {
@@ -1658,17 +2047,34 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
     char query[MAX_QUERY_LEN], mod_clause[256];
     MYSQL_ROW row;
     VALIDATOR_ITEM new_item;
+    string ids;
 
     if (!cursor.active) {
         if (wu_id_modulus) {
             sprintf(mod_clause,
-                " and wu.id %% %d = %d ",
+                " and id %% %d = %d ",
                 wu_id_modulus, wu_id_remainder
             );
         } else {
             strcpy(mod_clause, "");
         }
 
+        // first get the IDs of up to nwu_limit WUs
+        // from the (appid, need_validate) index,
+        // without reading their rows
+        //
+        sprintf(query,
+            "SELECT id FROM workunit "
+            "WHERE appid = %d and need_validate > 0 %s %s "
+            "LIMIT %d",
+            appid, mod_clause, id_clause.c_str(), nwu_limit
+        );
+        retval = get_id_list(db, query, ids, nitems_this_query);
+        if (retval) return retval;
+        if (!nitems_this_query) return ERR_DB_NOT_FOUND;
+
+        // then get those WUs and their results, grouped by WU
+        //
         sprintf(query,
             "SELECT "
             "   wu.id, "
@@ -1712,10 +2118,10 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
             "   res.runtime_outlier "
             "FROM "
             "   workunit AS wu, result AS res where wu.id = res.workunitid "
-            "   and wu.appid = %d and wu.need_validate > 0 %s "
-            "LIMIT "
-            "   %d ",
-            appid, mod_clause, nresult_limit
+            "   and wu.id in (%s) "
+            "ORDER BY "
+            "   wu.id ",
+            ids.c_str()
         );
 
         retval = db->do_query(query);
@@ -1735,7 +2141,6 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
             return ERR_DB_NOT_FOUND;
         }
         last_item.parse(row);
-        nitems_this_query = 1;
     }
 
     items.clear();
@@ -1746,16 +2151,17 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
             mysql_free_result(cursor.rp);
             cursor.active = false;
 
-            // if got fewer rows than requested, last group is complete
+            // if got fewer WUs than requested, this pass is done.
+            // Otherwise end the pass here, as when results were limited;
+            // the last group is done in the next pass.
             //
-            if (nitems_this_query < nresult_limit) {
+            if (nitems_this_query < nwu_limit) {
                 return 0;
             } else {
                 return ERR_DB_NOT_FOUND;
             }
         }
         new_item.parse(row);
-        nitems_this_query++;
         if (new_item.wu.id != last_item.wu.id) {
             last_item = new_item;
             return 0;
@@ -1946,6 +2352,90 @@ int DB_WORK_ITEM::enumerate_all(
 }
 
 
+int DB_WORK_ITEM::enumerate_keyset(
+    int limit, const char* select_clause, int order
+) {
+    char query[MAX_QUERY_LEN], keyset_clause[256];
+    const char* order_clause;
+    int retval;
+    MYSQL_ROW row;
+    if (!cursor.active) {
+        // with no position yet, start from the beginning of the ordering.
+        // Otherwise get rows strictly after (start_priority, start_id).
+        // The (server_state, priority) index includes the primary key,
+        // so the priority orderings are index range scans.
+        //
+        switch (order) {
+        case KEYSET_ORDER_PRIORITY_DESC:
+            order_clause = "order by r1.priority desc, r1.id";
+            if (keyset_started) {
+                sprintf(keyset_clause,
+                    " and (r1.priority<%d or (r1.priority=%d and r1.id>%d)) ",
+                    start_priority, start_priority, start_id
+                );
+            } else {
+                strcpy(keyset_clause, "");
+            }
+            break;
+        case KEYSET_ORDER_PRIORITY_ASC:
+            order_clause = "order by r1.priority asc, r1.id";
+            if (keyset_started) {
+                sprintf(keyset_clause,
+                    " and (r1.priority>%d or (r1.priority=%d and r1.id>%d)) ",
+                    start_priority, start_priority, start_id
+                );
+            } else {
+                strcpy(keyset_clause, "");
+            }
+            break;
+        default:
+            order_clause = "order by r1.id";
+            sprintf(keyset_clause, " and r1.id>%d ", start_id);
+            break;
+        }
+
+        // use "r1" to refer to the result, since the feeder assumes that
+        // (historical reasons)
+        //
+        sprintf(query,
+            "select high_priority r1.id, r1.priority, r1.server_state, r1.report_deadline, workunit.* from result r1, workunit, app "
+            " where r1.server_state=%d "
+            " and r1.workunitid=workunit.id "
+            " and workunit.appid=app.id "
+            " and app.deprecated=0 "
+            " and workunit.transitioner_flags=0 "
+            " %s "
+            " %s "
+            " %s "
+            "limit %d",
+            RESULT_SERVER_STATE_UNSENT,
+            keyset_clause,
+            select_clause,
+            order_clause,
+            limit
+        );
+        retval = db->do_query(query);
+        if (retval) return mysql_errno(db->mysql);
+        cursor.rp = mysql_store_result(db->mysql);
+        if (!cursor.rp) return mysql_errno(db->mysql);
+        cursor.active = true;
+    }
+    row = mysql_fetch_row(cursor.rp);
+    if (!row) {
+        mysql_free_result(cursor.rp);
+        cursor.active = false;
+        retval = mysql_errno(db->mysql);
+        if (retval) return ERR_DB_CONN_LOST;
+        return ERR_DB_NOT_FOUND;
+    } else {
+        parse(row);
+        start_id = res_id;
+        start_priority = res_priority;
+        keyset_started = true;
+    }
+    return 0;
+}
+
 void IN_PROGRESS_RESULT::parse(MYSQL_ROW& r) {
     int i=0;
     memset(this, 0, sizeof(IN_PROGRESS_RESULT));
@@ -2016,7 +2506,7 @@ void SCHED_RESULT_ITEM::parse(MYSQL_ROW& r) {
 
 int DB_SCHED_RESULT_ITEM_SET::add_result(char* result_name) {
     SCHED_RESULT_ITEM result;
-    result.id = 0;
+    result.clear();
     strcpy2(result.queried_name, result_name);
     results.push_back(result);
     return 0;
@@ -2098,12 +2588,13 @@ int DB_SCHED_RESULT_ITEM_SET::lookup_result(char* result_name, SCHED_RESULT_ITEM
 }
 
 int DB_SCHED_RESULT_ITEM_SET::update_result(SCHED_RESULT_ITEM& ri) {
-    char query[MAX_QUERY_LEN];
+    char buf[MAX_QUERY_LEN];
+    string stderr_out, xml_doc_out;
     int retval;
 
-    ESCAPE(ri.xml_doc_out);
-    ESCAPE(ri.stderr_out);
-    sprintf(query,
+    escape_string(ri.stderr_out, stderr_out);
+    escape_string(ri.xml_doc_out, xml_doc_out);
+    sprintf(buf,
         "UPDATE result SET "
         "    hostid=%d, "
         "    received_time=%d, "
@@ -2113,13 +2604,9 @@ int DB_SCHED_RESULT_ITEM_SET::update_result(SCHED_RESULT_ITEM& ri) {
         "    app_version_num=%d, "
         "    server_state=%d, "
         "    outcome=%d, "
-        "    stderr_out='%s', "
-        "    xml_doc_out='%s', "
         "    validate_state=%d, "
         "    teamid=%d, "
-        "    elapsed_time=%.15e "
-        "WHERE "
-        "    id=%u",
+        "    elapsed_time=%.15e, ",
         ri.hostid,
         ri.received_time,
         ri.client_state,
@@ -2128,20 +2615,100 @@ int DB_SCHED_RESULT_ITEM_SET::update_result(SCHED_RESULT_ITEM& ri) {
         ri.app_version_num,
         ri.server_state,
         ri.outcome,
-        ri.stderr_out,
-        ri.xml_doc_out,
         ri.validate_state,
         ri.teamid,
-        ri.elapsed_time,
-        ri.id
+        ri.elapsed_time
     );
-    retval = db->do_query(query);
-    UNESCAPE(ri.xml_doc_out);
-    UNESCAPE(ri.stderr_out);
+    string query = buf;
+    query += "    stderr_out='" + stderr_out + "', ";
+    query += "    xml_doc_out='" + xml_doc_out + "' ";
+    sprintf(buf, "WHERE id=%u", ri.id);
+    query += buf;
+    retval = db->do_query(query.c_str());
     if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
     return retval;
 }
 
+static void add_case(string& s, unsigned int id, const char* value) {
+    char buf[256];
+    sprintf(buf, " when %u then ", id);
+    s += buf;
+    s += value;
+}
+
+// a single query of the form
+// update result set hostid = case id when x then y ... end, ...
+// where id in (...)
+//
+int DB_SCHED_RESULT_ITEM_SET::update_results(
+    std::vector<SCHED_RESULT_ITEM*>& items
+) {
+    string hostid, received_time, client_state, cpu_time, exit_status;
+    string app_version_num, server_state, outcome, stderr_out, xml_doc_out;
+    string validate_state, teamid, elapsed_time, ids, escaped;
+    char buf[256];
+    unsigned int i, n = items.size();
+
+    if (!n) return 0;
+    for (i=0; i<n; i++) {
+        SCHED_RESULT_ITEM& ri = *items[i];
+        sprintf(buf, "%d", ri.hostid);
+        add_case(hostid, ri.id, buf);
+        sprintf(buf, "%d", ri.received_time);
+        add_case(received_time, ri.id, buf);
+        sprintf(buf, "%d", ri.client_state);
+        add_case(client_state, ri.id, buf);
+        sprintf(buf, "%.15e", ri.cpu_time);
+        add_case(cpu_time, ri.id, buf);
+        sprintf(buf, "%d", ri.exit_status);
+        add_case(exit_status, ri.id, buf);
+        sprintf(buf, "%d", ri.app_version_num);
+        add_case(app_version_num, ri.id, buf);
+        sprintf(buf, "%d", ri.server_state);
+        add_case(server_state, ri.id, buf);
+        sprintf(buf, "%d", ri.outcome);
+        add_case(outcome, ri.id, buf);
+        sprintf(buf, "%d", ri.validate_state);
+        add_case(validate_state, ri.id, buf);
+        sprintf(buf, "%d", ri.teamid);
+        add_case(teamid, ri.id, buf);
+        sprintf(buf, "%.15e", ri.elapsed_time);
+        add_case(elapsed_time, ri.id, buf);
+
+        sprintf(buf, " when %u then '", ri.id);
+        escape_string(ri.stderr_out, escaped);
+        stderr_out += buf;
+        stderr_out += escaped;
+        stderr_out += "'";
+        escape_string(ri.xml_doc_out, escaped);
+        xml_doc_out += buf;
+        xml_doc_out += escaped;
+        xml_doc_out += "'";
+
+        sprintf(buf, "%s%u", i?",":"", ri.id);
+        ids += buf;
+    }
+
+    string query = "UPDATE result SET hostid = case id"
+        + hostid + " end, received_time = case id"
+        + received_time + " end, client_state = case id"
+        + client_state + " end, cpu_time = case id"
+        + cpu_time + " end, exit_status = case id"
+        + exit_status + " end, app_version_num = case id"
+        + app_version_num + " end, server_state = case id"
+        + server_state + " end, outcome = case id"
+        + outcome + " end, stderr_out = case id"
+        + stderr_out + " end, xml_doc_out = case id"
+        + xml_doc_out + " end, validate_state = case id"
+        + validate_state + " end, teamid = case id"
+        + teamid + " end, elapsed_time = case id"
+        + elapsed_time + " end WHERE id in (" + ids + ")";
+    int retval = db->do_query(query.c_str());
+    if (retval) return retval;
+    if (db->affected_rows() != (int)n) return ERR_DB_NOT_FOUND;
+    return 0;
+}
+
 // set transition times of workunits -
 // but only those corresponding to updated results
 // (i.e. those that passed "sanity checks")
@@ -2517,6 +3084,21 @@ void DB_VDA_CHUNK_HOST::db_print(char* buf) {
     );
 }
 
+void DB_VDA_CHUNK_HOST::db_print_values(char* buf) {
+    sprintf(buf,
+        "(%f, %d, %d, '%s', %d, %d, %d, %f, %f)",
+        create_time,
+        vda_file_id,
+        host_id,
+        physical_file_name,
+        present_on_host,
+        transfer_in_progress,
+        transfer_wait,
+        transfer_request_time,
+        transfer_send_time
+    );
+}
+
 void DB_VDA_CHUNK_HOST::db_parse(MYSQL_ROW &r) {
     int i=0;
     clear();
@@ -27,6 +27,7 @@
 
 #include <cstdio>
 #include <vector>
+#include <map>
 #include <string.h>
 
 #include "db_base.h"
@@ -78,6 +79,9 @@ struct DB_HOST_APP_VERSION : public DB_BASE, public HOST_APP_VERSION {
     void db_parse(MYSQL_ROW &row);
     int update_scheduler(DB_HOST_APP_VERSION&);
     int update_validator(DB_HOST_APP_VERSION&);
+    bool scheduler_fields_changed(DB_HOST_APP_VERSION&);
+    void db_print_values(char*);
+    int insert_or_update_scheduler(std::string& values);
 };
 
 struct DB_USER_SUBMIT : public DB_BASE, public USER_SUBMIT {
@@ -109,6 +113,25 @@ struct DB_STATE_COUNTS : public DB_BASE, public STATE_COUNTS {
     void db_parse(MYSQL_ROW &row);
 };
 
+// Changes to the per-app counts of unsent and in-progress results
+// in state_counts (result_server_state_2 and _4;
+// the former includes inactive results).
+// Code that creates results or changes their server state notes it here,
+// and flush() applies the changes, one update per app.
+// Changes that aren't noted or flushed are corrected
+// when the counts are recounted (see count_unsent_results()).
+//
+struct STATE_COUNT_DELTAS {
+    std::map<int, std::pair<int, int> > deltas;
+        // appid -> (unsent, in progress)
+
+    void note(int appid, int old_server_state, int new_server_state);
+        // old_server_state is 0 for a new result
+    int flush();
+};
+
+extern STATE_COUNT_DELTAS state_count_deltas;
+
 struct VALIDATOR_ITEM {
     WORKUNIT wu;
     RESULT res;
@@ -187,6 +210,7 @@ public:
     int make_unsent(
         APP&, int size_class, int n, const char* order_clause, int& nchanged
     );
+    int update_diff(RESULT&);
 };
 
 class DB_WORKUNIT : public DB_BASE, public WORKUNIT {
@@ -194,8 +218,10 @@ public:
     DB_WORKUNIT(DB_CONN* p=0);
     int get_id();
     void db_print(char*);
+    void db_print_values(char*);
     void db_parse(MYSQL_ROW &row);
     void operator=(WORKUNIT& w) {WORKUNIT::operator=(w);}
+    int update_diff(WORKUNIT&);
 };
 
 class DB_CREDITED_JOB : public DB_BASE, public CREDITED_JOB {
@@ -218,6 +244,8 @@ class DB_MSG_TO_HOST : public DB_BASE, public MSG_TO_HOST {
 public:
     DB_MSG_TO_HOST(DB_CONN* p=0);
     int get_id();
+    int insert();
+        // also flags the host as having messages
     void db_print(char*);
     void db_parse(MYSQL_ROW &row);
 };
@@ -238,16 +266,37 @@ public:
     DB_TRANSITIONER_ITEM_SET(DB_CONN* p=0);
     TRANSITIONER_ITEM last_item;
     int nitems_this_query;
+        // number of WUs in the current query
+    std::string id_clause;
+        // if set, an extra condition on WU IDs
+        // (e.g. from a DAEMON_LEASE)
 
     int enumerate(
         int transition_time,
-        int nresult_limit,
+        int nwu_limit,
         int wu_id_modulus,
         int wu_id_remainder,
         std::vector<TRANSITIONER_ITEM>& items
     );
     int update_result(TRANSITIONER_ITEM&);
     int update_workunit(TRANSITIONER_ITEM&, TRANSITIONER_ITEM&);
+
+    // If batch_size > 1, update_result() queues the update,
+    // and flush_result_updates() does all queued updates
+    // in one multi-row UPDATE.
+    // It's flushed automatically if batch_size updates are queued.
+    //
+    int batch_size;
+    int flush_result_updates();
+private:
+    struct RESULT_UPDATE {
+        unsigned int id;
+        int server_state;
+        int outcome;
+        int validate_state;
+        int file_delete_state;
+    };
+    std::vector<RESULT_UPDATE> pending_results;
 };
 
 // The validator uses this to get (WU, result) pairs efficiently.
@@ -258,10 +307,13 @@ public:
     DB_VALIDATOR_ITEM_SET(DB_CONN* p=0);
     VALIDATOR_ITEM last_item;
     int nitems_this_query;
+        // number of WUs in the current query
+    std::string id_clause;
+        // if set, an extra condition on WU IDs
 
     int enumerate(
         int appid,
-        int nresult_limit,
+        int nwu_limit,
         int wu_id_modulus,
         int wu_id_remainder,
         std::vector<VALIDATOR_ITEM>& items
@@ -282,9 +334,19 @@ struct WORK_ITEM {
     void parse(MYSQL_ROW& row);
 };
 
+// orderings for DB_WORK_ITEM::enumerate_keyset()
+//
+#define KEYSET_ORDER_ID             0
+#define KEYSET_ORDER_PRIORITY_DESC  1
+#define KEYSET_ORDER_PRIORITY_ASC   2
+
 class DB_WORK_ITEM : public WORK_ITEM, public DB_BASE_SPECIAL {
     int start_id;
-        // when enumerate_all is used, keeps track of which ID to start from
+        // when enumerate_all or enumerate_keyset is used,
+        // keeps track of which ID to start from
+    int start_priority;
+    bool keyset_started;
+        // enumerate_keyset: start_id and start_priority are valid
 public:
     DB_WORK_ITEM(DB_CONN* p=0);
     int enumerate(
@@ -296,6 +358,22 @@ public:
     );
         // used by feeder when HR is used.
         // Successive calls cycle through all results.
+    int enumerate_keyset(
+        int limit, const char* select_clause, int order
+    );
+        // used by feeder with --keyset.
+        // Like enumerate(), but each query returns only results
+        // past the last one returned (in the given order),
+        // so a query costs in proportion to its limit
+        // rather than to the number of unsent results.
+        // When there are no more, return ERR_DB_NOT_FOUND
+        // but keep the position; new results (higher IDs) are found later.
+    void reset_keyset() {
+        keyset_started = false;
+        start_id = 0;
+    }
+        // start the next enumerate_keyset() from the beginning;
+        // picks up results the feeder passed over.
     int read_result();
         // used by scheduler to read result server state
     int update();
@@ -341,8 +419,11 @@ struct SCHED_RESULT_ITEM {
     int sent_time;
     int received_time;
     double cpu_time;
-    char xml_doc_out[BLOB_SIZE];
-    char stderr_out[BLOB_SIZE];
+    std::string xml_doc_out;
+    std::string stderr_out;
+        // not read from the DB; set from the client's report.
+        // Strings rather than BLOB_SIZE arrays,
+        // since a request may report thousands of results
     int app_version_num;
     int exit_status;
     int file_delete_state;
@@ -368,6 +449,9 @@ public:
     int lookup_result(char* result_name, SCHED_RESULT_ITEM** result);
 
     int update_result(SCHED_RESULT_ITEM& result);
+    int update_results(std::vector<SCHED_RESULT_ITEM*>&);
+        // do update_result() for several results in one query.
+        // Return ERR_DB_NOT_FOUND if not all were found.
     int update_workunits();
 };
 
@@ -502,6 +586,7 @@ struct DB_VDA_FILE : public DB_BASE, public VDA_FILE {
 struct DB_VDA_CHUNK_HOST : public DB_BASE, public VDA_CHUNK_HOST {
     DB_VDA_CHUNK_HOST(DB_CONN* p=0);
     void db_print(char*);
+    void db_print_values(char*);
     void db_parse(MYSQL_ROW &row);
 };
 
@@ -335,6 +335,12 @@ struct HOST {
         // that fail validation
         // DEPRECATED
     char product_name[256];
+    int msgs_pending;
+        // nonzero if there may be unhandled msg_to_host records
+        // for this host.  Set by DB_MSG_TO_HOST::insert(),
+        // cleared by the scheduler when it sends them.
+        // Not written by db_print(), so whole-record updates
+        // don't clobber it.
 
     // the following items are passed in scheduler requests,
     // and used in the scheduler,
@@ -32,13 +32,15 @@ alter table workunit
     add unique(name),
         -- not currently used but good invariant
     add index wu_val (appid, need_validate),
-        -- validator
-    add index wu_timeout (transition_time),
-        -- transitioner
+        -- validator (covers its WU ID query)
+    add index wu_timeout (transition_time, transitioner_flags),
+        -- transitioner (covers its WU ID query)
     add index wu_filedel (file_delete_state),
         -- file_deleter, db_purge
-    add index wu_assim (appid, assimilate_state);
+    add index wu_assim (appid, assimilate_state),
         -- assimilator
+    add index wu_batch (batch);
+        -- remote job submission; cancel_batch()
 
 alter table result
     add unique(name),
@@ -112,6 +114,9 @@ alter table credited_job
     add index credited_job_wu (workunitid),
     add unique credited_job_user_wu (userid, workunitid);
 
+alter table credit_journal
+    add index cj_owner (owner);
+
 alter table team_delta
     add index team_delta_teamid (teamid, timestamp);
 
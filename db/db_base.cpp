@@ -35,6 +35,7 @@ bool g_print_queries = false;
 
 DB_CONN::DB_CONN() {
     mysql = 0;
+    use_prepared = false;
 }
 
 int DB_CONN::open(
@@ -98,9 +99,74 @@ int DB_CONN::open(
 }
 
 void DB_CONN::close() {
+    std::map<std::string, MYSQL_STMT*>::iterator i;
+    for (i=stmts.begin(); i!=stmts.end(); i++) {
+        mysql_stmt_close(i->second);
+    }
+    stmts.clear();
     if (mysql) mysql_close(mysql);
 }
 
+// how many seconds this server (a replica) is behind its primary.
+// Return zero lag if it's not a replica,
+// and ERR_DB_NOT_FOUND if replication is stopped.
+//
+int DB_CONN::replica_lag(int& secs) {
+    int retval;
+    unsigned int i, n;
+    MYSQL_ROW row;
+    MYSQL_RES* rp;
+
+    secs = 0;
+    retval = do_query("show slave status");
+    if (retval) return retval;
+    rp = mysql_store_result(mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    row = mysql_fetch_row(rp);
+    if (row) {
+        retval = ERR_DB_NOT_FOUND;
+        n = mysql_num_fields(rp);
+        MYSQL_FIELD* fields = mysql_fetch_fields(rp);
+        for (i=0; i<n; i++) {
+            if (strcmp(fields[i].name, "Seconds_Behind_Master")) continue;
+            if (row[i]) {
+                secs = atoi(row[i]);
+                retval = 0;
+            }
+            break;
+        }
+    }
+    mysql_free_result(rp);
+    return retval;
+}
+
+// return a prepared statement for the given SQL, preparing it if needed.
+// Return NULL on error.
+//
+MYSQL_STMT* DB_CONN::get_stmt(const char* sql) {
+    std::map<std::string, MYSQL_STMT*>::iterator i = stmts.find(sql);
+    if (i != stmts.end()) return i->second;
+
+    MYSQL_STMT* stmt = mysql_stmt_init(mysql);
+    if (!stmt) return NULL;
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql))) {
+        fprintf(stderr, "Can't prepare %s: %s\n", sql, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    my_bool update_max_length = 1;
+    mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+    stmts[sql] = stmt;
+    return stmt;
+}
+
+void DB_CONN::drop_stmt(const char* sql) {
+    std::map<std::string, MYSQL_STMT*>::iterator i = stmts.find(sql);
+    if (i == stmts.end()) return;
+    mysql_stmt_close(i->second);
+    stmts.erase(i);
+}
+
 int DB_CONN::set_isolation_level(ISOLATION_LEVEL level) {
     const char* level_str;
     char query[256];
@@ -221,6 +287,12 @@ int DB_BASE::lookup_id(int id) {
     MYSQL_ROW row;
     MYSQL_RES* rp;
 
+    if (db->use_prepared) {
+        retval = lookup_id_prepared(id);
+        if (retval != ERR_DB_CANT_INIT) return retval;
+        // else fall back to a text query
+    }
+
     sprintf(query, "select * from %s where id=%u", table_name, id);
 
     retval = db->do_query(query);
@@ -236,6 +308,96 @@ int DB_BASE::lookup_id(int id) {
     return 0;
 }
 
+// lookup_id() with a cached prepared statement.
+// The ID goes to the server in binary,
+// and the server doesn't have to parse the query.
+// The row is fetched as strings so that db_parse() can be used.
+// Returns ERR_DB_CANT_INIT if the statement can't be used;
+// the caller should then fall back to a text query.
+//
+int DB_BASE::lookup_id_prepared(int id) {
+    char sql[256];
+    MYSQL_BIND param;
+    unsigned int i, nfields;
+
+    sprintf(sql, "select * from %s where id=?", table_name);
+    MYSQL_STMT* stmt = db->get_stmt(sql);
+    if (!stmt) return ERR_DB_CANT_INIT;
+
+    if (g_print_queries) {
+#ifdef _USING_FCGI_
+        log_messages.printf(MSG_NORMAL, "query: %s [id=%d]\n", sql, id);
+#else
+        fprintf(stderr, "query: %s [id=%d]\n", sql, id);
+#endif
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.buffer_type = MYSQL_TYPE_LONG;
+    param.buffer = &id;
+    if (mysql_stmt_bind_param(stmt, &param)
+        || mysql_stmt_execute(stmt)
+        || mysql_stmt_store_result(stmt)
+    ) {
+        fprintf(stderr, "Prepared statement error: %s\nquery=%s\n",
+            mysql_stmt_error(stmt), sql
+        );
+        db->drop_stmt(sql);
+        return ERR_DB_CANT_INIT;
+    }
+
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+    if (!meta) {
+        mysql_stmt_free_result(stmt);
+        db->drop_stmt(sql);
+        return ERR_DB_CANT_INIT;
+    }
+    nfields = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+
+    std::vector<MYSQL_BIND> binds(nfields);
+    std::vector<std::vector<char> > bufs(nfields);
+    std::vector<unsigned long> lengths(nfields);
+    std::vector<my_bool> is_null(nfields);
+    for (i=0; i<nfields; i++) {
+        bufs[i].resize(fields[i].max_length + 1);
+        memset(&binds[i], 0, sizeof(MYSQL_BIND));
+        binds[i].buffer_type = MYSQL_TYPE_STRING;
+        binds[i].buffer = &bufs[i][0];
+        binds[i].buffer_length = bufs[i].size();
+        binds[i].length = &lengths[i];
+        binds[i].is_null = &is_null[i];
+    }
+    mysql_free_result(meta);
+
+    int retval = 0;
+    if (mysql_stmt_bind_result(stmt, &binds[0])) {
+        retval = ERR_DB_CANT_INIT;
+    } else {
+        int x = mysql_stmt_fetch(stmt);
+        if (x == MYSQL_NO_DATA) {
+            retval = ERR_DB_NOT_FOUND;
+        } else if (x) {
+            retval = ERR_DB_CANT_INIT;
+        } else {
+            std::vector<char*> row(nfields);
+            for (i=0; i<nfields; i++) {
+                if (is_null[i]) {
+                    row[i] = NULL;
+                } else {
+                    bufs[i][lengths[i]] = 0;
+                    row[i] = &bufs[i][0];
+                }
+            }
+            MYSQL_ROW r = &row[0];
+            db_parse(r);
+        }
+    }
+    mysql_stmt_free_result(stmt);
+    if (retval == ERR_DB_CANT_INIT) db->drop_stmt(sql);
+    return retval;
+}
+
 // update an entire record
 //
 int DB_BASE::update() {
@@ -395,11 +557,76 @@ int DB_BASE::enumerate(const char* clause, bool use_use_result) {
     return 0;
 }
 
+// Enumerate in ID order, getting chunk_size rows at a time
+// with "id > (last ID)".
+// Unlike enumerate(), memory use is bounded by the chunk size,
+// and unlike enumerate() with use_use_result,
+// the connection is free between calls (e.g. for updates).
+// "cond" is an SQL condition (no where, order by or limit).
+// The table must have an integer ID, returned by get_id().
+//
+int DB_BASE::enumerate_by_id(const char* cond, int chunk_size) {
+    char query[MAX_QUERY_LEN];
+    MYSQL_ROW row;
+    int x;
+
+    if (!cursor.active) {
+        cursor.active = true;
+        cursor.last_id = 0;
+        cursor.rp = NULL;
+    }
+    while (1) {
+        if (!cursor.rp) {
+            if (strlen(cond)) {
+                sprintf(query,
+                    "select * from %s where id>%d and (%s) order by id limit %d",
+                    table_name, cursor.last_id, cond, chunk_size
+                );
+            } else {
+                sprintf(query,
+                    "select * from %s where id>%d order by id limit %d",
+                    table_name, cursor.last_id, chunk_size
+                );
+            }
+            x = db->do_query(query);
+            if (x) {
+                cursor.active = false;
+                return mysql_errno(db->mysql);
+            }
+            cursor.rp = mysql_store_result(db->mysql);
+            if (!cursor.rp) {
+                cursor.active = false;
+                return mysql_errno(db->mysql);
+            }
+            cursor.nrows = (int)mysql_num_rows(cursor.rp);
+        }
+        row = mysql_fetch_row(cursor.rp);
+        if (row) break;
+        mysql_free_result(cursor.rp);
+        cursor.rp = NULL;
+        if (cursor.nrows < chunk_size) {
+            cursor.active = false;
+            return ERR_DB_NOT_FOUND;
+        }
+    }
+    db_parse(row);
+    x = get_id();
+    if (x <= cursor.last_id) {
+        // no ID, or not in order; we'd loop forever
+        //
+        end_enumerate();
+        return ERR_NOT_IMPLEMENTED;
+    }
+    cursor.last_id = x;
+    return 0;
+}
+
 // call this to end an enumeration before reaching end
 //
 int DB_BASE::end_enumerate() {
     if (cursor.active) {
-        mysql_free_result(cursor.rp);
+        if (cursor.rp) mysql_free_result(cursor.rp);
+        cursor.rp = NULL;
         cursor.active = false;
     }
     return 0;
@@ -501,6 +728,16 @@ void escape_string(char* field, int len) {
 // undo the above process
 // (len not used because this doesn't expand the string)
 //
+void escape_string(const std::string& in, std::string& out) {
+    out.clear();
+    out.reserve(in.size() + in.size()/8);
+    for (std::string::size_type i=0; i<in.size(); i++) {
+        char c = in[i];
+        if (c == '\'' || c == '\\') out += '\\';
+        out += c;
+    }
+}
+
 void unescape_string(char* p, int /*len*/) {
     char* q = p;
     while (*p) {
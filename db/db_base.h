@@ -20,6 +20,8 @@
 
 #include <cstdlib>
 #include <string>
+#include <map>
+#include <vector>
 #include <mysql.h>
 
 extern bool g_print_queries;
@@ -54,9 +56,13 @@ inline double safe_atof(const char* s) {
 struct CURSOR {
     bool active;
     MYSQL_RES *rp;
-    CURSOR() { active = false; rp = NULL; }
+    int last_id;        // for enumerate_by_id()
+    int nrows;          // rows in current chunk
+    CURSOR() { active = false; rp = NULL; last_id = 0; nrows = 0; }
 };
 
+#define ENUM_CHUNK_SIZE 10000
+
 enum ISOLATION_LEVEL {
     READ_UNCOMMITTED,
     READ_COMMITTED,
@@ -81,6 +87,18 @@ public:
     int start_transaction();
     int rollback_transaction();
     int commit_transaction();
+    int replica_lag(int& secs);
+
+    // Prepared statements.
+    // If use_prepared is set, lookup_id() uses a prepared statement,
+    // cached here by its SQL text.
+    // Statements are dropped on error (e.g. after a reconnect)
+    // and re-prepared on next use.
+    //
+    MYSQL_STMT* get_stmt(const char* sql);
+    void drop_stmt(const char* sql);
+    bool use_prepared;
+    std::map<std::string, MYSQL_STMT*> stmts;
 
     MYSQL* mysql;
 };
@@ -104,6 +122,7 @@ public:
     int lookup_id(int id);
     int lookup(const char*);
     int enumerate(const char* clause="", bool use_use_result=false);
+    int enumerate_by_id(const char* cond="", int chunk_size=ENUM_CHUNK_SIZE);
     int end_enumerate();
     int count(int&, const char* clause="");
     int max_id(int&, const char* clause="");
@@ -111,6 +130,7 @@ public:
     int get_double(const char* query, double&);
     int get_integer(const char* query, int&);
     int affected_rows();
+    int lookup_id_prepared(int id);
 
     DB_CONN* db;
     const char *table_name;
@@ -132,6 +152,8 @@ public:
 };
 
 void escape_string(char* field, int len);
+void escape_string(const std::string& in, std::string& out);
+    // same, for text of any length
 void unescape_string(char* p, int len);
 void escape_mysql_like_pattern(const char* in, char* out);
     // if you're going to use a "like X" clause,
@@ -186,6 +186,7 @@ create table host (
     max_results_day         integer         not null,
     error_rate              double          not null default 0,
     product_name            varchar(254)    not null,
+    msgs_pending            tinyint         not null default 0,
 
     primary key (id)
 ) engine=InnoDB;
@@ -390,6 +391,51 @@ create table assignment (
     primary key (id)
 ) engine = InnoDB;
 
+-- Per-app counts of results and WUs in various states.
+-- The unsent and in-progress result counts are kept up to date
+-- by the transitioner and scheduler, and recounted periodically;
+-- see count_unsent_results()
+--
+create table state_counts (
+    appid                   integer         not null,
+    last_update_time        integer         not null,
+        -- when the counts were last recounted
+    result_server_state_2   integer         not null,
+        -- unsent, including inactive
+    result_server_state_4   integer         not null,
+        -- in progress
+    result_file_delete_state_1  integer     not null,
+    result_file_delete_state_2  integer     not null,
+    result_server_state_5_and_file_delete_state_0   integer not null,
+    workunit_need_validate_1    integer     not null,
+    workunit_assimilate_state_1 integer     not null,
+    workunit_file_delete_state_1    integer not null,
+    workunit_file_delete_state_2    integer not null,
+    primary key (appid)
+) engine=InnoDB;
+
+-- instances of a daemon run with --lease_partition; see daemon_lease.h
+--
+create table daemon_member (
+    daemon                  varchar(64)     not null,
+        -- e.g. "transitioner"
+    owner                   varchar(128)    not null,
+        -- host:PID
+    expire_time             integer         not null,
+    primary key (daemon, owner)
+) engine=InnoDB;
+
+-- which instance of a daemon handles IDs with a given (ID mod 64)
+--
+create table daemon_lease (
+    daemon                  varchar(64)     not null,
+    bucket                  integer         not null,
+    owner                   varchar(128)    not null,
+        -- empty if free
+    expire_time             integer         not null,
+    primary key (daemon, bucket)
+) engine=InnoDB;
+
 -- EVERYTHING FROM HERE ON IS USED ONLY FROM PHP,
 -- SO NOT IN BOINC_DB.H ETC.
 
@@ -600,6 +646,18 @@ create table credited_job (
     workunitid              bigint          not null
 ) engine=MyISAM;
 
+/* credit granted by a validator but not yet added to user/team totals
+ * (validator --credit_flush_interval)
+ */
+create table credit_journal (
+    id                      integer         not null auto_increment,
+    owner                   varchar(254)    not null,
+    userid                  integer         not null,
+    start_time              double          not null,
+    credit                  double          not null,
+    primary key (id)
+) engine=InnoDB;
+
 create table donation_items (
     id                      integer         not null auto_increment,
     item_name               varchar(32)     not null,
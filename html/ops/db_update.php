@@ -862,6 +862,71 @@ function update_9_17_2013() {
     do_query("alter table batch add expire_time double not null");
 }
 
+function update_1_14_2013() {
+    do_query("create table credit_journal (
+        id                      integer         not null auto_increment,
+        owner                   varchar(254)    not null,
+        userid                  integer         not null,
+        start_time              double          not null,
+        credit                  double          not null,
+        primary key (id)
+        ) engine=InnoDB"
+    );
+    do_query("alter table credit_journal add index cj_owner (owner)");
+}
+
+function update_1_25_2013() {
+    do_query("alter table workunit add index wu_batch (batch)");
+}
+
+function update_2_8_2013() {
+    do_query("alter table host add msgs_pending tinyint not null default 0");
+}
+
+function update_2_8_2013_workunit() {
+    do_query("alter table workunit drop index wu_timeout, add index wu_timeout (transition_time, transitioner_flags)");
+}
+
+// state_counts gets frequent single-row updates; make it InnoDB.
+// It may not exist if the project was created from schema.sql
+//
+function update_2_8_2013_state_counts() {
+    do_query("create table if not exists state_counts (
+            appid               integer     not null,
+            last_update_time    integer     not null,
+            result_server_state_2       integer not null,
+            result_server_state_4       integer not null,
+            result_file_delete_state_1  integer not null,
+            result_file_delete_state_2  integer not null,
+            result_server_state_5_and_file_delete_state_0       integer not null,
+            workunit_need_validate_1    integer not null,
+            workunit_assimilate_state_1 integer not null,
+            workunit_file_delete_state_1        integer not null,
+            workunit_file_delete_state_2        integer not null,
+            primary key (appid)
+            ) engine=InnoDB
+    ");
+    do_query("alter table state_counts engine=InnoDB");
+}
+
+function update_2_8_2013_lease() {
+    do_query("create table daemon_member (
+            daemon              varchar(64)     not null,
+            owner               varchar(128)    not null,
+            expire_time         integer         not null,
+            primary key (daemon, owner)
+            ) engine=InnoDB
+    ");
+    do_query("create table daemon_lease (
+            daemon              varchar(64)     not null,
+            bucket              integer         not null,
+            owner               varchar(128)    not null,
+            expire_time         integer         not null,
+            primary key (daemon, bucket)
+            ) engine=InnoDB
+    ");
+}
+
 // Updates are done automatically if you use "upgrade".
 //
 // If you need to do updates manually,
@@ -898,6 +963,12 @@ $db_updates = array (
     array(27002, "update_5_23_2013"),
     array(27003, "update_9_10_2013"),
     array(27004, "update_9_17_2013"),
+    array(27005, "update_1_14_2013"),
+    array(27006, "update_1_25_2013"),
+    array(27007, "update_2_8_2013"),
+    array(27008, "update_2_8_2013_workunit"),
+    array(27009, "update_2_8_2013_state_counts"),
+    array(27010, "update_2_8_2013_lease"),
 );
 
 ?>
@@ -141,6 +141,23 @@ function get_mysql_count($query) {
     return $count;
 }
 
+// an app's count of unsent (2) or in-progress (4) results.
+// Use state_counts, maintained by the daemons,
+// if it has been recounted recently
+//
+function get_app_result_count($appid, $state) {
+    $result = mysql_query("select * from state_counts where appid=$appid and last_update_time > unix_timestamp()-7200");
+    if ($result) {
+        $sc = mysql_fetch_object($result);
+        mysql_free_result($result);
+        if ($sc) {
+            $field = "result_server_state_$state";
+            return max(0, $sc->$field);
+        }
+    }
+    return get_mysql_count("result where server_state = $state and appid = $appid");
+}
+
 function get_mysql_value($query) {
     $value = unserialize(get_cached_data(3600, "get_mysql_value".$query));
     if ($value == false) {
@@ -456,8 +473,8 @@ if ($retval) {
              echo "      <app>\n";
              echo "        <id>".$appid."</id>\n";
              echo "        <name>".$app["name"]."</name>\n";
-             echo "        <unsent>".get_mysql_count("result where server_state = 2 and appid = $appid")."</unsent>\n";
-             echo "        <in_progress>".get_mysql_count("result where server_state = 4 and appid = $appid")."</in_progress>\n";
+             echo "        <unsent>".get_app_result_count($appid, 2)."</unsent>\n";
+             echo "        <in_progress>".get_app_result_count($appid, 4)."</in_progress>\n";
              echo "        <avg_runtime>".round($info->avg, 2)."</avg_runtime>\n";
              echo "        <min_runtime>".round($info->min, 2)."</min_runtime>\n";
              echo "        <max_runtime>".round($info->max, 2)."</max_runtime>\n";
@@ -465,8 +482,8 @@ if ($retval) {
              echo "      </app>\n";
         } else {
             echo "<tr><td>$uf_name</td>
-                <td>" . number_format(get_mysql_count("result where server_state = 2 and appid = $appid")) . "</td>
-                <td>" . number_format(get_mysql_count("result where server_state = 4 and appid = $appid")) . "</td>
+                <td>" . number_format(get_app_result_count($appid, 2)) . "</td>
+                <td>" . number_format(get_app_result_count($appid, 4)) . "</td>
                 <td>"
             ;
             echo number_format($info->avg,2) . " (" . number_format($info->min,2) . " - " . number_format($info->max,2) . ")";
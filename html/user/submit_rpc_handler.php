@@ -152,18 +152,45 @@ function stage_files(&$jobs, $template) {
     }
 }
 
-function submit_job($job, $template, $app, $batch_id, $i, $priority) {
-    $cmd = "cd ../..; ./bin/create_work --appname $app->name --batch $batch_id --rsc_fpops_est $job->rsc_fpops_est --priority $priority";
-    if ($job->command_line) {
-        $cmd .= " --command_line \"$job->command_line\"";
-    }
-    $cmd .= " --wu_name $job->name";
-    foreach ($job->input_files as $file) {
-        $cmd .= " $file->name";
+// quote a string for a create_work --stdin job line
+//
+function stdin_quote($s) {
+    return '"'.str_replace(array('\\', '"'), array('\\\\', '\\"'), $s).'"';
+}
+
+// create the jobs with a single create_work --stdin,
+// which inserts them in batches and skips jobs that already exist
+// (so a failed submission can be retried)
+//
+function submit_jobs($jobs, $template, $app, $batch_id, $priority) {
+    $path = tempnam("/tmp", "boinc_jobs_");
+    $f = fopen($path, "w");
+    if (!$f) {
+        xml_error(-1, "BOINC server: can't create job file");
+    }
+    foreach ($jobs as $job) {
+        $x = "";
+        if ($job->name) {
+            $x .= " --wu_name ".stdin_quote($job->name);
+        }
+        if ($job->rsc_fpops_est) {
+            $x .= " --rsc_fpops_est $job->rsc_fpops_est";
+        }
+        if ($job->command_line) {
+            $x .= " --command_line ".stdin_quote($job->command_line);
+        }
+        foreach ($job->input_files as $file) {
+            $x .= " ".stdin_quote($file->name);
+        }
+        fwrite($f, "$x\n");
     }
-    $ret = system($cmd);
-    if ($ret === FALSE) {
-        xml_error(-1, "BOINC server: can't create job");
+    fclose($f);
+    $cmd = "cd ../..; ./bin/create_work --appname $app->name --batch $batch_id --priority $priority --stdin < $path 2>&1";
+    $output = array();
+    exec($cmd, $output, $ret);
+    unlink($path);
+    if ($ret) {
+        xml_error(-1, "BOINC server: can't create jobs: ".implode("\n", $output));
     }
 }
 
@@ -247,10 +274,7 @@ function submit_batch($r) {
         }
         $batch = BoincBatch::lookup_id($batch_id);
     }
-    $i = 0;
-    foreach($jobs as $job) {
-        submit_job($job, $template, $app, $batch_id, $i++, $let);
-    }
+    submit_jobs($jobs, $template, $app, $batch_id, $let);
 
     // set state to IN_PROGRESS only after creating jobs;
     // otherwise we might flag batch as COMPLETED
@@ -22,7 +22,14 @@
 #else
 #include "config.h"
 #include <cstring>
+#include <map>
 #include <string>
+#ifdef __linux__
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #endif
 
 #include "error_numbers.h"
@@ -32,6 +39,7 @@
 #include "str_replace.h"
 #include "str_util.h"
 #include "url.h"
+#include "util.h"
 
 #include "app_ipc.h"
 
@@ -39,6 +47,7 @@
 #define strdup _strdup
 #endif
 
+using std::map;
 using std::string;
 
 APP_INIT_DATA::APP_INIT_DATA() : project_preferences(NULL) {
@@ -107,6 +116,10 @@ void APP_INIT_DATA::copy(const APP_INIT_DATA& a) {
     fraction_done_end             = a.fraction_done_end;
     gpu_device_num                = a.gpu_device_num;
     gpu_opencl_dev_index          = a.gpu_opencl_dev_index;
+    gpu_opencl_platform_index     = a.gpu_opencl_platform_index;
+    gpu_pci_domain_id             = a.gpu_pci_domain_id;
+    gpu_pci_bus_id                = a.gpu_pci_bus_id;
+    gpu_pci_device_id             = a.gpu_pci_device_id;
     gpu_usage                     = a.gpu_usage;
     ncpus                         = a.ncpus;
     checkpoint_period             = a.checkpoint_period;
@@ -117,6 +130,7 @@ void APP_INIT_DATA::copy(const APP_INIT_DATA& a) {
         project_preferences = NULL;
     }
     vbox_window                   = a.vbox_window;
+    shmem_ring_version            = a.shmem_ring_version;
 }
 
 int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
@@ -198,6 +212,10 @@ int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         "<gpu_type>%s</gpu_type>\n"
         "<gpu_device_num>%d</gpu_device_num>\n"
         "<gpu_opencl_dev_index>%d</gpu_opencl_dev_index>\n"
+        "<gpu_opencl_platform_index>%d</gpu_opencl_platform_index>\n"
+        "<gpu_pci_domain_id>%d</gpu_pci_domain_id>\n"
+        "<gpu_pci_bus_id>%d</gpu_pci_bus_id>\n"
+        "<gpu_pci_device_id>%d</gpu_pci_device_id>\n"
         "<gpu_usage>%f</gpu_usage>\n"
         "<ncpus>%f</ncpus>\n"
         "<rsc_fpops_est>%f</rsc_fpops_est>\n"
@@ -205,7 +223,8 @@ int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         "<rsc_memory_bound>%f</rsc_memory_bound>\n"
         "<rsc_disk_bound>%f</rsc_disk_bound>\n"
         "<computation_deadline>%f</computation_deadline>\n"
-        "<vbox_window>%d</vbox_window>\n",
+        "<vbox_window>%d</vbox_window>\n"
+        "<shmem_ring_version>%d</shmem_ring_version>\n",
         ai.slot,
         ai.client_pid,
         ai.wu_cpu_time,
@@ -223,6 +242,10 @@ int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         ai.gpu_type,
         ai.gpu_device_num,
         ai.gpu_opencl_dev_index,
+        ai.gpu_opencl_platform_index,
+        ai.gpu_pci_domain_id,
+        ai.gpu_pci_bus_id,
+        ai.gpu_pci_device_id,
         ai.gpu_usage,
         ai.ncpus,
         ai.rsc_fpops_est,
@@ -230,7 +253,8 @@ int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         ai.rsc_memory_bound,
         ai.rsc_disk_bound,
         ai.computation_deadline,
-        ai.vbox_window
+        ai.vbox_window,
+        ai.shmem_ring_version
     );
     MIOFILE mf;
     mf.init_file(f);
@@ -285,9 +309,14 @@ void APP_INIT_DATA::clear() {
     gpu_device_num = -1;
     // -1 means an older version without gpu_opencl_dev_index field
     gpu_opencl_dev_index = -1;
+    gpu_opencl_platform_index = -1;
+    gpu_pci_domain_id = -1;
+    gpu_pci_bus_id = -1;
+    gpu_pci_device_id = -1;
     gpu_usage = 0;
     ncpus = 0;
     memset(&shmem_seg_name, 0, sizeof(shmem_seg_name));
+    shmem_ring_version = 0;
     wu_cpu_time = 0;
     vbox_window = false;
 }
@@ -388,18 +417,33 @@ int parse_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         if (xp.parse_str("gpu_type", ai.gpu_type, sizeof(ai.gpu_type))) continue;
         if (xp.parse_int("gpu_device_num", ai.gpu_device_num)) continue;
         if (xp.parse_int("gpu_opencl_dev_index", ai.gpu_opencl_dev_index)) continue;
+        if (xp.parse_int("gpu_opencl_platform_index", ai.gpu_opencl_platform_index)) continue;
+        if (xp.parse_int("gpu_pci_domain_id", ai.gpu_pci_domain_id)) continue;
+        if (xp.parse_int("gpu_pci_bus_id", ai.gpu_pci_bus_id)) continue;
+        if (xp.parse_int("gpu_pci_device_id", ai.gpu_pci_device_id)) continue;
         if (xp.parse_double("gpu_usage", ai.gpu_usage)) continue;
         if (xp.parse_double("ncpus", ai.ncpus)) continue;
         if (xp.parse_double("fraction_done_start", ai.fraction_done_start)) continue;
         if (xp.parse_double("fraction_done_end", ai.fraction_done_end)) continue;
         if (xp.parse_bool("vbox_window", ai.vbox_window)) continue;
+        if (xp.parse_int("shmem_ring_version", ai.shmem_ring_version)) continue;
         xp.skip_unexpected(false, "parse_init_data_file");
     }
     fprintf(stderr, "parse_init_data_file: no end tag\n");
     return ERR_XML_PARSE;
 }
 
-APP_CLIENT_SHM::APP_CLIENT_SHM() : shm(NULL) {
+APP_CLIENT_SHM::APP_CLIENT_SHM() : shm(NULL), use_rings(false) {
+}
+
+// Messages that were sent on the channel before the app
+// announced ring support are older than those in the ring,
+// so check the channel first.
+//
+bool APP_CLIENT_SHM::get_process_control_msg(char* msg) {
+    if (shm->process_control_request.get_msg(msg)) return true;
+    if (use_rings) return shm->process_control_ring.get_msg(msg);
+    return false;
 }
 
 bool MSG_CHANNEL::get_msg(char *msg) {
@@ -421,6 +465,55 @@ void MSG_CHANNEL::send_msg_overwrite(const char* msg) {
     buf[0] = 1;
 }
 
+// the slot must be fully written (or read) before
+// the index that hands it to the other side is changed
+//
+#ifdef _WIN32
+#define MSG_RING_BARRIER()  MemoryBarrier()
+#else
+#define MSG_RING_BARRIER()  __sync_synchronize()
+#endif
+
+bool MSG_RING::get_msg(char* msg) {
+    unsigned int t = tail;
+    if (head == t) return false;
+    MSG_RING_BARRIER();
+    strlcpy(msg, msgs[t%MSG_RING_SLOTS], MSG_CHANNEL_SIZE);
+    MSG_RING_BARRIER();
+    tail = t+1;
+    return true;
+}
+
+bool MSG_RING::send_msg(const char* msg) {
+    unsigned int h = head;
+    if (h - tail >= MSG_RING_SLOTS) return false;
+    MSG_RING_BARRIER();
+    strlcpy(msgs[h%MSG_RING_SLOTS], msg, MSG_CHANNEL_SIZE);
+    MSG_RING_BARRIER();
+    head = h+1;
+#ifdef __linux__
+    syscall(SYS_futex, (int*)&head, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+    return true;
+}
+
+// If a message arrives between our check and the futex call,
+// "head" will have changed and FUTEX_WAIT returns immediately.
+//
+void MSG_RING::wait_msg(double timeout) {
+    unsigned int h = head;
+    if (h != tail) return;
+    if (timeout <= 0) return;
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = (time_t)timeout;
+    ts.tv_nsec = (long)((timeout - ts.tv_sec)*1e9);
+    syscall(SYS_futex, (int*)&head, FUTEX_WAIT, (int)h, &ts, NULL, 0);
+#else
+    boinc_sleep(timeout);
+#endif
+}
+
 void APP_CLIENT_SHM::reset_msgs() {
     memset(shm, 0, sizeof(SHARED_MEM));
 }
@@ -433,6 +526,52 @@ void APP_CLIENT_SHM::reset_msgs() {
 //   virtual name is a symbolic link
 // - Standalone: physical path is same as virtual name
 //
+// Resolving a name opens and reads a file,
+// so apps that resolve names repeatedly can have the results
+// for the slot directory's files read once (see boinc_resolve_cache_init()).
+// The cache isn't changed after that,
+// so threads can use it without locking.
+//
+static map<string, string> resolve_cache;
+
+// soft link files are one short line; bigger files aren't links
+//
+#define SOFT_LINK_MAX_SIZE  4096
+
+static const string* cached_name(const char* virtual_name) {
+    if (resolve_cache.empty()) return NULL;
+    map<string, string>::const_iterator i = resolve_cache.find(virtual_name);
+    if (i == resolve_cache.end()) return NULL;
+    return &(i->second);
+}
+
+int boinc_resolve_cache_init() {
+    char name[MAXPATHLEN];
+    string physical_name;
+    double size;
+
+    resolve_cache.clear();
+    DIRREF dir = dir_open(".");
+    if (!dir) return ERR_OPENDIR;
+    while (!dir_scan(name, dir, sizeof(name))) {
+#ifndef _WIN32
+        if (is_symlink(name)) {
+            resolve_cache[name] = name;
+            continue;
+        }
+#endif
+        if (!is_file(name)) continue;
+        if (file_size(name, size) || size > SOFT_LINK_MAX_SIZE) {
+            resolve_cache[name] = name;
+            continue;
+        }
+        boinc_resolve_filename_s(name, physical_name);
+        resolve_cache[name] = physical_name;
+    }
+    dir_close(dir);
+    return 0;
+}
+
 int boinc_resolve_filename(
     const char *virtual_name, char *physical_name, int len
 ) {
@@ -440,6 +579,11 @@ int boinc_resolve_filename(
     char buf[512], *p;
 
     if (!virtual_name) return ERR_NULL;
+    const string* cp = cached_name(virtual_name);
+    if (cp) {
+        strlcpy(physical_name, cp->c_str(), len);
+        return 0;
+    }
     strlcpy(physical_name, virtual_name, len);
 
 #ifndef _WIN32
@@ -472,6 +616,11 @@ int boinc_resolve_filename(
 int boinc_resolve_filename_s(const char *virtual_name, string& physical_name) {
     char buf[512], *p;
     if (!virtual_name) return ERR_NULL;
+    const string* cp = cached_name(virtual_name);
+    if (cp) {
+        physical_name = *cp;
+        return 0;
+    }
     physical_name = virtual_name;
 #ifndef _WIN32
     if (is_symlink(virtual_name)) {
@@ -64,6 +64,40 @@ struct MSG_CHANNEL {
                             // write message, overwriting any msg already there
 };
 
+// A MSG_RING holds up to MSG_RING_SLOTS messages,
+// for channels where a sender may have several messages
+// pending (e.g. suspend and resume) and we don't want
+// to deliver one per receiver poll.
+// There's one sender and one receiver;
+// "head" is written only by the sender, "tail" only by the receiver.
+//
+// Rings are at the end of SHARED_MEM, so old apps don't see them.
+// The client announces support with <shmem_ring_version>
+// in the init data file; an app that uses rings
+// sets SHARED_MEM::app_ring_version.
+// Each side uses a ring only if the other supports it.
+//
+#define MSG_RING_VERSION    1
+#define MSG_RING_SLOTS      8
+
+struct MSG_RING {
+    volatile unsigned int head;     // # of messages sent
+    volatile unsigned int tail;     // # of messages received
+    char msgs[MSG_RING_SLOTS][MSG_CHANNEL_SIZE];
+
+    bool get_msg(char*);            // returns false if empty
+    inline bool has_msg() {
+        return head != tail;
+    }
+    bool send_msg(const char*);     // returns false if full
+                                    // (on Linux, wakes up wait_msg())
+    void wait_msg(double timeout);
+        // receiver: wait until there's a message or timeout.
+        // Can return early.
+        // On Linux this uses a futex on "head";
+        // elsewhere it just sleeps.
+};
+
 struct SHARED_MEM {
     MSG_CHANNEL process_control_request;
         // core->app
@@ -97,6 +131,13 @@ struct SHARED_MEM {
     MSG_CHANNEL trickle_down;
         // core->app
         // <have_new_trickle_down/>
+
+    // the following are used only if both client and app support them;
+    // see MSG_RING
+    //
+    int app_ring_version;
+    MSG_RING process_control_ring;
+        // core->app; same messages as process_control_request
 };
 
 // MSG_QUEUE provides a queuing mechanism for shared-mem messages
@@ -107,8 +148,9 @@ struct MSG_QUEUE {
     char name[256];
 	double last_block;	// last time we found message channel full
 	void init(char*);
-    void msg_queue_send(const char*, MSG_CHANNEL& channel);
-    void msg_queue_poll(MSG_CHANNEL& channel);
+    void msg_queue_send(const char*, MSG_CHANNEL& channel, MSG_RING* ring=NULL);
+    void msg_queue_poll(MSG_CHANNEL& channel, MSG_RING* ring=NULL);
+        // if ring is non-NULL, use it instead of the channel
 	int msg_queue_purge(const char*);
 	bool timeout(double);
 };
@@ -121,9 +163,23 @@ struct MSG_QUEUE {
 class APP_CLIENT_SHM {
 public:
     SHARED_MEM *shm;
+    bool use_rings;
+        // app: the client supports MSG_RINGs,
+        // so the rings are in the segment
 
     void reset_msgs();        // resets all messages and clears their flags
 
+    // client: the process control ring, or NULL if the app doesn't use it
+    //
+    inline MSG_RING* process_control_ring() {
+        if (!shm || shm->app_ring_version < MSG_RING_VERSION) return NULL;
+        return &shm->process_control_ring;
+    }
+
+    // app: get a process control message from the channel or the ring
+    //
+    bool get_process_control_msg(char*);
+
     APP_CLIENT_SHM();
 };
 
@@ -192,6 +248,12 @@ struct APP_INIT_DATA {
     char gpu_type[64];
     int gpu_device_num;
     int gpu_opencl_dev_index;
+    int gpu_opencl_platform_index;
+        // index into clGetPlatformIDs(); -1 if unknown.
+        // Lets the app open its device without enumerating the others
+    int gpu_pci_domain_id;      // -1 if unknown
+    int gpu_pci_bus_id;
+    int gpu_pci_device_id;
     double gpu_usage;   // APP_VERSION.gpu_usage.usage
 
     // info for multicore apps: how many cores to use
@@ -206,6 +268,7 @@ struct APP_INIT_DATA {
     //
     double checkpoint_period;     // recommended checkpoint period
     SHMEM_SEG_NAME shmem_seg_name;
+    int shmem_ring_version;     // MSG_RING version supported by client
     double wu_cpu_time;       // cpu time from previous episodes
 
     APP_INIT_DATA();
@@ -246,6 +309,12 @@ int parse_graphics_file(FILE* f, GRAPHICS_INFO* gi);
 
 extern int boinc_link(const char* phys_name, const char* logical_name);
 extern int boinc_resolve_filename_s(const char*, std::string&);
+extern int boinc_resolve_cache_init();
+    // resolve the names of the files in the current (slot) directory,
+    // and have the above use the results rather than reading the files.
+    // Names not there at this point are resolved as usual.
+    // Call before starting threads that resolve names.
+    // boinc_init() calls this; a task's links don't change while it runs
 extern void url_to_project_dir(char* url, char* dir);
 
 extern "C" {
@@ -215,6 +215,7 @@ void CONFIG::defaults() {
     exit_after_finish = false;
     exit_before_start = false;
     exit_when_idle = false;
+    fetch_hysteresis = false;
     fetch_minimal_work = false;
     fetch_on_update = false;
     force_auth = "default";
@@ -225,18 +226,25 @@ void CONFIG::defaults() {
         ignore_gpu_instance[i].clear();
     }
     max_event_log_lines = DEFAULT_MAX_EVENT_LOG_LINES;
+    max_download_segments = 0;
     max_file_xfers = 8;
     max_file_xfers_per_project = 2;
     max_stderr_file_size = 0;
     max_stdout_file_size = 0;
     max_tasks_reported = 0;
+    max_mem_heavy_tasks_per_node = 0;
+    max_sched_rpcs = 4;
     ncpus = -1;
     network_test_url = "http://www.google.com/";
     no_alt_platform = false;
+    no_async_file_thread = false;
     no_gpus = false;
+    no_gpu_telemetry = false;
     no_info_fetch = false;
     no_priority_change = false;
+    no_restart_throttle = false;
     os_random_only = false;
+    perf_counters = false;
     proxy_info.clear();
     rec_half_life = 10*86400;
 #ifdef ANDROID
@@ -249,12 +257,15 @@ void CONFIG::defaults() {
     simple_gui_only = false;
     skip_cpu_benchmarks = false;
     start_delay = 0;
+    state_file_write_interval = 0;
     stderr_head = false;
     suppress_net_info = false;
+    task_affinity = false;
     unsigned_apps_ok = false;
     use_all_gpus = false;
     use_certs = false;
     use_certs_only = false;
+    use_cgroups = false;
     vbox_window = false;
 }
 
@@ -368,6 +379,7 @@ int CONFIG::parse_options(XML_PARSER& xp) {
             }
             continue;
         }
+        if (xp.parse_bool("fetch_hysteresis", fetch_hysteresis)) continue;
         if (xp.parse_bool("fetch_minimal_work", fetch_minimal_work)) continue;
         if (xp.parse_bool("fetch_on_update", fetch_on_update)) continue;
         if (xp.parse_string("force_auth", force_auth)) {
@@ -390,10 +402,13 @@ int CONFIG::parse_options(XML_PARSER& xp) {
             continue;
         }
         if (xp.parse_int("max_event_log_lines", max_event_log_lines)) continue;
+        if (xp.parse_int("max_download_segments", max_download_segments)) continue;
         if (xp.parse_int("max_file_xfers", max_file_xfers)) continue;
         if (xp.parse_int("max_file_xfers_per_project", max_file_xfers_per_project)) continue;
         if (xp.parse_int("max_stderr_file_size", max_stderr_file_size)) continue;
         if (xp.parse_int("max_stdout_file_size", max_stdout_file_size)) continue;
+        if (xp.parse_int("max_mem_heavy_tasks_per_node", max_mem_heavy_tasks_per_node)) continue;
+        if (xp.parse_int("max_sched_rpcs", max_sched_rpcs)) continue;
         if (xp.parse_int("max_tasks_reported", max_tasks_reported)) continue;
         if (xp.parse_int("ncpus", ncpus)) continue;
         if (xp.parse_string("network_test_url", network_test_url)) {
@@ -401,10 +416,14 @@ int CONFIG::parse_options(XML_PARSER& xp) {
             continue;
         }
         if (xp.parse_bool("no_alt_platform", no_alt_platform)) continue;
+        if (xp.parse_bool("no_async_file_thread", no_async_file_thread)) continue;
         if (xp.parse_bool("no_gpus", no_gpus)) continue;
+        if (xp.parse_bool("no_gpu_telemetry", no_gpu_telemetry)) continue;
         if (xp.parse_bool("no_info_fetch", no_info_fetch)) continue;
         if (xp.parse_bool("no_priority_change", no_priority_change)) continue;
+        if (xp.parse_bool("no_restart_throttle", no_restart_throttle)) continue;
         if (xp.parse_bool("os_random_only", os_random_only)) continue;
+        if (xp.parse_bool("perf_counters", perf_counters)) continue;
 #ifndef SIM
         if (xp.match_tag("proxy_info")) {
             proxy_info.parse_config(xp);
@@ -422,12 +441,15 @@ int CONFIG::parse_options(XML_PARSER& xp) {
         if (xp.parse_bool("simple_gui_only", simple_gui_only)) continue;
         if (xp.parse_bool("skip_cpu_benchmarks", skip_cpu_benchmarks)) continue;
         if (xp.parse_double("start_delay", start_delay)) continue;
+        if (xp.parse_int("state_file_write_interval", state_file_write_interval)) continue;
         if (xp.parse_bool("stderr_head", stderr_head)) continue;
         if (xp.parse_bool("suppress_net_info", suppress_net_info)) continue;
+        if (xp.parse_bool("task_affinity", task_affinity)) continue;
         if (xp.parse_bool("unsigned_apps_ok", unsigned_apps_ok)) continue;
         if (xp.parse_bool("use_all_gpus", use_all_gpus)) continue;
         if (xp.parse_bool("use_certs", use_certs)) continue;
         if (xp.parse_bool("use_certs_only", use_certs_only)) continue;
+        if (xp.parse_bool("use_cgroups", use_cgroups)) continue;
         if (xp.parse_bool("vbox_window", vbox_window)) continue;
 
         xp.skip_unexpected(true, "CONFIG::parse_options");
@@ -546,6 +568,7 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         "        <exit_after_finish>%d</exit_after_finish>\n"
         "        <exit_before_start>%d</exit_before_start>\n"
         "        <exit_when_idle>%d</exit_when_idle>\n"
+        "        <fetch_hysteresis>%d</fetch_hysteresis>\n"
         "        <fetch_minimal_work>%d</fetch_minimal_work>\n"
         "        <fetch_on_update>%d</fetch_on_update>\n"
         "        <force_auth>%s</force_auth>\n"
@@ -555,6 +578,7 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         exit_after_finish,
         exit_before_start,
         exit_when_idle,
+        fetch_hysteresis,
         fetch_minimal_work,
         fetch_on_update,
         force_auth.c_str(),
@@ -586,31 +610,45 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         
     out.printf(
         "        <max_event_log_lines>%d</max_event_log_lines>\n"
+        "        <max_download_segments>%d</max_download_segments>\n"
         "        <max_file_xfers>%d</max_file_xfers>\n"
         "        <max_file_xfers_per_project>%d</max_file_xfers_per_project>\n"
+        "        <max_mem_heavy_tasks_per_node>%d</max_mem_heavy_tasks_per_node>\n"
+        "        <max_sched_rpcs>%d</max_sched_rpcs>\n"
         "        <max_stderr_file_size>%d</max_stderr_file_size>\n"
         "        <max_stdout_file_size>%d</max_stdout_file_size>\n"
         "        <max_tasks_reported>%d</max_tasks_reported>\n"
         "        <ncpus>%d</ncpus>\n"
         "        <network_test_url>%s</network_test_url>\n"
         "        <no_alt_platform>%d</no_alt_platform>\n"
+        "        <no_async_file_thread>%d</no_async_file_thread>\n"
         "        <no_gpus>%d</no_gpus>\n"
+        "        <no_gpu_telemetry>%d</no_gpu_telemetry>\n"
         "        <no_info_fetch>%d</no_info_fetch>\n"
         "        <no_priority_change>%d</no_priority_change>\n"
-        "        <os_random_only>%d</os_random_only>\n",
+        "        <no_restart_throttle>%d</no_restart_throttle>\n"
+        "        <os_random_only>%d</os_random_only>\n"
+        "        <perf_counters>%d</perf_counters>\n",
         max_event_log_lines,
+        max_download_segments,
         max_file_xfers,
         max_file_xfers_per_project,
+        max_mem_heavy_tasks_per_node,
+        max_sched_rpcs,
         max_stderr_file_size,
         max_stdout_file_size,
         max_tasks_reported,
         ncpus,
         network_test_url.c_str(),
         no_alt_platform,
+        no_async_file_thread,
         no_gpus,
+        no_gpu_telemetry,
         no_info_fetch,
         no_priority_change,
-        os_random_only
+        no_restart_throttle,
+        os_random_only,
+        perf_counters
     );
     
     proxy_info.write(out);
@@ -623,12 +661,15 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         "        <skip_cpu_benchmarks>%d</skip_cpu_benchmarks>\n"
         "        <simple_gui_only>%d</simple_gui_only>\n"
         "        <start_delay>%d</start_delay>\n"
+        "        <state_file_write_interval>%d</state_file_write_interval>\n"
         "        <stderr_head>%d</stderr_head>\n"
         "        <suppress_net_info>%d</suppress_net_info>\n"
+        "        <task_affinity>%d</task_affinity>\n"
         "        <unsigned_apps_ok>%d</unsigned_apps_ok>\n"
         "        <use_all_gpus>%d</use_all_gpus>\n"
         "        <use_certs>%d</use_certs>\n"
         "        <use_certs_only>%d</use_certs_only>\n"
+        "        <use_cgroups>%d</use_cgroups>\n"
         "        <vbox_window>%d</vbox_window>\n",
         rec_half_life/86400,
         report_results_immediately,
@@ -637,12 +678,15 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         skip_cpu_benchmarks,
         simple_gui_only,
         start_delay,
+        state_file_write_interval,
         stderr_head,
         suppress_net_info,
+        task_affinity,
         unsigned_apps_ok,
         use_all_gpus,
         use_certs,
         use_certs_only,
+        use_cgroups,
         vbox_window
     );
 
@@ -156,6 +156,10 @@ struct CONFIG {
     bool exit_after_finish;
     bool exit_before_start;
     bool exit_when_idle;
+    bool fetch_hysteresis;
+        // when fetching work, fill the buffer to at least
+        // WORK_BUF_MIN_HYSTERESIS*work_buf_min past work_buf_min,
+        // even if work_buf_additional is less
     bool fetch_minimal_work;
     bool fetch_on_update;
     std::string force_auth;
@@ -163,18 +167,37 @@ struct CONFIG {
     int http_transfer_timeout_bps;
     int http_transfer_timeout;
     std::vector<int> ignore_gpu_instance[NPROC_TYPES];
+    int max_download_segments;
+        // download large files in segments,
+        // with up to this many requests at once; 0 or 1 = don't
     int max_file_xfers;
     int max_file_xfers_per_project;
+    int max_mem_heavy_tasks_per_node;
+        // if nonzero, run at most this many memory-bandwidth-heavy
+        // CPU tasks per NUMA node (classified using <perf_counters>
+        // or <mem_heavy> in app_config.xml)
+    int max_sched_rpcs;
+        // max # of scheduler RPCs (to different projects) at once
     int max_stderr_file_size;
     int max_stdout_file_size;
     int max_tasks_reported;
     int ncpus;
     std::string network_test_url;
     bool no_alt_platform;
+    bool no_async_file_thread;
+        // do async file ops in the main thread
     bool no_gpus;
+    bool no_gpu_telemetry;
+        // don't read GPU status (utilization, free memory etc.)
+        // from the vendor's management library
     bool no_info_fetch;
     bool no_priority_change;
+    bool no_restart_throttle;
+        // restart all scheduled tasks at once,
+        // rather than limiting the checkpoint data being read at once
     bool os_random_only;
+    bool perf_counters;
+        // Linux: count cycles, instructions and cache misses of tasks
     PROXY_INFO proxy_info;
     double rec_half_life;
     bool report_results_immediately;
@@ -183,13 +206,23 @@ struct CONFIG {
     bool skip_cpu_benchmarks;
     bool simple_gui_only;
     double start_delay;
+    int state_file_write_interval;
+        // if nonzero, routine state changes (task checkpoints,
+        // CPU scheduling, file transfer progress) are written
+        // to the state file at most this often (seconds)
     bool stderr_head;
     bool suppress_net_info;
+    bool task_affinity;
+        // Linux: place running tasks on CPUs
+        // according to the cache and NUMA topology
     bool unsigned_apps_ok;
     bool use_all_gpus;
     bool use_certs;
     bool use_certs_only;
         // overrides use_certs
+    bool use_cgroups;
+        // Linux: run each task in its own cgroup (v2),
+        // and use it to suspend, throttle and limit the task
     bool vbox_window;
 
     CONFIG();
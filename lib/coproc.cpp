@@ -78,6 +78,7 @@ int PCI_INFO::parse(XML_PARSER& xp) {
     bus_id = device_id = domain_id = 0;
     while (!xp.get_tag()) {
         if (xp.match_tag("/pci_info")) {
+            present = true;
             return 0;
         }
         if (xp.parse_int("bus_id", bus_id)) continue;
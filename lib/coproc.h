@@ -81,6 +81,9 @@
 #include "opencl_boinc.h"
 
 #define DEFER_ON_GPU_AVAIL_RAM  0
+    // if set, the client doesn't start GPU jobs that need more RAM
+    // than the GPU had when it was detected.
+    // The client uses measured free RAM when it has it (see gpu_telemetry.h)
 
 #define MAX_COPROC_INSTANCES 64
 #define MAX_RSC 8
@@ -167,15 +170,14 @@ struct COPROC {
     cl_device_id opencl_device_ids[MAX_COPROC_INSTANCES];
     int opencl_device_count;
     int opencl_device_indexes[MAX_COPROC_INSTANCES];
+    int opencl_platform_indexes[MAX_COPROC_INSTANCES];
     PCI_INFO pci_info;
     PCI_INFO pci_infos[MAX_COPROC_INSTANCES];
 
     bool running_graphics_app[MAX_COPROC_INSTANCES];
         // is this GPU running a graphics app (NVIDIA only)
-#if DEFER_ON_GPU_AVAIL_RAM
     double available_ram_temp[MAX_COPROC_INSTANCES];
         // used during job scheduling
-#endif
 
     double last_print_time;
 
@@ -205,10 +207,12 @@ struct COPROC {
         for (int i=0; i<MAX_COPROC_INSTANCES; i++) {
             device_nums[i] = 0;
             opencl_device_ids[i] = 0;
+            opencl_platform_indexes[i] = -1;
             running_graphics_app[i] = true;
         }
         memset(&opencl_prop, 0, sizeof(opencl_prop));
         memset(&pci_info, 0, sizeof(pci_info));
+        memset(pci_infos, 0, sizeof(pci_infos));
     }
     inline void clear_usage() {
         for (int i=0; i<count; i++) {
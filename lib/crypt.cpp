@@ -273,13 +273,21 @@ int decrypt_public(R_RSA_PUBLIC_KEY& key, DATA_BLOCK& in, DATA_BLOCK& out) {
     int retval;
     RSA* rp = RSA_new();
     public_to_openssl(key, rp);
+    retval = decrypt_public(rp, in, out);
+    RSA_free(rp);
+    return retval;
+}
+
+// same, with a key already converted by public_to_openssl();
+// for programs that check many signatures with the same key
+//
+int decrypt_public(RSA* rp, DATA_BLOCK& in, DATA_BLOCK& out) {
+    int retval;
     retval = RSA_public_decrypt(in.len, in.data, out.data, rp, RSA_PKCS1_PADDING);
     if (retval < 0) {
-        RSA_free(rp);
         return ERR_CRYPTO;
     }
     out.len = RSA_size(rp);
-    RSA_free(rp);
     return 0;
 }
 
@@ -385,6 +393,17 @@ int check_file_signature2(
 int check_string_signature(
     const char* text, const char* signature_text, R_RSA_PUBLIC_KEY& key,
     bool& answer
+) {
+    int retval;
+    RSA* rp = RSA_new();
+    public_to_openssl(key, rp);
+    retval = check_string_signature(text, signature_text, rp, answer);
+    RSA_free(rp);
+    return retval;
+}
+
+int check_string_signature(
+    const char* text, const char* signature_text, RSA* rp, bool& answer
 ) {
     char md5_buf[MD5_LEN];
     unsigned char signature_buf[SIGNATURE_SIZE_BINARY];
@@ -401,7 +420,7 @@ int check_string_signature(
     if (retval) return retval;
     clear_signature.data = (unsigned char*)clear_buf;
     clear_signature.len = 256;
-    retval = decrypt_public(key, signature, clear_signature);
+    retval = decrypt_public(rp, signature, clear_signature);
     if (retval) return retval;
     answer = !strncmp(md5_buf, clear_buf, n);
     return 0;
@@ -93,6 +93,7 @@ extern int encrypt_private(
 extern int decrypt_public(
     R_RSA_PUBLIC_KEY& key, DATA_BLOCK& in, DATA_BLOCK& out
 );
+extern int decrypt_public(RSA*, DATA_BLOCK& in, DATA_BLOCK& out);
 extern int sign_file(
     const char* path, R_RSA_PRIVATE_KEY&, DATA_BLOCK& signature
 );
@@ -108,6 +109,9 @@ extern int check_file_signature2(
 extern int check_string_signature(
     const char* text, const char* signature, R_RSA_PUBLIC_KEY&, bool&
 );
+extern int check_string_signature(
+    const char* text, const char* signature, RSA*, bool&
+);
 extern int check_string_signature2(
     const char* text, const char* signature, const char* key, bool&
 );
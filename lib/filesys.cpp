@@ -51,6 +51,15 @@
 #if HAVE_SYS_RESOURCE_H
 #include <sys/resource.h>
 #endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+#if HAVE_SYS_CLONEFILE_H
+#include <sys/clonefile.h>
+#endif
 #if HAVE_SYS_MOUNT_H
 #if HAVE_SYS_PARAM_H
 #include <sys/param.h>
@@ -589,6 +598,45 @@ int boinc_copy(const char* orig, const char* newf) {
 #endif
 }
 
+// Make a copy-on-write clone of a file, which takes no time
+// and no disk space until one of them is changed.
+// This works only on some filesystems (e.g. btrfs, XFS, APFS);
+// return nonzero if it doesn't work, in which case newf doesn't exist
+// and the caller should copy the file.
+//
+int boinc_clone_file(const char* orig, const char* newf) {
+#if defined(__linux__)
+    struct stat sbuf;
+    int in = open(orig, O_RDONLY);
+    if (in < 0) return ERR_FOPEN;
+    if (fstat(in, &sbuf)) {
+        close(in);
+        return ERR_FOPEN;
+    }
+    int out = open(newf, O_WRONLY|O_CREAT|O_TRUNC, sbuf.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return ERR_FOPEN;
+    }
+    int retval = ioctl(out, FICLONE, in);
+    close(in);
+    close(out);
+    if (retval) {
+        unlink(newf);
+        return ERR_NOT_IMPLEMENTED;
+    }
+    // as in boinc_copy(), copy ownership to the extent we're allowed
+    chown(newf, sbuf.st_uid, sbuf.st_gid);
+    return 0;
+#elif HAVE_SYS_CLONEFILE_H
+    unlink(newf);
+    if (clonefile(orig, newf, 0)) return ERR_NOT_IMPLEMENTED;
+    return 0;
+#else
+    return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
 static int boinc_rename_aux(const char* old, const char* newf) {
 #ifdef _WIN32
     if (MoveFileExA(old, newf, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)) return 0;
@@ -59,6 +59,7 @@ using std::vector;
 
 RPC_CLIENT::RPC_CLIENT() {
     sock = -1;
+    subscribed = false;
 }
 
 RPC_CLIENT::~RPC_CLIENT() {
@@ -87,6 +88,9 @@ void RPC_CLIENT::close() {
 		boinc_close_socket(sock);
 		sock = -1;
 	}
+    inbuf.clear();
+    events.clear();
+    subscribed = false;
 }
 
 int RPC_CLIENT::get_ip_addr(const char* host, int port) {
@@ -294,24 +298,85 @@ int RPC_CLIENT::send_request(const char* p) {
     return 0;
 }
 
-// get reply from server.  Caller must free buf
+// if a complete message (ending with \003) has been received,
+// remove it from the input and return it, with the \003
+//
+bool RPC_CLIENT::next_message(string& msg) {
+    string::size_type n = inbuf.find('\003');
+    if (n == string::npos) return false;
+    msg = inbuf.substr(0, n+1);
+    inbuf.erase(0, n+1);
+    return true;
+}
+
+static bool is_event(const string& msg) {
+    return msg.find("<boinc_gui_rpc_event>") == 0;
+}
+
+// get the contents of an event message
+//
+static string event_body(const string& msg) {
+    string::size_type start = strlen("<boinc_gui_rpc_event>\n");
+    string::size_type end = msg.rfind("</boinc_gui_rpc_event>");
+    if (end == string::npos || end < start) return "";
+    return msg.substr(start, end-start);
+}
+
+// get reply from server.  Caller must free buf.
+// On a subscribed connection, events may arrive first;
+// they're saved for get_events()
 //
 int RPC_CLIENT::get_reply(char*& mbuf) {
-    char buf[8193];
-    MFILE mf;
+    char buf[8192];
+    string msg;
     int n;
 
     while (1) {
-        n = recv(sock, buf, 8192, 0);
+        if (next_message(msg)) {
+            if (subscribed && is_event(msg)) {
+                events.push_back(event_body(msg));
+                continue;
+            }
+            break;
+        }
+        n = recv(sock, buf, sizeof(buf), 0);
         if (n <= 0) return ERR_READ;
-        buf[n]=0;
-        mf.puts(buf);
-        if (strchr(buf, '\003')) break;
+        inbuf.append(buf, n);
     }
-    mf.get_buf(mbuf, n);
+    mbuf = strdup(msg.c_str());
     return 0;
 }
 
+int RPC_CLIENT::get_events(vector<string>& evs, double wait) {
+    char buf[8192];
+    string msg;
+    fd_set read_fds;
+    struct timeval tv;
+
+    evs.clear();
+    if (sock < 0) return ERR_CONNECT;
+    while (1) {
+        while (next_message(msg)) {
+            if (is_event(msg)) events.push_back(event_body(msg));
+        }
+        while (!events.empty()) {
+            evs.push_back(events.front());
+            events.pop_front();
+        }
+        if (!evs.empty()) return 0;
+
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        tv.tv_sec = (long)wait;
+        tv.tv_usec = (long)((wait - (long)wait)*1e6);
+        if (select(sock+1, &read_fds, NULL, NULL, &tv) <= 0) return 0;
+        int n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) return ERR_READ;
+        inbuf.append(buf, n);
+        wait = 0;
+    }
+}
+
 RPC::RPC(RPC_CLIENT* rc) : xp(&fin) {
     mbuf = 0;
     rpc_client = rc;
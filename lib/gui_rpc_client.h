@@ -277,6 +277,11 @@ struct RESULT {
     double elapsed_time;
     double swap_size;
     double working_set_size_smoothed;
+    double perf_cycles;
+    double perf_instructions;
+    double perf_llc_misses;
+    double perf_mem_bytes;
+        // hardware event counts, if the client counts them
     double estimated_cpu_time_remaining;
         // actually, estimated elapsed time remaining
     bool too_large;
@@ -440,14 +445,38 @@ struct DISK_USAGE {
 
 struct RESULTS {
     std::vector<RESULT*> results;
+    int seqno;
+    int epoch;
+        // for get_results_delta(): where we are in the client's changes
 
-    RESULTS(){}
+    RESULTS(){seqno = 0; epoch = 0;}
     ~RESULTS();
 
     void print();
     void clear();
 };
 
+// which results to get, for get_results(RESULTS&, RESULT_FILTER&)
+//
+struct RESULT_FILTER {
+    std::string project_url;    // if nonempty, only this project's
+    int state;                  // if >= 0, only results in this state
+    std::string resource;       // if nonempty, only those using this
+                                // ("CPU" or a GPU type)
+    bool active_only;
+    int offset;                 // skip this many matching results
+    int limit;                  // if nonzero, get at most this many
+    int nmatched;               // returned: the number that match
+
+    RESULT_FILTER() {
+        state = -1;
+        active_only = false;
+        offset = 0;
+        limit = 0;
+        nmatched = 0;
+    }
+};
+
 struct FILE_TRANSFERS {
     std::vector<FILE_TRANSFER*> file_transfers;
 
@@ -604,6 +633,11 @@ struct CC_STATUS {
     bool disallow_attach;
     bool simple_gui_only;
     int max_event_log_lines;
+    int async_deletes;
+        // # of dirs (e.g. slot dirs of finished jobs)
+        // being deleted in the background
+    int async_delete_nfiles;
+        // # of files deleted so far from the first one
 
     CC_STATUS();
     ~CC_STATUS();
@@ -633,6 +667,40 @@ struct DAILY_XFER_HISTORY {
     void print();
 };
 
+// the last status read from a GPU's management library
+//
+struct GPU_STATUS {
+    std::string type;
+    int device_num;
+    double time;
+    double utilization;     // percent
+    double mem_utilization;
+    double mem_total;
+    double mem_free;
+    double temperature;     // Celsius
+    double clock_sm;        // MHz
+    double clock_mem;
+
+    GPU_STATUS() {
+        device_num = 0;
+        time = 0;
+        utilization = 0;
+        mem_utilization = 0;
+        mem_total = 0;
+        mem_free = 0;
+        temperature = 0;
+        clock_sm = 0;
+        clock_mem = 0;
+    }
+    int parse(XML_PARSER&);
+};
+
+struct GPU_TELEMETRY_INFO {
+    std::vector <GPU_STATUS> gpus;
+    int parse(XML_PARSER&);
+    void print();
+};
+
 // Keep this consistent with client/result.h
 //
 struct OLD_RESULT {
@@ -655,9 +723,16 @@ struct RPC_CLIENT {
     double timeout;
     bool retry;
     sockaddr_storage addr;
+    std::string inbuf;
+        // data received but not yet returned
+    bool subscribed;
+        // we sent <subscribe/>; the client sends events
+    std::deque<std::string> events;
+        // events received while waiting for a reply
 
     int send_request(const char*);
     int get_reply(char*&);
+    bool next_message(std::string&);
     RPC_CLIENT();
     ~RPC_CLIENT();
     int get_ip_addr(const char* host, int port);
@@ -680,6 +755,12 @@ struct RPC_CLIENT {
     int exchange_versions(VERSION_INFO&);
     int get_state(CC_STATE&);
     int get_results(RESULTS&, bool active_only = false);
+    int get_results(RESULTS&, RESULT_FILTER&);
+        // get some of the results; needs a client that supports it;
+        // older ones return all
+    int get_results_delta(RESULTS&);
+        // update the RESULTS from a previous call with
+        // the results that have changed since then
     int get_old_results(std::vector<OLD_RESULT>&);
     int get_file_transfers(FILE_TRANSFERS&);
     int get_simple_gui_info(SIMPLE_GUI_INFO&);
@@ -697,7 +778,10 @@ struct RPC_CLIENT {
     int run_benchmarks();
     int set_proxy_settings(GR_PROXY_INFO&);
     int get_proxy_settings(GR_PROXY_INFO&);
-    int get_messages(int seqno, MESSAGES&, bool translatable=false);
+    int get_messages(
+        int seqno, MESSAGES&, bool translatable=false,
+        int limit=0, const char* project=NULL
+    );
     int get_message_count(int& seqno);
     int get_notices(int seqno, NOTICES&);
     int get_notices_public(int seqno, NOTICES&);
@@ -712,6 +796,17 @@ struct RPC_CLIENT {
     int network_available();
     int get_project_init_status(PROJECT_INIT_STATUS& pis);
     int report_device_status(DEVICE_STATUS&);
+    int subscribe(double transfer_interval=0);
+        // have the client send events on this connection
+        // (task state changes, new messages, run mode changes etc.;
+        // see client/gui_rpc_server_ops.cpp).
+        // Fails with clients that don't have events.
+        // Other RPCs can still be done on the connection.
+    int get_events(std::vector<std::string>& events, double timeout=0);
+        // get the events that have arrived,
+        // waiting up to timeout for data if there are none.
+        // Each is the contents of a <boinc_gui_rpc_event> message.
+        // Returns ERR_READ if the connection is closed
 
     // the following are asynch operations.
     // Make the first call to start the op,
@@ -749,6 +844,7 @@ struct RPC_CLIENT {
     int get_cc_config(CONFIG& config, LOG_FLAGS& log_flags);
     int set_cc_config(CONFIG& config, LOG_FLAGS& log_flags);
     int get_daily_xfer_history(DAILY_XFER_HISTORY&);
+    int get_gpu_telemetry(GPU_TELEMETRY_INFO&);
 };
 
 struct RPC {
@@ -137,6 +137,39 @@ int DAILY_XFER_HISTORY::parse(XML_PARSER& xp) {
     return 0;
 }
 
+int GPU_STATUS::parse(XML_PARSER& xp) {
+    while (!xp.get_tag()) {
+        if (xp.match_tag("/gpu")) return 0;
+        if (xp.parse_string("type", type)) continue;
+        if (xp.parse_int("device_num", device_num)) continue;
+        if (xp.parse_double("time", time)) continue;
+        if (xp.parse_double("utilization", utilization)) continue;
+        if (xp.parse_double("mem_utilization", mem_utilization)) continue;
+        if (xp.parse_double("mem_total", mem_total)) continue;
+        if (xp.parse_double("mem_free", mem_free)) continue;
+        if (xp.parse_double("temperature", temperature)) continue;
+        if (xp.parse_double("clock_sm", clock_sm)) continue;
+        if (xp.parse_double("clock_mem", clock_mem)) continue;
+    }
+    return ERR_XML_PARSE;
+}
+
+int GPU_TELEMETRY_INFO::parse(XML_PARSER& xp) {
+    gpus.clear();
+    while (!xp.get_tag()) {
+        if (!xp.is_tag) continue;
+        if (xp.match_tag("/gpu_telemetry")) break;
+        if (xp.match_tag("gpu")) {
+            GPU_STATUS gs;
+            int retval = gs.parse(xp);
+            if (!retval) {
+                gpus.push_back(gs);
+            }
+        }
+    }
+    return 0;
+}
+
 int GUI_URL::parse(XML_PARSER& xp) {
     while (!xp.get_tag()) {
         if (!xp.is_tag) continue;
@@ -669,6 +702,10 @@ int RESULT::parse(XML_PARSER& xp) {
         if (xp.parse_double("elapsed_time", elapsed_time)) continue;
         if (xp.parse_double("swap_size", swap_size)) continue;
         if (xp.parse_double("working_set_size_smoothed", working_set_size_smoothed)) continue;
+        if (xp.parse_double("perf_cycles", perf_cycles)) continue;
+        if (xp.parse_double("perf_instructions", perf_instructions)) continue;
+        if (xp.parse_double("perf_llc_misses", perf_llc_misses)) continue;
+        if (xp.parse_double("perf_mem_bytes", perf_mem_bytes)) continue;
         if (xp.parse_double("fraction_done", fraction_done)) continue;
         if (xp.parse_double("estimated_cpu_time_remaining", estimated_cpu_time_remaining)) continue;
         if (xp.parse_bool("too_large", too_large)) continue;
@@ -723,6 +760,10 @@ void RESULT::clear() {
     elapsed_time = 0;
     swap_size = 0;
     working_set_size_smoothed = 0;
+    perf_cycles = 0;
+    perf_instructions = 0;
+    perf_llc_misses = 0;
+    perf_mem_bytes = 0;
     estimated_cpu_time_remaining = 0;
     too_large = false;
     needs_shmem = false;
@@ -1417,6 +1458,8 @@ int CC_STATUS::parse(XML_PARSER& xp) {
         if (xp.parse_bool("disallow_attach", disallow_attach)) continue;
         if (xp.parse_bool("simple_gui_only", simple_gui_only)) continue;
         if (xp.parse_int("max_event_log_lines", max_event_log_lines)) continue;
+        if (xp.parse_int("async_deletes", async_deletes)) continue;
+        if (xp.parse_int("async_delete_nfiles", async_delete_nfiles)) continue;
     }
     return ERR_XML_PARSE;
 }
@@ -1439,6 +1482,8 @@ void CC_STATUS::clear() {
 	gpu_mode_delay = 0;
     disallow_attach = false;
     simple_gui_only = false;
+    async_deletes = 0;
+    async_delete_nfiles = 0;
 }
 
 /////////// END OF PARSING FUNCTIONS.  RPCS START HERE ////////////////
@@ -1511,6 +1556,136 @@ int RPC_CLIENT::get_results(RESULTS& t, bool active_only) {
     return retval;
 }
 
+int RPC_CLIENT::get_results(RESULTS& t, RESULT_FILTER& f) {
+    int retval;
+    SET_LOCALE sl;
+    char buf[1024];
+    RPC rpc(this);
+    string s;
+
+    t.clear();
+    f.nmatched = 0;
+
+    s = "<get_results>\n";
+    if (f.project_url.size()) {
+        s += "   <project_url>" + f.project_url + "</project_url>\n";
+    }
+    if (f.state >= 0) {
+        sprintf(buf, "   <state>%d</state>\n", f.state);
+        s += buf;
+    }
+    if (f.resource.size()) {
+        s += "   <resource>" + f.resource + "</resource>\n";
+    }
+    if (f.active_only) {
+        s += "   <active_only/>\n";
+    }
+    sprintf(buf,
+        "   <offset>%d</offset>\n"
+        "   <limit>%d</limit>\n"
+        "</get_results>\n",
+        f.offset, f.limit
+    );
+    s += buf;
+    retval = rpc.do_rpc(s.c_str());
+    if (retval) return retval;
+    while (!rpc.xp.get_tag()) {
+        if (rpc.xp.match_tag("/results")) break;
+        if (rpc.xp.match_tag("result")) {
+            RESULT* rp = new RESULT();
+            rp->parse(rpc.xp);
+            t.results.push_back(rp);
+            continue;
+        }
+        if (rpc.xp.parse_int("nmatched", f.nmatched)) continue;
+    }
+    return 0;
+}
+
+int RPC_CLIENT::get_results_delta(RESULTS& t) {
+    int retval;
+    SET_LOCALE sl;
+    char buf[256];
+    RPC rpc(this);
+    vector<RESULT*> changed;
+    vector<RESULT*> deleted;
+    bool full = true;
+    unsigned int i, j;
+
+    sprintf(buf,
+        "<get_results>\n"
+        "   <seqno>%d</seqno>\n"
+        "   <epoch>%d</epoch>\n"
+        "</get_results>\n",
+        t.seqno, t.epoch
+    );
+    retval = rpc.do_rpc(buf);
+    if (retval) return retval;
+    while (!rpc.xp.get_tag()) {
+        if (rpc.xp.match_tag("/results")) break;
+        if (rpc.xp.match_tag("result")) {
+            RESULT* rp = new RESULT();
+            rp->parse(rpc.xp);
+            changed.push_back(rp);
+            continue;
+        }
+        if (rpc.xp.match_tag("deleted_result")) {
+            RESULT* rp = new RESULT();
+            while (!rpc.xp.get_tag()) {
+                if (rpc.xp.match_tag("/deleted_result")) break;
+                if (rpc.xp.parse_str("project_url", rp->project_url, sizeof(rp->project_url))) continue;
+                if (rpc.xp.parse_str("name", rp->name, sizeof(rp->name))) continue;
+            }
+            deleted.push_back(rp);
+            continue;
+        }
+        if (rpc.xp.parse_int("seqno", t.seqno)) {
+            // a client that doesn't do deltas doesn't send this
+            //
+            full = false;
+            continue;
+        }
+        if (rpc.xp.parse_int("epoch", t.epoch)) continue;
+        if (rpc.xp.parse_bool("full", full)) continue;
+    }
+
+    if (full) {
+        t.clear();
+        t.results = changed;
+    } else {
+        for (i=0; i<changed.size(); i++) {
+            RESULT* rp = changed[i];
+            for (j=0; j<t.results.size(); j++) {
+                RESULT* rp2 = t.results[j];
+                if (!strcmp(rp2->name, rp->name)
+                    && !strcmp(rp2->project_url, rp->project_url)
+                ) {
+                    delete rp2;
+                    t.results[j] = rp;
+                    rp = NULL;
+                    break;
+                }
+            }
+            if (rp) t.results.push_back(rp);
+        }
+    }
+    for (i=0; i<deleted.size(); i++) {
+        RESULT* rp = deleted[i];
+        for (j=0; j<t.results.size(); j++) {
+            RESULT* rp2 = t.results[j];
+            if (!strcmp(rp2->name, rp->name)
+                && !strcmp(rp2->project_url, rp->project_url)
+            ) {
+                delete rp2;
+                t.results.erase(t.results.begin()+j);
+                break;
+            }
+        }
+        delete rp;
+    }
+    return 0;
+}
+
 int RPC_CLIENT::get_old_results(vector<OLD_RESULT>& r) {
     int retval;
     SET_LOCALE sl;
@@ -1755,6 +1930,32 @@ int RPC_CLIENT::network_available() {
     return retval;
 }
 
+int RPC_CLIENT::subscribe(double transfer_interval) {
+    int retval;
+    SET_LOCALE sl;
+    char buf[256];
+    RPC rpc(this);
+
+    if (transfer_interval > 0) {
+        sprintf(buf,
+            "<subscribe>\n"
+            "   <transfer_interval>%f</transfer_interval>\n"
+            "</subscribe>\n",
+            transfer_interval
+        );
+    } else {
+        strcpy(buf, "<subscribe/>\n");
+    }
+
+    // events may come before the reply
+    //
+    subscribed = true;
+    retval = rpc.do_rpc(buf);
+    if (!retval) retval = rpc.parse_reply();
+    if (retval) subscribed = false;
+    return retval;
+}
+
 int RPC_CLIENT::project_op(PROJECT& project, const char* op) {
     int retval;
     SET_LOCALE sl;
@@ -2024,19 +2225,26 @@ int RPC_CLIENT::get_message_count(int& seqno) {
     return ERR_XML_PARSE;
 }
 
-int RPC_CLIENT::get_messages(int seqno, MESSAGES& msgs, bool translatable) {
+int RPC_CLIENT::get_messages(
+    int seqno, MESSAGES& msgs, bool translatable,
+    int limit, const char* project
+) {
     int retval;
     SET_LOCALE sl;
-    char buf[256];
+    char buf[1024];
     RPC rpc(this);
 
     sprintf(buf,
         "<get_messages>\n"
         "  <seqno>%d</seqno>\n"
         "%s"
+        "  <limit>%d</limit>\n"
+        "  <project>%.256s</project>\n"
         "</get_messages>\n",
         seqno,
-        translatable?"  <translatable/>\n":""
+        translatable?"  <translatable/>\n":"",
+        limit,
+        project?project:""
     );
 
     retval = rpc.do_rpc(buf);
@@ -2641,3 +2849,13 @@ int RPC_CLIENT::get_daily_xfer_history(DAILY_XFER_HISTORY& dxh) {
     if (retval) return retval;
     return dxh.parse(rpc.xp);
 }
+
+int RPC_CLIENT::get_gpu_telemetry(GPU_TELEMETRY_INFO& gti) {
+    SET_LOCALE sl;
+    RPC rpc(this);
+    int retval;
+
+    retval = rpc.do_rpc("<get_gpu_telemetry/>\n");
+    if (retval) return retval;
+    return gti.parse(rpc.xp);
+}
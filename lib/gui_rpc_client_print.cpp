@@ -63,6 +63,21 @@ void DAILY_XFER_HISTORY::print() {
     }
 }
 
+void GPU_TELEMETRY_INFO::print() {
+    printf("======== GPU status ========\n");
+    for (unsigned int i=0; i<gpus.size(); i++) {
+        GPU_STATUS& gs = gpus[i];
+        printf("%d) -----------\n", i+1);
+        printf("   type: %s\n", gs.type.c_str());
+        printf("   device: %d\n", gs.device_num);
+        printf("   utilization: %.0f%%\n", gs.utilization);
+        printf("   memory utilization: %.0f%%\n", gs.mem_utilization);
+        printf("   memory free: %.0f of %.0f MB\n", gs.mem_free/MEGA, gs.mem_total/MEGA);
+        printf("   temperature: %.0f C\n", gs.temperature);
+        printf("   clocks: %.0f MHz core, %.0f MHz memory\n", gs.clock_sm, gs.clock_mem);
+    }
+}
+
 void GUI_URL::print() {
     printf(
         "GUI URL:\n"
@@ -148,6 +163,12 @@ void RESULT::print() {
     printf("   fraction done: %f\n", fraction_done);
     printf("   swap size: %f\n", swap_size);
     printf("   working set size: %f\n", working_set_size_smoothed);
+    if (perf_cycles) {
+        printf("   cycles: %.0f\n", perf_cycles);
+        printf("   instructions: %.0f\n", perf_instructions);
+        printf("   LLC misses: %.0f\n", perf_llc_misses);
+        printf("   est. memory traffic: %.0f bytes\n", perf_mem_bytes);
+    }
     printf("   estimated CPU time remaining: %f\n", estimated_cpu_time_remaining);
 }
 
@@ -295,6 +316,11 @@ void CC_STATUS::print() {
         network_mode_perm,
         network_mode_delay
     );
+    if (async_deletes) {
+        printf("deleting %d directories (%d files done)\n",
+            async_deletes, async_delete_nfiles
+        );
+    }
 }
 
 void PROJECTS::print() {
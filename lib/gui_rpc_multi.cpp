@@ -0,0 +1,404 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Non-blocking GUI RPCs to many clients; see gui_rpc_multi.h
+
+#if defined(_WIN32) && !defined(__STDWX_H__) && !defined(_BOINC_WIN_) && !defined(_AFX_STDAFX_H_)
+#include "boinc_win.h"
+#endif
+
+#ifdef _WIN32
+#include "../version.h"
+#else
+#include "config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#include "error_numbers.h"
+#include "md5_file.h"
+#include "network.h"
+#include "parse.h"
+#include "str_replace.h"
+#include "util.h"
+
+#include "gui_rpc_multi.h"
+
+using std::deque;
+using std::string;
+using std::vector;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifdef _WIN32
+static int addr_len(sockaddr_storage&) {
+    return (int) sizeof(sockaddr_in);
+}
+static bool would_block() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+static int addr_len(sockaddr_storage& s) {
+    if (s.ss_family == AF_INET6) {
+        return (int) sizeof(sockaddr_in6);
+    }
+    return (int) sizeof(sockaddr_in);
+}
+static bool would_block() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+#endif
+
+static void wrap_request(const char* req, string& out) {
+    out += "<boinc_gui_rpc_request>\n";
+    out += req;
+    out += "</boinc_gui_rpc_request>\n\003";
+}
+
+RPC_HOST::RPC_HOST(const char* h, int p, const char* pw) {
+    host = h;
+    port = p;
+    password = pw;
+    max_in_flight = 4;
+    state = RPC_HOST_IDLE;
+    have_addr = false;
+    pipelining = false;
+    memset(&server_version, 0, sizeof(server_version));
+    last_activity = 0;
+    retry_time = 0;
+    backoff = 0;
+}
+
+RPC_HOST::~RPC_HOST() {
+    close(ERR_CONNECT);
+}
+
+void RPC_HOST::request(ASYNC_RPC* r) {
+    queue.push_back(r);
+}
+
+void RPC_HOST::close(int retval) {
+    deque<ASYNC_RPC*> failed;
+    unsigned int i;
+
+    // if the client closed an idle connection, it's not a failure
+    //
+    if (state != RPC_HOST_READY || !in_flight.empty()) {
+        backoff = backoff?std::min(2*backoff, (double)RPC_HOST_MAX_BACKOFF):RPC_HOST_MIN_BACKOFF;
+        retry_time = dtime() + backoff;
+    }
+    rpc.close();
+    state = RPC_HOST_IDLE;
+    pipelining = false;
+    out.clear();
+    in.clear();
+
+    // handlers may queue requests again; those go in the new queue
+    //
+    failed = in_flight;
+    for (i=0; i<queue.size(); i++) {
+        failed.push_back(queue[i]);
+    }
+    in_flight.clear();
+    queue.clear();
+    for (i=0; i<failed.size(); i++) {
+        failed[i]->handle_reply(retval, NULL);
+    }
+}
+
+void RPC_HOST::start_connect() {
+    if (!have_addr) {
+        if (rpc.get_ip_addr(host.c_str(), port)) {
+            close(ERR_CONNECT);
+            return;
+        }
+        have_addr = true;
+    }
+    if (boinc_socket(rpc.sock)) {
+        rpc.sock = -1;
+        close(ERR_CONNECT);
+        return;
+    }
+    boinc_socket_asynch(rpc.sock, true);
+    connect(rpc.sock, (const sockaddr*)(&rpc.addr), addr_len(rpc.addr));
+    state = RPC_HOST_CONNECTING;
+    last_activity = dtime();
+}
+
+// the connection is made; authorize if needed,
+// and see if the client can handle pipelined requests
+//
+void RPC_HOST::connected() {
+    if (password.empty()) {
+        state = RPC_HOST_VERSIONS;
+        send_internal("<exchange_versions/>\n");
+    } else {
+        state = RPC_HOST_AUTH1;
+        send_internal("<auth1/>\n");
+    }
+}
+
+void RPC_HOST::send_internal(const char* req) {
+    wrap_request(req, out);
+}
+
+void RPC_HOST::send_requests() {
+    unsigned int n = pipelining?max_in_flight:1;
+    if (state != RPC_HOST_READY) return;
+    while (!queue.empty() && in_flight.size() < n) {
+        ASYNC_RPC* r = queue.front();
+        queue.pop_front();
+        in_flight.push_back(r);
+        wrap_request(r->request.c_str(), out);
+    }
+}
+
+bool RPC_HOST::wants_write() {
+    return state == RPC_HOST_CONNECTING || !out.empty();
+}
+
+int RPC_HOST::do_write() {
+    if (out.empty()) return 0;
+    int n = send(rpc.sock, out.data(), (int)out.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+        if (would_block()) return 0;
+        return ERR_WRITE;
+    }
+    out.erase(0, n);
+    last_activity = dtime();
+    return 0;
+}
+
+int RPC_HOST::do_read() {
+    char buf[8192];
+    int retval;
+    string::size_type pos;
+
+    int n = recv(rpc.sock, buf, sizeof(buf), 0);
+    if (n < 0) {
+        if (would_block()) return 0;
+        return ERR_READ;
+    }
+    if (n == 0) return ERR_READ;
+    in.append(buf, n);
+    last_activity = dtime();
+
+    // replies end with \003
+    //
+    while ((pos = in.find('\003')) != string::npos) {
+        char* reply = strdup(in.substr(0, pos).c_str());
+        in.erase(0, pos+1);
+        retval = handle_reply(reply);
+        free(reply);
+        if (retval) return retval;
+    }
+    return 0;
+}
+
+int RPC_HOST::handle_reply(char* reply) {
+    char nonce[256], nonce_hash[256], buf[512];
+    ASYNC_RPC* r;
+
+    switch (state) {
+    case RPC_HOST_AUTH1:
+        if (!parse_str(reply, "<nonce>", nonce, sizeof(nonce))) {
+            return ERR_AUTHENTICATOR;
+        }
+        snprintf(buf, sizeof(buf), "%s%s", nonce, password.c_str());
+        md5_block((const unsigned char*)buf, (int)strlen(buf), nonce_hash);
+        snprintf(buf, sizeof(buf),
+            "<auth2>\n<nonce_hash>%s</nonce_hash>\n</auth2>\n", nonce_hash
+        );
+        state = RPC_HOST_AUTH2;
+        send_internal(buf);
+        return 0;
+    case RPC_HOST_AUTH2:
+        if (!strstr(reply, "<authorized/>")) {
+            return ERR_AUTHENTICATOR;
+        }
+        state = RPC_HOST_VERSIONS;
+        send_internal("<exchange_versions/>\n");
+        return 0;
+    case RPC_HOST_VERSIONS:
+        parse_int(reply, "<major>", server_version.major);
+        parse_int(reply, "<minor>", server_version.minor);
+        parse_int(reply, "<release>", server_version.release);
+        pipelining = (strstr(reply, "<pipelined_requests/>") != NULL);
+        state = RPC_HOST_READY;
+        backoff = 0;
+        send_requests();
+        return 0;
+    case RPC_HOST_READY:
+        if (in_flight.empty()) return ERR_READ;
+        r = in_flight.front();
+        in_flight.pop_front();
+        r->handle_reply(0, reply);
+        send_requests();
+        return 0;
+    }
+    return ERR_READ;
+}
+
+// fail if we're waiting to connect, or for a reply, and it's taking too long.
+// An idle connection stays open
+//
+void RPC_HOST::check_timeout(double timeout) {
+    if (state == RPC_HOST_IDLE) return;
+    if (state == RPC_HOST_READY && in_flight.empty() && out.empty()) return;
+    if (dtime() - last_activity > timeout) {
+        close(ERR_TIMEOUT);
+    }
+}
+
+RPC_MULTI::RPC_MULTI() {
+    timeout = 30;
+}
+
+RPC_MULTI::~RPC_MULTI() {
+    for (unsigned int i=0; i<hosts.size(); i++) {
+        delete hosts[i];
+    }
+    hosts.clear();
+}
+
+RPC_HOST* RPC_MULTI::add_host(const char* host, int port, const char* password) {
+    RPC_HOST* h = new RPC_HOST(host, port, password);
+    hosts.push_back(h);
+    return h;
+}
+
+void RPC_MULTI::remove_host(RPC_HOST* h) {
+    for (unsigned int i=0; i<hosts.size(); i++) {
+        if (hosts[i] == h) {
+            hosts.erase(hosts.begin()+i);
+            break;
+        }
+    }
+    delete h;
+}
+
+// a host's socket is ready.
+// If it was connecting, finish that; else read and write
+//
+static void handle_io(RPC_HOST* h, bool readable, bool writable, bool error) {
+    int retval;
+
+    if (h->state == RPC_HOST_CONNECTING) {
+        if (!readable && !writable && !error) return;
+        if (get_socket_error(h->rpc.sock)) {
+            h->close(ERR_CONNECT);
+            return;
+        }
+        h->connected();
+        return;
+    }
+    if (readable || error) {
+        retval = h->do_read();
+        if (retval) {
+            h->close(retval);
+            return;
+        }
+    }
+    if (writable) {
+        retval = h->do_write();
+        if (retval) {
+            h->close(retval);
+            return;
+        }
+    }
+}
+
+void RPC_MULTI::poll(double wait) {
+    unsigned int i;
+    double now = dtime();
+    vector<RPC_HOST*> active;
+
+    for (i=0; i<hosts.size(); i++) {
+        RPC_HOST* h = hosts[i];
+        if (h->state == RPC_HOST_IDLE) {
+            if (h->queue.empty() || now < h->retry_time) continue;
+            h->start_connect();
+            if (h->state == RPC_HOST_IDLE) continue;
+        }
+        h->send_requests();
+        active.push_back(h);
+    }
+
+#ifdef _WIN32
+    // Windows sockets aren't small ints, so select() works
+    // for any number of them (up to FD_SETSIZE)
+    //
+    if (active.empty()) {
+        boinc_sleep(wait);
+    } else {
+        FDSET_GROUP fg;
+        struct timeval tv;
+        fg.zero();
+        for (i=0; i<active.size(); i++) {
+            int sock = active[i]->rpc.sock;
+            FD_SET(sock, &fg.read_fds);
+            FD_SET(sock, &fg.exc_fds);
+            if (active[i]->wants_write()) FD_SET(sock, &fg.write_fds);
+        }
+        tv.tv_sec = (long)wait;
+        tv.tv_usec = (long)((wait - (long)wait)*1e6);
+        select(FD_SETSIZE, &fg.read_fds, &fg.write_fds, &fg.exc_fds, &tv);
+        for (i=0; i<active.size(); i++) {
+            int sock = active[i]->rpc.sock;
+            handle_io(active[i],
+                FD_ISSET(sock, &fg.read_fds) != 0,
+                FD_ISSET(sock, &fg.write_fds) != 0,
+                FD_ISSET(sock, &fg.exc_fds) != 0
+            );
+        }
+    }
+#else
+    // use poll() rather than select();
+    // with thousands of connections, descriptors exceed FD_SETSIZE
+    //
+    vector<struct pollfd> fds(active.size());
+    for (i=0; i<active.size(); i++) {
+        fds[i].fd = active[i]->rpc.sock;
+        fds[i].events = POLLIN;
+        if (active[i]->wants_write()) fds[i].events |= POLLOUT;
+        fds[i].revents = 0;
+    }
+    ::poll(fds.empty()?NULL:&fds[0], fds.size(), (int)(wait*1000));
+    for (i=0; i<active.size(); i++) {
+        short r = fds[i].revents;
+        handle_io(active[i],
+            (r & POLLIN) != 0,
+            (r & POLLOUT) != 0,
+            (r & (POLLERR|POLLHUP)) != 0
+        );
+    }
+#endif
+
+    for (i=0; i<hosts.size(); i++) {
+        hosts[i]->check_timeout(timeout);
+    }
+}
@@ -0,0 +1,151 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Non-blocking GUI RPCs to many BOINC clients from one thread,
+// e.g. for tools that manage a large number of hosts.
+// (RPC_CLIENT does one blocking RPC at a time to one client.)
+//
+// An RPC_MULTI has a set of RPC_HOSTs.
+// Each host has a connection to a client, and the client's password.
+// The connection is made (and authorized) when there are requests for it,
+// and kept open for later requests.
+// If it fails, it's made again, after a delay, when needed.
+//
+// Requests (ASYNC_RPCs) are queued on a host and sent in order.
+// If the client says (in its exchange_versions reply)
+// that it handles pipelined requests,
+// up to max_in_flight may be outstanding at once;
+// otherwise each is sent when the reply to the previous one arrives.
+//
+// Call RPC_MULTI::poll() in a loop (or periodically);
+// it waits for network activity, and calls ASYNC_RPC::handle_reply()
+// as replies arrive.
+//
+// Host names are resolved (with a blocking lookup)
+// the first time a host is connected.
+
+#ifndef _GUI_RPC_MULTI_H_
+#define _GUI_RPC_MULTI_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "gui_rpc_client.h"
+
+struct ASYNC_RPC {
+    std::string request;
+        // the request, e.g. "<get_cc_status/>\n"
+
+    ASYNC_RPC(const char* req="") {
+        request = req;
+    }
+    virtual ~ASYNC_RPC() {}
+    virtual void handle_reply(int retval, char* reply) = 0;
+        // called when the reply arrives (retval is zero)
+        // or the RPC fails (ERR_CONNECT, ERR_AUTHENTICATOR,
+        // ERR_READ, ERR_WRITE, ERR_TIMEOUT).
+        // reply is the reply message (NULL on failure);
+        // parse it with MIOFILE::init_buf_read() and XML_PARSER.
+        // The ASYNC_RPC isn't deleted;
+        // it may be queued again from here,
+        // but its host mustn't be removed from here
+};
+
+#define RPC_HOST_IDLE           0
+    // not connected
+#define RPC_HOST_CONNECTING     1
+#define RPC_HOST_AUTH1          2
+#define RPC_HOST_AUTH2          3
+#define RPC_HOST_VERSIONS       4
+    // waiting for the reply to the above (internal) requests
+#define RPC_HOST_READY          5
+
+#define RPC_HOST_MIN_BACKOFF    5
+#define RPC_HOST_MAX_BACKOFF    600
+
+struct RPC_HOST {
+    std::string host;
+    int port;
+    std::string password;
+    int max_in_flight;
+        // the most requests outstanding at once, if the client can
+        // handle pipelined requests (default 4)
+
+    int state;
+    RPC_CLIENT rpc;
+        // for its socket and address
+    bool have_addr;
+    bool pipelining;
+        // the client can handle pipelined requests
+    VERSION_INFO server_version;
+        // from the client's exchange_versions reply
+    double last_activity;
+        // when we last sent or got data, or started connecting
+    double retry_time;
+        // after a failure, don't connect again until then
+    double backoff;
+    std::deque<ASYNC_RPC*> queue;
+        // requests not yet sent
+    std::deque<ASYNC_RPC*> in_flight;
+        // requests sent, awaiting reply
+    std::string out;
+        // data to send
+    std::string in;
+        // data received (the start of a reply)
+
+    RPC_HOST(const char* host, int port, const char* password);
+    ~RPC_HOST();
+    void request(ASYNC_RPC*);
+    bool busy() {
+        return !queue.empty() || !in_flight.empty();
+    }
+    void close(int retval);
+        // close the connection, and fail the queued requests with retval
+
+    // the following are used by RPC_MULTI
+    //
+    void start_connect();
+    void connected();
+    void send_internal(const char*);
+    void send_requests();
+    bool wants_write();
+    int do_write();
+    int do_read();
+    int handle_reply(char*);
+    void check_timeout(double timeout);
+};
+
+struct RPC_MULTI {
+    std::vector<RPC_HOST*> hosts;
+    double timeout;
+        // fail requests if a host doesn't connect or reply in this time
+        // (default 30 sec)
+
+    RPC_MULTI();
+    ~RPC_MULTI();
+    RPC_HOST* add_host(
+        const char* host, int port=GUI_RPC_PORT, const char* password=""
+    );
+        // the RPC_MULTI owns the RPC_HOST
+    void remove_host(RPC_HOST*);
+        // fails its requests, and deletes it
+    void poll(double wait);
+        // handle network activity, waiting up to the given time for it
+};
+
+#endif
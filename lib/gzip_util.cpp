@@ -0,0 +1,325 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#if   defined(_WIN32) && !defined(__STDWX_H__)
+#include "boinc_win.h"
+#elif defined(_WIN32) && defined(__STDWX_H__)
+#include "stdwx.h"
+#else
+#include "config.h"
+#ifdef _USING_FCGI_
+#include "boinc_fcgi.h"
+#else
+#include <cstdio>
+#endif
+#include <pthread.h>
+#endif
+
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include "zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#include "error_numbers.h"
+#include "filesys.h"
+
+#include "gzip_util.h"
+
+#define GZIP_BUFSIZE    65536
+
+// windowBits for a gzip (rather than zlib) header
+//
+#define GZIP_WBITS      (16+MAX_WBITS)
+
+int gzip_mem(const void* in, size_t len, std::string& out, int level) {
+    z_stream zs;
+    int retval;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, GZIP_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return ERR_MALLOC;
+    }
+    out.resize(deflateBound(&zs, (uLong)len) + 32);
+    zs.next_in = (Bytef*)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = (uInt)out.size();
+    retval = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return (retval == Z_STREAM_END) ? 0 : ERR_WRITE;
+}
+
+// Handles concatenated gzip members.
+//
+int gunzip_mem(const void* in, size_t len, std::string& out) {
+    z_stream zs;
+    char buf[GZIP_BUFSIZE];
+    int retval;
+
+    out.clear();
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, GZIP_WBITS) != Z_OK) return ERR_MALLOC;
+    zs.next_in = (Bytef*)in;
+    zs.avail_in = (uInt)len;
+    while (1) {
+        zs.next_out = (Bytef*)buf;
+        zs.avail_out = sizeof(buf);
+        retval = inflate(&zs, Z_NO_FLUSH);
+        if (retval != Z_OK && retval != Z_STREAM_END) {
+            inflateEnd(&zs);
+            return ERR_READ;
+        }
+        out.append(buf, sizeof(buf) - zs.avail_out);
+        if (retval == Z_STREAM_END) {
+            if (!zs.avail_in) break;
+            inflateReset(&zs);
+        }
+    }
+    inflateEnd(&zs);
+    return 0;
+}
+
+// compress a stream as a single member, a buffer at a time
+//
+static int gzip_stream_serial(FILE* in, FILE* out, int level) {
+    z_stream zs;
+    char ibuf[GZIP_BUFSIZE], obuf[GZIP_BUFSIZE];
+    int flush, retval;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, GZIP_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return ERR_MALLOC;
+    }
+    do {
+        size_t n = fread(ibuf, 1, sizeof(ibuf), in);
+        if (n < sizeof(ibuf) && ferror(in)) {
+            deflateEnd(&zs);
+            return ERR_FREAD;
+        }
+        flush = (n < sizeof(ibuf)) ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = (Bytef*)ibuf;
+        zs.avail_in = (uInt)n;
+        do {
+            zs.next_out = (Bytef*)obuf;
+            zs.avail_out = sizeof(obuf);
+            retval = deflate(&zs, flush);
+            size_t m = sizeof(obuf) - zs.avail_out;
+            if (m && fwrite(obuf, 1, m, out) != m) {
+                deflateEnd(&zs);
+                return ERR_FWRITE;
+            }
+        } while (zs.avail_out == 0);
+    } while (flush != Z_FINISH);
+    deflateEnd(&zs);
+    return (retval == Z_STREAM_END) ? 0 : ERR_WRITE;
+}
+
+struct GZIP_BLOCK {
+    std::string in;
+    std::string out;
+    int level;
+    int retval;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    bool have_thread;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI gzip_block_thread(void* p) {
+#else
+static void* gzip_block_thread(void* p) {
+#endif
+    GZIP_BLOCK* bp = (GZIP_BLOCK*)p;
+    bp->retval = gzip_mem(bp->in.data(), bp->in.size(), bp->out, bp->level);
+    return 0;
+}
+
+// Compress the blocks, one thread per block.
+// If a thread can't be created, compress that block in this thread.
+//
+static void gzip_blocks(std::vector<GZIP_BLOCK>& blocks, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        GZIP_BLOCK& b = blocks[i];
+        b.have_thread = false;
+        if (i == n-1) break;
+#ifdef _WIN32
+        DWORD id;
+        b.thread = CreateThread(NULL, 0, gzip_block_thread, &b, 0, &id);
+        b.have_thread = (b.thread != NULL);
+#else
+        b.have_thread = !pthread_create(&b.thread, NULL, gzip_block_thread, &b);
+#endif
+    }
+    for (i=0; i<n; i++) {
+        GZIP_BLOCK& b = blocks[i];
+        if (!b.have_thread) {
+            gzip_block_thread(&b);
+        }
+    }
+    for (i=0; i<n; i++) {
+        GZIP_BLOCK& b = blocks[i];
+        if (!b.have_thread) continue;
+#ifdef _WIN32
+        WaitForSingleObject(b.thread, INFINITE);
+        CloseHandle(b.thread);
+#else
+        pthread_join(b.thread, NULL);
+#endif
+    }
+}
+
+int gzip_stream(FILE* in, FILE* out, int level, int nthreads) {
+    int i, n;
+    bool first = true, eof = false;
+
+    if (nthreads > GZIP_MAX_THREADS) nthreads = GZIP_MAX_THREADS;
+    if (nthreads <= 1) {
+        return gzip_stream_serial(in, out, level);
+    }
+
+    // read nthreads blocks, compress them in parallel, write them in order
+    //
+    std::vector<GZIP_BLOCK> blocks(nthreads);
+    while (!eof) {
+        n = 0;
+        while (n < nthreads && !eof) {
+            GZIP_BLOCK& b = blocks[n];
+            b.level = level;
+            b.in.resize(GZIP_BLOCK_SIZE);
+            size_t m = fread(&b.in[0], 1, GZIP_BLOCK_SIZE, in);
+            if (m < GZIP_BLOCK_SIZE) {
+                if (ferror(in)) return ERR_FREAD;
+                eof = true;
+            }
+            b.in.resize(m);
+
+            // an empty input still gets one (empty) member
+            //
+            if (m || first) n++;
+            first = false;
+        }
+        if (!n) break;
+        gzip_blocks(blocks, n);
+        for (i=0; i<n; i++) {
+            GZIP_BLOCK& b = blocks[i];
+            if (b.retval) return b.retval;
+            if (fwrite(b.out.data(), 1, b.out.size(), out) != b.out.size()) {
+                return ERR_FWRITE;
+            }
+        }
+    }
+    return 0;
+}
+
+// Handles concatenated gzip members.
+//
+int gunzip_stream(FILE* in, FILE* out) {
+    z_stream zs;
+    char ibuf[GZIP_BUFSIZE], obuf[GZIP_BUFSIZE];
+    int retval = Z_OK;
+    bool at_eof = false, output_full = false;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, GZIP_WBITS) != Z_OK) return ERR_MALLOC;
+    while (1) {
+        // if the output buffer filled, zlib may have more for us
+        // without more input
+        //
+        if (!zs.avail_in && !output_full) {
+            if (at_eof) break;
+            size_t n = fread(ibuf, 1, sizeof(ibuf), in);
+            if (n < sizeof(ibuf)) {
+                if (ferror(in)) {
+                    inflateEnd(&zs);
+                    return ERR_FREAD;
+                }
+                at_eof = true;
+            }
+            if (!n) break;
+            zs.next_in = (Bytef*)ibuf;
+            zs.avail_in = (uInt)n;
+        }
+        zs.next_out = (Bytef*)obuf;
+        zs.avail_out = sizeof(obuf);
+        retval = inflate(&zs, Z_NO_FLUSH);
+        if (retval == Z_BUF_ERROR && !zs.avail_in) {
+            // nothing more without input
+            //
+            output_full = false;
+            continue;
+        }
+        if (retval != Z_OK && retval != Z_STREAM_END) {
+            inflateEnd(&zs);
+            return ERR_READ;
+        }
+        size_t m = sizeof(obuf) - zs.avail_out;
+        if (m && fwrite(obuf, 1, m, out) != m) {
+            inflateEnd(&zs);
+            return ERR_FWRITE;
+        }
+        output_full = (zs.avail_out == 0);
+        if (retval == Z_STREAM_END) {
+            inflateReset(&zs);
+            output_full = false;
+        }
+    }
+    inflateEnd(&zs);
+
+    // input ended in the middle of a member
+    //
+    if (retval != Z_STREAM_END && zs.total_in) return ERR_READ;
+    return 0;
+}
+
+int gzip_file(
+    const char* inpath, const char* outpath, int level, int nthreads
+) {
+    FILE* in = boinc_fopen(inpath, "rb");
+    if (!in) return ERR_FOPEN;
+    FILE* out = boinc_fopen(outpath, "wb");
+    if (!out) {
+        fclose(in);
+        return ERR_FOPEN;
+    }
+    int retval = gzip_stream(in, out, level, nthreads);
+    fclose(in);
+    if (fclose(out) && !retval) retval = ERR_FWRITE;
+    return retval;
+}
+
+int gunzip_file(const char* inpath, const char* outpath) {
+    FILE* in = boinc_fopen(inpath, "rb");
+    if (!in) return ERR_FOPEN;
+    FILE* out = boinc_fopen(outpath, "wb");
+    if (!out) {
+        fclose(in);
+        return ERR_FOPEN;
+    }
+    int retval = gunzip_stream(in, out);
+    fclose(in);
+    if (fclose(out) && !retval) retval = ERR_FWRITE;
+    return retval;
+}
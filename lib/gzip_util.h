@@ -0,0 +1,56 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BOINC_GZIP_UTIL_H
+#define BOINC_GZIP_UTIL_H
+
+// gzip-format compression and decompression (using zlib),
+// memory to memory or stream to stream, without temp files.
+// Programs that use these must link with zlib.
+//
+// With nthreads > 1, gzip_stream() and gzip_file() split the input
+// into GZIP_BLOCK_SIZE blocks and compress them in parallel,
+// each as a separate gzip member.
+// Concatenated members form a valid gzip file (RFC 1952),
+// readable by gunzip, zlib and the functions below.
+
+#include <string>
+#include <cstdio>
+
+#define GZIP_BLOCK_SIZE     (4*1024*1024)
+#define GZIP_MAX_THREADS    16
+
+// level is a zlib level: 1 (fastest) .. 9 (best), or -1 for the default.
+// These return 0 or an ERR_* code;
+// ERR_READ means the compressed data is corrupt.
+//
+extern int gzip_mem(
+    const void* in, size_t len, std::string& out, int level
+);
+extern int gunzip_mem(const void* in, size_t len, std::string& out);
+
+// read "in" until EOF, write the result to "out"
+//
+extern int gzip_stream(FILE* in, FILE* out, int level, int nthreads);
+extern int gunzip_stream(FILE* in, FILE* out);
+
+extern int gzip_file(
+    const char* inpath, const char* outpath, int level, int nthreads
+);
+extern int gunzip_file(const char* inpath, const char* outpath);
+
+#endif
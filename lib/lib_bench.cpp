@@ -0,0 +1,533 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// lib_bench: time the library's hot paths
+// (XML parsing, MIOFILE/MFILE output, MD5, base64,
+// XML escaping, path hashing, string copies)
+// and print ns/op and MB/s for each.
+//
+// The XML inputs are in bench_data/:
+// sched_request.xml (a scheduler request with reported and other results)
+// and client_state.xml (a client state file with 3 projects and 120 jobs).
+// Use them, not your own files, when comparing numbers.
+//
+// lib_bench [--dir DIR] [--time SECS] [--only NAME]
+//     [--save FILE] [--compare FILE [--tolerance PCT]]
+//
+// --save writes the results; --compare reads saved results,
+// shows the change for each benchmark, and exits with 1 if any
+// is slower by more than PCT percent (default 15).
+// Run on a quiet machine, and run more than once before believing
+// a regression of a few percent.
+//
+// "make lib_bench" in lib/ builds it.
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "base64.h"
+#include "filesys.h"
+#include "md5_file.h"
+#include "mfile.h"
+#include "miofile.h"
+#include "parse.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "util.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+struct BENCH_RESULT {
+    string name;
+    double ns_per_op;
+    double mb_per_sec;
+};
+
+static vector<BENCH_RESULT> results;
+static double min_time = 0.5;
+static const char* only = 0;
+
+// inputs
+//
+static string sched_request;
+static string client_state;
+static string numbers_xml;
+static int numbers_count;
+static string binary_data;
+static string base64_data;
+static string text;
+static string escaped_text;
+static vector<string> names;
+static char md5_path[256];
+
+// keeps the compiler from dropping the work
+//
+static volatile long sink;
+
+typedef void (*BENCH_FUNC)();
+
+// run f until at least min_time has passed;
+// bytes is the amount of data per call (0 if not meaningful)
+//
+static void run(const char* name, BENCH_FUNC f, double bytes) {
+    long i, n = 1;
+    double start, elapsed;
+
+    if (only && !strstr(name, only)) return;
+    f();
+    while (1) {
+        start = dtime();
+        for (i=0; i<n; i++) f();
+        elapsed = dtime() - start;
+        if (elapsed >= min_time) break;
+        if (elapsed < min_time/10) {
+            n *= 10;
+        } else {
+            n = (long)(n*min_time*1.2/elapsed) + 1;
+        }
+    }
+    BENCH_RESULT r;
+    r.name = name;
+    r.ns_per_op = elapsed*1e9/n;
+    r.mb_per_sec = bytes ? (bytes*n/elapsed)/1e6 : 0;
+    results.push_back(r);
+    if (bytes) {
+        printf("%-28s %14.1f ns/op %10.1f MB/s\n", name, r.ns_per_op, r.mb_per_sec);
+    } else {
+        printf("%-28s %14.1f ns/op\n", name, r.ns_per_op);
+    }
+    fflush(stdout);
+}
+
+////////////// XML parsing
+
+// the token loop that all parsing is built on
+//
+static void xml_tokens(const string& s) {
+    MIOFILE mf;
+    char buf[4096];
+    bool is_tag;
+    long n = 0;
+
+    mf.init_buf_read(s.c_str());
+    XML_PARSER xp(&mf);
+    while (!xp.get(buf, sizeof(buf), is_tag)) {
+        n++;
+    }
+    sink = n;
+}
+
+static void xml_tokens_sched_request() {
+    xml_tokens(sched_request);
+}
+
+static void xml_tokens_client_state() {
+    xml_tokens(client_state);
+}
+
+// parse a document the way the parse() functions do:
+// get_tag(), then match it against a chain of names,
+// and parse element contents as numbers or strings
+//
+static void xml_parse(const string& s) {
+    MIOFILE mf;
+    char buf[256];
+    double x;
+    int i;
+    long n = 0;
+
+    mf.init_buf_read(s.c_str());
+    XML_PARSER xp(&mf);
+    while (!xp.get_tag()) {
+        if (!xp.is_tag) continue;
+        if (xp.parse_str("name", buf, sizeof(buf))) n++;
+        else if (xp.parse_str("app_name", buf, sizeof(buf))) n++;
+        else if (xp.parse_str("md5_cksum", buf, sizeof(buf))) n++;
+        else if (xp.parse_str("url", buf, sizeof(buf))) n++;
+        else if (xp.parse_str("platform", buf, sizeof(buf))) n++;
+        else if (xp.parse_int("state", i)) n++;
+        else if (xp.parse_int("version_num", i)) n++;
+        else if (xp.parse_int("exit_status", i)) n++;
+        else if (xp.parse_int("status", i)) n++;
+        else if (xp.parse_double("nbytes", x)) n++;
+        else if (xp.parse_double("max_nbytes", x)) n++;
+        else if (xp.parse_double("final_cpu_time", x)) n++;
+        else if (xp.parse_double("final_elapsed_time", x)) n++;
+        else if (xp.parse_double("report_deadline", x)) n++;
+        else if (xp.parse_double("rsc_fpops_est", x)) n++;
+        else if (xp.parse_double("fpops_cumulative", x)) n++;
+    }
+    sink = n;
+}
+
+static void xml_parse_sched_request() {
+    xml_parse(sched_request);
+}
+
+static void xml_parse_client_state() {
+    xml_parse(client_state);
+}
+
+static void xml_parse_doubles() {
+    MIOFILE mf;
+    double x, sum = 0;
+
+    mf.init_buf_read(numbers_xml.c_str());
+    XML_PARSER xp(&mf);
+    while (!xp.get_tag()) {
+        if (xp.parse_double("x", x)) sum += x;
+    }
+    sink = (long)sum;
+}
+
+////////////// output
+
+// the kind of output that the client and scheduler write:
+// many short records of names and numbers
+//
+static void write_records(MIOFILE& mf) {
+    for (unsigned int i=0; i<names.size(); i++) {
+        mf.printf(
+            "<result>\n"
+            "    <name>%s</name>\n"
+            "    <state>%d</state>\n"
+            "    <final_cpu_time>%f</final_cpu_time>\n"
+            "    <report_deadline>%f</report_deadline>\n"
+            "</result>\n",
+            names[i].c_str(), 2, 12345.678*i, 1360281203.128712+i
+        );
+    }
+}
+
+static void miofile_printf_mfile() {
+    MFILE m;
+    MIOFILE mf;
+    char* p;
+    int n;
+
+    mf.init_mfile(&m);
+    write_records(mf);
+    m.get_buf(p, n);
+    sink = n;
+    free(p);
+}
+
+static char write_buf[1024*1024];
+
+static void miofile_printf_buf() {
+    MIOFILE mf;
+
+    mf.init_buf_write(write_buf, sizeof(write_buf));
+    write_records(mf);
+    sink = write_buf[0];
+}
+
+// the same records with MFILE's formatting-free writers
+//
+static void mfile_put() {
+    MFILE m;
+    char* p;
+    int n;
+
+    for (unsigned int i=0; i<names.size(); i++) {
+        m.puts("<result>\n    <name>");
+        m.put_xml_escaped(names[i].c_str());
+        m.puts("</name>\n    <state>");
+        m.put_int(2);
+        m.puts("</state>\n    <final_cpu_time>");
+        m.put_double(12345.678*i);
+        m.puts("</final_cpu_time>\n    <report_deadline>");
+        m.put_double(1360281203.128712+i);
+        m.puts("</report_deadline>\n</result>\n");
+    }
+    m.get_buf(p, n);
+    sink = n;
+    free(p);
+}
+
+////////////// hashing
+
+static void md5_file_bench() {
+    char out[64];
+    double nbytes;
+
+    md5_file(md5_path, out, nbytes);
+    sink = out[0];
+}
+
+static void md5_block_bench() {
+    char out[64];
+
+    md5_block(
+        (const unsigned char*)client_state.c_str(), (int)client_state.size(), out
+    );
+    sink = out[0];
+}
+
+////////////// base64
+
+static void base64_encode() {
+    string s = r_base64_encode(binary_data.c_str(), binary_data.size());
+    sink = (long)s.size();
+}
+
+static void base64_decode() {
+    string s = r_base64_decode(base64_data.c_str(), base64_data.size());
+    sink = (long)s.size();
+}
+
+////////////// XML escaping
+
+static char escape_buf[1024*1024];
+
+static void xml_escape_bench() {
+    xml_escape(text.c_str(), escape_buf, sizeof(escape_buf));
+    sink = escape_buf[0];
+}
+
+static void xml_unescape_bench() {
+    string s = escaped_text;
+    xml_unescape(s);
+    sink = (long)s.size();
+}
+
+////////////// paths and strings
+
+// the hash that dir_hier_path() (sched/sched_util.cpp) uses
+// to choose a file's directory; it's in the scheduler library,
+// not this one, so time the same computation here
+//
+static void dir_hier_hash() {
+    char dir[256], path[1024];
+    long n = 0;
+
+    for (unsigned int i=0; i<names.size(); i++) {
+        const string& f = names[i];
+        string s = md5_string((const unsigned char*)f.c_str(), (int)f.size());
+        int x = strtol(s.substr(1, 7).c_str(), 0, 16);
+        sprintf(dir, "%x", x % 1024);
+        snprintf(path, sizeof(path), "../download/%s/%s", dir, f.c_str());
+        n += path[0];
+    }
+    sink = n;
+}
+
+static void strlcpy_names() {
+    char buf[256];
+    long n = 0;
+
+    for (unsigned int i=0; i<names.size(); i++) {
+        safe_strcpy(buf, names[i].c_str());
+        n += buf[0];
+    }
+    sink = n;
+}
+
+////////////// setup
+
+static int read_corpus(const char* dir, const char* name, string& s) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int retval = read_file_string(path, s);
+    if (retval) {
+        fprintf(stderr, "can't read %s: %s\n", path, boincerror(retval));
+    }
+    return retval;
+}
+
+// names and text from the corpora, and generated data
+//
+static int setup(const char* dir) {
+    char buf[256];
+    int i, retval;
+
+    retval = read_corpus(dir, "sched_request.xml", sched_request);
+    if (retval) return retval;
+    retval = read_corpus(dir, "client_state.xml", client_state);
+    if (retval) return retval;
+
+    MIOFILE mf;
+    mf.init_buf_read(client_state.c_str());
+    XML_PARSER xp(&mf);
+    while (!xp.get_tag()) {
+        if (xp.parse_str("name", buf, sizeof(buf))) {
+            names.push_back(buf);
+        }
+    }
+
+    // text with some characters to escape: the corpora, unescaped
+    //
+    text = sched_request;
+    xml_unescape(text);
+    escaped_text.resize(text.size()*6+1);
+    xml_escape(text.c_str(), &escaped_text[0], (int)escaped_text.size());
+    escaped_text.resize(strlen(escaped_text.c_str()));
+
+    srand(1);
+    numbers_count = 10000;
+    for (i=0; i<numbers_count; i++) {
+        snprintf(buf, sizeof(buf), "<x>%f</x>\n", drand()*1e6);
+        numbers_xml += buf;
+    }
+    for (i=0; i<64*1024; i++) {
+        binary_data += (char)(rand() & 0xff);
+    }
+    base64_data = r_base64_encode(binary_data.c_str(), binary_data.size());
+
+    // a 4 MB file for md5_file()
+    //
+    snprintf(md5_path, sizeof(md5_path), "lib_bench_%d.tmp", (int)getpid());
+    FILE* f = fopen(md5_path, "wb");
+    if (!f) {
+        fprintf(stderr, "can't create %s\n", md5_path);
+        return ERR_FOPEN;
+    }
+    while (ftell(f) < 4*1024*1024) {
+        fwrite(client_state.c_str(), 1, client_state.size(), f);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int save_results(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return ERR_FOPEN;
+    for (unsigned int i=0; i<results.size(); i++) {
+        fprintf(f, "%s %f\n", results[i].name.c_str(), results[i].ns_per_op);
+    }
+    fclose(f);
+    return 0;
+}
+
+// return the number of benchmarks slower than the saved ones
+// by more than tolerance percent
+//
+static int compare_results(const char* path, double tolerance) {
+    char name[256];
+    double ns;
+    map<string, double> saved;
+    int nslower = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "can't read %s\n", path);
+        return -1;
+    }
+    while (fscanf(f, "%255s %lf", name, &ns) == 2) {
+        saved[name] = ns;
+    }
+    fclose(f);
+
+    printf("\n%-28s %12s %12s %8s\n", "", "saved ns/op", "ns/op", "change");
+    for (unsigned int i=0; i<results.size(); i++) {
+        BENCH_RESULT& r = results[i];
+        map<string, double>::iterator it = saved.find(r.name);
+        if (it == saved.end() || it->second <= 0) continue;
+        double pct = (r.ns_per_op/it->second - 1)*100;
+        bool slower = pct > tolerance;
+        printf("%-28s %12.1f %12.1f %+7.1f%%%s\n",
+            r.name.c_str(), it->second, r.ns_per_op, pct,
+            slower?"  SLOWER":""
+        );
+        if (slower) nslower++;
+    }
+    return nslower;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: lib_bench [--dir DIR] [--time SECS] [--only NAME]\n"
+        "    [--save FILE] [--compare FILE [--tolerance PCT]]\n"
+    );
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = "bench_data";
+    const char* save_file = 0;
+    const char* compare_file = 0;
+    double tolerance = 15;
+    double md5_nbytes;
+    int i, retval;
+
+    for (i=1; i<argc; i++) {
+        if (i+1 >= argc) usage();
+        if (!strcmp(argv[i], "--dir")) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "--time")) {
+            min_time = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--only")) {
+            only = argv[++i];
+        } else if (!strcmp(argv[i], "--save")) {
+            save_file = argv[++i];
+        } else if (!strcmp(argv[i], "--compare")) {
+            compare_file = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance")) {
+            tolerance = atof(argv[++i]);
+        } else {
+            usage();
+        }
+    }
+
+    retval = setup(dir);
+    if (retval) {
+        unlink(md5_path);
+        exit(1);
+    }
+
+    run("xml_tokens_sched_request", xml_tokens_sched_request, sched_request.size());
+    run("xml_tokens_client_state", xml_tokens_client_state, client_state.size());
+    run("xml_parse_sched_request", xml_parse_sched_request, sched_request.size());
+    run("xml_parse_client_state", xml_parse_client_state, client_state.size());
+    run("xml_parse_doubles", xml_parse_doubles, numbers_xml.size());
+    run("miofile_printf_mfile", miofile_printf_mfile, 0);
+    run("miofile_printf_buf", miofile_printf_buf, 0);
+    run("mfile_put", mfile_put, 0);
+    file_size(md5_path, md5_nbytes);
+    run("md5_file", md5_file_bench, md5_nbytes);
+    run("md5_block", md5_block_bench, client_state.size());
+    run("base64_encode", base64_encode, binary_data.size());
+    run("base64_decode", base64_decode, base64_data.size());
+    run("xml_escape", xml_escape_bench, text.size());
+    run("xml_unescape", xml_unescape_bench, escaped_text.size());
+    run("dir_hier_hash", dir_hier_hash, 0);
+    run("strlcpy_names", strlcpy_names, 0);
+    unlink(md5_path);
+
+    printf("(%d names per output, path and copy op)\n", (int)names.size());
+
+    if (save_file) {
+        retval = save_results(save_file);
+        if (retval) {
+            fprintf(stderr, "can't write %s\n", save_file);
+            exit(1);
+        }
+    }
+    if (compare_file) {
+        int n = compare_results(compare_file, tolerance);
+        if (n) exit(1);
+    }
+    return 0;
+}
@@ -36,16 +36,81 @@
 #include <stdlib.h>
 #endif
 
+#include <cstdlib>
+#include <cstring>
+#ifdef HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#endif
+
 #include "error_numbers.h"
-#include "md5.h"
 
 #include "md5_file.h"
 
-int md5_file(const char* path, char* output, double& nbytes) {
-    unsigned char buf[4096];
+// read this much at a time
+//
+#define MD5_FILE_BUFSIZE    (64*1024)
+
+static void md5_hex(const unsigned char* binout, char* output) {
+    static const char* hex = "0123456789abcdef";
+    for (int i=0; i<16; i++) {
+        output[2*i] = hex[binout[i]>>4];
+        output[2*i+1] = hex[binout[i]&0xf];
+    }
+    output[32] = 0;
+}
+
+void MD5_STATE::init() {
+#ifdef USE_OPENSSL_MD5
+    MD5_Init(&ctx);
+#else
+    md5_init(&state);
+#endif
+}
+
+void MD5_STATE::append(const unsigned char* data, int nbytes) {
+#ifdef USE_OPENSSL_MD5
+    MD5_Update(&ctx, data, nbytes);
+#else
+    md5_append(&state, data, nbytes);
+#endif
+}
+
+void MD5_STATE::finish(char* output) {
     unsigned char binout[16];
-    md5_state_t state;
-    int i, n;
+#ifdef USE_OPENSSL_MD5
+    MD5_Final(binout, &ctx);
+#else
+    md5_finish(&state, binout);
+#endif
+    md5_hex(binout, output);
+}
+
+std::string MD5_STATE::save() {
+    static const char* hex = "0123456789abcdef";
+    const unsigned char* p = (const unsigned char*)this;
+    std::string s;
+    for (unsigned int i=0; i<sizeof(MD5_STATE); i++) {
+        s += hex[p[i]>>4];
+        s += hex[p[i]&0xf];
+    }
+    return s;
+}
+
+bool MD5_STATE::restore(const char* s) {
+    unsigned char buf[sizeof(MD5_STATE)];
+    if (strlen(s) != 2*sizeof(MD5_STATE)) return false;
+    for (unsigned int i=0; i<sizeof(MD5_STATE); i++) {
+        unsigned int x;
+        if (sscanf(s+2*i, "%2x", &x) != 1) return false;
+        buf[i] = (unsigned char)x;
+    }
+    memcpy(this, buf, sizeof(MD5_STATE));
+    return true;
+}
+
+int md5_file(const char* path, char* output, double& nbytes) {
+    MD5_STATE state;
+    int n;
 
     nbytes = 0;
 #ifndef _USING_FCGI_
@@ -63,34 +128,37 @@ int md5_file(const char* path, char* output, double& nbytes) {
 
         return ERR_FOPEN;
     }
-    md5_init(&state);
+#if defined(HAVE_POSIX_FADVISE) && !defined(_USING_FCGI_)
+    // we'll read the whole file; tell the kernel to read ahead
+    //
+    posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // the buffer is too big for some thread stacks
+    //
+    unsigned char* buf = (unsigned char*)malloc(MD5_FILE_BUFSIZE);
+    if (!buf) {
+        fclose(f);
+        return ERR_MALLOC;
+    }
+    state.init();
     while (1) {
-        n = (int)fread(buf, 1, 4096, f);
+        n = (int)fread(buf, 1, MD5_FILE_BUFSIZE, f);
         if (n<=0) break;
         nbytes += n;
-        md5_append(&state, buf, n);
-    }
-    md5_finish(&state, binout);
-    for (i=0; i<16; i++) {
-        sprintf(output+2*i, "%02x", binout[i]);
+        state.append(buf, n);
     }
-    output[32] = 0;
+    state.finish(output);
+    free(buf);
     fclose(f);
     return 0;
 }
 
 int md5_block(const unsigned char* data, int nbytes, char* output) {
-    unsigned char binout[16];
-    int i;
-
-    md5_state_t state;
-    md5_init(&state);
-    md5_append(&state, data, nbytes);
-    md5_finish(&state, binout);
-    for (i=0; i<16; i++) {
-        sprintf(output+2*i, "%02x", binout[i]);
-    }
-    output[32] = 0;
+    MD5_STATE state;
+    state.init();
+    state.append(data, nbytes);
+    state.finish(output);
     return 0;
 }
 
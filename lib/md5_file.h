@@ -20,6 +20,12 @@
 
 #include <string>
 
+#ifdef USE_OPENSSL_MD5
+#include <openssl/md5.h>
+#else
+#include "md5.h"
+#endif
+
 // length of buffer to hold an MD5 hash
 // In principle need 32 + 1 for NULL,
 // but leave some room for XML whitespace
@@ -27,6 +33,27 @@
 //
 #define MD5_LEN 64
 
+// incremental MD5, for data that arrives in pieces.
+// This uses OpenSSL's (faster) MD5 if USE_OPENSSL_MD5 is defined
+// (for programs that link with libcrypto anyway),
+// else the portable version in md5.c.
+//
+struct MD5_STATE {
+#ifdef USE_OPENSSL_MD5
+    MD5_CTX ctx;
+#else
+    md5_state_t state;
+#endif
+    void init();
+    void append(const unsigned char* data, int nbytes);
+    void finish(char* output);
+        // output is the hex digest; must have room for 33 chars
+    std::string save();
+    bool restore(const char*);
+        // the internal state in hex, so a computation can be
+        // resumed after a restart.  Specific to this host and build.
+};
+
 extern int md5_file(const char* path, char* output, double& nbytes);
 extern int md5_block(const unsigned char* data, int nbytes, char* output);
 
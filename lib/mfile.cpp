@@ -27,6 +27,9 @@
 #include <cstring>
 #include <string>
 #include <cerrno>
+#include <deque>
+#include <vector>
+#include <pthread.h>
 #include <unistd.h>
 #endif
 
@@ -35,61 +38,386 @@
 
 #include "mfile.h"
 
+// initial buffer size
+//
+#define MFILE_INIT_SIZE     (64*1024)
+
+// limit on the output of a single printf()
+//
+#define MFILE_MAX_PRINTF    (64*1024*1024)
+
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
+
 MFILE::MFILE() {
-    buf = (char*)malloc(64*1024);
+    buf = (char*)malloc(MFILE_INIT_SIZE);
+    cap = buf?MFILE_INIT_SIZE:0;
     len = 0;
+    flush_size = 0;
+    werr = 0;
+    f = NULL;
+    async = false;
+    async_pending = 0;
+    async_err = 0;
+    async_dirty = false;
 }
 
 MFILE::~MFILE() {
+    if (async) wait_writes(true);
     if (buf) free(buf);
 }
 
 int MFILE::open(const char* path, const char* mode) {
     f = boinc_fopen(path, mode);
     if (!f) return ERR_FOPEN;
-    if (!buf) buf = (char*)malloc(64*1024);
+    if (!buf) grow(0);
+    werr = 0;
     return 0;
 }
 
-// seems like Win's realloc is stupid,  Make it smart.
+// make room for n more bytes plus the NULL.
+// Grow by doubling so that a long series of small writes
+// does a logarithmic number of reallocs.
 //
-static inline char* realloc_aux(char* p, size_t len) {
+void MFILE::grow(int n) {
+    int need = len + n + 1;
+    if (buf && need <= cap) return;
+    int newcap = cap*2;
+    if (newcap < MFILE_INIT_SIZE) newcap = MFILE_INIT_SIZE;
+    if (newcap < need) newcap = need;
+    char* p = (char*)realloc(buf, newcap);
     if (!p) {
-        return (char*)malloc(64*1024);
+        fprintf(stderr,
+            "ERROR: realloc() failed in MFILE; len %d n %d\n", len, n
+        );
+        exit(1);
     }
-#ifdef _WIN32
-    if (_msize(p) >= (unsigned int)len) return p;
-    return (char*) realloc(p, len*2);
+    buf = p;
+    cap = newcap;
+}
+
+int MFILE::reserve(int n) {
+    grow(n);
+    return 0;
+}
+
+void MFILE::set_flush_size(int n) {
+    flush_size = n;
+}
+
+#ifndef _WIN32
+
+// Write-behind: buffers to write are queued for one I/O thread.
+// The mutex protects the queue, the list of files,
+// and the async_* members of those files.
+//
+struct MFILE_WRITE {
+    MFILE* mf;
+    int fd;
+    char* buf;
+    int len;
+};
+
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+    // signalled when a write is queued or done
+static std::deque<MFILE_WRITE> io_queue;
+static int io_busy = 0;         // writes taken off the queue, not done
+static bool io_thread_running = false;
+static std::vector<MFILE*> async_files;
+
+static int write_all(int fd, const char* p, int n) {
+    while (n > 0) {
+        ssize_t k = ::write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return ERR_WRITE;
+        }
+        p += k;
+        n -= (int)k;
+    }
+    return 0;
+}
+
+void* mfile_io_thread(void*) {
+    pthread_mutex_lock(&io_mutex);
+    while (1) {
+        if (io_queue.empty()) {
+            pthread_cond_wait(&io_cond, &io_mutex);
+            continue;
+        }
+        MFILE_WRITE w = io_queue.front();
+        io_queue.pop_front();
+        io_busy++;
+        pthread_mutex_unlock(&io_mutex);
+
+        int retval = write_all(w.fd, w.buf, w.len);
+        free(w.buf);
+
+        pthread_mutex_lock(&io_mutex);
+        if (retval && !w.mf->async_err) w.mf->async_err = retval;
+        w.mf->async_pending--;
+        io_busy--;
+        pthread_cond_broadcast(&io_cond);
+    }
+    return 0;
+}
+
+static void io_drain() {
+    pthread_mutex_lock(&io_mutex);
+    while (!io_queue.empty() || io_busy) {
+        pthread_cond_wait(&io_cond, &io_mutex);
+    }
+    pthread_mutex_unlock(&io_mutex);
+}
+
+// the I/O thread doesn't exist in a forked child; start one
+//
+static void io_child() {
+    pthread_t thread;
+    pthread_mutex_init(&io_mutex, NULL);
+    pthread_cond_init(&io_cond, NULL);
+    if (io_thread_running) {
+        if (pthread_create(&thread, NULL, mfile_io_thread, NULL)) {
+            io_thread_running = false;
+        } else {
+            pthread_detach(thread);
+        }
+    }
+}
+
+static int start_io_thread() {
+    pthread_t thread;
+    if (io_thread_running) return 0;
+    if (pthread_create(&thread, NULL, mfile_io_thread, NULL)) {
+        return ERR_THREAD;
+    }
+    pthread_detach(thread);
+    io_thread_running = true;
+
+    // don't lose queued output at exit, or duplicate it in a child
+    //
+    atexit(io_drain);
+    pthread_atfork(io_drain, NULL, io_child);
+    return 0;
+}
+
+int MFILE::set_async(int chunk_size) {
+    if (async) return 0;
+    if (!f) return ERR_NULL;
+    pthread_mutex_lock(&io_mutex);
+    int retval = start_io_thread();
+    if (!retval) {
+        async = true;
+        async_pending = 0;
+        async_err = 0;
+        async_dirty = false;
+        async_files.push_back(this);
+    }
+    pthread_mutex_unlock(&io_mutex);
+    if (retval) return retval;
+    flush_size = chunk_size;
+    return 0;
+}
+
+// give the buffer to the I/O thread and start a new one.
+// If there's no memory for a new one, write it here.
+//
+void MFILE::queue_write() {
+    if (!len) return;
+    char* p = (char*)malloc(cap);
+    if (!p) {
+        wait_writes(false);
+        int retval = write_out();
+        if (retval && !werr) werr = retval;
+        async_dirty = true;
+        return;
+    }
+    MFILE_WRITE w;
+    w.mf = this;
+    w.fd = fileno(f);
+    w.buf = buf;
+    w.len = len;
+    buf = p;
+    len = 0;
+    buf[0] = 0;
+
+    pthread_mutex_lock(&io_mutex);
+    async_pending++;
+    async_dirty = true;
+    io_queue.push_back(w);
+    pthread_cond_broadcast(&io_cond);
+    pthread_mutex_unlock(&io_mutex);
+}
+
+// wait for this file's writes;
+// if it's being closed, mfile_sync_all() stops tracking it
+//
+void MFILE::wait_writes(bool closing) {
+    pthread_mutex_lock(&io_mutex);
+    while (async_pending) {
+        pthread_cond_wait(&io_cond, &io_mutex);
+    }
+    if (async_err && !werr) werr = async_err;
+    async_err = 0;
+    if (closing) {
+        for (unsigned int i=0; i<async_files.size(); i++) {
+            if (async_files[i] == this) {
+                async_files.erase(async_files.begin()+i);
+                break;
+            }
+        }
+        async = false;
+    }
+    pthread_mutex_unlock(&io_mutex);
+}
+
+#ifdef __linux__
+#define mfile_datasync(fd)  fdatasync(fd)
 #else
-    return (char*) realloc(p, len);
+#define mfile_datasync(fd)  fsync(fd)
 #endif
+
+// The files are synced outside the lock, so that the app
+// can keep handing off writes meanwhile.
+// Syncing a dup() of the descriptor lets a file be closed in the meantime.
+//
+int mfile_sync_all() {
+    std::vector<int> fds;
+    unsigned int i;
+    int retval = 0;
+
+    pthread_mutex_lock(&io_mutex);
+    while (!io_queue.empty() || io_busy) {
+        pthread_cond_wait(&io_cond, &io_mutex);
+    }
+    for (i=0; i<async_files.size(); i++) {
+        MFILE* mf = async_files[i];
+        if (mf->async_err) {
+            if (!retval) retval = mf->async_err;
+            mf->async_err = 0;
+        }
+        if (mf->async_dirty && mf->f) {
+            int fd = dup(fileno(mf->f));
+            if (fd >= 0) {
+                fds.push_back(fd);
+            } else if (!retval) {
+                retval = ERR_DUP2;
+            }
+            mf->async_dirty = false;
+        }
+    }
+    pthread_mutex_unlock(&io_mutex);
+
+    for (i=0; i<fds.size(); i++) {
+        if (mfile_datasync(fds[i]) < 0 && !retval) retval = ERR_FSYNC;
+        ::close(fds[i]);
+    }
+    return retval;
 }
 
-#define BUFSIZE 100000
+#else
 
-int MFILE::vprintf(const char* format, va_list ap) {
-    char buf2[BUFSIZE];
-    int n, k;
-
-    k = vsnprintf(buf2, BUFSIZE, format, ap);
-    if (k<=-1 || k>=BUFSIZE) {
-        fprintf(stderr, "ERROR: buffer too small in MFILE::vprintf()\n");
-        fprintf(stderr, "ERROR: format: %s\n", format);
-        fprintf(stderr, "ERROR: k=%d, BUFSIZE=%d\n", k, BUFSIZE);
-        return -1;
-    }
-    n = (int)strlen(buf2);
-    buf = (char*)realloc_aux(buf, len+n+1);
-    if (!buf) {
-        fprintf(stderr,
-            "ERROR: realloc() failed in MFILE::vprintf(); len %d n %d\n",
-            len, n
-        );
-        exit(1);
+int MFILE::set_async(int) {
+    return ERR_NOT_IMPLEMENTED;
+}
+
+void MFILE::queue_write() {}
+void MFILE::wait_writes(bool) {}
+
+int mfile_sync_all() {
+    return 0;
+}
+
+#endif
+
+// write the buffer to the file and empty it.
+// On Unix this goes straight to the descriptor;
+// the data doesn't need another copy through stdio.
+//
+int MFILE::write_out() {
+    if (len) {
+#ifdef _WIN32
+        int n = (int)fwrite(buf, 1, len, f);
+        if (n != len) {
+            len = 0;
+            buf[0] = 0;
+            return ERR_FWRITE;
+        }
+#else
+        int fd = fileno(f);
+        char* p = buf;
+        int n = len;
+        while (n > 0) {
+            ssize_t k = ::write(fd, p, n);
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                len = 0;
+                buf[0] = 0;
+                return ERR_WRITE;
+            }
+            p += k;
+            n -= (int)k;
+        }
+#endif
+    }
+    len = 0;
+    buf[0] = 0;
+    return 0;
+}
+
+// called after each append
+//
+inline void MFILE::check_flush() {
+    if (flush_size && f && len >= flush_size) {
+        if (async) {
+            queue_write();
+            return;
+        }
+        int retval = write_out();
+        if (retval && !werr) werr = retval;
     }
-    strncpy(buf+len, buf2, n);
+}
+
+inline void MFILE::append(const char* p, int n) {
+    grow(n);
+    memcpy(buf+len, p, n);
     len += n;
     buf[len] = 0;
+    check_flush();
+}
+
+// format directly into the buffer;
+// if the output doesn't fit, grow the buffer and do it again.
+//
+int MFILE::vprintf(const char* format, va_list ap) {
+    va_list ap2;
+    int k;
+
+    if (!buf) grow(0);
+    while (1) {
+        int avail = cap - len;
+        va_copy(ap2, ap);
+        k = vsnprintf(buf+len, avail, format, ap2);
+        va_end(ap2);
+        if (k >= 0 && k < avail) break;
+
+        // C99 vsnprintf() returns the size needed;
+        // older Windows runtimes return -1 if the output was truncated
+        //
+        int need = (k >= 0) ? k : avail*2;
+        if (need > MFILE_MAX_PRINTF) {
+            buf[len] = 0;
+            fprintf(stderr, "ERROR: output too large in MFILE::vprintf()\n");
+            fprintf(stderr, "ERROR: format: %s\n", format);
+            fprintf(stderr, "ERROR: k=%d\n", k);
+            return -1;
+        }
+        grow(need);
+    }
+    len += k;
+    check_flush();
     return k;
 }
 
@@ -104,78 +432,157 @@ int MFILE::printf(const char* format, ...) {
 }
 
 size_t MFILE::write(const void *ptr, size_t size, size_t nitems) {
-    buf = (char *)realloc_aux( buf, len+(size*nitems)+1 );
-    if (!buf) {
-        fprintf(stderr,
-            "ERROR: realloc() failed in MFILE::write(); len %d size %lu nitems %lu\n",
-            len, size, nitems
-        );
-        exit(1);
-    }
-    memcpy( buf+len, ptr, size*nitems );
-    len += (int)size*(int)nitems;
-    buf[len] = 0;
+    append((const char*)ptr, (int)(size*nitems));
     return nitems;
 }
 
 int MFILE::_putchar(char c) {
-    buf = (char*)realloc_aux(buf, len+1+1);
-    if (!buf) {
-        fprintf(stderr,
-            "ERROR: realloc() failed in MFILE::_putchar(); len %d\n", len
-        );
-        exit(1);
-    }
-    buf[len] = c;
-    len++;
-    buf[len] = 0;
+    append(&c, 1);
     return c;
 }
 
 int MFILE::puts(const char* p) {
     int n = (int)strlen(p);
-    buf = (char*)realloc_aux(buf, len+n+1);
-    if (!buf) {
-        fprintf(stderr,
-            "ERROR: realloc() failed in MFILE::puts() len %d n %d\n", len, n
-        );
-        exit(1);
-    }
-    strncpy(buf+len, p, n);
-    len += n;
-    buf[len] = 0;
+    append(p, n);
     return n;
 }
 
+int MFILE::put_int(long x) {
+    char tmp[32];
+    char* end = tmp+sizeof(tmp);
+    char* p = end;
+    unsigned long u = (x<0) ? 0UL-(unsigned long)x : (unsigned long)x;
+
+    do {
+        *--p = (char)('0' + u%10);
+        u /= 10;
+    } while (u);
+    if (x < 0) *--p = '-';
+    append(p, (int)(end-p));
+    return (int)(end-p);
+}
+
+// Scale to an integer number of millionths and print that.
+// The result can differ from printf("%f") in the last digit
+// when the value is very close to a rounding boundary.
+//
+int MFILE::put_double(double x) {
+    char tmp[48];
+    char* end = tmp+sizeof(tmp);
+    char* p = end;
+    bool neg = false;
+    int i;
+
+    // this also catches NaN
+    //
+    if (!(x > -1e12 && x < 1e12)) {
+        return printf("%f", x);
+    }
+    if (x < 0) {
+        neg = true;
+        x = -x;
+    }
+    unsigned long long v = (unsigned long long)(x*1e6 + .5);
+    unsigned long long ip = v/1000000;
+    unsigned int frac = (unsigned int)(v%1000000);
+    for (i=0; i<6; i++) {
+        *--p = (char)('0' + frac%10);
+        frac /= 10;
+    }
+    *--p = '.';
+    do {
+        *--p = (char)('0' + (int)(ip%10));
+        ip /= 10;
+    } while (ip);
+    if (neg) *--p = '-';
+    append(p, (int)(end-p));
+    return (int)(end-p);
+}
+
+// copy runs of plain characters in one piece
+//
+int MFILE::put_xml_escaped(const char* in) {
+    int old_len = len;
+    const char* run = in;
+
+    for (; *in; in++) {
+        int x = (*in) & 0xff;
+        if (x != '<' && x != '&' && x <= 127 && x >= 32) continue;
+        if (in > run) append(run, (int)(in-run));
+        run = in+1;
+        if (x == '<') {
+            append("&lt;", 4);
+        } else if (x == '&') {
+            append("&amp;", 5);
+        } else if (x > 127 || x == 9 || x == 10 || x == 13) {
+            append("&#", 2);
+            put_int(x);
+            append(";", 1);
+        }
+    }
+    if (in > run) append(run, (int)(in-run));
+    return len - old_len;
+}
+
 int MFILE::close() {
     int retval = 0;
     if (f) {
-        flush();
+        retval = flush();
+        if (async) {
+            // mfile_sync_all() won't see this file after this; sync it now
+            //
+            wait_writes(true);
+            if (werr && !retval) retval = werr;
+            werr = 0;
+#ifndef _WIN32
+            if (async_dirty && mfile_datasync(fileno(f)) < 0 && !retval) {
+                retval = ERR_FSYNC;
+            }
+#endif
+            async_dirty = false;
+        }
         fclose(f);
         f = NULL;
     }
     if (buf) {
         free(buf);
         buf = NULL;
+        cap = 0;
     }
+    len = 0;
     return retval;
 }
 
 int MFILE::flush() {
-    int n, old_len = len;
-
-    n = (int)fwrite(buf, 1, len, f);
-    len = 0;
-    if (n != old_len) return ERR_FWRITE;
+    if (async) {
+        queue_write();
+        int retval = werr;
+        werr = 0;
+        return retval;
+    }
+    int retval = write_out();
+    if (werr) {
+        retval = werr;
+        werr = 0;
+    }
+    if (retval) return retval;
+#ifdef _WIN32
     if (fflush(f)) return ERR_FFLUSH;
-#ifndef _WIN32
+#else
     if (fsync(fileno(f)) < 0) return ERR_FSYNC;
 #endif
     return 0;
 }
 
 long MFILE::tell() const {
-    return f ? ftell(f) : -1;
+    if (!f) return -1;
+#ifdef _WIN32
+    return ftell(f);
+#else
+    // output bypasses stdio; ask the descriptor
+    //
+    return (long)lseek(fileno(f), 0, SEEK_CUR);
+#endif
 }
 
 void MFILE::get_buf(char*& b, int& l) {
@@ -183,5 +590,6 @@ void MFILE::get_buf(char*& b, int& l) {
     l = len;
     buf = 0;
     len = 0;
+    cap = 0;
 }
 
@@ -29,20 +29,77 @@
 //    The output is buffered in memory.
 //    Then close or flush all the MFILEs;
 //    all the buffers will be flushed to disk, almost atomically.
+//
+// The buffer grows geometrically, and printf() formats directly into it,
+// so a large write (e.g. client_state.xml) does few allocations and copies.
+//
+// Write-behind mode (set_async(); Unix only):
+// each time the buffer reaches the chunk size, it's handed to
+// a background I/O thread (one per process) which writes it,
+// and output continues in a new buffer.
+// flush() hands off what's buffered and returns without waiting.
+// The data is durable only after mfile_sync_all(),
+// which waits for all pending writes and syncs each file
+// written since the last call, once.
+// boinc_checkpoint_completed() calls it,
+// so an app using MFILEs this way does:
+//
+//  if (boinc_time_to_checkpoint()) {
+//      out.flush();
+//      write_checkpoint_file();    // overlaps with the writes
+//      boinc_checkpoint_completed();
+//  }
 
 class MFILE {
     char* buf;      // NULL-terminated
     int len;
+    int cap;        // allocated size of buf
+    int flush_size;
+    int werr;       // error from a write done by set_flush_size()
     FILE* f;
+    bool async;
+    int async_pending;  // writes handed off but not done
+    int async_err;      // error from one of them
+    bool async_dirty;   // written since the last sync
+    void grow(int n);
+    int write_out();
+    void queue_write();
+    void wait_writes(bool closing);
+    void check_flush();
+    void append(const char*, int);
+    friend int mfile_sync_all();
+    friend void* mfile_io_thread(void*);
 public:
     MFILE();
     ~MFILE();
     int open(const char* path, const char* mode);
+    int reserve(int n);
+        // make sure there's room for n more bytes without reallocating
+    void set_flush_size(int n);
+        // If n>0, write buffered data to the file whenever
+        // it reaches n bytes, rather than only in flush()/close().
+        // Use this only if partial output is harmless
+        // (e.g. the file is renamed into place after close()).
+    int set_async(int chunk_size);
+        // use write-behind mode (see above), writing chunk_size pieces.
+        // Call after open().  Returns ERR_NOT_IMPLEMENTED on Windows
+        // and ERR_THREAD if the I/O thread can't be started;
+        // the MFILE then works as before
     int _putchar(char);
     int puts(const char*);
     int vprintf(const char* format, va_list);
     int printf(const char* format, ...);
     size_t write(const void *, size_t size, size_t nitems);
+
+    // append values without going through vsnprintf()
+    //
+    int put_int(long);
+    int put_double(double);
+        // like printf("%f"); very large or non-finite values
+        // fall back to snprintf()
+    int put_xml_escaped(const char*);
+        // same escaping as xml_escape()
+
     int close();
     int flush();
     long tell() const;
@@ -52,4 +109,10 @@ public:
         // The MFILE's buffer is set to empty
 };
 
+extern int mfile_sync_all();
+    // wait for the writes of write-behind MFILEs, and make them durable
+    // (fdatasync() each file written since the last call).
+    // Returns the first error from any of them.
+    // Data not yet given to flush() or a full chunk isn't included.
+
 #endif
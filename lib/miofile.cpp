@@ -126,17 +126,24 @@ int MIOFILE::_ungetc(int c) {
 
 // copy from a file to static buffer
 //
+// If the contents don't fit, keep reading up to the end tag
+// (like the FILE* version) so the caller can continue parsing.
+//
 int copy_element_contents(MIOFILE& in, const char* end_tag, char* p, int len) {
     char buf[256];
     int n;
+    int retval = 0;
 
     strcpy(p, "");
     while (in.fgets(buf, 256)) {
         if (strstr(buf, end_tag)) {
-            return 0;
+            return retval;
         }
         n = (int)strlen(buf);
-        if (n >= len-1) return ERR_XML_PARSE;
+        if (n >= len-1) {
+            retval = ERR_XML_PARSE;
+            continue;
+        }
         strcat(p, buf);
         len -= n;
     }
@@ -70,6 +70,16 @@ public:
         }
         return (*buf)?(*buf++):EOF;
     }
+
+    // if reading from a memory buffer, return the current position;
+    // parsers can scan it directly and then advance()
+    //
+    inline const char* read_buf() {
+        return f ? 0 : buf;
+    }
+    inline void advance(size_t n) {
+        buf += n;
+    }
 };
 
 extern int copy_element_contents(MIOFILE& in, const char* end_tag, char* p, int len);
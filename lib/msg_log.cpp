@@ -21,12 +21,17 @@
 #include "config.h"
 #include <cstring>
 #include <string>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #endif
 
 #ifdef _USING_FCGI_
 #include "boinc_fcgi.h"
 #endif
 
+#include "error_numbers.h"
+#include "str_replace.h"
 #include "str_util.h"
 #include "util.h"
 
@@ -62,14 +67,29 @@ using std::string;
 
 // See sched/sched_msg_log.C and client/client_msg_log.C for those classes.
 
+// Normally each message is written to "output" when it's generated.
+// After start_writer(), messages are instead copied to a ring buffer,
+// and a thread copies them from there to "output".
+// Any thread can log: a message's space in the buffer is reserved
+// with a compare-and-swap, and messages become visible to the writer
+// in the order their space was reserved.
+// If the buffer is full, logging waits for the writer.
+
 MSG_LOG::MSG_LOG(FILE* output_) {
     output = output_;
     indent_level = 0;
     spaces[0] = 0;
     pid = 0;
+    json = false;
+    request_id[0] = 0;
+    writer = NULL;
     strcpy(spaces+1, "                                                                              ");
 }
 
+void MSG_LOG::set_request_id(const char* p) {
+    safe_strcpy(request_id, p);
+}
+
 void MSG_LOG::enter_level(int diff) {
     if (indent_level <= 0 ) indent_level = 0;
     if ((indent_level + diff) <= 0) return;
@@ -81,17 +101,78 @@ void MSG_LOG::enter_level(int diff) {
     spaces[indent_level] = 0;
 }
 
+// write a message.
+// As text it's text_prefix followed by msg;
+// as JSON the prefix is replaced by fields.
+//
+void MSG_LOG::emit(int kind, const char* text_prefix, const char* msg) {
+    string s;
+    if (json) {
+        char buf[256];
+        sprintf(buf, "{\"time\":%.4f", dtime());
+        s = buf;
+        if (pid) {
+            sprintf(buf, ",\"pid\":%d", pid);
+            s += buf;
+        }
+        sprintf(buf, ",\"level\":%d", kind);
+        s += buf;
+
+        // "[debug]" -> "debug"
+        //
+        const char* skind = v_format_kind(kind);
+        if (*skind == '[') skind++;
+        size_t n = strlen(skind);
+        if (n && skind[n-1] == ']') n--;
+        if (n) {
+            s += ",\"kind\":\"";
+            json_escape(string(skind, n).c_str(), s);
+            s += "\"";
+        }
+        if (request_id[0]) {
+            s += ",\"request\":\"";
+            json_escape(request_id, s);
+            s += "\"";
+        }
+        s += ",\"msg\":\"";
+        string m(msg);
+        while (!m.empty() && m[m.size()-1] == '\n') m.erase(m.size()-1);
+        json_escape(m.c_str(), s);
+        s += "\"}\n";
+    } else {
+        s = text_prefix;
+        s += msg;
+    }
+    write(s.c_str(), s.size());
+}
+
 void MSG_LOG::vprintf(int kind, const char* format, va_list va) {
-    char buf[256];
-    const char* now_timestamp = precision_time_to_string(dtime());
+    char buf[256], prefix[512], msg[4096];
     if (!v_message_wanted(kind)) return;
+    const char* now_timestamp = precision_time_to_string(dtime());
     if (pid) {
         sprintf(buf, " [PID=%-5d]", pid);
     } else {
         buf[0] = 0;
     }
-    fprintf(output, "%s%s %s%s ", now_timestamp, buf, v_format_kind(kind), spaces);
-    vfprintf(output, format, va);
+    snprintf(prefix, sizeof(prefix), "%s%s %s%s ",
+        now_timestamp, buf, v_format_kind(kind), spaces
+    );
+
+    // format into a local buffer if it fits (nearly always)
+    //
+    va_list va2;
+    va_copy(va2, va);
+    int n = vsnprintf(msg, sizeof(msg), format, va2);
+    va_end(va2);
+    if (n >= (int)sizeof(msg)) {
+        string big(n+1, 0);
+        vsnprintf(&big[0], n+1, format, va);
+        big.resize(n);
+        emit(kind, prefix, big.c_str());
+    } else if (n >= 0) {
+        emit(kind, prefix, msg);
+    }
 }
 
 // break a multi-line string into lines (so that we show prefix on each line)
@@ -108,11 +189,13 @@ void MSG_LOG::vprintf_multiline(
     }
     const char* now_timestamp = precision_time_to_string(dtime());
     const char* skind = v_format_kind(kind);
+    char prefix[512];
 
     string line;
+    snprintf(prefix, sizeof(prefix), "%s %s%s ", now_timestamp, skind, spaces);
     while (*str) {
         if (*str == '\n') {
-            fprintf(output, "%s %s%s %s%s\n", now_timestamp, skind, spaces, sprefix, line.c_str());
+            emit(kind, prefix, (string(sprefix) + line + "\n").c_str());
             line.erase();
         } else {
             line += *str;
@@ -120,7 +203,8 @@ void MSG_LOG::vprintf_multiline(
         ++str;
     }
     if (!line.empty()) {
-        fprintf(output, "%s %s[%s] %s%s\n", now_timestamp, spaces, skind, sprefix, line.c_str());
+        snprintf(prefix, sizeof(prefix), "%s %s[%s] ", now_timestamp, spaces, skind);
+        emit(kind, prefix, (string(sprefix) + line + "\n").c_str());
     }
 }
 
@@ -135,6 +219,8 @@ void MSG_LOG::vprintf_file(
     }
     const char* now_timestamp = precision_time_to_string(dtime());
     const char* skind = v_format_kind(kind);
+    char prefix[512];
+    snprintf(prefix, sizeof(prefix), "%s %s%s ", now_timestamp, skind, spaces);
 
 #ifndef _USING_FCGI_
     FILE* f = fopen(filename, "r");
@@ -145,11 +231,195 @@ void MSG_LOG::vprintf_file(
     char buf[256];
 
     while (fgets(buf, 256, f)) {
-        fprintf(output, "%s %s%s %s%s\n", now_timestamp, skind, spaces, sprefix, buf);
+        emit(kind, prefix, (string(sprefix) + buf + "\n").c_str());
     }
     fclose(f);
 }
 
+#ifdef MSG_LOG_ASYNC
+
+#define WRITER_POLL_USEC    10000
+
+struct MSG_LOG_WRITER {
+    char* buf;
+    size_t size;
+
+    // byte counts since the start; positions in buf are these mod size
+    //
+    volatile size_t reserved;   // space claimed by loggers
+    volatile size_t committed;  // copied into buf, in order
+    volatile size_t written;    // written to the file
+
+    volatile bool stop;
+    FILE* out;
+    pthread_t thread;
+};
+
+// write what's been committed; return false if there was nothing
+//
+static bool writer_flush(MSG_LOG_WRITER* w) {
+    size_t c = w->committed;
+    __sync_synchronize();
+    size_t done = w->written;
+    if (c == done) return false;
+    while (done < c) {
+        size_t pos = done % w->size;
+        size_t n = c - done;
+        if (n > w->size - pos) n = w->size - pos;
+        fwrite(w->buf + pos, 1, n, w->out);
+        done += n;
+    }
+    fflush(w->out);
+    __sync_synchronize();
+    w->written = c;
+    return true;
+}
+
+static void* writer_thread(void* p) {
+    MSG_LOG_WRITER* w = (MSG_LOG_WRITER*)p;
+    while (1) {
+        if (!writer_flush(w)) {
+            if (w->stop) break;
+            usleep(WRITER_POLL_USEC);
+        }
+    }
+    return 0;
+}
+
+static void writer_put(MSG_LOG_WRITER* w, const char* p, size_t len) {
+    size_t start;
+
+    // a message too big for the buffer is truncated
+    //
+    if (len > w->size) len = w->size;
+
+    // reserve space, waiting if the buffer is full
+    //
+    while (1) {
+        start = w->reserved;
+        if (start + len - w->written > w->size) {
+            usleep(1000);
+            continue;
+        }
+        if (__sync_bool_compare_and_swap(&w->reserved, start, start+len)) {
+            break;
+        }
+    }
+
+    size_t pos = start % w->size;
+    size_t n = len;
+    if (n > w->size - pos) n = w->size - pos;
+    memcpy(w->buf + pos, p, n);
+    if (n < len) memcpy(w->buf, p + n, len - n);
+
+    // publish after the messages reserved before ours
+    //
+    while (w->committed != start) {
+        sched_yield();
+    }
+    __sync_synchronize();
+    w->committed = start + len;
+}
+
+static void writer_drain(MSG_LOG_WRITER* w) {
+    while (w->written != w->committed) {
+        usleep(1000);
+    }
+}
+
+static MSG_LOG* async_log = NULL;
+
+static void async_log_exit() {
+    if (async_log) async_log->stop_writer();
+}
+
+static void async_log_prepare_fork() {
+    if (async_log && async_log->writer) writer_drain(async_log->writer);
+}
+
+// the writer thread doesn't exist in the child; start one
+//
+static void async_log_child() {
+    MSG_LOG_WRITER* w = async_log?async_log->writer:NULL;
+    if (!w) return;
+    w->reserved = w->committed = w->written = 0;
+    if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+        async_log->writer = NULL;
+        free(w->buf);
+        delete w;
+    }
+}
+
+int MSG_LOG::start_writer(int buf_size) {
+    static bool registered = false;
+    if (writer) return 0;
+    if (async_log) return ERR_INVALID_PARAM;
+    if (buf_size < 4096) buf_size = 4096;
+    MSG_LOG_WRITER* w = new MSG_LOG_WRITER;
+    w->buf = (char*)malloc(buf_size);
+    if (!w->buf) {
+        delete w;
+        return ERR_MALLOC;
+    }
+    w->size = buf_size;
+    w->reserved = w->committed = w->written = 0;
+    w->stop = false;
+    w->out = output;
+    fflush(output);
+    if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+        free(w->buf);
+        delete w;
+        return ERR_THREAD;
+    }
+    writer = w;
+    async_log = this;
+    if (!registered) {
+        registered = true;
+        atexit(async_log_exit);
+        pthread_atfork(
+            async_log_prepare_fork, NULL, async_log_child
+        );
+    }
+    return 0;
+}
+
+// write what's in the buffer, and go back to writing directly
+//
+void MSG_LOG::stop_writer() {
+    MSG_LOG_WRITER* w = writer;
+    if (!w) return;
+    w->stop = true;
+    pthread_join(w->thread, NULL);
+    writer_flush(w);
+    writer = NULL;
+    async_log = NULL;
+    free(w->buf);
+    delete w;
+}
+
+void MSG_LOG::write(const char* p, size_t len) {
+    if (writer) {
+        writer_put(writer, p, len);
+        return;
+    }
+    fputs(p, output);
+}
+
+#else
+
+int MSG_LOG::start_writer(int) {
+    return ERR_NOT_IMPLEMENTED;
+}
+
+void MSG_LOG::stop_writer() {
+}
+
+void MSG_LOG::write(const char* p, size_t) {
+    fputs(p, output);
+}
+
+#endif
+
 void MSG_LOG::printf(int kind, const char* format, ...) {
     va_list va;
     va_start(va, format);
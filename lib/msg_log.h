@@ -39,6 +39,13 @@
 #undef printf
 #undef vprintf
 
+// a background thread that writes log records (see msg_log.cpp)
+//
+#if !defined(_WIN32) && !defined(_USING_FCGI_)
+#define MSG_LOG_ASYNC
+#endif
+struct MSG_LOG_WRITER;
+
 class MSG_LOG {
 public:
     int debug_level;
@@ -46,10 +53,28 @@ public:
     FILE* output;
     int indent_level;
     int pid;
+    bool json;
+        // write each message as a JSON object on one line:
+        // {"time":..., "pid":..., "kind":..., "request":..., "msg":...}
+    char request_id[64];
+        // if nonempty, included in JSON records
+    MSG_LOG_WRITER* writer;
+        // if non-NULL, messages go through this
 
     MSG_LOG(FILE* output);
     virtual ~MSG_LOG(){}
 
+    void set_request_id(const char*);
+
+    // Write messages to a ring buffer of the given size,
+    // from which a thread copies them to "output",
+    // so that callers don't wait for the file system.
+    // Only one MSG_LOG per process can do this.
+    // Buffered messages are written on exit(), and before fork().
+    //
+    int start_writer(int buf_size);
+    void stop_writer();
+
     void enter_level(int = 1);
     void leave_level() { enter_level(-1); }
     MSG_LOG& operator++() { enter_level(); return *this; }
@@ -63,6 +88,8 @@ public:
     void vprintf_file(int kind, const char* filename, const char* prefix_format, va_list va);
 
 protected:
+    void emit(int kind, const char* text_prefix, const char* msg);
+    void write(const char* p, size_t len);
 
     virtual const char* v_format_kind(int kind) const = 0;
     virtual bool v_message_wanted(int kind) const = 0;
@@ -0,0 +1,88 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A per-type pool for objects of which there may be many
+// (e.g. the client's RESULTs, WORKUNITs and FILE_INFOs).
+// Objects are allocated from blocks of OBJ_POOL_BLOCK_SIZE;
+// freed objects go on a free list and are reused.
+// This means fewer malloc()s, no per-object malloc overhead,
+// and objects allocated together are adjacent in memory,
+// so that scans of them touch fewer cache lines and pages.
+// Blocks aren't returned to the heap.
+//
+// To use it, give the class
+//
+//  static void* operator new(size_t n) {
+//      return OBJ_POOL<FOO>::alloc(n);
+//  }
+//  static void operator delete(void* p, size_t n) {
+//      OBJ_POOL<FOO>::free(p, n);
+//  }
+//
+// Not thread-safe.
+
+#ifndef BOINC_OBJ_POOL_H
+#define BOINC_OBJ_POOL_H
+
+#include <cstddef>
+#include <new>
+
+#define OBJ_POOL_BLOCK_SIZE     64
+
+template <class T> class OBJ_POOL {
+    union SLOT {
+        SLOT* next;
+        double align;
+        char data[sizeof(T)];
+    };
+    static SLOT* free_list;
+public:
+    static size_t nblocks;
+    static void* alloc(size_t n) {
+        // subclasses are bigger; they get memory from the heap
+        //
+        if (n != sizeof(T)) return ::operator new(n);
+        if (!free_list) {
+            SLOT* block = (SLOT*)::operator new(
+                OBJ_POOL_BLOCK_SIZE*sizeof(SLOT)
+            );
+            for (int i=OBJ_POOL_BLOCK_SIZE-1; i>=0; i--) {
+                block[i].next = free_list;
+                free_list = &block[i];
+            }
+            nblocks++;
+        }
+        SLOT* s = free_list;
+        free_list = s->next;
+        return s;
+    }
+    static void free(void* p, size_t n) {
+        if (!p) return;
+        if (n != sizeof(T)) {
+            ::operator delete(p);
+            return;
+        }
+        SLOT* s = (SLOT*)p;
+        s->next = free_list;
+        free_list = s;
+    }
+};
+
+template <class T> typename OBJ_POOL<T>::SLOT* OBJ_POOL<T>::free_list = 0;
+template <class T> size_t OBJ_POOL<T>::nblocks = 0;
+
+#endif
@@ -88,12 +88,14 @@ void OPENCL_DEVICE_PROP::write_xml(MIOFILE& f, const char* tag, bool temp_file)
             "      <device_num>%d</device_num>\n"
             "      <peak_flops>%f</peak_flops>\n"
             "      <opencl_available_ram>%f</opencl_available_ram>\n"
-            "      <opencl_device_index>%d</opencl_device_index>\n",
+            "      <opencl_device_index>%d</opencl_device_index>\n"
+            "      <opencl_platform_index>%d</opencl_platform_index>\n",
             is_used,
             device_num,
             peak_flops,
             opencl_available_ram,
-            opencl_device_index
+            opencl_device_index,
+            opencl_platform_index
         );
     }
     f.printf("   </%s>\n", tag);
@@ -196,6 +198,10 @@ int OPENCL_DEVICE_PROP::parse(XML_PARSER& xp, const char* end_tag) {
             opencl_device_index = n;
             continue;
         }
+        if (xp.parse_int("opencl_platform_index", n)) {
+            opencl_platform_index = n;
+            continue;
+        }
     }
     return ERR_XML_PARSE;
 }
@@ -64,6 +64,7 @@ struct OPENCL_DEVICE_PROP {
     COPROC_USAGE is_used;               // temp used in scan process
     double opencl_available_ram;        // temp used in scan process
     int opencl_device_index;            // temp used in scan process
+    int opencl_platform_index;          // temp used in scan process
 
     void write_xml(MIOFILE&, const char* tag, bool temp_file=false);
     int parse(XML_PARSER&, const char* end_tag);
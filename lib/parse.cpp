@@ -32,6 +32,8 @@
 #include <cstdlib>
 #include <string>
 #include <cmath>
+#include <cfloat>
+#include <clocale>
 #include <ctype.h>
 #include <errno.h>
 #if HAVE_IEEEFP_H
@@ -55,6 +57,157 @@
 
 using std::string;
 
+std::map<std::string, int> xml_unexpected_tag_counts;
+
+// Powers of 10 that are exact as doubles
+//
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+};
+
+// strtod() in the "C" locale.
+// If the locale's decimal point isn't '.',
+// copy the number, replacing '.' with the locale's.
+//
+static double strtod_c(const char* str, char** end) {
+    char buf[256], *e;
+    int i;
+
+    const char* dp = localeconv()->decimal_point;
+    if (!dp || !strcmp(dp, ".") || strlen(dp) != 1) {
+        return strtod(str, end);
+    }
+    for (i=0; i<(int)sizeof(buf)-1; i++) {
+        char c = str[i];
+        if (!c || c == '<') break;
+        buf[i] = (c == '.')?dp[0]:c;
+    }
+    buf[i] = 0;
+    double x = strtod(buf, &e);
+    if (end) *end = (char*)str + (e - buf);
+    return x;
+}
+
+// Numbers in XML are almost always of the form [-]ddd[.ddd][e[-]dd]
+// with at most 19 significant digits.
+// If the digits fit in 53 bits and the power of 10 is at most 22,
+// both are exact as doubles,
+// and a single multiply or divide gives the correctly rounded result
+// (Clinger's fast path).
+// Otherwise (and for hex, inf, nan etc.) use strtod().
+//
+double boinc_strtod(const char* str, char** end) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    const char* p = str;
+    unsigned long long mant = 0;
+    int ndigits = 0, nsig = 0, exp10 = 0;
+    bool neg = false;
+
+    while (isspace(*p)) p++;
+    if (*p == '-') {
+        neg = true;
+        p++;
+    } else if (*p == '+') {
+        p++;
+    }
+    while (isdigit(*p)) {
+        if (mant || *p != '0') {
+            if (++nsig > 19) return strtod_c(str, end);
+            mant = mant*10 + (*p - '0');
+        }
+        ndigits++;
+        p++;
+    }
+    if (*p == 'x' || *p == 'X') return strtod_c(str, end);
+    if (*p == '.') {
+        p++;
+        while (isdigit(*p)) {
+            if (mant || *p != '0') {
+                if (++nsig > 19) return strtod_c(str, end);
+                mant = mant*10 + (*p - '0');
+            }
+            exp10--;
+            ndigits++;
+            p++;
+        }
+    }
+    if (!ndigits) return strtod_c(str, end);
+    if (*p == 'e' || *p == 'E') {
+        const char* q = p+1;
+        bool eneg = false;
+        int e = 0;
+        if (*q == '-') {
+            eneg = true;
+            q++;
+        } else if (*q == '+') {
+            q++;
+        }
+        if (isdigit(*q)) {
+            while (isdigit(*q)) {
+                if (e > 10000) return strtod_c(str, end);
+                e = e*10 + (*q - '0');
+                q++;
+            }
+            exp10 += eneg?-e:e;
+            p = q;
+        }
+    }
+    double x;
+    if (!mant) {
+        x = 0;
+    } else if (mant <= (1ULL<<53) && exp10 >= -22 && exp10 <= 22) {
+        x = (double)mant;
+        if (exp10 < 0) {
+            x /= exact_pow10[-exp10];
+        } else {
+            x *= exact_pow10[exp10];
+        }
+    } else {
+        return strtod_c(str, end);
+    }
+    if (end) *end = (char*)p;
+    return neg?-x:x;
+#else
+    // with extended-precision arithmetic the fast path
+    // may round twice
+    //
+    return strtod_c(str, end);
+#endif
+}
+
+// Decimal integers of up to 9 digits can't overflow a long;
+// leave anything else (hex, octal, long numbers) to strtol()
+//
+long boinc_strtol(const char* str, char** end) {
+    const char* p = str;
+    long x = 0;
+    int ndigits = 0;
+    bool neg = false;
+
+    while (isspace(*p)) p++;
+    if (*p == '-') {
+        neg = true;
+        p++;
+    } else if (*p == '+') {
+        p++;
+    }
+    if (*p == '0') {
+        if (isdigit(p[1]) || p[1] == 'x' || p[1] == 'X') {
+            return strtol(str, end, 0);
+        }
+    }
+    while (isdigit(*p)) {
+        if (++ndigits > 9) return strtol(str, end, 0);
+        x = x*10 + (*p - '0');
+        p++;
+    }
+    if (!ndigits) return strtol(str, end, 0);
+    if (end) *end = (char*)p;
+    return neg?-x:x;
+}
+
 // Parse a boolean; tag is of form "foobar"
 // Accept either <foobar/>, <foobar />, or <foobar>0|1</foobar>
 // (possibly with leading/trailing white space)
@@ -540,22 +693,6 @@ int XML_PARSER::scan_cdata(char* buf, int len) {
     }
 }
 
-static inline bool is_empty_string(char* parsed_tag, const char* start_tag) {
-    size_t n = strlen(parsed_tag);
-    char tag[TAG_BUF_LEN];
-
-    // handle the archaic form <tag/>, which means empty string
-    //
-    if (parsed_tag[n-1] == '/') {
-        strcpy(tag, parsed_tag);
-        tag[n-1] = 0;
-        if (!strcmp(tag, start_tag)) {
-            return true;
-        }
-    }
-    return false;
-}
-
 // we've parsed the start tag of a string; parse the string itself.
 //
 bool XML_PARSER::parse_str_aux(const char* start_tag, char* buf, int len) {
@@ -598,11 +735,15 @@ bool XML_PARSER::parse_str_aux(const char* start_tag, char* buf, int len) {
 // and return true.
 //
 bool XML_PARSER::parse_str(const char* start_tag, char* buf, int len) {
-    if (is_empty_string(parsed_tag, start_tag)) {
+    switch (match_start(start_tag)) {
+    case MATCH_NONE:
+        return false;
+    case MATCH_EMPTY:
+        // handle the archaic form <tag/>, which means empty string
+        //
         strcpy(buf, "");
         return true;
     }
-    if (strcmp(parsed_tag, start_tag)) return false;
     return parse_str_aux(start_tag, buf, len);
 }
 
@@ -611,11 +752,13 @@ bool XML_PARSER::parse_str(const char* start_tag, char* buf, int len) {
 // same, for std::string
 //
 bool XML_PARSER::parse_string(const char* start_tag, string& str) {
-    if (is_empty_string(parsed_tag, start_tag)) {
+    switch (match_start(start_tag)) {
+    case MATCH_NONE:
+        return false;
+    case MATCH_EMPTY:
         str = "";
         return true;
     }
-    if (strcmp(parsed_tag, start_tag)) return false;
     char *buf=(char *)malloc(MAX_XML_STRING);
     bool flag = parse_str_aux(start_tag, buf, MAX_XML_STRING);
     if (flag) {
@@ -632,7 +775,7 @@ bool XML_PARSER::parse_int(const char* start_tag, int& i) {
     bool eof;
     char end_tag[TAG_BUF_LEN], tag[TAG_BUF_LEN];
 
-    if (strcmp(parsed_tag, start_tag)) return false;
+    if (match_start(start_tag) != MATCH_TAG) return false;
 
     end_tag[0] = '/';
     strcpy(end_tag+1, start_tag);
@@ -648,7 +791,7 @@ bool XML_PARSER::parse_int(const char* start_tag, int& i) {
         }
     }
     errno = 0;
-    int val = strtol(buf, &end, 0);
+    int val = boinc_strtol(buf, &end);
     if (errno) return false;
     if (end != buf+strlen(buf)) return false;
 
@@ -667,7 +810,7 @@ bool XML_PARSER::parse_double(const char* start_tag, double& x) {
     bool eof;
     char end_tag[TAG_BUF_LEN], tag[TAG_BUF_LEN];
 
-    if (strcmp(parsed_tag, start_tag)) return false;
+    if (match_start(start_tag) != MATCH_TAG) return false;
 
     end_tag[0] = '/';
     strcpy(end_tag+1, start_tag);
@@ -683,7 +826,7 @@ bool XML_PARSER::parse_double(const char* start_tag, double& x) {
         }
     }
     errno = 0;
-    double val = strtod(buf, &end);
+    double val = boinc_strtod(buf, &end);
     if (errno) return false;
     if (end != buf+strlen(buf)) return false;
 
@@ -702,7 +845,7 @@ bool XML_PARSER::parse_ulong(const char* start_tag, unsigned long& x) {
     bool eof;
     char end_tag[TAG_BUF_LEN], tag[TAG_BUF_LEN];
 
-    if (strcmp(parsed_tag, start_tag)) return false;
+    if (match_start(start_tag) != MATCH_TAG) return false;
 
     end_tag[0] = '/';
     strcpy(end_tag+1, start_tag);
@@ -737,7 +880,7 @@ bool XML_PARSER::parse_ulonglong(const char* start_tag, unsigned long long& x) {
     bool eof;
     char end_tag[TAG_BUF_LEN], tag[TAG_BUF_LEN];
 
-    if (strcmp(parsed_tag, start_tag)) return false;
+    if (match_start(start_tag) != MATCH_TAG) return false;
 
     end_tag[0] = '/';
     strcpy(end_tag+1, start_tag);
@@ -772,18 +915,18 @@ bool XML_PARSER::parse_bool(const char* start_tag, bool& b) {
     bool eof;
     char end_tag[TAG_BUF_LEN], tag[TAG_BUF_LEN];
 
-    // handle the archaic form <tag/>, which means true
-    //
-    strcpy(tag, start_tag);
-    strcat(tag, "/");
-    if (!strcmp(parsed_tag, tag)) {
+    switch (match_start(start_tag)) {
+    case MATCH_NONE:
+        return false;
+    case MATCH_EMPTY:
+        // handle the archaic form <tag/>, which means true
+        //
         b = true;
         return true;
     }
 
     // otherwise look for something of the form <tag>int</tag>
     //
-    if (strcmp(parsed_tag, start_tag)) return false;
 
     eof = get(buf, sizeof(buf), is_tag);
     if (eof) return false;
@@ -830,8 +973,6 @@ bool XML_PARSER::parse_start(const char* start_tag) {
 void XML_PARSER::skip_unexpected(
     const char* start_tag, bool verbose, const char* where
 ) {
-    char buf[TAG_BUF_LEN], end_tag[TAG_BUF_LEN];
-
     if (verbose) {
         fprintf(stderr,
             "Unrecognized XML tag '<%s>' in %s; skipping\n",
@@ -839,6 +980,16 @@ void XML_PARSER::skip_unexpected(
         );
     }
     if (strchr(start_tag, '/')) return;
+    xml_unexpected_tag_counts[start_tag]++;
+    skip_element(start_tag);
+}
+
+// skip until the end tag for the given start tag,
+// skipping nested elements
+//
+void XML_PARSER::skip_element(const char* start_tag) {
+    char buf[TAG_BUF_LEN], end_tag[TAG_BUF_LEN];
+
     sprintf(end_tag, "/%s", start_tag);
 
     while (1) {
@@ -849,7 +1000,8 @@ void XML_PARSER::skip_unexpected(
             int retval = scan_tag(buf, sizeof(buf), 0, 0);
             if (retval != XML_PARSE_TAG) continue;
             if (!strcmp(buf, end_tag)) return;
-            skip_unexpected(buf, false, where);
+            if (strchr(buf, '/')) continue;
+            skip_element(buf);
         }
     }
 }
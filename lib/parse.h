@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <map>
+#include <string>
 
 #include "miofile.h"
 #include "error_numbers.h"
@@ -54,6 +56,8 @@ struct XML_PARSER {
     //
     inline int copy_until_tag(char* buf, int len) {
         int c;
+        const char* p = f->read_buf();
+        if (p) return copy_until_tag_mem(p, buf, len);
         while (1) {
             c = f->_getc();
             if (!c || c == EOF) return XML_PARSE_EOF;
@@ -69,6 +73,26 @@ struct XML_PARSER {
         }
     }
 
+    // same, when parsing from memory.
+    // Find the < with strchr() (vectorized in most C libraries)
+    // and copy the text in one piece.
+    //
+    inline int copy_until_tag_mem(const char* p, char* buf, int len) {
+        const char* q = strchr(p, '<');
+        size_t n = q ? (size_t)(q - p) : strlen(p);
+        if (len <= 0) return XML_PARSE_OVERFLOW;
+        if (n >= (size_t)len) {
+            memcpy(buf, p, len-1);
+            f->advance(len);
+            return XML_PARSE_OVERFLOW;
+        }
+        memcpy(buf, p, n);
+        f->advance(n);
+        if (!q) return XML_PARSE_EOF;
+        buf[n] = 0;
+        return XML_PARSE_DATA;
+    }
+
     // return true if EOF or error
     //
     inline bool get(
@@ -100,15 +124,46 @@ struct XML_PARSER {
         return false;
     }
     inline bool match_tag(const char* tag) {
+        if (parsed_tag[0] != tag[0]) return false;
         return !strcmp(parsed_tag, tag);
     }
 
+    // compare parsed_tag with the given tag name in one pass.
+    // Return 0 if no match, MATCH_TAG if <tag>, MATCH_EMPTY if <tag/>.
+    // The first-char test rejects most candidates in a match chain
+    //
+    enum {MATCH_NONE=0, MATCH_TAG, MATCH_EMPTY};
+    inline int match_start(const char* tag) {
+        if (parsed_tag[0] != tag[0]) return MATCH_NONE;
+        const char* p = parsed_tag;
+        while (*tag && *p == *tag) {
+            p++;
+            tag++;
+        }
+        if (*tag) return MATCH_NONE;
+        if (!*p) return MATCH_TAG;
+        if (p[0] == '/' && !p[1]) return MATCH_EMPTY;
+        return MATCH_NONE;
+    }
+
     // read until find non-whitespace char.
     // Return the char in the reference param
     // Return true iff reached EOF
     //
     inline bool scan_nonws(int& first_char) {
         int c;
+        const char* p = f->read_buf();
+        if (p) {
+            const char* q = p;
+            while (*q && isascii(*q) && isspace(*q)) q++;
+            if (!*q) {
+                f->advance(q - p);
+                return true;
+            }
+            first_char = *q;
+            f->advance(q - p + 1);
+            return false;
+        }
         while (1) {
             c = f->_getc();
             if (!c || c == EOF) return true;
@@ -222,6 +277,8 @@ struct XML_PARSER {
     inline int element_contents(const char* end_tag, char* buf, int buflen) {
         int n=0;
         int retval=0;
+        const char* p = f->read_buf();
+        if (p) return element_contents_mem(p, end_tag, buf, buflen);
         while (1) {
             if (n == buflen-1) {
                 retval = ERR_XML_PARSE;
@@ -244,6 +301,31 @@ struct XML_PARSER {
         strip_whitespace(buf);
         return retval;
     }
+
+    // same, when parsing from memory: find the end tag with strstr()
+    // rather than re-searching the output after each char
+    //
+    inline int element_contents_mem(
+        const char* p, const char* end_tag, char* buf, int buflen
+    ) {
+        const char* q = strstr(p, end_tag);
+        size_t n = q ? (size_t)(q - p) : strlen(p);
+        size_t m = q ? n + strlen(end_tag) : n;
+        if (buflen <= 0) return ERR_XML_PARSE;
+        if (q && m <= (size_t)(buflen-1)) {
+            memcpy(buf, p, n);
+            buf[n] = 0;
+            f->advance(m);
+            strip_whitespace(buf);
+            return 0;
+        }
+        if (m > (size_t)(buflen-1)) m = buflen-1;
+        memcpy(buf, p, m);
+        buf[m] = 0;
+        f->advance(m);
+        strip_whitespace(buf);
+        return ERR_XML_PARSE;
+    }
     bool parse_str_aux(const char*, char*, int);
 
     // interface starts here
@@ -258,13 +340,25 @@ struct XML_PARSER {
     bool parse_bool(const char*, bool&);
     int copy_element(std::string&);
     void skip_unexpected(const char*, bool verbose, const char*);
+    void skip_element(const char*);
     void skip_unexpected(bool verbose=false, const char* msg="") {
         skip_unexpected(parsed_tag, verbose, msg);
     }
 };
 
+// number of times each unrecognized tag was passed to skip_unexpected().
+// Lets long-running programs report fields they don't know about
+//
+extern std::map<std::string, int> xml_unexpected_tag_counts;
+
 extern bool boinc_is_finite(double);
 
+// Like strtod() and strtol(..., 0), but independent of locale,
+// and (for plain decimal numbers, the usual case) faster
+//
+extern double boinc_strtod(const char*, char** end);
+extern long boinc_strtol(const char*, char** end);
+
 /////////////// START DEPRECATED XML PARSER
 // Deprecated because it makes assumptions about
 // the format of the XML being parsed
@@ -313,7 +407,7 @@ inline bool parse_int(const char* buf, const char* tag, int& x) {
     const char* p = strstr(buf, tag);
     if (!p) return false;
     errno = 0;
-    int y = strtol(p+strlen(tag), 0, 0);        // this parses 0xabcd correctly
+    int y = boinc_strtol(p+strlen(tag), 0);     // this parses 0xabcd correctly
     if (errno) return false;
     x = y;
     return true;
@@ -326,7 +420,7 @@ inline bool parse_double(const char* buf, const char* tag, double& x) {
     const char* p = strstr(buf, tag);
     if (!p) return false;
     errno = 0;
-    y = strtod(p+strlen(tag), NULL);
+    y = boinc_strtod(p+strlen(tag), NULL);
     if (errno) return false;
     if (!boinc_is_finite(y)) {
         return false;
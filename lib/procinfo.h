@@ -79,4 +79,17 @@ extern void procinfo_non_boinc(PROCINFO&, PROC_MAP&);
 extern double process_tree_cpu_time(int pid);
     // get the CPU time of the given process and its descendants
 
+#ifdef __linux__
+extern int procinfo_setup_tasks(PROC_MAP&, std::vector<int>& pids);
+    // like procinfo_setup(), but get only the given processes
+    // and their descendants.
+    // Returns ERR_NOT_FOUND if the kernel doesn't support this.
+
+extern int procinfo_non_boinc_tasks(PROCINFO&, PROC_MAP&);
+    // like procinfo_non_boinc(), for a map from procinfo_setup_tasks()
+
+extern int procinfo_cgroup_memory(int pid, PROC_MAP&, double& mem);
+    // get memory usage of a process tree that has its own cgroup
+#endif
+
 #endif
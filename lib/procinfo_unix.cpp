@@ -31,6 +31,7 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <string.h>
 #include <sys/param.h>
 #include <ctype.h>
@@ -162,6 +163,44 @@ int PROC_STAT::parse(char* buf) {
     return 1;
 }
 
+#if !defined(HAVE_PROCFS_H) || !defined(HAVE__PROC_SELF_PSINFO)
+// parse /proc/PID/stat into a PROCINFO
+//
+static int read_proc_stat(
+    const char* path, PROC_STAT& ps, PROCINFO& p, int boinc_pid
+) {
+    char buf[1024];
+    int retval;
+
+    FILE* fd = fopen(path, "r");
+    if (!fd) return ERR_FOPEN;
+    if (fgets(buf, sizeof(buf), fd) == NULL) {
+        retval = ERR_NULL;
+    } else {
+        retval = ps.parse(buf);
+    }
+    fclose(fd);
+    if (retval) return retval;
+
+    p.clear();
+    p.id = ps.pid;
+    p.parentid = ps.ppid;
+    p.swap_size = ps.vsize;
+    // rss = pages, need bytes
+    // assumes page size = 4k
+    p.working_set_size = ps.rss * (float)getpagesize();
+    // page faults: I/O + non I/O
+    p.page_fault_count = ps.majflt + ps.minflt;
+    // times are in jiffies, need seconds
+    // assumes 100 jiffies per second
+    p.user_time = ps.utime / 100.;
+    p.kernel_time = ps.stime / 100.;
+    strlcpy(p.command, ps.comm, sizeof(p.command));
+    p.is_boinc_app = (p.id == boinc_pid || strcasestr(p.command, "boinc"));
+    return 0;
+}
+#endif
+
 // build table of all processes in system
 //
 int procinfo_setup(PROC_MAP& pm) {
@@ -169,10 +208,12 @@ int procinfo_setup(PROC_MAP& pm) {
 #if HAVE_DIRENT_H
     DIR *dir;
     dirent *piddir;
+#if defined(HAVE_PROCFS_H) && defined(HAVE__PROC_SELF_PSINFO)
     FILE* fd;
+#else
     PROC_STAT ps;
+#endif
     char pidpath[MAXPATHLEN];
-    char buf[1024];
     int pid = getpid();
     int retval, final_retval = 0;
 
@@ -216,35 +257,12 @@ int procinfo_setup(PROC_MAP& pm) {
         pm.insert(std::pair(p.id, p));
 #else  // linux
         sprintf(pidpath, "/proc/%s/stat", piddir->d_name);
-        fd = fopen(pidpath, "r");
-        if (!fd) continue;
-        if (fgets(buf, sizeof(buf), fd) == NULL) {
-            retval = ERR_NULL;
-        } else {
-            retval = ps.parse(buf);
-        }
-        fclose(fd);
-
+        PROCINFO p;
+        retval = read_proc_stat(pidpath, ps, p, pid);
         if (retval) {
-            final_retval = retval;
+            if (retval != ERR_FOPEN) final_retval = retval;
             continue;
         }
-        PROCINFO p;
-        p.clear();
-        p.id = ps.pid;
-        p.parentid = ps.ppid;
-        p.swap_size = ps.vsize;
-        // rss = pages, need bytes
-        // assumes page size = 4k
-        p.working_set_size = ps.rss * (float)getpagesize();
-        // page faults: I/O + non I/O
-        p.page_fault_count = ps.majflt + ps.minflt;
-        // times are in jiffies, need seconds
-        // assumes 100 jiffies per second
-        p.user_time = ps.utime / 100.;
-        p.kernel_time = ps.stime / 100.;
-        strlcpy(p.command, ps.comm, sizeof(p.command));
-        p.is_boinc_app = (p.id == pid || strcasestr(p.command, "boinc"));
         p.is_low_priority = (ps.priority == 39);
             // Linux seems to add 20 here,
             // but this isn't documented anywhere
@@ -257,3 +275,176 @@ int procinfo_setup(PROC_MAP& pm) {
     return final_retval;
 
 }
+
+#ifdef __linux__
+
+// Linux: get the processes with the given PIDs
+// and all their descendants, without scanning all of /proc.
+//
+// The children of a process are listed in
+// /proc/PID/task/TID/children (one file per thread);
+// this needs Linux 3.5 or later with CONFIG_PROC_CHILDREN.
+// If it's missing, return ERR_NOT_FOUND;
+// the caller should use procinfo_setup() instead.
+//
+// is_low_priority is set for processes with nice > 0,
+// to match what /proc/stat counts as "nice" time;
+// see procinfo_non_boinc_tasks().
+//
+int procinfo_setup_tasks(PROC_MAP& pm, vector<int>& pids) {
+    static int have_children_file = -1;
+    char path[MAXPATHLEN];
+    PROC_STAT ps;
+    int mypid = getpid();
+    int retval, final_retval = 0;
+    unsigned int i;
+
+    if (have_children_file < 0) {
+        sprintf(path, "/proc/%d/task/%d/children", mypid, mypid);
+        have_children_file = boinc_file_exists(path)?1:0;
+    }
+    if (!have_children_file) return ERR_NOT_FOUND;
+
+    vector<int> todo = pids;
+    for (i=0; i<todo.size(); i++) {
+        int pid = todo[i];
+        if (pm.find(pid) != pm.end()) continue;
+        sprintf(path, "/proc/%d/stat", pid);
+        PROCINFO p;
+        retval = read_proc_stat(path, ps, p, mypid);
+        if (retval) {
+            if (retval != ERR_FOPEN) final_retval = retval;
+            continue;
+        }
+        p.is_low_priority = (ps.nice > 0);
+        pm.insert(std::pair<int, PROCINFO>(p.id, p));
+
+        sprintf(path, "/proc/%d/task", pid);
+        DIR* dir = opendir(path);
+        if (!dir) continue;
+        while (1) {
+            dirent* tdir = readdir(dir);
+            if (!tdir) break;
+            if (!isdigit(tdir->d_name[0])) continue;
+            sprintf(path, "/proc/%d/task/%s/children", pid, tdir->d_name);
+            FILE* f = fopen(path, "r");
+            if (!f) continue;
+            int child;
+            while (fscanf(f, "%d", &child) == 1) {
+                todo.push_back(child);
+            }
+            fclose(f);
+        }
+        closedir(dir);
+    }
+    find_children(pm);
+    return final_retval;
+}
+
+// Linux: get the CPU time of non-BOINC processes,
+// given a PROC_MAP from procinfo_setup_tasks().
+// This is the system-wide user and system time from /proc/stat,
+// which excludes processes with nice > 0,
+// minus that of the non-niced processes in the map.
+//
+int procinfo_non_boinc_tasks(PROCINFO& procinfo, PROC_MAP& pm) {
+    unsigned long long user, nice, system;
+
+    procinfo.clear();
+    FILE* f = fopen("/proc/stat", "r");
+    if (!f) return ERR_FOPEN;
+    int n = fscanf(f, "cpu %llu %llu %llu", &user, &nice, &system);
+    fclose(f);
+    if (n != 3) return ERR_XML_PARSE;
+
+    // jiffies; assumes 100 per second as above
+    //
+    procinfo.user_time = user/100.;
+    procinfo.kernel_time = system/100.;
+    PROC_MAP::iterator i;
+    for (i=pm.begin(); i!=pm.end(); i++) {
+        PROCINFO& p = i->second;
+        if (p.is_low_priority) continue;
+        procinfo.user_time -= p.user_time;
+        procinfo.kernel_time -= p.kernel_time;
+    }
+    if (procinfo.user_time < 0) procinfo.user_time = 0;
+    if (procinfo.kernel_time < 0) procinfo.kernel_time = 0;
+    return 0;
+}
+
+// read the first line of a file into a string, without the newline
+//
+static int read_line(const char* path, char* buf, int len) {
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    char* p = fgets(buf, len, f);
+    fclose(f);
+    if (!p) return ERR_NULL;
+    strip_whitespace(buf);
+    return 0;
+}
+
+// get the cgroup v2 path of a process
+//
+static int cgroup_path(int pid, char* buf, int len) {
+    char path[MAXPATHLEN], line[MAXPATHLEN];
+    sprintf(path, "/proc/%d/cgroup", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    int retval = ERR_NOT_FOUND;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3)) continue;
+        strip_whitespace(line);
+        strlcpy(buf, line+3, len);
+        retval = 0;
+        break;
+    }
+    fclose(f);
+    return retval;
+}
+
+// Linux: if the given process is in a cgroup (v2) of its own,
+// i.e. not the client's, and containing only that process
+// and its descendants, get the cgroup's memory.current.
+// This includes page cache, and is more accurate than summing RSS.
+//
+int procinfo_cgroup_memory(int pid, PROC_MAP& pm, double& mem) {
+    char my_cg[MAXPATHLEN], cg[MAXPATHLEN], path[MAXPATHLEN], buf[256];
+    int retval;
+
+    retval = cgroup_path(pid, cg, sizeof(cg));
+    if (retval) return retval;
+    retval = cgroup_path(getpid(), my_cg, sizeof(my_cg));
+    if (retval) return retval;
+    if (!strcmp(cg, my_cg)) return ERR_NOT_FOUND;
+
+    snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cgroup.procs", cg);
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    int q;
+    retval = 0;
+    while (!retval && fscanf(f, "%d", &q) == 1) {
+        // walk up to pid
+        //
+        int depth = 0;
+        while (q != pid) {
+            PROC_MAP::iterator i = pm.find(q);
+            if (i == pm.end() || ++depth > 100) {
+                retval = ERR_NOT_FOUND;
+                break;
+            }
+            q = i->second.parentid;
+        }
+    }
+    fclose(f);
+    if (retval) return retval;
+
+    snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.current", cg);
+    retval = read_line(path, buf, sizeof(buf));
+    if (retval) return retval;
+    mem = atof(buf);
+    return 0;
+}
+
+#endif
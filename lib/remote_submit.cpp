@@ -22,6 +22,7 @@
 // http://boinc.berkeley.edu/trac/wiki/RemoteJobs
 
 #include <curl/curl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <vector>
 #include <string>
@@ -38,6 +39,34 @@ using std::string;
 
 //#define SHOW_REPLY
 
+// Each thread keeps a curl handle for its requests,
+// so that successive requests reuse the connection to the server
+// rather than making a new one (and doing the TLS handshake) each time.
+//
+static pthread_key_t curl_key;
+static pthread_once_t curl_key_once = PTHREAD_ONCE_INIT;
+
+static void free_curl(void* p) {
+    curl_easy_cleanup((CURL*)p);
+}
+
+static void make_curl_key() {
+    pthread_key_create(&curl_key, free_curl);
+}
+
+static CURL* get_curl() {
+    pthread_once(&curl_key_once, make_curl_key);
+    CURL* curl = (CURL*)pthread_getspecific(curl_key);
+    if (curl) {
+        // clears the options, but not the connection cache
+        curl_easy_reset(curl);
+        return curl;
+    }
+    curl = curl_easy_init();
+    if (curl) pthread_setspecific(curl_key, curl);
+    return curl;
+}
+
 // do an HTTP GET request.
 //
 static int do_http_get(
@@ -46,7 +75,7 @@ static int do_http_get(
 ) {
     FILE* reply = fopen(dst_path, "w");
     if (!reply) return -1;
-    CURL *curl = curl_easy_init();
+    CURL *curl = get_curl();
     if (!curl) {
         fclose(reply);
         return -1;
@@ -60,7 +89,6 @@ static int do_http_get(
         fprintf(stderr, "CURL error: %s\n", curl_easy_strerror(res));
     }
 
-    curl_easy_cleanup(curl);
     fclose(reply);
     return 0;
 }
@@ -78,7 +106,7 @@ static int do_http_post(
     CURLcode res;
     char buf[256];
      
-    curl = curl_easy_init();
+    curl = get_curl();
     if (!curl) {
         return -1;
     }
@@ -106,6 +134,7 @@ static int do_http_post(
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "BOINC Condor adapter");
     curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerlist);
     curl_easy_setopt(curl, CURLOPT_READDATA, request);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, reply);
 
@@ -114,7 +143,6 @@ static int do_http_post(
         fprintf(stderr, "CURL error: %s\n", curl_easy_strerror(res));
     }
 
-    curl_easy_cleanup(curl);
     curl_formfree(formpost);
     curl_slist_free_all(headerlist);
     return 0;
@@ -333,11 +333,14 @@ int create_shmem_mmap(const char *path, size_t size, void** pp) {
         return ERR_SHMGET;
     }
     if (sbuf.st_size < (long)size) {
-        // The following 2 lines extend the file and clear its new 
-        // area to all zeros because they write beyond the old EOF. 
-        // See the lseek man page for details.
-        lseek(fd, size-1, SEEK_SET);
-        write(fd, "\0", 1);
+        // extend the file; the new area is zeros.
+        // Use ftruncate() rather than writing at the end,
+        // since files on hugetlbfs can't be written
+        //
+        if (ftruncate(fd, size)) {
+            close(fd);
+            return ERR_SHMGET;
+        }
     }
 
     *pp = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED, fd, 0);
@@ -397,7 +400,7 @@ int detach_shmem_mmap(void* p, size_t size) {
 
 // Compatibility routines for Unix/Linux/Mac V5 applications 
 //
-int create_shmem(key_t key, int size, gid_t gid, void** pp) {
+static int create_shmem_aux(key_t key, int size, gid_t gid, int flags, void** pp) {
     int id;
     
     // try 0666, then SHM_R|SHM_W
@@ -412,9 +415,9 @@ int create_shmem(key_t key, int size, gid_t gid, void** pp) {
     // it's a big headache for anyone it affects,
     // and it's not a significant security issue.
     //
-    id = shmget(key, size, IPC_CREAT|0666);
+    id = shmget(key, size, IPC_CREAT|0666|flags);
     if (id < 0) {
-        id = shmget(key, size, IPC_CREAT|SHM_R|SHM_W);
+        id = shmget(key, size, IPC_CREAT|SHM_R|SHM_W|flags);
     }
     if (id < 0) {
         perror("shmget");
@@ -442,6 +445,22 @@ int create_shmem(key_t key, int size, gid_t gid, void** pp) {
     return attach_shmem(key, pp);
 }
 
+int create_shmem(key_t key, int size, gid_t gid, void** pp) {
+    return create_shmem_aux(key, size, gid, 0, pp);
+}
+
+// same, but use huge pages (Linux only).
+// size must be a multiple of the huge page size,
+// and the system must have enough huge pages reserved
+//
+int create_shmem_huge(key_t key, int size, gid_t gid, void** pp) {
+#ifdef SHM_HUGETLB
+    return create_shmem_aux(key, size, gid, SHM_HUGETLB, pp);
+#else
+    return ERR_SHMGET;
+#endif
+}
+
 // Mark the shared memory segment so it will be released after 
 // the last attached process detaches or exits.
 // On Mac OS X and some other systems, not doing this causes 
@@ -520,6 +539,10 @@ int create_shmem(key_t, int size, gid_t gid, void**) {
    perror("create_shmem: not supported on this platform");
    return ERR_SHMGET;
 }
+int create_shmem_huge(key_t, int size, gid_t gid, void**) {
+   perror("create_shmem_huge: not supported on this platform");
+   return ERR_SHMGET;
+}
 int attach_shmem(key_t, void**) {
    perror("attach_shmem: not supported on this platform");
    return ERR_SHMGET;
@@ -47,6 +47,8 @@ extern int attach_shmem_mmap(const char *path, void** pp);
 extern int detach_shmem_mmap(void* p, size_t size);
 #endif
 extern int create_shmem(key_t, int size, gid_t gid, void**);
+extern int create_shmem_huge(key_t, int size, gid_t gid, void**);
+    // same, but use huge pages (Linux only)
 extern int attach_shmem(key_t, void**);
 extern int detach_shmem(void*);
 extern int shmem_info(key_t key);
@@ -27,6 +27,7 @@
 #ifndef _WIN32
 #include "config.h"
 #include <string>
+#include <set>
 #include <cmath>
 #include <string.h>
 #include <time.h>
@@ -329,6 +330,33 @@ void strip_whitespace(string& str) {
     str.erase(n, str.length()-n);
 }
 
+const char* intern_string(const char* s) {
+    static std::set<string> strings;
+    return strings.insert(string(s)).first->c_str();
+}
+
+// append p to out, escaped for use in a JSON string
+//
+void json_escape(const char* p, string& out) {
+    char buf[8];
+    for (; *p; p++) {
+        unsigned char c = *p;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                sprintf(buf, "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+}
+
 char* time_to_string(double t) {
     static char buf[100];
     if (!t) {
@@ -28,6 +28,11 @@ extern int parse_command_line(char*, char**);
 extern void c2x(char *what);
 extern void strip_whitespace(char *str);
 extern void strip_whitespace(std::string&);
+extern const char* intern_string(const char*);
+    // return a copy of the string that's shared by all callers
+    // with the same string, and never freed.
+    // Use for strings that many objects have (e.g. platform names)
+extern void json_escape(const char*, std::string& out);
 extern char* time_to_string(double);
 extern char* precision_time_to_string(double);
 extern void secs_to_hmsf(double, char*);
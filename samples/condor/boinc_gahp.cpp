@@ -20,12 +20,21 @@
 // Notes:
 // - This is currently Unix-only (mostly because of its use of pthreads)
 //   but with some work it could be made to run on Windows
+// - Commands are done by a fixed pool of threads (--nthreads, default 8).
+//   Each thread reuses its connection to the server (see remote_submit.cpp).
+// - BOINC_QUERY_BATCHES commands that are queued at about the same time
+//   (within --batch_window seconds, default 0.1) are done with one RPC.
+// - The server's submit RPC handles one batch, so BOINC_SUBMIT commands
+//   can't be combined; but they check an app's templates only
+//   once per TEMPLATE_CHECK_PERIOD.
 
 #include <stdio.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
@@ -35,6 +44,7 @@
 #include "parse.h"
 #include "remote_submit.h"
 
+using std::deque;
 using std::map;
 using std::pair;
 using std::set;
@@ -59,6 +69,11 @@ bool debug_mode = false;
     // if set, handle commands synchronously rather than
     // handling them in separate threads
 
+int nthreads = 8;
+double batch_window = 0.1;
+
+#define TEMPLATE_CHECK_PERIOD   60
+
 struct SUBMIT_REQ {
     char batch_name[256];
     char app_name[256];
@@ -103,13 +118,25 @@ struct COMMAND {
 
 vector<COMMAND*> commands;
 
+// commands not started yet; the worker threads take them from here
+//
+deque<COMMAND*> command_queue;
+pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+// when we last got the templates of each app
+//
+map<string, double> template_check_times;
+pthread_mutex_t template_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 int compute_md5(string path, LOCAL_FILE& f) {
     return md5_file(path.c_str(), f.md5, f.nbytes);
 }
 
-const char *escape_str(const string &str) {
-	static string out;
-	out = "";
+// (returns a string; this is called from several threads)
+//
+string escape_str(const string &str) {
+	string out;
 	for (const char *ptr = str.c_str(); *ptr; ptr++) {
 		switch ( *ptr ) {
 		case ' ':
@@ -121,7 +148,7 @@ const char *escape_str(const string &str) {
 			out += *ptr;
 		}
 	}
-	return out.c_str();
+	return out;
 }
 
 // Get a list of the input files used by the batch.
@@ -254,14 +281,25 @@ void handle_submit(COMMAND& c) {
     string error_msg, s;
     char buf[1024];
 
-    retval = get_templates(
-        project_url, authenticator, req.app_name, NULL, td, error_msg
-    );
-    if (retval) {
-        sprintf(buf, "error\\ getting\\ templates:\\ %d\\ ", retval);
-        s = string(buf) + escape_str(error_msg);
-        c.out = strdup(s.c_str());
-        return;
+    // this checks that the app exists;
+    // a burst of submits for an app needs to do it only once
+    //
+    pthread_mutex_lock(&template_mutex);
+    double t = template_check_times[req.app_name];
+    pthread_mutex_unlock(&template_mutex);
+    if (time(0) > t + TEMPLATE_CHECK_PERIOD) {
+        retval = get_templates(
+            project_url, authenticator, req.app_name, NULL, td, error_msg
+        );
+        if (retval) {
+            sprintf(buf, "error\\ getting\\ templates:\\ %d\\ ", retval);
+            s = string(buf) + escape_str(error_msg);
+            c.out = strdup(s.c_str());
+            return;
+        }
+        pthread_mutex_lock(&template_mutex);
+        template_check_times[req.app_name] = time(0);
+        pthread_mutex_unlock(&template_mutex);
     }
     double expire_time = time(0) + 3600;
     retval = create_batch(
@@ -304,31 +342,67 @@ int COMMAND::parse_query_batches(char* p) {
     return 0;
 }
 
-void handle_query_batches(COMMAND&c) {
+// do a set of query commands with one RPC,
+// for the union of their batches
+//
+void handle_query_batches(vector<COMMAND*>& cmds) {
     QUERY_BATCH_SET_REPLY reply;
     char buf[256];
     string error_msg, s;
+    vector<string> names;
+    map<string, pair<int, int> > batch_jobs;
+        // batch name -> index of its first job in reply.jobs, number of jobs
+    unsigned int i, j;
+    int k, n;
+
+    for (i=0; i<cmds.size(); i++) {
+        for (j=0; j<cmds[i]->batch_names.size(); j++) {
+            string& name = cmds[i]->batch_names[j];
+            if (batch_jobs.count(name)) continue;
+            batch_jobs[name] = pair<int, int>(0, 0);
+            names.push_back(name);
+        }
+    }
     int retval = query_batch_set(
-        project_url, authenticator, c.batch_names, reply, error_msg
+        project_url, authenticator, names, reply, error_msg
     );
+    if (!retval) {
+        k = 0;
+        for (i=0; i<reply.batch_sizes.size() && i<names.size(); i++) {
+            batch_jobs[names[i]] = pair<int, int>(k, reply.batch_sizes[i]);
+            k += reply.batch_sizes[i];
+        }
+        if (reply.batch_sizes.size() != names.size() || k > (int)reply.jobs.size()) {
+            retval = -1;
+            error_msg = "bad reply";
+        }
+    }
     if (retval) {
         sprintf(buf, "error\\ querying\\ batch:\\ %d\\ ", retval);
         s = string(buf) + escape_str(error_msg);
-    } else {
+        for (i=0; i<cmds.size(); i++) {
+            cmds[i]->out = strdup(s.c_str());
+        }
+        return;
+    }
+
+    // the main thread may delete a command once its output is set
+    //
+    for (i=0; i<cmds.size(); i++) {
         s = string("NULL");
-        int i = 0;
-        for (unsigned int j=0; j<reply.batch_sizes.size(); j++) {
-            int n = reply.batch_sizes[j];
+        for (j=0; j<cmds[i]->batch_names.size(); j++) {
+            pair<int, int>& p = batch_jobs[cmds[i]->batch_names[j]];
+            n = p.second;
             sprintf(buf, " %d", n);
             s += string(buf);
-            for (int k=0; k<n; k++) {
-                JOB_STATUS &j = reply.jobs[i++];
-                sprintf(buf, " %s %s", j.job_name.c_str(), j.status.c_str());
+            for (k=0; k<n; k++) {
+                JOB_STATUS &js = reply.jobs[p.first + k];
+                sprintf(buf, " %s %s", js.job_name.c_str(), js.status.c_str());
                 s += string(buf);
             }
         }
+        cmds[i]->out = strdup(s.c_str());
     }
-    c.out = strdup(s.c_str());
 }
 
 // <job name> <dir> <stderr_filename>
@@ -594,12 +668,29 @@ void handle_ping(COMMAND& c) {
     c.out = strdup(s.c_str());
 }
 
+// a command is done; in async mode, tell Condor there are results
+//
+void command_done() {
+    flockfile(stdout);
+    if ( async_mode && !wrote_r ) {
+        BPRINTF("R\n");
+        fflush(stdout);
+        wrote_r = true;
+    }
+    funlockfile(stdout);
+}
+
+bool is_query(COMMAND* c) {
+    return !strcasecmp(c->cmd, "BOINC_QUERY_BATCHES");
+}
+
 void* handle_command_aux(void* q) {
     COMMAND &c = *((COMMAND*)q);
     if (!strcasecmp(c.cmd, "BOINC_SUBMIT")) {
         handle_submit(c);
     } else if (!strcasecmp(c.cmd, "BOINC_QUERY_BATCHES")) {
-        handle_query_batches(c);
+        vector<COMMAND*> cmds(1, &c);
+        handle_query_batches(cmds);
     } else if (!strcasecmp(c.cmd, "BOINC_FETCH_OUTPUT")) {
         handle_fetch_output(c);
     } else if (!strcasecmp(c.cmd, "BOINC_ABORT_JOBS")) {
@@ -613,16 +704,63 @@ void* handle_command_aux(void* q) {
     } else {
         c.out = strdup("Unknown command");
     }
-    flockfile(stdout);
-    if ( async_mode && !wrote_r ) {
-        BPRINTF("R\n");
-        fflush(stdout);
-        wrote_r = true;
+    command_done();
+    return NULL;
+}
+
+void* worker(void*) {
+    while (1) {
+        pthread_mutex_lock(&queue_mutex);
+        while (command_queue.empty()) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        COMMAND* c = command_queue.front();
+        command_queue.pop_front();
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (!is_query(c)) {
+            handle_command_aux(c);
+            continue;
+        }
+
+        // wait for more queries, and do all that are queued in one RPC
+        //
+        usleep((int)(batch_window*1e6));
+        vector<COMMAND*> cmds(1, c);
+        pthread_mutex_lock(&queue_mutex);
+        deque<COMMAND*>::iterator i = command_queue.begin();
+        while (i != command_queue.end()) {
+            if (is_query(*i)) {
+                cmds.push_back(*i);
+                i = command_queue.erase(i);
+            } else {
+                i++;
+            }
+        }
+        pthread_mutex_unlock(&queue_mutex);
+        handle_query_batches(cmds);
+        command_done();
     }
-    funlockfile(stdout);
     return NULL;
 }
 
+int start_workers() {
+    pthread_attr_t thread_attrs;
+    pthread_attr_init(&thread_attrs);
+    pthread_attr_setstacksize(&thread_attrs, 256*1024);
+    for (int i=0; i<nthreads; i++) {
+        pthread_t thread_handle;
+        int retval = pthread_create(
+            &thread_handle, &thread_attrs, &worker, NULL
+        );
+        if (retval) {
+            fprintf(stderr, "can't create thread\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int COMMAND::parse_command() {
     int retval;
     char *p;
@@ -740,17 +878,10 @@ int handle_command(char* p) {
         } else {
             printf("S\n");
             commands.push_back(cp);
-            pthread_t thread_handle;
-            pthread_attr_t thread_attrs;
-            pthread_attr_init(&thread_attrs);
-            pthread_attr_setstacksize(&thread_attrs, 256*1024);
-            int retval = pthread_create(
-                &thread_handle, &thread_attrs, &handle_command_aux, cp
-            );
-            if (retval) {
-                fprintf(stderr, "can't create thread\n");
-                return -1;
-            }
+            pthread_mutex_lock(&queue_mutex);
+            command_queue.push_back(cp);
+            pthread_cond_signal(&queue_cond);
+            pthread_mutex_unlock(&queue_mutex);
         }
     }
     free(p);
@@ -807,8 +938,21 @@ void read_config() {
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--nthreads") && i+1<argc) {
+            nthreads = atoi(argv[++i]);
+            if (nthreads < 1) nthreads = 1;
+        } else if (!strcmp(argv[i], "--batch_window") && i+1<argc) {
+            batch_window = atof(argv[++i]);
+            if (batch_window < 0) batch_window = 0;
+        } else {
+            fprintf(stderr, "usage: boinc_gahp [--nthreads N] [--batch_window secs]\n");
+            exit(1);
+        }
+    }
     read_config();
+    if (!debug_mode && start_workers()) exit(1);
     strcpy(response_prefix, "");
     print_version(true);
     fflush(stdout);
@@ -108,13 +108,6 @@ struct THREAD_SET {
         }
         return true;
     }
-    int units_done() {
-        int count = 0;
-        for (unsigned int i=0; i<threads.size(); i++) {
-            count += threads[i]->units_done;
-        }
-        return count;
-    }
 };
 
 // do a billion floating-point ops
@@ -142,6 +135,7 @@ void* worker(void* p) {
     for (int i=0; i<units_per_thread; i++) {
         double x = do_a_giga_flop(i);
         t->units_done++;
+        boinc_thread_progress(t->index, t->units_done);
         fprintf(stderr, "%s thread %d finished %d: %f\n",
             boinc_msg_prefix(buf, sizeof(buf)), t->index, i, x
         );
@@ -174,13 +168,15 @@ int main(int argc, char** argv) {
 
     units_per_thread = TOTAL_UNITS/nthreads;
 
+    // the runtime adds up the threads' progress
+    //
+    boinc_thread_progress_total(units_per_thread*nthreads);
+
     THREAD_SET thread_set;
     for (i=0; i<nthreads; i++) {
         thread_set.threads.push_back(new THREAD(worker, i));
     }
     while (1) {
-        double f = thread_set.units_done()/((double)TOTAL_UNITS);
-        boinc_fraction_done(f);
         if (thread_set.all_done()) break;
         boinc_sleep(1.0);
     }
@@ -35,9 +35,13 @@
 #include <sstream>
 #include <stdexcept>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 #endif
 
 using std::string;
+using std::vector;
 
 #if defined(_MSC_VER)
 #define getcwd      _getcwd
@@ -102,6 +106,11 @@ VBOX_VM::VBOX_VM() {
 #else
     vm_pid = 0;
 #endif
+    last_full_poll = 0;
+    vm_log_offset = 0;
+    snapshot_take_time = 0;
+    snapshot_merge_time = 0;
+    snapshot_merge_running = false;
 
     // Initialize default values
     vm_disk_controller_type = "ide";
@@ -298,6 +307,11 @@ int VBOX_VM::start() {
     retval = vbm_popen(command, output, "start VM");
     if (retval) return retval;
 
+    // The VM process starts a new VBox.log
+    //
+    last_full_poll = 0;
+    vm_log_offset = 0;
+
     // Wait for up to 5 minutes for the VM to switch states.  A system
     // under load can take a while.  Since the poll function can wait for up
     // to 45 seconds to execute a command we need to make this time based instead
@@ -339,6 +353,7 @@ int VBOX_VM::stop() {
         "%s Stopping VM.\n",
         vboxwrapper_msg_prefix(buf, sizeof(buf))
     );
+    wait_for_snapshot_merge();
     if (online) {
         command = "controlvm \"" + vm_name + "\" savestate";
         retval = vbm_popen(command, output, "stop VM", true, false);
@@ -376,6 +391,7 @@ int VBOX_VM::poweroff() {
         "%s Powering off VM.\n",
         vboxwrapper_msg_prefix(buf, sizeof(buf))
     );
+    wait_for_snapshot_merge();
     if (online) {
         command = "controlvm \"" + vm_name + "\" poweroff";
         retval = vbm_popen(command, output, "poweroff VM", true, false);
@@ -442,6 +458,7 @@ int VBOX_VM::createsnapshot(double elapsed_time) {
     string output;
     char buf[256];
     int retval;
+    double start_time;
 
     fprintf(
         stderr,
@@ -451,6 +468,7 @@ int VBOX_VM::createsnapshot(double elapsed_time) {
 
     // Pause VM - Try and avoid the live snapshot and trigger an online
     // snapshot instead.
+    start_time = dtime();
     pause();
 
     // Create new snapshot
@@ -463,24 +481,43 @@ int VBOX_VM::createsnapshot(double elapsed_time) {
 
     // Resume VM
     resume();
+    snapshot_take_time = dtime() - start_time;
 
     // Set the suspended flag back to false before deleting the stale
     // snapshot
     poll(false);
 
-    // Delete stale snapshot(s), if one exists
-    cleanupsnapshots(false);
+    // Delete stale snapshot(s), if one exists.
+    // This merges the stale snapshot's differencing image into its
+    // parent, which for a big disk means a lot of I/O;
+    // do it while the VM runs, in a background thread.
+    //
+    if (start_snapshot_merge()) {
+        cleanupsnapshots(false);
+    }
 
     fprintf(
         stderr,
-        "%s Checkpoint completed.\n",
-        vboxwrapper_msg_prefix(buf, sizeof(buf))
+        "%s Checkpoint completed (snapshot took %.1f seconds).\n",
+        vboxwrapper_msg_prefix(buf, sizeof(buf)),
+        snapshot_take_time
     );
 
     return 0;
 }
 
 int VBOX_VM::cleanupsnapshots(bool delete_active) {
+    vector<string> uuids;
+    int retval;
+
+    wait_for_snapshot_merge();
+    retval = get_stale_snapshots(delete_active, uuids);
+    if (retval) return retval;
+    delete_snapshots(uuids);
+    return 0;
+}
+
+int VBOX_VM::get_stale_snapshots(bool delete_active, vector<string>& uuids) {
     string command;
     string output;
     string line;
@@ -489,9 +526,9 @@ int VBOX_VM::cleanupsnapshots(bool delete_active) {
     size_t eol_prev_pos;
     size_t uuid_start;
     size_t uuid_end;
-    char buf[256];
     int retval;
 
+    uuids.clear();
 
     // Enumerate snapshot(s)
     command = "snapshot \"" + vm_name + "\" ";
@@ -521,20 +558,7 @@ int VBOX_VM::cleanupsnapshots(bool delete_active) {
             uuid_start += 7;
             uuid_end = line.find(")", uuid_start);
             uuid = line.substr(uuid_start, uuid_end - uuid_start);
-
-            fprintf(
-                stderr,
-                "%s Deleting stale snapshot.\n",
-                vboxwrapper_msg_prefix(buf, sizeof(buf))
-            );
-
-            // Delete stale snapshot, if one exists
-            command = "snapshot \"" + vm_name + "\" ";
-            command += "delete \"";
-            command += uuid;
-            command += "\" ";
-            
-            vbm_popen(command, output, "delete stale snapshot", true, false, 0);
+            uuids.push_back(uuid);
         }
 
         eol_prev_pos = eol_pos + 1;
@@ -544,6 +568,100 @@ int VBOX_VM::cleanupsnapshots(bool delete_active) {
     return 0;
 }
 
+void VBOX_VM::delete_snapshots(vector<string>& uuids) {
+    string command;
+    string output;
+    char buf[256];
+    unsigned int i;
+
+    for (i=0; i<uuids.size(); i++) {
+        fprintf(
+            stderr,
+            "%s Deleting stale snapshot.\n",
+            vboxwrapper_msg_prefix(buf, sizeof(buf))
+        );
+
+        // Delete stale snapshot, if one exists
+        command = "snapshot \"" + vm_name + "\" ";
+        command += "delete \"";
+        command += uuids[i];
+        command += "\" ";
+
+        vbm_popen(command, output, "delete stale snapshot", true, false, 0);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI snapshot_merge_thread(void* p) {
+#else
+static void* snapshot_merge_thread(void* p) {
+#endif
+    VBOX_VM* vm = (VBOX_VM*)p;
+    char buf[256];
+    double start_time = dtime();
+
+    vm->delete_snapshots(vm->stale_snapshots);
+    vm->snapshot_merge_time = dtime() - start_time;
+    fprintf(
+        stderr,
+        "%s Stale snapshot merge completed (%.1f seconds).\n",
+        vboxwrapper_msg_prefix(buf, sizeof(buf)),
+        vm->snapshot_merge_time
+    );
+    vm->snapshot_merge_running = false;
+    return 0;
+}
+
+// Find the stale snapshots and delete them in a separate thread.
+// Only one merge runs at a time.
+// Returns nonzero if the thread couldn't be started.
+//
+int VBOX_VM::start_snapshot_merge() {
+    int retval;
+
+    if (snapshot_merge_running) return 0;
+    retval = get_stale_snapshots(false, stale_snapshots);
+    if (retval) return retval;
+    if (stale_snapshots.empty()) return 0;
+
+    snapshot_merge_running = true;
+#ifdef _WIN32
+    DWORD id;
+    HANDLE h = CreateThread(NULL, 0, snapshot_merge_thread, this, 0, &id);
+    if (!h) {
+        snapshot_merge_running = false;
+        return ERR_THREAD;
+    }
+    CloseHandle(h);
+#else
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    retval = pthread_create(&thread, &attr, snapshot_merge_thread, this);
+    pthread_attr_destroy(&attr);
+    if (retval) {
+        snapshot_merge_running = false;
+        return ERR_THREAD;
+    }
+#endif
+    return 0;
+}
+
+void VBOX_VM::wait_for_snapshot_merge() {
+    char buf[256];
+
+    if (!snapshot_merge_running) return;
+    fprintf(
+        stderr,
+        "%s Waiting for stale snapshot merge to finish.\n",
+        vboxwrapper_msg_prefix(buf, sizeof(buf))
+    );
+    while (snapshot_merge_running) {
+        boinc_sleep(1.0);
+    }
+}
+
 int VBOX_VM::restoresnapshot() {
     string command;
     string output;
@@ -578,6 +696,12 @@ void VBOX_VM::cleanup() {
     boinc_sleep(5.0);
 }
 
+// Spawning VBoxManage costs far more than the VM state changes
+// we're looking for, so while the VM process is alive
+// we follow the state transitions it writes to VBox.log,
+// and ask VBoxManage only every FULL_POLL_PERIOD seconds,
+// or when the log shows something we can't interpret ourselves.
+//
 void VBOX_VM::poll(bool log_state) {
     char buf[256];
     string command;
@@ -586,10 +710,13 @@ void VBOX_VM::poll(bool log_state) {
     size_t vmstate_start;
     size_t vmstate_end;
 
+    if (poll_vm_log()) return;
+
     command  = "showvminfo \"" + vm_name + "\" ";
     command += "--machinereadable ";
 
     if (vbm_popen(command, output, "VM state", false, false) == 0) {
+        last_full_poll = dtime();
         vmstate_start = output.find("VMState=\"");
         if (vmstate_start != string::npos) {
             vmstate_start += 9;
@@ -666,6 +793,72 @@ void VBOX_VM::poll(bool log_state) {
     }
 }
 
+// Look at the state changes the VM process logged since the last call.
+// Return true if that's enough to know the current state.
+//
+bool VBOX_VM::poll_vm_log() {
+    string output;
+    string vmstate;
+    size_t pos, end;
+
+    if (!online || crashed) return false;
+    if (dtime() - last_full_poll > FULL_POLL_PERIOD) return false;
+    if (!is_vm_process_running()) return false;
+    if (read_vm_log_file(output, vm_log_offset)) return false;
+
+    // only consume whole lines; the VM may be in the middle of one
+    //
+    end = output.rfind('\n');
+    if (end == string::npos) return true;
+    output.erase(end + 1);
+    vm_log_offset += output.size();
+
+    // Lines look like:
+    // 00:00:02.186 Changing the VM state from 'POWERING_ON' to 'RUNNING'
+    //
+    pos = output.rfind("Changing the VM state from '");
+    if (pos == string::npos) return true;
+    pos = output.find("' to '", pos);
+    if (pos == string::npos) return false;
+    pos += 6;
+    end = output.find("'", pos);
+    if (end == string::npos) return false;
+    vmstate = output.substr(pos, end - pos);
+
+    if (starts_with(vmstate, "RUNNING")) {
+        suspended = false;
+    } else if (starts_with(vmstate, "SUSPENDED")) {
+        suspended = true;
+    } else if (starts_with(vmstate, "SUSPENDING")
+        || starts_with(vmstate, "RESUMING")
+        || starts_with(vmstate, "SAVING")
+        || starts_with(vmstate, "RESETTING")
+        || starts_with(vmstate, "POWERING_ON")
+        || starts_with(vmstate, "LOADING")
+    ) {
+        // in transition; still online
+    } else {
+        // powering off, off, guru meditation, fatal error etc.
+        // Let VBoxManage tell us how it turned out.
+        //
+        return false;
+    }
+    return true;
+}
+
+bool VBOX_VM::is_vm_process_running() {
+#ifdef _WIN32
+    if (!vm_pid_handle) return false;
+    return process_exists(vm_pid_handle);
+#else
+    // the VM process isn't our child, so we can't use waitpid()
+    //
+    if (!vm_pid) return false;
+    if (kill(vm_pid, 0) == 0) return true;
+    return (errno == EPERM);
+#endif
+}
+
 // Attempt to detect any condition that would prevent VirtualBox from running a VM properly, like:
 // 1. The DCOM service not being started on Windows
 // 2. Vboxmanage not being able to communicate with vboxsvc for some reason
@@ -1500,12 +1693,75 @@ int VBOX_VM::get_system_log(string& log) {
     return retval;
 }
 
+// The VM was created with the slot directory as its base folder,
+// so its log is in <slot>/<vm name>/Logs.
+//
+int VBOX_VM::get_vm_log_path(string& path) {
+    string slot_dir;
+
+    if (!get_slot_directory(slot_dir)) return ERR_NOT_FOUND;
+    path = slot_dir + "/" + vm_name + "/Logs/VBox.log";
+    return 0;
+}
+
+// read VBox.log from the given offset to the end.
+// If the log has been restarted (it's shorter than offset), read all of it.
+//
+int VBOX_VM::read_vm_log_file(string& output, size_t offset) {
+    string path;
+    char buf[8192];
+    double size;
+    size_t n;
+    int retval;
+
+    output.clear();
+    retval = get_vm_log_path(path);
+    if (retval) return retval;
+    retval = file_size(path.c_str(), size);
+    if (retval) return retval;
+    if ((double)offset > size) offset = 0;
+
+    FILE* f = boinc_fopen(path.c_str(), "rb");
+    if (!f) return ERR_FOPEN;
+    if (offset && fseek(f, (long)offset, SEEK_SET)) {
+        fclose(f);
+        return ERR_FREAD;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        output.append(buf, n);
+    }
+    fclose(f);
+    return 0;
+}
+
 int VBOX_VM::get_vm_log(string& log) {
     string command;
     string output;
     string::iterator iter;
+    double log_size;
+    string path;
     int retval;
 
+    // read the log directly if we can; fall back to VBoxManage
+    //
+    retval = get_vm_log_path(path);
+    if (!retval) retval = file_size(path.c_str(), log_size);
+    if (!retval) {
+        retval = read_vm_log_file(
+            output, (log_size > 16384) ? (size_t)log_size - 16384 : 0
+        );
+    }
+    if (!retval) {
+        // drop the partial first line
+        //
+        if (log_size > 16384) {
+            size_t n = output.find('\n');
+            if (n != string::npos) output.erase(0, n + 1);
+        }
+        log = output;
+        return 0;
+    }
+
     command  = "showvminfo \"" + vm_name + "\" ";
     command += "--log 0 ";
 
@@ -1561,11 +1817,16 @@ int VBOX_VM::get_vm_process_id(int& process_id) {
     size_t pid_end;
     int retval;
 
-    command  = "showvminfo \"" + vm_name + "\" ";
-    command += "--log 0 ";
+    // the process ID is near the start of VBox.log
+    //
+    retval = read_vm_log_file(output, 0);
+    if (retval || output.find("Process ID: ") == string::npos) {
+        command  = "showvminfo \"" + vm_name + "\" ";
+        command += "--log 0 ";
 
-    retval = vbm_popen(command, output, "get process ID");
-    if (retval) return retval;
+        retval = vbm_popen(command, output, "get process ID");
+        if (retval) return retval;
+    }
 
     // Output should look like this:
     // VirtualBox 4.1.0 r73009 win.amd64 (Jul 19 2011 13:05:53) release log
@@ -109,6 +109,18 @@ struct VBOX_VM {
     // the pid to the VM process
     int vm_pid;
 #endif
+    // when we last asked VBoxManage for the VM state
+    double last_full_poll;
+    // how much of VBox.log we've scanned for state changes
+    size_t vm_log_offset;
+    // how long the last snapshot took (VM paused),
+    // and how long the merge of the snapshots it replaced took
+    double snapshot_take_time;
+    double snapshot_merge_time;
+    // are stale snapshots being merged by the background thread?
+    volatile bool snapshot_merge_running;
+    // UUIDs of the snapshots the background thread is to delete
+    std::vector<std::string> stale_snapshots;
 
     int initialize();
     int run(double elapsed_time);
@@ -119,9 +131,15 @@ struct VBOX_VM {
     int resume();
     int createsnapshot(double elapsed_time);
     int cleanupsnapshots(bool delete_active);
+    int get_stale_snapshots(bool delete_active, std::vector<std::string>& uuids);
+    void delete_snapshots(std::vector<std::string>& uuids);
+    int start_snapshot_merge();
+    void wait_for_snapshot_merge();
     int restoresnapshot();
     void cleanup();
     void poll(bool log_state = true);
+    bool poll_vm_log();
+    bool is_vm_process_running();
 
     bool is_system_ready(std::string& message);
     bool is_registered();
@@ -138,6 +156,8 @@ struct VBOX_VM {
     int get_network_bytes_received(double& received);
     int get_system_log(std::string& log);
     int get_vm_log(std::string& log);
+    int get_vm_log_path(std::string& path);
+    int read_vm_log_file(std::string& output, size_t offset);
     int get_vm_exit_code(unsigned long& exit_code);
     int get_vm_process_id(int& process_id);
     int get_port_forwarding_port();
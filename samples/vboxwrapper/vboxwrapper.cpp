@@ -369,6 +369,7 @@ int main(int argc, char** argv) {
     double trickle_period = 0;
     double fraction_done = 0;
     double checkpoint_cpu_time = 0;
+    double checkpoint_interval = 0;
     double last_status_report_time = 0;
     double last_trickle_report_time = 0;
     double stopwatch_time = 0;
@@ -829,9 +830,22 @@ int main(int argc, char** argv) {
             }
 
             if (boinc_time_to_checkpoint()) {
-                // Only peform a VM checkpoint every ten minutes or so.
+                // Only peform a VM checkpoint every ten minutes or so,
+                // less often if snapshots are expensive on this host,
+                // and not while the previous snapshot is still being merged.
                 //
-                if (elapsed_time >= checkpoint_cpu_time + 600.0) {
+                checkpoint_interval = CHECKPOINT_COST_FACTOR * (
+                    vm.snapshot_take_time + vm.snapshot_merge_time
+                );
+                if (checkpoint_interval < MIN_CHECKPOINT_INTERVAL) {
+                    checkpoint_interval = MIN_CHECKPOINT_INTERVAL;
+                }
+                if (checkpoint_interval > MAX_CHECKPOINT_INTERVAL) {
+                    checkpoint_interval = MAX_CHECKPOINT_INTERVAL;
+                }
+                if (!vm.snapshot_merge_running
+                    && (elapsed_time >= checkpoint_cpu_time + checkpoint_interval)
+                ) {
                     // Basic bookkeeping
                     if (vm.job_duration) {
                         fraction_done = elapsed_time / vm.job_duration;
@@ -847,20 +861,24 @@ int main(int argc, char** argv) {
                         if (aid.global_prefs.daily_xfer_limit_mb) {
                             fprintf(
                                 stderr,
-                                "%s Status Report: Job Duration: '%f', Elapsed Time: '%f', Network Bytes Sent (Total): '%f', Network Bytes Received (Total): '%f'\n",
+                                "%s Status Report: Job Duration: '%f', Elapsed Time: '%f', Network Bytes Sent (Total): '%f', Network Bytes Received (Total): '%f', Snapshot Time: '%f', Snapshot Merge Time: '%f'\n",
                                 vboxwrapper_msg_prefix(buf, sizeof(buf)),
                                 vm.job_duration,
                                 elapsed_time,
                                 bytes_sent,
-                                bytes_received
+                                bytes_received,
+                                vm.snapshot_take_time,
+                                vm.snapshot_merge_time
                             );
                         } else {
                             fprintf(
                                 stderr,
-                                "%s Status Report: Job Duration: '%f', Elapsed Time: '%f'\n",
+                                "%s Status Report: Job Duration: '%f', Elapsed Time: '%f', Snapshot Time: '%f', Snapshot Merge Time: '%f'\n",
                                 vboxwrapper_msg_prefix(buf, sizeof(buf)),
                                 vm.job_duration,
-                                elapsed_time
+                                elapsed_time,
+                                vm.snapshot_take_time,
+                                vm.snapshot_merge_time
                             );
                         }
                     }
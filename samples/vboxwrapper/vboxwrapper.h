@@ -31,6 +31,15 @@
 #define PORTFORWARD_FILENAME "vbox_port_forward.xml"
 #define REMOTEDESKTOP_FILENAME "vbox_remote_desktop.xml"
 #define POLL_PERIOD 1.0
+#define FULL_POLL_PERIOD 60.0
+    // how often to confirm the VM state with VBoxManage
+    // while VBox.log can be used instead
+#define MIN_CHECKPOINT_INTERVAL 600.0
+#define MAX_CHECKPOINT_INTERVAL 3600.0
+#define CHECKPOINT_COST_FACTOR 20.0
+    // checkpoint at most every MIN_CHECKPOINT_INTERVAL seconds,
+    // less often if snapshots are expensive: keep the time spent taking
+    // and merging snapshots under 1/CHECKPOINT_COST_FACTOR of the total
 
 extern char* vboxwrapper_msg_prefix(char*, int);
 
@@ -24,6 +24,10 @@
 // - loss of heartbeat from core client
 // - checkpointing
 //      (at the level of task; or potentially within task)
+// - running independent tasks concurrently
+//      (tasks with <name> and <depends_on> elements)
+// - unzipping inputs and zipping outputs in a separate thread,
+//      overlapped with running tasks
 //
 // See http://boinc.berkeley.edu/trac/wiki/WrapperApp for details
 // Contributor: Andrew J. Younge (ajy4490@umiacs.umd.edu)
@@ -34,6 +38,7 @@
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <map>
 #ifdef _WIN32
 #include "boinc_win.h"
 #include "win_util.h"
@@ -50,6 +55,8 @@
 #include <sys/resource.h>
 #endif
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 #endif
 
 #include "boinc_api.h"
@@ -77,15 +84,25 @@ inline void debug_msg(const char* x) {
 
 #define JOB_FILENAME "job.xml"
 #define CHECKPOINT_FILENAME "wrapper_checkpoint.txt"
+#define UNZIP_DIR "wrapper_unzip"
+#define TEMP_ZIP_FILENAME "temp.zip"
 
 #define POLL_PERIOD 1.0
 
 using std::vector;
 using std::string;
+using std::map;
 int nthreads = 1;
 
 struct TASK {
     string application;
+    string name;
+        // optional; used to refer to the task in <depends_on>
+    vector<string> depends_on;
+        // names of tasks that must finish before this one starts
+    double avg_ncpus;
+        // number of CPUs this task uses (default 1);
+        // tasks run concurrently only if their total fits in the slot
     string exec_dir;
         // optional execution directory;
         // macro-substituted for $PROJECT_DIR and $NTHREADS
@@ -106,14 +123,21 @@ struct TASK {
     bool is_daemon;
     bool append_cmdline_args;
     bool multi_process;
+    bool wait_for_unzip;
+        // don't start until zipped inputs have been unzipped (default).
+        // Set to 0 for tasks that don't use them.
 
     // dynamic stuff follows
+    vector<int> deps;
+        // indices of the tasks in depends_on
+    bool running;
+    bool completed;
     double current_cpu_time;
         // most recently measured CPU time of this task
     double final_cpu_time;
         // final CPU time of this task
-    double starting_cpu;
-        // how much CPU time was used by tasks before this one
+    double checkpoint_cpu_time;
+        // CPU time of this task when it last checkpointed
     bool suspended;
     double time_limit;
     double elapsed_time;
@@ -125,7 +149,6 @@ struct TASK {
 #else
     int pid;
     struct stat last_stat;
-    double start_rusage;        // getrusage() CPU time at start of task
 #endif
     bool stat_first;
 
@@ -136,6 +159,7 @@ struct TASK {
     void stop();
     void resume();
     double cpu_time();
+    bool ready();
     inline bool has_checkpointed() {
         bool changed = false;
         if (checkpoint_filename.size() == 0) return false;
@@ -216,6 +240,19 @@ string zip_filename;
 vector<regexp*> zip_patterns;
 APP_INIT_DATA aid;
 
+// Unzipping inputs and zipping outputs are done in a separate thread,
+// so that they overlap with running tasks.
+// boinc_zip() isn't reentrant, so all calls to it are made from that thread.
+// The main thread asks for the outputs to be zipped
+// by incrementing zip_requests.
+// If something goes wrong, the zip thread sets zip_error and exits;
+// the main thread then kills the tasks and finishes.
+//
+volatile bool unzip_done = false;
+volatile int zip_requests = 0;
+volatile int zips_done = 0;
+volatile int zip_error = 0;
+
 // replace s1 with s2
 //
 void str_replace_all(char* buf, const char* s1, const char* s2) {
@@ -275,25 +312,57 @@ void read_initial_file_list(vector<string>& files) {
     fclose(f);
 }
 
-// if any zipped input files are present, unzip and remove them
+// if any zipped input files are present, unzip and remove them.
+// Each archive is extracted into a scratch directory,
+// and its top-level entries are then renamed into the slot dir
+// and added to the initial file list (so they aren't zipped as output).
+// Files thus appear complete or not at all.
 //
-void do_unzip_inputs() {
+int do_unzip_inputs() {
+    char fname[256];
+
     for (unsigned int i=0; i<unzip_filenames.size(); i++) {
         string zipfilename = unzip_filenames[i];
         if (boinc_file_exists(zipfilename.c_str())) {
             string path;
             boinc_resolve_filename_s(zipfilename.c_str(), path);
-            int retval = boinc_zip(UNZIP_IT, path, NULL);
+            boinc_mkdir(UNZIP_DIR);
+            int retval = boinc_zip(UNZIP_IT, path, string(UNZIP_DIR));
             if (retval) {
                 fprintf(stderr, "boinc_unzip() error: %d\n", retval);
-                exit(1);
+                return retval;
             }
+            FILE* f = fopen("initial_file_list", "a");
+            DIRREF d = dir_open(UNZIP_DIR);
+            while (!dir_scan(fname, d, sizeof(fname))) {
+                string src = string(UNZIP_DIR) + "/" + fname;
+                if (boinc_file_exists(fname)) {
+                    if (is_dir(fname)) {
+                        clean_out_dir(fname);
+                        boinc_rmdir(fname);
+                    } else {
+                        boinc_delete_file(fname);
+                    }
+                }
+                retval = boinc_rename(src.c_str(), fname);
+                if (retval) {
+                    fprintf(stderr, "can't move unzipped %s: %d\n", fname, retval);
+                    dir_close(d);
+                    if (f) fclose(f);
+                    return retval;
+                }
+                if (f) fprintf(f, "%s\n", fname);
+            }
+            dir_close(d);
+            if (f) fclose(f);
+            boinc_rmdir(UNZIP_DIR);
             retval = boinc_delete_file(zipfilename.c_str());
             if (retval) {
                 fprintf(stderr, "boinc_delete_file() error: %d\n", retval);
             }
         }
     }
+    return 0;
 }
 
 bool in_vector(string s, vector<string>& v) {
@@ -314,6 +383,8 @@ void get_zip_inputs(ZipFileList &files) {
     while (!dir_scan(fname, d, sizeof(fname))) {
         string filename = string(fname);
         if (in_vector(filename, initial_files)) continue;
+        if (filename == TEMP_ZIP_FILENAME) continue;
+        if (filename == UNZIP_DIR) continue;
         for (unsigned int i=0; i<zip_patterns.size(); i++) {
             regmatch match;
             if (re_exec_w(zip_patterns[i], fname, 1, &match) == 1) {
@@ -324,22 +395,152 @@ void get_zip_inputs(ZipFileList &files) {
     }
 }
 
+// Add output files to the temp zip file.
+// This is called (in the zip thread) each time a task finishes,
+// and once more at the end.
+// Files already added, and not changed since, are skipped,
+// so the final pass only compresses what the last tasks wrote.
+//
+struct ZIPPED_FILE {
+    double mod_time;
+    double size;
+    double zip_time;    // when the pass that added it started
+};
+map<string, ZIPPED_FILE> zipped_files;
+
+int update_zip_outputs() {
+    ZipFileList infiles, changed;
+    double now = dtime();
+    unsigned int i;
+
+    get_zip_inputs(infiles);
+    for (i=0; i<infiles.size(); i++) {
+        ZIPPED_FILE zf;
+        struct stat sbuf;
+        if (stat(infiles[i].c_str(), &sbuf)) continue;
+        zf.mod_time = (double)sbuf.st_mtime;
+        zf.size = (double)sbuf.st_size;
+        zf.zip_time = now;
+        map<string, ZIPPED_FILE>::iterator it = zipped_files.find(infiles[i]);
+        if (it != zipped_files.end()) {
+            ZIPPED_FILE& old = it->second;
+
+            // mtimes have 1-sec resolution;
+            // redo a file modified as (or after) we last zipped it
+            //
+            if (old.mod_time == zf.mod_time
+                && old.size == zf.size
+                && zf.mod_time < old.zip_time - 1
+            ) {
+                continue;
+            }
+        }
+        changed.push_back(infiles[i]);
+        zipped_files[infiles[i]] = zf;
+    }
+    if (changed.empty()) return 0;
+    int retval = boinc_zip(ZIP_ADD, string(TEMP_ZIP_FILENAME), &changed);
+    if (retval) {
+        fprintf(stderr, "boinc_zip() failed: %d\n", retval);
+        return retval;
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+DWORD WINAPI zip_thread(void*) {
+#else
+void* zip_thread(void*) {
+    // signals are handled in the main thread
+    //
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+#endif
+    int retval = do_unzip_inputs();
+    if (retval) {
+        zip_error = retval;
+        return 0;
+    }
+    unzip_done = true;
+    while (1) {
+        int n = zip_requests;
+        if (zips_done < n) {
+            retval = update_zip_outputs();
+            if (retval) {
+                zip_error = retval;
+                return 0;
+            }
+            zips_done = n;
+        } else {
+            boinc_sleep(0.1);
+        }
+    }
+    return 0;
+}
+
+int start_zip_thread() {
+    char buf[256];
+#ifdef _WIN32
+    DWORD id;
+    HANDLE h = CreateThread(NULL, 0, zip_thread, 0, 0, &id);
+    if (!h) {
+        fprintf(stderr, "%s CreateThread() failed, errno %d\n",
+            boinc_msg_prefix(buf, sizeof(buf)), GetLastError()
+        );
+        return ERR_THREAD;
+    }
+    CloseHandle(h);
+#else
+    pthread_t thread;
+    pthread_attr_t attrs;
+    pthread_attr_init(&attrs);
+    pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+    int retval = pthread_create(&thread, &attrs, zip_thread, NULL);
+    pthread_attr_destroy(&attrs);
+    if (retval) {
+        fprintf(stderr, "%s pthread_create(): %d\n",
+            boinc_msg_prefix(buf, sizeof(buf)), retval
+        );
+        return ERR_THREAD;
+    }
+#endif
+    return 0;
+}
+
+// ask the zip thread to add what the tasks have written so far
+//
+void request_zip_outputs() {
+    if (zip_filename.empty()) return;
+    zip_requests++;
+}
+
 // if the zipped output file is not present,
-// create the zip in a temp file, then rename it
+// finish the temp zip file, then rename it
 //
 void do_zip_outputs() {
     if (zip_filename.empty()) return;
     if (boinc_file_exists(zip_filename.c_str())) return;
-    ZipFileList infiles;
-    get_zip_inputs(infiles);
-    int retval = boinc_zip(ZIP_IT, string("temp.zip"), &infiles);
-    if (retval) {
-        fprintf(stderr, "boinc_zip() failed: %d\n", retval);
-        exit(1);
+    request_zip_outputs();
+    int n = zip_requests;
+    while (zips_done < n) {
+        if (zip_error) exit(1);
+        boinc_sleep(0.1);
+    }
+    if (!boinc_file_exists(TEMP_ZIP_FILENAME)) {
+        // no output files; make an empty archive as before
+        //
+        ZipFileList infiles;
+        int retval = boinc_zip(ZIP_IT, string(TEMP_ZIP_FILENAME), &infiles);
+        if (retval) {
+            fprintf(stderr, "boinc_zip() failed: %d\n", retval);
+            exit(1);
+        }
     }
     string path;
     boinc_resolve_filename_s(zip_filename.c_str(), path);
-    retval = boinc_rename("temp.zip", path.c_str());
+    int retval = boinc_rename(TEMP_ZIP_FILENAME, path.c_str());
     if (retval) {
         fprintf(stderr, "failed to rename temp.zip: %d\n", retval);
         exit(1);
@@ -350,12 +551,17 @@ int TASK::parse(XML_PARSER& xp) {
     char buf[8192];
 
     weight = 1;
+    avg_ncpus = 1;
+    running = false;
+    completed = false;
     current_cpu_time = 0;
     final_cpu_time = 0;
+    checkpoint_cpu_time = 0;
     stat_first = true;
     pid = 0;
     is_daemon = false;
     multi_process = false;
+    wait_for_unzip = true;
     append_cmdline_args = false;
     time_limit = 0;
 
@@ -370,6 +576,12 @@ int TASK::parse(XML_PARSER& xp) {
             return 0;
         }
         else if (xp.parse_string("application", application)) continue;
+        else if (xp.parse_string("name", name)) continue;
+        else if (xp.parse_str("depends_on", buf, sizeof(buf))) {
+            depends_on.push_back(buf);
+            continue;
+        }
+        else if (xp.parse_double("avg_ncpus", avg_ncpus)) continue;
         else if (xp.parse_str("exec_dir", buf, sizeof(buf))) {
             macro_substitute(buf);
             exec_dir = buf;
@@ -393,6 +605,7 @@ int TASK::parse(XML_PARSER& xp) {
         else if (xp.parse_double("weight", weight)) continue;
         else if (xp.parse_bool("daemon", is_daemon)) continue;
         else if (xp.parse_bool("multi_process", multi_process)) continue;
+        else if (xp.parse_bool("wait_for_unzip", wait_for_unzip)) continue;
         else if (xp.parse_bool("append_cmdline_args", append_cmdline_args)) continue;
         else if (xp.parse_double("time_limit", time_limit)) continue;
     }
@@ -503,6 +716,43 @@ int parse_job_file() {
     return ERR_XML_PARSE;
 }
 
+// Turn <depends_on> names into task indices.
+// If no task has a name, the job file predates dependencies:
+// make each task depend on the previous one so they run in order.
+//
+int resolve_dependencies() {
+    char buf[256];
+    unsigned int i, j, k;
+    bool use_names = false;
+
+    for (i=0; i<tasks.size(); i++) {
+        if (!tasks[i].name.empty()) use_names = true;
+    }
+    for (i=0; i<tasks.size(); i++) {
+        TASK& task = tasks[i];
+        task.deps.clear();
+        if (!use_names) {
+            if (i) task.deps.push_back(i-1);
+            continue;
+        }
+        for (j=0; j<task.depends_on.size(); j++) {
+            for (k=0; k<tasks.size(); k++) {
+                if (tasks[k].name == task.depends_on[j]) break;
+            }
+            if (k == tasks.size() || k == i) {
+                fprintf(stderr,
+                    "%s task %s: bad dependency %s\n",
+                    boinc_msg_prefix(buf, sizeof(buf)),
+                    task.application.c_str(), task.depends_on[j].c_str()
+                );
+                return ERR_XML_PARSE;
+            }
+            task.deps.push_back(k);
+        }
+    }
+    return 0;
+}
+
 int start_daemons(int argc, char** argv) {
     for (unsigned int i=0; i<daemons.size(); i++) {
         TASK& task = daemons[i];
@@ -702,10 +952,6 @@ int TASK::run(int argct, char** argvt) {
     FILE* stdin_file;
     FILE* stderr_file;
 
-    struct rusage ru;
-    getrusage(RUSAGE_CHILDREN, &ru);
-    start_rusage = (float)ru.ru_utime.tv_sec + ((float)ru.ru_utime.tv_usec)/1e+6;
-
     pid = fork();
     if (pid == -1) {
         perror("fork(): ");
@@ -814,11 +1060,12 @@ bool TASK::poll(int& status) {
     int wpid;
     struct rusage ru;
 
-    wpid = waitpid(pid, &status, WNOHANG);
+    // use wait4() rather than getrusage(RUSAGE_CHILDREN):
+    // other tasks may have exited while this one ran
+    //
+    wpid = wait4(pid, &status, WNOHANG, &ru);
     if (wpid) {
-        getrusage(RUSAGE_CHILDREN, &ru);
         final_cpu_time = (float)ru.ru_utime.tv_sec + ((float)ru.ru_utime.tv_usec)/1e+6;
-        final_cpu_time -= start_rusage;
 #ifdef DEBUG
         fprintf(stderr, "%s process exited; current CPU %f final CPU %f\n",
             boinc_message_prefix(buf, sizeof(buf)),
@@ -882,77 +1129,128 @@ double TASK::cpu_time() {
     return current_cpu_time;
 }
 
-void poll_boinc_messages(TASK& task) {
+// can this task start, i.e. have the tasks it depends on finished?
+//
+bool TASK::ready() {
+    if (wait_for_unzip && !unzip_done) return false;
+    for (unsigned int i=0; i<deps.size(); i++) {
+        if (!tasks[deps[i]].completed) return false;
+    }
+    return true;
+}
+
+void kill_running_tasks() {
+    for (unsigned int i=0; i<tasks.size(); i++) {
+        if (tasks[i].running) tasks[i].kill();
+    }
+}
+
+void poll_boinc_messages() {
     BOINC_STATUS status;
+    unsigned int i;
+
     boinc_get_status(&status);
     //fprintf(stderr, "wrapper: polling\n");
     if (status.no_heartbeat) {
         debug_msg("wrapper: kill");
-        task.kill();
+        kill_running_tasks();
         kill_daemons();
         exit(0);
     }
     if (status.quit_request) {
         debug_msg("wrapper: quit");
-        task.kill();
+        kill_running_tasks();
         kill_daemons();
         exit(0);
     }
     if (status.abort_request) {
         debug_msg("wrapper: abort");
-        task.kill();
+        kill_running_tasks();
         kill_daemons();
         exit(0);
     }
-    if (status.suspended) {
-        if (!task.suspended) {
-            debug_msg("wrapper: suspend");
-            task.stop();
-        }
-    } else {
-        if (task.suspended) {
-            debug_msg("wrapper: resume");
-            task.resume();
+    for (i=0; i<tasks.size(); i++) {
+        TASK& task = tasks[i];
+        if (!task.running) continue;
+        if (status.suspended) {
+            if (!task.suspended) {
+                debug_msg("wrapper: suspend");
+                task.stop();
+            }
+        } else {
+            if (task.suspended) {
+                debug_msg("wrapper: resume");
+                task.resume();
+            }
         }
     }
 }
 
 // Support for multiple tasks.
-// We keep a checkpoint file that says how many tasks we've completed
-// and how much CPU time has been used so far
+// We keep a checkpoint file that says which tasks we've completed
+// and how much CPU time has been used so far.
+// The first line is "ncompleted cpu"; the second lists the indices
+// of the completed tasks.
+// Files without the second line (from older wrappers)
+// mean the first ncompleted tasks are done.
 //
-void write_checkpoint(int ntasks_completed, double cpu) {
+void write_checkpoint(double cpu) {
+    unsigned int i;
+    int ncompleted = 0;
+
+    for (i=0; i<tasks.size(); i++) {
+        if (tasks[i].completed) ncompleted++;
+    }
     boinc_begin_critical_section();
     FILE* f = fopen(CHECKPOINT_FILENAME, "w");
     if (!f) return;
-    fprintf(f, "%d %f\n", ntasks_completed, cpu);
+    fprintf(f, "%d %f\n", ncompleted, cpu);
+    for (i=0; i<tasks.size(); i++) {
+        if (tasks[i].completed) fprintf(f, "%d ", i);
+    }
+    fprintf(f, "\n");
     fclose(f);
     boinc_checkpoint_completed();
 }
 
-int read_checkpoint(int& ntasks_completed, double& cpu) {
-    int nt;
+int read_checkpoint(vector<int>& completed, double& cpu) {
+    int nt, i, j;
     double c;
 
-    ntasks_completed = 0;
+    completed.clear();
     cpu = 0;
     FILE* f = fopen(CHECKPOINT_FILENAME, "r");
     if (!f) return ERR_FOPEN;
     int n = fscanf(f, "%d %lf", &nt, &c);
+    if (n != 2) {
+        fclose(f);
+        return 0;
+    }
+    for (i=0; i<nt; i++) {
+        if (fscanf(f, "%d", &j) != 1) break;
+        completed.push_back(j);
+    }
     fclose(f);
-    if (n != 2) return 0;
-    ntasks_completed = nt;
+    if (i == 0) {
+        for (i=0; i<nt; i++) {
+            completed.push_back(i);
+        }
+    }
     cpu = c;
     return 0;
 }
 
 int main(int argc, char** argv) {
     BOINC_OPTIONS options;
-    int retval, ntasks_completed;
+    int retval;
     unsigned int i;
+    vector<int> completed;
     double total_weight=0, weight_completed=0;
     double checkpoint_cpu_time;
         // total CPU time at last checkpoint
+    double base_cpu_time;
+        // CPU time of completed tasks and of previous runs
+    double ncpus;
     char buf[256];
 
 #ifdef _WIN32
@@ -966,6 +1264,9 @@ int main(int argc, char** argv) {
     }
 
     retval = parse_job_file();
+    if (!retval) {
+        retval = resolve_dependencies();
+    }
     if (retval) {
         fprintf(stderr, "%s can't parse job file: %d\n",
             boinc_msg_prefix(buf, sizeof(buf)),
@@ -974,16 +1275,14 @@ int main(int argc, char** argv) {
         boinc_finish(retval);
     }
 
-    do_unzip_inputs();
-
-    retval = read_checkpoint(ntasks_completed, checkpoint_cpu_time);
+    retval = read_checkpoint(completed, checkpoint_cpu_time);
     if (retval && !zip_filename.empty()) {
         // this is the first time we've run.
         // If we're going to zip output files,
         // make a list of files present at this point
         // so we can exclude them.
         //
-        write_checkpoint(0, 0);
+        write_checkpoint(0);
         get_initial_file_list();
     }
 
@@ -1003,17 +1302,35 @@ int main(int argc, char** argv) {
 
     boinc_get_init_data(aid);
 
-    if (ntasks_completed > (int)tasks.size()) {
-        fprintf(stderr,
-            "%s Checkpoint file: ntasks_completed too large: %d > %d\n",
-            boinc_msg_prefix(buf, sizeof(buf)),
-            ntasks_completed, (int)tasks.size()
-        );
-        boinc_finish(1);
+    retval = start_zip_thread();
+    if (retval) {
+        boinc_finish(retval);
+    }
+
+    for (i=0; i<completed.size(); i++) {
+        if (completed[i] < 0 || completed[i] >= (int)tasks.size()) {
+            fprintf(stderr,
+                "%s Checkpoint file: bad task index: %d (%d tasks)\n",
+                boinc_msg_prefix(buf, sizeof(buf)),
+                completed[i], (int)tasks.size()
+            );
+            boinc_finish(1);
+        }
+        tasks[completed[i]].completed = true;
     }
     for (i=0; i<tasks.size(); i++) {
         total_weight += tasks[i].weight;
+        if (tasks[i].completed) {
+            weight_completed += tasks[i].weight;
+        }
     }
+    base_cpu_time = checkpoint_cpu_time;
+
+    // how many CPUs our tasks can use at once
+    //
+    ncpus = aid.ncpus;
+    if (nthreads > ncpus) ncpus = nthreads;
+    if (ncpus < 1) ncpus = 1;
 
     retval = start_daemons(argc, argv);
     if (retval) {
@@ -1026,94 +1343,144 @@ int main(int argc, char** argv) {
         boinc_finish(retval);
     }
 
-    // loop over tasks
-    //
-    for (i=0; i<tasks.size(); i++) {
-        TASK& task = tasks[i];
-        if ((int)i<ntasks_completed) {
-            weight_completed += task.weight;
-            continue;
+    int counter = 0;
+    while (1) {
+        // start whatever tasks are ready, as long as they fit.
+        // Always run at least one, even if it asks for more CPUs than we have.
+        //
+        int nrunning = 0;
+        double ncpus_used = 0;
+        bool all_done = true;
+        for (i=0; i<tasks.size(); i++) {
+            TASK& task = tasks[i];
+            if (!task.completed) all_done = false;
+            if (task.running) {
+                nrunning++;
+                ncpus_used += task.avg_ncpus;
+            }
         }
-        double frac_done = weight_completed/total_weight;
-        double cpu_time = 0;
-
-        task.starting_cpu = checkpoint_cpu_time;
-        retval = task.run(argc, argv);
-        if (retval) {
-            boinc_finish(retval);
+        if (all_done) break;
+        for (i=0; i<tasks.size(); i++) {
+            TASK& task = tasks[i];
+            if (task.running || task.completed) continue;
+            if (!task.ready()) continue;
+            if (nrunning && ncpus_used + task.avg_ncpus > ncpus) continue;
+            retval = task.run(argc, argv);
+            if (retval) {
+                kill_running_tasks();
+                kill_daemons();
+                boinc_finish(retval);
+            }
+            task.running = true;
+            task.current_cpu_time = 0;
+            task.checkpoint_cpu_time = 0;
+            nrunning++;
+            ncpus_used += task.avg_ncpus;
         }
-        int counter = 0;
-        while (1) {
+        if (!nrunning && unzip_done) {
+            fprintf(stderr,
+                "%s no task can run: circular dependencies in %s\n",
+                boinc_msg_prefix(buf, sizeof(buf)), JOB_FILENAME
+            );
+            kill_daemons();
+            boinc_finish(1);
+        }
+
+        // see which tasks have exited
+        //
+        bool task_exited = false;
+        for (i=0; i<tasks.size(); i++) {
+            TASK& task = tasks[i];
+            if (!task.running) continue;
             int status;
-            if (task.poll(status)) {
-                if (status) {
-                    fprintf(stderr,
-                        "%s app exit status: 0x%x\n",
-                        boinc_msg_prefix(buf, sizeof(buf)),
-                        status
-                    );
-                    // On Unix, if the app is non-executable,
-                    // the child status will be 0x6c00.
-                    // If we return this the client will treat it
-                    // as recoverable, and restart us.
-                    // We don't want this, so return an 8-bit error code.
-                    //
-                    kill_daemons();
-                    boinc_finish(EXIT_CHILD_FAILED);
-                }
-                break;
+            if (!task.poll(status)) continue;
+            if (status) {
+                fprintf(stderr,
+                    "%s app exit status: 0x%x\n",
+                    boinc_msg_prefix(buf, sizeof(buf)),
+                    status
+                );
+                // On Unix, if the app is non-executable,
+                // the child status will be 0x6c00.
+                // If we return this the client will treat it
+                // as recoverable, and restart us.
+                // We don't want this, so return an 8-bit error code.
+                //
+                task.running = false;
+                kill_running_tasks();
+                kill_daemons();
+                boinc_finish(EXIT_CHILD_FAILED);
             }
-            poll_boinc_messages(task);
-            double task_fraction_done = task.fraction_done();
-            double delta = task_fraction_done*task.weight/total_weight;
+            task.running = false;
+            task.completed = true;
+            base_cpu_time += task.final_cpu_time;
+            weight_completed += task.weight;
+            task_exited = true;
+        }
+        if (task_exited) {
+            request_zip_outputs();
+        }
 
-            // getting CPU time of task tree is inefficient,
-            // so do it only every 10 sec
-            //
+        poll_boinc_messages();
+        if (zip_error) {
+            kill_running_tasks();
+            kill_daemons();
+            boinc_finish(1);
+        }
+
+        // Total CPU time is that of completed tasks plus running ones.
+        // The checkpointed CPU time counts running tasks
+        // only up to their last checkpoint,
+        // since that's where they'll resume if we're restarted.
+        // Getting CPU time of task trees is inefficient,
+        // so do it only every 10 sec.
+        //
+        bool checkpointed = task_exited;
+        double cpu_time = base_cpu_time;
+        double ckpt_cpu = base_cpu_time;
+        double frac_done = weight_completed;
+        for (i=0; i<tasks.size(); i++) {
+            TASK& task = tasks[i];
+            if (!task.running) continue;
             if (counter%10 == 0) {
-                cpu_time = task.cpu_time();
+                task.cpu_time();
             }
-#ifdef DEBUG
-            fprintf(stderr,
-                "%s cpu time %f, checkpoint CPU time %f frac done %f\n",
-                boinc_msg_prefix(buf, sizeof(buf)),
-                task.starting_cpu + cpu_time,
-                checkpoint_cpu_time,
-                frac_done + delta
-            );
-#endif
-            boinc_report_app_status(
-                task.starting_cpu + cpu_time,
-                checkpoint_cpu_time,
-                frac_done + delta
-            );
             if (task.has_checkpointed()) {
-                cpu_time = task.cpu_time();
-                checkpoint_cpu_time = task.starting_cpu + cpu_time;
-                write_checkpoint(i, checkpoint_cpu_time);
+                task.checkpoint_cpu_time = task.cpu_time();
+                checkpointed = true;
             }
-            boinc_sleep(POLL_PERIOD);
-            if (!task.suspended) {
-                task.elapsed_time += POLL_PERIOD;
-            }
-            counter++;
+            cpu_time += task.current_cpu_time;
+            ckpt_cpu += task.checkpoint_cpu_time;
+            frac_done += task.fraction_done()*task.weight;
+        }
+        frac_done /= total_weight;
+        if (checkpointed) {
+            checkpoint_cpu_time = ckpt_cpu;
+            write_checkpoint(checkpoint_cpu_time);
         }
-        checkpoint_cpu_time = task.starting_cpu + task.final_cpu_time;
 #ifdef DEBUG
-        fprintf(stderr, "%s cpu time %f, checkpoint CPU time %f frac done %f\n",
+        fprintf(stderr,
+            "%s cpu time %f, checkpoint CPU time %f frac done %f\n",
             boinc_msg_prefix(buf, sizeof(buf)),
-            task.starting_cpu + task.final_cpu_time,
+            cpu_time,
             checkpoint_cpu_time,
-            frac_done + task.weight/total_weight
+            frac_done
         );
 #endif
-        boinc_report_app_status(
-            task.starting_cpu + task.final_cpu_time,
-            checkpoint_cpu_time,
-            frac_done + task.weight/total_weight
-        );
-        write_checkpoint(i+1, checkpoint_cpu_time);
-        weight_completed += task.weight;
+        boinc_report_app_status(cpu_time, checkpoint_cpu_time, frac_done);
+
+        // if a task finished, start its successors right away
+        //
+        if (task_exited) continue;
+
+        boinc_sleep(POLL_PERIOD);
+        for (i=0; i<tasks.size(); i++) {
+            TASK& task = tasks[i];
+            if (task.running && !task.suspended) {
+                task.elapsed_time += POLL_PERIOD;
+            }
+        }
+        counter++;
     }
     kill_daemons();
     do_zip_outputs();
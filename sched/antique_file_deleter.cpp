@@ -36,6 +36,8 @@
 #include <pwd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
@@ -50,6 +52,7 @@
 #include "strings.h"
 #include "svn_version.h"
 
+#include "dir_walk.h"
 #include "sched_config.h"
 #include "sched_util.h"
 #include "sched_msgs.h"
@@ -59,6 +62,7 @@
 
 int antique_usleep = ANTIQUE_USLEEP;
 bool antiques_deletion_dry_run = false;
+int nthreads = 1;
 
 void usage(char *name) {
     fprintf(stderr, "Deletes files that have been uploaded after the result was purged from the DB.\n\n"
@@ -72,6 +76,8 @@ void usage(char *name) {
         "  --dry_run                       don't delete any files, just log what would be deleted\n"
         "  --usleep N                      sleep this number of usecs after each examined file.\n"
         "                                  Throttles I/O if there are many files. Defaults to %d.\n"
+        "                                  (Each thread sleeps separately.)\n"
+        "  --nthreads N                    scan N upload fanout directories at once\n"
         "  [ -h | --help ]                 shows this help text\n"
         "  [ -v | --version ]              shows version information\n",
         name, ANTIQUE_USLEEP
@@ -106,134 +112,145 @@ static inline char* actime(time_t t) {
     return p;
 }
 
-//  returns:
-//  0 if all went ok;
-//  1 on a transient error affecting only a single file;
-// -1 on a serious error that should switch off antique file deletion
+// The upload dirs are scanned by --nthreads threads (see dir_walk.h).
+// They lock around logging.
 //
-int delete_antiques_from_dir(char*dirpath, time_t mtime, uid_t uid) {
-    DIR*dir;
-    struct dirent*entry;
-    struct stat fstat;
-    int ret;
+struct ANTIQUE_SCAN {
+    std::vector<std::string> dirs;
+    std::string stop_file;
+    time_t mtime;
+    uid_t uid;
+    int nentries;       // for checking the stop file now and then
+    bool stop;          // stop file seen
+    int retval;         // as returned by delete_antiques_from_dir()
+};
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define STOP_CHECK_PERIOD   1000
+    // check the stop file after this many entries
+
+// examine a dir entry, and delete it if it's an antique.
+//
+static int delete_antique(
+    int dirfd, const char* dirpath, const char* name,
+    struct stat& fstat, int stat_errno, void* arg
+) {
+    ANTIQUE_SCAN& as = *(ANTIQUE_SCAN*)arg;
     char path[MAXPATHLEN];
 
-    // open directory
-    errno = 0;
-    dir = opendir(dirpath);
-    if (!dir) {
-        log_messages.printf(MSG_CRITICAL,
-            "delete_antiques_from_dir(): "
-            "Couldn't open dir '%s': %s (%d)\n",
-            dirpath, strerror(errno), errno
-        );
-        return -1;
+    // the stop file is checked here;
+    // the main thread quits once the scan has stopped
+    //
+    if (__sync_add_and_fetch(&as.nentries, 1) % STOP_CHECK_PERIOD == 0) {
+        if (boinc_file_exists(as.stop_file.c_str())) {
+            as.stop = true;
+        }
     }
+    if (as.stop) return 1;
 
-    // scan directory
-    errno = 0;
-    while ((entry = readdir(dir))) {
+    // construct absolute path of this entry
+    snprintf(path, sizeof(path), "%s/%s", dirpath, name);
 
-        // might be woken by a signal
-        check_stop_daemons();
+    pthread_mutex_lock(&log_lock);
 
-        // construct absolute path of this entry
-        safe_strcpy(path, dirpath);
-        strcat(path, "/");
-        strcat(path, entry->d_name);
+    // examine file
+    log_messages.printf(MSG_DEBUG,
+        "delete_antiques_from_dir(): examining file: '%s'\n",
+        path
+    );
 
-        // examine file
-        log_messages.printf(MSG_DEBUG,
-            "delete_antiques_from_dir(): examining file: '%s'\n",
-            path
+    // stat
+    if (stat_errno) {
+        log_messages.printf(MSG_NORMAL,
+            "delete_antiques_from_dir(): couldn't stat '%s: %s (%d)'\n",
+            path, strerror(stat_errno), stat_errno
         );
 
-        // stat
-        errno = 0;
-        if (lstat(path, &fstat)) {
-            log_messages.printf(MSG_NORMAL,
-                "delete_antiques_from_dir(): couldn't stat '%s: %s (%d)'\n",
-                path, strerror(errno), errno
-            );
-
-        // regular file
-        } else if ((fstat.st_mode & S_IFMT) != S_IFREG) {
-            log_messages.printf(MSG_DEBUG,"not a regular plain file\n");
+    // regular file
+    } else if ((fstat.st_mode & S_IFMT) != S_IFREG) {
+        log_messages.printf(MSG_DEBUG,"not a regular plain file\n");
 
-        // skip hidden files such as ".nfs"
-        } else if (entry->d_name[0] == '.') {
-            log_messages.printf(MSG_DEBUG,"hidden file or directory\n");
+    // skip hidden files such as ".nfs"
+    } else if (name[0] == '.') {
+        log_messages.printf(MSG_DEBUG,"hidden file or directory\n");
 
-        // modification time
-        } else if (fstat.st_mtime > mtime) {
-            log_messages.printf(MSG_DEBUG,"too young: %s\n", actime(fstat.st_mtime));
+    // modification time
+    } else if (fstat.st_mtime > as.mtime) {
+        log_messages.printf(MSG_DEBUG,"too young: %s\n", actime(fstat.st_mtime));
 
-        // check owner (must be apache)
-        } else if (fstat.st_uid != uid) {
-            log_messages.printf(MSG_DEBUG,"wrong owner: id %d\n", fstat.st_uid);
+    // check owner (must be apache)
+    } else if (fstat.st_uid != as.uid) {
+        log_messages.printf(MSG_DEBUG,"wrong owner: id %d\n", fstat.st_uid);
 
-        // skip if dry_run
-        } else if (antiques_deletion_dry_run) {
-            log_messages.printf(MSG_NORMAL,
-                  "Would delete '%s/%s' (%s)\n",
-                dirpath, entry->d_name, actime(fstat.st_mtime));
+    // skip if dry_run
+    } else if (antiques_deletion_dry_run) {
+        log_messages.printf(MSG_NORMAL,
+              "Would delete '%s' (%s)\n",
+            path, actime(fstat.st_mtime));
 
-        // found no reason to skip, actually delete this file
-        } else {
-            log_messages.printf(MSG_NORMAL, "Deleting file '%s' (%s)\n",
-                path, actime(fstat.st_mtime)
+    // found no reason to skip, actually delete this file
+    } else {
+        log_messages.printf(MSG_NORMAL, "Deleting file '%s' (%s)\n",
+            path, actime(fstat.st_mtime)
+        );
+        pthread_mutex_unlock(&log_lock);
+        int retval = unlinkat(dirfd, name, 0);
+        int unlink_errno = errno;
+        pthread_mutex_lock(&log_lock);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "delete_antiques_from_dir(): "
+                "Couldn't unlink '%s: %s (%d)'\n",
+                path, strerror(unlink_errno), unlink_errno
             );
-            errno = 0;
-            if (unlink(path)) {
-                log_messages.printf(MSG_CRITICAL,
-                    "delete_antiques_from_dir(): "
-                    "Couldn't unlink '%s: %s (%d)'\n",
-                    path, strerror(errno), errno
-                );
-                closedir(dir);
-                return 1;
-            }
+            if (!as.retval) as.retval = 1;
         }
+    }
+    pthread_mutex_unlock(&log_lock);
 
-        // throttle I/O if told to
-        if (antique_usleep) {
-            usleep(antique_usleep);
-        }
+    // throttle I/O if told to
+    if (antique_usleep) {
+        usleep(antique_usleep);
+    }
+    return 0;
+}
 
-    } // while (readdir())
+//  sets as.retval to:
+//  0 if all went ok;
+//  1 on a transient error affecting only a single file;
+// -1 on a serious error that should switch off antique file deletion
+//
+static void delete_antiques_from_dir(int i, void* arg) {
+    ANTIQUE_SCAN& as = *(ANTIQUE_SCAN*)arg;
+    const char* dirpath = as.dirs[i].c_str();
 
-    // if the loop terminated because of an error
-    if (errno) {
+    if (as.stop || as.retval < 0) return;
+    pthread_mutex_lock(&log_lock);
+    log_messages.printf(MSG_DEBUG,
+        "delete_antiques(): scanning upload directory '%s'\n",
+        dirpath
+    );
+    pthread_mutex_unlock(&log_lock);
+    int retval = scan_dir(dirpath, delete_antique, arg);
+    if (retval > 0) {
+        pthread_mutex_lock(&log_lock);
         log_messages.printf(MSG_CRITICAL,
             "delete_antiques_from_dir(): "
             "Couldn't read dir '%s': %s (%d)\n",
-            dirpath, strerror(errno), errno
+            dirpath, strerror(retval), retval
         );
-        closedir(dir);
-        return 1;
+        pthread_mutex_unlock(&log_lock);
+        as.retval = -1;
     }
-
-    // close dir
-    errno = 0;
-    ret = closedir(dir);
-    if (ret) {
-        log_messages.printf(MSG_CRITICAL,
-            "delete_antiques_from_dir(): "
-            "Couldn't close dir '%s': %s (%d)\n",
-            dirpath, strerror(errno), errno
-        );
-    }
-    return ret;
 }
 
-
 // collect information and call delete_antiques_from_dir()
 // for every relevant directory
 //
 static int delete_antiques() {
     DB_WORKUNIT wu;
     time_t t = 0;
-    int ret = 0;
 
     // t = min (create_time_of_oldest_wu, 31days_ago)
     t = time(0) - 32*86400;
@@ -262,25 +279,18 @@ static int delete_antiques() {
 
     // if fanout is configured, scan every fanout directory,
     // else just the plain upload directory
-    if (config.uldl_dir_fanout) {
-        for(int d = 0; d < config.uldl_dir_fanout; d++) {
-            char buf[270];
-            snprintf(buf, sizeof(buf), "%s/%x", config.upload_dir, d);
-            log_messages.printf(MSG_DEBUG,
-                "delete_antiques(): scanning upload fanout directory '%s'\n",
-                buf
-            );
-            ret = delete_antiques_from_dir(buf, t, apache_info->pw_uid);
-            if (ret < 0) return ret;
-        }
-    } else {
-        log_messages.printf(MSG_DEBUG,
-            "delete_antiques(): scanning upload directory '%s'\n",
-            config.upload_dir
-        );
-        ret = delete_antiques_from_dir(config.upload_dir, t, apache_info->pw_uid);
-    }
-    return ret;
+    //
+    ANTIQUE_SCAN as;
+    fanout_dirs(config.upload_dir, config.uldl_dir_fanout, as.dirs);
+    as.stop_file = config.project_path(STOP_DAEMONS_FILENAME);
+    as.mtime = t;
+    as.uid = apache_info->pw_uid;
+    as.nentries = 0;
+    as.stop = false;
+    as.retval = 0;
+    run_dir_workers((int)as.dirs.size(), nthreads, delete_antiques_from_dir, &as);
+    if (as.stop) check_stop_daemons();
+    return as.retval;
 }
 
 
@@ -304,6 +314,14 @@ int main(int argc, char** argv) {
             antiques_deletion_dry_run = true;
         } else if (is_arg(argv[i], "usleep")) {
             antique_usleep = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "nthreads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
+            if (nthreads < 1) nthreads = 1;
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -327,12 +345,7 @@ int main(int argc, char** argv) {
 
     log_messages.printf(MSG_NORMAL, "Starting\n");
 
-    retval = boinc_db.open(
-        config.replica_db_name,
-        config.replica_db_host,
-        config.replica_db_user,
-        config.replica_db_passwd
-    );
+    retval = open_replica_db(boinc_db);
     if (retval) {
         log_messages.printf(MSG_CRITICAL, "can't open DB\n");
         exit(1);
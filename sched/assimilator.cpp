@@ -27,6 +27,10 @@
 #include <unistd.h>
 #include <ctime>
 #include <vector>
+#include <string>
+#include <cerrno>
+#include <csignal>
+#include <sys/select.h>
 
 #include "boinc_db.h"
 #include "parse.h"
@@ -38,6 +42,7 @@
 
 #include "sched_config.h"
 #include "sched_util.h"
+#include "daemon_metrics.h"
 #include "sched_msgs.h"
 #include "assimilate_handler.h"
 
@@ -56,6 +61,10 @@ int g_argc;
 char** g_argv;
 char* results_prefix = NULL;
 char* transcripts_prefix = NULL;
+int nworkers = 0;
+    // if nonzero, run the handler in this many worker processes
+static int m_wus, m_deferred, m_pass_time;
+    // metrics
 
 void usage(char** argv) {
     fprintf(stderr,
@@ -74,6 +83,7 @@ void usage(char** argv) {
         "    [-d | --debug_level N]       Set verbosity level (1 to 4)\n"
         "    [--dont_update_db]    Don't update DB (for testing)\n"
         "    [--noinsert]          Don't insert records in app-specific DB\n"
+        "    [--nworkers N]        Run the handler in N worker processes\n"
         "    [-h | --help]                 Show this\n"
         "    [-v | --version]      Show version information\n",
         argv[0]
@@ -81,6 +91,262 @@ void usage(char** argv) {
     exit(0);
 }
 
+// With --nworkers N, the assimilator forks N worker processes,
+// each with its own DB connection, that run assimilate_handler().
+// This lets handlers that spend their time on I/O
+// (e.g. copying output files elsewhere) overlap.
+//
+// The parent enumerates WUs and their results,
+// and sends them to idle workers over pipes.
+// Each worker has at most WORKER_MAX_QUEUED WUs outstanding;
+// a WU's results can be larger than a pipe buffer,
+// so more than one would stall the parent on a busy worker.
+// Workers reply with the handler's return value,
+// and the parent updates assimilate_state for
+// UPDATE_BATCH_SIZE WUs at a time.
+//
+// A message to a worker is a WORKUNIT, a result count,
+// the RESULTs, and the index of the canonical result (or -1).
+//
+#define WORKER_MAX_QUEUED   1
+#define UPDATE_BATCH_SIZE   100
+
+struct WORKER {
+    int pid;
+    int to_fd;          // parent writes WUs here
+    int from_fd;        // worker writes WORKER_REPLYs here
+    int nqueued;
+};
+
+struct WORKER_REPLY {
+    int wuid;
+    int retval;
+    char name[256];
+};
+
+static vector<WORKER> workers;
+static vector<int> done_ids, deferred_ids;
+
+static void open_db() {
+    int retval = boinc_db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "Can't open DB\n");
+        exit(1);
+    }
+}
+
+static void worker_main(int in_fd, int out_fd) {
+    WORKUNIT wu;
+    RESULT canonical_result;
+    vector<RESULT> results;
+    WORKER_REPLY reply;
+    int n, icanonical;
+
+    open_db();
+    while (1) {
+        if (!read_all(in_fd, &wu, sizeof(wu))) {
+            // parent has exited
+            //
+            exit(0);
+        }
+        if (!read_all(in_fd, &n, sizeof(n))) exit(1);
+        results.resize(n);
+        if (n && !read_all(in_fd, &results[0], n*sizeof(RESULT))) exit(1);
+        if (!read_all(in_fd, &icanonical, sizeof(icanonical))) exit(1);
+        if (icanonical >= 0) {
+            canonical_result = results[icanonical];
+        } else {
+            canonical_result.clear();
+        }
+
+        reply.wuid = wu.id;
+        reply.retval = assimilate_handler(wu, results, canonical_result);
+        safe_strcpy(reply.name, wu.name);
+        if (!write_all(out_fd, &reply, sizeof(reply))) exit(1);
+    }
+}
+
+// fork the workers.
+// Do this before the parent opens its DB connection,
+// so that the children don't share its socket.
+//
+static void start_workers() {
+    int i, to_worker[2], from_worker[2];
+
+    signal(SIGPIPE, SIG_IGN);
+    for (i=0; i<nworkers; i++) {
+        if (pipe(to_worker) || pipe(from_worker)) {
+            log_messages.printf(MSG_CRITICAL, "pipe() failed; exiting\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            log_messages.printf(MSG_CRITICAL, "fork() failed; exiting\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (unsigned int j=0; j<workers.size(); j++) {
+                close(workers[j].to_fd);
+                close(workers[j].from_fd);
+            }
+            close(to_worker[1]);
+            close(from_worker[0]);
+            log_messages.pid = getpid();
+            worker_main(to_worker[0], from_worker[1]);
+            exit(0);
+        }
+        close(to_worker[0]);
+        close(from_worker[1]);
+        WORKER w;
+        w.pid = pid;
+        w.to_fd = to_worker[1];
+        w.from_fd = from_worker[0];
+        w.nqueued = 0;
+        workers.push_back(w);
+        log_messages.printf(MSG_NORMAL, "started worker %d (PID %d)\n", i, pid);
+    }
+}
+
+static void worker_died(WORKER& w) {
+    log_messages.printf(MSG_CRITICAL,
+        "worker PID %d exited; exiting\n", w.pid
+    );
+    exit(1);
+}
+
+static void update_assimilate_state(vector<int>& ids, int assimilate_state) {
+    char set_clause[256];
+    int retval;
+
+    if (ids.empty()) return;
+    std::string where_clause = "id in (";
+    for (unsigned int i=0; i<ids.size(); i++) {
+        char buf[32];
+        sprintf(buf, i?",%d":"%d", ids[i]);
+        where_clause += buf;
+    }
+    where_clause += ")";
+    sprintf(set_clause,
+        "assimilate_state=%d, transition_time=%d",
+        assimilate_state, (int)time(0)
+    );
+    DB_WORKUNIT wu;
+    retval = wu.update_fields_noid(set_clause, where_clause.c_str());
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "batch update of %d WUs failed: %s\n",
+            (int)ids.size(), boincerror(retval)
+        );
+        exit(1);
+    }
+    ids.clear();
+}
+
+static void flush_updates() {
+    update_assimilate_state(done_ids, ASSIMILATE_DONE);
+    update_assimilate_state(deferred_ids, ASSIMILATE_INIT);
+}
+
+// handle a reply from the given worker
+//
+static void handle_reply(WORKER& w) {
+    WORKER_REPLY reply;
+
+    if (!read_all(w.from_fd, &reply, sizeof(reply))) worker_died(w);
+    w.nqueued--;
+    if (reply.retval && reply.retval != DEFER_ASSIMILATION) {
+        log_messages.printf(MSG_CRITICAL,
+            "[%s] handler error: %s; exiting\n",
+            reply.name, boincerror(reply.retval)
+        );
+        flush_updates();
+        exit(reply.retval);
+    }
+    daemon_metrics.add(
+        reply.retval == DEFER_ASSIMILATION ? m_deferred : m_wus
+    );
+    if (!update_db) return;
+    if (reply.retval == DEFER_ASSIMILATION) {
+        deferred_ids.push_back(reply.wuid);
+    } else {
+        done_ids.push_back(reply.wuid);
+    }
+    if (done_ids.size() + deferred_ids.size() >= UPDATE_BATCH_SIZE) {
+        flush_updates();
+    }
+}
+
+// wait for a reply from any worker, and handle it
+//
+static void wait_for_reply() {
+    fd_set fds;
+    int maxfd = 0;
+    unsigned int i;
+
+    FD_ZERO(&fds);
+    for (i=0; i<workers.size(); i++) {
+        if (!workers[i].nqueued) continue;
+        FD_SET(workers[i].from_fd, &fds);
+        if (workers[i].from_fd > maxfd) maxfd = workers[i].from_fd;
+    }
+    int n = select(maxfd+1, &fds, NULL, NULL, NULL);
+    if (n < 0) {
+        if (errno == EINTR) return;
+        log_messages.printf(MSG_CRITICAL, "select() failed; exiting\n");
+        exit(1);
+    }
+    for (i=0; i<workers.size(); i++) {
+        if (FD_ISSET(workers[i].from_fd, &fds)) {
+            handle_reply(workers[i]);
+        }
+    }
+}
+
+// send a WU to the least-loaded worker,
+// first waiting for one to have room
+//
+static void send_to_worker(
+    WORKUNIT& wu, vector<RESULT>& results, int icanonical
+) {
+    unsigned int i;
+    WORKER* wp;
+
+    while (1) {
+        wp = &workers[0];
+        for (i=1; i<workers.size(); i++) {
+            if (workers[i].nqueued < wp->nqueued) wp = &workers[i];
+        }
+        if (wp->nqueued < WORKER_MAX_QUEUED) break;
+        wait_for_reply();
+    }
+    int n = (int)results.size();
+    if (!write_all(wp->to_fd, &wu, sizeof(wu))
+        || !write_all(wp->to_fd, &n, sizeof(n))
+        || (n && !write_all(wp->to_fd, &results[0], n*sizeof(RESULT)))
+        || !write_all(wp->to_fd, &icanonical, sizeof(icanonical))
+    ) {
+        worker_died(*wp);
+    }
+    wp->nqueued++;
+}
+
+// wait until all WUs sent to workers have been handled,
+// and update their assimilate_state
+//
+static void drain_workers() {
+    while (1) {
+        bool busy = false;
+        for (unsigned int i=0; i<workers.size(); i++) {
+            if (workers[i].nqueued) busy = true;
+        }
+        if (!busy) break;
+        wait_for_reply();
+    }
+    flush_updates();
+}
+
 // assimilate all WUs that need it
 // return nonzero (true) if did anything
 //
@@ -92,6 +358,7 @@ bool do_pass(APP& app) {
     char mod_clause[256];
     int retval;
     int num_assimilated=0;
+    double start = dtime();
 
     if (wu_id_modulus) {
         sprintf(mod_clause, " and workunit.id %% %d = %d ",
@@ -118,6 +385,7 @@ bool do_pass(APP& app) {
             break;
         }
         vector<RESULT> results;     // must be inside while()!
+        int icanonical = -1;
 
         // for testing purposes, pretend we did nothing
         //
@@ -146,6 +414,7 @@ bool do_pass(APP& app) {
             results.push_back(result);
             if (result.id == wu.canonical_resultid) {
                 canonical_result = result;
+                icanonical = (int)results.size() - 1;
                 found = true;
             }
         }
@@ -164,6 +433,13 @@ bool do_pass(APP& app) {
             wu.update_field(buf);
         }
 
+        num_assimilated++;
+
+        if (nworkers) {
+            send_to_worker(wu, results, icanonical);
+            continue;
+        }
+
         retval = assimilate_handler(wu, results, canonical_result);
         if (retval && retval != DEFER_ASSIMILATION) {
             log_messages.printf(MSG_CRITICAL,
@@ -171,6 +447,7 @@ bool do_pass(APP& app) {
             );
             exit(retval);
         }
+        daemon_metrics.add(retval == DEFER_ASSIMILATION ? m_deferred : m_wus);
 
         if (update_db) {
             // Defer assimilation until next result is returned
@@ -190,15 +467,20 @@ bool do_pass(APP& app) {
                 exit(1);
             }
         }
+    }
 
-        num_assimilated++;
-
+    // the WUs sent to workers are still ASSIMILATE_READY;
+    // finish them before the next enumeration
+    //
+    if (nworkers) {
+        drain_workers();
     }
 
     if (did_something) {
         boinc_db.commit_transaction();
     }
 
+    daemon_metrics.observe(m_pass_time, dtime() - start);
     if (num_assimilated)  {
         log_messages.printf(MSG_NORMAL,
             "Assimilated %d workunits.\n", num_assimilated
@@ -248,6 +530,8 @@ int main(int argc, char** argv) {
         } else if (is_arg(argv[i], "mod")) {
             wu_id_modulus   = atoi(argv[++i]);
             wu_id_remainder = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "nworkers")) {
+            nworkers = atoi(argv[++i]);
         } else if (is_arg(argv[i], "help") || is_arg(argv[i], "h")) {
             usage(argv);
         } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
@@ -284,11 +568,22 @@ int main(int argc, char** argv) {
 
     log_messages.printf(MSG_NORMAL, "Starting\n");
 
-    retval = boinc_db.open(config.db_name, config.db_host, config.db_user, config.db_passwd);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL, "Can't open DB\n");
-        exit(1);
+    sprintf(buf, "assimilator_%s", app.name);
+    daemon_metrics.open(buf);
+    m_wus = daemon_metrics.define(
+        "assimilator_wus", METRIC_COUNTER, "WUs assimilated"
+    );
+    m_deferred = daemon_metrics.define(
+        "assimilator_deferred", METRIC_COUNTER, "WUs whose assimilation was deferred"
+    );
+    m_pass_time = daemon_metrics.define(
+        "assimilator_pass_seconds", METRIC_HISTOGRAM, "Duration of passes"
+    );
+
+    if (nworkers) {
+        start_workers();
     }
+    open_db();
     sprintf(buf, "where name='%s'", app.name);
     retval = app.lookup(buf);
     if (retval) {
@@ -297,9 +592,11 @@ int main(int argc, char** argv) {
     }
     install_stop_signal_handler();
     do {
-        if (!do_pass(app)) {
+        if (do_pass(app)) {
+            daemon_notify("transitioner");
+        } else {
             if (!one_pass) {
-                daemon_sleep(sleep_interval);
+                daemon_sleep(sleep_interval, "assimilator");
             }
         }
         check_stop_daemons();
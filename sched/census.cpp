@@ -16,17 +16,35 @@
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
 // Census - scan the DB and create summary file: see usage() below
+//
+// With --daemon, run continuously and keep population statistics
+// in shared memory (see pop_stats.h):
+// scan the host table every --host_period seconds,
+// spreading each scan over --host_scan_time seconds,
+// and count unsent results every --result_period seconds.
+// The HR info file is still written after each host scan.
 
+#include "config.h"
 #include <cstdio>
+#include <cstring>
 
 #include "boinc_db.h"
 #include "str_util.h"
+#include "util.h"
 #include "sched_config.h"
 #include "sched_util.h"
 #include "sched_msgs.h"
 #include "hr_info.h"
+#include "pop_stats.h"
 #include "svn_version.h"
 
+#define HOST_CHUNK_SIZE     1000
+    // hosts per enumeration query, and between pacing checks
+
+double host_period = 86400;
+double host_scan_time = 3600;
+double result_period = 60;
+
 void usage(char *name) {
     fprintf(stderr,
         "This program scans the 'host' DB table and creates a file:\n\n"
@@ -36,18 +54,177 @@ void usage(char *name) {
         "For more info, see http://boinc.berkeley.edu/trac/wiki/HomogeneousRedundancy\n\n"
         "Usage: %s [OPTION]...\n\n"
         "Options:\n"
+        "  --daemon                 run continuously; keep stats in shared memory\n"
+        "  --host_period X          with --daemon: scan hosts every X sec (default 86400)\n"
+        "  --host_scan_time X       with --daemon: spread host scan over X sec (default 3600)\n"
+        "  --result_period X        with --daemon: count unsent results every X sec (default 60)\n"
         "  -h --help     shows this help text.\n"
         "  -v --version  shows version information.\n",
         HR_INFO_FILENAME, name
     );
 }
 
+// count unsent results of all apps, by size class, with one query
+//
+int count_unsent(POP_STATS& ps) {
+    char query[256];
+    MYSQL_ROW row;
+    MYSQL_RES* rp;
+
+    sprintf(query,
+        "select appid, size_class, count(*) from result where server_state=%d group by appid, size_class",
+        RESULT_SERVER_STATE_UNSENT
+    );
+    int retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    ps.clear_results();
+    while ((row = mysql_fetch_row(rp))) {
+        ps.add_unsent(atoi(row[0]), atoi(row[1]), atoi(row[2]));
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
+// copy the host part of the stats to shared memory
+//
+void publish_hosts(POP_STATS* shm, POP_STATS& ps) {
+    shm->begin_update();
+    shm->host_update_time = ps.host_update_time;
+    shm->nhosts = ps.nhosts;
+    shm->total_rac = ps.total_rac;
+    memcpy(shm->rac_per_class, ps.rac_per_class, sizeof(ps.rac_per_class));
+    memcpy(shm->nhosts_per_class, ps.nhosts_per_class, sizeof(ps.nhosts_per_class));
+    memcpy(shm->rac_hist, ps.rac_hist, sizeof(ps.rac_hist));
+    shm->end_update();
+}
+
+void publish_results(POP_STATS* shm, POP_STATS& ps) {
+    shm->begin_update();
+    shm->result_update_time = ps.result_update_time;
+    shm->result_period = result_period;
+    shm->napps = ps.napps;
+    memcpy(shm->apps, ps.apps, sizeof(ps.apps));
+    shm->end_update();
+}
+
+void daemon_loop() {
+    static POP_STATS ps;
+        // hosts scanned so far in this pass, and the last result count
+    HR_INFO hri;
+    DB_HOST host;
+    int retval, i, max_id = 0;
+    double now, scan_start = 0, next_scan_time = 0, next_result_time = 0;
+    bool scanning = false;
+
+    POP_STATS* shm = pop_stats_attach();
+    if (!shm) exit(1);
+    hri.init();
+
+    while (1) {
+        check_stop_daemons();
+        now = dtime();
+        if (now >= next_result_time) {
+            retval = count_unsent(ps);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "count_unsent(): %s\n", boincerror(retval)
+                );
+                exit(1);
+            }
+            ps.result_update_time = now;
+            publish_results(shm, ps);
+            next_result_time = now + result_period;
+        }
+        if (!scanning && now >= next_scan_time) {
+            log_messages.printf(MSG_NORMAL, "starting host scan\n");
+            ps.clear_hosts();
+            host.max_id(max_id);
+            scan_start = now;
+            next_scan_time = now + host_period;
+            scanning = true;
+        }
+
+        // do the next chunk of the host scan, if it's due.
+        // Chunk k of a scan of IDs up to max_id is due at
+        // scan_start + host_scan_time*(last ID)/max_id
+        //
+        if (scanning) {
+            double due = scan_start;
+            if (max_id > 0 && host.cursor.active) {
+                due += host_scan_time*host.cursor.last_id/max_id;
+            }
+            if (now >= due) {
+                for (i=0; i<HOST_CHUNK_SIZE; i++) {
+                    retval = host.enumerate_by_id("expavg_credit>1", HOST_CHUNK_SIZE);
+                    if (retval) break;
+                    ps.add_host(host);
+                }
+                if (i < HOST_CHUNK_SIZE) {
+                    if (retval != ERR_DB_NOT_FOUND) {
+                        log_messages.printf(MSG_CRITICAL,
+                            "host enum: %s\n", boincerror(retval)
+                        );
+                        exit(1);
+                    }
+                    scanning = false;
+                    ps.host_update_time = dtime();
+                    publish_hosts(shm, ps);
+                    for (int j=1; j<HR_NTYPES; j++) {
+                        for (int k=0; k<hr_nclasses[j]; k++) {
+                            hri.rac_per_class[j][k] = ps.rac_per_class[j][k];
+                        }
+                    }
+                    hri.write_file();
+                    log_messages.printf(MSG_NORMAL,
+                        "host scan done: %d hosts, %.0f total RAC\n",
+                        ps.nhosts, ps.total_rac
+                    );
+                }
+                continue;
+            }
+        }
+        daemon_sleep(1);
+    }
+}
+
 int main(int argc, char** argv) {
     HR_INFO hri;
     int retval;
-    
+    bool daemon_mode = false;
+
     for (int i=1; i<argc; i++) {
-        if (is_arg(argv[i], "help") || is_arg(argv[i], "h")) {
+        if (is_arg(argv[i], "daemon")) {
+            daemon_mode = true;
+        } else if (is_arg(argv[i], "host_period")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL,
+                    "%s requires an argument\n\n", argv[--i]
+                );
+                usage(argv[0]);
+                exit(1);
+            }
+            host_period = atof(argv[i]);
+        } else if (is_arg(argv[i], "host_scan_time")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL,
+                    "%s requires an argument\n\n", argv[--i]
+                );
+                usage(argv[0]);
+                exit(1);
+            }
+            host_scan_time = atof(argv[i]);
+        } else if (is_arg(argv[i], "result_period")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL,
+                    "%s requires an argument\n\n", argv[--i]
+                );
+                usage(argv[0]);
+                exit(1);
+            }
+            result_period = atof(argv[i]);
+        } else if (is_arg(argv[i], "help") || is_arg(argv[i], "h")) {
             usage(argv[0]);
             exit(0);
         } else if (is_arg(argv[i], "version") || is_arg(argv[i], "v")) {
@@ -69,15 +246,22 @@ int main(int argc, char** argv) {
         );
         exit(1);
     }
-    retval = boinc_db.open(
-        config.db_name, config.db_host, config.db_user, config.db_passwd
-    );
+    retval = open_replica_db(boinc_db);
     if (retval) {
         log_messages.printf(MSG_CRITICAL, "Can't open DB\n");
         exit(1);
     }
     log_messages.printf(MSG_NORMAL, "Starting\n");
     boinc_db.set_isolation_level(READ_UNCOMMITTED);
+    if (daemon_mode) {
+        if (!config.pop_stats_shmem_key) {
+            log_messages.printf(MSG_CRITICAL,
+                "--daemon requires <pop_stats_shmem_key> in config.xml\n"
+            );
+            exit(1);
+        }
+        daemon_loop();
+    }
     hri.init();
     hri.scan_db();
     hri.write_file();
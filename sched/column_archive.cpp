@@ -0,0 +1,263 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Reading and writing columnar archive files; see column_archive.h
+
+#include "config.h"
+#include <cstring>
+
+#include "error_numbers.h"
+
+#include "column_archive.h"
+
+void ARCHIVE_COLUMN::clear_values() {
+    ints.clear();
+    doubles.clear();
+    lengths.clear();
+    chars.clear();
+}
+
+////////// writer ///////////////
+
+COLUMN_ARCHIVE_WRITER::COLUMN_ARCHIVE_WRITER() {
+    f = NULL;
+    offset = 0;
+    nrows = 0;
+    cur_col = 0;
+}
+
+int COLUMN_ARCHIVE_WRITER::write(const void* p, size_t n) {
+    if (n && fwrite(p, 1, n, f) != n) return ERR_FWRITE;
+    offset += n;
+    return 0;
+}
+
+int COLUMN_ARCHIVE_WRITER::write_int(int x) {
+    return write(&x, sizeof(x));
+}
+
+void COLUMN_ARCHIVE_WRITER::add_column(const char* name, int type) {
+    ARCHIVE_COLUMN c;
+    c.name = name;
+    c.type = type;
+    columns.push_back(c);
+}
+
+int COLUMN_ARCHIVE_WRITER::open(FILE* _f) {
+    int retval;
+
+    f = _f;
+    offset = 0;
+    nrows = 0;
+    cur_col = 0;
+    groups.clear();
+    retval = write(COLUMN_ARCHIVE_MAGIC, 4);
+    if (!retval) retval = write_int((int)columns.size());
+    for (unsigned int i=0; i<columns.size() && !retval; i++) {
+        ARCHIVE_COLUMN& c = columns[i];
+        c.clear_values();
+        retval = write_int(c.type);
+        if (!retval) retval = write_int((int)c.name.size());
+        if (!retval) retval = write(c.name.c_str(), c.name.size());
+    }
+    return retval;
+}
+
+void COLUMN_ARCHIVE_WRITER::add_int(int x) {
+    columns[cur_col++].ints.push_back(x);
+}
+
+void COLUMN_ARCHIVE_WRITER::add_double(double x) {
+    columns[cur_col++].doubles.push_back(x);
+}
+
+void COLUMN_ARCHIVE_WRITER::add_string(const char* p) {
+    ARCHIVE_COLUMN& c = columns[cur_col++];
+    int n = (int)strlen(p);
+    c.lengths.push_back(n);
+    c.chars.append(p, n);
+}
+
+int COLUMN_ARCHIVE_WRITER::end_row() {
+    if (cur_col != columns.size()) return ERR_INVALID_PARAM;
+    cur_col = 0;
+    if (++nrows >= COLUMN_ARCHIVE_GROUP_ROWS) {
+        return flush_group();
+    }
+    return 0;
+}
+
+int COLUMN_ARCHIVE_WRITER::flush_group() {
+    int retval;
+
+    if (!nrows) return 0;
+
+    ARCHIVE_GROUP_INFO gi;
+    gi.offset = offset;
+    gi.nrows = nrows;
+    gi.min_id = gi.max_id = columns[0].ints[0];
+    for (int i=1; i<nrows; i++) {
+        int id = columns[0].ints[i];
+        if (id < gi.min_id) gi.min_id = id;
+        if (id > gi.max_id) gi.max_id = id;
+    }
+    groups.push_back(gi);
+
+    retval = write_int(nrows);
+    for (unsigned int i=0; i<columns.size() && !retval; i++) {
+        ARCHIVE_COLUMN& c = columns[i];
+        switch (c.type) {
+        case COLUMN_INT:
+            retval = write_int(nrows*sizeof(int));
+            if (!retval) retval = write(&c.ints[0], nrows*sizeof(int));
+            break;
+        case COLUMN_DOUBLE:
+            retval = write_int(nrows*sizeof(double));
+            if (!retval) retval = write(&c.doubles[0], nrows*sizeof(double));
+            break;
+        case COLUMN_STRING:
+            retval = write_int(nrows*sizeof(int) + c.chars.size());
+            if (!retval) retval = write(&c.lengths[0], nrows*sizeof(int));
+            if (!retval) retval = write(c.chars.data(), c.chars.size());
+            break;
+        }
+        c.clear_values();
+    }
+    nrows = 0;
+    return retval;
+}
+
+int COLUMN_ARCHIVE_WRITER::close() {
+    int retval;
+
+    if (!f) return 0;
+    retval = flush_group();
+    long long footer_offset = offset;
+    if (!retval) retval = write_int(-1);
+    if (!retval) retval = write_int((int)groups.size());
+    for (unsigned int i=0; i<groups.size() && !retval; i++) {
+        ARCHIVE_GROUP_INFO& gi = groups[i];
+        retval = write(&gi.offset, sizeof(gi.offset));
+        if (!retval) retval = write_int(gi.nrows);
+        if (!retval) retval = write_int(gi.min_id);
+        if (!retval) retval = write_int(gi.max_id);
+    }
+    if (!retval) retval = write(&footer_offset, sizeof(footer_offset));
+    if (!retval) retval = write(COLUMN_ARCHIVE_MAGIC, 4);
+    f = NULL;
+    return retval;
+}
+
+////////// reader ///////////////
+
+COLUMN_ARCHIVE_READER::COLUMN_ARCHIVE_READER() {
+    f = NULL;
+    nrows = 0;
+}
+
+int COLUMN_ARCHIVE_READER::read(void* p, size_t n) {
+    if (n && fread(p, 1, n, f) != n) return ERR_FREAD;
+    return 0;
+}
+
+int COLUMN_ARCHIVE_READER::read_int(int& x) {
+    return read(&x, sizeof(x));
+}
+
+int COLUMN_ARCHIVE_READER::open(FILE* _f) {
+    char magic[4];
+    int retval, ncols, len;
+
+    f = _f;
+    columns.clear();
+    retval = read(magic, 4);
+    if (retval) return retval;
+    if (memcmp(magic, COLUMN_ARCHIVE_MAGIC, 4)) return ERR_FREAD;
+    retval = read_int(ncols);
+    if (retval) return retval;
+    if (ncols <= 0) return ERR_FREAD;
+    for (int i=0; i<ncols; i++) {
+        ARCHIVE_COLUMN c;
+        retval = read_int(c.type);
+        if (!retval) retval = read_int(len);
+        if (retval) return retval;
+        if (len < 0) return ERR_FREAD;
+        c.name.resize(len);
+        if (len) {
+            retval = read(&c.name[0], len);
+            if (retval) return retval;
+        }
+        columns.push_back(c);
+    }
+    return 0;
+}
+
+int COLUMN_ARCHIVE_READER::read_group(std::vector<bool>& want) {
+    int retval, nbytes;
+
+    retval = read_int(nrows);
+    if (retval) return retval;
+    if (nrows < 0) return ERR_NOT_FOUND;
+    for (unsigned int i=0; i<columns.size(); i++) {
+        ARCHIVE_COLUMN& c = columns[i];
+        c.clear_values();
+        retval = read_int(nbytes);
+        if (retval) return retval;
+        if (nbytes < 0) return ERR_FREAD;
+        if (!want.empty() && !want[i]) {
+            // f may be a pipe, so fall back to reading
+            //
+            if (fseek(f, nbytes, SEEK_CUR)) {
+                std::string junk;
+                junk.resize(nbytes);
+                if (nbytes && read(&junk[0], nbytes)) return ERR_FREAD;
+            }
+            continue;
+        }
+        switch (c.type) {
+        case COLUMN_INT:
+            if (nbytes != nrows*(int)sizeof(int)) return ERR_FREAD;
+            c.ints.resize(nrows);
+            if (nrows) retval = read(&c.ints[0], nbytes);
+            break;
+        case COLUMN_DOUBLE:
+            if (nbytes != nrows*(int)sizeof(double)) return ERR_FREAD;
+            c.doubles.resize(nrows);
+            if (nrows) retval = read(&c.doubles[0], nbytes);
+            break;
+        case COLUMN_STRING:
+            if (nbytes < nrows*(int)sizeof(int)) return ERR_FREAD;
+            c.lengths.resize(nrows);
+            if (nrows) retval = read(&c.lengths[0], nrows*sizeof(int));
+            if (retval) return retval;
+            c.chars.resize(nbytes - nrows*sizeof(int));
+            if (c.chars.size()) retval = read(&c.chars[0], c.chars.size());
+            break;
+        default:
+            return ERR_FREAD;
+        }
+        if (retval) return retval;
+    }
+    return 0;
+}
+
+int COLUMN_ARCHIVE_READER::column_index(const char* name) {
+    for (unsigned int i=0; i<columns.size(); i++) {
+        if (columns[i].name == name) return (int)i;
+    }
+    return -1;
+}
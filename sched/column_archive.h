@@ -0,0 +1,128 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Columnar archive files, written by db_purge --columnar
+// and read by db_archive_dump.
+//
+// Rows are stored in groups of up to COLUMN_ARCHIVE_GROUP_ROWS;
+// within a group, the values of each column are contiguous,
+// so a reader can skip the columns it doesn't want.
+// All numbers are in host byte order.
+//
+// file:    "BCA1" ncols (type namelen name)*ncols group* footer
+// group:   nrows (nbytes data)*ncols
+//          int column: nrows ints
+//          double column: nrows doubles
+//          string column: nrows lengths, then the concatenated strings
+// footer:  -1 ngroups (offset nrows min_id max_id)*ngroups
+//          footer_offset "BCA1"
+//
+// Offsets are 8 bytes, everything else is 4 (or 8 for doubles).
+// The -1 ends a sequential read; the footer lets a reader of an
+// uncompressed file seek to a group with a given ID range.
+// The first column must be an int ID.
+
+#ifndef BOINC_COLUMN_ARCHIVE_H
+#define BOINC_COLUMN_ARCHIVE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define COLUMN_ARCHIVE_MAGIC        "BCA1"
+#define COLUMN_ARCHIVE_GROUP_ROWS   1000
+
+#define COLUMN_INT      0
+#define COLUMN_DOUBLE   1
+#define COLUMN_STRING   2
+
+struct ARCHIVE_COLUMN {
+    std::string name;
+    int type;
+
+    // the current group's values
+    //
+    std::vector<int> ints;
+    std::vector<double> doubles;
+    std::vector<int> lengths;
+    std::string chars;
+
+    void clear_values();
+};
+
+struct ARCHIVE_GROUP_INFO {
+    long long offset;
+    int nrows;
+    int min_id;
+    int max_id;
+};
+
+class COLUMN_ARCHIVE_WRITER {
+    FILE* f;
+    long long offset;       // bytes written so far; f may be a pipe
+    int nrows;              // in current group
+    unsigned int cur_col;   // next column of current row
+    std::vector<ARCHIVE_GROUP_INFO> groups;
+
+    int write(const void*, size_t);
+    int write_int(int);
+    int flush_group();
+public:
+    std::vector<ARCHIVE_COLUMN> columns;
+
+    COLUMN_ARCHIVE_WRITER();
+
+    // define the columns, then open(),
+    // then add each row's values in column order
+    //
+    void add_column(const char* name, int type);
+    int open(FILE*);
+    void add_int(int);
+    void add_double(double);
+    void add_string(const char*);
+    int end_row();
+
+    // write the last group and the footer.
+    // Doesn't close the FILE.
+    //
+    int close();
+    bool is_open() {return f != NULL;}
+};
+
+class COLUMN_ARCHIVE_READER {
+    FILE* f;
+    int read(void*, size_t);
+    int read_int(int&);
+public:
+    std::vector<ARCHIVE_COLUMN> columns;
+    int nrows;              // in the current group
+
+    COLUMN_ARCHIVE_READER();
+
+    // read the header
+    //
+    int open(FILE*);
+
+    // read the next group into columns[].
+    // If want is nonempty, skip columns i for which !want[i].
+    // Return ERR_NOT_FOUND at the end of the groups.
+    //
+    int read_group(std::vector<bool>& want);
+    int column_index(const char* name);
+};
+
+#endif
@@ -23,9 +23,11 @@
 // because you might grant credit e.g. from a trickle handler
 
 #include <cmath>
+#include <map>
 
 #include "boinc_db.h"
 #include "error_numbers.h"
+#include "str_replace.h"
 
 #include "sched_config.h"
 #include "sched_customize.h"
@@ -44,10 +46,170 @@ double cpu_time_to_credit(double cpu_time, double cpu_flops_sec) {
     return fpops_to_credit(cpu_time*cpu_flops_sec);
 }
 
+// Coalesced user and team credit (see start_credit_journal()).
+// Grants are recorded in the credit_journal table,
+// and summed per user in memory;
+// flush_credit() applies the sums to the user and team records
+// and deletes the journal records, in one transaction.
+//
+struct CREDIT_DELTA {
+    double credit;
+    double start_time;      // earliest
+    CREDIT_DELTA() {credit = 0; start_time = 0;}
+    void add(double c, double st) {
+        credit += c;
+        if (!start_time || st < start_time) start_time = st;
+    }
+};
+
+static char journal_owner[256];
+static int credit_flush_interval;
+static double last_credit_flush;
+static int journal_max_id;
+static std::map<int, CREDIT_DELTA> user_deltas;
+
+void start_credit_journal(const char* owner, int flush_interval) {
+    safe_strcpy(journal_owner, owner);
+    credit_flush_interval = flush_interval;
+    last_credit_flush = dtime();
+}
+
+// apply a credit delta to a user or team record
+//
+static int apply_delta(DB_BASE& rec, CREDIT_DELTA& d, double now,
+    double& expavg_credit, double& expavg_time
+) {
+    char buf[256];
+    update_average(
+        now,
+        d.start_time, d.credit, CREDIT_HALF_LIFE,
+        expavg_credit, expavg_time
+    );
+    sprintf(buf,
+        "total_credit=total_credit+%.15e, expavg_credit=%.15e, expavg_time=%.15e",
+        d.credit, expavg_credit, expavg_time
+    );
+    return rec.update_field(buf);
+}
+
+// apply user_deltas, and delete the journal records given by the clause.
+// Users and teams are updated in ID order, to avoid deadlocks
+// between validators.
+//
+static int apply_user_deltas(const char* journal_clause) {
+    DB_USER user;
+    DB_TEAM team;
+    std::map<int, CREDIT_DELTA> team_deltas;
+    std::map<int, CREDIT_DELTA>::iterator i;
+    char query[512];
+    int retval;
+    double now = dtime();
+
+    retval = boinc_db.start_transaction();
+    if (retval) return retval;
+    for (i=user_deltas.begin(); i!=user_deltas.end(); i++) {
+        retval = user.lookup_id(i->first);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "lookup of user %d failed: %s\n", i->first, boincerror(retval)
+            );
+            continue;
+        }
+        retval = apply_delta(
+            user, i->second, now, user.expavg_credit, user.expavg_time
+        );
+        if (retval) goto error;
+        if (user.teamid) {
+            team_deltas[user.teamid].add(i->second.credit, i->second.start_time);
+        }
+    }
+    for (i=team_deltas.begin(); i!=team_deltas.end(); i++) {
+        retval = team.lookup_id(i->first);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "lookup of team %d failed: %s\n", i->first, boincerror(retval)
+            );
+            continue;
+        }
+        retval = apply_delta(
+            team, i->second, now, team.expavg_credit, team.expavg_time
+        );
+        if (retval) goto error;
+    }
+    sprintf(query, "delete from credit_journal where %s", journal_clause);
+    retval = boinc_db.do_query(query);
+    if (retval) goto error;
+    retval = boinc_db.commit_transaction();
+    if (retval) goto error;
+    if (config.debug_credit) {
+        log_messages.printf(MSG_NORMAL,
+            "[credit] flushed credit for %d users, %d teams\n",
+            (int)user_deltas.size(), (int)team_deltas.size()
+        );
+    }
+    user_deltas.clear();
+    return 0;
+error:
+    log_messages.printf(MSG_CRITICAL,
+        "credit flush failed: %s; %s\n",
+        boincerror(retval), boinc_db.error_string()
+    );
+    boinc_db.rollback_transaction();
+    return retval;
+}
+
+int flush_credit(bool force) {
+    char clause[512];
+
+    if (!strlen(journal_owner)) return 0;
+    if (!force && dtime() < last_credit_flush + credit_flush_interval) {
+        return 0;
+    }
+    last_credit_flush = dtime();
+    if (user_deltas.empty()) return 0;
+    sprintf(clause, "owner='%s' and id<=%d", journal_owner, journal_max_id);
+    return apply_user_deltas(clause);
+}
+
+// apply and delete journal records left by processes
+// whose owner names start with the given prefix
+// (e.g. after a crash)
+//
+int recover_credit_journal(const char* owner_prefix) {
+    char query[512], clause[512];
+    MYSQL_ROW row;
+    MYSQL_RES* rp;
+    int retval, n=0;
+
+    sprintf(clause, "left(owner, %d)='%s'",
+        (int)strlen(owner_prefix), owner_prefix
+    );
+    sprintf(query,
+        "select userid, sum(credit), min(start_time) from credit_journal"
+        " where %s group by userid", clause
+    );
+    retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    while ((row = mysql_fetch_row(rp))) {
+        user_deltas[atoi(row[0])].add(atof(row[1]), atof(row[2]));
+        n++;
+    }
+    mysql_free_result(rp);
+    if (!n) return 0;
+    log_messages.printf(MSG_NORMAL,
+        "applying journaled credit for %d users\n", n
+    );
+    return apply_user_deltas(clause);
+}
+
 // Grant the host (and associated user and team)
 // the given amount of credit for work that started at the given time.
 // Update the user and team records,
-// but not the host record (caller must update)
+// but not the host record (caller must update).
+// If start_credit_journal() was called,
+// the user and team records are updated later, by flush_credit().
 //
 int grant_credit(DB_HOST &host, double start_time, double credit) {
     DB_USER user;
@@ -65,6 +227,25 @@ int grant_credit(DB_HOST &host, double start_time, double credit) {
     );
     host.total_credit += credit;
 
+    if (strlen(journal_owner)) {
+        char query[512];
+        sprintf(query,
+            "insert into credit_journal (owner, userid, start_time, credit)"
+            " values ('%s', %d, %.15e, %.15e)",
+            journal_owner, host.userid, start_time, credit
+        );
+        retval = boinc_db.do_query(query);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "credit journal insert failed: %s\n", boincerror(retval)
+            );
+            return retval;
+        }
+        journal_max_id = boinc_db.insert_id();
+        user_deltas[host.userid].add(credit, start_time);
+        return 0;
+    }
+
     // then the user
 
     retval = user.lookup_id(host.userid);
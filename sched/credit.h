@@ -41,6 +41,17 @@ extern double fpops_to_credit(double fpops);
 extern double cpu_time_to_credit(double cpu_time, double cpu_flops_sec);
 extern int grant_credit(DB_HOST& host, double start_time, double credit);
 
+// Coalesce user and team credit:
+// after start_credit_journal(), grant_credit() records grants in
+// the credit_journal table under the given owner name,
+// and flush_credit() updates the user and team records.
+// recover_credit_journal() applies records left by earlier processes.
+//
+extern void start_credit_journal(const char* owner, int flush_interval);
+extern int flush_credit(bool force);
+    // flush if force, or if flush_interval has elapsed
+extern int recover_credit_journal(const char* owner_prefix);
+
 extern int update_av_scales(struct SCHED_SHMEM*);
 extern int assign_credit_set(
     WORKUNIT&, std::vector<RESULT>&, DB_APP&, std::vector<DB_APP_VERSION>&,
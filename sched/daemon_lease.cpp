@@ -0,0 +1,214 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Dynamic partitioning of work among daemon instances;
+// see daemon_lease.h
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+
+#include "boinc_db.h"
+#include "error_numbers.h"
+
+#include "sched_msgs.h"
+
+#include "daemon_lease.h"
+
+using std::string;
+using std::vector;
+
+DAEMON_LEASE::DAEMON_LEASE(const char* n, int lp) {
+    char host[256], buf[512];
+    name = n;
+    lease_period = lp;
+    rows_created = false;
+    pid = (int)getpid();
+    if (gethostname(host, sizeof(host))) strcpy(host, "localhost");
+    host[sizeof(host)-1] = 0;
+    sprintf(buf, "%s:%d", host, (int)getpid());
+    owner = buf;
+}
+
+// the number of live instances (including this one)
+//
+static int count_members(const char* name, int& n) {
+    char query[512];
+    MYSQL_RES* rp;
+    MYSQL_ROW row;
+
+    sprintf(query,
+        "select count(*) from daemon_member where daemon='%s'", name
+    );
+    int retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    row = mysql_fetch_row(rp);
+    n = (row && row[0])?atoi(row[0]):0;
+    mysql_free_result(rp);
+    return 0;
+}
+
+int DAEMON_LEASE::update() {
+    char query[1024];
+    int retval, nmembers;
+    int now = (int)time(0);
+    int expire = now + lease_period;
+    MYSQL_RES* rp;
+    MYSQL_ROW row;
+    vector<int> free_buckets;
+
+    // register (or renew) ourselves, and drop instances that are gone
+    //
+    sprintf(query,
+        "replace into daemon_member (daemon, owner, expire_time) values ('%s', '%s', %d)",
+        name.c_str(), owner.c_str(), expire
+    );
+    retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    sprintf(query,
+        "delete from daemon_member where daemon='%s' and expire_time<%d",
+        name.c_str(), now
+    );
+    boinc_db.do_query(query);
+
+    // the first time, make sure there's a row for each bucket
+    //
+    if (!rows_created) {
+        string values;
+        for (int i=0; i<LEASE_NBUCKETS; i++) {
+            char buf[256];
+            sprintf(buf, "%s('%s', %d, '', 0)", i?",":"", name.c_str(), i);
+            values += buf;
+        }
+        string q = "insert ignore into daemon_lease (daemon, bucket, owner, expire_time) values " + values;
+        retval = boinc_db.do_query(q.c_str());
+        if (retval) return retval;
+        rows_created = true;
+    }
+
+    // renew our leases
+    //
+    sprintf(query,
+        "update daemon_lease set expire_time=%d where daemon='%s' and owner='%s'",
+        expire, name.c_str(), owner.c_str()
+    );
+    retval = boinc_db.do_query(query);
+    if (retval) return retval;
+
+    // see which buckets are ours, and which are free
+    //
+    buckets.clear();
+    sprintf(query,
+        "select bucket, owner, expire_time from daemon_lease where daemon='%s'",
+        name.c_str()
+    );
+    retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    while ((row = mysql_fetch_row(rp))) {
+        int bucket = atoi(row[0]);
+        if (!strcmp(row[1], owner.c_str())) {
+            buckets.insert(bucket);
+        } else if (atoi(row[2]) < now) {
+            free_buckets.push_back(bucket);
+        }
+    }
+    mysql_free_result(rp);
+
+    retval = count_members(name.c_str(), nmembers);
+    if (retval) return retval;
+    if (nmembers < 1) nmembers = 1;
+    int target = (LEASE_NBUCKETS + nmembers - 1)/nmembers;
+
+    // if others have joined, release our extra buckets;
+    // they'll claim them
+    //
+    while ((int)buckets.size() > target) {
+        int bucket = *buckets.rbegin();
+        sprintf(query,
+            "update daemon_lease set owner='', expire_time=0 where daemon='%s' and bucket=%d and owner='%s'",
+            name.c_str(), bucket, owner.c_str()
+        );
+        retval = boinc_db.do_query(query);
+        if (retval) return retval;
+        buckets.erase(bucket);
+        log_messages.printf(MSG_NORMAL,
+            "[lease] released bucket %d (%d instances)\n", bucket, nmembers
+        );
+    }
+
+    // claim free buckets up to our share.
+    // Another instance may get a bucket first; the update checks this.
+    //
+    for (unsigned int i=0; i<free_buckets.size(); i++) {
+        if ((int)buckets.size() >= target) break;
+        int bucket = free_buckets[i];
+        sprintf(query,
+            "update daemon_lease set owner='%s', expire_time=%d where daemon='%s' and bucket=%d and expire_time<%d",
+            owner.c_str(), expire, name.c_str(), bucket, now
+        );
+        retval = boinc_db.do_query(query);
+        if (retval) return retval;
+        if (boinc_db.affected_rows() != 1) continue;
+        buckets.insert(bucket);
+        log_messages.printf(MSG_NORMAL,
+            "[lease] claimed bucket %d (%d instances)\n", bucket, nmembers
+        );
+    }
+    return 0;
+}
+
+void DAEMON_LEASE::get_clause(const char* id_field, string& clause) {
+    char buf[256];
+    std::set<int>::iterator i;
+
+    if (buckets.empty()) {
+        clause = " and 0 ";
+        return;
+    }
+    sprintf(buf, " and %s %% %d in (", id_field, LEASE_NBUCKETS);
+    clause = buf;
+    for (i=buckets.begin(); i!=buckets.end(); i++) {
+        if (i != buckets.begin()) clause += ",";
+        sprintf(buf, "%d", *i);
+        clause += buf;
+    }
+    clause += ") ";
+}
+
+void DAEMON_LEASE::release() {
+    char query[1024];
+    if ((int)getpid() != pid) return;
+    sprintf(query,
+        "update daemon_lease set owner='', expire_time=0 where daemon='%s' and owner='%s'",
+        name.c_str(), owner.c_str()
+    );
+    boinc_db.do_query(query);
+    sprintf(query,
+        "delete from daemon_member where daemon='%s' and owner='%s'",
+        name.c_str(), owner.c_str()
+    );
+    boinc_db.do_query(query);
+    buckets.clear();
+}
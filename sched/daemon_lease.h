@@ -0,0 +1,67 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Dynamic partitioning of work among instances of a daemon,
+// as an alternative to --mod N I.
+//
+// IDs are divided into LEASE_NBUCKETS buckets (ID mod LEASE_NBUCKETS).
+// Each instance registers in the daemon_member table,
+// and claims buckets in the daemon_lease table,
+// with leases that it renews on each pass.
+// Each takes an equal share of the buckets;
+// when instances start or stop (or die, and their leases expire)
+// the others claim or release buckets to match.
+//
+// An instance must renew its leases (call update())
+// more often than lease_period,
+// or another instance may take over its buckets.
+
+#ifndef BOINC_DAEMON_LEASE_H
+#define BOINC_DAEMON_LEASE_H
+
+#include <set>
+#include <string>
+
+#define LEASE_NBUCKETS      64
+#define LEASE_PERIOD        300
+
+struct DAEMON_LEASE {
+    std::string name;
+        // e.g. "transitioner"; instances with the same name share work
+    std::string owner;
+        // this instance: host:PID
+    int lease_period;
+    std::set<int> buckets;
+        // the buckets we hold
+    bool rows_created;
+    int pid;
+        // release() does nothing in other processes (e.g. forked workers)
+
+    DAEMON_LEASE(const char* name, int lease_period=LEASE_PERIOD);
+    int update();
+        // renew our leases, and claim or release buckets as needed.
+        // Call this at the start of each pass.
+    void get_clause(const char* id_field, std::string&);
+        // an SQL clause (" and ...") selecting our buckets
+    bool owns(int id) {
+        return buckets.count(id % LEASE_NBUCKETS) > 0;
+    }
+    void release();
+        // release our buckets and leave; call on exit
+};
+
+#endif
@@ -0,0 +1,224 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Daemon metrics; see daemon_metrics.h
+
+#include "config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "shmem.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "util.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "daemon_metrics.h"
+
+DAEMON_METRICS daemon_metrics;
+
+static char metrics_path[MAXPATHLEN];
+static int metrics_pid = 0;
+
+// remove the page on exit; not in forked workers, which share it
+//
+static void metrics_cleanup() {
+    if ((int)getpid() == metrics_pid) unlink(metrics_path);
+}
+
+int DAEMON_METRICS::open(const char* daemon, bool shared) {
+    void* p;
+
+    if (!config.daemon_metrics) return 0;
+    if (page) return 0;
+    boinc_mkdir(config.project_path(METRICS_DIR));
+    if (shared) {
+        snprintf(metrics_path, sizeof(metrics_path), "%s/%s",
+            config.project_path(METRICS_DIR), daemon
+        );
+    } else {
+        snprintf(metrics_path, sizeof(metrics_path), "%s/%s.%d",
+            config.project_path(METRICS_DIR), daemon, (int)getpid()
+        );
+        unlink(metrics_path);
+    }
+    int retval = create_shmem_mmap(metrics_path, sizeof(METRICS_PAGE), &p);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't create metrics page %s: %s\n",
+            metrics_path, boincerror(retval)
+        );
+        return retval;
+    }
+    page = (METRICS_PAGE*)p;
+    if (!shared) {
+        page->pid = (int)getpid();
+        metrics_pid = page->pid;
+        atexit(metrics_cleanup);
+    }
+    if (!page->start_time) {
+        safe_strcpy(page->daemon, daemon);
+        page->start_time = dtime();
+    }
+    page->version = METRICS_VERSION;
+    return 0;
+}
+
+int DAEMON_METRICS::define(const char* name, int type, const char* help) {
+    int i, index = -1;
+
+    if (!page) return -1;
+    while (!__sync_bool_compare_and_swap(&page->lock, 0, 1)) {
+        boinc_sleep(.001);
+    }
+    for (i=0; i<page->nmetrics; i++) {
+        if (!strcmp(page->metrics[i].name, name)) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0 && page->nmetrics < METRICS_MAX) {
+        index = page->nmetrics;
+        METRIC& m = page->metrics[index];
+        memset(&m, 0, sizeof(m));
+        safe_strcpy(m.name, name);
+        safe_strcpy(m.help, help);
+        m.type = type;
+        __sync_synchronize();
+        page->nmetrics++;
+    }
+    __sync_lock_release(&page->lock);
+    if (index < 0) {
+        log_messages.printf(MSG_CRITICAL,
+            "too many metrics; can't define %s\n", name
+        );
+    }
+    return index;
+}
+
+void DAEMON_METRICS::add(int i, unsigned long long n) {
+    if (!page || i < 0) return;
+    __sync_fetch_and_add(&page->metrics[i].count, n);
+}
+
+void DAEMON_METRICS::set(int i, double x) {
+    if (!page || i < 0) return;
+    page->metrics[i].value = x;
+}
+
+void DAEMON_METRICS::observe(int i, double secs) {
+    int j;
+
+    if (!page || i < 0) return;
+    if (secs < 0) secs = 0;
+    METRIC& m = page->metrics[i];
+    double bound = METRICS_BUCKET_MIN;
+    for (j=0; j<METRICS_NBUCKETS; j++) {
+        if (secs <= bound) break;
+        bound *= 2;
+    }
+    __sync_fetch_and_add(&m.buckets[j], 1ULL);
+    __sync_fetch_and_add(&m.sum_usec, (unsigned long long)(secs*1e6));
+    __sync_fetch_and_add(&m.count, 1ULL);
+}
+
+static const char* type_name(int type) {
+    switch (type) {
+    case METRIC_COUNTER: return "counter";
+    case METRIC_GAUGE: return "gauge";
+    case METRIC_HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+void print_metric_header(FILE* f, METRIC& m) {
+    fprintf(f, "# HELP boinc_%s %s\n", m.name, m.help);
+    fprintf(f, "# TYPE boinc_%s %s\n", m.name, type_name(m.type));
+}
+
+void METRICS_PAGE::print_samples(FILE* f, int i) {
+    char labels[256];
+    METRIC& m = metrics[i];
+
+    if (pid) {
+        snprintf(labels, sizeof(labels), "daemon=\"%s\",pid=\"%d\"",
+            daemon, pid
+        );
+    } else {
+        snprintf(labels, sizeof(labels), "daemon=\"%s\"", daemon);
+    }
+    switch (m.type) {
+    case METRIC_COUNTER:
+        fprintf(f, "boinc_%s{%s} %llu\n", m.name, labels, m.count);
+        break;
+    case METRIC_GAUGE:
+        fprintf(f, "boinc_%s{%s} %.15g\n", m.name, labels, m.value);
+        break;
+    case METRIC_HISTOGRAM:
+        {
+            unsigned long long n = 0;
+            double bound = METRICS_BUCKET_MIN;
+            for (int j=0; j<METRICS_NBUCKETS; j++) {
+                n += m.buckets[j];
+                fprintf(f, "boinc_%s_bucket{%s,le=\"%g\"} %llu\n",
+                    m.name, labels, bound, n
+                );
+                bound *= 2;
+            }
+            n += m.buckets[METRICS_NBUCKETS];
+            fprintf(f, "boinc_%s_bucket{%s,le=\"+Inf\"} %llu\n",
+                m.name, labels, n
+            );
+            fprintf(f, "boinc_%s_sum{%s} %.6f\n",
+                m.name, labels, (double)m.sum_usec/1e6
+            );
+            fprintf(f, "boinc_%s_count{%s} %llu\n", m.name, labels, n);
+        }
+        break;
+    }
+}
+
+int read_metrics_page(const char* path, METRICS_PAGE& page) {
+    FILE* f = boinc_fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    size_t n = fread(&page, 1, sizeof(page), f);
+    fclose(f);
+    if (n != sizeof(page)) return ERR_NOT_FOUND;
+    if (page.version != METRICS_VERSION) return ERR_NOT_FOUND;
+    if (page.nmetrics < 0 || page.nmetrics > METRICS_MAX) return ERR_NOT_FOUND;
+    page.daemon[sizeof(page.daemon)-1] = 0;
+    for (int i=0; i<page.nmetrics; i++) {
+        page.metrics[i].name[sizeof(page.metrics[i].name)-1] = 0;
+        page.metrics[i].help[sizeof(page.metrics[i].help)-1] = 0;
+    }
+
+    // the daemon exited without removing its page
+    //
+    if (page.pid && kill(page.pid, 0) && errno == ESRCH) {
+        return ERR_NOT_FOUND;
+    }
+    return 0;
+}
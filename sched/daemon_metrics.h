@@ -0,0 +1,111 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Metrics (counters, gauges and histograms) for server daemons.
+// Enabled by <daemon_metrics/> in config.xml.
+//
+// Each daemon keeps its metrics in a page of shared memory,
+// an mmap()ed file METRICS_DIR/NAME.PID in the project dir
+// (or METRICS_DIR/NAME for the scheduler,
+// whose processes share a page).
+// Updates are atomic adds or stores, so forked workers
+// and concurrent scheduler processes can update the same page.
+// The "metrics" program reads the pages
+// and prints them in Prometheus text format.
+//
+// Histograms are of durations in seconds, with buckets whose
+// upper bounds are METRICS_BUCKET_MIN * 2^i.
+
+#ifndef BOINC_DAEMON_METRICS_H
+#define BOINC_DAEMON_METRICS_H
+
+#include <cstdio>
+
+#define METRICS_DIR         "metrics"
+#define METRICS_VERSION     1
+#define METRICS_MAX         32
+#define METRICS_NBUCKETS    20
+#define METRICS_BUCKET_MIN  .001
+
+#define METRIC_COUNTER      0
+#define METRIC_GAUGE        1
+#define METRIC_HISTOGRAM    2
+
+struct METRIC {
+    char name[64];
+        // e.g. "transitioner_wus"; the collector prefixes "boinc_"
+    char help[128];
+    int type;
+    unsigned long long count;
+        // counter: the value; histogram: number of observations
+    unsigned long long sum_usec;
+        // histogram: sum of observations
+    double value;
+        // gauge
+    unsigned long long buckets[METRICS_NBUCKETS+1];
+        // histogram: observations in each bucket (not cumulative);
+        // the last is for those above all the bounds
+};
+
+struct METRICS_PAGE {
+    int version;
+    int pid;
+        // 0 if shared by several processes
+    char daemon[64];
+    double start_time;
+    int lock;
+        // held while defining a metric
+    int nmetrics;
+    METRIC metrics[METRICS_MAX];
+
+    void print_samples(FILE*, int i);
+        // write the samples of metric i in Prometheus text format
+};
+
+struct DAEMON_METRICS {
+    METRICS_PAGE* page;
+
+    DAEMON_METRICS() {
+        page = 0;
+    }
+    int open(const char* daemon, bool shared=false);
+        // create or attach to the daemon's page.
+        // Call after config.xml is parsed;
+        // does nothing unless <daemon_metrics/> is set.
+        // If shared, processes with this name share a page
+    int define(const char* name, int type, const char* help);
+        // return the metric's index, creating it if needed;
+        // -1 if metrics are off or the page is full.
+        // Updates of index -1 do nothing.
+    void add(int, unsigned long long n=1);
+        // counter
+    void set(int, double);
+        // gauge
+    void observe(int, double secs);
+        // histogram
+};
+
+extern DAEMON_METRICS daemon_metrics;
+
+extern void print_metric_header(FILE*, METRIC&);
+    // the HELP and TYPE lines of a metric
+
+extern int read_metrics_page(const char* path, METRICS_PAGE&);
+    // read a page from its file; ERR_NOT_FOUND if
+    // its process is gone, or it's not a metrics page
+
+#endif
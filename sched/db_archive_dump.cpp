@@ -0,0 +1,203 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// db_archive_dump: print a columnar archive written by db_purge --columnar
+// as tab-separated text, one line per row, with a header line.
+// Tabs, newlines and backslashes in strings are written as \t, \n and \\.
+//
+// For compressed archives, use e.g.
+// zcat wu_archive_TIME.bca.gz | db_archive_dump -
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "error_numbers.h"
+#include "str_util.h"
+#include "svn_version.h"
+
+#include "column_archive.h"
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Prints a columnar archive file written by db_purge --columnar.\n\n"
+        "Usage: %s [OPTION] file\n"
+        "    file may be '-' for standard input\n\n"
+        "Options:\n"
+        "  [ --columns a,b,c ]    Show only these columns\n"
+        "  [ --list_columns ]     List the columns and their types\n"
+        "  [ -h | --help ]        Show this help text.\n"
+        "  [ -v | --version ]     Shows version information.\n",
+        name
+    );
+}
+
+void print_string(const char* p, int len) {
+    for (int i=0; i<len; i++) {
+        switch (p[i]) {
+        case '\t': fputs("\\t", stdout); break;
+        case '\n': fputs("\\n", stdout); break;
+        case '\\': fputs("\\\\", stdout); break;
+        default: putchar(p[i]);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    COLUMN_ARCHIVE_READER reader;
+    std::vector<bool> want;
+    std::vector<int> shown;
+    std::vector<std::string> names;
+    const char* path = NULL;
+    const char* columns = NULL;
+    bool list_columns = false;
+    unsigned int i;
+    int j, retval;
+    FILE* f;
+
+    for (int c = 1; c < argc; c++) {
+        std::string option(argv[c]);
+        if (option == "-h" || option == "--help") {
+            usage(argv[0]);
+            exit(0);
+        } else if (option == "-v" || option == "--version") {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else if (option == "--columns") {
+            if (!argv[++c]) {
+                usage(argv[0]);
+                exit(1);
+            }
+            columns = argv[c];
+        } else if (option == "--list_columns") {
+            list_columns = true;
+        } else if (!path && (option == "-" || option[0] != '-')) {
+            path = argv[c];
+        } else {
+            fprintf(stderr, "unknown command line argument: %s\n\n", argv[c]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if (!strcmp(path, "-")) {
+        f = stdin;
+    } else {
+        f = fopen(path, "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", path);
+            exit(1);
+        }
+    }
+    retval = reader.open(f);
+    if (retval) {
+        fprintf(stderr, "%s is not a columnar archive\n", path);
+        exit(1);
+    }
+
+    if (list_columns) {
+        for (i=0; i<reader.columns.size(); i++) {
+            ARCHIVE_COLUMN& c = reader.columns[i];
+            printf("%s\t%s\n", c.name.c_str(),
+                c.type==COLUMN_INT?"int":c.type==COLUMN_DOUBLE?"double":"string"
+            );
+        }
+        exit(0);
+    }
+
+    if (columns) {
+        std::string s(columns);
+        size_t start = 0;
+        while (start <= s.size()) {
+            size_t end = s.find(',', start);
+            if (end == std::string::npos) end = s.size();
+            names.push_back(s.substr(start, end-start));
+            start = end+1;
+        }
+        want.resize(reader.columns.size(), false);
+        for (i=0; i<names.size(); i++) {
+            int k = reader.column_index(names[i].c_str());
+            if (k < 0) {
+                fprintf(stderr, "no column %s\n", names[i].c_str());
+                exit(1);
+            }
+            want[k] = true;
+            shown.push_back(k);
+        }
+    } else {
+        for (i=0; i<reader.columns.size(); i++) {
+            shown.push_back(i);
+        }
+    }
+
+    for (i=0; i<shown.size(); i++) {
+        printf("%s%s", i?"\t":"", reader.columns[shown[i]].name.c_str());
+    }
+    printf("\n");
+
+    while (1) {
+        retval = reader.read_group(want);
+        if (retval == ERR_NOT_FOUND) break;
+        if (retval) {
+            fprintf(stderr, "read error: %s\n", boincerror(retval));
+            exit(1);
+        }
+
+        // offsets of each string column's current value
+        //
+        std::vector<size_t> offsets(reader.columns.size(), 0);
+
+        for (j=0; j<reader.nrows; j++) {
+            for (i=0; i<shown.size(); i++) {
+                ARCHIVE_COLUMN& c = reader.columns[shown[i]];
+                if (i) putchar('\t');
+                switch (c.type) {
+                case COLUMN_INT:
+                    printf("%d", c.ints[j]);
+                    break;
+                case COLUMN_DOUBLE:
+                    printf("%.15e", c.doubles[j]);
+                    break;
+                case COLUMN_STRING:
+                    print_string(
+                        c.chars.data() + offsets[shown[i]], c.lengths[j]
+                    );
+                    break;
+                }
+            }
+            putchar('\n');
+
+            // advance string offsets (once per column, even if shown twice)
+            //
+            for (i=0; i<reader.columns.size(); i++) {
+                ARCHIVE_COLUMN& c = reader.columns[i];
+                if (c.type == COLUMN_STRING && !c.lengths.empty()) {
+                    offsets[i] += c.lengths[j];
+                }
+            }
+        }
+    }
+}
+
+const char *BOINC_RCSID_5d1e2b07c4 = "$Id$";
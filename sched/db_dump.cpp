@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <string>
 #include <vector>
 
@@ -71,6 +72,74 @@ const char* tag_name[3] = {"users", "teams", "hosts"};
 int nusers, nhosts, nteams;
 double total_credit;
 
+DB_CONN stream_db;
+    // for enumerations sorted by credit;
+    // writing a record may need queries on boinc_db
+
+int nprocs = 1;
+    // run up to this many enumerations at once, each in its own process
+int ncompress = 0;
+    // if nonzero, compress files in up to this many background processes
+
+// Background compression (--ncompress N).
+// Jobs are waited for in the order they were started.
+//
+struct COMPRESS_JOB {
+    int pid;
+    string cmd;
+};
+
+static vector<COMPRESS_JOB> compress_jobs;
+
+static void wait_oldest_compress() {
+    int status;
+
+    COMPRESS_JOB& job = compress_jobs[0];
+    waitpid(job.pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        log_messages.printf(MSG_CRITICAL, "%s failed\n", job.cmd.c_str());
+        exit(1);
+    }
+    compress_jobs.erase(compress_jobs.begin());
+}
+
+static void wait_compressions() {
+    while (!compress_jobs.empty()) {
+        wait_oldest_compress();
+    }
+}
+
+static void compress(const char* cmd) {
+    int retval;
+
+    if (!ncompress) {
+        retval = system(cmd);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "%s failed: %s\n", cmd, boincerror(retval)
+            );
+            exit(retval);
+        }
+        return;
+    }
+    while ((int)compress_jobs.size() >= ncompress) {
+        wait_oldest_compress();
+    }
+    int pid = fork();
+    if (pid < 0) {
+        log_messages.printf(MSG_CRITICAL, "fork() failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", cmd, (char*)0);
+        _exit(127);
+    }
+    COMPRESS_JOB job;
+    job.pid = pid;
+    job.cmd = cmd;
+    compress_jobs.push_back(job);
+}
+
 struct OUTPUT {
     int recs_per_file;
     bool detail;
@@ -235,31 +304,18 @@ public:
     }
 
     void close() {
-        char buf[256];
-        int retval;
+        char buf[MAXPATHLEN+256];
         if (f) {
             fprintf(f, "</%s>\n", tag.c_str());
             fclose(f);
             switch(compression) {
             case COMPRESSION_ZIP:
                 sprintf(buf, "zip -q %s", current_path);
-                retval = system(buf);
-                if (retval) {
-                    log_messages.printf(MSG_CRITICAL,
-                        "%s failed: %s\n", buf, boincerror(retval)
-                    );
-                    exit(retval);
-                }
+                compress(buf);
                 break;
             case COMPRESSION_GZIP:
                 sprintf(buf, "gzip -fq %s", current_path);
-                retval = system(buf);
-                if (retval) {
-                    log_messages.printf(MSG_CRITICAL,
-                        "%s failed: %s\n", buf, boincerror(retval)
-                    );
-                    exit(retval);
-                }
+                compress(buf);
                 break;
             }
             f = 0;
@@ -614,12 +670,25 @@ int tables_file(char* dir) {
     return 0;
 }
 
+// get the next record to dump.
+// Unsorted and ID-sorted dumps get records by ID ranges
+// (see DB_BASE::enumerate_by_id());
+// dumps sorted by credit stream the whole result set.
+// Either way memory use is bounded.
+//
+static int enumerate_dump(DB_BASE& table, int sort, const char* clause) {
+    if (sort == SORT_NONE || sort == SORT_ID) {
+        return table.enumerate_by_id("total_credit > 0");
+    }
+    return table.enumerate(clause, true);
+}
+
 int ENUMERATION::make_it_happen(char* output_dir) {
     unsigned int i;
     int n, retval;
-    DB_USER user;
-    DB_TEAM team;
-    DB_HOST host;
+    DB_USER user(&stream_db);
+    DB_TEAM team(&stream_db);
+    DB_HOST host(&stream_db);
     char clause[256];
     char path[MAXPATHLEN];
 
@@ -654,7 +723,7 @@ int ENUMERATION::make_it_happen(char* output_dir) {
     case TABLE_USER:
         n = 0;
         while (1) {
-            retval = user.enumerate(clause, true);
+            retval = enumerate_dump(user, sort, clause);
             if (retval) break;
             nusers++;
             total_credit += user.total_credit;
@@ -680,7 +749,7 @@ int ENUMERATION::make_it_happen(char* output_dir) {
     case TABLE_HOST:
         n = 0;
         while(1) {
-            retval = host.enumerate(clause);
+            retval = enumerate_dump(host, sort, clause);
             if (retval) break;
             if (!host.userid) continue;
             nhosts++;
@@ -706,7 +775,7 @@ int ENUMERATION::make_it_happen(char* output_dir) {
     case TABLE_TEAM:
         n = 0;
         while(1) {
-            retval = team.enumerate(clause);
+            retval = enumerate_dump(team, sort, clause);
             if (retval) break;
             nteams++;
             for (i=0; i<outputs.size(); i++) {
@@ -737,6 +806,115 @@ int ENUMERATION::make_it_happen(char* output_dir) {
     return 0;
 }
 
+static void open_conn(DB_CONN& db, char* db_host) {
+    int retval;
+    if (db_host) {
+        retval = db.open(
+            config.replica_db_name, db_host,
+            config.replica_db_user, config.replica_db_passwd
+        );
+    } else {
+        retval = open_replica_db(db);
+    }
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "Can't open DB\n");
+        exit(1);
+    }
+    retval = db.set_isolation_level(READ_UNCOMMITTED);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "set_isolation_level: %s; %s\n",
+            boincerror(retval), db.error_string()
+        );
+    }
+}
+
+void open_db(char* db_host) {
+    open_conn(boinc_db, db_host);
+    open_conn(stream_db, db_host);
+}
+
+// Parallel enumerations (--nprocs N).
+// Each enumeration runs in a child process with its own DB connection;
+// when done, the child sends its counts back over a pipe.
+// This is done before the parent opens its DB connection.
+//
+struct DUMP_TOTALS {
+    int nusers, nhosts, nteams;
+    double total_credit;
+};
+
+struct DUMP_CHILD {
+    int pid;
+    int fd;
+};
+
+static void wait_oldest_child(vector<DUMP_CHILD>& children) {
+    DUMP_TOTALS t;
+    int status;
+
+    DUMP_CHILD& c = children[0];
+    bool ok = read_all(c.fd, &t, sizeof(t));
+    close(c.fd);
+    waitpid(c.pid, &status, 0);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        log_messages.printf(MSG_CRITICAL,
+            "enumeration process %d failed\n", c.pid
+        );
+        exit(1);
+    }
+    nusers += t.nusers;
+    nhosts += t.nhosts;
+    nteams += t.nteams;
+    total_credit += t.total_credit;
+    children.erase(children.begin());
+}
+
+void do_enumerations_parallel(DUMP_SPEC& spec, char* db_host) {
+    vector<DUMP_CHILD> children;
+    int fds[2];
+
+    for (unsigned int j=0; j<spec.enumerations.size(); j++) {
+        while ((int)children.size() >= nprocs) {
+            wait_oldest_child(children);
+        }
+        if (pipe(fds)) {
+            log_messages.printf(MSG_CRITICAL, "pipe() failed\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            log_messages.printf(MSG_CRITICAL, "fork() failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            for (unsigned int k=0; k<children.size(); k++) {
+                close(children[k].fd);
+            }
+            log_messages.pid = getpid();
+            open_db(db_host);
+            spec.enumerations[j].make_it_happen(spec.output_dir);
+            wait_compressions();
+            DUMP_TOTALS t;
+            t.nusers = nusers;
+            t.nhosts = nhosts;
+            t.nteams = nteams;
+            t.total_credit = total_credit;
+            if (!write_all(fds[1], &t, sizeof(t))) exit(1);
+            exit(0);
+        }
+        close(fds[1]);
+        DUMP_CHILD c;
+        c.pid = pid;
+        c.fd = fds[0];
+        children.push_back(c);
+    }
+    while (!children.empty()) {
+        wait_oldest_child(children);
+    }
+}
+
 void usage(char* name) {
     fprintf(stderr,
         "This program generates XML files containing project statistics.\n"
@@ -747,6 +925,8 @@ void usage(char* name) {
         "    --dump_spec filename          Use the given config file (use ../db_dump_spec.xml)\n"
         "    [-d N | --debug_level]        Set verbosity level (1 to 4)\n"
         "    [--db_host H]                 Use the DB server on host H\n"
+        "    [--nprocs N]                  Run up to N enumerations at once\n"
+        "    [--ncompress N]               Compress files in up to N background processes\n"
         "    [-h | --help]                 Show this\n"
         "    [-v | --version]              Show version information\n",
         name
@@ -789,6 +969,20 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             db_host = argv[i];
+        } else if (is_arg(argv[i], "nprocs")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nprocs = atoi(argv[i]);
+        } else if (is_arg(argv[i], "ncompress")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            ncompress = atoi(argv[i]);
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -837,33 +1031,21 @@ int main(int argc, char** argv) {
         );
         exit(1);
     }
-    retval = boinc_db.open(
-        config.replica_db_name,
-        db_host?db_host:config.replica_db_host,
-        config.replica_db_user,
-        config.replica_db_passwd
-    );
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL, "Can't open DB\n");
-        exit(1);
-    }
-    retval = boinc_db.set_isolation_level(READ_UNCOMMITTED);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "boinc_db.set_isolation_level: %s; %s\n",
-            boincerror(retval), boinc_db.error_string()
-        );
-    }
-
     boinc_mkdir(spec.output_dir);
 
-    unsigned int j;
-    for (j=0; j<spec.enumerations.size(); j++) {
-        ENUMERATION& e = spec.enumerations[j];
-        e.make_it_happen(spec.output_dir);
+    if (nprocs > 1) {
+        do_enumerations_parallel(spec, db_host);
+        open_db(db_host);
+    } else {
+        open_db(db_host);
+        for (unsigned int j=0; j<spec.enumerations.size(); j++) {
+            ENUMERATION& e = spec.enumerations[j];
+            e.make_it_happen(spec.output_dir);
+        }
     }
 
     tables_file(spec.output_dir);
+    wait_compressions();
 
     sprintf(buf, "cp %s %s/db_dump.xml", spec_filename, spec.output_dir);
     retval = system(buf);
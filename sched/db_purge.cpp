@@ -27,6 +27,19 @@
 // where TIME is the time it was created.
 // In addition there are index files associating each WU and result ID
 // with the timestamp of the file it's in.
+//
+// With --columnar, the WU and result archives are instead
+// columnar files (see column_archive.h) named
+// wu_archive_TIME.bca and result_archive_TIME.bca;
+// use db_archive_dump to read them.
+//
+// With --archive_tables, purged WUs and results are instead moved,
+// a batch at a time, to tables workunit_archive_DATE
+// and result_archive_DATE in the DB (DATE is YYYYMMDD, local time).
+// This keeps the workunit and result tables small,
+// and dropping a day's archive tables is much cheaper
+// than deleting its rows.
+// With --archive_table_days N, tables older than N days are dropped.
 
 #include "config.h"
 #include <cstdio>
@@ -39,6 +52,8 @@
 #include <string>
 #include <time.h>
 #include <errno.h>
+#include <cstddef>
+#include <vector>
 
 #include "boinc_db.h"
 #include "filesys.h"
@@ -54,6 +69,8 @@
 #include "error_numbers.h"
 #include "str_util.h"
 
+#include "column_archive.h"
+
 #define WU_FILENAME_PREFIX              "wu_archive"
 #define RESULT_FILENAME_PREFIX          "result_archive"
 #define WU_INDEX_FILENAME_PREFIX        "wu_index"
@@ -90,6 +107,134 @@ int wu_stored_in_file = 0;
     // keep track of how many WU archived in file so far
 int id_modulus=0, id_remainder=0;
     // allow more than one to run - doesn't work if archiving is enabled
+bool columnar = false;
+    // write WU and result archives in columnar format
+COLUMN_ARCHIVE_WRITER wu_writer, re_writer;
+bool archive_tables = false;
+    // move purged rows to archive tables rather than files
+int archive_table_days = 0;
+    // if nonzero, drop archive tables older than this
+
+// the fields written to columnar archives.
+// These are the fields in the XML archives; the first must be the ID.
+//
+#define FIELD_INT       0
+#define FIELD_DOUBLE    1
+#define FIELD_STRING    2
+#define FIELD_BOOL      3
+
+struct ARCHIVE_FIELD {
+    const char* name;
+    int type;
+    size_t offset;
+};
+
+#define WU_FIELD(name, type)    {#name, type, offsetof(WORKUNIT, name)}
+#define RESULT_FIELD(name, type)    {#name, type, offsetof(RESULT, name)}
+
+static ARCHIVE_FIELD wu_fields[] = {
+    WU_FIELD(id, FIELD_INT),
+    WU_FIELD(create_time, FIELD_INT),
+    WU_FIELD(appid, FIELD_INT),
+    WU_FIELD(name, FIELD_STRING),
+    WU_FIELD(xml_doc, FIELD_STRING),
+    WU_FIELD(batch, FIELD_INT),
+    WU_FIELD(rsc_fpops_est, FIELD_DOUBLE),
+    WU_FIELD(rsc_fpops_bound, FIELD_DOUBLE),
+    WU_FIELD(rsc_memory_bound, FIELD_DOUBLE),
+    WU_FIELD(rsc_disk_bound, FIELD_DOUBLE),
+    WU_FIELD(need_validate, FIELD_BOOL),
+    WU_FIELD(canonical_resultid, FIELD_INT),
+    WU_FIELD(canonical_credit, FIELD_DOUBLE),
+    WU_FIELD(transition_time, FIELD_INT),
+    WU_FIELD(delay_bound, FIELD_INT),
+    WU_FIELD(error_mask, FIELD_INT),
+    WU_FIELD(file_delete_state, FIELD_INT),
+    WU_FIELD(assimilate_state, FIELD_INT),
+    WU_FIELD(hr_class, FIELD_INT),
+    WU_FIELD(opaque, FIELD_DOUBLE),
+    WU_FIELD(min_quorum, FIELD_INT),
+    WU_FIELD(target_nresults, FIELD_INT),
+    WU_FIELD(max_error_results, FIELD_INT),
+    WU_FIELD(max_total_results, FIELD_INT),
+    WU_FIELD(max_success_results, FIELD_INT),
+    WU_FIELD(result_template_file, FIELD_STRING),
+    WU_FIELD(priority, FIELD_INT),
+    WU_FIELD(mod_time, FIELD_STRING),
+    {NULL, 0, 0}
+};
+
+static ARCHIVE_FIELD result_fields[] = {
+    RESULT_FIELD(id, FIELD_INT),
+    RESULT_FIELD(create_time, FIELD_INT),
+    RESULT_FIELD(workunitid, FIELD_INT),
+    RESULT_FIELD(server_state, FIELD_INT),
+    RESULT_FIELD(outcome, FIELD_INT),
+    RESULT_FIELD(client_state, FIELD_INT),
+    RESULT_FIELD(hostid, FIELD_INT),
+    RESULT_FIELD(userid, FIELD_INT),
+    RESULT_FIELD(report_deadline, FIELD_INT),
+    RESULT_FIELD(sent_time, FIELD_INT),
+    RESULT_FIELD(received_time, FIELD_INT),
+    RESULT_FIELD(name, FIELD_STRING),
+    RESULT_FIELD(cpu_time, FIELD_DOUBLE),
+    RESULT_FIELD(xml_doc_in, FIELD_STRING),
+    RESULT_FIELD(xml_doc_out, FIELD_STRING),
+    RESULT_FIELD(stderr_out, FIELD_STRING),
+    RESULT_FIELD(batch, FIELD_INT),
+    RESULT_FIELD(file_delete_state, FIELD_INT),
+    RESULT_FIELD(validate_state, FIELD_INT),
+    RESULT_FIELD(claimed_credit, FIELD_DOUBLE),
+    RESULT_FIELD(granted_credit, FIELD_DOUBLE),
+    RESULT_FIELD(opaque, FIELD_DOUBLE),
+    RESULT_FIELD(random, FIELD_INT),
+    RESULT_FIELD(app_version_num, FIELD_INT),
+    RESULT_FIELD(appid, FIELD_INT),
+    RESULT_FIELD(exit_status, FIELD_INT),
+    RESULT_FIELD(teamid, FIELD_INT),
+    RESULT_FIELD(priority, FIELD_INT),
+    RESULT_FIELD(mod_time, FIELD_STRING),
+    {NULL, 0, 0}
+};
+
+void define_columns(COLUMN_ARCHIVE_WRITER& writer, ARCHIVE_FIELD* fields) {
+    if (!writer.columns.empty()) return;
+    for (int i=0; fields[i].name; i++) {
+        switch (fields[i].type) {
+        case FIELD_DOUBLE:
+            writer.add_column(fields[i].name, COLUMN_DOUBLE);
+            break;
+        case FIELD_STRING:
+            writer.add_column(fields[i].name, COLUMN_STRING);
+            break;
+        default:
+            writer.add_column(fields[i].name, COLUMN_INT);
+        }
+    }
+}
+
+int archive_row(
+    COLUMN_ARCHIVE_WRITER& writer, ARCHIVE_FIELD* fields, const void* rec
+) {
+    for (int i=0; fields[i].name; i++) {
+        const char* p = (const char*)rec + fields[i].offset;
+        switch (fields[i].type) {
+        case FIELD_INT:
+            writer.add_int(*(const int*)p);
+            break;
+        case FIELD_DOUBLE:
+            writer.add_double(*(const double*)p);
+            break;
+        case FIELD_STRING:
+            writer.add_string(p);
+            break;
+        case FIELD_BOOL:
+            writer.add_int(*(const bool*)p?1:0);
+            break;
+        }
+    }
+    return writer.end_row();
+}
 
 bool time_to_quit() {
     if (max_number_workunits_to_purge) {
@@ -108,7 +253,8 @@ void fail(const char* msg) {
 // then we popen(2) a pipe to gzip or zip.
 // This does 'in place' compression.
 //
-void open_archive(const char* filename_prefix, FILE*& f){
+void open_archive(const char* filename_prefix, FILE*& f, bool binary=false){
+    const char* ext = binary?"bca":"xml";
     char path[MAXPATHLEN];
     char command[MAXPATHLEN+512];
 
@@ -127,12 +273,12 @@ void open_archive(const char* filename_prefix, FILE*& f){
         }
         safe_strcpy(path,
             config.project_path(
-                "archives/%s/%s_%d.xml", dirname, filename_prefix, time_int
+                "archives/%s/%s_%d.%s", dirname, filename_prefix, time_int, ext
             )
         );
     } else {
         safe_strcpy(path,
-            config.project_path("archives/%s_%d.xml", filename_prefix, time_int)
+            config.project_path("archives/%s_%d.%s", filename_prefix, time_int, ext)
         );
     }
     // append appropriate suffix for file type
@@ -173,13 +319,14 @@ void open_archive(const char* filename_prefix, FILE*& f){
     // set buffering to line buffered, since we are outputing XML on a
     // line-by-line basis.
     //
-    setlinebuf(f);
+    if (!binary) setlinebuf(f);
 
     return;
 }
 
-void close_archive(const char *filename, FILE*& fp){
+void close_archive(const char *filename, FILE*& fp, bool binary=false){
     char path[MAXPATHLEN];
+    const char* ext = binary?"bca":"xml";
 
     // Set file pointer to NULL after closing file to indicate that it's closed.
     //
@@ -202,12 +349,12 @@ void close_archive(const char *filename, FILE*& fp){
         strftime(dirname, sizeof(dirname), "%Y_%m_%d", gmtime(&time_time));
         safe_strcpy(path,
             config.project_path(
-                  "archives/%s/%s_%d.xml", dirname, filename, time_int
+                  "archives/%s/%s_%d.%s", dirname, filename, time_int, ext
             )
         );
     } else {
         safe_strcpy(path,
-            config.project_path("archives/%s_%d.xml", filename, time_int)
+            config.project_path("archives/%s_%d.%s", filename, time_int, ext)
         );
     }
     // append appropriate file type
@@ -234,12 +381,20 @@ void open_all_archives() {
     }
 
     // open all the archives.
-    open_archive(WU_FILENAME_PREFIX, wu_stream);
-    open_archive(RESULT_FILENAME_PREFIX, re_stream);
+    open_archive(WU_FILENAME_PREFIX, wu_stream, columnar);
+    open_archive(RESULT_FILENAME_PREFIX, re_stream, columnar);
     open_archive(RESULT_INDEX_FILENAME_PREFIX, re_index_stream);
     open_archive(WU_INDEX_FILENAME_PREFIX, wu_index_stream);
-    fprintf(wu_stream, "<archive>\n");
-    fprintf(re_stream, "<archive>\n");
+    if (columnar) {
+        define_columns(wu_writer, wu_fields);
+        define_columns(re_writer, result_fields);
+        if (wu_writer.open(wu_stream) || re_writer.open(re_stream)) {
+            fail("Can't write archive header\n");
+        }
+    } else {
+        fprintf(wu_stream, "<archive>\n");
+        fprintf(re_stream, "<archive>\n");
+    }
 
     return;
 }
@@ -248,10 +403,17 @@ void open_all_archives() {
 // pointers to indicate that files are not open.
 //
 void close_all_archives() {
-    if (wu_stream) fprintf(wu_stream, "</archive>\n");
-    if (re_stream) fprintf(re_stream, "</archive>\n");
-    close_archive(WU_FILENAME_PREFIX, wu_stream);
-    close_archive(RESULT_FILENAME_PREFIX, re_stream);
+    if (columnar) {
+        // in case of errors, carry on anyway (see close_archive())
+        //
+        wu_writer.close();
+        re_writer.close();
+    } else {
+        if (wu_stream) fprintf(wu_stream, "</archive>\n");
+        if (re_stream) fprintf(re_stream, "</archive>\n");
+    }
+    close_archive(WU_FILENAME_PREFIX, wu_stream, columnar);
+    close_archive(RESULT_FILENAME_PREFIX, re_stream, columnar);
     close_archive(RESULT_INDEX_FILENAME_PREFIX, re_index_stream);
     close_archive(WU_INDEX_FILENAME_PREFIX, wu_index_stream);
     log_messages.printf(MSG_NORMAL,
@@ -273,6 +435,19 @@ void close_db_exit_handler() {
 
 int archive_result(DB_RESULT& result) {
     int n;
+
+    if (columnar) {
+        if (archive_row(re_writer, result_fields, (RESULT*)&result)) {
+            fail("Can't write result archive\n");
+        }
+        n = fprintf(re_index_stream,
+            "%d     %d    %s\n",
+            result.id, time_int, result.name
+        );
+        if (n < 0) fail("fprintf() failed\n");
+        return 0;
+    }
+
     n = fprintf(re_stream,
         "<result_archive>\n"
         "    <id>%d</id>\n",
@@ -362,6 +537,19 @@ int archive_result(DB_RESULT& result) {
 
 int archive_wu(DB_WORKUNIT& wu) {
     int n;
+
+    if (columnar) {
+        if (archive_row(wu_writer, wu_fields, (WORKUNIT*)&wu)) {
+            fail("Can't write workunit archive\n");
+        }
+        n = fprintf(wu_index_stream,
+            "%d     %d    %s\n",
+            wu.id, time_int, wu.name
+        );
+        if (n < 0) fail("fprintf() failed\n");
+        return 0;
+    }
+
     n = fprintf(wu_stream,
         "<workunit_archive>\n"
         "    <id>%d</id>\n",
@@ -468,6 +656,178 @@ int purge_and_archive_results(DB_WORKUNIT& wu, int& number_results) {
     return 0;
 }
 
+// the date part of archive table names
+//
+static void archive_table_date(time_t t, char* buf) {
+    struct tm* tmp = localtime(&t);
+    strftime(buf, 16, "%Y%m%d", tmp);
+}
+
+// create today's archive tables if needed.
+// They're created like the live tables at that point,
+// so "insert ... select *" matches their columns
+// (a schema change takes effect in the next day's tables).
+//
+static int create_archive_tables(const char* date) {
+    static char created_date[16] = "";
+    char buf[256];
+    int retval;
+
+    if (!strcmp(date, created_date)) return 0;
+    sprintf(buf,
+        "create table if not exists workunit_archive_%s like workunit", date
+    );
+    retval = boinc_db.do_query(buf);
+    if (retval) return retval;
+    sprintf(buf,
+        "create table if not exists result_archive_%s like result", date
+    );
+    retval = boinc_db.do_query(buf);
+    if (retval) return retval;
+    strcpy(created_date, date);
+    return 0;
+}
+
+// drop archive tables whose date is more than archive_table_days ago
+//
+static void drop_old_archive_tables() {
+    static double last_check = 0;
+    char cutoff[16], buf[256];
+    std::vector<std::string> names;
+    MYSQL_RES* rp;
+    MYSQL_ROW row;
+
+    if (!archive_table_days) return;
+    if (dtime() - last_check < 3600) return;
+    last_check = dtime();
+    archive_table_date(time(0) - archive_table_days*86400, cutoff);
+
+    const char* prefixes[] = {"workunit_archive_", "result_archive_"};
+    for (int i=0; i<2; i++) {
+        sprintf(buf, "show tables like '%s%%'", prefixes[i]);
+        if (boinc_db.do_query(buf)) return;
+        rp = mysql_store_result(boinc_db.mysql);
+        if (!rp) return;
+        while ((row = mysql_fetch_row(rp))) {
+            const char* date = row[0] + strlen(prefixes[i]);
+            if (strlen(date) != 8) continue;
+            if (strcmp(date, cutoff) < 0) names.push_back(row[0]);
+        }
+        mysql_free_result(rp);
+    }
+    for (unsigned int i=0; i<names.size(); i++) {
+        sprintf(buf, "drop table %s", names[i].c_str());
+        if (boinc_db.do_query(buf)) {
+            log_messages.printf(MSG_CRITICAL,
+                "Can't drop archive table %s: %s\n",
+                names[i].c_str(), boinc_db.error_string()
+            );
+            continue;
+        }
+        log_messages.printf(MSG_NORMAL,
+            "Dropped archive table %s\n", names[i].c_str()
+        );
+    }
+}
+
+// move a batch of WUs, and their results and assignments,
+// to today's archive tables, in one transaction
+//
+static int move_to_archive_tables(
+    std::vector<int>& wu_ids, int& nresults
+) {
+    char date[16], buf[256];
+    std::string id_list, query;
+    int retval;
+
+    archive_table_date(time(0), date);
+    retval = create_archive_tables(date);
+    if (retval) return retval;
+
+    id_list = "(";
+    for (unsigned int i=0; i<wu_ids.size(); i++) {
+        if (i) id_list += ",";
+        sprintf(buf, "%d", wu_ids[i]);
+        id_list += buf;
+    }
+    id_list += ")";
+
+    retval = boinc_db.start_transaction();
+    if (retval) return retval;
+
+    query = std::string("insert into workunit_archive_") + date
+        + " select * from workunit where id in " + id_list;
+    retval = boinc_db.do_query(query.c_str());
+    if (retval) goto error;
+    query = std::string("insert into result_archive_") + date
+        + " select * from result where workunitid in " + id_list;
+    retval = boinc_db.do_query(query.c_str());
+    if (retval) goto error;
+    nresults = boinc_db.affected_rows();
+    query = "delete from result where workunitid in " + id_list;
+    retval = boinc_db.do_query(query.c_str());
+    if (retval) goto error;
+    query = "delete from workunit where id in " + id_list;
+    retval = boinc_db.do_query(query.c_str());
+    if (retval) goto error;
+    if (config.enable_assignment) {
+        query = "delete from assignment where workunitid in " + id_list;
+        retval = boinc_db.do_query(query.c_str());
+        if (retval) goto error;
+    }
+    return boinc_db.commit_transaction();
+
+error:
+    boinc_db.rollback_transaction();
+    return retval;
+}
+
+// a pass with --archive_tables: move the WUs matching the clause
+//
+static bool do_pass_archive_tables(const char* clause) {
+    DB_WORKUNIT wu;
+    std::vector<int> wu_ids;
+    int retval, nresults = 0;
+
+    drop_old_archive_tables();
+
+    while (1) {
+        retval = wu.enumerate(clause);
+        if (retval) {
+            if (retval != ERR_DB_NOT_FOUND) {
+                log_messages.printf(MSG_DEBUG,
+                    "DB connection lost, exiting\n"
+                );
+                exit(0);
+            }
+            break;
+        }
+        if (strstr(wu.name, "nodelete")) continue;
+        if (max_number_workunits_to_purge
+            && purged_workunits + (int)wu_ids.size() >= max_number_workunits_to_purge
+        ) {
+            continue;
+        }
+        wu_ids.push_back(wu.id);
+    }
+    if (wu_ids.empty()) return false;
+
+    retval = move_to_archive_tables(wu_ids, nresults);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't move workunits to archive tables: %s\n",
+            boinc_db.error_string()
+        );
+        exit(6);
+    }
+    purged_workunits += (int)wu_ids.size();
+    log_messages.printf(MSG_NORMAL,
+        "Moved %d workunits and %d results to archive tables\n",
+        (int)wu_ids.size(), nresults
+    );
+    return (int)wu_ids.size() > DB_QUERY_LIMIT/2;
+}
+
 // return true if did anything
 //
 bool do_pass() {
@@ -519,6 +879,10 @@ bool do_pass() {
         }
     }
 
+    if (archive_tables) {
+        return do_pass_archive_tables(buf);
+    }
+
     int n=0;
     while (1) {
         retval = wu.enumerate(buf);
@@ -632,6 +996,9 @@ void usage(char* name) {
         "    [--zip]                       Compress output files using zip\n"
         "    [--gzip]                      Compress output files using gzip\n"
         "    [--no_archive]                Don't write output files, just purge\n"
+        "    [--columnar]                  Write WU and result archives in columnar format\n"
+        "    [--archive_tables]            Move WUs and results to archive tables, not files\n"
+        "    [--archive_table_days N]      Drop archive tables older than N days\n"
         "    [--daily_dir]                 Write archives in a new directory each day\n"
         "    [--max_wu_per_file N]         Write at most N WUs per output file\n"
         "    [--sleep N]                   Sleep N sec after DB scan\n"
@@ -694,6 +1061,17 @@ int main(int argc, char** argv) {
             max_wu_per_file = atoi(argv[i]);
         } else if (is_arg(argv[i], "no_archive")) {
             no_archive = true;
+        } else if (is_arg(argv[i], "columnar")) {
+            columnar = true;
+        } else if (is_arg(argv[i], "archive_tables")) {
+            archive_tables = true;
+        } else if (is_arg(argv[i], "archive_table_days")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            archive_table_days = atoi(argv[i]);
         } else if (is_arg(argv[i], "-sleep")) {
             if(!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
@@ -734,6 +1112,17 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (archive_tables) {
+        if (dont_delete) {
+            log_messages.printf(MSG_CRITICAL,
+                "--archive_tables and --dont_delete are incompatible\n\n"
+            );
+            usage(argv[0]);
+            exit(1);
+        }
+        no_archive = true;
+    }
+
     if (id_modulus && !no_archive) {
         log_messages.printf(MSG_CRITICAL,
             "If you use modulus, you must set no_archive\n\n"
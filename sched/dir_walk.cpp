@@ -0,0 +1,180 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Parallel directory walks; see dir_walk.h
+
+#include "config.h"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "dir_walk.h"
+
+using std::string;
+using std::vector;
+
+void fanout_dirs(const char* root, int fanout, vector<string>& dirs) {
+    char buf[1024];
+    dirs.clear();
+    if (!fanout) {
+        dirs.push_back(root);
+        return;
+    }
+    for (int i=0; i<fanout; i++) {
+        snprintf(buf, sizeof(buf), "%s/%x", root, i);
+        dirs.push_back(buf);
+    }
+}
+
+struct DIR_WORKERS {
+    int ndirs;
+    int next_dir;       // next dir for a thread to take
+    void (*func)(int, void*);
+    void* arg;
+};
+
+static void* dir_worker(void* p) {
+    DIR_WORKERS& dw = *(DIR_WORKERS*)p;
+    while (1) {
+        int i = __sync_fetch_and_add(&dw.next_dir, 1);
+        if (i >= dw.ndirs) break;
+        dw.func(i, dw.arg);
+    }
+    return 0;
+}
+
+void run_dir_workers(
+    int ndirs, int nthreads, void (*func)(int, void*), void* arg
+) {
+    DIR_WORKERS dw;
+    vector<pthread_t> threads;
+    int i;
+
+    dw.ndirs = ndirs;
+    dw.next_dir = 0;
+    dw.func = func;
+    dw.arg = arg;
+    if (nthreads > ndirs) nthreads = ndirs;
+    for (i=0; i<nthreads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, dir_worker, &dw)) break;
+        threads.push_back(t);
+    }
+    if (threads.empty()) {
+        // couldn't create threads; do it ourselves
+        //
+        dir_worker(&dw);
+    }
+    for (i=0; i<(int)threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static inline bool is_dot(const char* name) {
+    return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+// returns nonzero if func did
+//
+static inline int scan_entry(
+    int dirfd, const char* dir, const char* name, DIR_SCAN_FUNC func, void* arg
+) {
+    struct stat sbuf;
+    int stat_errno = 0;
+    if (fstatat(dirfd, name, &sbuf, AT_SYMLINK_NOFOLLOW)) {
+        stat_errno = errno;
+        memset(&sbuf, 0, sizeof(sbuf));
+    }
+    return func(dirfd, dir, name, sbuf, stat_errno, arg);
+}
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+struct LINUX_DIRENT64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+int scan_dir(const char* dir, DIR_SCAN_FUNC func, void* arg) {
+    char buf[65536]
+        __attribute__ ((aligned(__alignof__(LINUX_DIRENT64))));
+    int retval = 0;
+
+    int dirfd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dirfd < 0) return errno;
+    while (1) {
+        long n = syscall(SYS_getdents64, dirfd, buf, sizeof(buf));
+        if (n < 0) {
+            retval = errno;
+            break;
+        }
+        if (n == 0) break;
+        for (long pos=0; pos<n; ) {
+            LINUX_DIRENT64* d = (LINUX_DIRENT64*)(buf+pos);
+            pos += d->d_reclen;
+            if (is_dot(d->d_name)) continue;
+            if (scan_entry(dirfd, dir, d->d_name, func, arg)) {
+                close(dirfd);
+                return -1;
+            }
+        }
+    }
+    close(dirfd);
+    return retval;
+}
+
+#else
+
+int scan_dir(const char* dir, DIR_SCAN_FUNC func, void* arg) {
+    int retval = 0;
+
+    int dirfd = open(dir, O_RDONLY);
+    if (dirfd < 0) return errno;
+    DIR* dirp = fdopendir(dirfd);
+    if (!dirp) {
+        retval = errno;
+        close(dirfd);
+        return retval;
+    }
+    while (1) {
+        errno = 0;
+        struct dirent* d = readdir(dirp);
+        if (!d) {
+            retval = errno;
+            break;
+        }
+        if (is_dot(d->d_name)) continue;
+        if (scan_entry(dirfd, dir, d->d_name, func, arg)) {
+            retval = -1;
+            break;
+        }
+    }
+    closedir(dirp);
+    return retval;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Parallel operations on the upload/download directory hierarchies,
+// for tools that handle many files
+// (antique_file_deleter, file_deleter, wu_check).
+// Work is divided by directory (e.g. fanout directory):
+// N threads take directories in turn.
+// Functions called in the threads should make only system calls;
+// they must lock around logging or other shared state.
+
+#ifndef BOINC_DIR_WALK_H
+#define BOINC_DIR_WALK_H
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+// the dirs of a hierarchy: root/0 ... root/(fanout-1) (hex),
+// or just root if fanout is zero
+//
+extern void fanout_dirs(
+    const char* root, int fanout, std::vector<std::string>& dirs
+);
+
+// call func(i, arg) for i = 0 ... ndirs-1, using up to nthreads threads.
+// If threads can't be created, do it in this thread.
+//
+extern void run_dir_workers(
+    int ndirs, int nthreads, void (*func)(int, void*), void* arg
+);
+
+// called for each entry of a dir (except . and ..).
+// dirfd is an open descriptor for the dir (e.g. for unlinkat()).
+// sbuf is from fstatat() (not following symlinks);
+// if that failed, stat_errno is nonzero.
+// Return nonzero to stop scanning.
+//
+typedef int (*DIR_SCAN_FUNC)(
+    int dirfd, const char* dir, const char* name,
+    struct stat& sbuf, int stat_errno, void* arg
+);
+
+// list a dir and fstatat() each entry.
+// On Linux, entries are read in large batches with getdents64.
+// Returns zero, an errno, or -1 if func stopped the scan
+//
+extern int scan_dir(const char* dir, DIR_SCAN_FUNC, void* arg);
+
+#endif
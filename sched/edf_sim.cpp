@@ -22,6 +22,8 @@
 #endif
 
 #include <vector>
+#include <queue>
+#include <functional>
 #include <algorithm>
 #include <cstring>
 #include <cstdarg>
@@ -213,6 +215,74 @@ vector<TEMP_RESULT> REQUEST_HANDLER_WORK_SEND::find_sendable_test_results (
 }
 #endif
 
+// EDF_MODEL: the host's workload (in-progress jobs plus jobs
+// we've decided to send) in EDF order, with the simulated start
+// and finish time of each job.
+// For each position we keep the least "allowance" of the jobs from
+// there on: how much later a job can finish without
+// 1) missing its deadline, if it wouldn't have otherwise, or
+// 2) finishing later than it would have, if it's already late.
+//
+// Adding a job of duration c at some position delays each later job
+// by at most c (exactly c with 1 CPU),
+// so the check is a binary search and a lookup.
+// With more than 1 CPU this is conservative:
+// a candidate may be rejected that a full simulation would accept.
+//
+void EDF_MODEL::init(int _ncpus, vector<IP_RESULT>& ip_results) {
+    ncpus = _ncpus;
+    if (ncpus < 1) ncpus = 1;
+    jobs = ip_results;
+    std::stable_sort(jobs.begin(), jobs.end(), lessthan_deadline);
+    simulate();
+}
+
+// compute start times and allowances.
+// CPUs are in a min-heap of the time each is next free.
+//
+void EDF_MODEL::simulate() {
+    unsigned int i, n = jobs.size();
+    std::priority_queue<double, vector<double>, std::greater<double> > booked_to;
+
+    for (int j=0; j<ncpus; j++) {
+        booked_to.push(0);
+    }
+    start.resize(n);
+    min_allowance.resize(n+1);
+    min_allowance_index.resize(n+1);
+    vector<double> finish(n);
+    for (i=0; i<n; i++) {
+        IP_RESULT& r = jobs[i];
+        start[i] = booked_to.top();
+        booked_to.pop();
+        finish[i] = start[i] + r.cpu_time_remaining;
+        booked_to.push(finish[i]);
+        log_msg(DETAIL, "[edf_detail]   %s: deadline %.2f, finishes at %.2f\n",
+            r.name, r.computation_deadline/TIME_SCALE, finish[i]/TIME_SCALE
+        );
+    }
+    next_start = booked_to.top();
+
+    min_allowance[n] = 1e300;
+    min_allowance_index[n] = -1;
+    for (i=n; i>0; i--) {
+        IP_RESULT& r = jobs[i-1];
+        double x = r.misses_deadline?r.estimated_completion_time:r.computation_deadline;
+        x -= finish[i-1];
+        if (x < min_allowance[i]) {
+            min_allowance[i-1] = x;
+            min_allowance_index[i-1] = i-1;
+        } else {
+            min_allowance[i-1] = min_allowance[i];
+            min_allowance_index[i-1] = min_allowance_index[i];
+        }
+    }
+}
+
+static bool deadline_before(double d, const IP_RESULT& r) {
+    return d < r.computation_deadline;
+}
+
 // Return false if
 // 1) the candidate result X would cause another result Y to miss its deadline
 //    (which Y would not have otherwise missed)
@@ -220,78 +290,56 @@ vector<TEMP_RESULT> REQUEST_HANDLER_WORK_SEND::find_sendable_test_results (
 //    it otherwise would have, or
 // 3) X would miss its deadline
 //
-bool check_candidate (
-    IP_RESULT& candidate,
-    int ncpus,
-    vector<IP_RESULT> ip_results        // passed by value (copy)
-) {
-    double booked_to[MAX_CPUS];     // keeps track of when each cpu is free
-    int j;
-
+bool EDF_MODEL::check_candidate(IP_RESULT& candidate) {
     log_msg(DETAIL, "[edf_detail] check_candidate %s: dl %.2f cpu %.2f\n",
         candidate.name, candidate.computation_deadline/TIME_SCALE,
         candidate.cpu_time_remaining/TIME_SCALE
     );
 
-    for (j=0; j<ncpus; j++) {
-        booked_to[j] = 0;
-    }
-    ip_results.push_back(candidate);
-
-    // sort ip_results in ascending order by deadline
+    // the candidate goes after the jobs with the same deadline
     //
-    sort(ip_results.begin(), ip_results.end(), lessthan_deadline);
-
-    // simulate execution of all queued results and test result
-    //
-    for (unsigned int i=0; i<ip_results.size(); i++) {
-        IP_RESULT& r = ip_results[i];
-
-        // find the CPU that will be free first
-        //
-        double lowest_booked_time = booked_to[0];
-        int lowest_booked_cpu = 0;
-        for (j=1; j<ncpus; j++) {
-            if (booked_to[j] < lowest_booked_time) {
-                lowest_booked_time = booked_to[j];
-                lowest_booked_cpu = j;
-            }
-        }
-        booked_to[lowest_booked_cpu] += r.cpu_time_remaining;
-        log_msg(DETAIL, "[edf_detail]   running %s on cpu %d; deadline %f, finishes at %.2f\n",
-            r.name, lowest_booked_cpu, r.computation_deadline, booked_to[lowest_booked_cpu]/TIME_SCALE
+    int p = std::upper_bound(
+        jobs.begin(), jobs.end(), candidate.computation_deadline,
+        deadline_before
+    ) - jobs.begin();
+    double finish = ((p < (int)jobs.size())?start[p]:next_start)
+        + candidate.cpu_time_remaining;
+    if (finish > candidate.computation_deadline) {
+        log_msg(SUMMARY,
+            "[send]  cand. fails; %s now misses deadline: %.2f > %.2f\n",
+            candidate.name, finish/TIME_SCALE,
+            candidate.computation_deadline/TIME_SCALE
         );
-
-        // return false if completion time if > computation_deadline AND
-        // result would not have missed deadline to begin with
-        //
-        if (booked_to[lowest_booked_cpu] > r.computation_deadline
-            && !r.misses_deadline
-        ) {
-            log_msg(SUMMARY,
-                "[send]  cand. fails; %s now misses deadline: %.2f > %.2f\n",
-                r.name, booked_to[lowest_booked_cpu]/TIME_SCALE,
-                r.computation_deadline/TIME_SCALE
-            );
-            return false;
-        }
-        // check a late result (i.e., one that would have missed its
-        // deadline) // would be made even later
-        //
-        if (r.misses_deadline
-            && booked_to[lowest_booked_cpu] > r.estimated_completion_time
-        ){
+        return false;
+    }
+    if (candidate.cpu_time_remaining > min_allowance[p]) {
+        IP_RESULT& r = jobs[min_allowance_index[p]];
+        if (r.misses_deadline) {
             log_msg(SUMMARY,
                 "[send]  cand. fails; late result %s would be returned even later\n",
                 r.name
             );
-            return false;
+        } else {
+            log_msg(SUMMARY,
+                "[send]  cand. fails; %s would miss deadline\n", r.name
+            );
         }
+        return false;
     }
     log_msg(SUMMARY, "[send]  candidate succeeds\n");
     return true;
 }
 
+// add a job we've decided to send
+//
+void EDF_MODEL::add(IP_RESULT& r) {
+    vector<IP_RESULT>::iterator i = std::upper_bound(
+        jobs.begin(), jobs.end(), r.computation_deadline, deadline_before
+    );
+    jobs.insert(i, r);
+    simulate();
+}
+
 #if 0
 int main() {
     vector<IP_RESULT> ip_results;
@@ -303,17 +351,19 @@ int main() {
     ip_results.push_back(IP_RESULT("R1", 5, 3));
     ip_results.push_back(IP_RESULT("R2", 5, 3));
     init_ip_results(work_buf_min, ncpus, ip_results);
+    EDF_MODEL edf;
+    edf.init(ncpus, ip_results);
 
     IP_RESULT c1 = IP_RESULT("C1", 10, 1);
-    if (check_candidate(c1, ncpus, ip_results)) {
+    if (edf.check_candidate(c1)) {
         printf("adding %s\n", c1.name);
-        ip_results.push_back(c1);
+        edf.add(c1);
     }
 
     IP_RESULT c2 = IP_RESULT("C2", 7, 2);
-    if (check_candidate(c2, ncpus, ip_results)) {
+    if (edf.check_candidate(c2)) {
         printf("adding %s\n", c2.name);
-        ip_results.push_back(c2);
+        edf.add(c2);
     }
 }
 #endif
@@ -47,7 +47,32 @@ struct IP_RESULT {
     }
 };
 
+// a host's workload, for checking whether a candidate job
+// could be added without deadline misses (see edf_sim.cpp)
+//
+struct EDF_MODEL {
+    int ncpus;
+    std::vector<IP_RESULT> jobs;
+        // in order of increasing computation_deadline
+    std::vector<double> start;
+        // when each job starts in the EDF simulation
+    double next_start;
+        // when a job after the last would start
+    std::vector<double> min_allowance;
+    std::vector<int> min_allowance_index;
+        // least allowance of jobs i.., and which job has it
+
+    EDF_MODEL() {
+        ncpus = 1;
+        next_start = 0;
+    }
+    void init(int ncpus, std::vector<IP_RESULT>&);
+        // ip_results must have been through init_ip_results()
+    void simulate();
+    bool check_candidate(IP_RESULT&);
+    void add(IP_RESULT&);
+};
+
 extern void init_ip_results(double, int, std::vector<IP_RESULT>&);
-extern bool check_candidate(IP_RESULT&, int, std::vector<IP_RESULT>);
 
 #endif
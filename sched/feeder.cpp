@@ -21,6 +21,9 @@
 // Usage: feeder [ options ]
 //  [ -d x ]                debug level x
 //  [ --allapps ]           interleave results from all applications uniformly
+//  [ --per_app_arrays ]    like --allapps, but give each app a contiguous
+//                          part of the work array, so that schedulers
+//                          can skip apps for which the host has no version
 //  [ --by_batch ]          interleave results from all batches uniformly
 //  [ --random_order ]      order by "random" field of result
 //  [ --priority_order ]    order by decreasing "priority" field of result
@@ -31,6 +34,13 @@
 //  [ --wmod n i ]          handle only workunits with (id mod n) == i
 //                          recommended if using HR with multiple schedulers
 //  [ --sleep_interval x ]  sleep x seconds if nothing to do
+//  [ --min_sleep_interval x ] if nothing to do, sleep x seconds at first,
+//                          doubling each time (up to --sleep_interval),
+//                          and wake up as soon as a scheduler empties a slot
+//  [ --keyset ]            page through unsent results using the position
+//                          of the last result read (see below)
+//  [ --keyset_reconcile x ] with --keyset, restart from the beginning
+//                          every x seconds (default 600)
 //  [ --appids a1{,a2} ]    get work only for appids a1,...
 //                          (comma-separated list)
 //  [ --purge_stale x ]     remove work items from the shared memory segment
@@ -56,6 +66,29 @@
 // - If an enumerated job was already in the array,
 //   stop the scan and sleep for N seconds
 // - Otherwise immediately start another scan
+//
+// With --min_sleep_interval, the sleep is interrupted when
+// a scheduler empties a slot (SCHED_SHMEM::nslots_emptied changes),
+// which is checked every min_sleep_interval seconds.
+// The sleep starts at min_sleep_interval and doubles after each scan
+// that adds nothing, so the feeder refills promptly when busy
+// and backs off when there's nothing to do.
+// Each early wakeup follows the sending of a job,
+// so this adds at most one scan per job sent.
+
+// If --keyset is used:
+// rather than repeating the same query (and getting mostly jobs
+// that are already in the array) each DB_WORK_ITEM remembers the
+// (priority, ID) of the last result it read, and each query gets
+// only results after that one, with a limit equal to
+// the number of empty slots.
+// This makes refilling cost proportional to the number of empty slots,
+// rather than to the number of unsent results.
+// Results that we pass over (e.g. purged as stale,
+// or rejected because of HR quotas) are picked up by a reconciliation
+// pass: every --keyset_reconcile seconds the position is reset.
+// --keyset can be used with no ordering, --priority_order,
+// or --priority_asc.
 
 // If --allapps is used:
 // - there are separate DB enumerators for each app
@@ -63,6 +96,12 @@
 //   slot_to_app[] maps slot (i.e. work array index) to app index.
 //   app_count[] is the number of slots per app
 //   (approximately proportional to its weight)
+//
+// If --per_app_arrays is used, the apps get the same number of slots
+// as with --allapps, but the slots of each app are contiguous,
+// and their location is stored in the shared memory segment.
+// The scheduler uses this to scan only the slots of apps
+// for which the host has a usable app version.
 
 // Homogeneous redundancy (HR):
 // If HR is used, jobs can either be "uncommitted"
@@ -105,6 +144,7 @@
 #include <sys/stat.h>
 #include <sys/param.h>
 #include <vector>
+#include <algorithm>
 using std::vector;
 
 #include "boinc_db.h"
@@ -121,8 +161,10 @@ using std::vector;
 #include "sched_config.h"
 #include "sched_shmem.h"
 #include "sched_util.h"
+#include "daemon_metrics.h"
 #include "sched_msgs.h"
 #include "hr_info.h"
+#include "pop_stats.h"
 #ifdef GCL_SIMULATOR
 #include "gcl_simulator.h"
 #endif
@@ -141,7 +183,15 @@ key_t sema_key;
 const char* order_clause="";
 char mod_select_clause[256];
 int sleep_interval = DEFAULT_SLEEP_INTERVAL;
+double min_sleep_interval = 0;
+static int m_slots_empty, m_slots_filled, m_added, m_collisions;
+    // metrics
+bool use_keyset = false;
+int keyset_order = KEYSET_ORDER_ID;
+bool order_allows_keyset = true;
+int keyset_reconcile_interval = 600;
 bool all_apps = false;
+bool per_app_arrays = false;
 int purge_stale_time = 0;
 int num_work_items = MAX_WU_RESULTS;
 int enum_limit = MAX_WU_RESULTS*2;
@@ -154,6 +204,28 @@ int *app_indices;
 int napps;
     // number of apps, else one
 
+// If --per_app_arrays, tell schedulers where each app's slots are.
+// Must be redone whenever ssp->init() is called.
+//
+static void set_app_slots() {
+    if (!per_app_arrays) return;
+    for (int i=0; i<ssp->napps; i++) {
+        ssp->app_slot_start[i] = -1;
+        ssp->app_nslots[i] = 0;
+    }
+    for (int i=0; i<ssp->max_wu_results; i++) {
+        int j = app_indices[i];
+        if (ssp->app_slot_start[j] < 0) {
+            ssp->app_slot_start[j] = i;
+        }
+        ssp->app_nslots[j]++;
+    }
+    for (int i=0; i<ssp->napps; i++) {
+        if (ssp->app_slot_start[i] < 0) ssp->app_slot_start[i] = 0;
+    }
+    ssp->per_app_arrays = true;
+}
+
 HR_INFO hr_info;
 bool using_hr;
     // true iff any app is using HR
@@ -167,8 +239,26 @@ void signal_handler(int) {
 
 void cleanup_shmem() {
     ssp->ready = false;
-    detach_shmem((void*)ssp);
-    destroy_shmem(config.shmem_key);
+    destroy_sched_shmem(ssp);
+}
+
+// We're using the job array left by a previous feeder.
+// Empty the slots of jobs we wouldn't have put there;
+// the rest are still good, or the schedulers will find they aren't
+//
+static void check_kept_slots() {
+    int i, n=0;
+    for (i=0; i<ssp->max_wu_results; i++) {
+        WU_RESULT& wu_result = ssp->wu_results[i];
+        if (wu_result.state != WR_STATE_PRESENT) continue;
+        APP* app = ssp->lookup_app(wu_result.workunit.appid);
+        if (app && (!all_apps || app_indices[i] == app - ssp->apps)) continue;
+        if (!wu_result.cas_state(WR_STATE_PRESENT, WR_STATE_EMPTY)) continue;
+        n++;
+    }
+    log_messages.printf(MSG_NORMAL,
+        "kept job array from previous feeder; emptied %d slots\n", n
+    );
 }
 
 int check_reread_trigger() {
@@ -183,6 +273,7 @@ int check_reread_trigger() {
         ssp->init(num_work_items);
         ssp->scan_tables();
         ssp->perf_info.get_from_db();
+        set_app_slots();
         int retval = unlink(config.project_path(REREAD_DB_FILENAME));
         if (retval) {
             // if we can't remove trigger file, exit to avoid infinite loop
@@ -230,6 +321,47 @@ void hr_count_slots() {
     }
 }
 
+// get RAC per HR class from the population stats in shared memory,
+// if census --daemon has done a host scan.
+// Return false otherwise.
+//
+bool hr_info_from_pop_stats() {
+    static POP_STATS ps;
+
+    if (!config.pop_stats_shmem_key) return false;
+    POP_STATS* shm = pop_stats_attach();
+    if (!shm) return false;
+    shm->snapshot(ps);
+    if (!ps.host_update_time) return false;
+    for (int i=1; i<HR_NTYPES; i++) {
+        for (int j=0; j<hr_nclasses[i]; j++) {
+            hr_info.rac_per_class[i][j] = ps.rac_per_class[i][j];
+        }
+    }
+    return true;
+}
+
+// If schedulers are counting requests per HR class,
+// reallocate HR slots according to the recent counts.
+// Classes over their new limit aren't emptied;
+// they just don't get more jobs until they're under it.
+//
+void hr_rebalance() {
+    HR_DEMAND_TABLE* dt = hr_demand_attach();
+    if (!dt) return;
+    if (!hr_info.update_demand(dt, dtime())) {
+        log_messages.printf(MSG_DEBUG, "no HR requests counted yet\n");
+        return;
+    }
+    hr_info.allocate(ssp->max_wu_results);
+    log_messages.printf(MSG_NORMAL,
+        "reallocated HR slots according to request rates\n"
+    );
+    if (log_messages.debug_level >= MSG_DEBUG) {
+        hr_info.show(stderr);
+    }
+}
+
 // Enumerate jobs from DB until find one that is not already in the work array.
 // If find one, return true.
 // If reach end of enum for second time on this array scan, return false
@@ -238,7 +370,8 @@ static bool get_job_from_db(
     DB_WORK_ITEM& wi,    // enumerator to get job from
     int app_index,       // if using --allapps, the app index
     int& enum_phase,
-    int& ncollisions
+    int& ncollisions,
+    int nempty           // # of empty slots for this app
 ) {
     bool collision;
     int retval, j, enum_size;
@@ -258,6 +391,11 @@ static bool get_job_from_db(
     while (1) {
         if (hrt && config.hr_allocate_slots) {
             retval = wi.enumerate_all(enum_size, select_clause);
+        } else if (use_keyset) {
+            retval = wi.enumerate_keyset(
+                std::max(1, std::min(nempty, enum_size)),
+                select_clause, keyset_order
+            );
         } else {
             retval = wi.enumerate(enum_size, select_clause, order_clause);
         }
@@ -451,6 +589,7 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
     int i;
     bool found;
     int enum_phase[napps];
+    int nempty[napps];
     int app_index;
     int nadditions=0, ncollisions=0;
     
@@ -460,7 +599,26 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
         } else {
             enum_phase[i] = ENUM_SECOND_PASS;
         }
+        nempty[i] = 0;
+    }
+    int nempty_total = 0;
+    for (i=0; i<ssp->max_wu_results; i++) {
+        if (ssp->wu_results[i].state == WR_STATE_EMPTY) {
+            nempty[app_indices[i]]++;
+            nempty_total++;
+        }
+    }
+
+    // slots are assumed to have been empty since the last scan
+    //
+    static double last_scan_time = 0;
+    double now = dtime();
+    if (last_scan_time) {
+        ssp->empty_slot_time += nempty_total*(now - last_scan_time);
     }
+    last_scan_time = now;
+    daemon_metrics.set(m_slots_empty, nempty_total);
+    daemon_metrics.set(m_slots_filled, ssp->max_wu_results - nempty_total);
 
     if (using_hr && config.hr_allocate_slots) {
         hr_count_slots();
@@ -474,12 +632,17 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
         switch (wu_result.state) {
         case WR_STATE_PRESENT:
             if (purge_stale_time && wu_result.time_added_to_shared_memory < (time(0) - purge_stale_time)) {
+                // a scheduler may reserve the slot while we look at it
+                //
+                if (!wu_result.cas_state(WR_STATE_PRESENT, WR_STATE_EMPTY)) {
+                    break;
+                }
                 log_messages.printf(MSG_NORMAL,
                     "remove result [RESULT#%u] from slot %d because it is stale\n",
                     wu_result.resultid, i
                 );
+                wu_result.time_emptied = dtime();
                 purge_stale(wu_result);
-                wu_result.state = WR_STATE_EMPTY;
                 // fall through, refill this array slot
             } else {
                 break;
@@ -487,9 +650,19 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
         case WR_STATE_EMPTY:
             if (enum_phase[app_index] == ENUM_OVER) continue;
             found = get_job_from_db(
-                wi, app_index, enum_phase[app_index], ncollisions
+                wi, app_index, enum_phase[app_index], ncollisions,
+                nempty[app_index]
             );
             if (found) {
+                // the job will be enumerated again later
+                //
+                if (ssp->set_workunit(wu_result, wi.wu)) {
+                    log_messages.printf(MSG_CRITICAL,
+                        "no room for XML of [WU#%u] in shared memory; increase <shmem_wu_xml_size>\n",
+                        wi.wu.id
+                    );
+                    break;
+                }
                 log_messages.printf(MSG_NORMAL,
                     "adding result [RESULT#%u] in slot %d\n",
                     wi.res_id, i
@@ -498,8 +671,6 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
                 wu_result.res_priority = wi.res_priority;
                 wu_result.res_server_state = wi.res_server_state;
                 wu_result.res_report_deadline = wi.res_report_deadline;
-                wu_result.workunit = wi.wu;
-                wu_result.state = WR_STATE_PRESENT;
                 // If the workunit has already been allocated to a certain
                 // OS then it should be assigned quickly,
                 // so we set its infeasible_count to 1
@@ -516,6 +687,19 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
                     wu_result.need_reliable = true;
                 }
                 wu_result.time_added_to_shared_memory = time(0);
+                if (wu_result.time_emptied) {
+                    double x = dtime() - wu_result.time_emptied;
+                    ssp->nrefills++;
+                    ssp->refill_latency_sum += x;
+                    if (x > ssp->refill_latency_max) {
+                        ssp->refill_latency_max = x;
+                    }
+                }
+
+                // make the slot visible to schedulers
+                // only after all its fields are written
+                //
+                wu_result.publish();
                 nadditions++;
             }
             break;
@@ -528,7 +712,7 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
             sprintf(buf, "/proc/%d", pid);
             log_messages.printf(MSG_NORMAL, "checking pid %d\n", pid);
             if (stat(buf, &s)) {
-                wu_result.state = WR_STATE_PRESENT;
+                wu_result.release(pid);
                 log_messages.printf(MSG_NORMAL,
                     "Result reserved by non-existent process PID %d; resetting\n",
                     pid
@@ -537,6 +721,8 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
         }
     }
     log_messages.printf(MSG_DEBUG, "Added %d results to array\n", nadditions);
+    daemon_metrics.add(m_added, nadditions);
+    daemon_metrics.add(m_collisions, ncollisions);
     if (ncollisions) {
         log_messages.printf(MSG_DEBUG,
             "%d results already in array\n", ncollisions
@@ -549,9 +735,28 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
     return true;
 }
 
+// Sleep for up to the given time,
+// returning early if a scheduler empties a slot
+//
+static void wait_for_empty_slot(double secs) {
+    unsigned int n = ssp->nslots_emptied;
+    double end = dtime() + secs;
+    while (dtime() < end) {
+        boinc_sleep(min_sleep_interval);
+        if (ssp->nslots_emptied != n) {
+            log_messages.printf(MSG_DEBUG, "slots emptied; waking up\n");
+            return;
+        }
+        check_stop_daemons();
+    }
+}
+
 void feeder_loop() {
     vector<DB_WORK_ITEM> work_items;
     double next_av_update_time=0;
+    double next_reconcile_time = dtime() + keyset_reconcile_interval;
+    double next_hr_rebalance_time = dtime() + config.hr_demand_period;
+    double cur_sleep_interval = min_sleep_interval;
     
     // may need one enumeration per app; create vector
     //
@@ -567,6 +772,7 @@ void feeder_loop() {
         } else {
             action = scan_work_array(work_items);
         }
+        ssp->update_work_for_platform();
         ssp->ready = true;
         if (!action) {
 #ifdef GCL_SIMULATOR
@@ -575,18 +781,45 @@ void feeder_loop() {
             signal(SIGUSR2, simulator_signal_handler);
             pause();
 #else
-            log_messages.printf(MSG_DEBUG,
-                "No action; sleeping %d sec\n", sleep_interval
-            );
-            daemon_sleep(sleep_interval);
+            if (min_sleep_interval) {
+                log_messages.printf(MSG_DEBUG,
+                    "No action; sleeping up to %.2f sec\n", cur_sleep_interval
+                );
+                wait_for_empty_slot(cur_sleep_interval);
+                cur_sleep_interval *= 2;
+                if (cur_sleep_interval > sleep_interval) {
+                    cur_sleep_interval = sleep_interval;
+                }
+            } else {
+                log_messages.printf(MSG_DEBUG,
+                    "No action; sleeping %d sec\n", sleep_interval
+                );
+                daemon_sleep(sleep_interval);
+            }
 #endif
         } else {
+            cur_sleep_interval = min_sleep_interval;
             if (config.job_size_matching) {
                 update_job_stats();
             }
         }
 
         double now = dtime();
+        if (use_keyset && now > next_reconcile_time) {
+            log_messages.printf(MSG_NORMAL,
+                "restarting keyset enumeration from the beginning\n"
+            );
+            for (int i=0; i<napps; i++) {
+                work_items[i].reset_keyset();
+            }
+            next_reconcile_time = now + keyset_reconcile_interval;
+        }
+        if (using_hr && config.hr_allocate_slots && config.hr_demand_shmem_key
+            && now > next_hr_rebalance_time
+        ) {
+            hr_rebalance();
+            next_hr_rebalance_time = now + config.hr_demand_period;
+        }
         if (is_main_feeder && now > next_av_update_time) {
             int retval = update_av_scales(ssp);
             if (retval) {
@@ -661,7 +894,14 @@ void hr_init() {
     using_hr = true;
     if (config.hr_allocate_slots) {
         hr_info.init();
-        retval = hr_info.read_file();
+        if (hr_info_from_pop_stats()) {
+            retval = 0;
+            log_messages.printf(MSG_NORMAL,
+                "using HR info from population stats\n"
+            );
+        } else {
+            retval = hr_info.read_file();
+        }
         if (retval) {
             log_messages.printf(MSG_CRITICAL,
                 "Can't read HR info file: %s\n", boincerror(retval)
@@ -681,6 +921,13 @@ void hr_init() {
         //
         hr_info.allocate(ssp->max_wu_results);
         hr_info.show(stderr);
+
+        if (config.hr_demand_shmem_key) {
+            HR_DEMAND_TABLE* dt = hr_demand_attach();
+            if (!dt) exit(1);
+            hr_info.demand_weight = config.hr_demand_weight;
+            hr_info.update_demand(dt, dtime());
+        }
     }
 }
 
@@ -705,6 +952,7 @@ void usage(char *name) {
         "Options:\n"
         "  [ -d X | --debug_level X]        Set log verbosity to X (1..4)\n"
         "  [ --allapps ]                    Interleave results from all applications uniformly.\n"
+        "  [ --per_app_arrays ]             Like --allapps, but use a contiguous sub-array per app.\n"
         "  [ --random_order ]               order by \"random\" field of result\n"
         "  [ --priority_asc ]               order by increasing \"priority\" field of result\n"
         "  [ --priority_order ]             order by decreasing \"priority\" field of result\n"
@@ -716,6 +964,10 @@ void usage(char *name) {
         "  [ --mod n i ]                    handle only results with (id mod n) == i\n"
         "  [ --wmod n i ]                   handle only workunits with (id mod n) == i\n"
         "  [ --sleep_interval x ]           sleep x seconds if nothing to do\n"
+        "  [ --min_sleep_interval x ]       if nothing to do, sleep x secs, doubling to sleep_interval;\n"
+        "                                   wake up when a scheduler empties a slot\n"
+        "  [ --keyset ]                     query only results after the last one read\n"
+        "  [ --keyset_reconcile x ]         with --keyset, restart from beginning every x secs\n"
         "  [ -h | --help ]                  Shows this help text.\n"
         "  [ -v | --version ]               Shows version information.\n",
         name, name
@@ -739,14 +991,21 @@ int main(int argc, char** argv) {
             if (dl == 4) g_print_queries = true;
         } else if (is_arg(argv[i], "random_order")) {
             order_clause = "order by r1.random ";
+            order_allows_keyset = false;
         } else if (is_arg(argv[i], "allapps")) {
             all_apps = true;
+        } else if (is_arg(argv[i], "per_app_arrays")) {
+            all_apps = true;
+            per_app_arrays = true;
         } else if (is_arg(argv[i], "priority_asc")) {
             order_clause = "order by r1.priority asc ";
+            keyset_order = KEYSET_ORDER_PRIORITY_ASC;
         } else if (is_arg(argv[i], "priority_order")) {
             order_clause = "order by r1.priority desc ";
+            keyset_order = KEYSET_ORDER_PRIORITY_DESC;
         } else if (is_arg(argv[i], "priority_order_create_time")) {
             order_clause = "order by r1.priority desc, r1.workunitid";
+            order_allows_keyset = false;
         } else if (is_arg(argv[i], "by_batch")) {
             // Evenly distribute work among batches
             // The 0=1 causes anything before the union statement
@@ -761,6 +1020,7 @@ int main(int argc, char** argv) {
                 enum_limit
             );
             order_clause = order_buf;      
+            order_allows_keyset = false;
         } else if (is_arg(argv[i], "purge_stale")) {
             purge_stale_time = atoi(argv[++i])*60;
         } else if (is_arg(argv[i], "appids")) {
@@ -792,6 +1052,22 @@ int main(int argc, char** argv) {
             int j = atoi(argv[++i]);
             sprintf(mod_select_clause, "and workunit.id %% %d = %d ", n, j);
             is_main_feeder = (j==0);
+        } else if (is_arg(argv[i], "keyset")) {
+            use_keyset = true;
+        } else if (is_arg(argv[i], "keyset_reconcile")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            keyset_reconcile_interval = atoi(argv[i]);
+        } else if (is_arg(argv[i], "min_sleep_interval")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            min_sleep_interval = atof(argv[i]);
         } else if (is_arg(argv[i], "sleep_interval")) {
             if (!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
@@ -812,6 +1088,13 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (use_keyset && !order_allows_keyset) {
+        log_messages.printf(MSG_CRITICAL,
+            "--keyset can't be used with this ordering option\n"
+        );
+        exit(1);
+    }
+
     retval = config.parse_file();
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
@@ -836,24 +1119,39 @@ int main(int argc, char** argv) {
     destroy_semaphore(sema_key);
     create_semaphore(sema_key);
 
-    retval = destroy_shmem(config.shmem_key);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL, "can't destroy shmem\n");
-        exit(1);
-    }
-
-    int shmem_size = sizeof(SCHED_SHMEM) + num_work_items*sizeof(WU_RESULT);
-    retval = create_shmem(config.shmem_key, shmem_size, 0 /* don't set GID */, &p);
+    bool kept;
+    int shmem_size = SCHED_SHMEM::size(num_work_items);
+    retval = create_sched_shmem(shmem_size, true, &p, kept);
     if (retval) {
         log_messages.printf(MSG_CRITICAL, "can't create shmem\n");
         exit(1);
     }
     ssp = (SCHED_SHMEM*)p;
-    ssp->init(num_work_items);
+    if (kept && !ssp->verify() && ssp->max_wu_results == num_work_items) {
+        ssp->ready = false;
+    } else {
+        kept = false;
+        ssp->init(num_work_items);
+    }
 
     atexit(cleanup_shmem);
     install_stop_signal_handler();
 
+    daemon_metrics.open("feeder");
+    m_slots_empty = daemon_metrics.define(
+        "feeder_slots_empty", METRIC_GAUGE, "Empty slots in the job array"
+    );
+    m_slots_filled = daemon_metrics.define(
+        "feeder_slots_filled", METRIC_GAUGE, "Filled slots in the job array"
+    );
+    m_added = daemon_metrics.define(
+        "feeder_results_added", METRIC_COUNTER, "Results added to the job array"
+    );
+    m_collisions = daemon_metrics.define(
+        "feeder_collisions", METRIC_COUNTER,
+        "Enumerated results that were already in the job array"
+    );
+
     retval = boinc_db.open(
         config.db_name, config.db_host, config.db_user, config.db_passwd
     );
@@ -911,11 +1209,23 @@ int main(int argc, char** argv) {
         weighted_interleave(
             weights, ssp->napps, ssp->max_wu_results, app_indices, counts
         );
+        if (per_app_arrays) {
+            // same number of slots per app, but contiguous
+            //
+            int k = 0;
+            for (i=0; i<ssp->napps; i++) {
+                for (int j=0; j<counts[i]; j++) {
+                    app_indices[k++] = i;
+                }
+            }
+        }
         free(weights);
         free(counts);
     } else {
         napps = 1;
     }
+    set_app_slots();
+    if (kept) check_kept_slots();
 
     hr_init();
 
@@ -31,6 +31,8 @@
 
 #include "config.h"
 #include <list>
+#include <map>
+#include <vector>
 #include <cstring>
 #include <string>
 #include <cstdlib>
@@ -40,6 +42,7 @@
 #include <pwd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #if HAVE_STRINGS_H
 #include <strings.h>
 #endif
@@ -54,9 +57,13 @@
 #include "strings.h"
 #include "svn_version.h"
 
+#include "dir_walk.h"
 #include "sched_config.h"
 #include "sched_util.h"
+#include "daemon_metrics.h"
 #include "sched_msgs.h"
+#include "daemon_lease.h"
+#include "upload_storage.h"
 
 #define LOCKFILE "file_deleter.out"
 #define PIDFILE  "file_deleter.pid"
@@ -70,6 +77,12 @@ bool dont_delete_batches = false;
 bool do_input_files = true;
 bool do_output_files = true;
 int sleep_interval = DEFAULT_SLEEP_INTERVAL;
+int nthreads = 0;
+    // if nonzero, delete files in batches, using this many threads
+DAEMON_LEASE* lease = NULL;
+    // if set, share WUs and results with other instances
+static int m_wus, m_results;
+    // metrics
 
 void usage(char *name) {
     fprintf(stderr, "Deletes files that are no longer needed.\n\n"
@@ -84,6 +97,8 @@ void usage(char *name) {
         "Options:\n"
         "  -d N | --debug_level N          set debug output level (1 to 4)\n"
         "  --mod M R                       handle only WUs with ID mod M == R\n"
+        "  --lease_partition               share WUs and results dynamically\n"
+        "                                  with other instances\n"
         "  --appid ID                      handle only WUs of app with id ID\n"
         "  --app NAME                      handle only WUs of app with name NAME\n"
         "  --one_pass                      instead of sleeping in 2), exit\n"
@@ -95,6 +110,8 @@ void usage(char *name) {
         "  --dont_delete_batches           don't delete anything with positive batch number\n"
         "  --input_files_only              delete only input (download) files\n"
         "  --output_files_only             delete only output (upload) files\n"
+        "  --nthreads N                    delete files in batches, grouped by\n"
+        "                                  directory, using N threads\n"
         "  [ -h | --help ]                 shows this help text\n"
         "  [ -v | --version ]              shows version information\n",
         name
@@ -123,7 +140,8 @@ int get_file_path(
 
 int wu_delete_files(WORKUNIT& wu) {
     char* p;
-    char filename[256], pathname[256], buf[BLOB_SIZE];
+    char filename[256], pathname[256], buf[BLOB_SIZE], md5[256];
+    double nbytes = 0;
     bool no_delete=false;
     int count_deleted = 0, retval, mthd_retval = 0;
 
@@ -135,9 +153,13 @@ int wu_delete_files(WORKUNIT& wu) {
     strcpy(filename, "");
     while (p) {
         if (parse_str(p, "<name>", filename, sizeof(filename))) {
+        } else if (parse_str(p, "<md5_cksum>", md5, sizeof(md5))) {
+        } else if (parse_double(p, "<nbytes>", nbytes)) {
         } else if (match_tag(p, "<file_info>")) {
             no_delete = false;
             strcpy(filename, "");
+            strcpy(md5, "");
+            nbytes = 0;
         } else if (match_tag(p, "<no_delete/>")) {
             no_delete = true;
         } else if (match_tag(p, "</file_info>")) {
@@ -171,6 +193,23 @@ int wu_delete_files(WORKUNIT& wu) {
                     } else {
                         count_deleted++;
                     }
+
+                    // if this was the last link to a stored copy,
+                    // delete that too
+                    //
+                    if (config.download_dedup && strlen(md5)) {
+                        retval = cas_release(
+                            md5, nbytes, config.download_dir,
+                            config.uldl_dir_fanout
+                        );
+                        if (retval) {
+                            log_messages.printf(MSG_CRITICAL,
+                                "[WU#%u] cas_release %s failed: %s\n",
+                                wu.id, filename, boincerror(retval)
+                            );
+                        }
+                    }
+
                     // delete the cached MD5 file if needed
                     //
                     if (config.cache_md5_info) {
@@ -213,7 +252,29 @@ int result_delete_files(RESULT& result) {
         } else if (match_tag(p, "<no_delete/>")) {
             no_delete = true;
         } else if (match_tag(p, "</file_info>")) {
-            if (!no_delete) {
+            if (!no_delete && upload_staging()) {
+                // the file may be staged, cached, and/or in the upload store
+                //
+                retval = upload_delete(filename, config.upload_md5);
+                if (retval == ERR_NOT_FOUND) {
+                    log_messages.printf(
+                        (RESULT_OUTCOME_SUCCESS == result.outcome)?MSG_CRITICAL:MSG_DEBUG,
+                        "[RESULT#%u] outcome=%d client_state=%d No file %s to delete\n",
+                        result.id, result.outcome, result.client_state, filename
+                    );
+                } else if (retval) {
+                    mthd_retval = ERR_UNLINK;
+                    log_messages.printf(MSG_CRITICAL,
+                        "[RESULT#%u] delete %s error: %s\n",
+                        result.id, filename, boincerror(retval)
+                    );
+                } else {
+                    count_deleted++;
+                    log_messages.printf(MSG_NORMAL,
+                        "[RESULT#%u] deleted %s\n", result.id, filename
+                    );
+                }
+            } else if (!no_delete) {
                 retval = get_file_path(
                     filename, config.upload_dir, config.uldl_dir_fanout,
                     pathname
@@ -255,6 +316,13 @@ int result_delete_files(RESULT& result) {
                             "[RESULT#%u] unlinked %s\n", result.id, pathname
                         );
                     }
+
+                    // delete the MD5 written by the upload handler, if any
+                    //
+                    if (config.upload_md5) {
+                        strcat(pathname, UPLOAD_MD5_SUFFIX);
+                        unlink(pathname);
+                    }
                 }
             }
         }
@@ -272,14 +340,368 @@ int result_delete_files(RESULT& result) {
 static bool preserve_wu_files=false;
 static bool preserve_result_files=false;
 
+// Batched deletion (--nthreads N).
+// Enumerate a batch of WUs (or results), get the names of their files,
+// and group these by fanout directory.
+// N threads then take directories in turn (see dir_walk.h),
+// open each one and unlinkat() its files.
+// Finally, update the file_delete_state of the batch
+// with one query per new state.
+//
+// The threads make only system calls;
+// logging and DB access are done by the main thread.
+// If uploads are staged (see upload_storage.h),
+// output files are deleted by the main thread, a result at a time.
+
+// a WU or result in the current batch
+//
+struct DELETE_ITEM {
+    unsigned int id;
+    int file_delete_state;
+    int outcome;
+    int retval;
+    int count_deleted;
+};
+
+struct FILE_DELETION {
+    int item;           // index in batch
+    std::string name;
+    bool md5;           // cached MD5 file; errors are ignored
+    std::string cksum;  // the file's MD5 and size, for <download_dedup>
+    double nbytes;
+    int dir;            // index in dirs
+    int error;          // errno from unlinkat(), or 0
+};
+
+struct DELETE_DIR {
+    std::string path;
+    std::vector<int> deletions;
+    int error;          // errno from open(), or 0
+};
+
+struct DELETE_BATCH {
+    std::vector<DELETE_ITEM> items;
+    std::vector<FILE_DELETION> deletions;
+    std::vector<DELETE_DIR> dirs;
+    std::map<std::string, int> dir_index;
+
+    void clear() {
+        items.clear();
+        deletions.clear();
+        dirs.clear();
+        dir_index.clear();
+    }
+};
+
+// add the deletable files in the given XML (a WU or result xml_doc)
+// to the batch
+//
+static void add_files(
+    DELETE_BATCH& batch, const char* xml_doc, const char* root, bool md5
+) {
+    char* p;
+    char filename[256], path[MAXPATHLEN], buf[BLOB_SIZE], cksum[256];
+    double nbytes = 0;
+    bool no_delete=false;
+    int item = (int)batch.items.size() - 1;
+
+    safe_strcpy(buf, xml_doc);
+    p = strtok(buf, "\n");
+    strcpy(filename, "");
+    strcpy(cksum, "");
+    while (p) {
+        if (parse_str(p, "<name>", filename, sizeof(filename))) {
+        } else if (parse_str(p, "<md5_cksum>", cksum, sizeof(cksum))) {
+        } else if (parse_double(p, "<nbytes>", nbytes)) {
+        } else if (match_tag(p, "<file_info>")) {
+            no_delete = false;
+            strcpy(filename, "");
+            strcpy(cksum, "");
+            nbytes = 0;
+        } else if (match_tag(p, "<no_delete/>")) {
+            no_delete = true;
+        } else if (match_tag(p, "</file_info>")) {
+            if (!no_delete) {
+                dir_hier_path(
+                    filename, root, config.uldl_dir_fanout, path, false
+                );
+                char* q = strrchr(path, '/');
+                *q = 0;
+                int dir;
+                std::map<std::string, int>::iterator it =
+                    batch.dir_index.find(path);
+                if (it == batch.dir_index.end()) {
+                    dir = (int)batch.dirs.size();
+                    DELETE_DIR dd;
+                    dd.path = path;
+                    dd.error = 0;
+                    batch.dirs.push_back(dd);
+                    batch.dir_index[path] = dir;
+                } else {
+                    dir = it->second;
+                }
+                FILE_DELETION fd;
+                fd.item = item;
+                fd.name = filename;
+                fd.md5 = false;
+                fd.cksum = cksum;
+                fd.nbytes = nbytes;
+                fd.dir = dir;
+                fd.error = 0;
+                batch.dirs[dir].deletions.push_back((int)batch.deletions.size());
+                batch.deletions.push_back(fd);
+                if (md5) {
+                    fd.name += ".md5";
+                    fd.md5 = true;
+                    fd.cksum = "";
+                    batch.dirs[dir].deletions.push_back((int)batch.deletions.size());
+                    batch.deletions.push_back(fd);
+                }
+            }
+        }
+        p = strtok(0, "\n");
+    }
+}
+
+// delete the files in one dir of the batch (called by run_dir_workers())
+//
+static void delete_dir_files(int i, void* arg) {
+    DELETE_BATCH& batch = *(DELETE_BATCH*)arg;
+    DELETE_DIR& dd = batch.dirs[i];
+    int dirfd = open(dd.path.c_str(), O_RDONLY|O_DIRECTORY);
+    if (dirfd < 0) {
+        dd.error = errno;
+        return;
+    }
+    for (unsigned int j=0; j<dd.deletions.size(); j++) {
+        FILE_DELETION& fd = batch.deletions[dd.deletions[j]];
+        if (unlinkat(dirfd, fd.name.c_str(), 0)) {
+            fd.error = errno;
+        }
+    }
+    close(dirfd);
+}
+
+static void do_deletions(DELETE_BATCH& batch) {
+    run_dir_workers(
+        (int)batch.dirs.size(), nthreads, delete_dir_files, &batch
+    );
+}
+
+// log the outcome of each deletion, and set each item's retval,
+// following the conventions of wu_delete_files() and result_delete_files()
+//
+static void check_deletions(DELETE_BATCH& batch, bool is_result) {
+    const char* type = is_result?"RESULT":"WU";
+
+    for (unsigned int i=0; i<batch.deletions.size(); i++) {
+        FILE_DELETION& fd = batch.deletions[i];
+        DELETE_ITEM& item = batch.items[fd.item];
+        DELETE_DIR& dd = batch.dirs[fd.dir];
+        int error = dd.error?dd.error:fd.error;
+        if (fd.md5) {
+            if (error && error != ENOENT) {
+                log_messages.printf(MSG_CRITICAL,
+                    "[%s#%u] unlink %s failed: %s\n",
+                    type, item.id, fd.name.c_str(), strerror(error)
+                );
+            }
+            continue;
+        }
+        if (!error) {
+            item.count_deleted++;
+            log_messages.printf(MSG_NORMAL,
+                "[%s#%u] deleted %s/%s\n",
+                type, item.id, dd.path.c_str(), fd.name.c_str()
+            );
+            if (!is_result && config.download_dedup && fd.cksum.size()) {
+                int retval = cas_release(
+                    fd.cksum.c_str(), fd.nbytes, config.download_dir,
+                    config.uldl_dir_fanout
+                );
+                if (retval) {
+                    log_messages.printf(MSG_CRITICAL,
+                        "[%s#%u] cas_release %s failed: %s\n",
+                        type, item.id, fd.name.c_str(), boincerror(retval)
+                    );
+                }
+            }
+        } else if (error == ENOENT) {
+            int debug_or_crit = MSG_CRITICAL;
+            if (is_result && item.outcome != RESULT_OUTCOME_SUCCESS) {
+                debug_or_crit = MSG_DEBUG;
+            }
+            log_messages.printf(debug_or_crit,
+                "[%s#%u] No file %s to delete\n",
+                type, item.id, fd.name.c_str()
+            );
+        } else if (dd.error) {
+            log_messages.printf(MSG_CRITICAL,
+                "[%s#%u] can't open dir %s for %s: %s\n",
+                type, item.id, dd.path.c_str(), fd.name.c_str(),
+                strerror(error)
+            );
+            item.retval = is_result?ERR_OPENDIR:ERR_UNLINK;
+        } else {
+            log_messages.printf(MSG_CRITICAL,
+                "[%s#%u] unlink %s/%s failed: %s\n",
+                type, item.id, dd.path.c_str(), fd.name.c_str(),
+                strerror(error)
+            );
+            item.retval = ERR_UNLINK;
+        }
+    }
+}
+
+static bool update_state(
+    DB_BASE& table, std::string& ids, int n, int state, const char* type
+) {
+    char set_clause[256];
+
+    if (!n) return false;
+    std::string where_clause = "id in (" + ids + ")";
+    sprintf(set_clause, "file_delete_state=%d", state);
+    int retval = table.update_fields_noid(set_clause, where_clause.c_str());
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "update of %d %ss failed: %s\n", n, type, boincerror(retval)
+        );
+        return false;
+    }
+    log_messages.printf(MSG_DEBUG,
+        "file_delete_state of %d %ss updated\n", n, type
+    );
+    return true;
+}
+
+// update file_delete_state of the batch's items,
+// with one query for each new state.
+// Return true if any were changed.
+//
+static bool update_items(DB_BASE& table, DELETE_BATCH& batch, bool is_result) {
+    const char* type = is_result?"RESULT":"WU";
+    std::string done_ids, error_ids;
+    int ndone = 0, nerror = 0;
+    char buf[32];
+    bool did_something = false;
+
+    for (unsigned int i=0; i<batch.items.size(); i++) {
+        DELETE_ITEM& item = batch.items[i];
+        log_messages.printf(MSG_DEBUG,
+            "[%s#%u] deleted %d file(s)\n", type, item.id, item.count_deleted
+        );
+        int new_state;
+        if (item.retval) {
+            new_state = FILE_DELETE_ERROR;
+            log_messages.printf(MSG_CRITICAL,
+                "[%s#%u] file deletion failed: %s\n",
+                type, item.id, boincerror(item.retval)
+            );
+        } else {
+            new_state = FILE_DELETE_DONE;
+        }
+        if (new_state == item.file_delete_state) continue;
+        if (new_state == FILE_DELETE_ERROR) {
+            sprintf(buf, nerror++?",%u":"%u", item.id);
+            error_ids += buf;
+        } else {
+            sprintf(buf, ndone++?",%u":"%u", item.id);
+            done_ids += buf;
+        }
+    }
+    if (update_state(table, done_ids, ndone, FILE_DELETE_DONE, type)) {
+        did_something = true;
+    }
+    if (update_state(table, error_ids, nerror, FILE_DELETE_ERROR, type)) {
+        did_something = true;
+    }
+    return did_something;
+}
+
+static bool do_pass_batched(const char* wu_clause, const char* result_clause) {
+    DB_WORKUNIT wu;
+    DB_RESULT result;
+    DELETE_BATCH batch;
+    DELETE_ITEM item;
+    bool did_something = false;
+    int retval;
+
+    if (do_input_files) {
+        batch.clear();
+        while (1) {
+            retval = wu.enumerate(wu_clause);
+            if (retval) {
+                if (retval != ERR_DB_NOT_FOUND) {
+                    log_messages.printf(MSG_DEBUG, "DB connection lost, exiting\n");
+                    exit(0);
+                }
+                break;
+            }
+            item.id = wu.id;
+            item.file_delete_state = wu.file_delete_state;
+            item.outcome = 0;
+            item.retval = 0;
+            item.count_deleted = 0;
+            batch.items.push_back(item);
+            if (preserve_wu_files || strstr(wu.name, "nodelete")) continue;
+            add_files(
+                batch, wu.xml_doc, config.download_dir, config.cache_md5_info
+            );
+        }
+        daemon_metrics.add(m_wus, batch.items.size());
+        do_deletions(batch);
+        check_deletions(batch, false);
+        if (update_items(wu, batch, false)) did_something = true;
+    }
+
+    if (do_output_files) {
+        batch.clear();
+        while (1) {
+            retval = result.enumerate(result_clause);
+            if (retval) {
+                if (retval != ERR_DB_NOT_FOUND) {
+                    log_messages.printf(MSG_DEBUG, "DB connection lost, exiting\n");
+                    exit(0);
+                }
+                break;
+            }
+            item.id = result.id;
+            item.file_delete_state = result.file_delete_state;
+            item.outcome = result.outcome;
+            item.retval = 0;
+            item.count_deleted = 0;
+            batch.items.push_back(item);
+            if (preserve_result_files) continue;
+            if (upload_staging()) {
+                // not all in upload_dir; delete them one at a time
+                //
+                batch.items.back().retval = result_delete_files(result);
+                continue;
+            }
+            add_files(
+                batch, result.xml_doc_in, config.upload_dir, config.upload_md5
+            );
+        }
+        daemon_metrics.add(m_results, batch.items.size());
+        do_deletions(batch);
+        check_deletions(batch, true);
+        if (update_items(result, batch, true)) did_something = true;
+    }
+    return did_something;
+}
+
+static void release_lease() {
+    lease->release();
+}
+
 // return true if we changed the file_delete_state of a WU or a result
 //
 bool do_pass(bool retry_error) {
     DB_WORKUNIT wu;
     DB_RESULT result;
     bool did_something = false;
-    char buf[256];
-    char clause[256];
+    char buf[1024];
+    char clause[1024];
     int retval, new_state;
 
     check_stop_daemons();
@@ -288,6 +710,18 @@ bool do_pass(bool retry_error) {
     if (id_modulus) {
         sprintf(clause, " and id %% %d = %d ", id_modulus, id_remainder);
     }
+    if (lease) {
+        std::string lease_clause;
+        retval = lease->update();
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't update leases: %s\n", boincerror(retval)
+            );
+            return false;
+        }
+        lease->get_clause("id", lease_clause);
+        strcat(clause, lease_clause.c_str());
+    }
     if (dont_delete_batches) {
         strcat(clause, " and batch <= 0 ");
     }
@@ -301,6 +735,16 @@ bool do_pass(bool retry_error) {
         clause, WUS_PER_ENUM
     );
 
+    if (nthreads) {
+        char result_clause[1024];
+        sprintf(result_clause,
+            "where file_delete_state=%d %s limit %d",
+            retry_error?FILE_DELETE_ERROR:FILE_DELETE_READY,
+            clause, RESULTS_PER_ENUM
+        );
+        return do_pass_batched(buf, result_clause);
+    }
+
     while (do_input_files) {
         retval = wu.enumerate(buf);
         if (retval) {
@@ -311,6 +755,7 @@ bool do_pass(bool retry_error) {
             break;
         }
 
+        daemon_metrics.add(m_wus);
         if (preserve_wu_files) {
             retval = 0;
         } else {
@@ -356,6 +801,7 @@ bool do_pass(bool retry_error) {
             break;
         }
 
+        daemon_metrics.add(m_results);
         if (preserve_result_files) {
             retval = 0;
         } else {
@@ -449,6 +895,8 @@ int main(int argc, char** argv) {
             }
             id_modulus   = atoi(argv[++i]);
             id_remainder = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "lease_partition")) {
+            lease = new DAEMON_LEASE("file_deleter");
         } else if (is_arg(argv[i], "dont_delete_antiques")) {
             log_messages.printf(MSG_CRITICAL, "'%s' has no effect, this file deleter does no antique files deletion\n", argv[i]);
         } else if (is_arg(argv[i], "antiques_deletion_dry_run")) {
@@ -467,6 +915,13 @@ int main(int argc, char** argv) {
             do_output_files = false;
         } else if (is_arg(argv[i], "output_files_only")) {
             do_input_files = false;
+        } else if (is_arg(argv[i], "nthreads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
         } else if (is_arg(argv[i], "sleep_interval")) {
             if (!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
@@ -487,6 +942,12 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (id_modulus && lease) {
+        log_messages.printf(MSG_CRITICAL,
+            "--lease_partition can't be used with --mod\n"
+        );
+        exit(1);
+    }
     if (id_modulus) {
         log_messages.printf(MSG_DEBUG,
             "Using mod'ed WU/result enumeration.  mod = %d  rem = %d\n",
@@ -530,6 +991,16 @@ int main(int argc, char** argv) {
     }
 
     install_stop_signal_handler();
+    if (lease) atexit(release_lease);
+
+    daemon_metrics.open("file_deleter");
+    m_wus = daemon_metrics.define(
+        "file_deleter_wus", METRIC_COUNTER, "WUs whose input files were handled"
+    );
+    m_results = daemon_metrics.define(
+        "file_deleter_results", METRIC_COUNTER,
+        "Results whose output files were handled"
+    );
 
     bool retry_errors_now = !dont_retry_errors;
     double next_error_time=0;
@@ -549,7 +1020,7 @@ int main(int argc, char** argv) {
         }
         if (one_pass) break;
         if (!got_any) {
-            daemon_sleep(sleep_interval);
+            daemon_sleep(sleep_interval, "file_deleter");
         }
         if (!dont_retry_errors && !retry_errors_now && (dtime() > next_error_time)) {
             retry_errors_now = true;
@@ -40,7 +40,9 @@
 #include "crypt.h"
 #include "error_numbers.h"
 #include "filesys.h"
+#include "md5_file.h"
 #include "parse.h"
+#include "shmem.h"
 #include "str_replace.h"
 #include "str_util.h"
 #include "svn_version.h"
@@ -49,6 +51,7 @@
 #include "sched_config.h"
 #include "sched_msgs.h"
 #include "sched_util.h"
+#include "upload_storage.h"
 
 using std::string;
 
@@ -62,6 +65,13 @@ using std::string;
 char this_filename[256];
 double start_time();
 
+// If set, we're handling a <multi_file_upload> request:
+// the reply has already been started,
+// and return_error() and return_success() write a
+// <file_upload_reply> element for the current file (this_filename).
+//
+bool multi_upload = false;
+
 inline static const char* get_remote_addr() {
     char* p = getenv("REMOTE_ADDR");
     if (p) return p;
@@ -76,15 +86,26 @@ int return_error(bool transient, const char* message, ...) {
     vsprintf(buf, message, va);
     va_end(va);
 
-    fprintf(stdout,
-        "Content-type: text/plain\n\n"
-        "<data_server_reply>\n"
-        "    <status>%d</status>\n"
-        "    <message>%s</message>\n"
-        "</data_server_reply>\n",
-        transient?1:-1,
-        buf
-    );
+    if (multi_upload) {
+        fprintf(stdout,
+            "    <file_upload_reply>\n"
+            "        <name>%s</name>\n"
+            "        <status>%d</status>\n"
+            "        <message>%s</message>\n"
+            "    </file_upload_reply>\n",
+            this_filename, transient?1:-1, buf
+        );
+    } else {
+        fprintf(stdout,
+            "Content-type: text/plain\n\n"
+            "<data_server_reply>\n"
+            "    <status>%d</status>\n"
+            "    <message>%s</message>\n"
+            "</data_server_reply>\n",
+            transient?1:-1,
+            buf
+        );
+    }
 
     log_messages.printf(MSG_NORMAL,
         "Returning error to client %s: %s (%s)\n",
@@ -95,6 +116,19 @@ int return_error(bool transient, const char* message, ...) {
 }
 
 int return_success(const char* text) {
+    if (multi_upload) {
+        fprintf(stdout,
+            "    <file_upload_reply>\n"
+            "        <name>%s</name>\n"
+            "        <status>0</status>\n",
+            this_filename
+        );
+        if (text) {
+            fprintf(stdout, "        %s\n", text);
+        }
+        fprintf(stdout, "    </file_upload_reply>\n");
+        return 0;
+    }
     fprintf(stdout,
         "Content-type: text/plain\n\n"
         "<data_server_reply>\n"
@@ -109,6 +143,75 @@ int return_success(const char* text) {
 
 #define BLOCK_SIZE  (256*1024)
 double bytes_left=-1;
+bool copy_started = false;
+    // whether we've started reading the current file's data
+
+#if defined(__linux__) && defined(__GLIBC__) && !defined(_USING_FCGI_)
+// Under CGI on Linux, once stdio's buffer has been used up,
+// copy the rest of the file with splice(),
+// which moves data from stdin (usually a pipe from the web server)
+// to the file without copying it through user space.
+//
+#define USE_SPLICE
+
+// the number of bytes in a stream's input buffer.
+// glibc-specific; this is what gnulib's freadahead() does
+//
+static inline size_t stdio_bytes_buffered(FILE* f) {
+    return f->_IO_read_end - f->_IO_read_ptr;
+}
+
+// copy nleft bytes from in_fd to the current position of out_fd.
+// If in_fd isn't a pipe, go through a pipe of our own.
+// On error return -1, with nleft the number of bytes not copied,
+// and errno set (0 for EOF).
+//
+static int splice_to_file(int in_fd, int out_fd, double& nleft) {
+    struct stat sbuf;
+    int p[2] = {-1, -1};
+    int retval = 0;
+
+    if (fstat(in_fd, &sbuf)) return -1;
+    if (!S_ISFIFO(sbuf.st_mode) && pipe(p)) return -1;
+    while (nleft > 0) {
+        size_t m = nleft<(double)BLOCK_SIZE ? (size_t)nleft : BLOCK_SIZE;
+        ssize_t n = splice(
+            in_fd, NULL, (p[1]<0)?out_fd:p[1], NULL, m,
+            SPLICE_F_MOVE|SPLICE_F_MORE
+        );
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = 0;
+            retval = -1;
+            break;
+        }
+
+        // drain our pipe into the file
+        //
+        ssize_t k = n;
+        while (p[0] >= 0 && k > 0) {
+            ssize_t r = splice(
+                p[0], NULL, out_fd, NULL, k, SPLICE_F_MOVE|SPLICE_F_MORE
+            );
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            k -= r;
+        }
+        if (k) {
+            retval = -1;
+            break;
+        }
+        nleft -= n;
+    }
+    if (p[0] >= 0) {
+        int e = errno;
+        close(p[0]);
+        close(p[1]);
+        errno = e;
+    }
+    return retval;
+}
+#endif
 
 int accept_empty_file(char* path) {
     int fd = open(path,
@@ -121,29 +224,107 @@ int accept_empty_file(char* path) {
         );
     }
     close(fd);
+    if (upload_write_done(this_filename)) {
+        return return_error(ERR_TRANSIENT, "can't store file %s", this_filename);
+    }
     return return_success(0);
 }
 
-// read from socket, write to file
+// add the first nbytes of the file to an MD5 computation
+// (for an upload that's being resumed)
+//
+static int md5_file_prefix(const char* path, double nbytes, MD5_STATE& md5) {
+    unsigned char buf[BLOCK_SIZE];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ERR_FOPEN;
+    while (nbytes > 0) {
+        int m = nbytes<(double)BLOCK_SIZE ? (int)nbytes : BLOCK_SIZE;
+        ssize_t n = read(fd, buf, m);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            return ERR_READ;
+        }
+        md5.append(buf, (int)n);
+        nbytes -= n;
+    }
+    close(fd);
+    return 0;
+}
+
+// write the MD5 of a completed upload to path.md5
+//
+static void write_upload_md5(const char* path, MD5_STATE& md5) {
+    char md5_path[MAXPATHLEN], buf[64];
+    md5.finish(buf);
+    strcat(buf, "\n");
+    sprintf(md5_path, "%s%s", path, UPLOAD_MD5_SUFFIX);
+    int fd = open(md5_path,
+        O_WRONLY|O_CREAT|O_TRUNC,
+        S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH
+    );
+    if (fd < 0) return;
+    ssize_t n = write(fd, buf, strlen(buf));
+    close(fd);
+    if (n != (ssize_t)strlen(buf)) unlink(md5_path);
+}
+
+// read from socket, write to file.
+// If md5 is non-NULL, compute the MD5 of the file as it arrives,
+// and write it to path.md5 when the file is complete.
 // ALWAYS returns an HTML reply
 //
-int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
+int copy_socket_to_file(
+    FILE* in, char* path, double offset, double nbytes, MD5_STATE* md5
+) {
     unsigned char buf[BLOCK_SIZE];
     struct stat sbuf;
     int pid, fd=0;
+#ifdef USE_SPLICE
+    // splice() doesn't let us see the data
+    //
+    bool use_splice = (md5 == NULL);
+#endif
 
     // caller guarantees that nbytes > offset
     //
     bytes_left = nbytes - offset;
+    copy_started = true;
 
     while (bytes_left > 0) {
         int n, m, to_write;
 
+#ifdef USE_SPLICE
+        if (fd && use_splice && stdio_bytes_buffered(in) == 0) {
+            double before = bytes_left;
+            if (!splice_to_file(fileno(in), fd, bytes_left)) break;
+
+            // if the file system doesn't support splice(),
+            // use fread()/write()
+            //
+            if (bytes_left == before && errno == EINVAL) {
+                use_splice = false;
+                continue;
+            }
+            close(fd);
+            if (errno == 0) {
+                return return_error(ERR_TRANSIENT,
+                    "EOF on socket read: %.0f bytes left\n", bytes_left
+                );
+            }
+            return return_error(ERR_TRANSIENT,
+                "can't copy to file %s: %s\n", path,
+                (errno == ENOSPC)?"No space left on server":strerror(errno)
+            );
+        }
+#endif
+
         m = bytes_left<(double)BLOCK_SIZE ? (int)bytes_left : BLOCK_SIZE;
 
         // try to get m bytes from socket (n>=0 is number actually returned)
         //
         n = fread(buf, 1, m, in);
+        bytes_left -= n;
 
         // delay opening the file until we've done the first socket read
         // to avoid filesystem lockups (WCG, possible paranoia)
@@ -185,7 +366,7 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
             // check that file length corresponds to offset
             // TODO: use a 64-bit variant
             //
-            if (stat(path, &sbuf)) {
+            if (fstat(fd, &sbuf)) {
                 close(fd);
                 return return_error(ERR_TRANSIENT,
                     "can't stat file %s: %s\n", path, strerror(errno)
@@ -199,13 +380,34 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
                 );
             }
             if (offset) lseek(fd, offset, SEEK_SET);
+#ifdef __linux__
+            // reserve space for the rest of the file, to limit
+            // fragmentation; keep the length, since it tells
+            // an interrupted upload where to resume
+            //
+            fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)(nbytes-offset));
+#endif
             if (sbuf.st_size > offset) {
                 log_messages.printf(MSG_CRITICAL,
                     "file %s length on disk %d bytes; host upload starting at %.0f bytes.\n",
                      this_filename, (int)sbuf.st_size, offset
                 );
             }
+
+            // for a resumed upload, start the MD5 with what we already have.
+            // If we can't, the scheduler will compute it from the file.
+            //
+            if (md5) {
+                char md5_path[MAXPATHLEN];
+                sprintf(md5_path, "%s%s", path, UPLOAD_MD5_SUFFIX);
+                unlink(md5_path);
+                md5->init();
+                if (offset && md5_file_prefix(path, offset, *md5)) {
+                    md5 = NULL;
+                }
+            }
         }
+        if (md5) md5->append(buf, n);
 
         // try to write n bytes to file
         //
@@ -250,10 +452,15 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
                 );
             }
         }
-
-        bytes_left -= n;
     }
     close(fd);
+    if (md5) write_upload_md5(path, *md5);
+
+    // if uploads are staged, queue the file for replication
+    //
+    if (upload_write_done(this_filename)) {
+        return return_error(ERR_TRANSIENT, "can't store file %s", this_filename);
+    }
     return return_success(0);
 }
 
@@ -268,6 +475,115 @@ void copy_socket_to_null(FILE* in) {
     }
 }
 
+// read and discard the unread part of the current file's data,
+// so that we can go on to the next file of a multi-file upload.
+// Return false on EOF or error.
+//
+bool skip_socket_data(FILE* in) {
+    unsigned char buf[BLOCK_SIZE];
+
+    while (bytes_left > 0) {
+        int m = bytes_left<(double)BLOCK_SIZE ? (int)bytes_left : BLOCK_SIZE;
+        int n = fread(buf, 1, m, in);
+        if (n <= 0) return false;
+        bytes_left -= n;
+    }
+    return true;
+}
+
+// Cache of the MD5s of (signed XML, signature) pairs
+// whose signature we've checked and found valid.
+// A client resuming an upload, or sending it in pieces,
+// sends the same signed XML and signature each time;
+// a hit saves the RSA operation.
+// The MD5 covers the signature as well as the signed XML
+// (which includes the file name and max_nbytes),
+// so a hit means that this exact signature was verified;
+// knowing the signed XML isn't enough.
+//
+// The cache is in shared memory if <fuh_signature_cache_shmem_key>
+// is set (so that it's shared by CGI processes);
+// otherwise it lasts for the life of the process (useful for FCGI).
+// Entries are overwritten without locking;
+// a torn entry just causes a miss.
+//
+#define SIG_CACHE_NSLOTS    4096
+#define SIG_CACHE_MD5_LEN   32
+
+struct SIG_CACHE {
+    char md5[SIG_CACHE_NSLOTS][SIG_CACHE_MD5_LEN];
+};
+
+static SIG_CACHE local_sig_cache;
+static SIG_CACHE* sig_cache = NULL;
+static RSA* upload_rsa = NULL;
+    // the upload key, converted once
+
+static void free_upload_rsa() {
+    if (upload_rsa) {
+        RSA_free(upload_rsa);
+        upload_rsa = NULL;
+    }
+}
+
+static void attach_sig_cache() {
+    void* p;
+    sig_cache = &local_sig_cache;
+    if (!config.fuh_signature_cache_shmem_key) return;
+    int retval = create_shmem(
+        config.fuh_signature_cache_shmem_key, sizeof(SIG_CACHE), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach signature cache shmem (key %x): %d\n",
+            config.fuh_signature_cache_shmem_key, retval
+        );
+        return;
+    }
+    sig_cache = (SIG_CACHE*)p;
+}
+
+static inline char* sig_cache_slot(const char* md5) {
+    char buf[9];
+    memcpy(buf, md5, 8);
+    buf[8] = 0;
+    return sig_cache->md5[strtoul(buf, 0, 16) % SIG_CACHE_NSLOTS];
+}
+
+// check an upload certificate, using the cache
+//
+int check_upload_signature(
+    const char* signed_xml, const char* xml_signature,
+    R_RSA_PUBLIC_KEY& key, bool& is_valid
+) {
+    char md5[MD5_LEN];
+    int retval;
+
+    if (!sig_cache) attach_sig_cache();
+    string s = string(signed_xml) + "\n" + xml_signature;
+    retval = md5_block((const unsigned char*)s.c_str(), (int)s.size(), md5);
+    if (!retval && !memcmp(sig_cache_slot(md5), md5, SIG_CACHE_MD5_LEN)) {
+        is_valid = true;
+        log_messages.printf(MSG_DEBUG,
+            "signature of %s found in cache\n", this_filename
+        );
+        return 0;
+    }
+    if (upload_rsa) {
+        retval = check_string_signature(
+            signed_xml, xml_signature, upload_rsa, is_valid
+        );
+    } else {
+        retval = check_string_signature(
+            signed_xml, xml_signature, key, is_valid
+        );
+    }
+    if (!retval && is_valid && strlen(md5) == SIG_CACHE_MD5_LEN) {
+        memcpy(sig_cache_slot(md5), md5, SIG_CACHE_MD5_LEN);
+    }
+    return retval;
+}
+
 // ALWAYS generates an HTML reply
 //
 int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
@@ -281,6 +597,8 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
 
     strcpy(name, "");
     strcpy(xml_signature, "");
+    bytes_left = 0;
+    copy_started = false;
     bool found_data = false;
     while (fgets(buf, 256, in)) {
 #if 1
@@ -313,6 +631,12 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
         }
         log_messages.printf(MSG_CRITICAL, "unrecognized: %s", buf);
     }
+
+    // the data that follows; if we return before reading it,
+    // skip_socket_data() discards it
+    //
+    if (found_data && nbytes > offset) bytes_left = nbytes - offset;
+
     if (strlen(name) == 0) {
         return return_error(ERR_PERMANENT, "Missing name");
     }
@@ -330,7 +654,7 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
             "<name>%s</name><max_nbytes>%.0f</max_nbytes>",
             name, max_nbytes
         );
-        retval = check_string_signature(
+        retval = check_upload_signature(
             signed_xml, xml_signature, key, is_valid
         );
         if (retval || !is_valid) {
@@ -356,7 +680,7 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
                 "file size (%d KB) exceeds limit (%d KB)",
                 (int)(nbytes/1024), (int)(max_nbytes/1024)
             );
-            copy_socket_to_null(in);
+            if (!multi_upload) copy_socket_to_null(in);
             return return_error(ERR_PERMANENT, buf);
         }
     }
@@ -376,14 +700,11 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
         );
     }
 
-    retval = dir_hier_path(
-        name, config.upload_dir, config.uldl_dir_fanout,
-        path, true
-    );
+    retval = upload_write_path(name, path);
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
             "Failed to find/create directory for file '%s' in '%s'\n",
-            name, config.upload_dir
+            name, upload_staging()?config.upload_stage_dir:config.upload_dir
         );
         return return_error(ERR_TRANSIENT, "can't open file");
     }
@@ -406,9 +727,20 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
             log_messages.printf(MSG_CRITICAL,
                 "ERROR: offset >= nbytes!!\n"
             );
+
+            // we may have failed to queue the file the last time
+            //
+            upload_write_done(name);
             return return_success(0);
         }
-        retval = copy_socket_to_file(in, path, offset, nbytes);
+        // compute the MD5 of VDA chunks in-stream,
+        // and of all files if <upload_md5> is set
+        //
+        MD5_STATE md5;
+        bool is_vda = !strncmp(name, VDA_UPLOAD_PREFIX, strlen(VDA_UPLOAD_PREFIX));
+        retval = copy_socket_to_file(
+            in, path, offset, nbytes, (is_vda || config.upload_md5)?&md5:NULL
+        );
         log_messages.printf(MSG_NORMAL,
             "Ended upload of %s from %s; retval %d\n",
             name,
@@ -442,13 +774,12 @@ int handle_get_file_size(char* file_name) {
     // TODO: check to ensure path doesn't point somewhere bad
     // Use 64-bit variant
     //
-    retval = dir_hier_path(
-        file_name, config.upload_dir, config.uldl_dir_fanout, path
-    );
+    char* dir = upload_staging()?config.upload_stage_dir:config.upload_dir;
+    retval = upload_write_path(file_name, path);
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
             "Failed to find/create directory for file '%s' in '%s'.\n",
-            file_name, config.upload_dir
+            file_name, dir
         );
         return return_error(ERR_TRANSIENT, "can't open file");
     }
@@ -456,7 +787,7 @@ int handle_get_file_size(char* file_name) {
     // if the volume is full, report a transient error
     // to prevent the client from starting a transfer
     //
-    if (volume_full(config.upload_dir)) {
+    if (volume_full(dir)) {
         return return_error(ERR_TRANSIENT, "Server is out of disk space");
     }
 
@@ -514,6 +845,51 @@ int handle_get_file_size(char* file_name) {
     return return_success(buf);
 }
 
+// handle a <multi_file_upload> request:
+// a sequence of <file_upload> and <get_file_size> elements,
+// each handled as if it were a separate request.
+// The reply has a <file_upload_reply> for each;
+// if a file's data can't be read, we stop there,
+// and the client will retry the remaining files.
+//
+int handle_multi_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
+    char buf[256], file_name[256];
+    int retval, nfiles=0;
+
+    fprintf(stdout,
+        "Content-type: text/plain\n\n"
+        "<data_server_reply>\n"
+        "    <status>0</status>\n"
+    );
+    multi_upload = true;
+    while (fgets(buf, 256, in)) {
+        if (match_tag(buf, "</multi_file_upload>")) break;
+        if (match_tag(buf, "<file_upload>")) {
+            strcpy(this_filename, "");
+            retval = handle_file_upload(in, key);
+            nfiles++;
+            if (retval && (copy_started || !skip_socket_data(in))) {
+                break;
+            }
+        } else if (parse_str(buf, "<get_file_size>", file_name, sizeof(file_name))) {
+            safe_strcpy(this_filename, file_name);
+            if (strstr(file_name, "..")) {
+                return_error(ERR_PERMANENT, "Bad filename");
+            } else {
+                handle_get_file_size(file_name);
+            }
+            nfiles++;
+        }
+    }
+    multi_upload = false;
+    fprintf(stdout, "</data_server_reply>\n");
+    log_messages.printf(MSG_NORMAL,
+        "multi-file upload from %s: handled %d files\n",
+        get_remote_addr(), nfiles
+    );
+    return 0;
+}
+
 // always generates an HTML reply
 //
 int handle_request(FILE* in, R_RSA_PUBLIC_KEY& key) {
@@ -544,6 +920,14 @@ int handle_request(FILE* in, R_RSA_PUBLIC_KEY& key) {
             }
             did_something = true;
             break;
+        } else if (match_tag(buf, "<multi_file_upload>")) {
+            if (!got_version) {
+                retval = return_error(ERR_PERMANENT, "Missing version");
+            } else {
+                retval = handle_multi_file_upload(in, key);
+            }
+            did_something = true;
+            break;
         } else if (parse_str(buf, "<get_file_size>", file_name, sizeof(file_name))) {
             if (strstr(file_name, "..")) {
                 return return_error(ERR_PERMANENT, "Bad filename");
@@ -714,6 +1098,9 @@ int main(int argc, char *argv[]) {
             return_error(ERR_TRANSIENT, "can't read key file");
             exit(1);
         }
+        upload_rsa = RSA_new();
+        public_to_openssl(key, upload_rsa);
+        atexit(free_upload_rsa);
     }
 
 #ifdef _USING_FCGI_
@@ -37,11 +37,13 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <zlib.h>
 
 #include "backend_lib.h"
 #include "boinc_db.h"
 #include "error_numbers.h"
 #include "filesys.h"
+#include "gzip_util.h"
 #include "parse.h"
 #include "str_replace.h"
 #include "str_util.h"
@@ -50,14 +52,19 @@
 #include "sched_vda.h"
 
 #include "credit.h"
+#include "sched_cache.h"
+#include "sched_host_lock.h"
 #include "sched_files.h"
 #include "sched_main.h"
+#include "sched_reply_cache.h"
 #include "sched_types.h"
 #include "sched_util.h"
 #include "handle_request.h"
 #include "sched_msgs.h"
 #include "sched_resend.h"
 #include "sched_send.h"
+#include "sched_timing.h"
+#include "daemon_metrics.h"
 #include "sched_config.h"
 #include "sched_locality.h"
 #include "sched_result.h"
@@ -112,19 +119,29 @@ static void send_error_message(const char* msg, int delay) {
 
 // Try to lock a file with name based on host ID,
 // to prevent 2 schedulers from running at same time for same host.
+// If <host_lock_shmem_key> is set, use the shared-memory
+// host lock table instead (no disk I/O).
 // Return:
 // 0 if successful
-//    In this case store file descriptor in reply struct so we can unlock later
+//    In this case store file descriptor (or table slot)
+//    in reply struct so we can unlock later
 //    In other cases store -1 in reply struct
 // PID (>0) if another process has lock
 // -1 if error (e.g. can't create file)
 //
 int lock_sched() {
+    SCHED_TIMER timer(SCHED_STAGE_LOCK);
+
     char filename[256];
     char pid_string[16];
     int fd, pid, count;
 
     g_reply->lockfile_fd=-1;
+    g_reply->host_lock_slot = -1;
+
+    if (config.host_lock_shmem_key) {
+        return host_lock_acquire(g_reply->host.id, g_reply->host_lock_slot);
+    }
 
     sprintf(filename, "%s/CGI_%07d",
         config.sched_lockfile_dir, g_reply->host.id
@@ -162,6 +179,10 @@ int lock_sched() {
 void unlock_sched() {
     char filename[256];
 
+    if (g_reply->host_lock_slot >= 0) {
+        host_lock_release(g_reply->host.id, g_reply->host_lock_slot);
+        g_reply->host_lock_slot = -1;
+    }
     if (g_reply->lockfile_fd < 0) return;
     sprintf(filename, "%s/CGI_%07d", config.sched_lockfile_dir, g_reply->host.id);
     unlink(filename);
@@ -240,6 +261,8 @@ static void mark_results_over(DB_HOST& host) {
 // - if user belongs to a team, reply.team contains team record
 //
 int authenticate_user() {
+    SCHED_TIMER timer(SCHED_STAGE_AUTHENTICATE);
+
     int retval;
     char buf[1024];
     DB_HOST host;
@@ -276,8 +299,7 @@ int authenticate_user() {
         // and see if the authenticator matches (regular or weak)
         //
         g_request->using_weak_auth = false;
-        sprintf(buf, "where id=%d", host.userid);
-        retval = user.lookup(buf);
+        retval = lookup_user_cached(host.userid, user);
         if (!retval && !strcmp(user.authenticator, g_request->authenticator)) {
             // req auth matches user auth - go on
         } else {
@@ -466,7 +488,7 @@ got_host:
     //
 
     if (g_reply->user.teamid) {
-        retval = team.lookup_id(g_reply->user.teamid);
+        retval = lookup_team_cached(g_reply->user.teamid, team);
         if (!retval) g_reply->team = team;
     }
 
@@ -561,6 +583,8 @@ static int modify_host_struct(HOST& host) {
 // update only those fields that have changed
 //
 static int update_host_record(HOST& initial_host, HOST& xhost, USER& user) {
+    SCHED_TIMER timer(SCHED_STAGE_UPDATE_HOST);
+
     DB_HOST host;
     int retval;
     char buf[1024];
@@ -633,36 +657,33 @@ int send_result_abort() {
     // and decide if they should be aborted
     //
     while (!(retval = result.enumerate(g_reply->host.id, result_names.c_str()))) {
-        for (i=0; i<g_request->other_results.size(); i++) {
-            OTHER_RESULT& orp = g_request->other_results[i];
-            if (!strcmp(orp.name, result.result_name)) {
-                if (result.error_mask&WU_ERROR_CANCELLED ) {
-                    // if the WU has been canceled, abort the result
-                    //
-                    orp.abort = true;
-                    orp.abort_if_not_started = false;
-                    orp.reason = ABORT_REASON_WU_CANCELLED;
-                } else if (result.assimilate_state == ASSIMILATE_DONE) {
-                    // if the WU has been assimilated, abort if not started
-                    //
-                    orp.abort = false;
-                    orp.abort_if_not_started = true;
-                    orp.reason = ABORT_REASON_ASSIMILATED;
-                } else if (result.server_state == RESULT_SERVER_STATE_OVER
-                    && result.outcome == RESULT_OUTCOME_NO_REPLY
-                ) {
-                    // if timed out, abort if not started
-                    //
-                    orp.abort = false;
-                    orp.abort_if_not_started = true;
-                    orp.reason = ABORT_REASON_TIMED_OUT;
-                } else {
-                    // all is good with the result - let it process
-                    orp.abort = false;
-                    orp.abort_if_not_started = false;
-                }
-                break;
-            }
+        OTHER_RESULT* orpp = g_request->lookup_other_result(result.result_name);
+        if (!orpp) continue;
+        OTHER_RESULT& orp = *orpp;
+        if (result.error_mask&WU_ERROR_CANCELLED ) {
+            // if the WU has been canceled, abort the result
+            //
+            orp.abort = true;
+            orp.abort_if_not_started = false;
+            orp.reason = ABORT_REASON_WU_CANCELLED;
+        } else if (result.assimilate_state == ASSIMILATE_DONE) {
+            // if the WU has been assimilated, abort if not started
+            //
+            orp.abort = false;
+            orp.abort_if_not_started = true;
+            orp.reason = ABORT_REASON_ASSIMILATED;
+        } else if (result.server_state == RESULT_SERVER_STATE_OVER
+            && result.outcome == RESULT_OUTCOME_NO_REPLY
+        ) {
+            // if timed out, abort if not started
+            //
+            orp.abort = false;
+            orp.abort_if_not_started = true;
+            orp.reason = ABORT_REASON_TIMED_OUT;
+        } else {
+            // all is good with the result - let it process
+            orp.abort = false;
+            orp.abort_if_not_started = false;
         }
     }
 
@@ -741,21 +762,29 @@ int handle_global_prefs() {
     // and parse them into g_request->global_prefs
     //
     if (have_working_prefs) {
-        g_request->global_prefs.parse(g_request->working_global_prefs_xml, "");
+        parse_global_prefs_cached(g_reply->user.id,
+            g_request->working_global_prefs_xml, "", g_request->global_prefs
+        );
         if (config.debug_prefs) {
             log_messages.printf(MSG_NORMAL, "[prefs] using working prefs\n");
         }
     } else {
         if (have_master_prefs) {
             if (have_db_prefs && db_mod_time > master_mod_time) {
-                g_request->global_prefs.parse(g_reply->user.global_prefs, g_reply->host.venue);
+                parse_global_prefs_cached(g_reply->user.id,
+                    g_reply->user.global_prefs, g_reply->host.venue,
+                    g_request->global_prefs
+                );
                 if (config.debug_prefs) {
                     log_messages.printf(MSG_NORMAL,
                         "[prefs] using db prefs - more recent\n"
                     );
                 }
             } else {
-                g_request->global_prefs.parse(g_request->global_prefs_xml, g_reply->host.venue);
+                parse_global_prefs_cached(g_reply->user.id,
+                    g_request->global_prefs_xml, g_reply->host.venue,
+                    g_request->global_prefs
+                );
                 if (config.debug_prefs) {
                     log_messages.printf(MSG_NORMAL,
                         "[prefs] using master prefs\n"
@@ -764,7 +793,10 @@ int handle_global_prefs() {
             }
         } else {
             if (have_db_prefs) {
-                g_request->global_prefs.parse(g_reply->user.global_prefs, g_reply->host.venue);
+                parse_global_prefs_cached(g_reply->user.id,
+                    g_reply->user.global_prefs, g_reply->host.venue,
+                    g_request->global_prefs
+                );
                 if (config.debug_prefs) {
                     log_messages.printf(MSG_NORMAL, "[prefs] using db prefs\n");
                 }
@@ -1035,18 +1067,49 @@ void handle_msgs_from_host() {
     }
 }
 
+// Send the host's unhandled messages, if it has any.
+// The host's msgs_pending flag is cleared before looking,
+// so a message inserted meanwhile sets it again
+// and goes out in the next RPC.
+//
 void handle_msgs_to_host() {
     DB_MSG_TO_HOST mth;
-    char buf[256];
+    DB_HOST host;
+    char buf[256], idbuf[32];
+    std::string ids;
+    int retval;
+
+    if (!g_reply->host.msgs_pending) return;
+    host.id = g_reply->host.id;
+    retval = host.update_field("msgs_pending=0");
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[HOST#%d] can't clear msgs_pending: %s\n",
+            host.id, boincerror(retval)
+        );
+        return;
+    }
     sprintf(buf, "where hostid = %d and handled = %d", g_reply->host.id, 0);
     while (!mth.enumerate(buf)) {
         g_reply->msgs_to_host.push_back(mth);
-        mth.handled = true;
-        mth.update();
+        sprintf(idbuf, ids.empty()?"%d":",%d", mth.id);
+        ids += idbuf;
+    }
+    if (ids.empty()) return;
+    ids = "id in (" + ids + ")";
+    retval = mth.update_fields_noid("handled=1", ids.c_str());
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[HOST#%d] can't mark messages as handled: %s\n",
+            host.id, boincerror(retval)
+        );
     }
 }
 
 static void log_request() {
+    char buf[64];
+    sprintf(buf, "%d.%d", g_reply->host.id, g_request->rpc_seqno);
+    log_messages.set_request_id(buf);
     log_messages.printf(MSG_NORMAL,
         "Request: [USER#%d] [HOST#%d] [IP %s] client %d.%d.%d\n",
         g_reply->user.id, g_reply->host.id, get_remote_addr(),
@@ -1092,6 +1155,68 @@ static inline bool requesting_work() {
     return false;
 }
 
+// Use the feeder's summary (SCHED_SHMEM::work_for_platform)
+// to see if there are no jobs for the host's platforms
+// and the processor types it's asking work for.
+// This doesn't claim a slot, or need the DB.
+// Return false if jobs may come from elsewhere
+// (locality scheduling, assignments, lost results)
+// or the client supplies its own app versions.
+//
+static bool no_work_for_host() {
+    bool want[NPROC_TYPES];
+    vector<PLATFORM*> platforms;
+    unsigned int i;
+    int j;
+
+    if (config.locality_scheduling || config.locality_scheduler_fraction) {
+        return false;
+    }
+    if (config.enable_assignment || config.resend_lost_results) return false;
+    if (!strcmp(g_request->platform.name, "anonymous")) return false;
+
+    PLATFORM* p = ssp->lookup_platform(g_request->platform.name);
+    if (p) platforms.push_back(p);
+    for (i=0; i<g_request->alt_platforms.size(); i++) {
+        p = ssp->lookup_platform(g_request->alt_platforms[i].name);
+        if (p) platforms.push_back(p);
+    }
+
+    // old clients ask for work in general
+    //
+    bool all = g_request->work_req_seconds > 0;
+    want[PROC_TYPE_CPU] = all || g_request->cpu_req_secs > 0 || ssp->have_nci_app;
+    want[PROC_TYPE_NVIDIA_GPU] = g_request->coprocs.nvidia.count
+        && (all || g_request->coprocs.nvidia.req_secs);
+    want[PROC_TYPE_AMD_GPU] = g_request->coprocs.ati.count
+        && (all || g_request->coprocs.ati.req_secs);
+    want[PROC_TYPE_INTEL_GPU] = g_request->coprocs.intel_gpu.count
+        && (all || g_request->coprocs.intel_gpu.req_secs);
+
+    for (i=0; i<platforms.size(); i++) {
+        int k = platforms[i] - ssp->platforms;
+        for (j=0; j<NPROC_TYPES; j++) {
+            if (want[j] && ssp->work_for_platform[k][j]) return false;
+        }
+    }
+    return true;
+}
+
+// if update_host_after_reply is set, process_request() leaves
+// the host record update to handle_request_aux(), using this
+//
+static bool host_update_pending = false;
+static HOST pending_initial_host;
+
+// process_request() got to the end; the reply can be cached
+//
+static bool request_handled = false;
+
+// MD5 of the request text;
+// a cached reply is sent only to an identical request
+//
+static char request_md5[256];
+
 void process_request(char* code_sign_key) {
     PLATFORM* platform;
     int retval;
@@ -1119,6 +1244,18 @@ void process_request(char* code_sign_key) {
         ok_to_send_work = false;
     }
 
+    // if we're overloaded, refuse work, but still accept reported jobs;
+    // if there are none, we return below without accessing the DB
+    //
+    if (ok_to_send_work && requesting_work()) {
+        int delay = sched_shed_delay();
+        if (delay) {
+            ok_to_send_work = false;
+            g_reply->insert_message("Server is busy; will try later", "low");
+            g_reply->set_delay(delay);
+        }
+    }
+
     // if no jobs reported and none to send, return without accessing DB
     //
     if (!ok_to_send_work && !g_request->results.size()) {
@@ -1130,13 +1267,14 @@ void process_request(char* code_sign_key) {
     if (requesting_work()) {
         if (config.locality_scheduling || config.locality_scheduler_fraction || config.enable_assignment) {
             have_no_work = false;
+        } else if (no_work_for_host()) {
+            have_no_work = true;
+            g_wreq->no_jobs_available = true;
         } else {
-            lock_sema();
             have_no_work = ssp->no_work(g_pid);
             if (have_no_work) {
                 g_wreq->no_jobs_available = true;
             }
-            unlock_sema();
         }
     }
 
@@ -1194,7 +1332,7 @@ void process_request(char* code_sign_key) {
         goto leave;
     }
 
-    if (strlen(config.sched_lockfile_dir)) {
+    if (strlen(config.sched_lockfile_dir) || config.host_lock_shmem_key) {
         int pid_with_lock = lock_sched();
         if (pid_with_lock > 0) {
             log_messages.printf(MSG_CRITICAL,
@@ -1352,8 +1490,15 @@ void process_request(char* code_sign_key) {
         handle_msgs_to_host();
     }
 
-    update_host_record(initial_host, g_reply->host, g_reply->user);
-    write_host_app_versions();
+    request_handled = true;
+
+    if (config.update_host_after_reply) {
+        pending_initial_host = initial_host;
+        host_update_pending = true;
+    } else {
+        update_host_record(initial_host, g_reply->host, g_reply->user);
+        write_host_app_versions();
+    }
 
 leave:
     if (!have_no_work) {
@@ -1389,24 +1534,240 @@ static void log_user_messages() {
     }
 }
 
-void handle_request(FILE* fin, FILE* fout, char* code_sign_key) {
+// scheduler processes share a metrics page
+//
+static void record_metrics(int nreported, int nsent, double dt) {
+    static bool opened = false;
+    static int m_requests, m_reported, m_sent, m_time;
+
+    if (!config.daemon_metrics) return;
+    if (!opened) {
+        opened = true;
+        daemon_metrics.open("scheduler", true);
+        m_requests = daemon_metrics.define(
+            "scheduler_requests", METRIC_COUNTER, "Scheduler requests"
+        );
+        m_reported = daemon_metrics.define(
+            "scheduler_results_reported", METRIC_COUNTER, "Results reported"
+        );
+        m_sent = daemon_metrics.define(
+            "scheduler_jobs_sent", METRIC_COUNTER, "Jobs sent"
+        );
+        m_time = daemon_metrics.define(
+            "scheduler_request_seconds", METRIC_HISTOGRAM,
+            "Time to handle a request, up to writing the reply"
+        );
+    }
+    daemon_metrics.add(m_requests);
+    daemon_metrics.add(m_reported, nreported);
+    daemon_metrics.add(m_sent, nsent);
+    daemon_metrics.observe(m_time, dt);
+}
+
+// Clients send a gzipped request if we've told them we accept it
+// (see <gzip_request/> in SCHEDULER_REPLY::write()).
+// We look at the data rather than Content-Encoding,
+// since the web server may or may not have decompressed it already.
+//
+static inline bool is_gzipped(std::string& s) {
+    return s.size() >= 2
+        && (unsigned char)s[0] == 0x1f
+        && (unsigned char)s[1] == 0x8b;
+}
+
+static int gunzip_request(std::string& s) {
+    std::string out;
+    int retval = gunzip_mem(s.data(), s.size(), out);
+    if (retval) return retval;
+    s.swap(out);
+    return 0;
+}
+
+// The client (libcurl) says what encodings it accepts.
+// Don't compress replies we're saving for debugging.
+//
+static bool gzip_reply_ok() {
+    if (config.dont_gzip_sched_reply) return false;
+    if (strlen(config.debug_req_reply_dir)) return false;
+    const char* p = getenv("HTTP_ACCEPT_ENCODING");
+    if (!p) return false;
+    return strstr(p, "gzip") != NULL;
+}
+
+// the reply can be sent again if the client retries this request
+//
+static bool cache_reply_ok(SCHEDULER_REPLY& sreply, SCHEDULER_REQUEST& sreq) {
+    if (config.reply_cache_max_age <= 0) return false;
+    if (!request_handled || !request_md5[0]) return false;
+    return sreq.hostid && sreply.host.id == sreq.hostid;
+}
+
+// Put the reply (in tmp) in the cache, and send it
+//
+static void write_cached_reply(FILE* fout, FILE* tmp, SCHEDULER_REQUEST& sreq) {
+    std::string text, gz;
+    char buf[65536];
+    size_t n;
+    int retval;
+
+    rewind(tmp);
+    while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0) {
+        text.append(buf, n);
+    }
+    retval = gzip_mem(text.data(), text.size(), gz, Z_DEFAULT_COMPRESSION);
+    if (!retval) {
+        retval = reply_cache_store(
+            sreq.hostid, sreq.rpc_seqno, sreq.authenticator, request_md5, gz
+        );
+    }
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't cache reply: %s\n", boincerror(retval)
+        );
+    }
+    if (!retval && gzip_reply_ok()) {
+        fprintf(fout,
+            "Content-type: text/xml\n"
+            "Content-Encoding: gzip\n\n"
+        );
+        fwrite(gz.data(), 1, gz.size(), fout);
+    } else {
+        fprintf(fout, "Content-type: text/xml\n\n");
+        fwrite(text.data(), 1, text.size(), fout);
+    }
+}
+
+// send a cached reply to a retried request
+//
+static void send_cached_reply(FILE* fout, std::string& gz) {
+    if (gzip_reply_ok()) {
+        fprintf(fout,
+            "Content-type: text/xml\n"
+            "Content-Encoding: gzip\n\n"
+        );
+        fwrite(gz.data(), 1, gz.size(), fout);
+        return;
+    }
+    std::string text;
+    int retval = gunzip_mem(gz.data(), gz.size(), text);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't decompress cached reply: %s\n", boincerror(retval)
+        );
+    }
+    fprintf(fout, "Content-type: text/xml\n\n");
+    fwrite(text.data(), 1, text.size(), fout);
+}
+
+// Write the reply, gzipped if the client accepts it.
+// We build the reply in a temp file first;
+// if that can't be created, send it uncompressed.
+//
+static void write_reply(
+    FILE* fout, SCHEDULER_REPLY& sreply, SCHEDULER_REQUEST& sreq
+) {
+    FILE* tmp = NULL;
+    bool cache = cache_reply_ok(sreply, sreq);
+    if (cache || gzip_reply_ok()) {
+        tmp = tmpfile();
+    }
+    if (!tmp) {
+        fprintf(fout, "Content-type: text/xml\n\n");
+        sreply.write(fout, sreq);
+        return;
+    }
+    sreply.write(tmp, sreq);
+    if (cache) {
+        write_cached_reply(fout, tmp, sreq);
+        fclose(tmp);
+        return;
+    }
+    fprintf(fout,
+        "Content-type: text/xml\n"
+        "Content-Encoding: gzip\n\n"
+    );
+    rewind(tmp);
+    int retval = gzip_stream(tmp, fout, Z_DEFAULT_COMPRESSION, 1);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "gzip of reply failed: %s\n", boincerror(retval)
+        );
+    }
+    fclose(tmp);
+}
+
+static void handle_request_aux(FILE* fin, FILE* fout, char* code_sign_key) {
     SCHEDULER_REQUEST sreq;
     SCHEDULER_REPLY sreply;
     char buf[1024];
+    int retval;
 
     g_request = &sreq;
     g_reply = &sreply;
     g_wreq = &sreply.wreq;
+    request_handled = false;
+    request_md5[0] = 0;
 
     sreply.nucleus_only = true;
 
     log_messages.set_indent_level(1);
+    log_messages.set_request_id("");
+
+    // read the request into memory;
+    // XML_PARSER scans memory much faster than a stream
+    //
+    std::string req_text;
+    char rbuf[65536];
+    size_t n;
+    while ((n = fread(rbuf, 1, sizeof(rbuf), fin)) > 0) {
+        req_text.append(rbuf, n);
+    }
+    if (is_gzipped(req_text)) {
+        size_t zsize = req_text.size();
+        if (gunzip_request(req_text)) {
+            log_messages.printf(MSG_NORMAL,
+                "can't decompress request (%d bytes)\n", (int)zsize
+            );
+            req_text.clear();
+        } else if (config.debug_request_details) {
+            log_messages.printf(MSG_NORMAL,
+                "decompressed request: %d -> %d bytes\n",
+                (int)zsize, (int)req_text.size()
+            );
+        }
+    }
 
+    SCHED_TIMER request_timer(SCHED_STAGE_REQUEST);
     MIOFILE mf;
     XML_PARSER xp(&mf);
-    mf.init_file(fin);
-    const char* p = sreq.parse(xp);
+    mf.init_buf_read(req_text.c_str());
+    const char* p;
+    {
+        SCHED_TIMER timer(SCHED_STAGE_PARSE);
+        p = sreq.parse(xp);
+    }
     double start_time = dtime();
+
+    // if this is a retry of a request we've handled, send the same reply
+    //
+    if (!p && config.reply_cache_max_age > 0) {
+        std::string gz;
+        md5_block(
+            (const unsigned char*)req_text.data(), (int)req_text.size(),
+            request_md5
+        );
+        if (!reply_cache_lookup(
+            sreq.hostid, sreq.rpc_seqno, sreq.authenticator, request_md5, gz
+        )) {
+            log_messages.printf(MSG_NORMAL,
+                "[HOST#%d] retried RPC (seqno %d); sending cached reply\n",
+                sreq.hostid, sreq.rpc_seqno
+            );
+            send_cached_reply(fout, gz);
+            return;
+        }
+    }
+
     if (!p){
         process_request(code_sign_key);
 
@@ -1423,14 +1784,56 @@ void handle_request(FILE* fin, FILE* fout, char* code_sign_key) {
         log_user_messages();
     }
 
-    sreply.write(fout, sreq);
+    {
+        SCHED_TIMER timer(SCHED_STAGE_WRITE_REPLY);
+        write_reply(fout, sreply, sreq);
+    }
     log_messages.printf(MSG_NORMAL,
         "Scheduler ran %.3f seconds\n", dtime()-start_time
     );
+    record_metrics(
+        p?0:(int)sreq.results.size(), (int)sreply.results.size(),
+        dtime()-start_time
+    );
+
+    // the rest needn't hold up the client
+    //
+    retval = state_count_deltas.flush();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't update state_counts: %s\n", boincerror(retval)
+        );
+    }
+
+    // reported results make their WUs ready for the transitioner
+    //
+    if (!p && sreq.results.size()) {
+        daemon_notify("transitioner");
+    }
+    if (host_update_pending) {
+        host_update_pending = false;
+        finish_reply(fout);
+        update_host_record(pending_initial_host, sreply.host, sreply.user);
+        write_host_app_versions();
+    }
 
-    if (strlen(config.sched_lockfile_dir)) {
+    if (strlen(config.sched_lockfile_dir) || config.host_lock_shmem_key) {
         unlock_sched();
     }
 }
 
+void handle_request(FILE* fin, FILE* fout, char* code_sign_key) {
+    if (config.sched_arena_block_size > 0
+        && sched_arena.block_size != (size_t)config.sched_arena_block_size
+    ) {
+        sched_arena.init(config.sched_arena_block_size);
+    }
+
+    // the request and reply are destroyed on return,
+    // after which their arena memory can be reclaimed
+    //
+    handle_request_aux(fin, fout, code_sign_key);
+    sched_arena.reset();
+}
+
 const char *BOINC_RCSID_2ac231f9de = "$Id$";
@@ -25,6 +25,9 @@
 #include <cmath>
 
 #include "error_numbers.h"
+#include "shmem.h"
+
+#include "sched_config.h"
 #include "sched_msgs.h"
 
 int HR_INFO::write_file() {
@@ -85,6 +88,8 @@ void HR_INFO::init() {
         rac_per_class[i] = (double*) calloc(hr_nclasses[i], sizeof(double));
         max_slots[i] = (int*) calloc(hr_nclasses[i], sizeof(int));
         cur_slots[i] = (int*) calloc(hr_nclasses[i], sizeof(int));
+        demand_per_class[i] = (double*) calloc(hr_nclasses[i], sizeof(double));
+        last_nrequests[i] = (unsigned int*) calloc(hr_nclasses[i], sizeof(int));
     }
 }
 
@@ -95,7 +100,7 @@ void HR_INFO::scan_db() {
     double sum=0, sum_sqr=0;
 
     while (1) {
-        retval = host.enumerate("where expavg_credit>1");
+        retval = host.enumerate_by_id("expavg_credit>1");
         if (retval) break;
         if (host.p_fpops > 1e7 && host.p_fpops < 1e13) {
             n++;
@@ -146,13 +151,29 @@ void HR_INFO::allocate(int total_slots) {
             "type %d uncommitted: allocating %d slots\n", i, nuncom
         );
 
-        double total_rac = 0;
+        double total_rac = 0, total_demand = 0;
         for (j=1; j<hr_nclasses[i]; j++) {
             total_rac += rac_per_class[i][j];
+            if (demand_per_class[i]) total_demand += demand_per_class[i][j];
+        }
+
+        // if we've seen requests, allocate (part of) the committed slots
+        // in proportion to them
+        //
+        double dw = 0;
+        if (total_demand > 0) {
+            dw = (total_rac > 0)?demand_weight:1;
         }
         max_slots[i][0] = nuncom;
         for (j=1; j<hr_nclasses[i]; j++) {
-            int n = (int)(ncom*rac_per_class[i][j]/total_rac);
+            double frac;
+            if (dw > 0) {
+                frac = dw*demand_per_class[i][j]/total_demand;
+                if (dw < 1) frac += (1-dw)*rac_per_class[i][j]/total_rac;
+            } else {
+                frac = rac_per_class[i][j]/total_rac;
+            }
+            int n = (int)(ncom*frac);
 
             // every HR class has a max of at least one,
             // so that new classes can get "on the board".
@@ -172,6 +193,34 @@ void HR_INFO::allocate(int total_slots) {
     }
 }
 
+// Add the requests counted since the last call to demand_per_class.
+// The rate over each period is averaged with the previous value,
+// so a class's demand decays by half per period in which it makes
+// no requests, rather than disappearing.
+// Return true if any class of a type in use has demand.
+//
+bool HR_INFO::update_demand(HR_DEMAND_TABLE* dt, double now) {
+    int i, j;
+    bool first = (last_demand_time == 0);
+    double dt_secs = now - last_demand_time;
+    bool found = false;
+
+    for (i=1; i<HR_NTYPES; i++) {
+        if (!type_being_used[i]) continue;
+        for (j=0; j<hr_nclasses[i]; j++) {
+            unsigned int n = dt->nrequests[i][j];
+            if (!first && dt_secs > 0) {
+                double rate = (n - last_nrequests[i][j])/dt_secs;
+                demand_per_class[i][j] = (demand_per_class[i][j] + rate)/2;
+            }
+            last_nrequests[i][j] = n;
+            if (j && demand_per_class[i][j] > 0) found = true;
+        }
+    }
+    last_demand_time = now;
+    return found;
+}
+
 // Decide if job of the given HR type and class should be added to array,
 // and if so update counts
 //
@@ -192,11 +241,45 @@ void HR_INFO::show(FILE* f) {
             hr_names[ht], type_weights[ht], slots_per_type[ht]
         );
         for (int hc=0; hc<hr_nclasses[ht]; hc++) {
-            if (hc && rac_per_class[ht][hc] == 0) continue;
+            double d = demand_per_class[ht]?demand_per_class[ht][hc]:0;
+            if (hc && rac_per_class[ht][hc] == 0 && d == 0) continue;
             fprintf(f,
-                "  class %d: rac %f max_slots %d cur_slots %d\n",
-                hc, rac_per_class[ht][hc], max_slots[ht][hc], cur_slots[ht][hc]
+                "  class %d: rac %f demand %f max_slots %d cur_slots %d\n",
+                hc, rac_per_class[ht][hc], d, max_slots[ht][hc],
+                cur_slots[ht][hc]
             );
         }
     }
 }
+
+static HR_DEMAND_TABLE* hr_demand = 0;
+
+// Attach to the demand table; the first process to do so creates it
+//
+HR_DEMAND_TABLE* hr_demand_attach() {
+    void* p;
+    if (hr_demand) return hr_demand;
+    int retval = create_shmem(
+        config.hr_demand_shmem_key, sizeof(HR_DEMAND_TABLE), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach HR demand shmem (key %x): %d\n",
+            config.hr_demand_shmem_key, retval
+        );
+        return NULL;
+    }
+    hr_demand = (HR_DEMAND_TABLE*)p;
+    return hr_demand;
+}
+
+void hr_demand_count(HOST& host) {
+    HR_DEMAND_TABLE* dt = hr_demand_attach();
+    if (!dt) return;
+    for (int i=1; i<HR_NTYPES; i++) {
+        if (hr_unknown_class(host, i)) continue;
+        int hrc = hr_class(host, i);
+        if (hrc <= 0 || hrc >= hr_nclasses[i]) continue;
+        __sync_fetch_and_add(&dt->nrequests[i][hrc], 1);
+    }
+}
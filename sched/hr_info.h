@@ -20,6 +20,24 @@
 
 #include "hr.h"
 
+#define HR_MAX_NCLASSES 768
+    // >= hr_nclasses[i] for all i
+
+// Counts of work requests from hosts in each HR class,
+// kept in a shared-memory segment (key <hr_demand_shmem_key>).
+// Schedulers increment them; the feeder periodically looks at
+// how much they've grown and reallocates slots accordingly.
+// The counts wrap around; only differences are used.
+//
+struct HR_DEMAND_TABLE {
+    unsigned int nrequests[HR_NTYPES][HR_MAX_NCLASSES];
+};
+
+extern HR_DEMAND_TABLE* hr_demand_attach();
+    // return NULL if can't attach
+extern void hr_demand_count(HOST&);
+    // count a work request from the host
+
 struct HR_INFO {
     double *rac_per_class[HR_NTYPES];
         // how much RAC per class
@@ -33,6 +51,14 @@ struct HR_INFO {
         // # of slots per type (fixed at start)
     bool type_being_used[HR_NTYPES];
         // whether any app is actually using this HR type
+    double *demand_per_class[HR_NTYPES];
+        // recent rate of work requests per class (requests/sec),
+        // if using the HR demand table
+    unsigned int *last_nrequests[HR_NTYPES];
+    double last_demand_time;
+    double demand_weight;
+        // fraction of committed slots to allocate by demand
+        // rather than by RAC
 
     int write_file();
     int read_file();
@@ -40,6 +66,7 @@ struct HR_INFO {
     void allot();
     void init();
     void allocate(int);
+    bool update_demand(HR_DEMAND_TABLE*, double now);
     bool accept(int, int);
     void show(FILE*);
 };
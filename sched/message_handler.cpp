@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include "boinc_db.h"
 #include "util.h"
@@ -42,6 +43,9 @@
 #include "sched_util.h"
 #include "sched_msgs.h"
 
+using std::string;
+using std::vector;
+
 char app_name[256];
 
 extern int handle_message(MSG_FROM_HOST&);
@@ -63,33 +67,82 @@ int handle_message(MSG_FROM_HOST& mfh) {
     return 0;
 }
 
+// Messages are enumerated ENUM_BATCH_SIZE at a time, in ID order.
+// Each batch is handled in a transaction,
+// and its messages are marked as handled with a single UPDATE.
+//
+#define ENUM_BATCH_SIZE     1000
+
+// mark the given messages as handled, and commit
+//
+void finish_batch(vector<int>& ids) {
+    DB_MSG_FROM_HOST mfh;
+    char buf[32];
+    int retval;
+
+    if (ids.size()) {
+        string where_clause = "id in (";
+        for (unsigned int i=0; i<ids.size(); i++) {
+            sprintf(buf, i?",%d":"%d", ids[i]);
+            where_clause += buf;
+        }
+        where_clause += ")";
+        retval = mfh.update_fields_noid("handled=1", where_clause.c_str());
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "batch update of %d messages failed: %s\n",
+                (int)ids.size(), boincerror(retval)
+            );
+            exit(1);
+        }
+        ids.clear();
+    }
+    retval = boinc_db.commit_transaction();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "commit failed: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
 // make one pass through msgs_from_host with handled == 0
 // return true if there were any
 //
 bool do_message_scan() {
     DB_MSG_FROM_HOST mfh;
+    vector<int> handled_ids;
     char buf[256];
     bool found=false;
-    int retval;
+    int retval, n, last_id = 0;
 
-    sprintf(buf, "where handled=0");
     while (1) {
-        retval = mfh.enumerate(buf);
-        if (retval) {
-            if (retval != ERR_DB_NOT_FOUND) {
-                log_messages.printf(MSG_DEBUG,
-                    "DB connection lost, exiting\n"
-                );
-                exit(0);
+        sprintf(buf, "where handled=0 and id>%d order by id limit %d",
+            last_id, ENUM_BATCH_SIZE
+        );
+        boinc_db.start_transaction();
+        n = 0;
+        while (1) {
+            retval = mfh.enumerate(buf);
+            if (retval) {
+                if (retval != ERR_DB_NOT_FOUND) {
+                    log_messages.printf(MSG_DEBUG,
+                        "DB connection lost, exiting\n"
+                    );
+                    exit(0);
+                }
+                break;
             }
-            break;
-        }
-        retval = handle_message(mfh);
-        if (!retval) {
-            mfh.handled = true;
-            mfh.update();
+            n++;
+            last_id = mfh.id;
+            retval = handle_message(mfh);
+            if (!retval) {
+                handled_ids.push_back(mfh.id);
+            }
+            found = true;
         }
-        found = true;
+        finish_batch(handled_ids);
+        if (n < ENUM_BATCH_SIZE) break;
     }
     return found;
 }
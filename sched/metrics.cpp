@@ -0,0 +1,128 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// metrics: print the metrics of the project's daemons
+// (as kept if <daemon_metrics/> is set in config.xml)
+// in Prometheus text format.
+// Run as a CGI program (e.g. in cgi-bin) for Prometheus to scrape,
+// or from the command line.
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/param.h>
+
+#include "filesys.h"
+#include "str_util.h"
+#include "svn_version.h"
+
+#include "daemon_metrics.h"
+#include "sched_config.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Prints the metrics of server daemons in Prometheus text format.\n\n"
+        "Usage: %s [OPTION]\n\n"
+        "Options:\n"
+        "  [ -h | --help ]        Show this help text.\n"
+        "  [ -v | --version ]     Shows version information.\n",
+        name
+    );
+}
+
+int main(int argc, char *argv[]) {
+    char filename[256], path[MAXPATHLEN];
+    vector<METRICS_PAGE*> pages;
+    map<string, vector<int> > names;
+        // metric name -> indices of the pages that have it
+    map<string, vector<int> >::iterator it;
+    unsigned int i, j;
+    int k, retval;
+    bool cgi = getenv("REQUEST_METHOD") != NULL;
+
+    for (int c = 1; c < argc; c++) {
+        string option(argv[c]);
+        if(option == "-h" || option == "--help") {
+            usage(argv[0]);
+            exit(0);
+        } else if(option == "-v" || option == "--version") {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else {
+            fprintf(stderr, "unknown command line argument: %s\n\n", argv[c]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (cgi) {
+        printf("Content-type: text/plain; version=0.0.4\n\n");
+    }
+    retval = config.parse_file();
+    if (retval) {
+        printf("# Can't parse config.xml: %s\n", boincerror(retval));
+        exit(1);
+    }
+
+    DIRREF dirp = dir_open(config.project_path(METRICS_DIR));
+    if (!dirp) {
+        printf("# no metrics; is <daemon_metrics/> set in config.xml?\n");
+        exit(0);
+    }
+    while (!dir_scan(filename, dirp, sizeof(filename))) {
+        snprintf(path, sizeof(path), "%s/%s",
+            config.project_path(METRICS_DIR), filename
+        );
+        METRICS_PAGE* p = new METRICS_PAGE;
+        if (read_metrics_page(path, *p)) {
+            delete p;
+            continue;
+        }
+        for (k=0; k<p->nmetrics; k++) {
+            names[p->metrics[k].name].push_back((int)pages.size());
+        }
+        pages.push_back(p);
+    }
+    dir_close(dirp);
+
+    // Prometheus wants the samples of a metric together,
+    // after a single HELP and TYPE
+    //
+    for (it=names.begin(); it!=names.end(); it++) {
+        vector<int>& v = it->second;
+        for (j=0; j<v.size(); j++) {
+            METRICS_PAGE* p = pages[v[j]];
+            for (k=0; k<p->nmetrics; k++) {
+                if (it->first != p->metrics[k].name) continue;
+                if (j == 0) print_metric_header(stdout, p->metrics[k]);
+                p->print_samples(stdout, k);
+            }
+        }
+    }
+    for (i=0; i<pages.size(); i++) {
+        delete pages[i];
+    }
+    return 0;
+}
@@ -93,6 +93,18 @@ bool PLAN_CLASS_SPEC::check(SCHEDULER_REQUEST& sreq, HOST_USAGE& hu) {
         return false;
     }
 
+    // memory bandwidth
+    //
+    if (min_membw && g_reply->host.p_membw < min_membw) {
+        if (config.debug_version_select) {
+            log_messages.printf(MSG_NORMAL,
+                "[version] plan_class_spec: memory bandwidth too low: %f < %f\n",
+                g_reply->host.p_membw, min_membw
+            );
+        }
+        return false;
+    }
+
     // host summary
     //
     if (have_host_summary_regex
@@ -212,8 +224,7 @@ bool PLAN_CLASS_SPEC::check(SCHEDULER_REQUEST& sreq, HOST_USAGE& hu) {
     //
     if (have_project_prefs_regex && strlen(project_prefs_tag)) {
         char tag[256], value[256];
-        char buf[65536];
-        extract_venue(g_reply->user.project_prefs, g_reply->host.venue, buf, sizeof(buf));
+        const char* buf = g_reply->venue_project_prefs();
         sprintf(tag,"<%s>",project_prefs_tag);
         bool p = parse_str(buf, tag, value, sizeof(value));
         if (config.debug_version_select) {
@@ -241,9 +252,8 @@ bool PLAN_CLASS_SPEC::check(SCHEDULER_REQUEST& sreq, HOST_USAGE& hu) {
     //
     if (strlen(gpu_utilization_tag)) {
         char tag[256];
-        char buf[65536];
+        const char* buf = g_reply->venue_project_prefs();
         double v = 0;
-        extract_venue(g_reply->user.project_prefs, g_reply->host.venue, buf, sizeof(buf));
         sprintf(tag,"<%s>",gpu_utilization_tag);
         bool p = parse_double(buf, tag, v);
         if (config.debug_version_select) {
@@ -627,12 +637,36 @@ bool PLAN_CLASS_SPEC::check(SCHEDULER_REQUEST& sreq, HOST_USAGE& hu) {
 }
 
 
+// The result of a check depends only on the request
+// (and on effective_ncpus, set partway through handling it).
+// Many app versions may have the same plan class,
+// so remember results for the rest of the request.
+//
 bool PLAN_CLASS_SPECS::check(
     SCHEDULER_REQUEST& sreq, char* plan_class, HOST_USAGE& hu
 ) {
+    std::map<std::string, PLAN_CLASS_MEMO>::iterator it =
+        sreq.plan_class_memo.find(plan_class);
+    if (it != sreq.plan_class_memo.end()
+        && it->second.effective_ncpus == g_wreq->effective_ncpus
+    ) {
+        if (config.debug_version_select) {
+            log_messages.printf(MSG_NORMAL,
+                "[version] plan_class_spec: using earlier result for %s\n",
+                plan_class
+            );
+        }
+        hu = it->second.host_usage;
+        return it->second.ok;
+    }
     for (unsigned int i=0; i<classes.size(); i++) {
         if (!strcmp(classes[i].name, plan_class)) {
-            return classes[i].check(sreq, hu);
+            PLAN_CLASS_MEMO m;
+            m.ok = classes[i].check(sreq, hu);
+            m.effective_ncpus = g_wreq->effective_ncpus;
+            m.host_usage = hu;
+            sreq.plan_class_memo[plan_class] = m;
+            return m.ok;
         }
     }
     log_messages.printf(MSG_CRITICAL, "Unknown plan class: %s\n", plan_class);
@@ -659,6 +693,7 @@ int PLAN_CLASS_SPEC::parse(XML_PARSER& xp) {
             continue;
         }
         if (xp.parse_double("min_ncpus", min_ncpus)) continue;
+        if (xp.parse_double("min_membw", min_membw)) continue;
         if (xp.parse_int("max_threads", max_threads)) continue;
         if (xp.parse_double("projected_flops_scale", projected_flops_scale)) continue;
         if (xp.parse_str("os_regex", buf, sizeof(buf))) {
@@ -721,6 +756,18 @@ int PLAN_CLASS_SPEC::parse(XML_PARSER& xp) {
     return ERR_XML_PARSE;
 }
 
+// free compiled regular expressions and remove all classes
+//
+void PLAN_CLASS_SPECS::clear() {
+    for (unsigned int i=0; i<classes.size(); i++) {
+        PLAN_CLASS_SPEC& pc = classes[i];
+        if (pc.have_os_regex) regfree(&pc.os_regex);
+        if (pc.have_project_prefs_regex) regfree(&pc.project_prefs_regex);
+        if (pc.have_host_summary_regex) regfree(&pc.host_summary_regex);
+    }
+    classes.clear();
+}
+
 int PLAN_CLASS_SPECS::parse_specs(FILE* f) {
     MIOFILE mf;
     XML_PARSER xp(&mf);
@@ -754,6 +801,7 @@ PLAN_CLASS_SPEC::PLAN_CLASS_SPEC() {
     virtualbox = false;
     is64bit = false;
     min_ncpus = 0;
+    min_membw = 0;
     max_threads = 1;
     projected_flops_scale = 1;
     have_os_regex = false;
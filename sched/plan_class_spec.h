@@ -33,6 +33,8 @@ struct PLAN_CLASS_SPEC {
     bool is64bit;
     std::vector<std::string> cpu_features;
     double min_ncpus;
+    double min_membw;
+        // memory bandwidth per CPU, bytes/sec (from client benchmark)
     int max_threads;
     double projected_flops_scale;
     bool have_os_regex;
@@ -100,6 +102,7 @@ struct PLAN_CLASS_SPECS {
     std::vector<PLAN_CLASS_SPEC> classes;
     int parse_file(const char*);
     int parse_specs(FILE*);
+    void clear();
     bool check(SCHEDULER_REQUEST& sreq, char* plan_class, HOST_USAGE& hu);
     PLAN_CLASS_SPECS(){};
 };
@@ -0,0 +1,121 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Population statistics in shared memory; see pop_stats.h
+
+#include "config.h"
+#include <cstring>
+
+#include "shmem.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "pop_stats.h"
+
+static POP_STATS* pop_stats = NULL;
+
+POP_STATS* pop_stats_attach() {
+    void* p;
+    if (pop_stats) return pop_stats;
+    int retval = create_shmem(
+        config.pop_stats_shmem_key, sizeof(POP_STATS), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach population stats shmem (key %x): %d\n",
+            config.pop_stats_shmem_key, retval
+        );
+        return NULL;
+    }
+    pop_stats = (POP_STATS*)p;
+    return pop_stats;
+}
+
+void POP_STATS::clear_hosts() {
+    host_update_time = 0;
+    nhosts = 0;
+    total_rac = 0;
+    memset(rac_per_class, 0, sizeof(rac_per_class));
+    memset(nhosts_per_class, 0, sizeof(nhosts_per_class));
+    memset(rac_hist, 0, sizeof(rac_hist));
+}
+
+void POP_STATS::add_host(HOST& host) {
+    int i;
+
+    nhosts++;
+    total_rac += host.expavg_credit;
+    for (i=1; i<HR_NTYPES; i++) {
+        if (hr_unknown_class(host, i)) continue;
+        int hrc = hr_class(host, i);
+        if (hrc <= 0 || hrc >= HR_MAX_NCLASSES) continue;
+        rac_per_class[i][hrc] += host.expavg_credit;
+        nhosts_per_class[i][hrc]++;
+    }
+    double x = host.expavg_credit;
+    for (i=0; i<POP_STATS_RAC_BUCKETS-1 && x >= 1; i++) {
+        x /= 2;
+    }
+    rac_hist[i]++;
+}
+
+void POP_STATS::clear_results() {
+    napps = 0;
+    memset(apps, 0, sizeof(apps));
+}
+
+POP_STATS_APP* POP_STATS::lookup_app(int appid) {
+    for (int i=0; i<napps; i++) {
+        if (apps[i].appid == appid) return &apps[i];
+    }
+    return NULL;
+}
+
+void POP_STATS::add_unsent(int appid, int size_class, int count) {
+    if (size_class < 0 || size_class >= MAX_SIZE_CLASSES) return;
+    POP_STATS_APP* ap = lookup_app(appid);
+    if (!ap) {
+        if (napps == POP_STATS_MAX_APPS) return;
+        ap = &apps[napps++];
+        ap->appid = appid;
+    }
+    ap->unsent[size_class] = count;
+    if (size_class >= ap->n_size_classes) {
+        ap->n_size_classes = size_class + 1;
+    }
+}
+
+void POP_STATS::snapshot(POP_STATS& dst) {
+    while (1) {
+        int s = seqno;
+        __sync_synchronize();
+        if (!(s & 1)) {
+            memcpy(&dst, this, sizeof(POP_STATS));
+            __sync_synchronize();
+            if (seqno == s) return;
+        }
+    }
+}
+
+void POP_STATS::begin_update() {
+    __sync_fetch_and_add(&seqno, 1);
+}
+
+void POP_STATS::end_update() {
+    __sync_fetch_and_add(&seqno, 1);
+}
@@ -0,0 +1,89 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Population statistics kept in shared memory
+// (key <pop_stats_shmem_key> in config.xml):
+// RAC and number of hosts per HR class, the distribution of host RAC,
+// and the number of unsent results per app and size class.
+//
+// They're computed by "census --daemon", which makes one paced scan
+// of the host table per host period and counts unsent results
+// (for all apps, with one query) every result period.
+// The feeder reads the HR info from here, rather than hr_info.txt,
+// and size_regulator reads the unsent counts,
+// so neither has to scan the DB itself.
+//
+// The writer increments seqno before and after each update,
+// so a reader seeing an odd or changed seqno retries (see snapshot()).
+
+#ifndef _POP_STATS_H_
+#define _POP_STATS_H_
+
+#include "boinc_db_types.h"
+
+#include "hr.h"
+#include "hr_info.h"
+
+#define POP_STATS_MAX_APPS      64
+#define POP_STATS_RAC_BUCKETS   32
+    // bucket i has hosts with RAC in [2^(i-1), 2^i)
+
+struct POP_STATS_APP {
+    int appid;
+    int n_size_classes;         // 1 + largest size class seen
+    int unsent[MAX_SIZE_CLASSES];
+};
+
+struct POP_STATS {
+    volatile int seqno;
+
+    // from the last complete host scan
+    //
+    double host_update_time;    // 0 if no scan completed yet
+    int nhosts;                 // hosts with RAC > 1
+    double total_rac;
+    double rac_per_class[HR_NTYPES][HR_MAX_NCLASSES];
+    int nhosts_per_class[HR_NTYPES][HR_MAX_NCLASSES];
+    int rac_hist[POP_STATS_RAC_BUCKETS];
+
+    // from the last count of unsent results
+    //
+    double result_update_time;
+    double result_period;
+    int napps;
+    POP_STATS_APP apps[POP_STATS_MAX_APPS];
+
+    void clear_hosts();
+    void add_host(HOST&);
+    void clear_results();
+    void add_unsent(int appid, int size_class, int count);
+    POP_STATS_APP* lookup_app(int appid);
+
+    // copy to dst, retrying if an update is in progress
+    //
+    void snapshot(POP_STATS& dst);
+
+    // the writer brackets updates with these
+    //
+    void begin_update();
+    void end_update();
+};
+
+extern POP_STATS* pop_stats_attach();
+    // return NULL if can't attach
+
+#endif
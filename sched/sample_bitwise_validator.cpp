@@ -49,7 +49,6 @@ int init_result(RESULT& result, void*& data) {
     FILE_CKSUM_LIST* fcl = new FILE_CKSUM_LIST;
     vector<OUTPUT_FILE_INFO> files;
     char md5_buf[MD5_LEN];
-    double nbytes;
 
     retval = get_output_file_infos(result, files);
     if (retval) {
@@ -63,7 +62,7 @@ int init_result(RESULT& result, void*& data) {
     for (unsigned int i=0; i<files.size(); i++) {
         OUTPUT_FILE_INFO& fi = files[i];
         if (fi.no_validate) continue;
-        retval = md5_file(fi.path.c_str(), md5_buf, nbytes);
+        retval = get_output_file_md5(fi.path, md5_buf);
         if (retval) {
             if (fi.optional) {
                 strcpy(md5_buf, "");
@@ -20,6 +20,8 @@
 // --app name               app name (default example_app)
 // --in_template_file       input template file (default example_app_in)
 // --out_template_file      output template file (default example_app_out)
+// --batch_size N           insert jobs in batches of N (default 100)
+// --nthreads N             write input files in N threads (default 1)
 // -d N                     log verbosity level (0..4)
 // --help                   show usage
 // --version                show version
@@ -53,6 +55,7 @@
 #include "sched_config.h"
 #include "sched_util.h"
 #include "sched_msgs.h"
+#include "work_generator.h"
 
 #define CUSHION 10
     // maintain at least this many unsent results
@@ -68,95 +71,44 @@ DB_APP app;
 int start_time;
 int seqno;
 
-// create one new job
+// describes an unbounded supply of jobs;
+// the work generator framework (work_generator.h) does the rest
 //
-int make_job() {
-    DB_WORKUNIT wu;
-    char name[256], path[MAXPATHLEN];
-    const char* infiles[1];
-    int retval;
-
-    // make a unique name (for the job and its input file)
-    //
-    sprintf(name, "%s_%d_%d", app_name, start_time, seqno++);
-
-    // Create the input file.
-    // Put it at the right place in the download dir hierarchy
-    //
-    retval = config.download_path(name, path);
-    if (retval) return retval;
-    FILE* f = fopen(path, "w");
-    if (!f) return ERR_FOPEN;
-    fprintf(f, "This is the input file for job %s", name);
-    fclose(f);
-
-    // Fill in the job parameters
-    //
-    wu.clear();
-    wu.appid = app.id;
-    safe_strcpy(wu.name, name);
-    wu.rsc_fpops_est = 1e12;
-    wu.rsc_fpops_bound = 1e14;
-    wu.rsc_memory_bound = 1e8;
-    wu.rsc_disk_bound = 1e8;
-    wu.delay_bound = 86400;
-    wu.min_quorum = REPLICATION_FACTOR;
-    wu.target_nresults = REPLICATION_FACTOR;
-    wu.max_error_results = REPLICATION_FACTOR*4;
-    wu.max_total_results = REPLICATION_FACTOR*8;
-    wu.max_success_results = REPLICATION_FACTOR*4;
-    infiles[0] = name;
-
-    // Register the job with BOINC
-    //
-    sprintf(path, "templates/%s", out_template_file);
-    return create_work(
-        wu,
-        in_template,
-        path,
-        config.project_path(path),
-        infiles,
-        1,
-        config
-    );
-}
-
-void main_loop() {
-    int retval;
-
-    while (1) {
-        check_stop_daemons();
-        int n;
-        retval = count_unsent_results(n, app.id);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "count_unsent_jobs() failed: %s\n", boincerror(retval)
-            );
-            exit(retval);
-        }
-        if (n > CUSHION) {
-            daemon_sleep(10);
-        } else {
-            int njobs = (CUSHION-n)/REPLICATION_FACTOR;
-            log_messages.printf(MSG_DEBUG,
-                "Making %d jobs\n", njobs
-            );
-            for (int i=0; i<njobs; i++) {
-                retval = make_job();
-                if (retval) {
-                    log_messages.printf(MSG_CRITICAL,
-                        "can't make job: %s\n", boincerror(retval)
-                    );
-                    exit(retval);
-                }
-            }
-            // Now sleep for a few seconds to let the transitioner
-            // create instances for the jobs we just created.
-            // Otherwise we could end up creating an excess of jobs.
-            daemon_sleep(5);
-        }
+class SAMPLE_JOB_SOURCE : public JOB_SOURCE {
+public:
+    int next_job(WG_JOB& job) {
+        char name[256], buf[256];
+
+        // make a unique name (for the job and its input file)
+        //
+        sprintf(name, "%s_%d_%d", app_name, start_time, seqno++);
+
+        // Describe the input file.
+        // The framework puts it at the right place
+        // in the download dir hierarchy
+        //
+        WG_INPUT_FILE f;
+        f.name = name;
+        sprintf(buf, "This is the input file for job %s", name);
+        f.contents = buf;
+        job.infiles.push_back(f);
+
+        // Fill in the job parameters
+        //
+        safe_strcpy(job.wu.name, name);
+        job.wu.rsc_fpops_est = 1e12;
+        job.wu.rsc_fpops_bound = 1e14;
+        job.wu.rsc_memory_bound = 1e8;
+        job.wu.rsc_disk_bound = 1e8;
+        job.wu.delay_bound = 86400;
+        job.wu.min_quorum = REPLICATION_FACTOR;
+        job.wu.target_nresults = REPLICATION_FACTOR;
+        job.wu.max_error_results = REPLICATION_FACTOR*4;
+        job.wu.max_total_results = REPLICATION_FACTOR*8;
+        job.wu.max_success_results = REPLICATION_FACTOR*4;
+        return 0;
     }
-}
+};
 
 void usage(char *name) {
     fprintf(stderr, "This is an example BOINC work generator.\n"
@@ -173,6 +125,8 @@ void usage(char *name) {
         "  [ --app X                Application name (default: example_app)\n"
         "  [ --in_template_file     Input template (default: example_app_in)\n"
         "  [ --out_template_file    Output template (default: example_app_out)\n"
+        "  [ --batch_size N ]       Insert jobs in batches of N\n"
+        "  [ --nthreads N ]         Write input files in N threads\n"
         "  [ -d X ]                 Sets debug level to X.\n"
         "  [ -h | --help ]          Shows this help text.\n"
         "  [ -v | --version ]       Shows version information.\n",
@@ -182,6 +136,8 @@ void usage(char *name) {
 
 int main(int argc, char** argv) {
     int i, retval;
+    int batch_size = 100;
+    int nthreads = 1;
     char buf[256];
 
     for (i=1; i<argc; i++) {
@@ -200,6 +156,20 @@ int main(int argc, char** argv) {
             in_template_file = argv[++i];
         } else if (!strcmp(argv[i], "--out_template_file")) {
             out_template_file = argv[++i];
+        } else if (is_arg(argv[i], "batch_size")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            batch_size = atoi(argv[i]);
+        } else if (is_arg(argv[i], "nthreads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -220,7 +190,6 @@ int main(int argc, char** argv) {
         );
         exit(1);
     }
-
     retval = boinc_db.open(
         config.db_name, config.db_host, config.db_user, config.db_passwd
     );
@@ -244,7 +213,23 @@ int main(int argc, char** argv) {
     start_time = time(0);
     seqno = 0;
 
+    SAMPLE_JOB_SOURCE source;
+    WORK_GENERATOR wg(config, app, source);
+    wg.wu_template = in_template;
+    sprintf(buf, "templates/%s", out_template_file);
+    wg.result_template = buf;
+    wg.target_unsent = CUSHION;
+    wg.nthreads = nthreads;
+    wg.batch_size = batch_size;
+    retval = wg.init();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't start work generator: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+
     log_messages.printf(MSG_NORMAL, "Starting\n");
 
-    main_loop();
+    wg.run();
 }
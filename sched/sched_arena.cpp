@@ -0,0 +1,80 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <cstdlib>
+
+#include "sched_arena.h"
+
+SCHED_ARENA sched_arena;
+
+// allocations are rounded up to this, so that any type is aligned
+//
+#define ARENA_ALIGN 16
+
+// Enable the arena, with blocks of the given size.
+// Must be called when no arena-allocated containers exist.
+//
+void SCHED_ARENA::init(size_t bsize) {
+    reset();
+    for (unsigned int i=0; i<blocks.size(); i++) {
+        ::free(blocks[i]);
+    }
+    blocks.clear();
+    block_size = bsize;
+    enabled = (bsize != 0);
+}
+
+void* SCHED_ARENA::alloc(size_t n) {
+    if (!enabled) return ::operator new(n);
+    n = (n + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+    nbytes += n;
+    if (n > block_size) {
+        char* p = (char*)malloc(n);
+        if (!p) throw std::bad_alloc();
+        big_blocks.push_back(p);
+        return p;
+    }
+    if (blocks.empty() || cur_offset + n > block_size) {
+        if (!blocks.empty()) {
+            cur_block++;
+        }
+        if (cur_block == blocks.size()) {
+            char* p = (char*)malloc(block_size);
+            if (!p) throw std::bad_alloc();
+            blocks.push_back(p);
+        }
+        cur_offset = 0;
+    }
+    void* p = blocks[cur_block] + cur_offset;
+    cur_offset += n;
+    return p;
+}
+
+// Reclaim everything allocated since the last reset.
+// Regular blocks are kept for reuse.
+//
+void SCHED_ARENA::reset() {
+    for (unsigned int i=0; i<big_blocks.size(); i++) {
+        ::free(big_blocks[i]);
+    }
+    big_blocks.clear();
+    if (nbytes > max_nbytes) max_nbytes = nbytes;
+    nbytes = 0;
+    cur_block = 0;
+    cur_offset = 0;
+}
@@ -0,0 +1,120 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A per-request memory arena for the scheduler.
+// Enabled by <sched_arena_block_size> in config.xml.
+//
+// Lists in SCHEDULER_REQUEST and SCHEDULER_REPLY that can get long
+// (e.g. the sticky files reported by locality-scheduling hosts,
+// which may number in the thousands)
+// get their memory from the arena rather than the heap.
+// Allocation is a pointer bump; freeing does nothing.
+// All the memory is reclaimed at once
+// after the reply has been written and the request and reply destroyed.
+// Blocks are kept for the next request,
+// so a FastCGI process stops calling malloc() for these lists
+// once it has seen a few requests.
+//
+// If the arena isn't enabled, allocation falls through to the heap.
+
+#ifndef _SCHED_ARENA_H_
+#define _SCHED_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+struct SCHED_ARENA {
+    bool enabled;
+    size_t block_size;
+    std::vector<char*> blocks;
+        // blocks of size block_size
+    std::vector<char*> big_blocks;
+        // dedicated blocks for allocations bigger than block_size;
+        // freed on reset
+    unsigned int cur_block;
+    size_t cur_offset;
+    size_t nbytes;              // bytes allocated since last reset
+    size_t max_nbytes;          // max of the above over all requests
+
+    SCHED_ARENA() {
+        enabled = false;
+        block_size = 0;
+        cur_block = 0;
+        cur_offset = 0;
+        nbytes = 0;
+        max_nbytes = 0;
+    }
+    void init(size_t bsize);
+    void* alloc(size_t);
+    void free(void* p) {
+        if (!enabled) ::operator delete(p);
+    }
+    void reset();
+};
+
+extern SCHED_ARENA sched_arena;
+
+// An STL allocator that uses sched_arena.
+// Containers using it must not outlive the request.
+//
+template <class T> class ARENA_ALLOCATOR {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template <class U> struct rebind {
+        typedef ARENA_ALLOCATOR<U> other;
+    };
+
+    ARENA_ALLOCATOR() {}
+    ARENA_ALLOCATOR(const ARENA_ALLOCATOR&) {}
+    template <class U> ARENA_ALLOCATOR(const ARENA_ALLOCATOR<U>&) {}
+
+    pointer address(reference x) const {return &x;}
+    const_pointer address(const_reference x) const {return &x;}
+    pointer allocate(size_type n, const void* = 0) {
+        return (pointer)sched_arena.alloc(n*sizeof(T));
+    }
+    void deallocate(pointer p, size_type) {
+        sched_arena.free(p);
+    }
+    size_type max_size() const {
+        return ((size_t)-1)/sizeof(T);
+    }
+    void construct(pointer p, const T& x) {
+        new((void*)p) T(x);
+    }
+    void destroy(pointer p) {
+        p->~T();
+    }
+};
+
+template <class T, class U>
+inline bool operator==(const ARENA_ALLOCATOR<T>&, const ARENA_ALLOCATOR<U>&) {
+    return true;
+}
+template <class T, class U>
+inline bool operator!=(const ARENA_ALLOCATOR<T>&, const ARENA_ALLOCATOR<U>&) {
+    return false;
+}
+
+#endif
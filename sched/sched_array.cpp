@@ -17,9 +17,11 @@
 
 // scheduler code related to sending work
 
+#include <algorithm>
 #include <cstdlib>
 #include <string>
 #include <cstring>
+#include <vector>
 
 #include "config.h"
 
@@ -30,6 +32,7 @@
 #include "sched_msgs.h"
 #include "sched_send.h"
 #include "sched_shmem.h"
+#include "sched_timing.h"
 #include "sched_types.h"
 #include "sched_util.h"
 #include "sched_version.h"
@@ -46,7 +49,8 @@
 static bool quick_check(
     WU_RESULT& wu_result,
     WORKUNIT& wu,       // a mutable copy of wu_result.workunit.
-        // We may modify its delay_bound, rsc_fpops_est, and rsc_fpops_bound
+        // We may modify its delay_bound, rsc_fpops_est, and rsc_fpops_bound.
+        // Its xml_doc isn't filled in, except as needed here
     BEST_APP_VERSION* &bavp,
     APP* app,
     int& last_retval
@@ -132,11 +136,12 @@ static bool quick_check(
         if (app->locality_scheduling == LOCALITY_SCHED_LITE
             && g_request->file_infos.size()
         ) {
-            int n = nfiles_on_host(wu_result.workunit);
+            ssp->get_wu_xml_doc(wu_result, wu.xml_doc);
+            int n = nfiles_on_host(wu);
             if (config.debug_locality_lite) {
                 log_messages.printf(MSG_NORMAL,
                     "[loc_lite] job %s has %d files on this host\n",
-                    wu_result.workunit.name, n
+                    wu.name, n
                 );
             }
             if (n == 0) {
@@ -203,6 +208,60 @@ static bool quick_check(
     return true;
 }
 
+// Get the order in which to scan the job array: a random rotation.
+// If the feeder uses per-app sub-arrays,
+// include only the sub-arrays of apps for which get_app_version()
+// finds a usable version, visiting the apps in random order.
+//
+void get_scan_order(vector<int>& slots, bool reliable_only) {
+    int i, j, rnd_off;
+
+    slots.clear();
+    if (!ssp->per_app_arrays) {
+        rnd_off = rand() % ssp->max_wu_results;
+        for (j=0; j<ssp->max_wu_results; j++) {
+            slots.push_back((j+rnd_off) % ssp->max_wu_results);
+        }
+        return;
+    }
+
+    vector<int> app_order;
+    for (i=0; i<ssp->napps; i++) {
+        if (ssp->app_nslots[i]) app_order.push_back(i);
+    }
+    std::random_shuffle(app_order.begin(), app_order.end());
+
+    for (unsigned int k=0; k<app_order.size(); k++) {
+        APP& app = ssp->apps[app_order[k]];
+        int start = ssp->app_slot_start[app_order[k]];
+        int n = ssp->app_nslots[app_order[k]];
+
+        // Jobs of homogeneous-app-version apps may be committed
+        // to a particular version; check them individually.
+        // Otherwise a job with no special requirements is as easy to
+        // find a version for as any job of the app.
+        //
+        if (!app.homogeneous_app_version && !app.non_cpu_intensive) {
+            WORKUNIT wu;
+            memset(&wu, 0, sizeof(wu));
+            wu.appid = app.id;
+            if (!get_app_version(wu, true, reliable_only)) {
+                if (config.debug_array) {
+                    log_messages.printf(MSG_NORMAL,
+                        "[array] no usable version of %s; skipping %d slots\n",
+                        app.name, n
+                    );
+                }
+                continue;
+            }
+        }
+        rnd_off = rand() % n;
+        for (j=0; j<n; j++) {
+            slots.push_back(start + (j+rnd_off) % n);
+        }
+    }
+}
+
 // Make a pass through the wu/results array, sending work.
 // The choice of jobs is limited by flags in g_wreq, as follows:
 // infeasible_only:
@@ -221,22 +280,24 @@ static bool quick_check(
 // Return true if no more work is needed.
 //
 static bool scan_work_array() {
-    int i, j, rnd_off, last_retval=0;;
+    int i, last_retval=0;;
+    unsigned int j;
     APP* app;
     BEST_APP_VERSION* bavp;
     bool no_more_needed = false;
     SCHED_DB_RESULT result;
+    WORKUNIT wu;
+    vector<int> slots;
 
-    // To minimize the amount of time we lock the array,
-    // we initially scan without holding the lock.
+    // We scan without any lock.
     // If we find a job that passes quick_check(),
-    // we acquire the lock and then check the job again.
+    // we reserve its slot with an atomic compare-and-swap,
+    // which fails if another scheduler got there first
+    // or if the feeder has refilled the slot since we copied it.
     //
-    bool sema_locked = false;
-
-    rnd_off = rand() % ssp->max_wu_results;
-    for (j=0; j<ssp->max_wu_results; j++) {
-        i = (j+rnd_off) % ssp->max_wu_results;
+    get_scan_order(slots, g_wreq->reliable_only);
+    for (j=0; j<slots.size(); j++) {
+        i = slots[j];
 
         WU_RESULT& wu_result = ssp->wu_results[i];
 
@@ -246,21 +307,23 @@ static bool scan_work_array() {
             );
         }
 
-recheck:
-        if (wu_result.state != WR_STATE_PRESENT && wu_result.state != g_pid) {
+        bool reserved = (wu_result.state == g_pid);
+        if (wu_result.state != WR_STATE_PRESENT && !reserved) {
             continue;
         }
+        int gen = wu_result.read_gen();
 
         // make a copy of the WORKUNIT part,
-        // which we can modify without affecting the cache
+        // which we can modify without affecting the cache.
+        // The XML is copied only if we send the job
         //
-        WORKUNIT wu = wu_result.workunit;
+        wu_result.workunit.get(wu);
 
-        app = ssp->lookup_app(wu_result.workunit.appid);
+        app = ssp->lookup_app(wu.appid);
         if (app == NULL) {
             log_messages.printf(MSG_CRITICAL,
                 "[WU#%u] no app\n",
-                wu_result.workunit.id
+                wu.id
             );
             continue; // this should never happen
         }
@@ -279,35 +342,34 @@ recheck:
             continue;
         }
 
-        if (!sema_locked) {
-            lock_sema();
-            sema_locked = true;
-            goto recheck;
-        }
-
-        // mark wu_result as checked out and release semaphore.
+        // mark wu_result as checked out.
         // from here on in this loop, don't continue on failure;
-        // instead, goto dont_send (so that we reacquire semaphore)
+        // instead, release or clear the slot.
         //
-        // Note: without the semaphore we don't have mutual exclusion;
-        // ideally we should use a transaction from now until when
-        // we commit to sending the results.
-
-        wu_result.state = g_pid;
-        unlock_sema();
-        sema_locked = false;
+        // Note: we don't have mutual exclusion with other schedulers
+        // on the result itself; ideally we should use a transaction
+        // from now until when we commit to sending the results.
+        //
+        if (!reserved && !wu_result.claim(g_pid, gen)) {
+            if (config.debug_array_detail) {
+                log_messages.printf(MSG_NORMAL,
+                    "[array_detail] slot %d was taken or refilled\n", i
+                );
+            }
+            continue;
+        }
 
         switch (slow_check(wu_result, app, bavp)) {
         case 1:
             // if we couldn't send the result to this host,
             // set its state back to PRESENT
             //
-            wu_result.state = WR_STATE_PRESENT;
+            wu_result.release(g_pid);
             break;
         case 2:
             // can't send this job to any host
             //
-            wu_result.state = WR_STATE_EMPTY;
+            ssp->clear_slot(wu_result, g_pid);
             break;
         default:
             // slow_check() refreshes fields of wu_result.workunit;
@@ -315,17 +377,18 @@ recheck:
             //
             wu.hr_class = wu_result.workunit.hr_class;
             wu.app_version_id = wu_result.workunit.app_version_id;
+            ssp->get_wu_xml_doc(wu_result, wu.xml_doc);
+            result.id = wu_result.resultid;
 
             // mark slot as empty AFTER we've copied out of it
             // (since otherwise feeder might overwrite it)
             //
-            wu_result.state = WR_STATE_EMPTY;
+            ssp->clear_slot(wu_result, g_pid);
 
             // reread result from DB, make sure it's still unsent
             // TODO: from here to end of add_result_to_reply()
             // (which updates the DB record) should be a transaction
             //
-            result.id = wu_result.resultid;
             if (result_still_sendable(result, wu)) {
                 add_result_to_reply(result, wu, bavp, false);
 
@@ -343,9 +406,6 @@ recheck:
             break;
         }
     }
-    if (sema_locked) {
-        unlock_sema();
-    }
     return no_more_needed;
 }
 
@@ -353,6 +413,8 @@ recheck:
 // with different selection criteria on each scan.
 //
 void send_work_old() {
+    SCHED_TIMER timer(SCHED_STAGE_SEND_WORK_ARRAY);
+
     g_wreq->beta_only = false;
     g_wreq->user_apps_only = true;
     g_wreq->infeasible_only = false;
@@ -448,27 +510,27 @@ int send_job_for_app(APP& app) {
     int retval = 0;
     BEST_APP_VERSION* bavp;
     SCHED_DB_RESULT result;
+    WORKUNIT wu;
 
-    lock_sema();
     for (int i=0; i<ssp->max_wu_results; i++) {
         WU_RESULT& wu_result = ssp->wu_results[i];
         if (wu_result.state != WR_STATE_PRESENT) continue;
-        WORKUNIT wu = wu_result.workunit;
-        if (wu.appid != app.id) continue;
+        if (wu_result.workunit.appid != app.id) continue;
+        int gen = wu_result.read_gen();
+        wu_result.workunit.get(wu);
         if (!quick_check(wu_result, wu, bavp, &app, retval)) {
             // All jobs for a given NCI app are identical.
             // If we can't send one, we can't send any.
             //
-            unlock_sema();
             log_messages.printf(MSG_NORMAL,
                 "quick_check() failed for NCI job\n"
             );
             return -1;
         }
-        wu_result.state = g_pid;
-        unlock_sema();
+        if (!wu_result.claim(g_pid, gen)) continue;
+        ssp->get_wu_xml_doc(wu_result, wu.xml_doc);
         result.id = wu_result.resultid;
-        wu_result.state = WR_STATE_EMPTY;
+        ssp->clear_slot(wu_result, g_pid);
         if (result_still_sendable(result, wu)) {
             if (config.debug_send) {
                 log_messages.printf(MSG_NORMAL,
@@ -481,12 +543,10 @@ int send_job_for_app(APP& app) {
         log_messages.printf(MSG_NORMAL,
             "NCI job was not still sendable\n"
         );
-        lock_sema();
     }
     log_messages.printf(MSG_NORMAL,
         "no sendable NCI jobs for %s\n", app.user_friendly_name
     );
-    unlock_sema();
     return 1;
 }
 
@@ -15,5 +15,8 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <vector>
+
+extern void get_scan_order(std::vector<int>& slots, bool reliable_only);
 extern void send_work_old();
 extern int send_nci();
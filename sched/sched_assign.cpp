@@ -28,6 +28,9 @@
 
 #include <sys/param.h>
 #include <unistd.h>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "backend_lib.h"
 #include "boinc_db.h"
@@ -35,6 +38,7 @@
 #include "error_numbers.h"
 #include "filesys.h"
 
+#include "sched_cache.h"
 #include "sched_main.h"
 #include "sched_msgs.h"
 #include "sched_send.h"
@@ -43,6 +47,9 @@
 
 #include "sched_assign.h"
 
+using std::string;
+using std::vector;
+
 // send a job for the given assignment
 //
 static int send_assigned_job(ASSIGNMENT& asg) {
@@ -113,59 +120,87 @@ static int send_assigned_job(ASSIGNMENT& asg) {
     return 0;
 }
 
+// For each host, the WUs of multi assignments that we know
+// it already has results for.
+// Kept across requests (in FastCGI schedulers) so that a host
+// that has all the assignments that apply to it costs no DB query.
+//
+#define ASSIGN_CACHE_SIZE   10000
+
+static LRU_CACHE<vector<int> > assign_cache;
+
+// add the multi assignments for the given target to the list
+//
+static void get_assignments(
+    int target_type, int target_id, vector<ASSIGNMENT*>& asgs
+) {
+    int first, n;
+    ssp->lookup_assignments(target_type, target_id, first, n);
+    for (int i=0; i<n; i++) {
+        asgs.push_back(&ssp->assignments[first+i]);
+    }
+}
+
 // Send this host any "multi" assigned jobs.
+// The assignments for this host's user and team, and those for all hosts,
+// are found in the shared-mem index.
+// Those not known to have been sent are checked with a single query.
 // Return true iff we sent anything
 //
 bool send_broadcast_jobs() {
     DB_RESULT result;
-    int retval;
+    vector<ASSIGNMENT*> asgs, unsent;
+    std::set<int> have_wus;
+    string clause;
     char buf[256];
+    unsigned int i;
+    int retval;
     bool sent_something = false;
 
-    for (int i=0; i<ssp->nassignments; i++) {
-        ASSIGNMENT& asg = ssp->assignments[i];
+    get_assignments(ASSIGN_NONE, 0, asgs);
+    get_assignments(ASSIGN_USER, g_reply->user.id, asgs);
+    get_assignments(ASSIGN_TEAM, g_reply->team.id, asgs);
+    if (asgs.empty()) return false;
 
+    assign_cache.max_size = ASSIGN_CACHE_SIZE;
+    LRU_CACHE<vector<int> >::ENTRY* e = assign_cache.lookup(g_reply->host.id);
+    vector<int> known_wus;
+    if (e) known_wus = e->rec;
+    have_wus.insert(known_wus.begin(), known_wus.end());
+
+    for (i=0; i<asgs.size(); i++) {
         if (config.debug_assignment) {
             log_messages.printf(MSG_NORMAL,
                 "[assign] processing multi assignment type %d\n",
-                asg.target_type
+                asgs[i]->target_type
             );
         }
-        // see if this assignment applies to this host
-        //
-        switch (asg.target_type) {
-        case ASSIGN_NONE:
-            sprintf(buf, "where hostid=%d and workunitid=%d",
-                g_reply->host.id, asg.workunitid
-            );
-            retval = result.lookup(buf);
-            if (retval == ERR_DB_NOT_FOUND) {
-                retval = send_assigned_job(asg);
-                if (!retval) sent_something = true;
-            }
-            break;
-        case ASSIGN_USER:
-            if (g_reply->user.id != asg.target_id) continue;
-            sprintf(buf, "where workunitid=%d and hostid=%d",
-                asg.workunitid, g_reply->host.id
-            );
-            retval = result.lookup(buf);
-            if (retval == ERR_DB_NOT_FOUND) {
-                retval = send_assigned_job(asg);
-                if (!retval) sent_something = true;
-            }
-            break;
-        case ASSIGN_TEAM:
-            if (g_reply->team.id != asg.target_id) continue;
-            sprintf(buf, "where workunitid=%d and hostid=%d", asg.workunitid, g_reply->host.id);
-            retval = result.lookup(buf);
-            if (retval == ERR_DB_NOT_FOUND) {
-                retval = send_assigned_job(asg);
-                if (!retval) sent_something = true;
-            }
-            break;
+        if (have_wus.count(asgs[i]->workunitid)) continue;
+        unsent.push_back(asgs[i]);
+        sprintf(buf, clause.empty()?"%d":",%d", asgs[i]->workunitid);
+        clause += buf;
+    }
+    if (unsent.empty()) return false;
+
+    // see which of the others the host already has
+    //
+    sprintf(buf, "where hostid=%d and workunitid in (", g_reply->host.id);
+    clause = buf + clause + ")";
+    while (!result.enumerate(clause.c_str())) {
+        have_wus.insert(result.workunitid);
+    }
+    for (i=0; i<unsent.size(); i++) {
+        ASSIGNMENT& asg = *unsent[i];
+        if (!have_wus.count(asg.workunitid)) {
+            retval = send_assigned_job(asg);
+            if (retval) continue;
+            sent_something = true;
+            have_wus.insert(asg.workunitid);
         }
     }
+
+    known_wus.assign(have_wus.begin(), have_wus.end());
+    assign_cache.insert(g_reply->host.id, "", known_wus);
     return sent_something;
 }
 
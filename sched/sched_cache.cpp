@@ -0,0 +1,130 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Per-process caches of user and team records,
+// and of parsed global prefs; see sched_cache.h
+
+#include "config.h"
+
+#include "error_numbers.h"
+#include "md5_file.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "sched_cache.h"
+
+// expressions for the version digests.
+// concat_ws() skips NULLs; that's OK for this purpose.
+//
+#define USER_VERSION_EXPR \
+    "md5(concat_ws(',', create_time, email_addr, name, authenticator, " \
+    "country, postal_code, total_credit, expavg_credit, expavg_time, " \
+    "global_prefs, project_prefs, teamid, venue, url, send_email, " \
+    "show_hosts, posts, seti_id, seti_nresults, seti_last_result_time, " \
+    "seti_total_cpu, has_profile, cross_project_id, passwd_hash, " \
+    "email_validated, donated))"
+
+#define TEAM_VERSION_EXPR \
+    "md5(concat_ws(',', create_time, userid, name, name_lc, url, type, " \
+    "name_html, description, nusers, country, total_credit, " \
+    "expavg_credit, expavg_time, seti_id, ping_user, ping_time, joinable))"
+
+static LRU_CACHE<DB_USER> user_cache;
+static LRU_CACHE<DB_TEAM> team_cache;
+static LRU_CACHE<GLOBAL_PREFS> prefs_cache;
+
+// Look up a record by ID, using the given cache.
+// T is DB_USER or DB_TEAM.
+//
+template <class T> static int lookup_cached(
+    LRU_CACHE<T>& cache, int id, T& rec, const char* version_expr
+) {
+    char version[256];
+    int retval;
+
+    cache.max_size = config.sched_record_cache_size;
+    if (!cache.max_size) {
+        return rec.lookup_id(id);
+    }
+
+    rec.id = id;
+    strcpy(version, "");
+    retval = rec.get_field_str(version_expr, version, sizeof(version));
+    if (retval) {
+        cache.remove(id);
+        return retval;
+    }
+    typename LRU_CACHE<T>::ENTRY* ep = cache.lookup(id);
+    if (ep && ep->version == version) {
+        rec = ep->rec;
+        cache.nhits++;
+        return 0;
+    }
+    cache.nmisses++;
+    retval = rec.lookup_id(id);
+    if (retval) {
+        cache.remove(id);
+        return retval;
+    }
+    cache.insert(id, version, rec);
+    return 0;
+}
+
+int lookup_user_cached(int id, DB_USER& user) {
+    return lookup_cached(user_cache, id, user, USER_VERSION_EXPR);
+}
+
+int lookup_team_cached(int id, DB_TEAM& team) {
+    return lookup_cached(team_cache, id, team, TEAM_VERSION_EXPR);
+}
+
+// Parse global prefs (extracting the given venue).
+// Most requests from a user have the same prefs and venue,
+// so keep the result rather than parsing the XML each time.
+//
+void parse_global_prefs_cached(
+    int userid, const char* xml, const char* venue, GLOBAL_PREFS& prefs
+) {
+    prefs_cache.max_size = config.sched_record_cache_size;
+    if (!prefs_cache.max_size) {
+        prefs.parse(xml, venue);
+        return;
+    }
+    std::string version = venue;
+    version += ":";
+    version += md5_string((const unsigned char*)xml, (int)strlen(xml));
+    LRU_CACHE<GLOBAL_PREFS>::ENTRY* ep = prefs_cache.lookup(userid);
+    if (ep && ep->version == version) {
+        prefs = ep->rec;
+        prefs_cache.nhits++;
+        return;
+    }
+    prefs_cache.nmisses++;
+    prefs.parse(xml, venue);
+    prefs_cache.insert(userid, version, prefs);
+}
+
+void log_record_cache_stats() {
+    if (!config.sched_record_cache_size) return;
+    log_messages.printf(MSG_NORMAL,
+        "record cache: users %d hits %d misses; teams %d hits %d misses; prefs %d hits %d misses\n",
+        user_cache.nhits, user_cache.nmisses,
+        team_cache.nhits, team_cache.nmisses,
+        prefs_cache.nhits, prefs_cache.nmisses
+    );
+}
@@ -0,0 +1,107 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Caches of DB records that persist across requests
+// handled by a FastCGI scheduler process.
+// Enabled by <sched_record_cache_size> in config.xml.
+//
+// Each record is stored along with a "version":
+// a digest, computed by the DB server, of the record's columns.
+// A lookup fetches only the version (a short string)
+// rather than the whole record (which for users includes prefs blobs).
+// If it matches the cached version, the cached record is used.
+// So changes made by other processes (web code, daemons,
+// other scheduler instances) are always seen.
+//
+// Host records aren't cached: the scheduler rewrites
+// the host record on every RPC, so a cached copy is always stale.
+//
+// Parsed global prefs are also cached, by user ID;
+// the version is the venue plus a digest of the prefs XML.
+
+#ifndef _SCHED_CACHE_H_
+#define _SCHED_CACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "boinc_db.h"
+
+#include "sched_types.h"
+
+// a fixed-size map from record ID to (version, record),
+// discarding the least recently used entry when full
+//
+template <class T> struct LRU_CACHE {
+    struct ENTRY {
+        int id;
+        std::string version;
+        T rec;
+    };
+    typedef typename std::list<ENTRY>::iterator ITER;
+
+    std::list<ENTRY> entries;       // most recently used first
+    std::map<int, ITER> index;
+    unsigned int max_size;
+    int nhits, nmisses;
+
+    LRU_CACHE() {
+        max_size = 0;
+        nhits = nmisses = 0;
+    }
+
+    // return the entry for the given ID, or NULL
+    //
+    ENTRY* lookup(int id) {
+        typename std::map<int, ITER>::iterator i = index.find(id);
+        if (i == index.end()) return NULL;
+        entries.splice(entries.begin(), entries, i->second);
+        return &(*i->second);
+    }
+
+    void insert(int id, const std::string& version, T& rec) {
+        if (!max_size) return;
+        remove(id);
+        ENTRY e;
+        e.id = id;
+        e.version = version;
+        e.rec = rec;
+        entries.push_front(e);
+        index[id] = entries.begin();
+        while (entries.size() > max_size) {
+            index.erase(entries.back().id);
+            entries.pop_back();
+        }
+    }
+
+    void remove(int id) {
+        typename std::map<int, ITER>::iterator i = index.find(id);
+        if (i == index.end()) return;
+        entries.erase(i->second);
+        index.erase(i);
+    }
+};
+
+extern int lookup_user_cached(int id, DB_USER&);
+extern int lookup_team_cached(int id, DB_TEAM&);
+extern void parse_global_prefs_cached(
+    int userid, const char* xml, const char* venue, GLOBAL_PREFS&
+);
+extern void log_record_cache_stats();
+
+#endif
@@ -231,7 +231,7 @@ static inline int check_deadline(
         }
         IP_RESULT candidate("", wu.delay_bound, est_dur);
         safe_strcpy(candidate.name, wu.name);
-        if (check_candidate(candidate, g_wreq->effective_ncpus, g_request->ip_results)) {
+        if (g_request->edf_model.check_candidate(candidate)) {
             // it passed the feasibility test,
             // but don't add it to the workload yet;
             // wait until we commit to sending it
@@ -310,7 +310,7 @@ int wu_is_infeasible_fast(
             }
             return INFEASIBLE_HR;
         }
-        if (already_sent_to_different_hr_class(wu, app)) {
+        if (already_sent_to_different_hr_class(wu.hr_class, app)) {
             if (config.debug_send) {
                 log_messages.printf(MSG_NORMAL,
                     "[send] [HOST#%d] [WU#%u %s] failed quick HR check: WU is class %d, host is class %d\n",
@@ -387,7 +387,7 @@ int slow_check(
     int n, retval;
     DB_RESULT result;
     char buf[256];
-    WORKUNIT& wu = wu_result.workunit;
+    SHMEM_WORKUNIT& wu = wu_result.workunit;
 
     // Don't send if we've already sent a result of this WU to this user.
     //
@@ -463,7 +463,7 @@ int slow_check(
 
         if (app_hr_type(*app)) {
             wu.hr_class = vals[0];
-            if (already_sent_to_different_hr_class(wu, *app)) {
+            if (already_sent_to_different_hr_class(wu.hr_class, *app)) {
                 if (config.debug_send) {
                     log_messages.printf(MSG_NORMAL,
                         "[send] [HOST#%d] [WU#%u %s] is assigned to different HR class\n",
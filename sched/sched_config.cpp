@@ -82,6 +82,7 @@ int SCHED_CONFIG::parse(FILE* f) {
     ban_cpu = new vector<regex_t>;
     locality_scheduling_workunit_file = new vector<regex_t>;
     locality_scheduling_sticky_file = new vector<regex_t>;
+    replica_db_hosts = new vector<std::string>;
     max_wus_to_send = 10;
     default_disk_max_used_gb = 100.;
     default_disk_max_used_pct = 50.;
@@ -92,6 +93,10 @@ int SCHED_CONFIG::parse(FILE* f) {
     max_ncpus = MAX_NCPUS;
     scheduler_log_buffer = 32768;
     version_select_random_factor = 1.;
+    locality_index_empty_period = 60;
+    hr_demand_period = 600;
+    hr_demand_weight = 1;
+    shed_delay = 60;
 
     if (!xp.parse_start("boinc")) return ERR_XML_PARSE;
     if (!xp.parse_start("config")) return ERR_XML_PARSE;
@@ -109,6 +114,7 @@ int SCHED_CONFIG::parse(FILE* f) {
             if (!strcmp(hostname, db_host)) strcpy(db_host, "localhost");
             if (!strlen(replica_db_host)) {
                 safe_strcpy(replica_db_host, db_host);
+                replica_db_hosts->push_back(replica_db_host);
             }
             if (!strlen(replica_db_name)) {
                 safe_strcpy(replica_db_name, db_name);
@@ -119,6 +125,11 @@ int SCHED_CONFIG::parse(FILE* f) {
             if (!strlen(replica_db_passwd)) {
                 safe_strcpy(replica_db_passwd, db_passwd);
             }
+            if (strlen(upload_stage_dir) && !strlen(upload_cache_dir)) {
+                snprintf(upload_cache_dir, sizeof(upload_cache_dir),
+                    "%s/cache", upload_stage_dir
+                );
+            }
             return 0;
         }
         if (xp.parse_str("master_url", master_url, sizeof(master_url))) continue;
@@ -130,7 +141,15 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_str("replica_db_name", replica_db_name, sizeof(replica_db_name))) continue;
         if (xp.parse_str("replica_db_user", replica_db_user, sizeof(replica_db_user))) continue;
         if (xp.parse_str("replica_db_passwd", replica_db_passwd, sizeof(replica_db_passwd))) continue;
-        if (xp.parse_str("replica_db_host", replica_db_host, sizeof(replica_db_host))) continue;
+        if (xp.parse_str("replica_db_host", buf, sizeof(buf))) {
+            if (replica_db_hosts->empty()) {
+                safe_strcpy(replica_db_host, buf);
+            }
+            replica_db_hosts->push_back(buf);
+            continue;
+        }
+        if (xp.parse_int("replica_max_lag", replica_max_lag)) continue;
+        if (xp.parse_bool("db_prepared_statements", db_prepared_statements)) continue;
         if (xp.parse_str("project_dir", project_dir, sizeof(project_dir))) continue;
         if (xp.parse_int("shmem_key", shmem_key)) continue;
         if (xp.parse_str("key_dir", key_dir, sizeof(key_dir))) continue;
@@ -142,12 +161,22 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_bool("verify_files_on_app_start", verify_files_on_app_start)) continue;
         if (xp.parse_int("homogeneous_redundancy", homogeneous_redundancy)) continue;
         if (xp.parse_bool("hr_allocate_slots", hr_allocate_slots)) continue;
+        if (xp.parse_int("hr_demand_shmem_key", hr_demand_shmem_key)) continue;
+        if (xp.parse_int("hr_demand_period", hr_demand_period)) continue;
+        if (xp.parse_double("hr_demand_weight", hr_demand_weight)) continue;
         if (xp.parse_bool("msg_to_host", msg_to_host)) continue;
         if (xp.parse_bool("ignore_upload_certificates", ignore_upload_certificates)) continue;
         if (xp.parse_bool("dont_generate_upload_certificates", dont_generate_upload_certificates)) continue;
         if (xp.parse_int("uldl_dir_fanout", uldl_dir_fanout)) continue;
         if (xp.parse_bool("cache_md5_info", cache_md5_info)) continue;
+        if (xp.parse_bool("download_dedup", download_dedup)) continue;
         if (xp.parse_int("fuh_debug_level", fuh_debug_level)) continue;
+        if (xp.parse_int("fuh_signature_cache_shmem_key", fuh_signature_cache_shmem_key)) continue;
+        if (xp.parse_bool("upload_md5", upload_md5)) continue;
+        if (xp.parse_str("upload_stage_dir", upload_stage_dir, sizeof(upload_stage_dir))) continue;
+        if (xp.parse_str("upload_cache_dir", upload_cache_dir, sizeof(upload_cache_dir))) continue;
+        if (xp.parse_str("upload_store_cmd", upload_store_cmd, sizeof(upload_store_cmd))) continue;
+        if (xp.parse_double("upload_cache_max_mb", upload_cache_max_mb)) continue;
         if (xp.parse_int("reliable_priority_on_over", reliable_priority_on_over)) continue;
         if (xp.parse_int("reliable_priority_on_over_except_error", reliable_priority_on_over_except_error)) continue;
         if (xp.parse_int("reliable_on_priority", reliable_on_priority)) continue;
@@ -163,6 +192,9 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_bool("distinct_beta_apps", distinct_beta_apps)) continue;
         if (xp.parse_bool("ended", ended)) continue;
         if (xp.parse_int("shmem_work_items", shmem_work_items)) continue;
+        if (xp.parse_int("shmem_wu_xml_size", shmem_wu_xml_size)) continue;
+        if (xp.parse_str("shmem_file", shmem_file, sizeof(shmem_file))) continue;
+        if (xp.parse_bool("shmem_huge_pages", shmem_huge_pages)) continue;
         if (xp.parse_int("feeder_query_size", feeder_query_size)) continue;
         if (xp.parse_str("httpd_user", httpd_user, sizeof(httpd_user))) continue;
         if (xp.parse_bool("enable_vda", enable_vda)) continue;
@@ -210,6 +242,8 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_bool("locality_scheduling_sorted_order", locality_scheduling_sorted_order)) continue;
         if (xp.parse_int("locality_scheduling_wait_period", locality_scheduling_wait_period)) continue;
         if (xp.parse_int("locality_scheduling_send_timeout", locality_scheduling_send_timeout)) continue;
+        if (xp.parse_int("locality_index_shmem_key", locality_index_shmem_key)) continue;
+        if (xp.parse_int("locality_index_empty_period", locality_index_empty_period)) continue;
         if (xp.parse_str("locality_scheduling_workunit_file", buf, sizeof(buf))) {
             retval = regcomp(&re, buf, REG_EXTENDED|REG_NOSUB);
             if (retval) {
@@ -282,11 +316,26 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_str("replace_download_url_by_timezone", replace_download_url_by_timezone, sizeof(replace_download_url_by_timezone))) continue;
         if (xp.parse_int("max_download_urls_per_file", max_download_urls_per_file)) continue;
         if (xp.parse_int("report_max", report_max)) continue;
+        if (xp.parse_int("result_update_batch_size", result_update_batch_size)) continue;
+        if (xp.parse_bool("update_host_after_reply", update_host_after_reply)) continue;
         if (xp.parse_bool("request_time_stats_log", request_time_stats_log)) continue;
         if (xp.parse_bool("resend_lost_results", resend_lost_results)) continue;
         if (xp.parse_int("sched_debug_level", sched_debug_level)) continue;
         if (xp.parse_int("scheduler_log_buffer", scheduler_log_buffer)) continue;
+        if (xp.parse_int("log_writer_buffer", log_writer_buffer)) continue;
+        if (xp.parse_bool("log_json", log_json)) continue;
+        if (xp.parse_int("sched_record_cache_size", sched_record_cache_size)) continue;
+        if (xp.parse_int("sched_arena_block_size", sched_arena_block_size)) continue;
+        if (xp.parse_bool("dont_gzip_sched_reply", dont_gzip_sched_reply)) continue;
+        if (xp.parse_int("reply_cache_max_age", reply_cache_max_age)) continue;
         if (xp.parse_str("sched_lockfile_dir", sched_lockfile_dir, sizeof(sched_lockfile_dir))) continue;
+        if (xp.parse_int("host_lock_shmem_key", host_lock_shmem_key)) continue;
+        if (xp.parse_int("sched_stats_shmem_key", sched_stats_shmem_key)) continue;
+        if (xp.parse_double("shed_request_time", shed_request_time)) continue;
+        if (xp.parse_double("shed_db_time", shed_db_time)) continue;
+        if (xp.parse_int("shed_delay", shed_delay)) continue;
+        if (xp.parse_int("pop_stats_shmem_key", pop_stats_shmem_key)) continue;
+        if (xp.parse_bool("daemon_metrics", daemon_metrics)) continue;
         if (xp.parse_bool("send_result_abort", send_result_abort)) continue;
         if (xp.parse_str("symstore", symstore, sizeof(symstore))) continue;
 
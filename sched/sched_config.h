@@ -19,6 +19,7 @@
 #define _SCHED_CONFIG_
 
 #include <regex.h>
+#include <string>
 #include <vector>
 #include <cstdio>
 
@@ -51,6 +52,13 @@ struct SCHED_CONFIG {
     char replica_db_user[256];
     char replica_db_passwd[256];
     char replica_db_host[256];
+    vector<std::string> *replica_db_hosts;
+        // all <replica_db_host>s; the first is also in replica_db_host
+    int replica_max_lag;
+        // if nonzero, open_replica_db() skips replicas
+        // more than this many seconds behind
+    bool db_prepared_statements;
+        // look up records by ID with prepared statements
     int shmem_key;
     char project_dir[256];
     char key_dir[256];
@@ -67,11 +75,42 @@ struct SCHED_CONFIG {
     bool verify_files_on_app_start;
     int homogeneous_redundancy;
     bool hr_allocate_slots;
+    int hr_demand_shmem_key;
+        // if nonzero (and hr_allocate_slots), schedulers count requests
+        // per HR class in a shared-memory segment with this key,
+        // and the feeder allocates slots based on these counts
+    int hr_demand_period;
+        // how often the feeder reallocates HR slots (sec)
+    double hr_demand_weight;
+        // fraction of committed HR slots allocated by request counts;
+        // the rest are allocated by RAC as in hr_info.txt
     bool ignore_upload_certificates;
     bool dont_generate_upload_certificates;
     int uldl_dir_fanout;        // fanout of ul/dl dirs; 0 if none
     bool cache_md5_info;
+    bool download_dedup;
+        // store input files with identical contents only once
+        // (see dir_hier_cas_path() in sched_util.cpp)
     int fuh_debug_level;
+    int fuh_signature_cache_shmem_key;
+        // if set, file upload handlers share a cache of
+        // verified upload signatures in this shmem segment
+    bool upload_md5;
+        // file upload handlers compute the MD5 of each upload
+        // as it arrives, and write it to a file next to it
+        // (see get_output_file_md5())
+    char upload_stage_dir[256];
+        // if set, uploads are written here, and copied to the
+        // upload store by upload_replicator (see upload_storage.h)
+    char upload_cache_dir[256];
+        // local copies of replicated or fetched uploads;
+        // default upload_stage_dir/cache
+    char upload_store_cmd[256];
+        // if set, a program that stores uploads;
+        // otherwise they're stored in upload_dir
+    double upload_cache_max_mb;
+        // upload_replicator deletes the oldest files in upload_cache_dir
+        // if they total more than this
     int reliable_priority_on_over;
         // additional results generated after at least one result
         // is over will have their priority boosted by this amount    
@@ -88,6 +127,13 @@ struct SCHED_CONFIG {
         // Project has ended - tell clients to detach
     int shmem_work_items;
         // number of work items in shared memory
+    int shmem_wu_xml_size;
+        // space in shared memory for workunit XML, bytes per work item
+    char shmem_file[256];
+        // if set, the job array is in this file (mapped by each process)
+        // rather than a SysV segment; see sched_shmem.h
+    bool shmem_huge_pages;
+        // use huge pages for the job array
     int feeder_query_size;
         // number of work items to request in each feeder query
     char httpd_user[256];
@@ -120,6 +166,12 @@ struct SCHED_CONFIG {
     bool locality_scheduling_sorted_order;
     int locality_scheduling_wait_period;
     int locality_scheduling_send_timeout;
+    int locality_index_shmem_key;
+        // if nonzero, keep hints about filesets' unsent results
+        // in a shared-memory segment with this key
+    int locality_index_empty_period;
+        // if using the index, assume a fileset with no work
+        // still has none for this long (sec)
     vector<regex_t> *locality_scheduling_workunit_file;
     vector<regex_t> *locality_scheduling_sticky_file;
     bool matchmaker;
@@ -164,11 +216,58 @@ struct SCHED_CONFIG {
         // in deciding what version is fastest,
         // multiply projected FLOPS by a random var with mean 1 and this stddev.
     int report_max;
+    int result_update_batch_size;
+        // if > 1, update reported results in multi-row UPDATEs
+        // of up to this many results, in a single transaction
+    bool update_host_after_reply;
+        // finish sending the reply before updating the host
+        // and host_app_version records.
+        // Meant for FastCGI; a CGI process may be killed
+        // by the web server once its reply is complete.
     bool request_time_stats_log;
     bool resend_lost_results;
     int sched_debug_level;
     int scheduler_log_buffer;
+    int log_writer_buffer;
+        // if nonzero, the scheduler (CGI) and transitioner
+        // put log messages in a buffer of this size,
+        // and a separate thread writes them to the log file
+    bool log_json;
+        // write log messages as JSON objects, one per line
+    int sched_record_cache_size;
+        // FastCGI: cache this many user and team records per process
+    int sched_arena_block_size;
+        // if nonzero, allocate long request/reply lists
+        // from a per-request arena with blocks of this many bytes
+    bool dont_gzip_sched_reply;
+        // don't gzip replies, even if the client accepts it
+    int reply_cache_max_age;
+        // if nonzero, keep each host's last reply for this many seconds,
+        // and send it again if the client retries the RPC
+        // (see sched_reply_cache.h)
     char sched_lockfile_dir[256];
+    int host_lock_shmem_key;
+        // if nonzero, use per-host locks in a shared-memory segment
+        // with this key, rather than lock files in sched_lockfile_dir
+    int sched_stats_shmem_key;
+        // if nonzero, record the time spent in each stage of
+        // scheduler RPCs in a shared-memory segment with this key
+    double shed_request_time;
+    double shed_db_time;
+        // if nonzero, and the recent mean time of requests
+        // (or of their initial DB lookups) exceeds this,
+        // refuse work requests; see sched_shed_delay().
+        // Requires sched_stats_shmem_key.
+    int shed_delay;
+        // the request delay for refused requests,
+        // scaled up by the degree of overload
+    int pop_stats_shmem_key;
+        // if nonzero, "census --daemon" keeps host and unsent-result
+        // statistics in a shared-memory segment with this key,
+        // and the feeder and size_regulator use them
+    bool daemon_metrics;
+        // daemons and the scheduler keep metrics
+        // in shared memory; see daemon_metrics.h
     bool send_result_abort;
     char symstore[256];
     bool user_filter;
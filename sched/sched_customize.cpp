@@ -51,6 +51,7 @@
 #include "config.h" 
 
 #include <string>
+#include <sys/stat.h>
 
 using std::string;
 
@@ -957,47 +958,77 @@ static inline bool app_plan_vbox(
 
 PLAN_CLASS_SPECS plan_class_specs;
 
+// A FastCGI scheduler handles many requests,
+// so keep the parsed plan class specs, but check every so often
+// whether plan_class_spec.xml has changed, and if so reparse it.
+//
+#define PLAN_CLASS_SPEC_CHECK_PERIOD    10
+
+static bool have_plan_class_spec = false;
+static bool bad_plan_class_spec = false;
+
+static void check_plan_class_spec_file() {
+    char buf[256];
+    struct stat sbuf;
+    static bool first = true;
+    static double last_check_time = 0;
+    static time_t spec_mtime = 0;
+
+    double now = dtime();
+    if (!first && now < last_check_time + PLAN_CLASS_SPEC_CHECK_PERIOD) {
+        return;
+    }
+    last_check_time = now;
+    safe_strcpy(buf, config.project_dir);
+    safe_strcat(buf, "/plan_class_spec.xml");
+    if (!first) {
+        if (stat(buf, &sbuf)) {
+            if (!have_plan_class_spec && !bad_plan_class_spec) return;
+        } else if (sbuf.st_mtime == spec_mtime) {
+            return;
+        }
+        log_messages.printf(MSG_NORMAL,
+            "plan class spec file '%s' changed; rereading\n", buf
+        );
+    }
+    first = false;
+    spec_mtime = stat(buf, &sbuf)?0:sbuf.st_mtime;
+    plan_class_specs.clear();
+    have_plan_class_spec = false;
+    bad_plan_class_spec = false;
+    int retval = plan_class_specs.parse_file(buf);
+    if (retval == ERR_FOPEN) {
+        if (config.debug_version_select) {
+            log_messages.printf(MSG_NORMAL,
+                "[version] Couldn't open plan class spec file '%s'\n", buf
+            );
+        }
+    } else if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "Error parsing plan class spec file '%s'\n", buf
+        );
+        bad_plan_class_spec = true;
+    } else {
+        if (config.debug_version_select) {
+            log_messages.printf(MSG_NORMAL,
+                "[version] reading plan classes from file '%s'\n", buf
+            );
+        }
+        have_plan_class_spec = true;
+    }
+}
+
 // app planning function.
 // See http://boinc.berkeley.edu/trac/wiki/AppPlan
 //
 bool app_plan(SCHEDULER_REQUEST& sreq, char* plan_class, HOST_USAGE& hu) {
-    char buf[256];
-    static bool check_plan_class_spec = true;
-    static bool have_plan_class_spec = false;
-    static bool bad_plan_class_spec = false;
-
     if (config.debug_version_select) {
         log_messages.printf(MSG_NORMAL,
             "[version] Checking plan class '%s'\n", plan_class
         );
     }
 
-    if (check_plan_class_spec) {
-        check_plan_class_spec = false;
-        safe_strcpy(buf, config.project_dir);
-        safe_strcat(buf, "/plan_class_spec.xml");
-        int retval = plan_class_specs.parse_file(buf);
-        if (retval == ERR_FOPEN) {
-            if (config.debug_version_select) {
-                log_messages.printf(MSG_NORMAL,
-                    "[version] Couldn't open plan class spec file '%s'\n", buf
-                );
-            }
-            have_plan_class_spec = false;
-        } else if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "Error parsing plan class spec file '%s'\n", buf
-            );
-            bad_plan_class_spec = true;
-        } else {
-            if (config.debug_version_select) {
-                log_messages.printf(MSG_NORMAL,
-                    "[version] reading plan classes from file '%s'\n", buf
-                );
-            }
-            have_plan_class_spec = true;
-        }
-    }
+    check_plan_class_spec_file();
     if (bad_plan_class_spec) {
         return false;
     }
@@ -15,7 +15,6 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
-
 // This program generates a stream of scheduler requests;
 // it acts as a "driver" for the scheduler when used as:
 // sched_driver | cgi --batch --mark_jobs_done
@@ -24,12 +23,25 @@
 // of the feeder and scheduler,
 // but it could be used for a variety of other purposes.
 //
-// Usage: sched_driver --nrequests N --reqs_per_second X
+// Usage: sched_driver --nrequests N --reqs_per_second X [options]
 //
 // Each request asks for a uniformly-distributed random amount of work.
 // The OS and CPU info is taken from the successive lines of a file of the form
 // | os_name | p_vendor | p_model |
 // Generate this file with a SQL query, trimming off the start and end.
+// Requests can also have (randomly) a number of CPUs, an NVIDIA GPU,
+// sticky files, and reported results (see usage()).
+// The contents of request i depend only on i and --seed,
+// so runs are reproducible.
+//
+// With --nprocs N, rather than writing requests to stdout,
+// sched_driver runs N scheduler processes (cgi --batch), in the current
+// directory, and divides the requests among them, each process getting
+// the next request when it has replied to the previous one.
+// At the end it reports throughput and request latency,
+// and, if <sched_stats_shmem_key> is set, the time spent in each stage
+// of the scheduler (the stage times are reset at the start).
+// --json writes these to a file, for comparison between runs.
 
 // Notes:
 // 1) Use sample_trivial_validator and sample_dummy_assimilator
@@ -40,17 +52,27 @@
 #define HOSTID "7"
     // ID of a host belonging to that user
 
+#include "config.h"
 #include <cstdio>
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "util.h"
 #include "str_replace.h"
 #include "str_util.h"
 #include "svn_version.h"
 
+#include "sched_config.h"
+#include "sched_timing.h"
+
 using std::vector;
+using std::string;
 
 struct HOST_DESC{
     char os_name[256];
@@ -59,8 +81,14 @@ struct HOST_DESC{
 };
 
 vector<HOST_DESC> host_descs;
+vector<string> result_names;
 double min_time = 1;
 double max_time = 1;
+int seed = 0;
+double gpu_fraction = 0;
+int nsticky_files = 0;
+int file_pool = 1000;
+int nresults = 0;
 
 void read_hosts() {
     char buf[256], buf2[256];
@@ -88,6 +116,20 @@ void read_hosts() {
     fclose(f);
 }
 
+void read_result_names(const char* path) {
+    char buf[256];
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        strip_whitespace(buf);
+        if (strlen(buf)) result_names.push_back(buf);
+    }
+    fclose(f);
+}
+
 inline double req_time() {
     if (max_time == min_time) return min_time;
     return min_time  + drand()*(max_time-min_time);
@@ -97,9 +139,13 @@ inline double exponential(double mean) {
         return -mean*log(1-drand()); 
 }
 
-void make_request(int i) {
+void make_request(FILE* f, int i) {
     HOST_DESC& hd = host_descs[i%host_descs.size()];
-    printf(
+    int j;
+
+    srand(seed*1000003 + i);
+    int ncpus = 1 << (rand() % 5);
+    fprintf(f,
         "<scheduler_request>\n"
         "   <authenticator>%s</authenticator>\n"
         "   <hostid>%s</hostid>\n"
@@ -109,19 +155,251 @@ void make_request(int i) {
         "      <os_name>%s</os_name>\n"
         "      <p_vendor>%s</p_vendor>\n"
         "      <p_model>%s</p_model>\n"
-        "      <p_fops>1e9</p_fops>\n"
+        "      <p_ncpus>%d</p_ncpus>\n"
+        "      <p_fpops>%f</p_fpops>\n"
         "      <m_nbytes>1e9</m_nbytes>\n"
         "      <d_total>1e11</d_total>\n"
-        "      <d_free>1e11</d_free>\n"
-        "   </host_info>\n"
-        "</scheduler_request>\n",
+        "      <d_free>1e11</d_free>\n",
         AUTHENTICATOR,
         HOSTID,
         req_time(),
         hd.os_name,
         hd.p_vendor,
-        hd.p_model
+        hd.p_model,
+        ncpus,
+        1e9*(1+4*drand())
+    );
+    if (drand() < gpu_fraction) {
+        fprintf(f,
+            "      <coprocs>\n"
+            "         <coproc_cuda>\n"
+            "            <count>1</count>\n"
+            "            <name>GeForce GTX 560</name>\n"
+            "            <peak_flops>%f</peak_flops>\n"
+            "            <req_secs>%f</req_secs>\n"
+            "            <req_instances>1</req_instances>\n"
+            "            <have_cuda>1</have_cuda>\n"
+            "            <cudaVersion>4020</cudaVersion>\n"
+            "            <drvVersion>30142</drvVersion>\n"
+            "            <totalGlobalMem>1073741824</totalGlobalMem>\n"
+            "         </coproc_cuda>\n"
+            "      </coprocs>\n",
+            1e11*(1+4*drand()),
+            req_time()
+        );
+    }
+    fprintf(f, "   </host_info>\n");
+    for (j=0; j<nsticky_files; j++) {
+        fprintf(f,
+            "   <file_info>\n"
+            "      <name>sched_driver_%d</name>\n"
+            "      <nbytes>1000000</nbytes>\n"
+            "      <status>1</status>\n"
+            "      <sticky/>\n"
+            "   </file_info>\n",
+            rand() % file_pool
+        );
+    }
+    for (j=0; j<nresults; j++) {
+        unsigned int k = i*nresults + j;
+        if (k >= result_names.size()) break;
+        fprintf(f,
+            "   <result>\n"
+            "      <name>%s</name>\n"
+            "      <state>5</state>\n"
+            "      <exit_status>0</exit_status>\n"
+            "      <final_cpu_time>%f</final_cpu_time>\n"
+            "      <final_elapsed_time>%f</final_elapsed_time>\n"
+            "      <app_version_num>1</app_version_num>\n"
+            "   </result>\n",
+            result_names[k].c_str(),
+            req_time(), req_time()
+        );
+    }
+    fprintf(f, "</scheduler_request>\n");
+}
+
+// Run a scheduler process and send it requests
+// iworker, iworker+nprocs, ... , waiting for each reply.
+// Write the latency of each request to out_fd.
+//
+void run_worker(
+    int iworker, int nprocs, int nrequests, double reqs_per_second,
+    const char* cgi_path, int out_fd
+) {
+    int to_cgi[2], from_cgi[2];
+    char buf[4096];
+
+    if (pipe(to_cgi) || pipe(from_cgi)) {
+        perror("pipe");
+        exit(1);
+    }
+    int pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        dup2(to_cgi[0], 0);
+        dup2(from_cgi[1], 1);
+        close(to_cgi[0]);
+        close(to_cgi[1]);
+        close(from_cgi[0]);
+        close(from_cgi[1]);
+        close(out_fd);
+        execl(cgi_path, cgi_path, "--batch", (char*)0);
+        perror("execl");
+        exit(1);
+    }
+    close(to_cgi[0]);
+    close(from_cgi[1]);
+    FILE* fin = fdopen(to_cgi[1], "w");
+    FILE* fout = fdopen(from_cgi[0], "r");
+
+    for (int i=iworker; i<nrequests; i+=nprocs) {
+        double t1 = dtime();
+        make_request(fin, i);
+        fflush(fin);
+        bool got_reply = false;
+        while (fgets(buf, sizeof(buf), fout)) {
+            if (strstr(buf, "</scheduler_reply>")) {
+                got_reply = true;
+                break;
+            }
+        }
+        if (!got_reply) {
+            fprintf(stderr, "worker %d: scheduler exited\n", iworker);
+            exit(1);
+        }
+        double t2 = dtime();
+        double latency = t2 - t1;
+        if (write(out_fd, &latency, sizeof(latency)) != sizeof(latency)) {
+            exit(1);
+        }
+        if (reqs_per_second > 0) {
+            double x = exponential(nprocs/reqs_per_second);
+            if (latency < x) {
+                boinc_sleep(x - latency);
+            }
+        }
+    }
+    fclose(fin);
+    while (fgets(buf, sizeof(buf), fout));
+    fclose(fout);
+    waitpid(pid, 0, 0);
+    exit(0);
+}
+
+inline double percentile(vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    return v[(size_t)(p*(v.size()-1))];
+}
+
+void write_json(
+    FILE* f, int nprocs, double elapsed, vector<double>& latencies,
+    SCHED_TIMING_TABLE* stp
+) {
+    double sum = 0;
+    for (unsigned int i=0; i<latencies.size(); i++) {
+        sum += latencies[i];
+    }
+    fprintf(f,
+        "{\n"
+        "  \"nrequests\": %d,\n"
+        "  \"nprocs\": %d,\n"
+        "  \"seed\": %d,\n"
+        "  \"elapsed\": %f,\n"
+        "  \"throughput\": %f,\n"
+        "  \"latency\": {\"mean\": %f, \"p50\": %f, \"p90\": %f, \"p99\": %f, \"max\": %f}",
+        (int)latencies.size(), nprocs, seed, elapsed,
+        elapsed>0?latencies.size()/elapsed:0,
+        latencies.empty()?0:sum/latencies.size(),
+        percentile(latencies, .5), percentile(latencies, .9),
+        percentile(latencies, .99), percentile(latencies, 1)
     );
+    if (stp) {
+        fprintf(f, ",\n  \"stages\": {\n");
+        for (int i=0; i<NSCHED_STAGES; i++) {
+            SCHED_TIMING_STAGE& s = stp->stages[i];
+            fprintf(f,
+                "    \"%s\": {\"n\": %llu, \"mean\": %f, \"p50\": %f, \"p90\": %f, \"p99\": %f, \"max\": %f}%s\n",
+                sched_stage_name(i), s.n, s.mean()/1e6,
+                s.percentile(.5)/1e6, s.percentile(.9)/1e6,
+                s.percentile(.99)/1e6, s.max_usec/1e6,
+                (i<NSCHED_STAGES-1)?",":""
+            );
+        }
+        fprintf(f, "  }");
+    }
+    fprintf(f, "\n}\n");
+}
+
+// run the benchmark: start the workers, collect latencies, report
+//
+void run_benchmark(
+    int nprocs, int nrequests, double reqs_per_second,
+    const char* cgi_path, const char* json_path
+) {
+    int fds[2];
+    int i;
+    SCHED_TIMING_TABLE* stp = NULL;
+    vector<double> latencies;
+    double latency;
+
+    if (!config.parse_file() && config.sched_stats_shmem_key) {
+        stp = attach_sched_timing();
+        if (stp) stp->reset();
+    }
+    if (pipe(fds)) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    double start = dtime();
+    for (i=0; i<nprocs; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            run_worker(i, nprocs, nrequests, reqs_per_second, cgi_path, fds[1]);
+        }
+    }
+    close(fds[1]);
+
+    // each write is smaller than PIPE_BUF, so they aren't interleaved
+    //
+    while (read(fds[0], &latency, sizeof(latency)) == sizeof(latency)) {
+        latencies.push_back(latency);
+    }
+    for (i=0; i<nprocs; i++) {
+        wait(0);
+    }
+    double elapsed = dtime() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%d requests in %.3f sec (%.3f/sec); %d processes\n",
+        (int)latencies.size(), elapsed,
+        elapsed>0?latencies.size()/elapsed:0, nprocs
+    );
+    printf("latency (msec): p50 %.3f p90 %.3f p99 %.3f max %.3f\n\n",
+        percentile(latencies, .5)*1000, percentile(latencies, .9)*1000,
+        percentile(latencies, .99)*1000, percentile(latencies, 1)*1000
+    );
+    if (stp) {
+        stp->print(stdout);
+    }
+    if (json_path) {
+        FILE* f = fopen(json_path, "w");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", json_path);
+            exit(1);
+        }
+        write_json(f, nprocs, elapsed, latencies, stp);
+        fclose(f);
+    }
 }
 
 void usage(char *name) {
@@ -146,6 +424,16 @@ void usage(char *name) {
         "Options: \n"
         "  --nrequests N                  Sets the total numberer of requests to N\n"
         "  --reqs_per_second X            Sets the number of requests per second to X\n"
+        "                                 (with --nprocs, 0 means as fast as possible)\n"
+        "  [ --seed N ]                   Seed for the random request contents\n"
+        "  [ --gpu_fraction X ]           Fraction of requests from hosts with an NVIDIA GPU\n"
+        "  [ --sticky_files N ]           List N sticky files per request, from a pool of\n"
+        "  [ --file_pool M ]              M names (default 1000)\n"
+        "  [ --result_names file ]        Names of results to report, one per line\n"
+        "  [ --nresults N ]               Report N of these per request\n"
+        "  [ --nprocs N ]                 Run N scheduler processes and report performance\n"
+        "  [ --cgi path ]                 The scheduler program (default ./cgi)\n"
+        "  [ --json file ]                Write performance to file as JSON\n"
         "  [ -h | --help ]                Show this help text.\n"
         "  [ -v | --version ]             Show version information\n",
         name, name
@@ -153,8 +441,10 @@ void usage(char *name) {
 }
 
 int main(int argc, char** argv) {
-    int i, nrequests = 1;
+    int i, nrequests = 1, nprocs = 0;
     double reqs_per_second = 1;
+    const char* cgi_path = "./cgi";
+    const char* json_path = NULL;
 
     for (i=1; i<argc; i++) {
         if (!strcmp(argv[i], "--nrequests")) {
@@ -173,6 +463,79 @@ int main(int argc, char** argv) {
             }
             reqs_per_second = atof(argv[i]);
         }
+        else if (!strcmp(argv[i], "--seed")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            seed = atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--gpu_fraction")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            gpu_fraction = atof(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--sticky_files")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nsticky_files = atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--file_pool")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            file_pool = atoi(argv[i]);
+            if (file_pool < 1) file_pool = 1;
+        }
+        else if (!strcmp(argv[i], "--result_names")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            read_result_names(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--nresults")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nresults = atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--nprocs")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nprocs = atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--cgi")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            cgi_path = argv[i];
+        }
+        else if (!strcmp(argv[i], "--json")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            json_path = argv[i];
+        }
         else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             usage(argv[0]);
             exit(0);
@@ -187,10 +550,14 @@ int main(int argc, char** argv) {
         }
     }
     read_hosts();
+    if (nprocs > 0) {
+        run_benchmark(nprocs, nrequests, reqs_per_second, cgi_path, json_path);
+        exit(0);
+    }
     double t1, t2, x;
     for (i=0; i<nrequests; i++) {
         t1 = dtime();
-        make_request(i);
+        make_request(stdout, i);
         t2 = dtime();
         x = exponential(1./reqs_per_second);
         if (t2 - t1 < x) {
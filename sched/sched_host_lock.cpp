@@ -0,0 +1,151 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <cerrno>
+#include <csignal>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "shmem.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "sched_host_lock.h"
+
+static HOST_LOCK_TABLE* host_lock_table = 0;
+
+static inline unsigned long long make_entry(int hostid, int pid) {
+    return (((unsigned long long)(unsigned int)hostid) << 32)
+        | (unsigned int)pid;
+}
+
+static inline int entry_hostid(unsigned long long e) {
+    return (int)(e >> 32);
+}
+
+static inline int entry_pid(unsigned long long e) {
+    return (int)(e & 0xffffffff);
+}
+
+static bool pid_alive(int pid) {
+    if (kill(pid, 0) == 0) return true;
+    return errno == EPERM;
+}
+
+static int attach_host_lock_table() {
+    void* p;
+    if (host_lock_table) return 0;
+    int retval = create_shmem(
+        config.host_lock_shmem_key, sizeof(HOST_LOCK_TABLE), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach host lock shmem (key %x): %d\n",
+            config.host_lock_shmem_key, retval
+        );
+        return -1;
+    }
+    host_lock_table = (HOST_LOCK_TABLE*)p;
+    return 0;
+}
+
+// If another live process holds the lock for the host
+// (in some slot other than "except"), return its PID.
+// Clear entries for the host left by dead processes.
+//
+static int find_holder(
+    int hostid, int pid, int except, int& free_slot
+) {
+    unsigned long long* entries = host_lock_table->entries;
+    int home = (int)((unsigned int)hostid % HOST_LOCK_NSLOTS);
+
+    free_slot = -1;
+    for (int i=0; i<HOST_LOCK_WINDOW; i++) {
+        int s = (home + i) % HOST_LOCK_NSLOTS;
+        if (s == except) continue;
+        unsigned long long e = entries[s];
+        if (e && entry_hostid(e) == hostid) {
+            int p = entry_pid(e);
+            if (p != pid && pid_alive(p)) return p;
+
+            // stale: the owner exited without unlocking.
+            // (if it's this process, an earlier request didn't unlock)
+            //
+            if (__sync_bool_compare_and_swap(&entries[s], e, 0ULL)) {
+                if (config.debug_fcgi) {
+                    log_messages.printf(MSG_NORMAL,
+                        "[fcgi] cleared stale lock for [HOST#%d] from PID %d\n",
+                        hostid, p
+                    );
+                }
+                e = 0;
+            }
+        }
+        if (!e && free_slot < 0) free_slot = s;
+    }
+    return 0;
+}
+
+int host_lock_acquire(int hostid, int& slot) {
+    int pid = getpid();
+    int holder, free_slot, dummy;
+
+    slot = -1;
+    if (attach_host_lock_table()) return -1;
+    unsigned long long* entries = host_lock_table->entries;
+    unsigned long long mine = make_entry(hostid, pid);
+
+    // the loop repeats only if another process
+    // takes the free slot we picked
+    //
+    for (int tries=0; tries<HOST_LOCK_WINDOW; tries++) {
+        holder = find_holder(hostid, pid, -1, free_slot);
+        if (holder) return holder;
+        if (free_slot < 0) {
+            log_messages.printf(MSG_CRITICAL,
+                "No free host lock slot for [HOST#%d]; increase HOST_LOCK_NSLOTS\n",
+                hostid
+            );
+            return -1;
+        }
+        if (!__sync_bool_compare_and_swap(&entries[free_slot], 0ULL, mine)) {
+            continue;
+        }
+
+        // Another process may have locked the same host
+        // in a different slot at the same time.
+        // If so, both back off.
+        //
+        holder = find_holder(hostid, pid, free_slot, dummy);
+        if (holder) {
+            host_lock_release(hostid, free_slot);
+            return holder;
+        }
+        slot = free_slot;
+        return 0;
+    }
+    return -1;
+}
+
+void host_lock_release(int hostid, int slot) {
+    if (!host_lock_table || slot < 0) return;
+    __sync_bool_compare_and_swap(
+        &host_lock_table->entries[slot], make_entry(hostid, getpid()), 0ULL
+    );
+}
@@ -0,0 +1,51 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Per-host scheduler locks kept in shared memory,
+// an alternative to lock files in <sched_lockfile_dir>.
+// Enabled by <host_lock_shmem_key> in config.xml.
+//
+// The table is a separate shared-memory segment (not part of SCHED_SHMEM,
+// so it survives feeder restarts).
+// It's created, zero-filled, by the first scheduler process that needs it.
+//
+// Each entry is either 0 (free) or a host ID and the PID of the
+// scheduler process holding the lock for that host.
+// A host's entry goes in one of the HOST_LOCK_WINDOW slots
+// starting at (host ID mod HOST_LOCK_NSLOTS).
+// Entries are set and cleared with 64-bit compare-and-swap.
+// An entry whose process no longer exists is stale, and is reclaimed.
+
+#ifndef _SCHED_HOST_LOCK_H_
+#define _SCHED_HOST_LOCK_H_
+
+#ifndef HOST_LOCK_NSLOTS
+#define HOST_LOCK_NSLOTS    16384
+#endif
+#define HOST_LOCK_WINDOW    32
+
+struct HOST_LOCK_TABLE {
+    unsigned long long entries[HOST_LOCK_NSLOTS];
+};
+
+extern int host_lock_acquire(int hostid, int& slot);
+    // return 0 if we got the lock (and set slot),
+    // the PID of the process holding the lock,
+    // or -1 if error (can't attach segment, or no free slot)
+extern void host_lock_release(int hostid, int slot);
+
+#endif
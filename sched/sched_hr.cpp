@@ -50,10 +50,10 @@ bool hr_unknown_platform(HOST& host) {
 
 // check for HR compatibility
 //
-bool already_sent_to_different_hr_class(WORKUNIT& wu, APP& app) {
+bool already_sent_to_different_hr_class(int wu_hr_class, APP& app) {
     g_wreq->hr_reject_temp = false;
     int host_hr_class = hr_class(g_request->host, app_hr_type(app));
-    if (wu.hr_class && (host_hr_class != wu.hr_class)) {
+    if (wu_hr_class && (host_hr_class != wu_hr_class)) {
         g_wreq->hr_reject_temp = true;
         return true;
     }
@@ -18,7 +18,7 @@
 #ifndef __SCHED_HR__
 #define __SCHED_HR__
 
-extern bool already_sent_to_different_hr_class(WORKUNIT& workunit, APP&);
+extern bool already_sent_to_different_hr_class(int wu_hr_class, APP&);
 
 extern bool hr_unknown_platform(HOST&);
 
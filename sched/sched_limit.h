@@ -112,6 +112,9 @@ struct JOB_LIMIT {
 struct JOB_LIMITS {
     JOB_LIMIT project_limits;      // project-wide limits
     vector<JOB_LIMIT> app_limits;  // per-app limits
+    vector<int> app_limit_index;
+        // app ID -> index in app_limits, -1 if none, -2 if not known yet.
+        // Lets app_limit() compare names only once per app per process.
 
     int parse(XML_PARSER&, const char* end_tag);
     void print_log();
@@ -135,10 +138,37 @@ struct JOB_LIMITS {
         return NULL;
     }
 
+    // the per-app limit for the given app, or NULL
+    //
+    inline JOB_LIMIT* app_limit(APP* app) {
+        if (app_limits.empty()) return NULL;
+        if (app->id < 0 || app->id > 100000) return lookup_app(app->name);
+        if (app->id >= (int)app_limit_index.size()) {
+            app_limit_index.resize(app->id+1, -2);
+        }
+        int& k = app_limit_index[app->id];
+        if (k == -2) {
+            JOB_LIMIT* jlp = lookup_app(app->name);
+            k = jlp?(int)(jlp - &app_limits[0]):-1;
+        }
+        return (k >= 0)?&app_limits[k]:NULL;
+    }
+
+    // whether there are any limits at all;
+    // if not, jobs in progress needn't be counted
+    //
+    inline bool any_limit() {
+        if (project_limits.any_limit()) return true;
+        for (unsigned int i=0; i<app_limits.size(); i++) {
+            if (app_limits[i].any_limit()) return true;
+        }
+        return false;
+    }
+
     inline bool exceeded(APP* app, bool is_gpu) {
         if (project_limits.exceeded(is_gpu)) return true;
         if (app) {
-            JOB_LIMIT* jlp = lookup_app(app->name);
+            JOB_LIMIT* jlp = app_limit(app);
             if (jlp) {
                 if (jlp->exceeded(is_gpu)) return true;
             }
@@ -149,7 +179,7 @@ struct JOB_LIMITS {
     inline void register_job(APP* app, bool is_gpu) {
         project_limits.register_job(is_gpu);
         if (app) {
-            JOB_LIMIT* jlp = lookup_app(app->name);
+            JOB_LIMIT* jlp = app_limit(app);
             if (jlp) {
                 jlp->register_job(is_gpu);
             }
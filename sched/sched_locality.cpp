@@ -38,10 +38,12 @@
 #include "sched_check.h"
 #include "sched_config.h"
 #include "sched_locality.h"
+#include "sched_locality_index.h"
 #include "sched_main.h"
 #include "sched_msgs.h"
 #include "sched_send.h"
 #include "sched_shmem.h"
+#include "sched_timing.h"
 #include "sched_types.h"
 #include "sched_util.h"
 #include "sched_version.h"
@@ -144,18 +146,9 @@ bool host_has_file(char *filename, bool skip_last_wu) {
     int i, uplim;
     bool has_file=false;
 
-    // loop over files already on host to see if host already has the
-    // file
+    // see if host already has the file
     //
-    for (i=0; i<(int)g_request->file_infos.size(); i++) {
-        FILE_INFO& fi = g_request->file_infos[i];
-        if (!strcmp(filename, fi.name)) {
-            has_file=true;
-            break;
-        }
-    }
-
-    if (has_file) {
+    if (g_request->has_file(filename)) {
         if (config.debug_locality) {
             log_messages.printf(MSG_NORMAL,
                 "[locality] [HOST#%d] Already has file %s\n", g_reply->host.id, filename
@@ -551,6 +544,8 @@ static int send_results_for_file(
     SCHED_DB_RESULT result, prev_result;
     char buf[256], query[1024];
     int i, maxid, retval_max, retval_lookup, sleep_made_no_work=0;
+    int min_id, empty_until;
+    bool use_index = config.locality_index_shmem_key != 0;
 
     nsent = 0;
 
@@ -558,6 +553,21 @@ static int send_results_for_file(
         return 0;
     }
 
+    // if another scheduler found no work for this file recently,
+    // don't look again
+    //
+    if (use_index
+        && !locality_index_lookup(filename, min_id, empty_until)
+        && empty_until > time(0)
+    ) {
+        if (config.debug_locality) {
+            log_messages.printf(MSG_NORMAL,
+                "[locality] index says no work for file %s\n", filename
+            );
+        }
+        return 0;
+    }
+
     // find largest ID of results already sent to this user for this
     // file, if any.  Any result that is sent will have userid field
     // set, so unsent results can not be returned by this query.
@@ -584,9 +594,26 @@ static int send_results_for_file(
 
     for (i=0; i<100; i++) {     // avoid infinite loop
         int query_retval;
+        int after_id = prev_result.id;
+        bool hinted = false;
 
         if (!work_needed(true)) break;
 
+        // there are no unsent results for the file with ID < min_id
+        //
+        if (use_index
+            && !locality_index_lookup(filename, min_id, empty_until)
+            && min_id-1 > after_id
+        ) {
+            after_id = min_id-1;
+            hinted = true;
+        }
+
+        // if so, the result we find is the file's first unsent result
+        //
+        bool first_unsent = (hinted || !prev_result.id)
+            && !(config.one_result_per_user_per_wu && prev_result.id);
+
         if (config.debug_locality) {
             log_messages.printf(MSG_NORMAL,
                 "[locality] in_send_results_for_file(%s, %d) prev_result.id=%d\n",
@@ -603,24 +630,24 @@ static int send_results_for_file(
 #ifdef USE_REGEXP
             sprintf(query,
                 "INNER JOIN (SELECT id FROM result WHERE name like binary '%s%%' and id>%d and workunitid<>%d and server_state=%d order by id limit 1) AS single USING (id) ",
-                escaped_pattern, prev_result.id, prev_result.workunitid, RESULT_SERVER_STATE_UNSENT
+                escaped_pattern, after_id, prev_result.workunitid, RESULT_SERVER_STATE_UNSENT
             );
 #else
             sprintf(query,
                 "INNER JOIN (SELECT id FROM result WHERE name>binary '%s__' and name<binary '%s__~' and id>%d and workunitid<>%d and server_state=%d order by id limit 1) AS single USING (id) ",
-                filename, filename, prev_result.id, prev_result.workunitid, RESULT_SERVER_STATE_UNSENT
+                filename, filename, after_id, prev_result.workunitid, RESULT_SERVER_STATE_UNSENT
             );
 #endif
         } else {
 #ifdef USE_REGEXP
             sprintf(query,
                 "INNER JOIN (SELECT id FROM result WHERE name like binary '%s%%' and id>%d and server_state=%d order by id limit 1) AS single USING (id) ",
-                escaped_pattern, prev_result.id, RESULT_SERVER_STATE_UNSENT
+                escaped_pattern, after_id, RESULT_SERVER_STATE_UNSENT
             );
 #else
             sprintf(query,
                 "INNER JOIN (SELECT id FROM result WHERE name>binary '%s__' and name<binary '%s__~' and id>%d and server_state=%d order by id limit 1) AS single USING (id) ",
-                filename, filename, prev_result.id, RESULT_SERVER_STATE_UNSENT
+                filename, filename, after_id, RESULT_SERVER_STATE_UNSENT
             );
 #endif
         }
@@ -639,6 +666,15 @@ static int send_results_for_file(
             //
             boinc_db.commit_transaction();
 
+            // none above the index's min_id.
+            // Make sure (it's only a hint) - look again without it.
+            //
+            if (hinted) {
+                locality_index_clear_min_id(filename);
+                use_index = false;
+                continue;
+            }
+
             // see if no more work remains to be made for this file,
             // or if an attempt to make more work fails.
             //
@@ -679,6 +715,11 @@ static int send_results_for_file(
                 // arrive here if and only if there exist no further
                 // unsent results for this file.
                 flag_for_possible_removal(filename);
+                if (config.locality_index_shmem_key) {
+                    locality_index_set_empty(
+                        filename, time(0) + config.locality_index_empty_period
+                    );
+                }
                 if (config.debug_locality) {
                     log_messages.printf(MSG_NORMAL,
                         "[locality] No remaining work for file %s (%d), flagging for removal\n", filename, i
@@ -709,6 +750,12 @@ static int send_results_for_file(
             retval_send = possibly_send_result(result);
             boinc_db.commit_transaction();
 
+            if (use_index && first_unsent) {
+                locality_index_set_min_id(
+                    filename, retval_send ? result.id : result.id+1
+                );
+            }
+
             // if no app version or not enough resources, give up completely
             //
             if (retval_send == ERR_NO_APP_VERSION || retval_send==ERR_INSUFFICIENT_RESOURCE) return retval_send;
@@ -1093,6 +1140,8 @@ bool is_workunit_file(char*fname) {
 }
 
 void send_work_locality() {
+    SCHED_TIMER timer(SCHED_STAGE_SEND_WORK_LOCALITY);
+
     int i, nsent, nfiles, j;
 
     // seed the random number generator
@@ -1106,9 +1155,10 @@ void send_work_locality() {
         FILE_INFO& fi = g_request->file_infos[k];
         escape_string(fi.name, sizeof(fi.name));
     }
+    g_request->index_files();
 
 #ifdef EINSTEIN_AT_HOME
-    std::vector<FILE_INFO> eah_copy = g_request->file_infos;
+    FILE_INFO_LIST eah_copy = g_request->file_infos;
     g_request->file_infos.clear();
     g_request->files_not_needed.clear();
     nfiles = (int) eah_copy.size();
@@ -1143,6 +1193,7 @@ void send_work_locality() {
             }
         }
     }
+    g_request->index_files();
 #endif // EINSTEIN_AT_HOME
 
     nfiles = (int) g_request->file_infos.size();
@@ -0,0 +1,169 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// The locality scheduling index; see sched_locality_index.h
+
+#include "config.h"
+#include <cstdlib>
+
+#include "shmem.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "sched_locality_index.h"
+
+static LOCALITY_INDEX_TABLE* locality_index = 0;
+
+static int attach_locality_index() {
+    void* p;
+    if (locality_index) return 0;
+    int retval = create_shmem(
+        config.locality_index_shmem_key, sizeof(LOCALITY_INDEX_TABLE), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach locality index shmem (key %x): %d\n",
+            config.locality_index_shmem_key, retval
+        );
+        return -1;
+    }
+    locality_index = (LOCALITY_INDEX_TABLE*)p;
+    return 0;
+}
+
+// FNV-1a; the slot hash and the tag use different offset bases.
+// The tag is never zero, so a zero word is free.
+//
+static unsigned int name_hash(const char* p, unsigned int h) {
+    while (*p) {
+        h ^= (unsigned char)*p++;
+        h *= 16777619;
+    }
+    return h;
+}
+
+static inline unsigned int slot_hash(const char* name) {
+    return name_hash(name, 2166136261U);
+}
+
+static inline unsigned int name_tag(const char* name) {
+    unsigned int t = name_hash(name, 84696351U);
+    return t ? t : 1;
+}
+
+static inline unsigned long long make_word(unsigned int tag, int value) {
+    return (((unsigned long long)tag) << 32) | (unsigned int)value;
+}
+
+static inline unsigned int word_tag(unsigned long long w) {
+    return (unsigned int)(w >> 32);
+}
+
+static inline int word_value(unsigned long long w) {
+    return (int)(w & 0xffffffff);
+}
+
+// Find the fileset's slot.
+// If it has none and "create" is set, claim a free slot
+// (or replace one) and return it.
+// Return NULL if none or can't attach.
+//
+static LOCALITY_INDEX_SLOT* find_slot(const char* name, bool create) {
+    if (attach_locality_index()) return NULL;
+    unsigned int tag = name_tag(name);
+    int home = (int)(slot_hash(name) % LOCALITY_INDEX_NSLOTS);
+    int free_slot = -1;
+
+    for (int i=0; i<LOCALITY_INDEX_WINDOW; i++) {
+        LOCALITY_INDEX_SLOT& s = locality_index->slots[(home + i) % LOCALITY_INDEX_NSLOTS];
+        unsigned long long m = s.min_id, e = s.empty_until;
+        if (word_tag(m) == tag || word_tag(e) == tag) return &s;
+        if (!m && !e && free_slot < 0) free_slot = i;
+    }
+    if (!create) return NULL;
+    if (free_slot < 0) free_slot = rand() % LOCALITY_INDEX_WINDOW;
+    return &locality_index->slots[(home + free_slot) % LOCALITY_INDEX_NSLOTS];
+}
+
+// Set a word to the given value for the fileset,
+// if it's not already set to a larger value for the fileset.
+// If "raise" isn't set, always set it.
+//
+static void set_word(
+    unsigned long long& w, unsigned int tag, int value, bool raise
+) {
+    unsigned long long x = make_word(tag, value);
+
+    // the loop repeats only if other processes
+    // are updating the same word
+    //
+    for (int tries=0; tries<10; tries++) {
+        unsigned long long old = w;
+        if (raise && word_tag(old) == tag && word_value(old) >= value) {
+            return;
+        }
+        if (__sync_bool_compare_and_swap(&w, old, x)) return;
+    }
+}
+
+int locality_index_lookup(
+    const char* fileset, int& min_id, int& empty_until
+) {
+    min_id = 0;
+    empty_until = 0;
+    if (attach_locality_index()) return -1;
+    LOCALITY_INDEX_SLOT* s = find_slot(fileset, false);
+    if (!s) return 0;
+    unsigned int tag = name_tag(fileset);
+    unsigned long long m = s->min_id, e = s->empty_until;
+    if (word_tag(m) == tag) min_id = word_value(m);
+    if (word_tag(e) == tag) empty_until = word_value(e);
+    return 0;
+}
+
+void locality_index_set_min_id(const char* fileset, int min_id) {
+    LOCALITY_INDEX_SLOT* s = find_slot(fileset, true);
+    if (!s) return;
+    unsigned int tag = name_tag(fileset);
+
+    // if the slot was someone else's, take over both words
+    //
+    if (word_tag(s->empty_until) != tag) {
+        set_word(s->empty_until, tag, 0, false);
+    }
+    set_word(s->min_id, tag, min_id, true);
+}
+
+void locality_index_clear_min_id(const char* fileset) {
+    LOCALITY_INDEX_SLOT* s = find_slot(fileset, false);
+    if (!s) return;
+    unsigned int tag = name_tag(fileset);
+    unsigned long long old = s->min_id;
+    if (word_tag(old) != tag) return;
+    __sync_bool_compare_and_swap(&s->min_id, old, make_word(tag, 0));
+}
+
+void locality_index_set_empty(const char* fileset, int until) {
+    LOCALITY_INDEX_SLOT* s = find_slot(fileset, true);
+    if (!s) return;
+    unsigned int tag = name_tag(fileset);
+    if (word_tag(s->min_id) != tag) {
+        set_word(s->min_id, tag, 0, false);
+    }
+    set_word(s->empty_until, tag, until, false);
+}
@@ -0,0 +1,70 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A shared-memory index of what locality-scheduling processes
+// have learned about each fileset's unsent results,
+// so that send_results_for_file() can narrow or skip its result queries.
+// Enabled by <locality_index_shmem_key> in config.xml.
+//
+// Like the host lock table, it's a separate segment,
+// created (zero-filled) by the first scheduler process that needs it.
+// The information in it is only a hint;
+// all sends still go through the DB.
+//
+// For each fileset the index has
+// - min_id: all unsent results for the fileset have ID >= min_id
+//   (result IDs increase, and results don't become unsent again)
+// - empty_until: there's no work for the fileset,
+//   and the work generator can't make more, until this time.
+//
+// A fileset's entry goes in one of LOCALITY_INDEX_WINDOW slots
+// starting at (hash mod LOCALITY_INDEX_NSLOTS).
+// Each of the two values is a 64-bit word holding a 32-bit hash
+// of the fileset name (different from the slot hash) and the value,
+// so each word can be updated with compare-and-swap,
+// and words written for a fileset that's since been replaced
+// in the slot are ignored.
+// If there's no free slot, a random one in the window is replaced.
+
+#ifndef _SCHED_LOCALITY_INDEX_H_
+#define _SCHED_LOCALITY_INDEX_H_
+
+#ifndef LOCALITY_INDEX_NSLOTS
+#define LOCALITY_INDEX_NSLOTS   65536
+#endif
+#define LOCALITY_INDEX_WINDOW   16
+
+struct LOCALITY_INDEX_SLOT {
+    unsigned long long min_id;
+    unsigned long long empty_until;
+};
+
+struct LOCALITY_INDEX_TABLE {
+    LOCALITY_INDEX_SLOT slots[LOCALITY_INDEX_NSLOTS];
+};
+
+extern int locality_index_lookup(
+    const char* fileset, int& min_id, int& empty_until
+);
+    // get the values for a fileset (0 if unknown).
+    // Return nonzero if the index can't be attached.
+extern void locality_index_set_min_id(const char* fileset, int min_id);
+    // raise min_id (never lowers it)
+extern void locality_index_clear_min_id(const char* fileset);
+extern void locality_index_set_empty(const char* fileset, int until);
+
+#endif
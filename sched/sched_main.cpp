@@ -30,6 +30,7 @@
 #include <cstdio>
 #endif
 #include <cstdlib>
+#include <map>
 #include <vector>
 #include <string>
 #include <cstring>
@@ -53,6 +54,7 @@
 #include "util.h"
 
 #include "handle_request.h"
+#include "sched_cache.h"
 #include "sched_config.h"
 #include "sched_files.h"
 #include "sched_msgs.h"
@@ -196,10 +198,27 @@ int open_database() {
         log_messages.printf(MSG_CRITICAL, "can't open database\n");
         return retval;
     }
+    boinc_db.use_prepared = config.db_prepared_statements;
     db_opened = true;
     return 0;
 }
 
+// If the reply is going directly to the client,
+// tell the web server that it's complete,
+// so that the client doesn't wait for what we do afterwards.
+//
+void finish_reply(FILE* fout) {
+    fflush(fout);
+    if (fout != stdout || batch || strlen(config.debug_req_reply_dir)) {
+        return;
+    }
+#ifdef _USING_FCGI_
+    FCGI_Finish();
+#else
+    fclose(stdout);
+#endif
+}
+
 // If the scheduler 'hangs' (e.g. because DB is slow),
 // Apache will send it a SIGTERM.
 // Record this in the log file and close the DB conn.
@@ -293,7 +312,7 @@ void attach_to_feeder_shmem() {
     int i, retval;
     void* p;
 
-    retval = attach_shmem(config.shmem_key, &p);
+    retval = attach_sched_shmem(&p);
     if (retval || p==0) {
         log_messages.printf(MSG_CRITICAL,
             "Can't attach shmem: %d (feeder not running?)\n",
@@ -492,6 +511,7 @@ int main(int argc, char** argv) {
 
     log_messages.set_debug_level(config.sched_debug_level);
     if (config.sched_debug_level == 4) g_print_queries = true;
+    config_log_messages();
 
     gui_urls.init();
     project_files.init();
@@ -650,6 +670,16 @@ done:
             log_messages.printf(MSG_NORMAL,
                 "FCGI: counter: %d\n", counter
             );
+            log_record_cache_stats();
+            std::map<std::string, int>::iterator it;
+            for (it = xml_unexpected_tag_counts.begin();
+                it != xml_unexpected_tag_counts.end(); ++it
+            ) {
+                log_messages.printf(MSG_NORMAL,
+                    "FCGI: unrecognized tag <%s>: %d\n",
+                    it->first.c_str(), it->second
+                );
+            }
             log_messages.flush();
         }
     }   // do()
@@ -70,4 +70,5 @@ extern bool mark_jobs_done;
 extern bool all_apps_use_hr;
 
 extern int open_database();
+extern void finish_reply(FILE*);
 extern void debug_sched(const char *trigger);
@@ -31,7 +31,7 @@ const char* SCHED_MSG_LOG::v_format_kind(int kind) const {
 }
 
 bool SCHED_MSG_LOG::v_message_wanted(int kind) const {
-    return ( kind <= debug_level );
+    return wanted(kind);
 }
 
 void SCHED_MSG_LOG::set_indent_level(const int new_indent_level) {
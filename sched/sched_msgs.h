@@ -26,6 +26,14 @@
 
 enum { MSG_CRITICAL=1, MSG_NORMAL, MSG_DEBUG };
 
+// messages above this level are never written.
+// Compile with -DSCHED_MSG_MAX_LEVEL=2 to remove the code
+// for debug messages guarded by log_messages.wanted(MSG_DEBUG)
+//
+#ifndef SCHED_MSG_MAX_LEVEL
+#define SCHED_MSG_MAX_LEVEL MSG_DEBUG
+#endif
+
 class SCHED_MSG_LOG : public MSG_LOG {
     const char* v_format_kind(int kind) const;
     bool v_message_wanted(int kind) const;
@@ -34,6 +42,13 @@ public:
     enum { MSG_CRITICAL=1, MSG_NORMAL, MSG_DEBUG };
     SCHED_MSG_LOG(): MSG_LOG(stderr) { debug_level = MSG_NORMAL; }
     void set_debug_level(int new_level) { debug_level = new_level; }
+
+    // whether messages of the given kind are written.
+    // Use this to skip building messages in frequently-executed code
+    //
+    inline bool wanted(int kind) const {
+        return kind <= SCHED_MSG_MAX_LEVEL && kind <= debug_level;
+    }
     void set_indent_level(const int new_indent_level);
 #ifdef _USING_FCGI_
     ~SCHED_MSG_LOG();
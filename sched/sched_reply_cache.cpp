@@ -0,0 +1,132 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Cache of scheduler replies; see sched_reply_cache.h
+
+#include "config.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "md5_file.h"
+#include "util.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "sched_reply_cache.h"
+
+using std::string;
+
+static void cache_path(int hostid, char* path, int len) {
+    snprintf(path, len, "%s/%d/%d",
+        config.project_path(REPLY_CACHE_DIR), hostid % REPLY_CACHE_NDIRS,
+        hostid
+    );
+}
+
+static void auth_hash(const char* authenticator, char* hash) {
+    md5_block(
+        (const unsigned char*)authenticator, (int)strlen(authenticator), hash
+    );
+}
+
+int reply_cache_lookup(
+    int hostid, int rpc_seqno, const char* authenticator,
+    const char* request_md5, string& reply
+) {
+    char path[MAXPATHLEN], buf[1024], hash[256], file_hash[256];
+    char file_request_md5[256];
+    int seqno;
+    struct stat sbuf;
+
+    if (config.reply_cache_max_age <= 0 || hostid <= 0) return ERR_NOT_FOUND;
+    cache_path(hostid, path, sizeof(path));
+    FILE* f = boinc_fopen(path, "r");
+    if (!f) return ERR_NOT_FOUND;
+    if (!fgets(buf, sizeof(buf), f)
+        || sscanf(buf, "%d %255s %255s", &seqno, file_hash, file_request_md5) != 3
+        || seqno != rpc_seqno
+        || strcmp(file_request_md5, request_md5)
+    ) {
+        fclose(f);
+        return ERR_NOT_FOUND;
+    }
+    auth_hash(authenticator, hash);
+    if (strcmp(hash, file_hash)) {
+        fclose(f);
+        return ERR_NOT_FOUND;
+    }
+    if (fstat(fileno(f), &sbuf)
+        || dtime() - sbuf.st_mtime > config.reply_cache_max_age
+    ) {
+        fclose(f);
+        unlink(path);
+        return ERR_NOT_FOUND;
+    }
+    reply.clear();
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        reply.append(buf, n);
+    }
+    fclose(f);
+    if (reply.empty()) return ERR_NOT_FOUND;
+    return 0;
+}
+
+// write to a temp file and rename,
+// so that a concurrent lookup sees the old reply or the new one
+//
+int reply_cache_store(
+    int hostid, int rpc_seqno, const char* authenticator,
+    const char* request_md5, const string& reply
+) {
+    char dir[MAXPATHLEN], path[MAXPATHLEN], tmp_path[MAXPATHLEN], hash[256];
+    int retval;
+
+    if (config.reply_cache_max_age <= 0 || hostid <= 0) return 0;
+    snprintf(dir, sizeof(dir), "%s/%d",
+        config.project_path(REPLY_CACHE_DIR), hostid % REPLY_CACHE_NDIRS
+    );
+    cache_path(hostid, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    FILE* f = boinc_fopen(tmp_path, "w");
+    if (!f) {
+        boinc_mkdir(config.project_path(REPLY_CACHE_DIR));
+        boinc_mkdir(dir);
+        f = boinc_fopen(tmp_path, "w");
+        if (!f) return ERR_FOPEN;
+    }
+    auth_hash(authenticator, hash);
+    fprintf(f, "%d %s %s\n", rpc_seqno, hash, request_md5);
+    size_t n = fwrite(reply.data(), 1, reply.size(), f);
+    retval = fclose(f);
+    if (n != reply.size() || retval) {
+        unlink(tmp_path);
+        return ERR_FWRITE;
+    }
+    retval = rename(tmp_path, path);
+    if (retval) {
+        unlink(tmp_path);
+        return ERR_RENAME;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A cache of each host's last scheduler reply,
+// so that a retried RPC gets the same reply
+// rather than being handled again.
+// Enabled by <reply_cache_max_age> in config.xml.
+//
+// If a client doesn't get the reply to an RPC
+// (e.g. the connection times out)
+// it sends the request again with the same rpc_seqno.
+// If the first request was handled, its reply is in the cache,
+// and we send that without looking at the DB.
+// The cached reply is sent only if the request is byte-for-byte
+// the same (same MD5) as the one it answered;
+// otherwise the request is handled normally.
+//
+// The reply (gzipped) is in REPLY_CACHE_DIR/(hostid mod 1024)/hostid,
+// after a line with the RPC seqno, the MD5 of the authenticator,
+// and the MD5 of the request.
+// There's one file per host; each reply replaces the last.
+// Files of hosts that stop contacting the project stay;
+// a cron job can remove ones older than reply_cache_max_age.
+
+#ifndef BOINC_SCHED_REPLY_CACHE_H
+#define BOINC_SCHED_REPLY_CACHE_H
+
+#include <string>
+
+#define REPLY_CACHE_DIR     "reply_cache"
+#define REPLY_CACHE_NDIRS   1024
+
+extern int reply_cache_lookup(
+    int hostid, int rpc_seqno, const char* authenticator,
+    const char* request_md5, std::string& reply
+);
+    // if there's an unexpired reply for this host and seqno,
+    // and the authenticator and request MD5 match,
+    // return 0 and the gzipped reply
+
+extern int reply_cache_store(
+    int hostid, int rpc_seqno, const char* authenticator,
+    const char* request_md5, const std::string& reply
+);
+
+#endif
@@ -95,6 +95,31 @@ static int possibly_give_result_new_deadline(
     return 0;
 }
 
+// Get the IDs of results that are in progress on this host
+// according to the DB, but that the host didn't report.
+// Only IDs and names are read,
+// so this is cheap for hosts with many jobs and none lost.
+//
+static int get_lost_result_ids(std::vector<int>& ids) {
+    char query[256];
+    MYSQL_ROW row;
+
+    sprintf(query,
+        "select id, name from result where hostid=%d and server_state=%d",
+        g_reply->host.id, RESULT_SERVER_STATE_IN_PROGRESS
+    );
+    int retval = boinc_db.do_query(query);
+    if (retval) return retval;
+    MYSQL_RES* rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    while ((row = mysql_fetch_row(rp))) {
+        if (g_request->lookup_other_result(row[1])) continue;
+        ids.push_back(atoi(row[0]));
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
 // resend any jobs that:
 // 1) we already sent to this host;
 // 2) are still in progress (i.e. haven't timed out) and
@@ -103,9 +128,8 @@ static int possibly_give_result_new_deadline(
 //
 bool resend_lost_work() {
     SCHED_DB_RESULT result;
-    std::vector<DB_RESULT>results;
+    std::vector<int> lost_ids;
     unsigned int i;
-    char buf[256];
     char warning_msg[256];
     bool did_any = false;
     int num_eligible_to_resend=0;
@@ -114,24 +138,22 @@ bool resend_lost_work() {
     APP* app = NULL;
     int retval;
 
-    sprintf(buf, " where hostid=%d and server_state=%d ",
-        g_reply->host.id, RESULT_SERVER_STATE_IN_PROGRESS
-    );
-    while (!result.enumerate(buf)) {
+    retval = get_lost_result_ids(lost_ids);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[HOST#%d] can't get in-progress results: %s\n",
+            g_reply->host.id, boincerror(retval)
+        );
+        return false;
+    }
+    for (i=0; i<lost_ids.size(); i++) {
         if (!work_needed(false)) {
-            result.end_enumerate();
             break;
         }
 
-        bool found = false;
-        for (i=0; i<g_request->other_results.size(); i++) {
-            OTHER_RESULT& orp = g_request->other_results[i];
-            if (!strcmp(orp.name, result.name)) {
-                found = true;
-                break;
-            }
-        }
-        if (found) continue;
+        retval = result.lookup_id(lost_ids[i]);
+        if (retval) continue;
+        if (result.server_state != RESULT_SERVER_STATE_IN_PROGRESS) continue;
 
         num_eligible_to_resend++;
         if (config.debug_resend) {
@@ -248,7 +270,6 @@ bool resend_lost_work() {
             did_any = true;
 
             if (g_wreq->njobs_sent >= config.max_wus_to_send) {
-                result.end_enumerate();
                 break;
             }
         }
@@ -26,6 +26,7 @@
 #include "sched_util.h"
 #include "sched_main.h"
 #include "sched_config.h"
+#include "sched_timing.h"
 
 #include "sched_result.h"
 
@@ -88,9 +89,63 @@ static inline void got_bad_result(SCHED_RESULT_ITEM& sri) {
     havp->consecutive_valid = 0;
 }
 
+// limit on the size of a multi-row result update;
+// must be less than the MySQL server's max_allowed_packet
+//
+#define RESULT_BATCH_MAX_BYTES  1000000
+
+// Update the results that passed the checks in handle_results()
+// in multi-row UPDATEs of up to config.result_update_batch_size results,
+// and set their WUs' transition times, all in one transaction.
+// Return nonzero (having rolled back) if anything fails.
+//
+static int update_results_batch(DB_SCHED_RESULT_ITEM_SET& result_handler) {
+    std::vector<SCHED_RESULT_ITEM*> batch;
+    size_t nbytes = 0;
+    unsigned int i;
+    int retval;
+
+    retval = boinc_db.start_transaction();
+    if (retval) return retval;
+    for (i=0; i<result_handler.results.size(); i++) {
+        SCHED_RESULT_ITEM& sri = result_handler.results[i];
+        if (sri.id == 0) continue;
+        batch.push_back(&sri);
+
+        // escaping may double the size of the text fields
+        //
+        nbytes += 2*(sri.stderr_out.size() + sri.xml_doc_out.size()) + 512;
+        if ((int)batch.size() >= config.result_update_batch_size
+            || nbytes > RESULT_BATCH_MAX_BYTES
+        ) {
+            retval = result_handler.update_results(batch);
+            if (retval) break;
+            batch.clear();
+            nbytes = 0;
+        }
+    }
+    if (!retval) retval = result_handler.update_results(batch);
+    if (!retval) retval = result_handler.update_workunits();
+    if (retval) {
+        boinc_db.rollback_transaction();
+        return retval;
+    }
+    retval = boinc_db.commit_transaction();
+    if (retval) return retval;
+
+    for (i=0; i<result_handler.results.size(); i++) {
+        SCHED_RESULT_ITEM& sri = result_handler.results[i];
+        if (sri.id == 0) continue;
+        g_reply->result_acks.push_back(std::string(sri.name));
+    }
+    return 0;
+}
+
 // handle completed results
 //
 int handle_results() {
+    SCHED_TIMER timer(SCHED_STAGE_HANDLE_RESULTS);
+
     DB_SCHED_RESULT_ITEM_SET result_handler;
     SCHED_RESULT_ITEM* srip;
     unsigned int i;
@@ -339,16 +394,19 @@ int handle_results() {
 
         srip->exit_status = rp->exit_status;
         srip->app_version_num = rp->app_version_num;
+        state_count_deltas.note(
+            srip->appid, srip->server_state, RESULT_SERVER_STATE_OVER
+        );
         srip->server_state = RESULT_SERVER_STATE_OVER;
 
-        strlcpy(srip->stderr_out, rp->stderr_out, sizeof(srip->stderr_out));
-        strlcpy(srip->xml_doc_out, rp->xml_doc_out, sizeof(srip->xml_doc_out));
+        srip->stderr_out = rp->stderr_out;
+        srip->xml_doc_out = rp->xml_doc_out;
 
         // look for exit status and app version in stderr_out
         // (historical - can be deleted at some point)
         //
-        parse_int(srip->stderr_out, "<exit_status>", srip->exit_status);
-        parse_int(srip->stderr_out, "<app_version>", srip->app_version_num);
+        parse_int(srip->stderr_out.c_str(), "<exit_status>", srip->exit_status);
+        parse_int(srip->stderr_out.c_str(), "<app_version>", srip->app_version_num);
 
         if ((srip->client_state == RESULT_FILES_UPLOADED) && (srip->exit_status == 0)) {
             srip->outcome = RESULT_OUTCOME_SUCCESS;
@@ -361,7 +419,7 @@ int handle_results() {
             got_good_result(*srip);
             
             if (config.dont_store_success_stderr) {
-                strcpy(srip->stderr_out, "");
+                srip->stderr_out.clear();
             }
         } else {
             if (config.debug_handle_results) {
@@ -379,6 +437,15 @@ int handle_results() {
         }
     } // loop over all incoming results
 
+    if (config.result_update_batch_size > 1) {
+        retval = update_results_batch(result_handler);
+        if (!retval) return 0;
+        log_messages.printf(MSG_CRITICAL,
+            "[HOST#%d] batched result update failed (%s); updating one at a time\n",
+            g_reply->host.id, boincerror(retval)
+        );
+    }
+
     // Update the result records
     // (skip items that we previously marked to skip)
     //
@@ -30,8 +30,10 @@
 #include "sched_msgs.h"
 #include "sched_send.h"
 #include "sched_shmem.h"
+#include "sched_timing.h"
 #include "sched_types.h"
 #include "sched_version.h"
+#include "sched_array.h"
 
 #include "sched_score.h"
 
@@ -47,9 +49,10 @@ static int get_size_class(APP& app, double es) {
 // Assign a score to this job,
 // representing the value of sending the job to this host.
 // Also do some initial screening,
-// and return false if can't send the job to host
+// and return false if can't send the job to host.
+// wu is a copy of the slot's workunit, without its XML
 //
-bool JOB::get_score(WU_RESULT& wu_result) {
+bool JOB::get_score(WU_RESULT& wu_result, WORKUNIT& wu) {
     score = 0;
 
     if (!app->beta && wu_result.need_reliable) {
@@ -66,7 +69,7 @@ bool JOB::get_score(WU_RESULT& wu_result) {
         }
     }
 
-    if (app_not_selected(wu_result.workunit)) {
+    if (app_not_selected(wu)) {
         if (g_wreq->allow_non_preferred_apps) {
             score -= 1;
         } else {
@@ -81,11 +84,12 @@ bool JOB::get_score(WU_RESULT& wu_result) {
     if (app->locality_scheduling == LOCALITY_SCHED_LITE
         && g_request->file_infos.size()
     ) {
-        int n = nfiles_on_host(wu_result.workunit);
+        ssp->get_wu_xml_doc(wu_result, wu.xml_doc);
+        int n = nfiles_on_host(wu);
         if (config.debug_locality_lite) {
             log_messages.printf(MSG_NORMAL,
                 "[loc_lite] job %s has %d files on this host\n",
-                wu_result.workunit.name, n
+                wu.name, n
             );
         }
         if (n > 0) {
@@ -99,12 +103,12 @@ bool JOB::get_score(WU_RESULT& wu_result) {
         if (config.debug_send) {
             log_messages.printf(MSG_NORMAL,
                 "[send] size: host %d job %d speed %f\n",
-                target_size, wu_result.workunit.size_class, effective_speed
+                target_size, wu.size_class, effective_speed
             );
         }
-        if (target_size == wu_result.workunit.size_class) {
+        if (target_size == wu.size_class) {
             score += 5;
-        } else if (target_size < wu_result.workunit.size_class) {
+        } else if (target_size < wu.size_class) {
             score -= 2;
         } else {
             score -= 1;
@@ -119,8 +123,47 @@ bool JOB::get_score(WU_RESULT& wu_result) {
     return true;
 }
 
-bool job_compare(JOB j1, JOB j2) {
-    return (j1.score > j2.score);
+// for a heap with the highest score on top
+//
+bool job_compare(const JOB& j1, const JOB& j2) {
+    return (j1.score < j2.score);
+}
+
+// get_app_version() gives the same answer for jobs of an app
+// with the same memory bound,
+// unless the app uses homogeneous app version
+// and the job is committed to a version.
+// Remember its answers for the duration of a scan.
+//
+struct APP_VERSION_MEMO {
+    int appid;
+    double rsc_memory_bound;
+    APP* app;
+    BEST_APP_VERSION* bavp;
+};
+
+static BEST_APP_VERSION* memo_app_version(
+    vector<APP_VERSION_MEMO>& memo, WORKUNIT& wu, APP*& app
+) {
+    for (unsigned int i=0; i<memo.size(); i++) {
+        APP_VERSION_MEMO& m = memo[i];
+        if (m.appid == wu.appid && m.rsc_memory_bound == wu.rsc_memory_bound) {
+            app = m.app;
+            return m.bavp;
+        }
+    }
+    app = ssp->lookup_app(wu.appid);
+    if (!app || app->non_cpu_intensive) return NULL;
+    if (app->homogeneous_app_version && wu.app_version_id) {
+        return get_app_version(wu, true, false);
+    }
+    APP_VERSION_MEMO m;
+    m.appid = wu.appid;
+    m.rsc_memory_bound = wu.rsc_memory_bound;
+    m.app = app;
+    m.bavp = get_app_version(wu, true, false);
+    memo.push_back(m);
+    return m.bavp;
 }
 
 static double req_sec_save[NPROC_TYPES];
@@ -148,6 +191,8 @@ static void restore_others(int rt) {
 //
 void send_work_score_type(int rt) {
     vector<JOB> jobs;
+    vector<APP_VERSION_MEMO> memo;
+    WORKUNIT wu;
 
     if (config.debug_send) {
         log_messages.printf(MSG_NORMAL,
@@ -157,57 +202,64 @@ void send_work_score_type(int rt) {
 
     clear_others(rt);
 
+    vector<int> slots;
+    get_scan_order(slots, false);
     int nscan = config.mm_max_slots;
-    if (!nscan) nscan = ssp->max_wu_results;
-    int rnd_off = rand() % ssp->max_wu_results;
+    if (!nscan || nscan > (int)slots.size()) nscan = (int)slots.size();
     for (int j=0; j<nscan; j++) {
-        int i = (j+rnd_off) % ssp->max_wu_results;
+        int i = slots[j];
         WU_RESULT& wu_result = ssp->wu_results[i];
         if (wu_result.state != WR_STATE_PRESENT) {
             continue;
         }
-        WORKUNIT wu = wu_result.workunit;
         JOB job;
-        job.app = ssp->lookup_app(wu.appid);
-        if (job.app->non_cpu_intensive) continue;
-        job.bavp = get_app_version(wu, true, false);
+        job.gen = wu_result.read_gen();
+
+        // Copy the workunit fields but not its XML.
+        // If the feeder changes the slot while we look at it,
+        // claim() will fail below.
+        //
+        wu_result.workunit.get(wu);
+        job.bavp = memo_app_version(memo, wu, job.app);
         if (!job.bavp) continue;
 
         job.index = i;
         job.result_id = wu_result.resultid;
-        if (!job.get_score(wu_result)) {
+        if (!job.get_score(wu_result, wu)) {
             continue;
         }
         jobs.push_back(job);
     }
 
-    std::sort(jobs.begin(), jobs.end(), job_compare);
+    // we usually send only a few of the jobs,
+    // so rather than sorting them, make a heap and pop as needed
+    //
+    std::make_heap(jobs.begin(), jobs.end(), job_compare);
 
-    bool sema_locked = false;
-    for (unsigned int i=0; i<jobs.size(); i++) {
+    while (!jobs.empty()) {
         if (!work_needed(false)) {
             break;
         }
         if (!g_wreq->need_proc_type(rt)) {
             break;
         }
-        JOB& job = jobs[i];
-        if (!sema_locked) {
-            lock_sema();
-            sema_locked = true;
-        }
+        std::pop_heap(jobs.begin(), jobs.end(), job_compare);
+        JOB job = jobs.back();
+        jobs.pop_back();
 
-        // make sure the job is still in the cache
-        // array is locked at this point.
+        // make sure the job is still in the cache, and reserve it.
+        // This fails if another scheduler took it,
+        // or if the feeder put a different job in the slot.
         //
         WU_RESULT& wu_result = ssp->wu_results[job.index];
-        if (wu_result.state != WR_STATE_PRESENT) {
+        if (!wu_result.claim(g_pid, job.gen)) {
             continue;
         }
         if (wu_result.resultid != job.result_id) {
+            wu_result.release(g_pid);
             continue;
         }
-        WORKUNIT wu = wu_result.workunit;
+        wu_result.workunit.get(wu);
         int retval = wu_is_infeasible_fast(
             wu,
             wu_result.res_server_state, wu_result.res_priority,
@@ -217,21 +269,18 @@ void send_work_score_type(int rt) {
         );
 
         if (retval) {
+            wu_result.release(g_pid);
             continue;
         }
-        wu_result.state = g_pid;
-
-        // It passed fast checks.
-        // Release sema and to slow checks
-        unlock_sema();
-        sema_locked = false;
 
+        // It passed fast checks; do slow checks
+        //
         switch (slow_check(wu_result, job.app, job.bavp)) {
         case 1:
-            wu_result.state = WR_STATE_PRESENT;
+            wu_result.release(g_pid);
             break;
         case 2:
-            wu_result.state = WR_STATE_EMPTY;
+            ssp->clear_slot(wu_result, g_pid);
             break;
         default:
             // slow_check() refreshes fields of wu_result.workunit;
@@ -239,18 +288,19 @@ void send_work_score_type(int rt) {
             //
             wu.hr_class = wu_result.workunit.hr_class;
             wu.app_version_id = wu_result.workunit.app_version_id;
+            ssp->get_wu_xml_doc(wu_result, wu.xml_doc);
+            SCHED_DB_RESULT result;
+            result.id = wu_result.resultid;
 
             // mark slot as empty AFTER we've copied out of it
             // (since otherwise feeder might overwrite it)
             //
-            wu_result.state = WR_STATE_EMPTY;
+            ssp->clear_slot(wu_result, g_pid);
 
             // reread result from DB, make sure it's still unsent
             // TODO: from here to end of add_result_to_reply()
             // (which updates the DB record) should be a transaction
             //
-            SCHED_DB_RESULT result;
-            result.id = wu_result.resultid;
             if (result_still_sendable(result, wu)) {
                 add_result_to_reply(result, wu, job.bavp, false);
 
@@ -264,15 +314,14 @@ void send_work_score_type(int rt) {
             break;
         }
     }
-    if (sema_locked) {
-        unlock_sema();
-    }
 
     restore_others(rt);
     g_wreq->best_app_versions.clear();
 }
 
 void send_work_score() {
+    SCHED_TIMER timer(SCHED_STAGE_SEND_WORK_SCORE);
+
     for (int i=0; i<NPROC_TYPES; i++) {
         if (g_wreq->need_proc_type(i)) {
             send_work_score_type(i);
@@ -367,9 +416,9 @@ bool wu_is_infeasible_slow(
     }
 
     APP* app = ssp->lookup_app(wu_result.workunit.appid);
-    WORKUNIT wu = wu_result.workunit;
+    SHMEM_WORKUNIT& wu = wu_result.workunit;
     if (app_hr_type(*app)) {
-        if (already_sent_to_different_hr_class(wu, *app)) {
+        if (already_sent_to_different_hr_class(wu.hr_class, *app)) {
             if (config.debug_send) {
                 log_messages.printf(MSG_NORMAL,
                     "[send] [HOST#%d] [WU#%u %s] WU is infeasible (assigned to different platform)\n",
@@ -469,10 +518,12 @@ void JOB_SET::send() {
     std::list<JOB>::iterator i = jobs.begin();
     while (i != jobs.end()) {
         JOB& job = *(i++);
-        WU_RESULT wu_result = ssp->wu_results[job.index];
-        ssp->wu_results[job.index].state = WR_STATE_EMPTY;
-        wu = wu_result.workunit;
+        WU_RESULT& wu_result = ssp->wu_results[job.index];
+        ssp->get_workunit(wu_result, wu);
         result.id = wu_result.resultid;
+        wu_result.time_emptied = dtime();
+        wu_result.state = WR_STATE_EMPTY;
+        __sync_fetch_and_add(&ssp->nslots_emptied, 1);
         retval = read_sendable_result(result);
         if (!retval) {
             add_result_to_reply(result, wu, job.bavp, false);
@@ -481,6 +532,8 @@ void JOB_SET::send() {
 }
 
 void send_work_score() {
+    SCHED_TIMER timer(SCHED_STAGE_SEND_WORK_SCORE);
+
     int i, slots_locked=0, slots_nonempty=0;
     JOB_SET jobs;
     int min_slots = config.mm_min_slots;
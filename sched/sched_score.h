@@ -20,12 +20,13 @@
 #ifdef NEW_SCORE
 struct JOB {
     int index;
+    int gen;            // WU_RESULT.gen when we scanned the slot
     int result_id;
     double score;
     APP* app;
     BEST_APP_VERSION* bavp;
 
-    bool get_score(WU_RESULT&);
+    bool get_score(WU_RESULT&, WORKUNIT&);
 };
 
 #else
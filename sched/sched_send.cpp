@@ -38,6 +38,7 @@
 
 #include "credit.h"
 #include "hr.h"
+#include "hr_info.h"
 #include "sched_array.h"
 #include "sched_assign.h"
 #include "sched_config.h"
@@ -47,6 +48,7 @@
 #include "sched_main.h"
 #include "sched_msgs.h"
 #include "sched_shmem.h"
+#include "sched_timing.h"
 #include "sched_score.h"
 #include "sched_timezone.h"
 #include "sched_types.h"
@@ -65,16 +67,6 @@ const double DEFAULT_RAM_SIZE = 64000000;
 
 int preferred_app_message_index=0;
 
-static inline bool file_present_on_host(const char* name) {
-    for (unsigned i=0; i<g_request->file_infos.size(); i++) {
-        FILE_INFO& fi = g_request->file_infos[i];
-        if (!strstr(name, fi.name)) {
-            return true;
-        }
-    }
-    return false;
-}
-
 // return the number of sticky files present on host, used by job
 //
 int nfiles_on_host(WORKUNIT& wu) {
@@ -88,7 +80,7 @@ int nfiles_on_host(WORKUNIT& wu) {
             int retval = fi.parse(xp);
             if (retval) continue;
             if (!fi.sticky) continue;
-            if (file_present_on_host(fi.name)) {
+            if (g_request->has_file(fi.name)) {
                 n++;
             }
         }
@@ -110,7 +102,7 @@ void add_job_files_to_host(WORKUNIT& wu) {
             int retval = fi.parse(xp);
             if (retval) continue;
             if (!fi.sticky) continue;
-            if (!file_present_on_host(fi.name)) {
+            if (!g_request->has_file(fi.name)) {
                 if (config.debug_send) {
                     log_messages.printf(MSG_NORMAL,
                         "[send] Adding file %s to host file list\n", fi.name
@@ -454,15 +446,12 @@ double estimate_duration(WORKUNIT& wu, BEST_APP_VERSION& bav) {
 // TODO: use XML_PARSER
 //
 static void get_prefs_info() {
-    char buf[8096];
-    std::string str;
+    const char* buf = g_reply->venue_project_prefs();
+    std::string str = buf;
     unsigned int pos = 0;
     int temp_int=0;
     bool flag;
 
-    extract_venue(g_reply->user.project_prefs, g_reply->host.venue, buf, sizeof(buf));
-    str = buf;
-
     // scan user's project prefs for elements of the form <app_id>N</app_id>,
     // indicating the apps they want to run.
     //
@@ -520,17 +509,19 @@ static inline void update_estimated_delay(BEST_APP_VERSION& bav, double dt) {
     }
 }
 
-// insert "text" right after "after" in the given buffer
+// insert "text" right after "after" in the given buffer.
+// The tail of the buffer is moved in place (no temp copy).
 //
 static int insert_after(char* buffer, const char* after, const char* text) {
     char* p;
-    char temp[BLOB_SIZE];
+    size_t buf_len = strlen(buffer);
+    size_t text_len = strlen(text);
 
-    if (strlen(buffer) + strlen(text) >= BLOB_SIZE-1) {
+    if (buf_len + text_len >= BLOB_SIZE-1) {
         log_messages.printf(MSG_CRITICAL,
             "insert_after: overflow: %d %d\n",
-            (int)strlen(buffer),
-            (int)strlen(text)
+            (int)buf_len,
+            (int)text_len
         );
         return ERR_BUFFER_OVERFLOW;
     }
@@ -542,9 +533,8 @@ static int insert_after(char* buffer, const char* after, const char* text) {
         return ERR_XML_PARSE;
     }
     p += strlen(after);
-    strcpy(temp, p);
-    strcpy(p, text);
-    strcat(p, temp);
+    memmove(p + text_len, p, buffer + buf_len + 1 - p);
+    memcpy(p, text, text_len);
     return 0;
 }
 
@@ -604,6 +594,13 @@ static int add_wu_to_reply(
         }
     }
 
+    // if the WU is already in the reply (another instance of it
+    // is being sent) we're done; don't copy and edit its XML again
+    //
+    for (unsigned int i=0; i<g_reply->wus.size(); i++) {
+        if (g_reply->wus[i].id == wu.id) return 0;
+    }
+
     // modify the WU's xml_doc; add <name>, <rsc_*> etc.
     //
     wu2 = wu;       // make copy since we're going to modify its XML field
@@ -621,39 +618,32 @@ static int add_wu_to_reply(
         );
         return retval;
     }
-    wu3 = wu2;
     if (strlen(config.replace_download_url_by_timezone)) {
+        wu3 = wu2;
         process_wu_timezone(wu2, wu3);
+        g_reply->insert_workunit_unique(wu3);
+    } else {
+        g_reply->insert_workunit_unique(wu2);
     }
 
-    g_reply->insert_workunit_unique(wu3);
-
     // switch to tighter policy for estimating delay
     //
     return 0;
 }
 
-// add <name> tags to result's xml_doc_in
+// add <name>, <wu_name> and <report_deadline> tags to result's xml_doc_in.
+// Do it with one insertion, since each moves the rest of the doc
 //
-static int insert_name_tags(RESULT& result, WORKUNIT const& wu) {
-    char buf[256];
-    int retval;
-
-    sprintf(buf, "<name>%s</name>\n", result.name);
-    retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    sprintf(buf, "<wu_name>%s</wu_name>\n", wu.name);
-    retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    return 0;
-}
+static int insert_result_tags(RESULT& result, WORKUNIT const& wu) {
+    char buf[512];
 
-static int insert_deadline_tag(RESULT& result) {
-    char buf[256];
-    sprintf(buf, "<report_deadline>%d</report_deadline>\n", result.report_deadline);
-    int retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    return 0;
+    sprintf(buf,
+        "<report_deadline>%d</report_deadline>\n"
+        "<wu_name>%s</wu_name>\n"
+        "<name>%s</name>\n",
+        result.report_deadline, wu.name, result.name
+    );
+    return insert_after(result.xml_doc_in, "<result>\n", buf);
 }
 
 // update workunit fields when send an instance of it:
@@ -960,18 +950,10 @@ int add_result_to_reply(
     // The following overwrites the result's xml_doc field.
     // But that's OK cuz we're done with DB updates
     //
-    retval = insert_name_tags(result, wu);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "add_result_to_reply: can't insert name tags: %d\n",
-            retval
-        );
-        return retval;
-    }
-    retval = insert_deadline_tag(result);
+    retval = insert_result_tags(result, wu);
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
-            "add_result_to_reply: can't insert deadline tag: %s\n", boincerror(retval)
+            "add_result_to_reply: can't insert name tags: %s\n", boincerror(retval)
         );
         return retval;
     }
@@ -1001,9 +983,11 @@ int add_result_to_reply(
 
     // add this result to workload for simulation
     //
+    // (deadlines are relative to now, as in check_candidate())
+    //
     if (config.workload_sim && g_request->have_other_results_list) {
-        IP_RESULT ipr ("", time(0)+wu.delay_bound, est_dur);
-        g_request->ip_results.push_back(ipr);
+        IP_RESULT ipr(wu.name, wu.delay_bound, est_dur);
+        g_request->edf_model.add(ipr);
     }
 
     // mark job as done if debugging flag is set;
@@ -1399,7 +1383,10 @@ void send_work_setup() {
         }
     }
 
-    for (i=0; i<g_request->other_results.size(); i++) {
+    // count jobs in progress against the limits, if there are any
+    //
+    bool count_in_progress = config.max_jobs_in_progress.any_limit();
+    for (i=0; count_in_progress && i<g_request->other_results.size(); i++) {
         OTHER_RESULT& r = g_request->other_results[i];
         APP* app = NULL;
         bool uses_gpu = false;
@@ -1506,12 +1493,12 @@ void send_work_setup() {
     }
 }
 
-// If a record is not in DB, create it.
+// If a record is not in DB, add it to g_wreq->host_app_versions;
+// write_host_app_versions() will create it.
 //
 int update_host_app_versions(vector<SCHED_DB_RESULT>& results, int hostid) {
     vector<DB_HOST_APP_VERSION> new_havs;
     unsigned int i, j;
-    int retval;
 
     for (i=0; i<results.size(); i++) {
         RESULT& r = results[i];
@@ -1537,33 +1524,30 @@ int update_host_app_versions(vector<SCHED_DB_RESULT>& results, int hostid) {
         }
     }
 
-    // create new records
-    //
     for (i=0; i<new_havs.size(); i++) {
         DB_HOST_APP_VERSION& hav = new_havs[i];
-
-        retval = hav.insert();
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "hav.insert(): %s\n", boincerror(retval)
+        g_wreq->host_app_versions.push_back(hav);
+        if (config.debug_credit) {
+            log_messages.printf(MSG_NORMAL,
+                "[credit] creating host_app_version record (%d, %d)\n",
+                hav.host_id, hav.app_version_id
             );
-        } else {
-            if (config.debug_credit) {
-                log_messages.printf(MSG_NORMAL,
-                    "[credit] created host_app_version record (%d, %d)\n",
-                    hav.host_id, hav.app_version_id
-                );
-            }
         }
     }
     return 0;
 }
 
 void send_work() {
+    SCHED_TIMER timer(SCHED_STAGE_SEND_WORK);
+
     int retval;
 
     g_wreq->no_jobs_available = true;
 
+    if (config.hr_allocate_slots && config.hr_demand_shmem_key) {
+        hr_demand_count(g_request->host);
+    }
+
     if (all_apps_use_hr && hr_unknown_platform(g_request->host)) {
         log_messages.printf(MSG_NORMAL,
             "Not sending work because unknown HR class\n"
@@ -1599,6 +1583,9 @@ void send_work() {
             g_request->global_prefs.work_buf_min(),
             g_wreq->effective_ncpus, g_request->ip_results
         );
+        g_request->edf_model.init(
+            g_wreq->effective_ncpus, g_request->ip_results
+        );
     }
 
     // send non-CPU-intensive jobs if needed
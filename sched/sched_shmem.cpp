@@ -23,15 +23,20 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <sys/param.h>
+#include <sys/stat.h>
 
 using std::vector;
 
 #include "boinc_db.h"
 #include "error_numbers.h"
 #include "filesys.h"
+#include "shmem.h"
+#include "str_replace.h"
 
 #ifdef _USING_FCGI_
 #include "boinc_fcgi.h"
@@ -45,10 +50,26 @@ using std::vector;
 #include "sched_shmem.h"
 
 
+// the number of XML heap chunks for the given number of slots.
+// Make sure that a maximal xml_doc fits
+//
+static int wu_xml_nchunks_for(int nwu_results) {
+    double avg = config.shmem_wu_xml_size?config.shmem_wu_xml_size:WU_XML_AVG_SIZE;
+    int n = (int)ceil(nwu_results*avg/WU_XML_CHUNK_SIZE);
+    return std::max(n, 2*BLOB_SIZE/WU_XML_CHUNK_SIZE);
+}
+
+int SCHED_SHMEM::size(int nwu_results) {
+    return sizeof(SCHED_SHMEM)
+        + nwu_results*sizeof(WU_RESULT)
+        + wu_xml_nchunks_for(nwu_results)*(WU_XML_CHUNK_SIZE+1);
+}
+
 void SCHED_SHMEM::init(int nwu_results) {
-    int size = sizeof(SCHED_SHMEM) + nwu_results*sizeof(WU_RESULT);
+    int size = SCHED_SHMEM::size(nwu_results);
     memset(this, 0, size);
     ss_size = size;
+    wu_xml_nchunks = wu_xml_nchunks_for(nwu_results);
     platform_size = sizeof(PLATFORM);
     app_size = sizeof(APP);
     app_version_size = sizeof(APP_VERSION);
@@ -67,7 +88,9 @@ static int error_return(const char* p) {
 }
 
 int SCHED_SHMEM::verify() {
-    int size = sizeof(SCHED_SHMEM) + max_wu_results*sizeof(WU_RESULT);
+    int size = sizeof(SCHED_SHMEM)
+        + max_wu_results*sizeof(WU_RESULT)
+        + wu_xml_nchunks*(WU_XML_CHUNK_SIZE+1);
     if (ss_size != size) return error_return("shmem");
     if (platform_size != sizeof(PLATFORM)) return error_return("platform");
     if (app_size != sizeof(APP)) return error_return("app");
@@ -92,6 +115,26 @@ static void overflow(const char* table, const char* param_name) {
     exit(1);
 }
 
+static bool assignment_less(const ASSIGNMENT& a1, const ASSIGNMENT& a2) {
+    if (a1.target_type != a2.target_type) {
+        return a1.target_type < a2.target_type;
+    }
+    return a1.target_id < a2.target_id;
+}
+
+// the processor type an app version uses, judging from its plan class
+//
+static int app_version_proc_type(APP_VERSION& av) {
+    if (strstr(av.plan_class, "cuda") || strstr(av.plan_class, "nvidia")) {
+        return PROC_TYPE_NVIDIA_GPU;
+    } else if (strstr(av.plan_class, "ati")) {
+        return PROC_TYPE_AMD_GPU;
+    } else if (strstr(av.plan_class, "intel_gpu")) {
+        return PROC_TYPE_INTEL_GPU;
+    }
+    return PROC_TYPE_CPU;
+}
+
 int SCHED_SHMEM::scan_tables() {
     DB_PLATFORM platform;
     DB_APP app;
@@ -211,30 +254,41 @@ int SCHED_SHMEM::scan_tables() {
         have_apps_for_proc_type[i] = false;
     }
     for (i=0; i<napp_versions; i++) {
-        APP_VERSION& av = app_versions[i];
-        if (strstr(av.plan_class, "cuda") || strstr(av.plan_class, "nvidia")) {
-            have_apps_for_proc_type[PROC_TYPE_NVIDIA_GPU] = true;
-        } else if (strstr(av.plan_class, "ati")) {
-            have_apps_for_proc_type[PROC_TYPE_AMD_GPU] = true;
-        } else if (strstr(av.plan_class, "intel_gpu")) {
-            have_apps_for_proc_type[PROC_TYPE_INTEL_GPU] = true;
-        } else {
-            have_apps_for_proc_type[PROC_TYPE_CPU] = true;
-        }
+        have_apps_for_proc_type[app_version_proc_type(app_versions[i])] = true;
     }
 
     n = 0;
     while (!assignment.enumerate("where multi <> 0")) {
+        if (assignment.target_type == ASSIGN_NONE) {
+            assignment.target_id = 0;
+        }
         assignments[n++] = assignment;
         if (n == MAX_ASSIGNMENTS) {
             overflow("assignments", "MAX_ASSIGNMENTS");
         }
     }
     nassignments = n;
+    std::sort(assignments, assignments+n, assignment_less);
 
     return 0;
 }
 
+// find the multi assignments for the given target:
+// assignments[first] .. assignments[first+n-1]
+//
+void SCHED_SHMEM::lookup_assignments(
+    int target_type, int target_id, int& first, int& n
+) {
+    ASSIGNMENT key;
+    key.target_type = target_type;
+    key.target_id = target_id;
+    std::pair<ASSIGNMENT*, ASSIGNMENT*> r = std::equal_range(
+        assignments, assignments+nassignments, key, assignment_less
+    );
+    first = (int)(r.first - assignments);
+    n = (int)(r.second - r.first);
+}
+
 PLATFORM* SCHED_SHMEM::lookup_platform(char* name) {
     for (int i=0; i<nplatforms; i++) {
         if (!strcmp(platforms[i].name, name)) {
@@ -289,6 +343,139 @@ APP_VERSION* SCHED_SHMEM::lookup_app_version_platform_plan_class(
     return NULL;
 }
 
+void SHMEM_WORKUNIT::set(WORKUNIT& wu) {
+    id = wu.id;
+    create_time = wu.create_time;
+    appid = wu.appid;
+    safe_strcpy(name, wu.name);
+    batch = wu.batch;
+    rsc_fpops_est = wu.rsc_fpops_est;
+    rsc_fpops_bound = wu.rsc_fpops_bound;
+    rsc_memory_bound = wu.rsc_memory_bound;
+    rsc_disk_bound = wu.rsc_disk_bound;
+    need_validate = wu.need_validate;
+    canonical_resultid = wu.canonical_resultid;
+    canonical_credit = wu.canonical_credit;
+    transition_time = wu.transition_time;
+    delay_bound = wu.delay_bound;
+    error_mask = wu.error_mask;
+    file_delete_state = wu.file_delete_state;
+    assimilate_state = wu.assimilate_state;
+    hr_class = wu.hr_class;
+    opaque = wu.opaque;
+    min_quorum = wu.min_quorum;
+    target_nresults = wu.target_nresults;
+    max_error_results = wu.max_error_results;
+    max_total_results = wu.max_total_results;
+    max_success_results = wu.max_success_results;
+    safe_strcpy(result_template_file, wu.result_template_file);
+    priority = wu.priority;
+    safe_strcpy(mod_time, wu.mod_time);
+    rsc_bandwidth_bound = wu.rsc_bandwidth_bound;
+    fileset_id = wu.fileset_id;
+    app_version_id = wu.app_version_id;
+    transitioner_flags = wu.transitioner_flags;
+    size_class = wu.size_class;
+}
+
+void SHMEM_WORKUNIT::get(WORKUNIT& wu) {
+    wu.id = id;
+    wu.create_time = create_time;
+    wu.appid = appid;
+    safe_strcpy(wu.name, name);
+    wu.batch = batch;
+    wu.rsc_fpops_est = rsc_fpops_est;
+    wu.rsc_fpops_bound = rsc_fpops_bound;
+    wu.rsc_memory_bound = rsc_memory_bound;
+    wu.rsc_disk_bound = rsc_disk_bound;
+    wu.need_validate = need_validate;
+    wu.canonical_resultid = canonical_resultid;
+    wu.canonical_credit = canonical_credit;
+    wu.transition_time = transition_time;
+    wu.delay_bound = delay_bound;
+    wu.error_mask = error_mask;
+    wu.file_delete_state = file_delete_state;
+    wu.assimilate_state = assimilate_state;
+    wu.hr_class = hr_class;
+    wu.opaque = opaque;
+    wu.min_quorum = min_quorum;
+    wu.target_nresults = target_nresults;
+    wu.max_error_results = max_error_results;
+    wu.max_total_results = max_total_results;
+    wu.max_success_results = max_success_results;
+    safe_strcpy(wu.result_template_file, result_template_file);
+    wu.priority = priority;
+    safe_strcpy(wu.mod_time, mod_time);
+    wu.rsc_bandwidth_bound = rsc_bandwidth_bound;
+    wu.fileset_id = fileset_id;
+    wu.app_version_id = app_version_id;
+    wu.transitioner_flags = transitioner_flags;
+    wu.size_class = size_class;
+}
+
+// find n free chunks in a row, starting at the rover
+// and wrapping around once; return the first, or -1
+//
+static int alloc_chunks(SCHED_SHMEM* ssp, int n) {
+    unsigned char* map = ssp->wu_xml_map();
+    int i = ssp->wu_xml_rover, first = 0, run = 0;
+    for (int k=0; k<ssp->wu_xml_nchunks+n; k++, i++) {
+        if (i >= ssp->wu_xml_nchunks) {
+            i = 0;
+            run = 0;
+        }
+        if (map[i]) {
+            run = 0;
+            continue;
+        }
+        if (run == 0) first = i;
+        if (++run == n) {
+            memset(map+first, 1, n);
+            ssp->wu_xml_rover = first + n;
+            ssp->wu_xml_nchunks_used += n;
+            return first;
+        }
+    }
+    return -1;
+}
+
+void SCHED_SHMEM::free_wu_xml(WU_RESULT& wr) {
+    if (!wr.xml_nchunks) return;
+    memset(wu_xml_map()+wr.xml_chunk, 0, wr.xml_nchunks);
+    wu_xml_nchunks_used -= wr.xml_nchunks;
+    wr.xml_nchunks = 0;
+}
+
+int SCHED_SHMEM::set_workunit(WU_RESULT& wr, WORKUNIT& wu) {
+    int len = (int)strlen(wu.xml_doc);
+    int n = len/WU_XML_CHUNK_SIZE + 1;
+
+    free_wu_xml(wr);
+    int chunk = alloc_chunks(this, n);
+    if (chunk < 0) return ERR_BUFFER_OVERFLOW;
+    memcpy(wu_xml_heap() + chunk*WU_XML_CHUNK_SIZE, wu.xml_doc, len+1);
+    wr.xml_chunk = chunk;
+    wr.xml_nchunks = n;
+    wr.workunit.set(wu);
+    return 0;
+}
+
+void SCHED_SHMEM::get_wu_xml_doc(WU_RESULT& wr, char* buf) {
+    int chunk = wr.xml_chunk;
+    int n = wr.xml_nchunks;
+
+    // if the slot is being refilled these may be inconsistent;
+    // don't read outside the heap
+    //
+    if (n <= 0 || chunk < 0 || chunk + n > wu_xml_nchunks) {
+        buf[0] = 0;
+        return;
+    }
+    int len = std::min(n*WU_XML_CHUNK_SIZE, BLOB_SIZE);
+    memcpy(buf, wu_xml_heap() + chunk*WU_XML_CHUNK_SIZE, len);
+    buf[len-1] = 0;
+}
+
 // see if there's any work.
 // If there is, reserve it for this process
 // (if we don't do this, there's a race condition where lots
@@ -297,18 +484,43 @@ APP_VERSION* SCHED_SHMEM::lookup_app_version_platform_plan_class(
 bool SCHED_SHMEM::no_work(int pid) {
     if (!ready) return true;
     for (int i=0; i<max_wu_results; i++) {
-        if (wu_results[i].state == WR_STATE_PRESENT) {
-            wu_results[i].state = pid;
+        if (wu_results[i].claim(pid)) {
             return false;
         }
     }
     return true;
 }
 
+// Compute work_for_platform from the apps of the jobs in the array.
+// Reserved slots count, since they may be released.
+//
+void SCHED_SHMEM::update_work_for_platform() {
+    bool app_has_work[MAX_APPS];
+    bool x[MAX_PLATFORMS][NPROC_TYPES];
+    int i;
+
+    memset(app_has_work, 0, sizeof(app_has_work));
+    memset(x, 0, sizeof(x));
+    for (i=0; i<max_wu_results; i++) {
+        if (wu_results[i].state == WR_STATE_EMPTY) continue;
+        APP* app = lookup_app(wu_results[i].workunit.appid);
+        if (app) app_has_work[app - apps] = true;
+    }
+    for (i=0; i<napp_versions; i++) {
+        APP_VERSION& av = app_versions[i];
+        APP* app = lookup_app(av.appid);
+        if (!app || !app_has_work[app - apps]) continue;
+        PLATFORM* p = lookup_platform_id(av.platformid);
+        if (!p) continue;
+        x[p - platforms][app_version_proc_type(av)] = true;
+    }
+    memcpy(work_for_platform, x, sizeof(x));
+}
+
 void SCHED_SHMEM::restore_work(int pid) {
     for (int i=0; i<max_wu_results; i++) {
         if (wu_results[i].state == pid) {
-            wu_results[i].state = WR_STATE_PRESENT;
+            wu_results[i].release(pid);
             return;
         }
     }
@@ -337,6 +549,14 @@ void SCHED_SHMEM::show(FILE* f) {
             have_apps_for_proc_type[i]?"yes":"no"
         );
     }
+    if (per_app_arrays) {
+        fprintf(f, "per-app job arrays:\n");
+        for (int i=0; i<napps; i++) {
+            fprintf(f, "%s: %d slots starting at %d\n",
+                apps[i].name, app_nslots[i], app_slot_start[i]
+            );
+        }
+    }
     fprintf(f,
         "Jobs; key:\n"
         "ap: app ID\n"
@@ -356,6 +576,16 @@ void SCHED_SHMEM::show(FILE* f) {
     );
     fprintf(f, "ready: %d\n", ready);
     fprintf(f, "max_wu_results: %d\n", max_wu_results);
+    fprintf(f, "workunit XML heap: %d of %d KB used\n",
+        wu_xml_nchunks_used*WU_XML_CHUNK_SIZE/1024,
+        wu_xml_nchunks*WU_XML_CHUNK_SIZE/1024
+    );
+    fprintf(f,
+        "slots emptied: %u refilled: %d refill latency avg %.2f max %.2f sec; empty slot time %.0f sec\n",
+        nslots_emptied, nrefills,
+        nrefills?refill_latency_sum/nrefills:0, refill_latency_max,
+        empty_slot_time
+    );
     for (int i=0; i<max_wu_results; i++) {
         if (i%24 == 0) {
             fprintf(f,
@@ -406,4 +636,95 @@ void SCHED_SHMEM::show(FILE* f) {
     }
 }
 
+static int mapped_size = 0;
+    // if the array is in a file, the size of our mapping
+
+static const char* shmem_file_path() {
+    if (config.shmem_file[0] == '/') return config.shmem_file;
+    return config.project_path("%s", config.shmem_file);
+}
+
+// huge pages are allocated whole
+//
+static int round_to_huge_page(int size) {
+    char buf[256];
+    int kb = 2048;
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (f) {
+        while (fgets(buf, sizeof(buf), f)) {
+            if (sscanf(buf, "Hugepagesize: %d", &kb) == 1) break;
+        }
+        fclose(f);
+    }
+    int n = kb*1024;
+    return ((size + n - 1)/n)*n;
+}
+
+int create_sched_shmem(int size, bool keep, void** pp, bool& kept) {
+    struct stat sbuf;
+    int retval;
+
+    kept = false;
+    if (config.shmem_huge_pages) {
+        size = round_to_huge_page(size);
+    }
+    if (strlen(config.shmem_file)) {
+        const char* path = shmem_file_path();
+        if (!stat(path, &sbuf)) {
+            if (keep && sbuf.st_size == size) {
+                retval = attach_shmem_mmap(path, pp);
+                if (!retval) {
+                    mapped_size = size;
+                    kept = true;
+                    return 0;
+                }
+            }
+            unlink(path);
+        }
+        retval = create_shmem_mmap(path, size, pp);
+        if (retval) return retval;
+        mapped_size = size;
+        return 0;
+    }
+    retval = destroy_shmem(config.shmem_key);
+    if (retval) return retval;
+    if (config.shmem_huge_pages) {
+        retval = create_shmem_huge(config.shmem_key, size, 0, pp);
+        if (!retval) return 0;
+        log_messages.printf(MSG_CRITICAL,
+            "can't create shmem with huge pages; using normal pages\n"
+        );
+    }
+    return create_shmem(config.shmem_key, size, 0, pp);
+}
+
+int attach_sched_shmem(void** pp) {
+    struct stat sbuf;
+
+    if (strlen(config.shmem_file)) {
+        const char* path = shmem_file_path();
+        if (stat(path, &sbuf)) return ERR_SHMGET;
+        int retval = attach_shmem_mmap(path, pp);
+        if (retval) return retval;
+        mapped_size = (int)sbuf.st_size;
+        return 0;
+    }
+    return attach_shmem(config.shmem_key, pp);
+}
+
+void detach_sched_shmem(SCHED_SHMEM* ssp) {
+    if (strlen(config.shmem_file)) {
+        detach_shmem_mmap(ssp, mapped_size);
+    } else {
+        detach_shmem(ssp);
+    }
+}
+
+void destroy_sched_shmem(SCHED_SHMEM* ssp) {
+    detach_sched_shmem(ssp);
+    if (!strlen(config.shmem_file)) {
+        destroy_shmem(config.shmem_key);
+    }
+}
+
 const char *BOINC_RCSID_e548c94703 = "$Id$";
@@ -49,7 +49,7 @@
 
 // Default number of work items in shared mem.
 // You can configure this in config.xml (<shmem_work_items>)
-// If you increase this above 100,
+// If you increase this a lot,
 // you may exceed the max shared-memory segment size
 // on some operating systems.
 //
@@ -57,28 +57,176 @@
 #define MAX_WU_RESULTS      100
 #endif
 
+// Workunit XML is kept in a heap after the job array,
+// in chunks of WU_XML_CHUNK_SIZE bytes.
+// The heap has room for WU_XML_AVG_SIZE bytes per slot;
+// you can configure this in config.xml (<shmem_wu_xml_size>).
+//
+#define WU_XML_CHUNK_SIZE   256
+#ifndef WU_XML_AVG_SIZE
+#define WU_XML_AVG_SIZE     4096
+#endif
+
 // values of WU_RESULT.state
 #define WR_STATE_EMPTY   0
 #define WR_STATE_PRESENT 1
 // If neither of the above, the value is the PID of a scheduler process
 // that has this item reserved
 
+// Slots change state only by atomic compare-and-swap,
+// so scheduler instances can reserve jobs in parallel
+// without holding the global semaphore:
+//
+// EMPTY -> PRESENT     feeder, after filling in the slot (publish())
+// PRESENT -> EMPTY     feeder, when purging a stale job
+// PRESENT -> PID       scheduler, to reserve the job (claim())
+// PID -> PRESENT       scheduler that can't use the job (release()),
+//                      or feeder if the reserving process has died
+// PID -> EMPTY         scheduler that sent the job, or job can't be sent
+//
+// Schedulers empty slots with SCHED_SHMEM::clear_slot(),
+// which counts them (nslots_emptied) so that the feeder
+// can wake up and refill them.
+//
+// The feeder increments "gen" each time it fills a slot.
+// A scheduler that copies a slot without owning it records gen first,
+// and passes it to claim(); if the slot was emptied and refilled
+// in the meantime (ABA) the claim is undone and fails.
+
+// The fields of a WORKUNIT except xml_doc (and app_name,
+// which the scheduler doesn't use).
+// xml_doc is 64KB, though it's usually a few KB;
+// keeping it out of the slots makes them small,
+// so that scans of the array are fast
+// and there can be many more slots in the same memory.
+//
+struct SHMEM_WORKUNIT {
+    int id;
+    int create_time;
+    int appid;
+    char name[256];
+    int batch;
+    double rsc_fpops_est;
+    double rsc_fpops_bound;
+    double rsc_memory_bound;
+    double rsc_disk_bound;
+    bool need_validate;
+    int canonical_resultid;
+    double canonical_credit;
+    int transition_time;
+    int delay_bound;
+    int error_mask;
+    int file_delete_state;
+    int assimilate_state;
+    int hr_class;
+    double opaque;
+    int min_quorum;
+    int target_nresults;
+    int max_error_results;
+    int max_total_results;
+    int max_success_results;
+    char result_template_file[64];
+    int priority;
+    char mod_time[16];
+    double rsc_bandwidth_bound;
+    int fileset_id;
+    int app_version_id;
+    int transitioner_flags;
+    int size_class;
+
+    void set(WORKUNIT&);
+    void get(WORKUNIT&);
+        // copy the above fields; xml_doc is left alone
+};
+
 // a workunit/result pair
 struct WU_RESULT {
     int state;
         // EMPTY, PRESENT, or PID of locking process
+    int gen;
+        // number of times the feeder has filled this slot
     int infeasible_count;
     bool need_reliable;        // try to send to a reliable host
-    WORKUNIT workunit;
+    SHMEM_WORKUNIT workunit;
+    int xml_chunk;
+    int xml_nchunks;
+        // the workunit's xml_doc is in these chunks of the heap
+        // (xml_nchunks is zero if none)
     int resultid;
     int time_added_to_shared_memory;
     int res_priority;
     int res_server_state;
     double res_report_deadline;
     double fpops_size;      // measured in stdevs
+    double time_emptied;
+        // when the slot was last emptied (0 if never)
+
+    inline bool cas_state(int old_state, int new_state) {
+        return __sync_bool_compare_and_swap(&state, old_state, new_state);
+    }
+
+    // reserve a PRESENT slot for the given process
+    //
+    inline bool claim(int pid) {
+        return cas_state(WR_STATE_PRESENT, pid);
+    }
+
+    // same, but fail if the slot has been refilled since
+    // the caller read gen as "expected_gen"
+    //
+    inline bool claim(int pid, int expected_gen) {
+        if (!claim(pid)) return false;
+        if (gen != expected_gen) {
+            release(pid);
+            return false;
+        }
+        return true;
+    }
+
+    // give back a slot reserved by the given process
+    //
+    inline void release(int pid) {
+        cas_state(pid, WR_STATE_PRESENT);
+    }
+
+    // mark a slot reserved by the given process as empty.
+    // Do this only after copying whatever's needed out of the slot,
+    // since the feeder may overwrite it immediately.
+    //
+    inline void clear(int pid) {
+        time_emptied = dtime();
+        cas_state(pid, WR_STATE_EMPTY);
+    }
+
+    // called by the feeder after filling in an EMPTY slot
+    //
+    inline void publish() {
+        __sync_synchronize();
+        gen++;
+        __sync_synchronize();
+        state = WR_STATE_PRESENT;
+    }
+
+    // read gen for a later claim(pid, gen);
+    // the caller may then copy fields out of the slot
+    //
+    inline int read_gen() {
+        int g = gen;
+        __sync_synchronize();
+        return g;
+    }
 };
 
-// this struct is followed in memory by an array of WU_RESULTS
+// this struct is followed in memory by an array of WU_RESULTS,
+// then by the workunit XML heap:
+// wu_xml_nchunks chunks, and a byte per chunk saying if it's in use.
+//
+// Only the process that fills slots (the feeder or work_cache_client)
+// allocates and frees chunks.
+// A slot's chunks are freed when the slot is refilled.
+// A scheduler that copies the XML of a slot it hasn't claimed
+// may get garbage if the slot is refilled meanwhile;
+// its claim(pid, gen) will then fail, as with the other fields.
 //
 struct SCHED_SHMEM {
     bool ready;             // feeder sets to true when init done
@@ -100,21 +248,78 @@ struct SCHED_SHMEM {
     int max_app_versions;
     int max_assignments;
     int max_wu_results;
+    int wu_xml_nchunks;
+    int wu_xml_nchunks_used;
+    int wu_xml_rover;
+        // where to start looking for free chunks
     bool locality_sched_lite;   // some app uses locality sched Lite
     bool have_nci_app;
     bool have_apps_for_proc_type[NPROC_TYPES];
+    bool per_app_arrays;
+        // feeder --per_app_arrays: wu_results is divided into
+        // contiguous sub-arrays, one per app (in the order of apps[]).
+        // Those of apps[i] are
+        // app_slot_start[i] .. app_slot_start[i]+app_nslots[i]-1
+    int app_slot_start[MAX_APPS];
+    int app_nslots[MAX_APPS];
+    unsigned int nslots_emptied;
+        // number of slots emptied by schedulers (wraps around)
+    int nrefills;
+        // the following are maintained by the feeder since it started:
+        // number of slots refilled,
+    double refill_latency_sum;
+    double refill_latency_max;
+        // time from emptying a slot to refilling it,
+    double empty_slot_time;
+        // and total slot-seconds that slots have been empty
+    bool work_for_platform[MAX_PLATFORMS][NPROC_TYPES];
+        // set by the feeder after each scan of the array:
+        // whether it has jobs with app versions for
+        // platforms[i] and the given processor type.
+        // Schedulers use this to see that there's nothing for a host
+        // without claiming a slot
     PERF_INFO perf_info;
     PLATFORM platforms[MAX_PLATFORMS];
     APP apps[MAX_APPS];
     APP_VERSION app_versions[MAX_APP_VERSIONS];
     ASSIGNMENT assignments[MAX_ASSIGNMENTS];
+        // "multi" assignments, sorted by (target_type, target_id)
+        // so that those for a given target can be found quickly;
+        // the target_id of ASSIGN_NONE assignments is set to 0
     WU_RESULT wu_results[0];
 
+    static int size(int nwu_results);
+        // size of the segment, including the job array and XML heap
     void init(int nwu_results);
     int verify();
     int scan_tables();
     bool no_work(int pid);
     void restore_work(int pid);
+    void update_work_for_platform();
+
+    // called by a scheduler to empty a slot it has reserved
+    //
+    inline void clear_slot(WU_RESULT& wr, int pid) {
+        wr.clear(pid);
+        __sync_fetch_and_add(&nslots_emptied, 1);
+    }
+
+    inline char* wu_xml_heap() {
+        return (char*)(wu_results + max_wu_results);
+    }
+    inline unsigned char* wu_xml_map() {
+        return (unsigned char*)wu_xml_heap() + wu_xml_nchunks*WU_XML_CHUNK_SIZE;
+    }
+    int set_workunit(WU_RESULT&, WORKUNIT&);
+        // by the feeder, to put a workunit in an EMPTY slot;
+        // ERR_BUFFER_OVERFLOW if there's no room for its XML
+    void free_wu_xml(WU_RESULT&);
+    void get_wu_xml_doc(WU_RESULT&, char* buf);
+        // copy the slot's XML to buf (BLOB_SIZE bytes)
+    void get_workunit(WU_RESULT& wr, WORKUNIT& wu) {
+        wr.workunit.get(wu);
+        get_wu_xml_doc(wr, wu.xml_doc);
+    }
 #ifndef _USING_FCGI_
     void show(FILE*);
 #else
@@ -127,6 +332,7 @@ struct SCHED_SHMEM {
     APP_VERSION* lookup_app_version_platform_plan_class(
         int platform, char* plan_class
     );
+    void lookup_assignments(int target_type, int target_id, int& first, int& n);
     double total_expavg_credit() {
         double x = 0;
         for (int i=0; i<napp_versions; i++) {
@@ -138,4 +344,25 @@ struct SCHED_SHMEM {
     PLATFORM* lookup_platform(char*);
 };
 
+// The job array is in a SysV segment with key <shmem_key>,
+// or, if <shmem_file> is set in config.xml, in that file,
+// which each process maps.
+// With <shmem_huge_pages/>, the SysV segment uses huge pages (Linux);
+// for a file, put it on a hugetlbfs mount to do that
+// (<shmem_huge_pages/> then makes its size a multiple of the page size).
+// Huge pages make scans of a large array faster (fewer TLB misses).
+//
+// The file isn't removed when the feeder exits,
+// so a restarted feeder can keep the jobs in it
+// rather than filling the array from the DB again.
+//
+extern int create_sched_shmem(int size, bool keep, void** pp, bool& kept);
+    // create the segment; destroy any existing one first,
+    // unless keep is set and there's a file of the right size
+    // (in which case set kept)
+extern int attach_sched_shmem(void** pp);
+extern void detach_sched_shmem(SCHED_SHMEM*);
+extern void destroy_sched_shmem(SCHED_SHMEM*);
+    // detach; destroy the segment unless it's a file
+
 #endif
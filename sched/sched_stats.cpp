@@ -0,0 +1,85 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// sched_stats: show the time spent in each stage of scheduler RPCs,
+// as recorded if <sched_stats_shmem_key> is set in config.xml
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "sched_config.h"
+#include "sched_timing.h"
+#include "str_util.h"
+#include "svn_version.h"
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Shows the time spent in each stage of scheduler RPCs.\n\n"
+        "Usage: %s [OPTION]\n\n"
+        "Options:\n"
+        "  [ --reset ]            Show, then reset the counts\n"
+        "  [ -h | --help ]        Show this help text.\n"
+        "  [ -v | --version ]     Shows version information.\n",
+        name
+    );
+}
+
+int main(int argc, char *argv[]) {
+    SCHED_TIMING_TABLE* stp;
+    bool reset = false;
+    int retval;
+
+    for (int c = 1; c < argc; c++) {
+        std::string option(argv[c]);
+        if(option == "-h" || option == "--help") {
+            usage(argv[0]);
+            exit(0);
+        } else if(option == "-v" || option == "--version") {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else if(option == "--reset") {
+            reset = true;
+        } else {
+            fprintf(stderr, "unknown command line argument: %s\n\n", argv[c]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    retval = config.parse_file();
+    if (retval) {
+        printf("Can't parse config.xml: %s\n", boincerror(retval));
+        exit(1);
+    }
+    if (!config.sched_stats_shmem_key) {
+        printf("<sched_stats_shmem_key> isn't set in config.xml\n");
+        exit(1);
+    }
+    stp = attach_sched_timing();
+    if (!stp) {
+        printf("can't attach shmem: key %x\n", config.sched_stats_shmem_key);
+        exit(1);
+    }
+    stp->print(stdout);
+    if (reset) {
+        stp->reset();
+    }
+}
+
+const char *BOINC_RCSID_3c81d0b7e2 = "$Id$";
@@ -21,9 +21,12 @@
 #include "config.h"
 #include <sys/param.h>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
+#include "error_numbers.h"
 #include "filesys.h"
 #include "parse.h"
 
@@ -35,185 +38,202 @@
 #include "boinc_fcgi.h"
 #endif
 
-typedef struct urltag {
+// The download servers are read once.
+// For each time zone (rounded to TZ_BUCKET_SIZE) the servers
+// are sorted by distance the first time a host in that zone is seen.
+// Servers at the same distance are rotated by host ID,
+// so that hosts in a zone are spread evenly across them.
+// The URL prefixes in this order are computed once per host,
+// so adding a file's download URLs is just copying.
+//
+#define TZ_BUCKET_SIZE  900
+#define NTZ_BUCKETS     (86400/TZ_BUCKET_SIZE)
+
+struct DOWNLOAD_SERVER {
     int zone;
-    char name[124];
-} URLTYPE;
+    std::string name;
+};
+
+struct TZ_BUCKET {
+    bool sorted;
+    std::vector<int> order;
+        // indices in download_servers, nearest first
+    std::vector<int> group_start;
+        // start (in order) of each set of servers at the same distance
+    TZ_BUCKET() {
+        sorted = false;
+    }
+};
 
+static std::vector<DOWNLOAD_SERVER> download_servers;
+static bool download_servers_read = false;
+static TZ_BUCKET tz_buckets[NTZ_BUCKETS];
 
-// these global variables are needed to pass information into the
-// compare function below.
+// URL prefixes ("\n    <url>server") for the current host
 //
-static int tzone=0;
-static int hostid=0;
+static int url_list_hostid = -1;
+static int url_list_tz = 0;
+static std::vector<std::string> url_list;
 
 // Evaluate differences between time-zone.  Two time zones that differ
 // by almost 24 hours are actually very close on the surface of the
 // earth.  This function finds the 'shortest way around'
 //
-static int compare(const void *x, const void *y) {
-    const URLTYPE *a=(const URLTYPE *)x;
-    const URLTYPE *b=(const URLTYPE *)y;
-
-    char longname[512];
-
-    const int twelve_hours = 12*3600;
-
-    int diffa = abs(tzone - (a->zone));
-    int diffb = abs(tzone - (b->zone));
-
-    if (diffa > twelve_hours) {
-        diffa = 2*twelve_hours-diffa;
-    }
-
-    if (diffb > twelve_hours) {
-        diffb = 2*twelve_hours-diffb;
-    }
-
-    if (diffa < diffb) {
-        return -1;
-    }
-
-    if (diffa > diffb) {
-        return +1;
-    }
-
-    // In order to ensure uniform distribution, we hash paths that are
-    // equidistant from the host's timezone in a way that gives a
-    // unique ordering for each host but which is effectively random
-    // between hosts.
-    //
-    sprintf(longname, "%s%d", a->name, hostid);
-    std::string sa = md5_string((const unsigned char *)longname, strlen((const char *)longname));
-    sprintf(longname, "%s%d", b->name, hostid);
-    std::string sb = md5_string((const unsigned char *)longname, strlen((const char *)longname));
-    int xa = strtol(sa.substr(1, 7).c_str(), 0, 16);
-    int xb = strtol(sb.substr(1, 7).c_str(), 0, 16);
-
-    if (xa<xb) {
-        return -1;
-    }
-
-    if (xa>xb) {
-        return 1;
-    }
-
-    return 0;
+static int tz_distance(int tz1, int tz2) {
+    int diff = abs(tz1 - tz2) % 86400;
+    if (diff > 43200) diff = 86400 - diff;
+    return diff;
 }
 
-static URLTYPE *cached=NULL;
-#define BLOCKSIZE 32
-
-URLTYPE* read_download_list() {
-    int count=0;
-    int i;
+static int read_download_list() {
+    char name[256];
+    int zone;
 
-    if (cached) return cached;
+    if (download_servers_read) return 0;
 
-    const char *download_servers = config.project_path("download_servers");
+    const char *path = config.project_path("download_servers");
 #ifndef _USING_FCGI_
-    FILE *fp=fopen(download_servers, "r");
+    FILE *fp=fopen(path, "r");
 #else
-    FCGI_FILE *fp=FCGI::fopen(download_servers, "r");
+    FCGI_FILE *fp=FCGI::fopen(path, "r");
 #endif
 
     if (!fp) {
         log_messages.printf(MSG_CRITICAL,
-            "File %s not found or unreadable!\n", download_servers
+            "File %s not found or unreadable!\n", path
         );
-        return NULL;
+        return ERR_FOPEN;
     }
 
-    // read in lines from file
+    // read timezone offset and URL from each line
     //
-    while (1) {
-        // allocate memory in blocks
-        if ((count % BLOCKSIZE)==0) {
-            cached=(URLTYPE *)realloc(cached, (count+BLOCKSIZE)*sizeof(URLTYPE));
-            if (!cached) {
-                fclose(fp);
-                return NULL;
-            }
-        }
-        // read timezone offset and URL from file, and store in cache list
-        //
-        if (2==fscanf(fp, "%d %s", &(cached[count].zone), cached[count].name)) {
-            count++;
-        } else {
-            // provide a null terminator so we don't need to keep
-            // another global variable for count.
-            //
-            cached[count].name[0]='\0';
-            break;
-        }
+    while (2 == fscanf(fp, "%d %255s", &zone, name)) {
+        DOWNLOAD_SERVER ds;
+        ds.zone = zone;
+        ds.name = name;
+        download_servers.push_back(ds);
     }
     fclose(fp);
 
-    if (!count) {
+    if (download_servers.empty()) {
         log_messages.printf(MSG_CRITICAL,
             "File %s contained no valid entries!\n"
             "Format of this file is one or more lines containing:\n"
             "TIMEZONE_OFFSET_IN_SEC   http://some.url.path\n",
-            download_servers
+            path
         );
-        free(cached);
-        return NULL;
+        return ERR_NOT_FOUND;
     }
+    download_servers_read = true;
+    return 0;
+}
+
+static int bucket_tz;
+
+static bool nearer(int a, int b) {
+    return tz_distance(bucket_tz, download_servers[a].zone)
+        < tz_distance(bucket_tz, download_servers[b].zone);
+}
 
-    // sort URLs by distance from host timezone.  See compare() above
-    // for details.
-    qsort(cached, count, sizeof(URLTYPE), compare);
+// sort the servers by distance from the given bucket's time zone
+//
+static void sort_bucket(int bucket) {
+    TZ_BUCKET& tb = tz_buckets[bucket];
+    unsigned int i;
+
+    bucket_tz = bucket*TZ_BUCKET_SIZE;
+    for (i=0; i<download_servers.size(); i++) {
+        tb.order.push_back(i);
+    }
+    std::stable_sort(tb.order.begin(), tb.order.end(), nearer);
+    for (i=0; i<tb.order.size(); i++) {
+        if (!i || nearer(tb.order[i-1], tb.order[i])) {
+            tb.group_start.push_back(i);
+        }
+    }
+    tb.sorted = true;
 
     log_messages.printf(MSG_DEBUG,
-        "Sorted list of URLs follows [host timezone: UTC%+d]\n",
-        tzone
+        "Sorted list of URLs follows [time zone: UTC%+d]\n", bucket_tz
     );
-    for (i=0; i<count; i++) {
+    for (i=0; i<tb.order.size(); i++) {
+        DOWNLOAD_SERVER& ds = download_servers[tb.order[i]];
         log_messages.printf(MSG_DEBUG,
-            "zone=%+06d url=%s\n", cached[i].zone, cached[i].name
+            "zone=%+06d url=%s\n", ds.zone, ds.name.c_str()
         );
     }
-    return cached;
 }
 
-// return number of bytes written, or <0 to indicate an error
+// compute url_list for the given host
 //
-int make_download_list(char *buffer, char *path, unsigned int lim, int tz) {
-    char *start = buffer;
-    unsigned int l,len = 0;
-    int i;
+static int make_url_list(int tz, int hostid) {
+    int retval;
+    unsigned int i;
 
-    // global variable used in the compare() function
-    tzone=tz;
-    URLTYPE *serverlist=read_download_list();
+    if (hostid == url_list_hostid && tz == url_list_tz) return 0;
+    retval = read_download_list();
+    if (retval) return retval;
 
-    if (!serverlist) return -1;
+    int bucket = ((tz % 86400) + 86400 + TZ_BUCKET_SIZE/2) % 86400;
+    bucket /= TZ_BUCKET_SIZE;
+    TZ_BUCKET& tb = tz_buckets[bucket];
+    if (!tb.sorted) sort_bucket(bucket);
 
-    // print list of servers in sorted order.
-    // Space is to format them nicely
-    //
-    for (i=0;
-        strlen(serverlist[i].name) && (config.max_download_urls_per_file ?(i < config.max_download_urls_per_file) :true);
-        i++
+    unsigned int n = tb.order.size();
+    if (config.max_download_urls_per_file
+        && n > (unsigned int)config.max_download_urls_per_file
     ) {
-        l = sprintf(start, "%s<url>%s%s</url>", i?"\n    ":"", serverlist[i].name, path);
-        len += l;
-        if (len >= lim) {
-            *start = '\0';
-            return (start-buffer);
+        n = config.max_download_urls_per_file;
+    }
+    url_list.clear();
+    for (i=0; i<tb.group_start.size() && url_list.size() < n; i++) {
+        int start = tb.group_start[i];
+        int end = (i+1 < tb.group_start.size())?tb.group_start[i+1]:(int)tb.order.size();
+        int size = end - start;
+        for (int j=0; j<size && url_list.size() < n; j++) {
+            int k = start + (j + hostid) % size;
+            std::string s(url_list.empty()?"<url>":"\n    <url>");
+            s += download_servers[tb.order[k]].name;
+            url_list.push_back(s);
         }
-        start += l;
     }
+    url_list_hostid = hostid;
+    url_list_tz = tz;
+    return 0;
+}
 
-    return (start-buffer);
+// write the host's download URLs for the given path.
+// return number of bytes written (as many URLs as fit in lim)
+//
+static int make_download_list(char *buffer, char *path, int lim) {
+    char *p = buffer;
+    int path_len = strlen(path);
+    static const char end_tag[] = "</url>";
+    int end_len = sizeof(end_tag) - 1;
+
+    for (unsigned int i=0; i<url_list.size(); i++) {
+        int len = url_list[i].size();
+        if ((p - buffer) + len + path_len + end_len >= lim) {
+            break;
+        }
+        memcpy(p, url_list[i].c_str(), len);
+        p += len;
+        memcpy(p, path, path_len);
+        p += path_len;
+        memcpy(p, end_tag, end_len);
+        p += end_len;
+    }
+    return (int)(p - buffer);
 }
 
 // returns zero on success, non-zero to indicate an error
 //
-int add_download_servers(char *old_xml, char *new_xml, int tz) {
+int add_download_servers(char *old_xml, char *new_xml, int tz, int hostid) {
     char *p, *q, *r;
     int total_free = BLOB_SIZE - strlen(old_xml);
 
+    if (make_url_list(tz, hostid)) return 1;
+
     p = (r = old_xml);
 
     // search for next URL to do surgery on
@@ -260,7 +280,7 @@ int add_download_servers(char *old_xml, char *new_xml, int tz) {
             s += strlen(config.replace_download_url_by_timezone);
 
             // insert new download list in place of the original single URL
-            len = make_download_list(new_xml, s, lim, tz);
+            len = make_download_list(new_xml, s, lim);
             if (len == 0) {
                 // if the replacement would exceed the maximum XML length,
                 // just keep the original URL
@@ -286,12 +306,9 @@ int add_download_servers(char *old_xml, char *new_xml, int tz) {
 void process_av_timezone(APP_VERSION* avp, APP_VERSION& av2) {
     int retval;
 
-    // set these global variables, needed by the compare()
-    // function so that the download URL list can be sorted by timezone
-    //
-    tzone = g_reply->host.timezone;
-    hostid = g_reply->host.id;
-    retval = add_download_servers(avp->xml_doc, av2.xml_doc, g_reply->host.timezone);
+    retval = add_download_servers(
+        avp->xml_doc, av2.xml_doc, g_reply->host.timezone, g_reply->host.id
+    );
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
             "add_download_servers(to APP version) failed\n"
@@ -309,10 +326,9 @@ void process_wu_timezone(
 ) {
     int retval;
 
-    tzone = g_reply->host.timezone;
-    hostid = g_reply->host.id;
-
-    retval = add_download_servers(wu2.xml_doc, wu3.xml_doc, g_reply->host.timezone);
+    retval = add_download_servers(
+        wu2.xml_doc, wu3.xml_doc, g_reply->host.timezone, g_reply->host.id
+    );
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
             "add_download_servers(to WU) failed\n"
@@ -0,0 +1,216 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Scheduler stage timing; see sched_timing.h
+
+#include "config.h"
+#include <cstring>
+
+#include "shmem.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+
+#include "sched_timing.h"
+
+static const char* stage_names[NSCHED_STAGES] = {
+    "request",
+    "parse",
+    "authenticate",
+    "lock",
+    "handle_results",
+    "send_work",
+    "send_work_array",
+    "send_work_score",
+    "send_work_locality",
+    "update_host",
+    "write_reply"
+};
+
+const char* sched_stage_name(int stage) {
+    if (stage < 0 || stage >= NSCHED_STAGES) return "unknown";
+    return stage_names[stage];
+}
+
+static SCHED_TIMING_TABLE* timing_table = 0;
+static bool timing_attach_failed = false;
+
+SCHED_TIMING_TABLE* attach_sched_timing() {
+    void* p;
+    if (timing_table) return timing_table;
+    if (timing_attach_failed) return NULL;
+    int retval = create_shmem(
+        config.sched_stats_shmem_key, sizeof(SCHED_TIMING_TABLE), 0, &p
+    );
+    if (retval || !p) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't attach scheduler stats shmem (key %x): %d\n",
+            config.sched_stats_shmem_key, retval
+        );
+        timing_attach_failed = true;
+        return NULL;
+    }
+    timing_table = (SCHED_TIMING_TABLE*)p;
+    if (!timing_table->start_time) {
+        timing_table->start_time = dtime();
+    }
+    return timing_table;
+}
+
+static inline int bucket_index(unsigned long long usec) {
+    if (usec < TIMING_LINEAR_BUCKETS) return (int)usec;
+    int k = 0;
+    while ((usec >> k) >= 2*TIMING_SUB_BUCKETS) k++;
+
+    // now usec>>k is in [8,16)
+    //
+    int i = TIMING_LINEAR_BUCKETS + (k-1)*TIMING_SUB_BUCKETS
+        + (int)(usec >> k) - TIMING_SUB_BUCKETS;
+    if (i >= TIMING_NBUCKETS) i = TIMING_NBUCKETS - 1;
+    return i;
+}
+
+// the largest value in the bucket
+//
+static double bucket_max(int i) {
+    if (i < TIMING_LINEAR_BUCKETS) return i;
+    int j = i - TIMING_LINEAR_BUCKETS;
+    int k = j/TIMING_SUB_BUCKETS + 1;
+    int sub = j%TIMING_SUB_BUCKETS;
+    return (double)(((unsigned long long)(TIMING_SUB_BUCKETS+sub+1) << k) - 1);
+}
+
+static bool request_shed = false;
+    // the current request was shed
+
+// Update a moving average.
+// Concurrent updates may be lost; that's OK
+//
+static inline void update_avg(double& avg, double x) {
+    double a = avg;
+    avg = a + SHED_AVG_WEIGHT*(x - a);
+}
+
+void sched_timing_record(int stage, double dt) {
+    if (!config.sched_stats_shmem_key) return;
+    if (stage < 0 || stage >= NSCHED_STAGES) return;
+    if (!attach_sched_timing()) return;
+    if (dt < 0) dt = 0;
+
+    // shed requests are fast, and would hide the overload.
+    // The request stage ends last.
+    //
+    if (stage == SCHED_STAGE_REQUEST) {
+        if (!request_shed) update_avg(timing_table->avg_request_time, dt);
+        request_shed = false;
+    } else if (stage == SCHED_STAGE_AUTHENTICATE) {
+        update_avg(timing_table->avg_auth_time, dt);
+    }
+    unsigned long long usec = (unsigned long long)(dt*1e6);
+    SCHED_TIMING_STAGE& s = timing_table->stages[stage];
+    __sync_fetch_and_add(&s.counts[bucket_index(usec)], 1ULL);
+    __sync_fetch_and_add(&s.total_usec, usec);
+    __sync_fetch_and_add(&s.n, 1ULL);
+    unsigned long long m = s.max_usec;
+    while (usec > m) {
+        if (__sync_bool_compare_and_swap(&s.max_usec, m, usec)) break;
+        m = s.max_usec;
+    }
+}
+
+// Shed a request with probability 1 - T/avg,
+// where T is the threshold and avg the moving average it applies to
+// (the larger if both are over).
+// Admitted requests keep the averages current,
+// so shedding stops when the load drops.
+// The delay grows with the overload, and is randomized
+// so that shed clients don't come back together.
+//
+int sched_shed_delay() {
+    double ratio = 0;
+
+    if (!config.shed_request_time && !config.shed_db_time) return 0;
+    if (!config.sched_stats_shmem_key) return 0;
+    if (!attach_sched_timing()) return 0;
+    if (config.shed_request_time) {
+        double x = timing_table->avg_request_time/config.shed_request_time;
+        if (x > ratio) ratio = x;
+    }
+    if (config.shed_db_time) {
+        double x = timing_table->avg_auth_time/config.shed_db_time;
+        if (x > ratio) ratio = x;
+    }
+    if (ratio <= 1) return 0;
+    if (drand() < 1/ratio) return 0;
+    request_shed = true;
+    double delay = config.shed_delay*ratio*(1 + drand());
+    if (delay > 3600) delay = 3600;
+    log_messages.printf(MSG_NORMAL,
+        "overloaded (%.1fx); refusing work, delay %.0f\n", ratio, delay
+    );
+    return (int)delay;
+}
+
+double SCHED_TIMING_STAGE::mean() {
+    if (!n) return 0;
+    return (double)total_usec/n;
+}
+
+double SCHED_TIMING_STAGE::percentile(double p) {
+    unsigned long long total = 0, sum = 0;
+    int i;
+    for (i=0; i<TIMING_NBUCKETS; i++) {
+        total += counts[i];
+    }
+    if (!total) return 0;
+    double target = p*total;
+    for (i=0; i<TIMING_NBUCKETS; i++) {
+        sum += counts[i];
+        if (sum >= target && counts[i]) {
+            double x = bucket_max(i);
+            return x < max_usec ? x : (double)max_usec;
+        }
+    }
+    return (double)max_usec;
+}
+
+void SCHED_TIMING_TABLE::reset() {
+    memset(stages, 0, sizeof(stages));
+    avg_request_time = 0;
+    avg_auth_time = 0;
+    start_time = dtime();
+}
+
+void SCHED_TIMING_TABLE::print(FILE* f) {
+    fprintf(f, "Scheduler stage times (msec) over the last %.0f sec\n\n",
+        dtime() - start_time
+    );
+    fprintf(f, "%-20s %10s %10s %10s %10s %10s %10s\n",
+        "stage", "count", "mean", "p50", "p90", "p99", "max"
+    );
+    for (int i=0; i<NSCHED_STAGES; i++) {
+        SCHED_TIMING_STAGE& s = stages[i];
+        fprintf(f, "%-20s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+            sched_stage_name(i), s.n,
+            s.mean()/1000, s.percentile(.5)/1000, s.percentile(.9)/1000,
+            s.percentile(.99)/1000, (double)s.max_usec/1000
+        );
+    }
+    fprintf(f, "\nmoving averages (msec): request %.3f, authenticate %.3f\n",
+        avg_request_time*1000, avg_auth_time*1000
+    );
+}
@@ -0,0 +1,111 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Timing of the stages of scheduler RPCs.
+// Enabled by <sched_stats_shmem_key> in config.xml.
+//
+// Each stage has a latency histogram in a shared-memory segment
+// (separate from SCHED_SHMEM, and created by the first
+// scheduler process that needs it),
+// updated with atomic adds, so it covers all scheduler processes.
+// Display it with sched_stats.
+//
+// Histograms are log-linear, in microseconds:
+// values below 16 have their own bucket;
+// above that, each power of 2 is divided into 8 buckets,
+// so a bucket's width is at most 1/8 of its lower bound.
+//
+// The segment also has moving averages of the time of requests
+// and of authentication (mostly DB lookups),
+// used for load shedding (see sched_shed_delay()).
+
+#ifndef _SCHED_TIMING_H_
+#define _SCHED_TIMING_H_
+
+#include <cstdio>
+
+#include "util.h"
+
+#define SCHED_STAGE_REQUEST             0
+    // all of handle_request()
+#define SCHED_STAGE_PARSE               1
+#define SCHED_STAGE_AUTHENTICATE        2
+#define SCHED_STAGE_LOCK                3
+#define SCHED_STAGE_HANDLE_RESULTS      4
+#define SCHED_STAGE_SEND_WORK           5
+#define SCHED_STAGE_SEND_WORK_ARRAY     6
+#define SCHED_STAGE_SEND_WORK_SCORE     7
+#define SCHED_STAGE_SEND_WORK_LOCALITY  8
+#define SCHED_STAGE_UPDATE_HOST         9
+#define SCHED_STAGE_WRITE_REPLY         10
+#define NSCHED_STAGES                   11
+
+#define TIMING_LINEAR_BUCKETS   16
+#define TIMING_SUB_BUCKETS      8
+#define TIMING_NBUCKETS         (TIMING_LINEAR_BUCKETS + 28*TIMING_SUB_BUCKETS)
+
+struct SCHED_TIMING_STAGE {
+    unsigned long long n;
+    unsigned long long total_usec;
+    unsigned long long max_usec;
+    unsigned long long counts[TIMING_NBUCKETS];
+
+    double mean();
+    double percentile(double);
+        // in usec; the upper bound of the bucket holding the value
+};
+
+#define SHED_AVG_WEIGHT     .05
+    // weight of a new sample in the moving averages
+
+struct SCHED_TIMING_TABLE {
+    double start_time;
+        // when the counts were last reset
+    SCHED_TIMING_STAGE stages[NSCHED_STAGES];
+    double avg_request_time;
+        // moving average over requests that weren't shed
+    double avg_auth_time;
+
+    void reset();
+    void print(FILE*);
+};
+
+extern const char* sched_stage_name(int);
+extern SCHED_TIMING_TABLE* attach_sched_timing();
+    // return NULL if error (message is logged)
+extern void sched_timing_record(int stage, double dt);
+extern int sched_shed_delay();
+    // if the scheduler is overloaded, decide whether to
+    // refuse work for the current request.
+    // Return the request delay if so, else zero
+
+// times the enclosing scope
+//
+struct SCHED_TIMER {
+    int stage;
+    double start;
+
+    SCHED_TIMER(int s) {
+        stage = s;
+        start = dtime();
+    }
+    ~SCHED_TIMER() {
+        sched_timing_record(stage, dtime() - start);
+    }
+};
+
+#endif
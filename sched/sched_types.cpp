@@ -316,7 +316,7 @@ const char* SCHEDULER_REQUEST::parse(XML_PARSER& xp) {
             continue;
         }
         if (xp.match_tag("time_stats_log")) {
-            handle_time_stats_log(xp.f->f);
+            handle_time_stats_log(*xp.f);
             have_time_stats_log = true;
             continue;
         }
@@ -355,7 +355,7 @@ const char* SCHEDULER_REQUEST::parse(XML_PARSER& xp) {
             continue;
         }
         if (xp.match_tag("code_sign_key")) {
-            copy_element_contents(xp.f->f, "</code_sign_key>", code_sign_key, sizeof(code_sign_key));
+            copy_element_contents(*xp.f, "</code_sign_key>", code_sign_key, sizeof(code_sign_key));
             strip_whitespace(code_sign_key);
             continue;
         }
@@ -461,6 +461,40 @@ const char* SCHEDULER_REQUEST::parse(XML_PARSER& xp) {
     return "no end tag";
 }
 
+void SCHEDULER_REQUEST::index_files() {
+    file_names.clear();
+    for (unsigned int i=0; i<file_infos.size(); i++) {
+        file_names.insert(file_infos[i].name);
+    }
+    nfile_names = file_infos.size();
+}
+
+// does the host have a sticky file with this name?
+//
+bool SCHEDULER_REQUEST::has_file(const char* name) {
+    if (nfile_names != file_infos.size()) {
+        index_files();
+    }
+    return file_names.find(name) != file_names.end();
+}
+
+// return the host's in-progress result with this name, if any
+//
+OTHER_RESULT* SCHEDULER_REQUEST::lookup_other_result(const char* name) {
+    if (nother_results != other_results.size()) {
+        other_result_index.clear();
+        for (unsigned int i=0; i<other_results.size(); i++) {
+            other_result_index.insert(
+                std::make_pair(std::string(other_results[i].name), (int)i)
+            );
+        }
+        nother_results = other_results.size();
+    }
+    std::map<std::string, int>::iterator it = other_result_index.find(name);
+    if (it == other_result_index.end()) return NULL;
+    return &other_results[it->second];
+}
+
 // I'm not real sure why this is here.
 // Why not copy the request message directly?
 //
@@ -612,6 +646,23 @@ SCHEDULER_REPLY::SCHEDULER_REPLY() {
     project_is_down = false;
     send_msg_ack = false;
     strcpy(email_hash, "");
+    lockfile_fd = -1;
+    host_lock_slot = -1;
+    have_venue_project_prefs = false;
+}
+
+// Several places (plan classes, app preferences) look at project prefs;
+// extract the venue once per request.
+// Call only after the user and host records are final.
+//
+const char* SCHEDULER_REPLY::venue_project_prefs() {
+    char buf[BLOB_SIZE];
+    if (!have_venue_project_prefs) {
+        extract_venue(user.project_prefs, host.venue, buf, sizeof(buf));
+        venue_project_prefs_xml = buf;
+        have_venue_project_prefs = true;
+    }
+    return venue_project_prefs_xml.c_str();
 }
 
 static bool have_apps_for_client() {
@@ -632,10 +683,10 @@ int SCHEDULER_REPLY::write(FILE* fout, SCHEDULER_REQUEST& sreq) {
     // Note: at one point we had
     // "<?xml version=\"1.0\" encoding=\"ISO-8859-1\" ?>\n"
     // after the Content-type (to make it legit XML),
-    // but this broke 4.19 clients
+    // but this broke 4.19 clients.
+    // The HTTP header is written by the caller.
     //
     fprintf(fout,
-        "Content-type: text/xml\n\n"
         "<scheduler_reply>\n"
         "<scheduler_version>%d</scheduler_version>\n",
         BOINC_MAJOR_VERSION*100+BOINC_MINOR_VERSION
@@ -643,6 +694,7 @@ int SCHEDULER_REPLY::write(FILE* fout, SCHEDULER_REQUEST& sreq) {
     if (sreq.core_client_version >= 70028) {
         fprintf(fout, "<dont_use_dcf/>\n");
     }
+    fprintf(fout, "<gzip_request/>\n");
     if (strlen(config.master_url)) {
         fprintf(fout,
             "<master_url>%s</master_url>\n",
@@ -1096,16 +1148,14 @@ int APP_VERSION::write(FILE* fout) {
 }
 
 int SCHED_DB_RESULT::write_to_client(FILE* fout) {
-    char buf[BLOB_SIZE];
-
-    safe_strcpy(buf, xml_doc_in);
-    char* p = strstr(buf, "</result>");
+    // write xml_doc_in up to the end tag, without copying it
+    //
+    char* p = strstr(xml_doc_in, "</result>");
     if (!p) {
         fprintf(stderr, "ERROR: result %d XML has no end tag!\n", id);
         return -1;
     }
-    *p = 0;
-    fputs(buf, fout);
+    fwrite(xml_doc_in, 1, p - xml_doc_in, fout);
     fputs("\n", fout);  // for old clients
 
     APP_VERSION* avp = bav.avp;
@@ -1157,7 +1207,7 @@ int SCHED_DB_RESULT::parse_from_client(XML_PARSER& xp) {
             continue;
         }
         if (xp.match_tag("stderr_out" )) {
-            copy_element_contents(xp.f->f, "</stderr_out>", stderr_out, sizeof(stderr_out));
+            copy_element_contents(*xp.f, "</stderr_out>", stderr_out, sizeof(stderr_out));
             continue;
         }
         if (xp.parse_string("platform", stemp)) continue;
@@ -1174,6 +1224,11 @@ int SCHED_DB_RESULT::parse_from_client(XML_PARSER& xp) {
         if (xp.parse_double("report_deadline", dtemp)) continue;
         if (xp.parse_string("wu_name", stemp)) continue;
 
+        // hardware event counts; not stored
+        if (xp.parse_double("perf_cycles", dtemp)) continue;
+        if (xp.parse_double("perf_instructions", dtemp)) continue;
+        if (xp.parse_double("perf_llc_misses", dtemp)) continue;
+
         // deprecated stuff
         if (xp.parse_double("fpops_per_cpu_sec", dtemp)) continue;
         if (xp.parse_double("fpops_cumulative", dtemp)) continue;
@@ -1418,17 +1473,34 @@ DB_HOST_APP_VERSION* gavid_to_havp(int gavid) {
     return NULL;
 }
 
+// Write changed and new records (those past the end of
+// host_app_versions_orig; see update_host_app_versions())
+// in a single statement,
+// so that each RPC locks these rows once.
+//
 void write_host_app_versions() {
-    for (unsigned int i=0; i<g_wreq->host_app_versions.size(); i++) {
-        DB_HOST_APP_VERSION& hav = g_wreq->host_app_versions[i];
-        DB_HOST_APP_VERSION& hav_orig = g_wreq->host_app_versions_orig[i];
+    DB_HOST_APP_VERSION hav;
+    std::string values;
+    char buf[1024];
 
-        int retval = hav.update_scheduler(hav_orig);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "CRITICAL: hav.update_sched() error: %s\n", boincerror(retval)
-            );
+    for (unsigned int i=0; i<g_wreq->host_app_versions.size(); i++) {
+        hav = g_wreq->host_app_versions[i];
+        if (i < g_wreq->host_app_versions_orig.size()
+            && !hav.scheduler_fields_changed(g_wreq->host_app_versions_orig[i])
+        ) {
+            continue;
         }
+        hav.db_print_values(buf);
+        if (values.size()) values += ",";
+        values += buf;
+    }
+    if (values.empty()) return;
+    int retval = hav.insert_or_update_scheduler(values);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "CRITICAL: hav.insert_or_update_scheduler() error: %s\n",
+            boincerror(retval)
+        );
     }
 }
 
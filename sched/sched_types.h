@@ -19,6 +19,9 @@
 #define _SCHED_TYPES_
 
 #include <cstdio>
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 
 #include "boinc_db.h"
@@ -27,6 +30,7 @@
 #include "coproc.h"
 
 #include "edf_sim.h"
+#include "sched_arena.h"
 
 // for projects that support work filtering by app,
 // this records an app for which the user will accept work
@@ -255,6 +259,22 @@ struct PLATFORM_LIST {
     std::vector<PLATFORM*> list;
 };
 
+// lists that get their memory from the per-request arena (see sched_arena.h)
+//
+typedef std::vector<FILE_INFO, ARENA_ALLOCATOR<FILE_INFO> > FILE_INFO_LIST;
+// the outcome of a plan class check;
+// see PLAN_CLASS_SPECS::check() and app_plan_memo()
+//
+struct PLAN_CLASS_MEMO {
+    bool ok;
+    int effective_ncpus;
+    HOST_USAGE host_usage;
+};
+
+typedef std::vector<OTHER_RESULT, ARENA_ALLOCATOR<OTHER_RESULT> > OTHER_RESULT_LIST;
+typedef std::vector<MSG_FROM_HOST_DESC, ARENA_ALLOCATOR<MSG_FROM_HOST_DESC> > MSG_FROM_HOST_LIST;
+typedef std::vector<CLIENT_APP_VERSION, ARENA_ALLOCATOR<CLIENT_APP_VERSION> > CLIENT_APP_VERSION_LIST;
+
 struct SCHEDULER_REQUEST {
     char authenticator[256];
     CLIENT_PLATFORM platform;
@@ -287,7 +307,7 @@ struct SCHEDULER_REQUEST {
     char working_global_prefs_xml[BLOB_SIZE];
     char code_sign_key[4096];
 
-    std::vector<CLIENT_APP_VERSION> client_app_versions;
+    CLIENT_APP_VERSION_LIST client_app_versions;
 
     GLOBAL_PREFS global_prefs;
     char global_prefs_source_email_hash[MD5_LEN];
@@ -302,20 +322,35 @@ struct SCHEDULER_REQUEST {
         // In this case, don't resend lost results
         // since we don't know what was lost.
     std::vector<RESULT> file_xfer_results;
-    std::vector<MSG_FROM_HOST_DESC> msgs_from_host;
-    std::vector<FILE_INFO> file_infos;
+    MSG_FROM_HOST_LIST msgs_from_host;
+    FILE_INFO_LIST file_infos;
         // sticky files reported by host
+    std::set<std::string> file_names;
+    unsigned int nfile_names;
+        // index of the names in file_infos, for has_file().
+        // Rebuilt if file_infos has changed size;
+        // call index_files() after changing names in place.
 
     // temps used by locality scheduling:
-    std::vector<FILE_INFO> file_delete_candidates;
+    FILE_INFO_LIST file_delete_candidates;
         // deletion candidates
-    std::vector<FILE_INFO> files_not_needed;
+    FILE_INFO_LIST files_not_needed;
         // files no longer needed
 
-    std::vector<OTHER_RESULT> other_results;
+    OTHER_RESULT_LIST other_results;
         // in-progress results from this project
+    std::map<std::string, int> other_result_index;
+    unsigned int nother_results;
+        // index of other_results by name, for lookup_other_result();
+        // rebuilt if other_results has changed size
+    std::map<std::string, PLAN_CLASS_MEMO> plan_class_memo;
+        // plan class spec check results, by plan class
+    std::map<int, PLAN_CLASS_MEMO> app_plan_memo;
+        // app_plan() results, by app version ID
     std::vector<IP_RESULT> ip_results;
         // in-progress results from all projects
+    EDF_MODEL edf_model;
+        // ip_results plus the jobs we're sending, for workload_sim
     bool have_other_results_list;
     bool have_ip_results_list;
     bool have_time_stats_log;
@@ -331,9 +366,12 @@ struct SCHEDULER_REQUEST {
     int current_rpc_dayofyear;
     std::string client_opaque;
 
-    SCHEDULER_REQUEST(){};
+    SCHEDULER_REQUEST(){nfile_names = 0; nother_results = 0;};
     ~SCHEDULER_REQUEST(){};
     const char* parse(XML_PARSER&);
+    void index_files();
+    bool has_file(const char* name);
+    OTHER_RESULT* lookup_other_result(const char* name);
     int write(FILE*); // write request info to file: not complete
 };
 
@@ -481,6 +519,7 @@ struct SCHEDULER_REPLY {
         // nonzero only if a new host record was created.
         // this tells client to reset rpc_seqno
     int lockfile_fd; // file descriptor of lockfile, or -1 if no lock.
+    int host_lock_slot; // slot in shmem host lock table, or -1 if no lock.
     bool send_global_prefs;
     bool nucleus_only;          // send only message
     USER user;
@@ -495,7 +534,7 @@ struct SCHEDULER_REPLY {
     std::vector<std::string>result_aborts;
     std::vector<std::string>result_abort_if_not_starteds;
     std::vector<MSG_TO_HOST>msgs_to_host;
-    std::vector<FILE_INFO>file_deletes;
+    FILE_INFO_LIST file_deletes;
     std::vector<std::string> file_transfer_requests;
     char code_sign_key[4096];
     char code_sign_key_signature[4096];
@@ -504,6 +543,8 @@ struct SCHEDULER_REPLY {
     std::vector<APP_VERSION>old_app_versions;
         // superceded app versions that we consider using because of
         // homogeneous app version.
+    std::string venue_project_prefs_xml;
+    bool have_venue_project_prefs;
 
     SCHEDULER_REPLY();
     ~SCHEDULER_REPLY(){};
@@ -515,6 +556,9 @@ struct SCHEDULER_REPLY {
     void insert_message(const char* msg, const char* prio);
     void insert_message(USER_MESSAGE&);
     void set_delay(double);
+    const char* venue_project_prefs();
+        // the user's project prefs for the host's venue,
+        // extracted on the first call
 };
 
 extern SCHEDULER_REQUEST* g_request;
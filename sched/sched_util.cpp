@@ -25,10 +25,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "error_numbers.h"
 #include "filesys.h"
 #include "md5_file.h"
+#include "str_replace.h"
 #include "util.h"
 
 #include "sched_config.h"
@@ -89,13 +93,108 @@ void check_stop_daemons() {
     }
 }
 
-// sleep for n seconds, but check every second for trigger file
+// Wakeup notification.
+// A daemon waiting on a channel binds a Unix datagram socket
+// WAKEUP_DIR/CHANNEL.PID; daemon_notify() sends a byte
+// to each socket for the channel.
+// Notifications sent while the daemon is busy stay queued in its socket,
+// so the next daemon_sleep() returns at once.
+// If the socket can't be created, daemons just sleep.
 //
-void daemon_sleep(int nsecs) {
+#define WAKEUP_DIR  "wakeup"
+
+static int wakeup_fd = -1;
+static char wakeup_path[MAXPATHLEN];
+
+static void wakeup_cleanup() {
+    unlink(wakeup_path);
+}
+
+static int wakeup_socket(const char* channel) {
+    static bool tried = false;
+    struct sockaddr_un addr;
+
+    if (tried) return wakeup_fd;
+    tried = true;
+    boinc_mkdir(config.project_path(WAKEUP_DIR));
+    snprintf(wakeup_path, sizeof(wakeup_path), "%s/%s.%d",
+        config.project_path(WAKEUP_DIR), channel, (int)getpid()
+    );
+    if (strlen(wakeup_path) >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, wakeup_path);
+    unlink(wakeup_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    atexit(wakeup_cleanup);
+    wakeup_fd = fd;
+    return fd;
+}
+
+// sleep for n seconds, but check every second for trigger file.
+// If a channel is given, return when notified
+//
+void daemon_sleep(int nsecs, const char* channel) {
+    char buf[256];
+    int fd = channel?wakeup_socket(channel):-1;
+
     for (int i=0; i<nsecs; i++) {
         check_stop_daemons();
-        sleep(1);
+        if (fd < 0) {
+            sleep(1);
+            continue;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 1000) > 0) {
+            // drain queued notifications; one pass handles them all
+            //
+            while (recv(fd, buf, sizeof(buf), 0) > 0) ;
+            return;
+        }
+    }
+}
+
+void daemon_notify(const char* channel) {
+    char filename[256], prefix[256], path[MAXPATHLEN];
+    struct sockaddr_un addr;
+    char c = 0;
+
+    DIRREF dirp = dir_open(config.project_path(WAKEUP_DIR));
+    if (!dirp) return;
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        dir_close(dirp);
+        return;
+    }
+    snprintf(prefix, sizeof(prefix), "%s.", channel);
+    while (!dir_scan(filename, dirp, sizeof(filename))) {
+        if (strncmp(filename, prefix, strlen(prefix))) continue;
+        snprintf(path, sizeof(path), "%s/%s",
+            config.project_path(WAKEUP_DIR), filename
+        );
+        if (strlen(path) >= sizeof(addr.sun_path)) continue;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        if (sendto(fd, &c, 1, MSG_DONTWAIT,
+            (struct sockaddr*)&addr, sizeof(addr)) < 0
+        ) {
+            // no one is listening; the daemon died without cleaning up
+            //
+            if (errno == ECONNREFUSED) unlink(path);
+        }
     }
+    close(fd);
+    dir_close(dirp);
 }
 
 bool check_stop_sched() {
@@ -165,6 +264,25 @@ static void filename_hash(const char* filename, int fanout, char* dir) {
     sprintf(dir, "%x", x % fanout);
 }
 
+// set up log_messages as specified in config.xml
+// (log_json, log_writer_buffer).
+// Call this after parsing config.xml.
+// FCGI programs write their logs synchronously.
+//
+void config_log_messages() {
+    log_messages.json = config.log_json;
+#ifndef _USING_FCGI_
+    if (config.log_writer_buffer) {
+        int retval = log_messages.start_writer(config.log_writer_buffer);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't start log writer: %s\n", boincerror(retval)
+            );
+        }
+    }
+#endif
+}
+
 // given a filename, compute its path in a directory hierarchy
 // If create is true, create the directory if needed
 //
@@ -214,6 +332,99 @@ int dir_hier_url(
     return 0;
 }
 
+// Content-addressed storage of download files (<download_dedup/>).
+// Input files with the same contents are stored once, as
+// root/cas/X/MD5_NBYTES (X is the dir_hier_path() directory of MD5),
+// and their names in the download hierarchy are hard links to it.
+// So the link count is a reference count,
+// maintained by the file system.
+//
+int dir_hier_cas_path(
+    const char* md5, double nbytes, const char* root, int fanout,
+    char* path, bool create
+) {
+    char casroot[MAXPATHLEN], name[256];
+    int retval;
+
+    sprintf(casroot, "%s/cas", root);
+    if (create) {
+        retval = boinc_mkdir(casroot);
+        if (retval && (errno != EEXIST)) {
+            fprintf(stderr, "boinc_mkdir(%s): %s: errno %d\n",
+                casroot, boincerror(retval), errno
+            );
+            return ERR_MKDIR;
+        }
+    }
+    sprintf(name, "%s_%.0f", md5, nbytes);
+    return dir_hier_path(name, casroot, fanout, path, create);
+}
+
+// The download file at path has the given MD5 and size.
+// If there's a stored copy with these, replace the file with a link to it;
+// otherwise make the file the stored copy.
+//
+int dedup_download_file(
+    const char* path, const char* md5, double nbytes,
+    const char* root, int fanout
+) {
+    char cas_path[MAXPATHLEN], tmp_path[MAXPATHLEN];
+    struct stat sbuf, cbuf;
+    int retval;
+
+    retval = dir_hier_cas_path(md5, nbytes, root, fanout, cas_path, true);
+    if (retval) return retval;
+    if (stat(path, &sbuf)) return ERR_NOT_FOUND;
+
+    // two tries, in case a file_deleter removes the stored copy
+    // or another process creates it while we're here
+    //
+    for (int i=0; i<2; i++) {
+        if (!stat(cas_path, &cbuf)) {
+            if (cbuf.st_dev == sbuf.st_dev && cbuf.st_ino == sbuf.st_ino) {
+                return 0;
+            }
+            if ((double)cbuf.st_size != nbytes) {
+                fprintf(stderr,
+                    "dedup_download_file: %s has size %.0f, expected %.0f\n",
+                    cas_path, (double)cbuf.st_size, nbytes
+                );
+                return ERR_WRONG_SIZE;
+            }
+            sprintf(tmp_path, "%s.cas_tmp", path);
+            unlink(tmp_path);
+            if (link(cas_path, tmp_path)) {
+                if (errno == ENOENT) continue;
+                return ERR_SYMLINK;
+            }
+            if (rename(tmp_path, path)) {
+                unlink(tmp_path);
+                return ERR_RENAME;
+            }
+            return 0;
+        }
+        if (!link(path, cas_path)) return 0;
+        if (errno != EEXIST) return ERR_SYMLINK;
+    }
+    return ERR_SYMLINK;
+}
+
+// A download file with the given MD5 and size has been deleted.
+// If no other file links to the stored copy, delete it.
+//
+int cas_release(const char* md5, double nbytes, const char* root, int fanout) {
+    char cas_path[MAXPATHLEN];
+    struct stat sbuf;
+    int retval;
+
+    retval = dir_hier_cas_path(md5, nbytes, root, fanout, cas_path, false);
+    if (retval) return retval;
+    if (stat(cas_path, &sbuf)) return 0;
+    if (sbuf.st_nlink > 1) return 0;
+    if (unlink(cas_path)) return ERR_UNLINK;
+    return 0;
+}
+
 void compute_avg_turnaround(HOST& host, double turnaround) {
     double new_avg;
     if (host.avg_turnaround == 0) {
@@ -268,20 +479,107 @@ int count_results(char* query, int& n) {
     return result.count(n, query);
 }
 
+int open_replica_db(DB_CONN& db) {
+    int retval, lag;
+    char host[256];
+    vector<std::string>& hosts = *config.replica_db_hosts;
+    unsigned int i, n = hosts.size();
+    unsigned int start = n?(rand() % n):0;
+
+    for (i=0; i<n; i++) {
+        safe_strcpy(host, hosts[(start+i)%n].c_str());
+        retval = db.open(
+            config.replica_db_name, host,
+            config.replica_db_user, config.replica_db_passwd
+        );
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't open replica DB on %s: %s\n", host, boincerror(retval)
+            );
+            continue;
+        }
+        if (config.replica_max_lag) {
+            retval = db.replica_lag(lag);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "replication on %s isn't running; skipping\n", host
+                );
+                db.close();
+                continue;
+            }
+            if (lag > config.replica_max_lag) {
+                log_messages.printf(MSG_NORMAL,
+                    "replica %s is %d sec behind; skipping\n", host, lag
+                );
+                db.close();
+                continue;
+            }
+        }
+        if (n > 1) {
+            log_messages.printf(MSG_NORMAL, "using replica DB on %s\n", host);
+        }
+        return 0;
+    }
+    log_messages.printf(MSG_CRITICAL, "no usable replica DB; using primary\n");
+    return db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+}
+
 int count_workunits(int& n, const char* query) {
     DB_WORKUNIT workunit;
     return workunit.count(n, query);
 }
 
+// count an app's unsent and in-progress results,
+// and store the counts in its state_counts row
+//
+static int recount_result_states(int appid, int& nunsent) {
+    char buf[1024];
+    int nin_progress, retval;
+
+    sprintf(buf, "where server_state<=%d and appid=%d ",
+        RESULT_SERVER_STATE_UNSENT, appid
+    );
+    retval = count_results(buf, nunsent);
+    if (retval) return retval;
+    sprintf(buf, "where server_state=%d and appid=%d ",
+        RESULT_SERVER_STATE_IN_PROGRESS, appid
+    );
+    retval = count_results(buf, nin_progress);
+    if (retval) return retval;
+    sprintf(buf,
+        "insert into state_counts values (%d, %d, %d, %d, 0, 0, 0, 0, 0, 0, 0) "
+        "on duplicate key update last_update_time=values(last_update_time), "
+        "result_server_state_2=values(result_server_state_2), "
+        "result_server_state_4=values(result_server_state_4)",
+        appid, (int)time(0), nunsent, nin_progress
+    );
+    boinc_db.do_query(buf);
+        // if this fails we still have the count
+    return 0;
+}
+
+// The number of unsent (or inactive) results.
+// For a given app, this comes from state_counts,
+// which the transitioner and scheduler update as they create
+// and send results; it's recounted periodically to correct drift.
+//
 int count_unsent_results(int& n, int appid) {
     char buf[256];
     if (appid) {
-        sprintf(buf, "where server_state<=%d and appid=%d ",
-            RESULT_SERVER_STATE_UNSENT, appid
-        );
-    } else {
-        sprintf(buf, "where server_state<=%d", RESULT_SERVER_STATE_UNSENT);
+        DB_STATE_COUNTS sc;
+        sprintf(buf, "where appid=%d", appid);
+        if (!sc.lookup(buf)
+            && sc.last_update_time > time(0) - STATE_COUNTS_RECOUNT_INTERVAL
+        ) {
+            n = sc.result_server_state_2;
+            if (n < 0) n = 0;
+            return 0;
+        }
+        return recount_result_states(appid, n);
     }
+    sprintf(buf, "where server_state<=%d", RESULT_SERVER_STATE_UNSENT);
     return count_results(buf, n);
 
 }
@@ -295,6 +593,30 @@ bool is_arg(const char* x, const char* y) {
     return false;
 }
 
+bool read_all(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
 // the following is used, among other things,
 // to enforce limits on in-progress jobs
 // for GPUs and CPUs (see handle_request.cpp)
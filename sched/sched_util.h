@@ -33,12 +33,19 @@
 
 extern void write_pid_file(const char* filename);
 extern void set_debug_level(int);
+extern const char* STOP_DAEMONS_FILENAME;
 extern void check_stop_daemons();
-extern void daemon_sleep(int);
+extern void daemon_sleep(int nsecs, const char* channel=NULL);
+    // if a channel is given (e.g. "validator"), return early
+    // when some other program calls daemon_notify() for it
+extern void daemon_notify(const char* channel);
+    // tell daemons waiting on the channel that there may be work.
+    // This doesn't block, and does nothing if none are waiting.
 extern bool check_stop_sched();
 extern void install_stop_signal_handler();
 extern int try_fopen(const char* path, FILE*& f, const char* mode);
 extern void get_log_path(char*, const char*);
+extern void config_log_messages();
 
 // convert filename to path in a hierarchical directory system
 //
@@ -47,6 +54,16 @@ extern int dir_hier_path(
     char* result, bool create=false
 );
 
+// When file_upload_handler finishes receiving a VDA chunk
+// (a file whose name starts with "vda_"), or any file if <upload_md5> is set,
+// it writes the MD5 of the data, computed as the data arrived,
+// to a file with this suffix next to the upload,
+// so that the scheduler or validator can check the upload without reading it.
+//
+#define VDA_UPLOAD_PREFIX       "vda_"
+#define UPLOAD_MD5_SUFFIX       ".md5"
+#define VDA_UPLOAD_MD5_SUFFIX   UPLOAD_MD5_SUFFIX
+
 // convert filename to URL in a hierarchical directory system
 //
 extern int dir_hier_url(
@@ -54,6 +71,20 @@ extern int dir_hier_url(
     char* result
 );
 
+// content-addressed storage of download files
+//
+extern int dir_hier_cas_path(
+    const char* md5, double nbytes, const char* root, int fanout,
+    char* path, bool create=false
+);
+extern int dedup_download_file(
+    const char* path, const char* md5, double nbytes,
+    const char* root, int fanout
+);
+extern int cas_release(
+    const char* md5, double nbytes, const char* root, int fanout
+);
+
 extern void compute_avg_turnaround(HOST& host, double turnaround);
 
 struct PERF_INFO {
@@ -71,8 +102,21 @@ struct PERF_INFO {
 //
 extern int mylockf(int fd);
 
+class DB_CONN;
+
+// open a connection for read-only queries.
+// Tries the <replica_db_host>s, starting at a random one,
+// skipping those more than <replica_max_lag> seconds behind.
+// If none is usable, connects to the primary.
+//
+extern int open_replica_db(DB_CONN&);
+
 extern int count_workunits(int&, const char* query);
 extern int count_unsent_results(int&, int appid);
+    // for a given app, this reads state_counts,
+    // recounting if it's older than STATE_COUNTS_RECOUNT_INTERVAL
+
+#define STATE_COUNTS_RECOUNT_INTERVAL   3600
 
 // Return a value for host_app_version.app_version_id.
 // if the app version is anonymous platform,
@@ -90,6 +134,12 @@ inline int generalized_app_version_id(int avid, int appid) {
 //
 extern bool is_arg(const char*, const char*);
 
+// read or write exactly len bytes on a pipe or socket, retrying on EINTR.
+// return false on error or EOF
+//
+extern bool read_all(int fd, void* buf, size_t len);
+extern bool write_all(int fd, const void* buf, size_t len);
+
 extern bool app_plan_uses_gpu(const char* plan_class);
 
 extern int restrict_wu_to_user(WORKUNIT& wu, int userid);
@@ -427,6 +427,29 @@ static double max_32b_address_space() {
     return 2*GIGA;
 }
 
+// app_plan() depends only on the request (and on effective_ncpus,
+// set partway through handling it),
+// but get_app_version() may consider an app version many times
+// in one request; e.g. once per processor type in score-based scheduling.
+// Remember its results.
+//
+static bool app_plan_memo(APP_VERSION& av, HOST_USAGE& hu) {
+    std::map<int, PLAN_CLASS_MEMO>::iterator it =
+        g_request->app_plan_memo.find(av.id);
+    if (it != g_request->app_plan_memo.end()
+        && it->second.effective_ncpus == g_wreq->effective_ncpus
+    ) {
+        hu = it->second.host_usage;
+        return it->second.ok;
+    }
+    PLAN_CLASS_MEMO m;
+    m.ok = app_plan(*g_request, av.plan_class, hu);
+    m.effective_ncpus = g_wreq->effective_ncpus;
+    m.host_usage = hu;
+    g_request->app_plan_memo[av.id] = m;
+    return m.ok;
+}
+
 // The WU is already committed to an app version.
 // - check if this host supports that platform
 // - if plan class, check if this host can handle it
@@ -485,7 +508,7 @@ static BEST_APP_VERSION* check_homogeneous_app_version(
     // and see if it supports the plan class
     //
     if (strlen(avp->plan_class)) {
-        if (!app_plan(*g_request, avp->plan_class, bav.host_usage)) {
+        if (!app_plan_memo(*avp, bav.host_usage)) {
             return NULL;
         }
     } else {
@@ -683,7 +706,7 @@ BEST_APP_VERSION* get_app_version(
             if (av.platformid != p->id) continue;
 
             if (strlen(av.plan_class)) {
-                if (!app_plan(*g_request, av.plan_class, host_usage)) {
+                if (!app_plan_memo(av, host_usage)) {
                     if (config.debug_version_select) {
                         log_messages.printf(MSG_NORMAL,
                             "[version] [AV#%d] app_plan() returned false\n",
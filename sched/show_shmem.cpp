@@ -65,7 +65,7 @@ int main(int argc, char *argv[]) {
         printf("Can't parse config.xml: %s\n", boincerror(retval));
         exit(1);
     }
-    retval = attach_shmem(config.shmem_key, &p);
+    retval = attach_sched_shmem(&p);
     if (retval) {
         printf("can't attach shmem: key %x\n", config.shmem_key);
         exit(1);
@@ -17,8 +17,13 @@
 
 // daemon to regulate the transition of jobs from INACTIVE to UNSENT,
 // to maintain a buffer of UNSENT jobs of each size class.
+//
+// If <pop_stats_shmem_key> is set and census --daemon is running,
+// the unsent counts are taken from shared memory (see pop_stats.h)
+// rather than counted with a query each pass.
 
 #include <stdio.h>
+#include <string.h>
 
 #include "boinc_db.h"
 
@@ -27,6 +32,7 @@
 #include "sched_config.h"
 #include "sched_msgs.h"
 #include "sched_util.h"
+#include "pop_stats.h"
 
 char* app_name = NULL;
 int lo = 0;
@@ -35,6 +41,36 @@ int sleep_time = 0;
 DB_APP app;
 const char* order_clause = "";
 
+// jobs we've released since the last shared-memory count
+//
+double release_time = 0;
+int nreleased[MAX_SIZE_CLASSES];
+
+// get unsent counts from shared memory, if there's a recent count.
+// Add the jobs we've released since then.
+//
+bool get_shmem_counts(int* unsent) {
+    static POP_STATS ps;
+
+    if (!config.pop_stats_shmem_key) return false;
+    POP_STATS* shm = pop_stats_attach();
+    if (!shm) return false;
+    shm->snapshot(ps);
+    if (!ps.result_update_time) return false;
+    if (dtime() - ps.result_update_time > 2*ps.result_period + sleep_time) {
+        return false;
+    }
+    if (ps.result_update_time > release_time) {
+        memset(nreleased, 0, sizeof(nreleased));
+    }
+    POP_STATS_APP* ap = ps.lookup_app(app.id);
+    for (int i=0; i<app.n_size_classes; i++) {
+        unsent[i] = nreleased[i];
+        if (ap && i < ap->n_size_classes) unsent[i] += ap->unsent[i];
+    }
+    return true;
+}
+
 void usage(){
     fprintf(stderr, "usage: size_regulator --app_name x --lo x --hi x --sleep_time x\n");
     exit(1);
@@ -43,8 +79,11 @@ void usage(){
 int do_pass(bool& action) {
     DB_RESULT result;
     int unsent[100];
-    int retval = result.get_unsent_counts(app, unsent);
-    if (retval) return retval;
+    int retval;
+    if (!get_shmem_counts(unsent)) {
+        retval = result.get_unsent_counts(app, unsent);
+        if (retval) return retval;
+    }
     action = false;
     for (int i=0; i<app.n_size_classes; i++) {
         log_messages.printf(MSG_NORMAL, "%d unsent for class %d\n", unsent[i], i);
@@ -58,6 +97,8 @@ int do_pass(bool& action) {
             log_messages.printf(MSG_NORMAL,
                 "%d jobs released\n", nchanged
             );
+            nreleased[i] += nchanged;
+            release_time = dtime();
             if (nchanged == n) {
                 action = true;
             }
@@ -15,6 +15,8 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstring>
+#include <string>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -34,8 +36,10 @@ static char* stats_buf = 0;
 // don't write them to disk yet, since we haven't authenticated the host
 //
 
-void handle_time_stats_log(FILE* fin) {
-    dup_element_contents(fin, "</time_stats_log>", &stats_buf);
+void handle_time_stats_log(MIOFILE& fin) {
+    std::string s;
+    if (copy_element_contents(fin, "</time_stats_log>", s)) return;
+    stats_buf = strdup(s.c_str());
 }
 
 // The host has been authenticated, so write the stats.
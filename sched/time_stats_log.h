@@ -17,6 +17,8 @@
 
 #include <cstdio>
 
-extern void handle_time_stats_log(FILE* fin);
+#include "miofile.h"
+
+extern void handle_time_stats_log(MIOFILE& fin);
 extern void write_time_stats_log();
 extern bool have_time_stats_log();
@@ -24,6 +24,8 @@
 //   [ --one_pass ]          do one pass, then exit
 //   [ --d x ]               debug level x
 //   [ --mod n i ]           process only WUs with (id mod n) == i
+//   [ --batch_size n ]      handle n WUs per transaction; batch result updates
+//   [ --nworkers n ]        handle WUs in n worker processes
 //   [ --sleep_interval x ]  sleep x seconds if nothing to do
 
 #include "config.h"
@@ -49,7 +51,9 @@
 #include "sched_config.h"
 #include "credit.h"
 #include "sched_util.h"
+#include "daemon_metrics.h"
 #include "sched_msgs.h"
+#include "daemon_lease.h"
 #ifdef GCL_SIMULATOR
 #include "gcl_simulator.h"
 #endif
@@ -67,6 +71,15 @@ int mod_n, mod_i;
 bool do_mod = false;
 bool one_pass = false;
 int sleep_interval = DEFAULT_SLEEP_INTERVAL;
+int batch_size = 1;
+    // if > 1, handle this many WUs per DB transaction,
+    // and do result updates as multi-row UPDATEs
+int nworkers = 0;
+    // if nonzero, handle WUs in this many worker processes
+DAEMON_LEASE* lease = NULL;
+    // with --lease_partition
+static int m_wus, m_lag, m_pass_time;
+    // metrics
 
 void signal_handler(int) {
     log_messages.printf(MSG_NORMAL, "Signaled by simulator\n");
@@ -234,6 +247,10 @@ int handle_wu(
                     res_item.res_name,
                     res_item.res_report_deadline, (int)now
                 );
+                state_count_deltas.note(
+                    wu_item.appid, res_item.res_server_state,
+                    RESULT_SERVER_STATE_OVER
+                );
                 res_item.res_server_state = RESULT_SERVER_STATE_OVER;
                 res_item.res_outcome = RESULT_OUTCOME_NO_REPLY;
                 retval = transitioner.update_result(res_item);
@@ -311,11 +328,13 @@ int handle_wu(
         }
     }
 
-    log_messages.printf(MSG_DEBUG,
-        "[WU#%u %s] %d results: unsent %d, in_progress %d, over %d (success %d, error %d, couldnt_send %d, no_reply %d, didnt_need %d)\n",
-        wu_item.id, wu_item.name, ntotal, nunsent, ninprogress, nover,
-        nsuccess, nerrors, ncouldnt_send, nno_reply, ndidnt_need
-    );
+    if (log_messages.wanted(MSG_DEBUG)) {
+        log_messages.printf(MSG_DEBUG,
+            "[WU#%u %s] %d results: unsent %d, in_progress %d, over %d (success %d, error %d, couldnt_send %d, no_reply %d, didnt_need %d)\n",
+            wu_item.id, wu_item.name, ntotal, nunsent, ninprogress, nover,
+            nsuccess, nerrors, ncouldnt_send, nno_reply, ndidnt_need
+        );
+    }
 
     // if there's a new result to validate, trigger validation
     //
@@ -396,6 +415,10 @@ int handle_wu(
                     "[WU#%u %s] [RESULT#%u %s] server_state:UNSENT=>OVER; outcome:=>DIDNT_NEED\n",
                     wu_item.id, wu_item.name, res_item.res_id, res_item.res_name
                 );
+                state_count_deltas.note(
+                    wu_item.appid, res_item.res_server_state,
+                    RESULT_SERVER_STATE_OVER
+                );
                 res_item.res_server_state = RESULT_SERVER_STATE_OVER;
                 res_item.res_outcome = RESULT_OUTCOME_DIDNT_NEED;
                 update_result = true;
@@ -538,10 +561,12 @@ int handle_wu(
             //
             if (all_over_and_validated && wu_item.file_delete_state == FILE_DELETE_INIT) {
                 wu_item.file_delete_state = FILE_DELETE_READY;
-                log_messages.printf(MSG_DEBUG,
-                    "[WU#%u %s] ASSIMILATE_DONE: file_delete_state:=>READY\n",
-                    wu_item.id, wu_item.name
-                );
+                if (log_messages.wanted(MSG_DEBUG)) {
+                    log_messages.printf(MSG_DEBUG,
+                        "[WU#%u %s] ASSIMILATE_DONE: file_delete_state:=>READY\n",
+                        wu_item.id, wu_item.name
+                    );
+                }
             }
 
             // output of error results can be deleted immediately;
@@ -586,12 +611,14 @@ int handle_wu(
             }
         } else {
             deferred_file_delete_time = most_recently_returned + config.delete_delay;
-            log_messages.printf(MSG_DEBUG,
-                "[WU#%u %s] deferring file deletion for %.0f seconds\n",
-                wu_item.id,
-                wu_item.name,
-                deferred_file_delete_time - now
-            );
+            if (log_messages.wanted(MSG_DEBUG)) {
+                log_messages.printf(MSG_DEBUG,
+                    "[WU#%u %s] deferring file deletion for %.0f seconds\n",
+                    wu_item.id,
+                    wu_item.name,
+                    deferred_file_delete_time - now
+                );
+            }
         }
     }
 
@@ -648,17 +675,21 @@ int handle_wu(
         int extra_delay = 2*(now - wu_item.transition_time);
         if (extra_delay < 60) extra_delay = 60;
         if (extra_delay > 86400) extra_delay = 86400;
-        log_messages.printf(MSG_DEBUG,
-            "[WU#%u %s] transition time in past: adding extra delay %d sec\n",
-            wu_item.id, wu_item.name, extra_delay
-        );
+        if (log_messages.wanted(MSG_DEBUG)) {
+            log_messages.printf(MSG_DEBUG,
+                "[WU#%u %s] transition time in past: adding extra delay %d sec\n",
+                wu_item.id, wu_item.name, extra_delay
+            );
+        }
         wu_item.transition_time = now + extra_delay;
     }
 
-    log_messages.printf(MSG_DEBUG,
-        "[WU#%u %s] setting transition_time to %d\n",
-        wu_item.id, wu_item.name, wu_item.transition_time
-    );
+    if (log_messages.wanted(MSG_DEBUG)) {
+        log_messages.printf(MSG_DEBUG,
+            "[WU#%u %s] setting transition_time to %d\n",
+            wu_item.id, wu_item.name, wu_item.transition_time
+        );
+    }
 
     retval = transitioner.update_workunit(wu_item, wu_item_original);
     if (retval) {
@@ -671,17 +702,246 @@ int handle_wu(
     return 0;
 }
 
+// apply the changes to state_counts of the WUs handled so far
+//
+static void flush_state_counts() {
+    int retval = state_count_deltas.flush();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't update state_counts: %s\n", boincerror(retval)
+        );
+    }
+}
+
+// do queued result updates and commit the current transaction
+//
+static void commit_batch(DB_TRANSITIONER_ITEM_SET& transitioner) {
+    int retval = transitioner.flush_result_updates();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "flush_result_updates(): %s\n", boincerror(retval)
+        );
+    }
+    flush_state_counts();
+    retval = boinc_db.commit_transaction();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "commit_transaction(): %s; exiting\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
+// handle a WU.
+// If batching, start a transaction if needed,
+// and commit it if it has batch_size WUs
+//
+static void process_wu(
+    DB_TRANSITIONER_ITEM_SET& transitioner,
+    std::vector<TRANSITIONER_ITEM>& items, int& nbatch
+) {
+    int retval;
+
+    if (batch_size > 1 && !nbatch) {
+        retval = boinc_db.start_transaction();
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "start_transaction(): %s; exiting\n", boincerror(retval)
+            );
+            exit(1);
+        }
+    }
+    TRANSITIONER_ITEM& wu_item = items[0];
+    retval = handle_wu(transitioner, items);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[WU#%u %s] handle_wu: %s; quitting\n",
+            wu_item.id, wu_item.name, boincerror(retval)
+        );
+        exit(1);
+    }
+    if (batch_size > 1 && ++nbatch >= batch_size) {
+        commit_batch(transitioner);
+        nbatch = 0;
+    }
+}
+
+// With --nworkers N, the transitioner forks N worker processes,
+// each with its own DB connection.
+// The parent does the enumeration (one query rather than N)
+// and sends each WU's items over a pipe to the worker for its WU ID,
+// so a given WU is always handled by the same worker.
+//
+// Before each new enumeration query, the parent has all workers
+// finish (and commit) what they've been sent;
+// otherwise WUs not yet updated would be enumerated again.
+//
+// Messages to a worker are an item count followed by the items;
+// a count of 0 means "finish up and acknowledge".
+//
+struct WORKER {
+    int pid;
+    int to_fd;          // parent writes items here
+    int from_fd;        // worker writes acks here
+};
+
+static std::vector<WORKER> workers;
+
+static void open_db() {
+    int retval = boinc_db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "boinc_db.open: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
+static void worker_main(int in_fd, int out_fd) {
+    DB_TRANSITIONER_ITEM_SET transitioner;
+    std::vector<TRANSITIONER_ITEM> items;
+    int n, nbatch = 0;
+    char ack = 0;
+
+    open_db();
+    transitioner.batch_size = batch_size;
+    while (1) {
+        if (!read_all(in_fd, &n, sizeof(n))) {
+            // parent has exited
+            //
+            exit(0);
+        }
+        if (n == 0) {
+            if (nbatch) {
+                commit_batch(transitioner);
+                nbatch = 0;
+            } else {
+                flush_state_counts();
+            }
+            if (!write_all(out_fd, &ack, 1)) exit(1);
+            continue;
+        }
+        items.resize(n);
+        if (!read_all(in_fd, &items[0], n*sizeof(TRANSITIONER_ITEM))) {
+            exit(1);
+        }
+        process_wu(transitioner, items, nbatch);
+    }
+}
+
+// fork the workers.
+// Do this before the parent opens its DB connection,
+// so that the children don't share its socket.
+//
+static void start_workers() {
+    int i, to_worker[2], from_worker[2];
+
+    signal(SIGPIPE, SIG_IGN);
+    for (i=0; i<nworkers; i++) {
+        if (pipe(to_worker) || pipe(from_worker)) {
+            log_messages.printf(MSG_CRITICAL, "pipe() failed; exiting\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            log_messages.printf(MSG_CRITICAL, "fork() failed; exiting\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (unsigned int j=0; j<workers.size(); j++) {
+                close(workers[j].to_fd);
+                close(workers[j].from_fd);
+            }
+            close(to_worker[1]);
+            close(from_worker[0]);
+            log_messages.pid = getpid();
+            worker_main(to_worker[0], from_worker[1]);
+            exit(0);
+        }
+        close(to_worker[0]);
+        close(from_worker[1]);
+        WORKER w;
+        w.pid = pid;
+        w.to_fd = to_worker[1];
+        w.from_fd = from_worker[0];
+        workers.push_back(w);
+        log_messages.printf(MSG_NORMAL, "started worker %d (PID %d)\n", i, pid);
+    }
+}
+
+static void worker_died(WORKER& w) {
+    log_messages.printf(MSG_CRITICAL,
+        "worker PID %d exited; exiting\n", w.pid
+    );
+    exit(1);
+}
+
+static void send_to_worker(std::vector<TRANSITIONER_ITEM>& items) {
+    int n = (int)items.size();
+    int k = items[0].id;
+    if (do_mod) k /= mod_n;
+    if (lease) k /= LEASE_NBUCKETS;
+    WORKER& w = workers[k % nworkers];
+    if (!write_all(w.to_fd, &n, sizeof(n))) worker_died(w);
+    if (!write_all(w.to_fd, &items[0], n*sizeof(TRANSITIONER_ITEM))) {
+        worker_died(w);
+    }
+}
+
+// wait until all workers have finished the WUs sent to them
+//
+static void sync_workers() {
+    unsigned int i;
+    int zero = 0;
+    char ack;
+
+    for (i=0; i<workers.size(); i++) {
+        if (!write_all(workers[i].to_fd, &zero, sizeof(zero))) {
+            worker_died(workers[i]);
+        }
+    }
+    for (i=0; i<workers.size(); i++) {
+        if (!read_all(workers[i].from_fd, &ack, 1)) {
+            worker_died(workers[i]);
+        }
+    }
+}
+
 bool do_pass() {
     int retval;
     DB_TRANSITIONER_ITEM_SET transitioner;
     std::vector<TRANSITIONER_ITEM> items;
     bool did_something = false;
+    int nbatch = 0, nwus = 0, lag = 0;
+    int now = (int)time(0);
+    double start = dtime();
+
+    transitioner.batch_size = batch_size;
 
     if (!one_pass) check_stop_daemons();
 
     // loop over entries that are due to be checked
     //
     while (1) {
+        if (nworkers && !transitioner.cursor.active) {
+            sync_workers();
+        }
+
+        // renew our leases before each query;
+        // workers are done with any buckets we release
+        //
+        if (lease && !transitioner.cursor.active) {
+            retval = lease->update();
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "can't update leases: %s\n", boincerror(retval)
+                );
+                break;
+            }
+            lease->get_clause("id", transitioner.id_clause);
+        }
         retval = transitioner.enumerate(
             (int)time(0), SELECT_LIMIT, mod_n, mod_i, items
         );
@@ -695,35 +955,63 @@ bool do_pass() {
             break;
         }
         did_something = true;
-        TRANSITIONER_ITEM& wu_item = items[0];
-        retval = handle_wu(transitioner, items);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "[WU#%u %s] handle_wu: %s; quitting\n",
-                wu_item.id, wu_item.name, boincerror(retval)
-            );
-            exit(1);
+        nwus++;
+        if (now - items[0].transition_time > lag) {
+            lag = now - items[0].transition_time;
+        }
+        if (nworkers) {
+            send_to_worker(items);
+        } else {
+            process_wu(transitioner, items, nbatch);
         }
 
         if (!one_pass) check_stop_daemons();
     }
+    if (nbatch) {
+        commit_batch(transitioner);
+    } else {
+        flush_state_counts();
+    }
+    if (nworkers) {
+        sync_workers();
+    }
+    daemon_metrics.add(m_wus, nwus);
+    daemon_metrics.set(m_lag, lag);
+    daemon_metrics.observe(m_pass_time, dtime() - start);
     return did_something;
 }
 
-void main_loop() {
-    int retval;
+static void release_lease() {
+    lease->release();
+}
 
-    retval = boinc_db.open(config.db_name, config.db_host, config.db_user, config.db_passwd);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "boinc_db.open: %s\n", boincerror(retval)
-        );
-        exit(1);
+void main_loop() {
+    daemon_metrics.open("transitioner");
+    m_wus = daemon_metrics.define(
+        "transitioner_wus", METRIC_COUNTER, "WUs handled"
+    );
+    m_lag = daemon_metrics.define(
+        "transitioner_lag_seconds", METRIC_GAUGE,
+        "In the last pass, the largest delay past a WU's transition_time"
+    );
+    m_pass_time = daemon_metrics.define(
+        "transitioner_pass_seconds", METRIC_HISTOGRAM, "Duration of passes"
+    );
+    if (nworkers) {
+        start_workers();
     }
+    open_db();
+    if (lease) atexit(release_lease);
 
     while (1) {
         log_messages.printf(MSG_DEBUG, "doing a pass\n");
-        if (!do_pass()) {
+        if (do_pass()) {
+            // we may have made WUs ready for these
+            //
+            daemon_notify("validator");
+            daemon_notify("assimilator");
+            daemon_notify("file_deleter");
+        } else {
             if (one_pass) break;
 #ifdef GCL_SIMULATOR
             continue_simulation("transitioner");
@@ -731,7 +1019,7 @@ void main_loop() {
             pause();
 #else
             log_messages.printf(MSG_DEBUG, "sleeping %d\n", sleep_interval);
-            daemon_sleep(sleep_interval);
+            daemon_sleep(sleep_interval, "transitioner");
 #endif
         }
     }
@@ -748,7 +1036,12 @@ void usage(char *name) {
         "  [ --one_pass ]                  do one pass, then exit\n"
         "  [ --d x ]                       debug level x\n"
         "  [ --mod n i ]                   process only WUs with (id mod n) == i\n"
+        "  [ --lease_partition ]           share WUs with other instances\n"
+        "                                  that use this option, dynamically\n"
         "  [ --sleep_interval x ]          sleep x seconds if nothing to do\n"
+        "  [ --nworkers n ]                handle WUs in n worker processes\n"
+        "  [ --batch_size n ]              handle n WUs per DB transaction,\n"
+        "                                  with batched result updates\n"
         "  [ -h | --help ]                 Show this help text.\n"
         "  [ -v | --version ]              Shows version information.\n",
         name
@@ -781,6 +1074,8 @@ int main(int argc, char** argv) {
             mod_n = atoi(argv[++i]);
             mod_i = atoi(argv[++i]);
             do_mod = true;
+        } else if (is_arg(argv[i], "lease_partition")) {
+            lease = new DAEMON_LEASE("transitioner");
         } else if (is_arg(argv[i], "sleep_interval")) {
             if (!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
@@ -788,6 +1083,20 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             sleep_interval = atoi(argv[i]);
+        } else if (is_arg(argv[i], "batch_size")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            batch_size = atoi(argv[i]);
+        } else if (is_arg(argv[i], "nworkers")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nworkers = atoi(argv[i]);
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -800,6 +1109,13 @@ int main(int argc, char** argv) {
             exit(1);
         }
     }
+    if (do_mod && lease) {
+        log_messages.printf(MSG_CRITICAL,
+            "--mod and --lease_partition are incompatible\n\n"
+        );
+        usage(argv[0]);
+        exit(1);
+    }
     if (!one_pass) check_stop_daemons();
 
     retval = config.parse_file();
@@ -807,6 +1123,7 @@ int main(int argc, char** argv) {
         log_messages.printf(MSG_CRITICAL, "Can't parse config.xml: %s\n", boincerror(retval));
         exit(1);
     }
+    config_log_messages();
 
     sprintf(path, "%s/upload_private", config.key_dir);
     retval = read_key_file(path, key);
@@ -126,10 +126,11 @@ int handle_trickle(MSG_FROM_HOST& mfh) {
         // don't do anything
         return 0;
     }
-    // extend the deadline
+    // extend the deadline; only that field is written
     //
+    RESULT orig = task;
     task.report_deadline += extension_period;
-    retval = task.update();
+    retval = task.update_diff(orig);
     if (retval) return retval;
     log_messages.printf(MSG_DEBUG,
         "[RESULT#%u][HOST#%u] report deadline extended to %d\n",
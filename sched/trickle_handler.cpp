@@ -21,6 +21,8 @@
 //  --variety variety
 //  [--d debug_level]
 //  [--one_pass]     // make one pass through table, then exit
+//  [--nworkers N]   // run the handler in N worker processes
+//  [--mod N R]      // handle only messages from hosts with ID % N == R
 //
 // This program must be linked with an app-specific function:
 //
@@ -30,7 +32,13 @@
 // return nonzero on error
 
 #include "config.h"
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <string>
+#include <vector>
 #include <unistd.h>
+#include <sys/select.h>
 
 #include "boinc_db.h"
 #include "util.h"
@@ -44,34 +52,285 @@
 #include "sched_msgs.h"
 #include "trickle_handler.h"
 
+using std::vector;
+
 char variety[256];
+int nworkers = 0;
+    // if nonzero, run the handler in this many worker processes
+int host_id_modulus = 0, host_id_remainder = 0;
+int g_argc;
+char** g_argv;
+
+// Messages are enumerated ENUM_BATCH_SIZE at a time, in ID order,
+// and marked as handled UPDATE_BATCH_SIZE at a time
+// with a single UPDATE.
+//
+// With --nworkers N, the handler forks N worker processes,
+// each with its own DB connection, that call handle_trickle().
+// A message goes to worker (hostid % N),
+// so a given host's messages are handled in order;
+// there's no ordering between hosts.
+// Each worker has at most WORKER_MAX_QUEUED messages outstanding,
+// so that its replies always fit in the pipe
+// and it can't block while the parent is writing to it.
+//
+// A message to a worker is the MSG_FROM_HOST up to xml,
+// the length of xml, and xml.
+//
+#define ENUM_BATCH_SIZE     1000
+#define UPDATE_BATCH_SIZE   100
+#define WORKER_MAX_QUEUED   100
+
+struct WORKER {
+    int pid;
+    int to_fd;          // parent writes messages here
+    int from_fd;        // worker writes WORKER_REPLYs here
+    int nqueued;
+};
+
+struct WORKER_REPLY {
+    int id;
+    int retval;
+};
+
+static vector<WORKER> workers;
+static vector<int> handled_ids;
+
+static void open_db() {
+    int retval = boinc_db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "boinc_db.open failed: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
+static void worker_main(int in_fd, int out_fd) {
+    static MSG_FROM_HOST mfh;
+    WORKER_REPLY reply;
+    int len;
+
+    open_db();
+    if (handle_trickle_init(g_argc, g_argv)) exit(1);
+    while (1) {
+        if (!read_all(in_fd, &mfh, offsetof(MSG_FROM_HOST, xml))) {
+            // parent has exited
+            //
+            exit(0);
+        }
+        if (!read_all(in_fd, &len, sizeof(len))) exit(1);
+        if (len < 0 || len >= (int)sizeof(mfh.xml)) exit(1);
+        if (len && !read_all(in_fd, mfh.xml, len)) exit(1);
+        mfh.xml[len] = 0;
+
+        reply.id = mfh.id;
+        reply.retval = handle_trickle(mfh);
+        if (!write_all(out_fd, &reply, sizeof(reply))) exit(1);
+    }
+}
+
+// fork the workers.
+// Do this before the parent opens its DB connection,
+// so that the children don't share its socket.
+//
+static void start_workers() {
+    int i, to_worker[2], from_worker[2];
+
+    signal(SIGPIPE, SIG_IGN);
+    for (i=0; i<nworkers; i++) {
+        if (pipe(to_worker) || pipe(from_worker)) {
+            log_messages.printf(MSG_CRITICAL, "pipe() failed; exiting\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            log_messages.printf(MSG_CRITICAL, "fork() failed; exiting\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (unsigned int j=0; j<workers.size(); j++) {
+                close(workers[j].to_fd);
+                close(workers[j].from_fd);
+            }
+            close(to_worker[1]);
+            close(from_worker[0]);
+            log_messages.pid = getpid();
+            worker_main(to_worker[0], from_worker[1]);
+            exit(0);
+        }
+        close(to_worker[0]);
+        close(from_worker[1]);
+        WORKER w;
+        w.pid = pid;
+        w.to_fd = to_worker[1];
+        w.from_fd = from_worker[0];
+        w.nqueued = 0;
+        workers.push_back(w);
+        log_messages.printf(MSG_NORMAL, "started worker %d (PID %d)\n", i, pid);
+    }
+}
+
+static void worker_died(WORKER& w) {
+    log_messages.printf(MSG_CRITICAL,
+        "worker PID %d exited; exiting\n", w.pid
+    );
+    exit(1);
+}
+
+// mark the messages in handled_ids as handled
+//
+static void flush_updates() {
+    DB_MSG_FROM_HOST mfh;
+    int retval;
+
+    if (handled_ids.empty()) return;
+    std::string where_clause = "id in (";
+    for (unsigned int i=0; i<handled_ids.size(); i++) {
+        char buf[32];
+        sprintf(buf, i?",%d":"%d", handled_ids[i]);
+        where_clause += buf;
+    }
+    where_clause += ")";
+    retval = mfh.update_fields_noid("handled=1", where_clause.c_str());
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "batch update of %d messages failed: %s\n",
+            (int)handled_ids.size(), boincerror(retval)
+        );
+        exit(1);
+    }
+    handled_ids.clear();
+}
+
+static void message_done(int id, int retval) {
+    if (retval) {
+        log_messages.printf(MSG_NORMAL,
+            "handle_trickle() failed for message %d: %s\n",
+            id, boincerror(retval)
+        );
+        return;
+    }
+    handled_ids.push_back(id);
+    if (handled_ids.size() >= UPDATE_BATCH_SIZE) {
+        flush_updates();
+    }
+}
+
+// handle a reply from the given worker
+//
+static void handle_reply(WORKER& w) {
+    WORKER_REPLY reply;
+
+    if (!read_all(w.from_fd, &reply, sizeof(reply))) worker_died(w);
+    w.nqueued--;
+    message_done(reply.id, reply.retval);
+}
+
+// wait for a reply from any worker, and handle it
+//
+static void wait_for_reply() {
+    fd_set fds;
+    int maxfd = 0;
+    unsigned int i;
+
+    FD_ZERO(&fds);
+    for (i=0; i<workers.size(); i++) {
+        if (!workers[i].nqueued) continue;
+        FD_SET(workers[i].from_fd, &fds);
+        if (workers[i].from_fd > maxfd) maxfd = workers[i].from_fd;
+    }
+    int n = select(maxfd+1, &fds, NULL, NULL, NULL);
+    if (n < 0) {
+        if (errno == EINTR) return;
+        log_messages.printf(MSG_CRITICAL, "select() failed; exiting\n");
+        exit(1);
+    }
+    for (i=0; i<workers.size(); i++) {
+        if (FD_ISSET(workers[i].from_fd, &fds)) {
+            handle_reply(workers[i]);
+        }
+    }
+}
+
+// send a message to the worker for its host,
+// first waiting for that worker to have room
+//
+static void send_to_worker(MSG_FROM_HOST& mfh) {
+    WORKER& w = workers[mfh.hostid % workers.size()];
+    while (w.nqueued >= WORKER_MAX_QUEUED) {
+        wait_for_reply();
+    }
+    int len = (int)strlen(mfh.xml);
+    if (!write_all(w.to_fd, &mfh, offsetof(MSG_FROM_HOST, xml))
+        || !write_all(w.to_fd, &len, sizeof(len))
+        || (len && !write_all(w.to_fd, mfh.xml, len))
+    ) {
+        worker_died(w);
+    }
+    w.nqueued++;
+}
+
+// wait until all messages sent to workers have been handled,
+// and mark them as handled
+//
+static void drain_workers() {
+    while (1) {
+        bool busy = false;
+        for (unsigned int i=0; i<workers.size(); i++) {
+            if (workers[i].nqueued) busy = true;
+        }
+        if (!busy) break;
+        wait_for_reply();
+    }
+    flush_updates();
+}
 
 // make one pass through trickle_ups with handled == 0
 // return true if there were any
 //
 bool do_trickle_scan() {
     DB_MSG_FROM_HOST mfh;
-    char buf[256];
+    char buf[512], mod_clause[256];
     bool found=false;
-    int retval;
+    int retval, n, last_id = 0;
 
-    sprintf(buf, "where variety='%s' and handled=0", variety);
+    if (host_id_modulus) {
+        sprintf(mod_clause, " and hostid %% %d = %d",
+            host_id_modulus, host_id_remainder
+        );
+    } else {
+        strcpy(mod_clause, "");
+    }
     while (1) {
-        retval = mfh.enumerate(buf);
-        if (retval) {
-            if (retval != ERR_DB_NOT_FOUND) {
-                fprintf(stderr, "lost DB conn\n");
-                exit(1);
+        sprintf(buf,
+            "where variety='%s' and handled=0 and id>%d%s order by id limit %d",
+            variety, last_id, mod_clause, ENUM_BATCH_SIZE
+        );
+        n = 0;
+        while (1) {
+            retval = mfh.enumerate(buf);
+            if (retval) {
+                if (retval != ERR_DB_NOT_FOUND) {
+                    fprintf(stderr, "lost DB conn\n");
+                    exit(1);
+                }
+                break;
             }
-            break;
-        }
-        retval = handle_trickle(mfh);
-        if (!retval) {
-            mfh.handled = true;
-            mfh.update();
+            n++;
+            last_id = mfh.id;
+            if (workers.size()) {
+                send_to_worker(mfh);
+            } else {
+                message_done(mfh.id, handle_trickle(mfh));
+            }
+            found = true;
         }
-        found = true;
+        if (n < ENUM_BATCH_SIZE) break;
     }
+    drain_workers();
     return found;
 }
 
@@ -101,6 +360,8 @@ void usage(char *name) {
         "  --variety X                     Set Variety to X\n"
         "  [ -d X ]                        Set debug level to X\n"
         "  [ --one_pass ]                  Make one pass through table, then exit\n"
+        "  [ --nworkers N ]                Run the handler in N worker processes\n"
+        "  [ --mod N R ]                   Handle only messages from hosts with ID %% N == R\n"
         "  [ -h | --help ]                 Show this help text\n"
         "  [ -v | --version ]              Shows version information\n",
         name
@@ -126,6 +387,25 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             safe_strcpy(variety, argv[i]);
+        } else if (is_arg(argv[i], "nworkers")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL,
+                    "%s requires an argument\n\n", argv[--i]
+                );
+                usage(argv[0]);
+                exit(1);
+            }
+            nworkers = atoi(argv[i]);
+        } else if (is_arg(argv[i], "mod")) {
+            if (!argv[++i] || !argv[i+1]) {
+                log_messages.printf(MSG_CRITICAL,
+                    "%s requires two arguments\n\n", argv[--i]
+                );
+                usage(argv[0]);
+                exit(1);
+            }
+            host_id_modulus = atoi(argv[i]);
+            host_id_remainder = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-d")) {
             if (!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL,
@@ -157,19 +437,19 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    retval = boinc_db.open(
-        config.db_name, config.db_host, config.db_user, config.db_passwd
-    );
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "boinc_db.open failed: %s\n", boincerror(retval)
-        );
-        exit(1);
-    }
-
+    // with --nworkers, the workers call handle_trickle_init()
+    //
     argv[j] = 0;
-    retval = handle_trickle_init(j, argv);
-    if (retval) exit(1);
+    g_argc = j;
+    g_argv = argv;
+    if (nworkers) {
+        start_workers();
+    }
+    open_db();
+    if (!nworkers) {
+        retval = handle_trickle_init(j, argv);
+        if (retval) exit(1);
+    }
 
     log_messages.printf(MSG_NORMAL, "Starting trickle handler\n");
 
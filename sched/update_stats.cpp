@@ -29,14 +29,18 @@
 //  [--update_users]
 //  [--update_hosts]
 //  [--min_age nsec] don't update items updated more recently than this
+//  [--bulk]         decay user and host credit with set-based UPDATEs,
+//                   BULK_CHUNK IDs at a time, rather than row by row
 
 
 #include "config.h"
 #include <cstdio>
+#include <cmath>
 #include <cstring>
 #include <string>
 #include <cstdlib>
 #include <unistd.h>
+#include <map>
 
 #include "boinc_db.h"
 #include "util.h"
@@ -53,7 +57,53 @@
 
 #define MIN_AGE 86400
 
+// with --bulk, update this many IDs per statement
+//
+#define BULK_CHUNK 100000
+
 double max_update_time;
+bool bulk = false;
+
+// Decay the expavg_credit of the idle rows of a user or host table,
+// as update_average() with no new work would,
+// using one UPDATE per range of BULK_CHUNK IDs.
+//
+int bulk_decay(DB_BASE& table, const char* name) {
+    char set_clause[512], where_clause[512];
+    int retval, max_id, id, nupdated=0;
+    double now = dtime();
+
+    retval = table.max_id(max_id);
+    if (retval) {
+        // empty table
+        //
+        return 0;
+    }
+    sprintf(set_clause,
+        "expavg_credit = if(expavg_time>0, "
+        "expavg_credit*exp(-greatest(%f-expavg_time, 0)*%.15e), "
+        "expavg_credit), "
+        "expavg_time=%f",
+        now, M_LN2/CREDIT_HALF_LIFE, now
+    );
+    for (id=0; id<=max_id; id+=BULK_CHUNK) {
+        sprintf(where_clause,
+            "id>=%d and id<%d and expavg_credit>0.1 and expavg_time < %f",
+            id, id+BULK_CHUNK, max_update_time
+        );
+        retval = table.update_fields_noid(set_clause, where_clause);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "Can't update %ss with IDs %d to %d\n",
+                name, id, id+BULK_CHUNK-1
+            );
+            return retval;
+        }
+        nupdated += table.affected_rows();
+    }
+    log_messages.printf(MSG_NORMAL, "updated %d %ss\n", nupdated, name);
+    return 0;
+}
 
 int update_users() {
     DB_USER user;
@@ -61,9 +111,11 @@ int update_users() {
     char buf[256];
     double now = dtime();
 
+    if (bulk) return bulk_decay(user, "user");
+
     while (1) {
-        sprintf(buf, "where expavg_credit>0.1 and expavg_time < %f", max_update_time);
-        retval = user.enumerate(buf);
+        sprintf(buf, "expavg_credit>0.1 and expavg_time < %f", max_update_time);
+        retval = user.enumerate_by_id(buf);
         if (retval) {
             if (retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_CRITICAL, "lost DB conn\n");
@@ -93,9 +145,11 @@ int update_hosts() {
     char buf[256];
     double now = dtime();
 
+    if (bulk) return bulk_decay(host, "host");
+
     while (1) {
-        sprintf(buf, "where expavg_credit>0.1 and expavg_time < %f", max_update_time);
-        retval = host.enumerate(buf);
+        sprintf(buf, "expavg_credit>0.1 and expavg_time < %f", max_update_time);
+        retval = host.enumerate_by_id(buf);
         if (retval) {
             if (retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_CRITICAL, "lost DB conn\n");
@@ -120,17 +174,30 @@ int update_hosts() {
     return 0;
 }
 
-int get_team_totals(TEAM& team) {
-    int nusers;
-    int retval;
-    DB_USER user;
-    char buf[256];
+// get the number of users on each team, in one pass
+//
+int get_team_counts(std::map<int, int>& counts) {
+    MYSQL_RES* rp;
+    MYSQL_ROW row;
 
-    // count the number of users on the team
-    //
-    sprintf(buf, "where teamid=%d", team.id);
-    retval = user.count(nusers, buf);
+    int retval = boinc_db.do_query(
+        "select teamid, count(*) from user where teamid>0 group by teamid"
+    );
     if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    while ((row = mysql_fetch_row(rp))) {
+        counts[atoi(row[0])] = atoi(row[1]);
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
+void get_team_totals(TEAM& team, std::map<int, int>& counts) {
+    int nusers = 0;
+
+    std::map<int, int>::iterator i = counts.find(team.id);
+    if (i != counts.end()) nusers = i->second;
 
     if (team.nusers != nusers) {
         log_messages.printf(MSG_CRITICAL,
@@ -139,8 +206,6 @@ int get_team_totals(TEAM& team) {
         );
     }
     team.nusers = nusers;
-
-    return 0;
 }
 
 // fill in the nusers, total_credit and expavg_credit fields
@@ -152,9 +217,18 @@ int update_teams() {
     int retval;
     char buf[256];
     double now = dtime();
+    std::map<int, int> counts;
+
+    retval = get_team_counts(counts);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "update_teams: can't count team members: %s\n", boincerror(retval)
+        );
+        return retval;
+    }
 
     while (1) {
-        retval = team.enumerate("where expavg_credit>0.1");
+        retval = team.enumerate_by_id("expavg_credit>0.1");
         if (retval) {
             if (retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_CRITICAL, "lost DB conn\n");
@@ -163,15 +237,7 @@ int update_teams() {
             break;
         }
 
-        retval = get_team_totals(team);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL,
-                "update_teams: get_team_credit([TEAM#%d]) failed: %d\n",
-                team.id,
-                retval
-            );
-            continue;
-        }
+        get_team_totals(team, counts);
         if (team.expavg_time < max_update_time) {
             update_average(
                 now, 0, 0, CREDIT_HALF_LIFE, team.expavg_credit,
@@ -205,6 +271,8 @@ void usage(char *name) {
         "  [ --update_teams ]              Updates teams.\n"
         "  [ --update_users ]              Updates users.\n"
         "  [ --update_hosts ]              Updates hosts.\n"
+        "  [ --bulk ]                      Update users and hosts with\n"
+        "                                  set-based queries\n"
         "  [ -h | --help ]                 Shows this help text\n"
         "  [ -v | --version ]              Shows version information\n",
         name
@@ -228,6 +296,8 @@ int main(int argc, char** argv) {
             do_update_users = true;
         } else if (is_arg(argv[i], "update_hosts")) {
             do_update_hosts = true;
+        } else if (is_arg(argv[i], "bulk")) {
+            bulk = true;
         } else if (is_arg(argv[i], "min_age")) {
             double x = atof(argv[++i]);
             max_update_time = time(0) - x;
@@ -0,0 +1,315 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// upload_replicator: copy staged uploads to the upload store
+// (see upload_storage.h).
+// Run this on the host that runs file_upload_handler,
+// if <upload_stage_dir> is set in config.xml.
+//
+// Each pass:
+// - find the NAME.ready files in the upload_stage_dir hierarchy,
+//   and for each, copy NAME to the store and move it to upload_cache_dir.
+//   N threads take fanout dirs in turn (see dir_walk.h).
+// - every CACHE_TRIM_PERIOD seconds, if <upload_cache_max_mb> is set,
+//   delete the oldest files in upload_cache_dir
+//   until they total less than that.
+//   They can be fetched from the store if they're needed again.
+
+#include "config.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "str_util.h"
+#include "svn_version.h"
+#include "util.h"
+
+#include "daemon_metrics.h"
+#include "dir_walk.h"
+#include "sched_config.h"
+#include "sched_msgs.h"
+#include "sched_util.h"
+#include "upload_storage.h"
+
+using std::string;
+using std::vector;
+
+#define DEFAULT_SLEEP_INTERVAL  5
+#define DEFAULT_NTHREADS        4
+#define CACHE_TRIM_PERIOD       600
+
+static int sleep_interval = DEFAULT_SLEEP_INTERVAL;
+static int nthreads = DEFAULT_NTHREADS;
+static int m_files, m_errors;
+
+// the ready files in a fanout dir
+//
+struct REPLICATE_DIR {
+    string path;
+    int error;              // errno from scanning the dir, or 0
+    vector<string> names;
+    vector<int> retvals;    // from upload_replicate()
+};
+
+static int scan_ready(
+    int, const char*, const char* name, struct stat&, int, void* arg
+) {
+    REPLICATE_DIR& rd = *(REPLICATE_DIR*)arg;
+    if (!ends_with(name, UPLOAD_READY_SUFFIX)) return 0;
+    string s = name;
+    s.erase(s.size() - strlen(UPLOAD_READY_SUFFIX));
+    rd.names.push_back(s);
+    return 0;
+}
+
+// find and replicate the ready files in a dir (called by run_dir_workers())
+//
+static void replicate_dir(int i, void* arg) {
+    REPLICATE_DIR& rd = (*(vector<REPLICATE_DIR>*)arg)[i];
+    rd.error = scan_dir(rd.path.c_str(), scan_ready, &rd);
+    if (rd.error) return;
+    for (unsigned int j=0; j<rd.names.size(); j++) {
+        rd.retvals.push_back(upload_replicate(rd.names[j].c_str()));
+    }
+}
+
+// return true if we replicated anything
+//
+static bool do_replicate() {
+    vector<string> dirs;
+    vector<REPLICATE_DIR> rdirs;
+    unsigned int i, j;
+    int nfiles = 0, nerrors = 0;
+
+    fanout_dirs(config.upload_stage_dir, config.uldl_dir_fanout, dirs);
+    rdirs.resize(dirs.size());
+    for (i=0; i<dirs.size(); i++) {
+        rdirs[i].path = dirs[i];
+    }
+    run_dir_workers((int)rdirs.size(), nthreads, replicate_dir, &rdirs);
+
+    for (i=0; i<rdirs.size(); i++) {
+        REPLICATE_DIR& rd = rdirs[i];
+        if (rd.error && rd.error != ENOENT) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't scan %s: %s\n", rd.path.c_str(), strerror(rd.error)
+            );
+            continue;
+        }
+        for (j=0; j<rd.names.size(); j++) {
+            const char* name = rd.names[j].c_str();
+            int retval = rd.retvals[j];
+            if (retval == ERR_NOT_FOUND) {
+                log_messages.printf(MSG_DEBUG, "%s is gone\n", name);
+            } else if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "can't replicate %s: %s\n", name, boincerror(retval)
+                );
+                nerrors++;
+            } else {
+                log_messages.printf(MSG_NORMAL, "replicated %s\n", name);
+                nfiles++;
+            }
+        }
+    }
+    daemon_metrics.add(m_files, nfiles);
+    daemon_metrics.add(m_errors, nerrors);
+    return nfiles > 0;
+}
+
+struct CACHE_FILE {
+    string path;
+    double size;
+    double mtime;
+
+    bool operator<(const CACHE_FILE& f) const {
+        return mtime < f.mtime;
+    }
+};
+
+static int scan_cache(
+    int, const char* dir, const char* name, struct stat& sbuf,
+    int stat_errno, void* arg
+) {
+    vector<CACHE_FILE>& files = *(vector<CACHE_FILE>*)arg;
+    if (stat_errno || !S_ISREG(sbuf.st_mode)) return 0;
+
+    // skip MD5 files (deleted with their file)
+    // and fetches in progress
+    //
+    if (ends_with(name, UPLOAD_MD5_SUFFIX)) return 0;
+    if (strstr(name, ".tmp")) return 0;
+    CACHE_FILE cf;
+    cf.path = string(dir) + "/" + name;
+    cf.size = (double)sbuf.st_size;
+    cf.mtime = (double)sbuf.st_mtime;
+    files.push_back(cf);
+    return 0;
+}
+
+// delete the oldest cached files until they total less than max_bytes
+//
+static void trim_cache(double max_bytes) {
+    vector<string> dirs;
+    vector<CACHE_FILE> files;
+    double total = 0;
+    unsigned int i;
+    int n = 0;
+
+    fanout_dirs(config.upload_cache_dir, config.uldl_dir_fanout, dirs);
+    for (i=0; i<dirs.size(); i++) {
+        scan_dir(dirs[i].c_str(), scan_cache, &files);
+    }
+    for (i=0; i<files.size(); i++) {
+        total += files[i].size;
+    }
+    log_messages.printf(MSG_DEBUG,
+        "cache has %d files, %.0f MB\n", (int)files.size(), total/MEGA
+    );
+    if (total <= max_bytes) return;
+    std::sort(files.begin(), files.end());
+    for (i=0; i<files.size() && total > max_bytes; i++) {
+        CACHE_FILE& cf = files[i];
+        if (unlink(cf.path.c_str()) && errno != ENOENT) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't delete %s: %s\n", cf.path.c_str(), strerror(errno)
+            );
+            continue;
+        }
+        string md5_path = cf.path + UPLOAD_MD5_SUFFIX;
+        unlink(md5_path.c_str());
+        total -= cf.size;
+        n++;
+    }
+    log_messages.printf(MSG_NORMAL,
+        "deleted %d files from cache; %.0f MB left\n", n, total/MEGA
+    );
+}
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Copies staged uploads to the upload store.\n\n"
+        "Usage: %s [OPTION]...\n\n"
+        "Options:\n"
+        "  --nthreads N                    replicate files in N fanout dirs\n"
+        "                                  at a time (default %d)\n"
+        "  --sleep_interval N              sleep N seconds if nothing to do\n"
+        "  --one_pass                      do one pass, then exit\n"
+        "  [ -d X ]                        set debug level to X\n"
+        "  [ -h | --help ]                 shows this help text\n"
+        "  [ -v | --version ]              shows version information\n",
+        name, DEFAULT_NTHREADS
+    );
+}
+
+int main(int argc, char** argv) {
+    int i, retval;
+    bool one_pass = false;
+    double next_trim_time = 0;
+
+    check_stop_daemons();
+
+    for (i=1; i<argc; i++) {
+        if (is_arg(argv[i], "one_pass")) {
+            one_pass = true;
+        } else if (is_arg(argv[i], "d") || is_arg(argv[i], "debug_level")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            log_messages.set_debug_level(atoi(argv[i]));
+        } else if (is_arg(argv[i], "nthreads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
+        } else if (is_arg(argv[i], "sleep_interval")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            sleep_interval = atoi(argv[i]);
+        } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
+            usage(argv[0]);
+            exit(0);
+        } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else {
+            log_messages.printf(MSG_CRITICAL, "unknown command line argument: %s\n\n", argv[i]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    retval = config.parse_file();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't parse config.xml: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+    if (!upload_staging()) {
+        log_messages.printf(MSG_CRITICAL,
+            "<upload_stage_dir> isn't set in config.xml\n"
+        );
+        exit(1);
+    }
+
+    // create the store before starting threads
+    //
+    upload_store();
+
+    log_messages.printf(MSG_NORMAL,
+        "Starting: %s -> %s\n", config.upload_stage_dir,
+        strlen(config.upload_store_cmd)?config.upload_store_cmd:config.upload_dir
+    );
+
+    install_stop_signal_handler();
+
+    daemon_metrics.open("upload_replicator");
+    m_files = daemon_metrics.define(
+        "upload_replicator_files", METRIC_COUNTER, "files copied to the upload store"
+    );
+    m_errors = daemon_metrics.define(
+        "upload_replicator_errors", METRIC_COUNTER, "files that couldn't be copied"
+    );
+
+    while (1) {
+        check_stop_daemons();
+        bool did_something = do_replicate();
+        if (config.upload_cache_max_mb && dtime() > next_trim_time) {
+            trim_cache(config.upload_cache_max_mb*MEGA);
+            next_trim_time = dtime() + CACHE_TRIM_PERIOD;
+        }
+        if (one_pass) break;
+        if (!did_something) {
+            daemon_sleep(sleep_interval, "upload_replicator");
+        }
+    }
+}
@@ -0,0 +1,328 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Storage of uploaded files; see upload_storage.h
+//
+// These functions make only system calls (no logging or DB access),
+// so that upload_replicator can call them from several threads.
+
+#include "config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "str_replace.h"
+
+#include "sched_config.h"
+#include "sched_util.h"
+
+#include "upload_storage.h"
+
+// the upload_dir hierarchy
+//
+struct DIR_STORE : UPLOAD_STORE {
+    int put(const char* name, const char* path) {
+        char dst[MAXPATHLEN], tmp[MAXPATHLEN];
+        int retval = dir_hier_path(
+            name, config.upload_dir, config.uldl_dir_fanout, dst, true
+        );
+        if (retval) return retval;
+
+        // copy to a temp file, so that readers never see part of the file
+        //
+        snprintf(tmp, sizeof(tmp), "%s.tmp%d", dst, (int)getpid());
+        retval = boinc_copy(path, tmp);
+        if (retval) {
+            unlink(tmp);
+            return retval;
+        }
+        if (rename(tmp, dst)) {
+            unlink(tmp);
+            return ERR_RENAME;
+        }
+        return 0;
+    }
+    int get(const char* name, const char* path) {
+        char src[MAXPATHLEN];
+        dir_hier_path(name, config.upload_dir, config.uldl_dir_fanout, src);
+        if (!boinc_file_exists(src)) return ERR_NOT_FOUND;
+        return boinc_copy(src, path);
+    }
+    int remove(const char* name) {
+        char path[MAXPATHLEN];
+        dir_hier_path(name, config.upload_dir, config.uldl_dir_fanout, path);
+        if (unlink(path)) {
+            return (errno == ENOENT)?ERR_NOT_FOUND:ERR_UNLINK;
+        }
+        return 0;
+    }
+};
+
+// a program (<upload_store_cmd>)
+//
+struct CMD_STORE : UPLOAD_STORE {
+    char cmd[MAXPATHLEN];
+
+    CMD_STORE() {
+        if (config.upload_store_cmd[0] == '/') {
+            safe_strcpy(cmd, config.upload_store_cmd);
+        } else {
+            safe_strcpy(cmd, config.project_path("%s", config.upload_store_cmd));
+        }
+    }
+
+    int run(const char* op, const char* name, const char* path) {
+        char* argv[5];
+        int status;
+
+        argv[0] = cmd;
+        argv[1] = (char*)op;
+        argv[2] = (char*)name;
+        argv[3] = (char*)path;
+        argv[4] = NULL;
+        pid_t pid = fork();
+        if (pid < 0) return ERR_FORK;
+        if (pid == 0) {
+            execv(cmd, argv);
+            _exit(127);
+        }
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) return ERR_EXEC;
+        }
+        if (!WIFEXITED(status)) return ERR_EXEC;
+        switch (WEXITSTATUS(status)) {
+        case 0:
+            return 0;
+        case UPLOAD_STORE_NOT_FOUND:
+            return ERR_NOT_FOUND;
+        }
+        return ERR_EXEC;
+    }
+    int put(const char* name, const char* path) {
+        return run("put", name, path);
+    }
+    int get(const char* name, const char* path) {
+        return run("get", name, path);
+    }
+    int remove(const char* name) {
+        return run("delete", name, NULL);
+    }
+};
+
+UPLOAD_STORE* upload_store() {
+    static UPLOAD_STORE* store = NULL;
+    if (!store) {
+        if (strlen(config.upload_store_cmd)) {
+            store = new CMD_STORE;
+        } else {
+            store = new DIR_STORE;
+        }
+    }
+    return store;
+}
+
+bool upload_staging() {
+    return strlen(config.upload_stage_dir) > 0;
+}
+
+static inline int stage_path(const char* name, char* path, bool create) {
+    return dir_hier_path(
+        name, config.upload_stage_dir, config.uldl_dir_fanout, path, create
+    );
+}
+
+// the cache dir may be the default, so create it if needed
+//
+static inline int cache_path(const char* name, char* path, bool create) {
+    if (create && boinc_mkdir(config.upload_cache_dir) && errno != EEXIST) {
+        return ERR_MKDIR;
+    }
+    return dir_hier_path(
+        name, config.upload_cache_dir, config.uldl_dir_fanout, path, create
+    );
+}
+
+int upload_write_path(const char* name, char* path) {
+    if (!upload_staging()) {
+        return dir_hier_path(
+            name, config.upload_dir, config.uldl_dir_fanout, path, true
+        );
+    }
+    return stage_path(name, path, true);
+}
+
+int upload_write_done(const char* name) {
+    char path[MAXPATHLEN];
+
+    if (!upload_staging()) return 0;
+    int retval = stage_path(name, path, true);
+    if (retval) return retval;
+    safe_strcat(path, UPLOAD_READY_SUFFIX);
+    int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+    if (fd < 0) return ERR_FOPEN;
+    close(fd);
+    return 0;
+}
+
+// get a file from the store into the cache dir
+//
+static int fetch(const char* name, const char* path) {
+    char tmp[MAXPATHLEN];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+    int retval = upload_store()->get(name, tmp);
+    if (retval) {
+        unlink(tmp);
+        return retval;
+    }
+    if (rename(tmp, path)) {
+        unlink(tmp);
+        return ERR_RENAME;
+    }
+    return 0;
+}
+
+int upload_read_path(const char* name, char* path) {
+    char md5_name[256], md5_path[MAXPATHLEN];
+    int retval;
+
+    if (!upload_staging()) {
+        return dir_hier_path(
+            name, config.upload_dir, config.uldl_dir_fanout, path
+        );
+    }
+
+    // upload_replicator moves files from the stage dir to the cache dir,
+    // so look in the cache dir again if the file isn't staged
+    //
+    cache_path(name, path, false);
+    if (boinc_file_exists(path)) return 0;
+    stage_path(name, path, false);
+    if (boinc_file_exists(path)) return 0;
+    retval = cache_path(name, path, true);
+    if (retval) return ERR_OPENDIR;
+    if (boinc_file_exists(path)) return 0;
+
+    retval = fetch(name, path);
+    if (retval == ERR_NOT_FOUND) return 0;
+    if (retval) return ERR_OPENDIR;
+    if (config.upload_md5) {
+        snprintf(md5_name, sizeof(md5_name), "%s%s", name, UPLOAD_MD5_SUFFIX);
+        snprintf(md5_path, sizeof(md5_path), "%s%s", path, UPLOAD_MD5_SUFFIX);
+        fetch(md5_name, md5_path);
+    }
+    return 0;
+}
+
+int upload_replicate(const char* name) {
+    char spath[MAXPATHLEN], cpath[MAXPATHLEN], ready_path[MAXPATHLEN];
+    char md5_name[256], smd5_path[MAXPATHLEN], cmd5_path[MAXPATHLEN];
+    int retval;
+
+    stage_path(name, spath, false);
+    snprintf(ready_path, sizeof(ready_path), "%s%s", spath, UPLOAD_READY_SUFFIX);
+    retval = cache_path(name, cpath, true);
+    if (retval) return retval;
+
+    // if we were interrupted after moving the file, just finish up
+    //
+    if (!boinc_file_exists(spath)) {
+        unlink(ready_path);
+        return boinc_file_exists(cpath)?0:ERR_NOT_FOUND;
+    }
+
+    retval = upload_store()->put(name, spath);
+    if (retval) return retval;
+    snprintf(md5_name, sizeof(md5_name), "%s%s", name, UPLOAD_MD5_SUFFIX);
+    snprintf(smd5_path, sizeof(smd5_path), "%s%s", spath, UPLOAD_MD5_SUFFIX);
+    snprintf(cmd5_path, sizeof(cmd5_path), "%s%s", cpath, UPLOAD_MD5_SUFFIX);
+    if (boinc_file_exists(smd5_path)) {
+        retval = upload_store()->put(md5_name, smd5_path);
+        if (retval) return retval;
+        rename(smd5_path, cmd5_path);
+    }
+
+    if (rename(spath, cpath)) {
+        if (errno != ENOENT) return ERR_RENAME;
+
+        // file_deleter deleted it while we were copying it
+        //
+        upload_store()->remove(name);
+        upload_store()->remove(md5_name);
+        unlink(cmd5_path);
+    }
+    unlink(ready_path);
+    return 0;
+}
+
+// unlink a file; return 1 if it was there
+//
+static int unlink_file(const char* path, int& retval) {
+    if (!unlink(path)) return 1;
+    if (errno != ENOENT) retval = ERR_UNLINK;
+    return 0;
+}
+
+int upload_delete(const char* name, bool md5) {
+    char path[MAXPATHLEN], buf[MAXPATHLEN], md5_name[256];
+    int retval = 0, n = 0, r;
+
+    if (!upload_staging()) {
+        dir_hier_path(name, config.upload_dir, config.uldl_dir_fanout, path);
+        n += unlink_file(path, retval);
+        if (md5) {
+            snprintf(buf, sizeof(buf), "%s%s", path, UPLOAD_MD5_SUFFIX);
+            unlink(buf);
+        }
+        if (retval) return retval;
+        return n?0:ERR_NOT_FOUND;
+    }
+
+    // delete the ready marker first, so that upload_replicator
+    // doesn't copy the file to the store after we delete it there
+    //
+    stage_path(name, path, false);
+    snprintf(buf, sizeof(buf), "%s%s", path, UPLOAD_READY_SUFFIX);
+    unlink(buf);
+    n += unlink_file(path, retval);
+    snprintf(buf, sizeof(buf), "%s%s", path, UPLOAD_MD5_SUFFIX);
+    unlink(buf);
+
+    cache_path(name, path, false);
+    n += unlink_file(path, retval);
+    snprintf(buf, sizeof(buf), "%s%s", path, UPLOAD_MD5_SUFFIX);
+    unlink(buf);
+
+    r = upload_store()->remove(name);
+    if (!r) {
+        n++;
+    } else if (r != ERR_NOT_FOUND) {
+        retval = r;
+    }
+    if (md5) {
+        snprintf(md5_name, sizeof(md5_name), "%s%s", name, UPLOAD_MD5_SUFFIX);
+        upload_store()->remove(md5_name);
+    }
+    if (retval) return retval;
+    return n?0:ERR_NOT_FOUND;
+}
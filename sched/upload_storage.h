@@ -0,0 +1,106 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Where uploaded (output) files are kept.
+//
+// By default, file_upload_handler writes uploads to the upload_dir
+// hierarchy, and validators, assimilators and file_deleter use them there.
+// If upload_dir is on a shared file system,
+// it's on the critical path of all of these.
+//
+// With <upload_stage_dir> in config.xml:
+// - file_upload_handler writes uploads to that directory
+//   (fast local disk; same fanout as upload_dir).
+//   When an upload is complete it creates NAME.ready next to it.
+// - upload_replicator copies ready files to the upload store,
+//   then moves them to <upload_cache_dir>
+//   (default upload_stage_dir/cache; must be on the same file system).
+// - validators and assimilators (get_output_file_info() etc.)
+//   use the file in the cache dir, or in the stage dir
+//   if it hasn't been replicated yet;
+//   otherwise they get it from the store into the cache dir.
+// - file_deleter deletes files from all of these.
+//
+// The upload store is either
+// - the upload_dir hierarchy (default), or
+// - a program, <upload_store_cmd>, run as
+//      cmd put NAME PATH       copy local file PATH to the store
+//      cmd get NAME PATH       copy NAME from the store to PATH
+//      cmd delete NAME
+//   which exits with 0 on success, or UPLOAD_STORE_NOT_FOUND
+//   if NAME isn't in the store (get, delete).
+//   E.g. a script that uses an object store's command-line client.
+//   A relative path is relative to the project dir.
+//
+// Validators and assimilators on other hosts don't see the stage dir,
+// so they may find a file missing if it hasn't been replicated yet.
+// Run them on the upload server, or don't stage uploads.
+
+#ifndef BOINC_UPLOAD_STORAGE_H
+#define BOINC_UPLOAD_STORAGE_H
+
+#define UPLOAD_READY_SUFFIX     ".ready"
+#define UPLOAD_STORE_NOT_FOUND  2
+
+struct UPLOAD_STORE {
+    virtual ~UPLOAD_STORE() {}
+    virtual int put(const char* name, const char* path) = 0;
+    virtual int get(const char* name, const char* path) = 0;
+        // return ERR_NOT_FOUND if name isn't there
+    virtual int remove(const char* name) = 0;
+        // return ERR_NOT_FOUND if name isn't there
+};
+
+// the store selected by config.xml.
+// Call this before using it from several threads.
+//
+extern UPLOAD_STORE* upload_store();
+
+// whether uploads are staged (<upload_stage_dir> is set)
+//
+extern bool upload_staging();
+
+// the path where file_upload_handler writes an upload;
+// the directory is created if needed
+//
+extern int upload_write_path(const char* name, char* path);
+
+// file_upload_handler has the whole file
+//
+extern int upload_write_done(const char* name);
+
+// a local path from which to read an uploaded file.
+// If the file isn't local (staged or cached) get it from the store.
+// If it's not there either, return zero and a path that doesn't exist,
+// as for a missing file in upload_dir.
+// Return ERR_OPENDIR (a transient error for validators)
+// if the store couldn't be read.
+//
+extern int upload_read_path(const char* name, char* path);
+
+// copy a staged file to the store and move it to the cache dir
+// (called by upload_replicator)
+//
+extern int upload_replicate(const char* name);
+
+// delete an uploaded file (and its MD5 file if md5 is set)
+// from the stage dir, cache dir and store.
+// Return ERR_NOT_FOUND if it wasn't anywhere.
+//
+extern int upload_delete(const char* name, bool md5);
+
+#endif
@@ -22,16 +22,23 @@
 
 #include <cstring>
 #include "config.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "error_numbers.h"
 #include "filesys.h"
+#include "md5_file.h"
 #include "parse.h"
 #include "str_replace.h"
+#include "str_util.h"
 #include "util.h"
 
 #include "sched_util.h"
 #include "sched_config.h"
 #include "sched_msgs.h"
+#include "upload_storage.h"
 #include "validator.h"
 #include "validate_util.h"
 
@@ -75,10 +82,8 @@ int get_output_file_info(RESULT& result, OUTPUT_FILE_INFO& fi) {
             if (standalone) {
                 safe_strcpy(path, fi.name.c_str());
             } else {
-                dir_hier_path(
-                    fi.name.c_str(), config.upload_dir,
-                    config.uldl_dir_fanout, path
-                );
+                retval = upload_read_path(fi.name.c_str(), path);
+                if (retval) return retval;
             }
             fi.path = path;
             return 0;
@@ -103,10 +108,8 @@ int get_output_file_infos(RESULT& result, vector<OUTPUT_FILE_INFO>& fis) {
             if (standalone) {
                 safe_strcpy(path, fi.name.c_str());
             } else {
-                dir_hier_path(
-                    fi.name.c_str(), config.upload_dir,
-                    config.uldl_dir_fanout, path
-                );
+                retval = upload_read_path(fi.name.c_str(), path);
+                if (retval) return retval;
             }
             fi.path = path;
             fis.push_back(fi);
@@ -185,6 +188,103 @@ int get_logical_name(RESULT& result, string& path, string& name) {
     return ERR_XML_PARSE;
 }
 
+////////// memory-mapped access to output files ///////////////
+
+struct MAPPED_FILE {
+    string path;
+    void* addr;
+    size_t size;
+};
+
+// files mapped while handling the current WU
+//
+static vector<MAPPED_FILE> mapped_files;
+
+static void unmap_file(MAPPED_FILE& mf) {
+    if (mf.size) munmap(mf.addr, mf.size);
+}
+
+int map_output_file(const string& path, const char*& data, size_t& size) {
+    unsigned int i;
+    struct stat sbuf;
+
+    for (i=0; i<mapped_files.size(); i++) {
+        if (mapped_files[i].path == path) {
+            data = (const char*)mapped_files[i].addr;
+            size = mapped_files[i].size;
+            return 0;
+        }
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return ERR_FOPEN;
+    if (fstat(fd, &sbuf)) {
+        close(fd);
+        return ERR_READ;
+    }
+    MAPPED_FILE mf;
+    mf.path = path;
+    mf.size = sbuf.st_size;
+    if (mf.size) {
+        mf.addr = mmap(NULL, mf.size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mf.addr == MAP_FAILED) {
+            close(fd);
+            return ERR_READ;
+        }
+        madvise(mf.addr, mf.size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(mf.addr, mf.size, MADV_HUGEPAGE);
+#endif
+    } else {
+        mf.addr = (void*)"";
+    }
+    close(fd);
+    mapped_files.push_back(mf);
+    data = (const char*)mf.addr;
+    size = mf.size;
+    return 0;
+}
+
+void release_output_files() {
+    for (unsigned int i=0; i<mapped_files.size(); i++) {
+        unmap_file(mapped_files[i]);
+    }
+    mapped_files.clear();
+}
+
+// read the MD5 that file_upload_handler wrote when the file arrived.
+// Ignore it if the file has been modified since then.
+//
+static int read_upload_md5(const string& path, char* md5) {
+    struct stat sbuf, md5_sbuf;
+    char buf[64];
+
+    string md5_path = path + UPLOAD_MD5_SUFFIX;
+    if (stat(path.c_str(), &sbuf)) return ERR_FOPEN;
+    if (stat(md5_path.c_str(), &md5_sbuf)) return ERR_FOPEN;
+    if (md5_sbuf.st_mtime < sbuf.st_mtime) return ERR_NOT_FOUND;
+    FILE* f = boinc_fopen(md5_path.c_str(), "r");
+    if (!f) return ERR_FOPEN;
+    char* p = fgets(buf, sizeof(buf), f);
+    fclose(f);
+    if (!p) return ERR_READ;
+    strip_whitespace(buf);
+    if (strlen(buf) != 32) return ERR_XML_PARSE;
+    strcpy(md5, buf);
+    return 0;
+}
+
+int get_output_file_md5(const string& path, char* md5) {
+    const char* data;
+    size_t size;
+
+    if (!read_upload_md5(path, md5)) return 0;
+    int retval = map_output_file(path, data, size);
+    if (retval) return retval;
+    md5_block((const unsigned char*)data, (int)size, md5);
+    return 0;
+}
+
 int get_credit_from_wu(WORKUNIT& wu, vector<RESULT>&, double& credit) {
     double x;
     int retval;
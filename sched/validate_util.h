@@ -35,6 +35,10 @@ struct OUTPUT_FILE_INFO {
     int parse(XML_PARSER&);
 };
 
+// The paths are local; if uploads are staged (see upload_storage.h)
+// files may be fetched from the upload store to do this.
+// If that fails these return ERR_OPENDIR (a transient error).
+//
 extern int get_output_file_info(RESULT& result, OUTPUT_FILE_INFO&);
 extern int get_output_file_infos(RESULT& result, std::vector<OUTPUT_FILE_INFO>&);
 extern int get_output_file_path(RESULT& result, std::string&);
@@ -43,6 +47,27 @@ extern int get_logical_name(
     RESULT& result, std::string& path, std::string& name
 );
 
+// Get a read-only memory-mapped view of an output file
+// (e.g. a path returned by the above).
+// The data is not NUL-terminated.
+// Views are cached by path, so comparing several results
+// against the same one doesn't reread its files;
+// they stay valid until release_output_files() is called,
+// which the validator does after handling each WU.
+//
+extern int map_output_file(
+    const std::string& path, const char*& data, size_t& size
+);
+extern void release_output_files();
+
+// Get the MD5 of an output file.
+// If file_upload_handler computed it as the file arrived
+// (<upload_md5> in config.xml) use that, so the file isn't read;
+// otherwise compute it from the mapped file.
+// md5 must have room for MD5_LEN chars.
+//
+extern int get_output_file_md5(const std::string& path, char* md5);
+
 extern int get_credit_from_wu(WORKUNIT&, std::vector<RESULT>& results, double&);
 
 extern bool standalone;
@@ -21,13 +21,16 @@
 //
 
 #include "config.h"
+#include <algorithm>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 
 
 #include "boinc_db.h"
 #include "error_numbers.h"
+#include "util.h"
 
 #include "sched_config.h"
 #include "sched_msgs.h"
@@ -38,6 +41,72 @@
 
 using std::vector;
 
+VALIDATE_TIMES* validate_times = NULL;
+
+void CALLBACK_TIMES::clear() {
+    memset(this, 0, sizeof(*this));
+}
+
+void CALLBACK_TIMES::add(double secs) {
+    int i;
+    double bound = 1e-6;
+    for (i=0; i<CALLBACK_NBUCKETS-1; i++) {
+        if (secs < bound) break;
+        bound *= 2;
+    }
+    buckets[i]++;
+    n++;
+    total += secs;
+    if (secs > max) max = secs;
+}
+
+void CALLBACK_TIMES::merge(CALLBACK_TIMES& c) {
+    for (int i=0; i<CALLBACK_NBUCKETS; i++) {
+        buckets[i] += c.buckets[i];
+    }
+    n += c.n;
+    total += c.total;
+    if (c.max > max) max = c.max;
+}
+
+double CALLBACK_TIMES::percentile(double frac) {
+    double x = 0, bound = 1e-6;
+    for (int i=0; i<CALLBACK_NBUCKETS; i++) {
+        x += buckets[i];
+        if (x >= frac*n) return std::min(bound, max);
+        bound *= 2;
+    }
+    return max;
+}
+
+// call the project's functions, timing them if needed
+//
+static inline int timed_init_result(RESULT& r, void*& data) {
+    if (!validate_times) return init_result(r, data);
+    double t = dtime();
+    int retval = init_result(r, data);
+    validate_times->init_result.add(dtime() - t);
+    return retval;
+}
+
+static inline int timed_compare_results(
+    RESULT& r1, void* data1, RESULT const& r2, void* data2, bool& match
+) {
+    if (!validate_times) return compare_results(r1, data1, r2, data2, match);
+    double t = dtime();
+    int retval = compare_results(r1, data1, r2, data2, match);
+    validate_times->compare_results.add(dtime() - t);
+    return retval;
+}
+
+static inline int timed_cleanup_result(RESULT const& r, void* data) {
+    if (!validate_times) return cleanup_result(r, data);
+    double t = dtime();
+    int retval = cleanup_result(r, data);
+    validate_times->cleanup_result.add(dtime() - t);
+    return retval;
+}
+
 // Given a set of results:
 // 1) call init_result() for each one;
 //    this detects results with bad or missing output files
@@ -81,7 +150,7 @@ int check_set(
     }
     int good_results = 0;
     for (i=0; i<n; i++) {
-        retval = init_result(results[i], data[i]);
+        retval = timed_init_result(results[i], data[i]);
         if (retval == ERR_OPENDIR) {
             log_messages.printf(MSG_CRITICAL,
                 "check_set: init_result([RESULT#%u %s]) transient failure\n",
@@ -116,7 +185,7 @@ int check_set(
             if (i == j) {
                 ++neq;
                 matches[j] = true;
-            } else if (compare_results(results[i], data[i], results[j], data[j], match)) {
+            } else if (timed_compare_results(results[i], data[i], results[j], data[j], match)) {
                 log_messages.printf(MSG_CRITICAL,
                     "generic_check_set: check_pair_with_data([RESULT#%u %s], [RESULT#%u %s]) failed\n",
                     results[i].id, results[i].name, results[j].id, results[j].name
@@ -142,7 +211,7 @@ int check_set(
 cleanup:
 
     for (i=0; i<n; i++) {
-        cleanup_result(results[i], data[i]);
+        timed_cleanup_result(results[i], data[i]);
     }
     return 0;
 }
@@ -156,7 +225,7 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
     bool match;
 
     retry = false;
-    retval = init_result(r1, data1);
+    retval = timed_init_result(r1, data1);
     if (retval == ERR_OPENDIR) {
         log_messages.printf(MSG_CRITICAL,
             "check_pair: init_result([RESULT#%u %s]) transient failure 1\n",
@@ -174,13 +243,13 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
         return;
     }
 
-    retval = init_result(r2, data2);
+    retval = timed_init_result(r2, data2);
     if (retval == ERR_OPENDIR) {
         log_messages.printf(MSG_CRITICAL,
             "check_pair: init_result([RESULT#%u %s]) transient failure 2\n",
             r2.id, r2.name
         );
-        cleanup_result(r1, data1);
+        timed_cleanup_result(r1, data1);
         retry = true;
         return;
     } else if (retval) {
@@ -188,14 +257,14 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
             "check_pair: init_result([RESULT#%u %s]) perm failure2\n",
             r2.id, r2.name
         );
-        cleanup_result(r1, data1);
+        timed_cleanup_result(r1, data1);
         r1.outcome = RESULT_OUTCOME_VALIDATE_ERROR;
         r1.validate_state = VALIDATE_STATE_INVALID;
         return;
     }
 
-    retval = compare_results(r1, data1, r2, data2, match);
+    retval = timed_compare_results(r1, data1, r2, data2, match);
     r1.validate_state = match?VALIDATE_STATE_VALID:VALIDATE_STATE_INVALID;
-    cleanup_result(r1, data1);
-    cleanup_result(r2, data2);
+    timed_cleanup_result(r1, data1);
+    timed_cleanup_result(r2, data2);
 }
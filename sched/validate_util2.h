@@ -31,4 +31,38 @@ extern int check_set(
     int& canonicalid, double& credit_deprecated, bool& retry
 );
 extern void check_pair(RESULT& r1, RESULT& r2, bool& retry);
+
+// times of calls to one of the above functions.
+// Bucket i counts calls that took less than 2^i usec
+//
+#define CALLBACK_NBUCKETS   32
+
+struct CALLBACK_TIMES {
+    double n;
+    double total;
+    double max;
+    double buckets[CALLBACK_NBUCKETS];
+
+    void clear();
+    void add(double secs);
+    void merge(CALLBACK_TIMES&);
+    double percentile(double frac);
+        // upper bound of the bucket containing it
+};
+
+struct VALIDATE_TIMES {
+    CALLBACK_TIMES init_result;
+    CALLBACK_TIMES compare_results;
+    CALLBACK_TIMES cleanup_result;
+
+    void clear() {
+        init_result.clear();
+        compare_results.clear();
+        cleanup_result.clear();
+    }
+};
+
+extern VALIDATE_TIMES* validate_times;
+    // if set, check_set() and check_pair() time their calls
+    // to the project's functions (validator_test --bench)
 #endif
@@ -32,8 +32,18 @@
 //  [--one_pass_N_WU N]         Validate only N WU in one pass, then exit
 //  [--one_pass]                make one pass through WU table, then exit
 //  [--mod n i]                 process only WUs with (id mod n) == i
+//  [--lease_partition]         share WUs dynamically with other instances
+//                              (see daemon_lease.h)
 //  [--max_granted_credit X]    limit maximum granted credit to X
 //  [--update_credited_job]     add userid/wuid pair to credited_job table
+//  [--nworkers n]              validate WUs in n parallel worker processes
+//  [--credit_flush_interval n]  update user and team credit every n seconds
+//                              (grants are journaled in credit_journal)
+//
+//  If compiled with VALIDATOR_ASSIMILATE, this must also be linked with
+//  assimilate_handler(), and has an additional option:
+//  [--assimilate]              when a canonical result is found,
+//                              assimilate the WU here (see assimilate_wu())
 //
 //  credit options.  The default is to grant credit using an
 //  adaptive scheme that provides devices neutrality
@@ -65,10 +75,15 @@
 #include "credit.h"
 #include "sched_config.h"
 #include "sched_util.h"
+#include "daemon_metrics.h"
 #include "sched_msgs.h"
+#include "daemon_lease.h"
 #include "validator.h"
 #include "validate_util.h"
 #include "validate_util2.h"
+#ifdef VALIDATOR_ASSIMILATE
+#include "assimilate_handler.h"
+#endif
 #ifdef GCL_SIMULATOR
 #include "gcl_simulator.h"
 #endif
@@ -92,6 +107,10 @@ char app_name[256];
 DB_APP app;
 int wu_id_modulus=0;
 int wu_id_remainder=0;
+bool use_lease = false;
+DAEMON_LEASE* lease = NULL;
+static int m_wus, m_canonical, m_pass_time;
+    // metrics
 int one_pass_N_WU=0;
 bool one_pass = false;
 double max_granted_credit = 200 * 1000 * 365;
@@ -101,6 +120,17 @@ bool credit_from_wu = false;
 bool credit_from_runtime = false;
 double max_runtime = 0;
 bool no_credit = false;
+int credit_flush_interval = 0;
+#ifdef VALIDATOR_ASSIMILATE
+bool assimilate = false;
+
+// for assimilate_handler()
+//
+int g_argc;
+char** g_argv;
+char* results_prefix = NULL;
+char* transcripts_prefix = NULL;
+#endif
 
 WORKUNIT* g_wup;
 vector<DB_APP_VERSION> app_versions;
@@ -166,6 +196,63 @@ static inline void is_invalid(DB_HOST_APP_VERSION& hav) {
     }
 }
 
+#ifdef VALIDATOR_ASSIMILATE
+// Assimilate a WU whose canonical result we just found,
+// using the results we already have,
+// rather than leaving it for the assimilator to enumerate them again.
+// The WU's other fields are read by ID.
+// If the handler fails, the WU stays ASSIMILATE_READY
+// and the assimilator will handle it.
+//
+static void assimilate_wu(WORKUNIT& wu, vector<VALIDATOR_ITEM>& items) {
+    DB_WORKUNIT full_wu;
+    vector<RESULT> results;
+    RESULT canonical_result;
+    unsigned int i;
+
+    int retval = full_wu.lookup_id(wu.id);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[WU#%u %s] can't look up WU for assimilation: %s\n",
+            wu.id, wu.name, boincerror(retval)
+        );
+        return;
+    }
+    full_wu.canonical_resultid = wu.canonical_resultid;
+    full_wu.canonical_credit = wu.canonical_credit;
+    full_wu.target_nresults = wu.target_nresults;
+    full_wu.error_mask = wu.error_mask;
+    full_wu.assimilate_state = wu.assimilate_state;
+
+    canonical_result.clear();
+    for (i=0; i<items.size(); i++) {
+        RESULT& result = items[i].res;
+        result.workunitid = wu.id;
+        results.push_back(result);
+        if (result.id == wu.canonical_resultid) {
+            canonical_result = result;
+        }
+    }
+
+    retval = assimilate_handler(full_wu, results, canonical_result);
+    if (retval == DEFER_ASSIMILATION) {
+        wu.assimilate_state = ASSIMILATE_INIT;
+    } else if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "[WU#%u %s] assimilate_handler() failed: %s; leaving it for the assimilator\n",
+            wu.id, wu.name, boincerror(retval)
+        );
+        return;
+    } else {
+        wu.assimilate_state = ASSIMILATE_DONE;
+    }
+    log_messages.printf(MSG_DEBUG,
+        "[WU#%u %s] assimilated; state=%d\n",
+        wu.id, wu.name, wu.assimilate_state
+    );
+}
+#endif
+
 // handle a workunit which has new results
 //
 int handle_wu(
@@ -576,6 +663,7 @@ int handle_wu(
                 wu.canonical_resultid = canonicalid;
                 wu.canonical_credit = credit;
                 wu.assimilate_state = ASSIMILATE_READY;
+                daemon_metrics.add(m_canonical);
 
                 // don't need to send any more results
                 //
@@ -596,6 +684,17 @@ int handle_wu(
                         );
                     }
                 }
+
+#ifdef VALIDATOR_ASSIMILATE
+                // if we assimilated it, the transitioner can go ahead
+                //
+                if (assimilate) {
+                    assimilate_wu(wu, items);
+                    if (wu.assimilate_state != ASSIMILATE_READY) {
+                        transition_time = IMMEDIATE;
+                    }
+                }
+#endif
             } else {
                 // here if no consensus.
 
@@ -650,6 +749,208 @@ leave:
     return 0;
 }
 
+// With --nworkers N, the validator forks N worker processes,
+// each with its own DB connection,
+// so that the reading and comparison of output files
+// (check_set() and check_pair()) for different WUs proceed in parallel.
+// The parent does the enumeration
+// and sends each WU's items over a pipe to the worker for its WU ID;
+// the worker handles the WU, including its DB updates.
+//
+// Before each new enumeration query, the parent has all workers
+// finish what they've been sent;
+// otherwise WUs not yet updated would be enumerated again.
+//
+// Messages to a worker are an item count followed by the items.
+// A count of 0 means "finish up and acknowledge",
+// and WORKER_IDLE means the parent found nothing to do:
+// write modified app versions and reread the app.
+//
+#define WORKER_IDLE     -1
+
+struct WORKER {
+    int pid;
+    int to_fd;          // parent writes items here
+    int from_fd;        // worker writes acks here
+};
+
+static vector<WORKER> workers;
+static int nworkers = 0;
+
+static void open_db() {
+    int retval = boinc_db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "boinc_db.open failed: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
+static void lookup_app() {
+    char buf[256];
+
+    sprintf(buf, "where name='%s'", app_name);
+    int retval = app.lookup(buf);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "can't find app %s\n", app_name);
+        exit(1);
+    }
+}
+
+// With --credit_flush_interval, each process journals credit
+// under a name made from this prefix and its worker number
+//
+static void journal_owner_prefix(char* buf) {
+    sprintf(buf, "validator %s %d %d ",
+        app_name, wu_id_modulus, wu_id_remainder
+    );
+}
+
+static void start_journal(int worker) {
+    char owner[256];
+
+    if (!credit_flush_interval || no_credit) return;
+    journal_owner_prefix(owner);
+    sprintf(owner+strlen(owner), "%d", worker);
+    start_credit_journal(owner, credit_flush_interval);
+}
+
+// apply credit journaled by an earlier instance.
+// Do this before forking workers.
+//
+static void recover_journal() {
+    char prefix[256];
+
+    if (!credit_flush_interval || no_credit) return;
+    journal_owner_prefix(prefix);
+    int retval = recover_credit_journal(prefix);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "recover_credit_journal() failed: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+}
+
+static void worker_main(int in_fd, int out_fd, int index) {
+    DB_VALIDATOR_ITEM_SET validator;
+    std::vector<VALIDATOR_ITEM> items;
+    int n;
+    char ack = 0;
+
+    open_db();
+    lookup_app();
+    start_journal(index);
+    while (1) {
+        if (!read_all(in_fd, &n, sizeof(n))) {
+            // parent has exited
+            //
+            write_modified_app_versions(app_versions);
+            flush_credit(true);
+            exit(0);
+        }
+        if (n == 0) {
+            if (!write_all(out_fd, &ack, 1)) exit(1);
+            continue;
+        }
+        if (n == WORKER_IDLE) {
+            write_modified_app_versions(app_versions);
+            flush_credit(true);
+            lookup_app();
+            if (!write_all(out_fd, &ack, 1)) exit(1);
+            continue;
+        }
+        items.resize(n);
+        if (!read_all(in_fd, &items[0], n*sizeof(VALIDATOR_ITEM))) {
+            exit(1);
+        }
+        handle_wu(validator, items);
+        release_output_files();
+        flush_credit(false);
+    }
+}
+
+// fork the workers.
+// Do this before the parent opens its DB connection,
+// so that the children don't share its socket.
+//
+static void start_workers() {
+    int i, to_worker[2], from_worker[2];
+
+    signal(SIGPIPE, SIG_IGN);
+    for (i=0; i<nworkers; i++) {
+        if (pipe(to_worker) || pipe(from_worker)) {
+            log_messages.printf(MSG_CRITICAL, "pipe() failed; exiting\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            log_messages.printf(MSG_CRITICAL, "fork() failed; exiting\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (unsigned int j=0; j<workers.size(); j++) {
+                close(workers[j].to_fd);
+                close(workers[j].from_fd);
+            }
+            close(to_worker[1]);
+            close(from_worker[0]);
+            log_messages.pid = getpid();
+            worker_main(to_worker[0], from_worker[1], i);
+            exit(0);
+        }
+        close(to_worker[0]);
+        close(from_worker[1]);
+        WORKER w;
+        w.pid = pid;
+        w.to_fd = to_worker[1];
+        w.from_fd = from_worker[0];
+        workers.push_back(w);
+        log_messages.printf(MSG_NORMAL, "started worker %d (PID %d)\n", i, pid);
+    }
+}
+
+static void worker_died(WORKER& w) {
+    log_messages.printf(MSG_CRITICAL,
+        "worker PID %d exited; exiting\n", w.pid
+    );
+    exit(1);
+}
+
+static void send_to_worker(std::vector<VALIDATOR_ITEM>& items) {
+    int n = (int)items.size();
+    int k = items[0].wu.id;
+    if (wu_id_modulus) k /= wu_id_modulus;
+    if (lease) k /= LEASE_NBUCKETS;
+    WORKER& w = workers[k % nworkers];
+    if (!write_all(w.to_fd, &n, sizeof(n))) worker_died(w);
+    if (!write_all(w.to_fd, &items[0], n*sizeof(VALIDATOR_ITEM))) {
+        worker_died(w);
+    }
+}
+
+// send a message to all workers and wait until they've acknowledged it,
+// i.e. finished the WUs sent to them before it
+//
+static void sync_workers(int msg=0) {
+    unsigned int i;
+    char ack;
+
+    for (i=0; i<workers.size(); i++) {
+        if (!write_all(workers[i].to_fd, &msg, sizeof(msg))) {
+            worker_died(workers[i]);
+        }
+    }
+    for (i=0; i<workers.size(); i++) {
+        if (!read_all(workers[i].from_fd, &ack, 1)) {
+            worker_died(workers[i]);
+        }
+    }
+}
+
 // make one pass through the workunits with need_validate set.
 // return true if there were any
 //
@@ -658,10 +959,28 @@ bool do_validate_scan() {
     std::vector<VALIDATOR_ITEM> items;
     bool found=false;
     int retval, i=0;
+    double start = dtime();
 
     // loop over entries that need to be checked
     //
     while (1) {
+        if (nworkers && !validator.cursor.active) {
+            sync_workers();
+        }
+
+        // renew our leases before each query;
+        // workers are done with any buckets we release
+        //
+        if (lease && !validator.cursor.active) {
+            retval = lease->update();
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "can't update leases: %s\n", boincerror(retval)
+                );
+                break;
+            }
+            lease->get_clause("id", validator.id_clause);
+        }
         retval = validator.enumerate(
             app.id, SELECT_LIMIT, wu_id_modulus, wu_id_remainder, items
         );
@@ -674,19 +993,27 @@ bool do_validate_scan() {
             }
             break;
         }
-        retval = handle_wu(validator, items);
-        if (!retval) found = true;
+        daemon_metrics.add(m_wus);
+        if (nworkers) {
+            send_to_worker(items);
+            found = true;
+        } else {
+            retval = handle_wu(validator, items);
+            release_output_files();
+            flush_credit(false);
+            if (!retval) found = true;
+        }
         if (++i == one_pass_N_WU) break;
     }
+    if (nworkers) {
+        sync_workers();
+    }
+    daemon_metrics.observe(m_pass_time, dtime() - start);
     return found;
 }
 
 int main_loop() {
-    int retval;
     bool did_something;
-    char buf[256];
-
-    sprintf(buf, "where name='%s'", app_name);
 
     while (1) {
         check_stop_daemons();
@@ -694,14 +1021,17 @@ int main_loop() {
         // look up app within the loop,
         // in case its min_avg_pfc has been changed by the feeder
         //
-        retval = app.lookup(buf);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL, "can't find app %s\n", app_name);
-            exit(1);
-        }
+        lookup_app();
         did_something = do_validate_scan();
-        if (!did_something) {
-            write_modified_app_versions(app_versions);
+        if (did_something) {
+            daemon_notify("transitioner");
+        } else {
+            if (nworkers) {
+                sync_workers(WORKER_IDLE);
+            } else {
+                write_modified_app_versions(app_versions);
+                flush_credit(true);
+            }
             if (one_pass) break;
 #ifdef GCL_SIMULATOR
             char nameforsim[64];
@@ -710,13 +1040,35 @@ int main_loop() {
             signal(SIGUSR2, simulator_signal_handler);
             pause();
 #else
-            daemon_sleep(sleep_interval);
+            daemon_sleep(sleep_interval, "validator");
 #endif
         }
     }
     return 0;
 }
 
+static void release_lease() {
+    lease->release();
+}
+
+// open the metrics page before forking workers, so they share it
+//
+static void open_metrics() {
+    char buf[256];
+    sprintf(buf, "validator_%s", app_name);
+    daemon_metrics.open(buf);
+    m_wus = daemon_metrics.define(
+        "validator_wus", METRIC_COUNTER, "WUs handled"
+    );
+    m_canonical = daemon_metrics.define(
+        "validator_canonical_found", METRIC_COUNTER,
+        "WUs for which a canonical result was found"
+    );
+    m_pass_time = daemon_metrics.define(
+        "validator_pass_seconds", METRIC_HISTOGRAM, "Duration of passes"
+    );
+}
+
 // For use by project-supplied routines check_set() and check_pair()
 //
 int debug_level=0;
@@ -731,12 +1083,20 @@ int main(int argc, char** argv) {
       "  --one_pass_N_WU N       Validate at most N WUs, then exit\n"
       "  --one_pass              Make one pass through WU table, then exit\n"
       "  --mod n i               Process only WUs with (id mod n) == i\n"
+      "  --lease_partition       Share WUs dynamically with other instances\n"
       "  --max_granted_credit X  Grant no more than this amount of credit to a result\n"
       "  --update_credited_job   Add record to credited_job table after granting credit\n"
       "  --credit_from_wu        Credit is specified in WU XML\n"
       "  --credit_from_runtime X  Grant credit based on runtime (max X seconds)and estimated FLOPS\n"
       "  --no_credit             Don't grant credit\n"
       "  --sleep_interval n      Set sleep-interval to n\n"
+      "  --nworkers n            Validate WUs in n worker processes\n"
+      "  --credit_flush_interval n  Update user/team credit every n seconds\n"
+#ifdef VALIDATOR_ASSIMILATE
+      "  --assimilate            Assimilate WUs when a canonical result is found\n"
+      "  --results_prefix x      (passed to assimilate_handler())\n"
+      "  --transcripts_prefix x  (passed to assimilate_handler())\n"
+#endif
       "  -d n, --debug_level n   Set log verbosity level, 1-4\n"
       "  -h | --help             Show this\n"
       "  -v | --version          Show version information\n";
@@ -753,6 +1113,10 @@ int main(int argc, char** argv) {
 
     check_stop_daemons();
 
+#ifdef VALIDATOR_ASSIMILATE
+    g_argc = argc;
+    g_argv = argv;
+#endif
     for (i=1; i<argc; i++) {
         if (is_arg(argv[i], "one_pass_N_WU")) {
             one_pass_N_WU = atoi(argv[++i]);
@@ -770,6 +1134,16 @@ int main(int argc, char** argv) {
         } else if (is_arg(argv[i], "mod")) {
             wu_id_modulus = atoi(argv[++i]);
             wu_id_remainder = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "lease_partition")) {
+            use_lease = true;
+#ifdef VALIDATOR_ASSIMILATE
+        } else if (is_arg(argv[i], "assimilate")) {
+            assimilate = true;
+        } else if (is_arg(argv[i], "results_prefix")) {
+            results_prefix = argv[++i];
+        } else if (is_arg(argv[i], "transcripts_prefix")) {
+            transcripts_prefix = argv[++i];
+#endif
         } else if (is_arg(argv[i], "max_granted_credit")) {
             max_granted_credit = atof(argv[++i]);
         } else if (is_arg(argv[i], "update_credited_job")) {
@@ -781,6 +1155,10 @@ int main(int argc, char** argv) {
             max_runtime = atof(argv[++i]);
         } else if (is_arg(argv[i], "no_credit")) {
             no_credit = true;
+        } else if (is_arg(argv[i], "nworkers")) {
+            nworkers = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "credit_flush_interval")) {
+            credit_flush_interval = atoi(argv[++i]);
         } else {
             fprintf(stderr,
                 "Invalid option '%s'\nTry `%s --help` for more information\n",
@@ -798,6 +1176,19 @@ int main(int argc, char** argv) {
         printf (usage, argv[0] );
         exit(1);      
     }
+    if (use_lease) {
+        // credit journals are named by the static partition
+        //
+        if (wu_id_modulus || credit_flush_interval) {
+            log_messages.printf(MSG_CRITICAL,
+                "--lease_partition can't be used with --mod or --credit_flush_interval\n"
+            );
+            exit(1);
+        }
+        char lease_name[256];
+        sprintf(lease_name, "validator_%s", app_name);
+        lease = new DAEMON_LEASE(lease_name);
+    }
 
     retval = config.parse_file();
     if (retval) {
@@ -807,16 +1198,6 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    retval = boinc_db.open(
-        config.db_name, config.db_host, config.db_user, config.db_passwd
-    );
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "boinc_db.open failed: %s\n", boincerror(retval)
-        );
-        exit(1);
-    }
-
     log_messages.printf(MSG_NORMAL,
         "Starting validator, debug level %d\n", log_messages.debug_level
     );
@@ -834,7 +1215,19 @@ int main(int argc, char** argv) {
     }
 
     install_stop_signal_handler();
+    open_metrics();
 
+    if (credit_flush_interval && !no_credit) {
+        open_db();
+        recover_journal();
+        boinc_db.close();
+    }
+    if (nworkers) {
+        start_workers();
+    }
+    open_db();
+    if (lease) atexit(release_lease);
+    if (!nworkers) start_journal(0);
     main_loop();
 }
 
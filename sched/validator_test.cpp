@@ -25,13 +25,51 @@
 // validator_test file1 file2
 // and it will compare those two output files
 // (this only works if your functions expect 1 file per result)
+//
+// or as
+// validator_test --bench dir [--nprocs N] [--repeat N] [--min_quorum N]
+// to measure the throughput of your functions on captured output files.
+// dir has a subdirectory per WU, containing an entry per result:
+// either a file (the result's only output file)
+// or a directory (the result's output files, in name order).
+// Each WU is validated as the validator does, with check_set()
+// (no database is used; the results are made up from the files).
+// With --nprocs N, the WUs are divided among N processes
+// (as with the validator's --nworkers).
+// --repeat N validates each WU N times.
+// --min_quorum N sets the WUs' quorum (default: all their results).
+// It prints WUs/sec, the bytes of output files read,
+// and the distribution of times of each of your functions.
+
+#include "config.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "error_numbers.h"
+#include "filesys.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "util.h"
+
+#include "sched_util.h"
 #include "validate_util.h"
 #include "validate_util2.h"
 
+using std::string;
+using std::vector;
+
 void usage(char* prog) {
     fprintf(stderr,
-        "usage: %s file1 file2\n", prog
+        "usage: %s file1 file2\n"
+        "   or: %s --bench dir [--nprocs N] [--repeat N] [--min_quorum N]\n",
+        prog, prog
     );
     exit(1);
 }
@@ -41,7 +79,281 @@ int get_output_file_info(RESULT r, OUTPUT_FILE_INFO& fi) {
     return 0;
 }
 
+////////// benchmark mode ///////////////
+
+// a captured quorum set
+//
+struct BENCH_WU {
+    string name;
+    vector<string> result_names;
+    vector<string> result_xml;
+        // <file_ref>s for the result's output files
+    double nbytes;
+        // total size of output files
+};
+
+// counts for one process; sent to the parent over a pipe
+//
+struct BENCH_STATS {
+    double nwus;
+    double nresults;
+    double nbytes;
+    double ncanonical;
+        // WUs for which check_set() found a canonical result
+    double nvalid;
+    double ninvalid;
+    double nerror;
+        // results with a validate error (init_result() failed)
+    double nretry;
+        // WUs where check_set() asked for a retry
+    VALIDATE_TIMES times;
+
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+    void merge(BENCH_STATS& s) {
+        nwus += s.nwus;
+        nresults += s.nresults;
+        nbytes += s.nbytes;
+        ncanonical += s.ncanonical;
+        nvalid += s.nvalid;
+        ninvalid += s.ninvalid;
+        nerror += s.nerror;
+        nretry += s.nretry;
+        times.init_result.merge(s.times.init_result);
+        times.compare_results.merge(s.times.compare_results);
+        times.cleanup_result.merge(s.times.cleanup_result);
+    }
+};
+
+static void scan_sorted(const char* dir, vector<string>& names) {
+    string name;
+    DirScanner ds(dir);
+    names.clear();
+    while (ds.scan(name)) {
+        names.push_back(name);
+    }
+    std::sort(names.begin(), names.end());
+}
+
+static int add_file(const char* path, string& xml, double& nbytes) {
+    char buf[MAXPATHLEN+256];
+    double size;
+
+    int retval = file_size(path, size);
+    if (retval) return retval;
+    nbytes += size;
+    snprintf(buf, sizeof(buf),
+        "<file_ref><file_name>%s</file_name></file_ref>\n", path
+    );
+    xml += buf;
+    return 0;
+}
+
+static int read_corpus(const char* dir, vector<BENCH_WU>& wus) {
+    char wu_path[MAXPATHLEN], path[MAXPATHLEN], fpath[MAXPATHLEN];
+    vector<string> wu_names, result_names, file_names;
+    unsigned int i, j, k;
+    int retval;
+
+    if (!is_dir(dir)) return ERR_OPENDIR;
+    scan_sorted(dir, wu_names);
+    for (i=0; i<wu_names.size(); i++) {
+        snprintf(wu_path, sizeof(wu_path), "%s/%s", dir, wu_names[i].c_str());
+        if (!is_dir(wu_path)) continue;
+        BENCH_WU wu;
+        wu.name = wu_names[i];
+        wu.nbytes = 0;
+        scan_sorted(wu_path, result_names);
+        for (j=0; j<result_names.size(); j++) {
+            string xml;
+            snprintf(path, sizeof(path), "%s/%s", wu_path, result_names[j].c_str());
+            if (is_dir(path)) {
+                scan_sorted(path, file_names);
+                for (k=0; k<file_names.size(); k++) {
+                    snprintf(fpath, sizeof(fpath), "%s/%s", path, file_names[k].c_str());
+                    retval = add_file(fpath, xml, wu.nbytes);
+                    if (retval) return retval;
+                }
+            } else {
+                retval = add_file(path, xml, wu.nbytes);
+                if (retval) return retval;
+            }
+            if (xml.size() >= BLOB_SIZE) {
+                fprintf(stderr, "%s: too many output files\n", path);
+                return ERR_BUFFER_OVERFLOW;
+            }
+            wu.result_names.push_back(result_names[j]);
+            wu.result_xml.push_back(xml);
+        }
+        if (wu.result_names.empty()) continue;
+        wus.push_back(wu);
+    }
+    return 0;
+}
+
+static void bench_wu(BENCH_WU& bwu, int id, int min_quorum, BENCH_STATS& stats) {
+    vector<RESULT> results;
+    WORKUNIT wu;
+    int canonicalid = 0;
+    double credit = 0;
+    bool retry;
+    unsigned int i, n = bwu.result_names.size();
+
+    wu.clear();
+    wu.id = id;
+    safe_strcpy(wu.name, bwu.name.c_str());
+    wu.min_quorum = min_quorum?min_quorum:n;
+    results.resize(n);
+    for (i=0; i<n; i++) {
+        RESULT& r = results[i];
+        r.clear();
+        r.id = i+1;
+        r.workunitid = id;
+        safe_strcpy(r.name, bwu.result_names[i].c_str());
+        safe_strcpy(r.xml_doc_in, bwu.result_xml[i].c_str());
+        r.outcome = RESULT_OUTCOME_SUCCESS;
+        r.validate_state = VALIDATE_STATE_INIT;
+    }
+
+    check_set(results, wu, canonicalid, credit, retry);
+    release_output_files();
+
+    stats.nwus++;
+    stats.nresults += n;
+    stats.nbytes += bwu.nbytes;
+    if (canonicalid) stats.ncanonical++;
+    if (retry) stats.nretry++;
+    for (i=0; i<n; i++) {
+        if (results[i].outcome == RESULT_OUTCOME_VALIDATE_ERROR) {
+            stats.nerror++;
+        } else if (results[i].validate_state == VALIDATE_STATE_VALID) {
+            stats.nvalid++;
+        } else if (results[i].validate_state == VALIDATE_STATE_INVALID) {
+            stats.ninvalid++;
+        }
+    }
+}
+
+// validate the WUs assigned to process k of nprocs
+//
+static void bench_proc(
+    vector<BENCH_WU>& wus, int k, int nprocs, int repeat, int min_quorum,
+    BENCH_STATS& stats
+) {
+    stats.clear();
+    validate_times = &stats.times;
+    for (int pass=0; pass<repeat; pass++) {
+        for (unsigned int i=k; i<wus.size(); i+=nprocs) {
+            bench_wu(wus[i], i+1, min_quorum, stats);
+        }
+    }
+    validate_times = NULL;
+}
+
+static void print_times(const char* name, CALLBACK_TIMES& t) {
+    if (!t.n) return;
+    printf("%-16s %10.0f %10.1f %10.1f %10.1f %10.1f\n",
+        name, t.n, t.total/t.n*1e6, t.percentile(.5)*1e6,
+        t.percentile(.99)*1e6, t.max*1e6
+    );
+}
+
+static void print_stats(BENCH_STATS& s, double elapsed, int nprocs) {
+    printf("%.0f WUs (%.0f results) in %.3f sec with %d process%s\n",
+        s.nwus, s.nresults, elapsed, nprocs, nprocs>1?"es":""
+    );
+    printf("  %.1f WUs/sec\n", s.nwus/elapsed);
+    printf("  %.0f bytes read (%.1f MB/sec)\n", s.nbytes, s.nbytes/elapsed/MEGA);
+    printf("  canonical result found: %.0f WUs\n", s.ncanonical);
+    printf("  results valid %.0f, invalid %.0f, validate error %.0f\n",
+        s.nvalid, s.ninvalid, s.nerror
+    );
+    if (s.nretry) {
+        printf("  transient errors (retry): %.0f WUs\n", s.nretry);
+    }
+    printf("\n%-16s %10s %10s %10s %10s %10s\n",
+        "function", "calls", "mean usec", "p50 <", "p99 <", "max usec"
+    );
+    print_times("init_result", s.times.init_result);
+    print_times("compare_results", s.times.compare_results);
+    print_times("cleanup_result", s.times.cleanup_result);
+}
+
+static int bench(const char* dir, int nprocs, int repeat, int min_quorum) {
+    vector<BENCH_WU> wus;
+    vector<int> pids, fds;
+    BENCH_STATS total, stats;
+    int i, retval;
+
+    retval = read_corpus(dir, wus);
+    if (retval) {
+        fprintf(stderr, "can't read %s: %s\n", dir, boincerror(retval));
+        return retval;
+    }
+    if (wus.empty()) {
+        fprintf(stderr, "no WUs in %s\n", dir);
+        return ERR_NOT_FOUND;
+    }
+    if (nprocs < 1) nprocs = 1;
+    if (repeat < 1) repeat = 1;
+
+    total.clear();
+    double start = dtime();
+    if (nprocs == 1) {
+        bench_proc(wus, 0, 1, repeat, min_quorum, total);
+    } else {
+        signal(SIGPIPE, SIG_IGN);
+        for (i=0; i<nprocs; i++) {
+            int fd[2];
+            if (pipe(fd)) return ERR_EXEC;
+            int pid = fork();
+            if (pid < 0) return ERR_FORK;
+            if (pid == 0) {
+                close(fd[0]);
+                bench_proc(wus, i, nprocs, repeat, min_quorum, stats);
+                exit(write_all(fd[1], &stats, sizeof(stats))?0:1);
+            }
+            close(fd[1]);
+            pids.push_back(pid);
+            fds.push_back(fd[0]);
+        }
+        for (i=0; i<nprocs; i++) {
+            if (!read_all(fds[i], &stats, sizeof(stats))) {
+                fprintf(stderr, "process %d failed\n", i);
+                retval = ERR_READ;
+            } else {
+                total.merge(stats);
+            }
+            close(fds[i]);
+            waitpid(pids[i], NULL, 0);
+        }
+        if (retval) return retval;
+    }
+    print_stats(total, dtime() - start, nprocs);
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    standalone = true;
+
+    if (argc >= 3 && is_arg(argv[1], "bench")) {
+        int nprocs = 1, repeat = 1, min_quorum = 0;
+        for (int i=3; i<argc; i++) {
+            if (i+1 == argc) usage(argv[0]);
+            if (is_arg(argv[i], "nprocs")) {
+                nprocs = atoi(argv[++i]);
+            } else if (is_arg(argv[i], "repeat")) {
+                repeat = atoi(argv[++i]);
+            } else if (is_arg(argv[i], "min_quorum")) {
+                min_quorum = atoi(argv[++i]);
+            } else {
+                usage(argv[0]);
+            }
+        }
+        exit(bench(argv[2], nprocs, repeat, min_quorum)?1:0);
+    }
+
     if (argc != 3) {
         usage(argv[0]);
     }
@@ -49,8 +361,6 @@ int main(int argc, char** argv) {
     RESULT r1, r2;
     bool match;
 
-    standalone = true;
-
     sprintf(r1.xml_doc_in, "<file_ref><file_name>%s</file_name></file_ref>", argv[1]);
     sprintf(r2.xml_doc_in, "<file_ref><file_name>%s</file_name></file_ref>", argv[2]);
     int retval;
@@ -0,0 +1,51 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// I/O shared by work_cache_server and work_cache_client;
+// see work_cache.h
+
+#include "config.h"
+#include <cerrno>
+#include <unistd.h>
+
+#include "error_numbers.h"
+
+#include "work_cache.h"
+
+int wc_write(int sock, const void* p, int len) {
+    const char* buf = (const char*)p;
+    while (len > 0) {
+        ssize_t n = write(sock, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return ERR_WRITE;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int wc_read(int sock, void* p, int len) {
+    char* buf = (char*)p;
+    while (len > 0) {
+        ssize_t n = read(sock, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return ERR_READ;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Protocol between work_cache_server, which leases jobs from the
+// feeder's shared-memory work array, and work_cache_client,
+// which keeps a local copy of the array on another machine
+// for the schedulers there.
+// This lets the scheduler run on several web servers
+// with a single feeder.
+//
+// A client sends a WC_REQUEST and gets a WC_REPLY, each possibly
+// followed by data:
+//
+// WC_REQ_TABLES    reply is followed by the server's SCHED_SHMEM struct
+//                  (the app, app version etc. tables; not the job slots)
+// WC_REQ_LEASE     request n jobs; the reply is followed by
+//                  reply.n (<= n) WC_JOBs,
+//                  each followed by xml_doc_len bytes of workunit XML.
+//                  Each job's slot in the feeder's array stays reserved
+//                  for the client until the lease expires
+//                  (after reply.lease_time seconds) or is returned.
+// WC_REQ_RETURN    followed by n WC_RETURNs.
+//                  A job that was used (sent, or found unsendable)
+//                  has its slot emptied, so the feeder refills it;
+//                  otherwise the slot is made available again.
+//
+// A lease is identified by the slot and its gen (see sched_shmem.h),
+// so a late return for a slot that has since been refilled is ignored.
+// Expired leases are released by the server;
+// if a job was actually sent in the meantime,
+// the scheduler that gets it next will find it's no longer unsendable
+// when it rereads the result.
+//
+// The structs are sent in native layout (byte order, padding),
+// so the client and server must be the same build on the same platform.
+// Every request includes the magic number and the struct sizes,
+// and the server checks them:
+// a client with a different byte order fails the magic number check,
+// and one with different struct layouts (usually) fails the size check.
+
+#ifndef _WORK_CACHE_H_
+#define _WORK_CACHE_H_
+
+#include "sched_shmem.h"
+
+#define WORK_CACHE_MAGIC        0x31435742
+    // "BWC1"
+#define DEFAULT_WORK_CACHE_PORT 31417
+
+// request types
+#define WC_REQ_TABLES   1
+#define WC_REQ_LEASE    2
+#define WC_REQ_RETURN   3
+
+struct WC_REQUEST {
+    int magic;
+    int type;
+    int n;
+    int ss_size;            // sizeof(SCHED_SHMEM)
+    int wu_result_size;     // sizeof(WU_RESULT)
+};
+
+struct WC_REPLY {
+    int magic;
+    int status;             // 0 or an ERR_* code
+    int n;
+    int lease_time;
+};
+
+struct WC_JOB {
+    int slot;
+    int gen;
+    int xml_doc_len;
+    WU_RESULT wu_result;
+        // its xml_chunk and xml_nchunks refer to the server's heap
+};
+
+struct WC_RETURN {
+    int slot;
+    int gen;
+    int used;
+};
+
+extern int wc_write(int sock, const void*, int len);
+extern int wc_read(int sock, void*, int len);
+    // write or read exactly len bytes (blocking); nonzero on error or EOF.
+    // work_cache_server sets a socket timeout so these can't block forever.
+
+#endif
@@ -0,0 +1,478 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// work_cache_client: keep a local work array, for the schedulers on
+// this machine, filled with jobs leased from a work_cache_server
+// on the feeder's machine; see work_cache.h
+//
+// Usage: work_cache_client --server host [ options ]
+//  [ -d x ]                debug level x
+//  [ --port n ]            server's TCP port (default 31417)
+//  [ --sleep_interval x ]  check the local array at least every
+//                          x seconds (default 1)
+//  [ --tables_period x ]   get the app and app version tables
+//                          every x seconds (default 60)
+//
+// Run this instead of the feeder on each scheduler machine.
+// The local array has <shmem_work_items> slots;
+// the client keeps all of them filled if it can,
+// so that schedulers here don't wait for the network.
+// Jobs still unsent when their lease is 3/4 over are given back.
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "error_numbers.h"
+#include "network.h"
+#include "shmem.h"
+#include "str_util.h"
+#include "svn_version.h"
+#include "synch.h"
+#include "util.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+#include "sched_util.h"
+
+#include "work_cache.h"
+
+// what a local slot holds
+//
+struct LOCAL_LEASE {
+    bool active;
+    int slot;           // in the server's array
+    int gen;            // of that slot
+    int local_gen;      // of our slot, when we filled it
+    double expire;
+};
+
+SCHED_SHMEM* ssp = 0;
+SCHED_SHMEM* remote_tables = 0;
+std::vector<LOCAL_LEASE> local_leases;
+std::vector<WC_RETURN> returns;
+    // not yet sent to the server
+key_t sema_key;
+const char* server_name = 0;
+int port = DEFAULT_WORK_CACHE_PORT;
+int sock = -1;
+int mypid;
+double sleep_interval = 1;
+int tables_period = 60;
+
+void disconnect() {
+    if (sock >= 0) boinc_close_socket(sock);
+    sock = -1;
+}
+
+int connect_to_server() {
+    sockaddr_storage addr;
+    int retval;
+
+    memset(&addr, 0, sizeof(addr));
+    retval = resolve_hostname_or_ip_addr(server_name, addr);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "can't resolve %s\n", server_name);
+        return retval;
+    }
+    if (addr.ss_family == AF_INET6) {
+        ((sockaddr_in6*)&addr)->sin6_port = htons(port);
+    } else {
+        ((sockaddr_in*)&addr)->sin_port = htons(port);
+    }
+    sock = (int)socket(addr.ss_family, SOCK_STREAM, 0);
+    if (sock < 0) return ERR_SOCKET;
+    if (connect(sock, (sockaddr*)&addr, sizeof(addr))) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't connect to %s port %d\n", server_name, port
+        );
+        disconnect();
+        return ERR_CONNECT;
+    }
+    log_messages.printf(MSG_NORMAL, "connected to %s\n", server_name);
+    return 0;
+}
+
+// send a request and get the reply header
+//
+int do_request(int type, int n, const void* data, int len, WC_REPLY& reply) {
+    WC_REQUEST req;
+    int retval;
+
+    req.magic = WORK_CACHE_MAGIC;
+    req.type = type;
+    req.n = n;
+    req.ss_size = sizeof(SCHED_SHMEM);
+    req.wu_result_size = sizeof(WU_RESULT);
+    retval = wc_write(sock, &req, sizeof(req));
+    if (!retval && len) retval = wc_write(sock, data, len);
+    if (!retval) retval = wc_read(sock, &reply, sizeof(reply));
+    if (retval) return retval;
+    if (reply.magic != WORK_CACHE_MAGIC) return ERR_INVALID_PARAM;
+    if (reply.status) {
+        log_messages.printf(MSG_CRITICAL,
+            "server error: %s\n", boincerror(reply.status)
+        );
+        return reply.status;
+    }
+    return 0;
+}
+
+// copy the server's tables into our segment,
+// keeping the fields that describe our array
+//
+int get_tables() {
+    WC_REPLY reply;
+    int retval = do_request(WC_REQ_TABLES, 0, NULL, 0, reply);
+    if (!retval) retval = wc_read(sock, remote_tables, sizeof(SCHED_SHMEM));
+    if (retval) return retval;
+
+    SCHED_SHMEM& r = *remote_tables;
+    r.ready = true;
+    r.ss_size = ssp->ss_size;
+    r.max_wu_results = ssp->max_wu_results;
+    r.wu_xml_nchunks = ssp->wu_xml_nchunks;
+    r.wu_xml_nchunks_used = ssp->wu_xml_nchunks_used;
+    r.wu_xml_rover = ssp->wu_xml_rover;
+    r.per_app_arrays = false;
+    memcpy(r.app_slot_start, ssp->app_slot_start, sizeof(r.app_slot_start));
+    memcpy(r.app_nslots, ssp->app_nslots, sizeof(r.app_nslots));
+    r.nslots_emptied = ssp->nslots_emptied;
+    r.nrefills = ssp->nrefills;
+    r.refill_latency_sum = ssp->refill_latency_sum;
+    r.refill_latency_max = ssp->refill_latency_max;
+    r.empty_slot_time = ssp->empty_slot_time;
+    if (memcmp(&r, ssp, sizeof(SCHED_SHMEM))) {
+        log_messages.printf(MSG_NORMAL, "updating tables\n");
+        memcpy(ssp, &r, sizeof(SCHED_SHMEM));
+    }
+    return 0;
+}
+
+// find leases to return: those whose jobs schedulers have taken,
+// and unused ones that will soon expire.
+// Also reset slots reserved by schedulers that no longer exist.
+//
+void get_returns() {
+    double now = dtime();
+    for (int i=0; i<ssp->max_wu_results; i++) {
+        WU_RESULT& wu_result = ssp->wu_results[i];
+        LOCAL_LEASE& ll = local_leases[i];
+        if (!ll.active) continue;
+        WC_RETURN r;
+        r.slot = ll.slot;
+        r.gen = ll.gen;
+        switch (wu_result.state) {
+        case WR_STATE_EMPTY:
+            r.used = 1;
+            returns.push_back(r);
+            ll.active = false;
+            break;
+        case WR_STATE_PRESENT:
+            if (now < ll.expire) break;
+            if (!wu_result.claim(mypid, ll.local_gen)) break;
+            wu_result.clear(mypid);
+            r.used = 0;
+            returns.push_back(r);
+            ll.active = false;
+            break;
+        default:
+            int pid = wu_result.state;
+            struct stat s;
+            char buf[256];
+            sprintf(buf, "/proc/%d", pid);
+            if (stat(buf, &s)) {
+                wu_result.release(pid);
+                log_messages.printf(MSG_NORMAL,
+                    "Result reserved by non-existent process PID %d; resetting\n",
+                    pid
+                );
+            }
+        }
+    }
+}
+
+int send_returns() {
+    WC_REPLY reply;
+    if (returns.empty()) return 0;
+    log_messages.printf(MSG_DEBUG, "returning %d jobs\n", (int)returns.size());
+    int retval = do_request(
+        WC_REQ_RETURN, (int)returns.size(),
+        &returns[0], (int)(returns.size()*sizeof(WC_RETURN)), reply
+    );
+    if (!retval) returns.clear();
+    return retval;
+}
+
+// lease jobs for our empty slots
+//
+int fill_slots() {
+    std::vector<int> empty;
+    WC_JOB job;
+    static WORKUNIT wu;
+    WC_REPLY reply;
+    int i, retval, nfilled=0;
+
+    for (i=0; i<ssp->max_wu_results; i++) {
+        if (ssp->wu_results[i].state == WR_STATE_EMPTY
+            && !local_leases[i].active
+        ) {
+            empty.push_back(i);
+        }
+    }
+    if (empty.empty()) return 0;
+    retval = do_request(WC_REQ_LEASE, (int)empty.size(), NULL, 0, reply);
+    if (retval) return retval;
+    if (reply.n < 0 || reply.n > (int)empty.size()) return ERR_INVALID_PARAM;
+    if (reply.n == 0) return 0;
+
+    double now = dtime();
+    for (i=0; i<reply.n; i++) {
+        retval = wc_read(sock, &job, sizeof(job));
+        if (retval) return retval;
+        if (job.xml_doc_len < 0 || job.xml_doc_len >= BLOB_SIZE) {
+            return ERR_INVALID_PARAM;
+        }
+        retval = wc_read(sock, wu.xml_doc, job.xml_doc_len);
+        if (retval) return retval;
+        wu.xml_doc[job.xml_doc_len] = 0;
+        job.wu_result.workunit.get(wu);
+
+        // if there's no room for the XML, give the job back
+        //
+        WU_RESULT& wu_result = ssp->wu_results[empty[i]];
+        if (ssp->set_workunit(wu_result, wu)) {
+            log_messages.printf(MSG_CRITICAL,
+                "no room for XML of [WU#%u] in shared memory; increase <shmem_wu_xml_size>\n",
+                wu.id
+            );
+            WC_RETURN r;
+            r.slot = job.slot;
+            r.gen = job.gen;
+            r.used = 0;
+            returns.push_back(r);
+            continue;
+        }
+        int gen = wu_result.gen;
+        double time_emptied = wu_result.time_emptied;
+        int xml_chunk = wu_result.xml_chunk;
+        int xml_nchunks = wu_result.xml_nchunks;
+        wu_result = job.wu_result;
+        wu_result.state = WR_STATE_EMPTY;
+        wu_result.gen = gen;
+        wu_result.time_emptied = time_emptied;
+        wu_result.xml_chunk = xml_chunk;
+        wu_result.xml_nchunks = xml_nchunks;
+        if (time_emptied) {
+            double x = now - time_emptied;
+            ssp->nrefills++;
+            ssp->refill_latency_sum += x;
+            if (x > ssp->refill_latency_max) ssp->refill_latency_max = x;
+        }
+        wu_result.publish();
+
+        LOCAL_LEASE& ll = local_leases[empty[i]];
+        ll.active = true;
+        ll.slot = job.slot;
+        ll.gen = job.gen;
+        ll.local_gen = wu_result.gen;
+        ll.expire = now + reply.lease_time*.75;
+        nfilled++;
+    }
+    log_messages.printf(MSG_DEBUG, "leased %d jobs\n", nfilled);
+    return 0;
+}
+
+// sleep until a scheduler empties a slot, or sleep_interval passes
+//
+void wait_for_empty_slot() {
+    unsigned int n = ssp->nslots_emptied;
+    double end = dtime() + sleep_interval;
+    while (dtime() < end) {
+        boinc_sleep(.1);
+        if (ssp->nslots_emptied != n) return;
+    }
+}
+
+// give back all unused jobs, and destroy our segment
+//
+void cleanup() {
+    if (!ssp) return;
+    ssp->ready = false;
+    for (int i=0; i<ssp->max_wu_results; i++) {
+        ssp->wu_results[i].time_emptied = 0;
+        local_leases[i].expire = 0;
+    }
+    get_returns();
+    if (sock >= 0) send_returns();
+    destroy_sched_shmem(ssp);
+}
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Keeps a local work array filled with jobs from a work_cache_server.\n\n"
+        "Usage: %s --server host [OPTION]...\n\n"
+        "Options:\n"
+        "  [ -d X | --debug_level X]        Set log verbosity to X (1..4)\n"
+        "  [ --port n ]                     Server's TCP port (default %d)\n"
+        "  [ --sleep_interval x ]           Check the local array every x secs (default 1)\n"
+        "  [ --tables_period x ]            Get app tables every x secs (default 60)\n"
+        "  [ -h | --help ]                  Shows this help text.\n"
+        "  [ -v | --version ]               Shows version information.\n",
+        name, DEFAULT_WORK_CACHE_PORT
+    );
+}
+
+int main(int argc, char** argv) {
+    int i, retval;
+    int num_work_items = MAX_WU_RESULTS;
+    void* p;
+    char path[MAXPATHLEN];
+
+    for (i=1; i<argc; i++) {
+        if (is_arg(argv[i], "d") || is_arg(argv[i], "debug_level")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            log_messages.set_debug_level(atoi(argv[i]));
+        } else if (is_arg(argv[i], "server")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            server_name = argv[i];
+        } else if (is_arg(argv[i], "port")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            port = atoi(argv[i]);
+        } else if (is_arg(argv[i], "sleep_interval")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            sleep_interval = atof(argv[i]);
+        } else if (is_arg(argv[i], "tables_period")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            tables_period = atoi(argv[i]);
+        } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
+            usage(argv[0]);
+            exit(0);
+        } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else {
+            log_messages.printf(MSG_CRITICAL, "unknown command line argument: %s\n\n", argv[i]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (!server_name) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    retval = config.parse_file();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't parse config.xml: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+
+    log_messages.printf(MSG_NORMAL, "Starting\n");
+    mypid = getpid();
+    if (config.shmem_work_items) {
+        num_work_items = config.shmem_work_items;
+    }
+
+    // create the semaphore and segment, as the feeder would
+    //
+    strncpy(path, config.project_dir, sizeof(path));
+    get_key(path, 'a', sema_key);
+    destroy_semaphore(sema_key);
+    create_semaphore(sema_key);
+
+    // our leases are gone, so don't keep an existing array
+    //
+    bool kept;
+    int shmem_size = SCHED_SHMEM::size(num_work_items);
+    retval = create_sched_shmem(shmem_size, false, &p, kept);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "can't create shmem\n");
+        exit(1);
+    }
+    ssp = (SCHED_SHMEM*)p;
+    ssp->init(num_work_items);
+    remote_tables = (SCHED_SHMEM*)calloc(1, sizeof(SCHED_SHMEM));
+    local_leases.resize(num_work_items);
+    for (i=0; i<num_work_items; i++) {
+        local_leases[i].active = false;
+    }
+
+    atexit(cleanup);
+    install_stop_signal_handler();
+
+    double next_tables_time = 0;
+    while (1) {
+        check_stop_daemons();
+        if (sock < 0 && connect_to_server()) {
+            daemon_sleep(5);
+            continue;
+        }
+        double now = dtime();
+        retval = 0;
+        if (now > next_tables_time) {
+            retval = get_tables();
+            if (!retval) next_tables_time = now + tables_period;
+        }
+        if (!retval) {
+            get_returns();
+            retval = send_returns();
+        }
+        if (!retval) retval = fill_slots();
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "lost connection to server: %s\n", boincerror(retval)
+            );
+            disconnect();
+            next_tables_time = 0;
+            continue;
+        }
+        wait_for_empty_slot();
+    }
+}
+
+const char *BOINC_RCSID_2c8a4f61d9 = "$Id$";
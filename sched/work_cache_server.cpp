@@ -0,0 +1,450 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// work_cache_server: lease jobs from the feeder's work array
+// to work_cache_client processes on other machines; see work_cache.h
+//
+// Usage: work_cache_server [ options ]
+//  [ -d x ]                debug level x
+//  [ --port n ]            listen on TCP port n (default 31417)
+//  [ --bind_addr a.b.c.d ] listen on this address (default 127.0.0.1);
+//                          0.0.0.0 means all interfaces
+//  [ --io_timeout x ]      drop a client if a read or write of a request
+//                          takes more than x seconds (default 10)
+//  [ --lease_time x ]      leases expire after x seconds (default 600)
+//  [ --max_lease n ]       lease at most n jobs per request (default 100)
+//
+// Run this on the feeder's machine.
+// There's no authentication: anyone who can connect can get jobs,
+// so by default we listen only on the loopback interface.
+// If the clients are on other machines, use --bind_addr to pick
+// an interface on the project's private network,
+// and make sure the port isn't reachable from outside.
+//
+// Clients are served one request at a time from a select() loop.
+// A client that stops in the middle of a request would block the others,
+// so reads and writes on client sockets time out (--io_timeout),
+// and the client is dropped.
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "error_numbers.h"
+#include "network.h"
+#include "shmem.h"
+#include "str_util.h"
+#include "svn_version.h"
+#include "util.h"
+
+#include "sched_config.h"
+#include "sched_msgs.h"
+#include "sched_util.h"
+
+#include "work_cache.h"
+
+struct LEASE {
+    int gen;
+    double expire;
+};
+
+SCHED_SHMEM* ssp = 0;
+std::map<int, LEASE> leases;    // keyed by slot
+int lease_time = 600;
+int max_lease = 100;
+int io_timeout = 10;
+int mypid;
+
+// attach to the feeder's segment, waiting for it if needed
+//
+void attach_feeder_shmem() {
+    void* p;
+    while (1) {
+        int retval = attach_sched_shmem(&p);
+        if (!retval && p) {
+            ssp = (SCHED_SHMEM*)p;
+            if (ssp->verify()) {
+                log_messages.printf(MSG_CRITICAL,
+                    "shmem has wrong struct sizes - recompile\n"
+                );
+                exit(1);
+            }
+            if (ssp->ready) return;
+            detach_sched_shmem(ssp);
+        }
+        log_messages.printf(MSG_NORMAL, "waiting for feeder\n");
+        daemon_sleep(5);
+    }
+}
+
+// give back the slots of all leases
+//
+void release_leases(bool expired_only) {
+    double now = dtime();
+    std::map<int, LEASE>::iterator i = leases.begin();
+    while (i != leases.end()) {
+        if (expired_only && i->second.expire > now) {
+            ++i;
+            continue;
+        }
+        WU_RESULT& wu_result = ssp->wu_results[i->first];
+        if (wu_result.state == mypid && wu_result.gen == i->second.gen) {
+            wu_result.release(mypid);
+            if (expired_only) {
+                log_messages.printf(MSG_NORMAL,
+                    "lease of slot %d expired\n", i->first
+                );
+            }
+        }
+        leases.erase(i++);
+    }
+}
+
+void cleanup() {
+    if (ssp) release_leases(false);
+}
+
+int send_reply(int sock, int status, int n) {
+    WC_REPLY reply;
+    reply.magic = WORK_CACHE_MAGIC;
+    reply.status = status;
+    reply.n = n;
+    reply.lease_time = lease_time;
+    return wc_write(sock, &reply, sizeof(reply));
+}
+
+// reserve up to n jobs for the client and send them
+//
+int handle_lease(int sock, int n) {
+    std::string jobs;
+        // WC_JOBs, each followed by its XML
+    static char xml_doc[BLOB_SIZE];
+    double now = dtime();
+    int retval, njobs=0;
+
+    if (n > max_lease) n = max_lease;
+    for (int i=0; i<ssp->max_wu_results && njobs<n; i++) {
+        WU_RESULT& wu_result = ssp->wu_results[i];
+        if (wu_result.state != WR_STATE_PRESENT) continue;
+        int gen = wu_result.read_gen();
+        if (!wu_result.claim(mypid, gen)) continue;
+        WC_JOB job;
+        job.slot = i;
+        job.gen = gen;
+        job.wu_result = wu_result;
+        ssp->get_wu_xml_doc(wu_result, xml_doc);
+        job.xml_doc_len = (int)strlen(xml_doc);
+        jobs.append((const char*)&job, sizeof(job));
+        jobs.append(xml_doc, job.xml_doc_len);
+        njobs++;
+        LEASE& lease = leases[i];
+        lease.gen = gen;
+        lease.expire = now + lease_time;
+    }
+    log_messages.printf(MSG_DEBUG,
+        "leasing %d of %d jobs\n", njobs, n
+    );
+
+    // if the client doesn't get them, the leases will expire
+    //
+    retval = send_reply(sock, 0, njobs);
+    if (retval) return retval;
+    if (jobs.empty()) return 0;
+    return wc_write(sock, jobs.data(), (int)jobs.size());
+}
+
+int handle_return(int sock, int n) {
+    std::vector<WC_RETURN> returns;
+    int retval, nused=0;
+
+    if (n < 0 || n > ssp->max_wu_results) return ERR_INVALID_PARAM;
+    if (n == 0) return send_reply(sock, 0, 0);
+    returns.resize(n);
+    retval = wc_read(sock, &returns[0], n*sizeof(WC_RETURN));
+    if (retval) return retval;
+    for (int i=0; i<n; i++) {
+        WC_RETURN& r = returns[i];
+        std::map<int, LEASE>::iterator li = leases.find(r.slot);
+        if (li == leases.end() || li->second.gen != r.gen) continue;
+        leases.erase(li);
+        WU_RESULT& wu_result = ssp->wu_results[r.slot];
+        if (wu_result.state != mypid || wu_result.gen != r.gen) continue;
+        if (r.used) {
+            ssp->clear_slot(wu_result, mypid);
+            nused++;
+        } else {
+            wu_result.release(mypid);
+        }
+    }
+    log_messages.printf(MSG_DEBUG,
+        "%d jobs returned, %d used\n", n, nused
+    );
+    return send_reply(sock, 0, n);
+}
+
+// handle a request; nonzero return means close the connection
+//
+int handle_request(int sock) {
+    WC_REQUEST req;
+    int retval;
+
+    retval = wc_read(sock, &req, sizeof(req));
+    if (retval) return retval;
+    if (req.magic != WORK_CACHE_MAGIC
+        || req.ss_size != (int)sizeof(SCHED_SHMEM)
+        || req.wu_result_size != (int)sizeof(WU_RESULT)
+    ) {
+        log_messages.printf(MSG_CRITICAL,
+            "bad request header; client is a different build?\n"
+        );
+        send_reply(sock, ERR_WRONG_SIZE, 0);
+        return ERR_WRONG_SIZE;
+    }
+    switch (req.type) {
+    case WC_REQ_TABLES:
+        retval = send_reply(sock, 0, 0);
+        if (retval) return retval;
+        return wc_write(sock, ssp, sizeof(SCHED_SHMEM));
+    case WC_REQ_LEASE:
+        return handle_lease(sock, req.n);
+    case WC_REQ_RETURN:
+        return handle_return(sock, req.n);
+    }
+    log_messages.printf(MSG_CRITICAL, "bad request type %d\n", req.type);
+    return ERR_INVALID_PARAM;
+}
+
+int open_listen_socket(const char* bind_addr, int port) {
+    int sock, retval;
+    sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
+        log_messages.printf(MSG_CRITICAL, "bad address %s\n", bind_addr);
+        return -1;
+    }
+    retval = boinc_socket(sock);
+    if (retval) return -1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)&one, sizeof(one));
+    if (bind(sock, (sockaddr*)&addr, sizeof(addr))) {
+        log_messages.printf(MSG_CRITICAL,
+            "bind to %s port %d failed\n", bind_addr, port
+        );
+        boinc_close_socket(sock);
+        return -1;
+    }
+    if (listen(sock, 16)) {
+        log_messages.printf(MSG_CRITICAL, "listen failed\n");
+        boinc_close_socket(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// make reads and writes on a client socket fail after io_timeout seconds,
+// so that wc_read() and wc_write() don't block the other clients
+//
+int set_io_timeout(int sock) {
+    timeval tv;
+    tv.tv_sec = io_timeout;
+    tv.tv_usec = 0;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&tv, sizeof(tv))) {
+        return ERR_SOCKET;
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char*)&tv, sizeof(tv))) {
+        return ERR_SOCKET;
+    }
+    return 0;
+}
+
+void serve(int listen_sock) {
+    std::vector<int> clients;
+    unsigned int i;
+
+    while (1) {
+        fd_set fds;
+        int max_fd = listen_sock;
+        FD_ZERO(&fds);
+        FD_SET(listen_sock, &fds);
+        for (i=0; i<clients.size(); i++) {
+            FD_SET(clients[i], &fds);
+            if (clients[i] > max_fd) max_fd = clients[i];
+        }
+        timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        int n = select(max_fd+1, &fds, NULL, NULL, &tv);
+        if (n > 0) {
+            if (FD_ISSET(listen_sock, &fds)) {
+                sockaddr_in addr;
+                socklen_t addr_len = sizeof(addr);
+                int sock = accept(listen_sock, (sockaddr*)&addr, &addr_len);
+                if (sock >= 0 && set_io_timeout(sock)) {
+                    log_messages.printf(MSG_CRITICAL,
+                        "can't set timeout on socket %d\n", sock
+                    );
+                    boinc_close_socket(sock);
+                } else if (sock >= 0) {
+                    log_messages.printf(MSG_NORMAL,
+                        "client %s connected (socket %d)\n",
+                        inet_ntoa(addr.sin_addr), sock
+                    );
+                    clients.push_back(sock);
+                }
+            }
+            for (i=0; i<clients.size(); ) {
+                int sock = clients[i];
+                if (FD_ISSET(sock, &fds) && handle_request(sock)) {
+                    log_messages.printf(MSG_NORMAL,
+                        "client disconnected (socket %d)\n", sock
+                    );
+                    boinc_close_socket(sock);
+                    clients.erase(clients.begin()+i);
+                    continue;
+                }
+                i++;
+            }
+        }
+        release_leases(true);
+
+        // if the feeder has exited, its segment is going away,
+        // or (if it's a file) may be kept by the next feeder;
+        // give back our slots in case
+        //
+        if (!ssp->ready) {
+            log_messages.printf(MSG_NORMAL, "feeder stopped\n");
+            release_leases(false);
+            detach_sched_shmem(ssp);
+            ssp = 0;
+            attach_feeder_shmem();
+        }
+        check_stop_daemons();
+    }
+}
+
+void usage(char *name) {
+    fprintf(stderr,
+        "Leases jobs from the feeder's shared memory to work_cache_client\n"
+        "processes on other machines.\n\n"
+        "Usage: %s [OPTION]...\n\n"
+        "Options:\n"
+        "  [ -d X | --debug_level X]        Set log verbosity to X (1..4)\n"
+        "  [ --port n ]                     Listen on TCP port n (default %d)\n"
+        "  [ --bind_addr a.b.c.d ]          Listen on this address (default 127.0.0.1)\n"
+        "  [ --io_timeout x ]               Drop clients that stall for x seconds (default 10)\n"
+        "  [ --lease_time x ]               Leases expire after x seconds (default 600)\n"
+        "  [ --max_lease n ]                Lease at most n jobs per request (default 100)\n"
+        "  [ -h | --help ]                  Shows this help text.\n"
+        "  [ -v | --version ]               Shows version information.\n",
+        name, DEFAULT_WORK_CACHE_PORT
+    );
+}
+
+int main(int argc, char** argv) {
+    int i, retval;
+    int port = DEFAULT_WORK_CACHE_PORT;
+    const char* bind_addr = "127.0.0.1";
+
+    for (i=1; i<argc; i++) {
+        if (is_arg(argv[i], "d") || is_arg(argv[i], "debug_level")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            log_messages.set_debug_level(atoi(argv[i]));
+        } else if (is_arg(argv[i], "port")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            port = atoi(argv[i]);
+        } else if (is_arg(argv[i], "bind_addr")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            bind_addr = argv[i];
+        } else if (is_arg(argv[i], "io_timeout")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            io_timeout = atoi(argv[i]);
+            if (io_timeout < 1) io_timeout = 1;
+        } else if (is_arg(argv[i], "lease_time")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            lease_time = atoi(argv[i]);
+        } else if (is_arg(argv[i], "max_lease")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            max_lease = atoi(argv[i]);
+        } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
+            usage(argv[0]);
+            exit(0);
+        } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else {
+            log_messages.printf(MSG_CRITICAL, "unknown command line argument: %s\n\n", argv[i]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    retval = config.parse_file();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "Can't parse config.xml: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+
+    log_messages.printf(MSG_NORMAL, "Starting\n");
+    mypid = getpid();
+    install_stop_signal_handler();
+    attach_feeder_shmem();
+    atexit(cleanup);
+
+    int sock = open_listen_socket(bind_addr, port);
+    if (sock < 0) exit(1);
+    serve(sock);
+}
+
+const char *BOINC_RCSID_7b3e09a1c5 = "$Id$";
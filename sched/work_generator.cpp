@@ -0,0 +1,311 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// The work generator framework; see work_generator.h
+
+#include "config.h"
+#include <sys/param.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "error_numbers.h"
+#include "md5_file.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "util.h"
+
+#include "sched_msgs.h"
+#include "sched_util.h"
+
+#include "work_generator.h"
+
+using std::vector;
+
+int JOB_SOURCE::stage_file(
+    WG_JOB&, WG_INPUT_FILE& f, const char* path, char* md5, double& nbytes
+) {
+    FILE* out = fopen(path, "w");
+    if (!out) return ERR_FOPEN;
+    size_t n = fwrite(f.contents.data(), 1, f.contents.size(), out);
+    if (fclose(out) || n != f.contents.size()) {
+        unlink(path);
+        return ERR_FWRITE;
+    }
+    nbytes = (double)f.contents.size();
+    return md5_block(
+        (const unsigned char*)f.contents.data(), (int)f.contents.size(), md5
+    );
+}
+
+static void* stage_thread(void* p) {
+    ((WORK_GENERATOR*)p)->stage_loop();
+    return NULL;
+}
+
+WORK_GENERATOR::WORK_GENERATOR(
+    SCHED_CONFIG& c, DB_APP& a, JOB_SOURCE& s
+) : config(c), app(a), source(s) {
+    wu_template = NULL;
+    result_template = NULL;
+    target_unsent = 100;
+    max_jobs = 1000;
+    nthreads = 1;
+    batch_size = 100;
+    count_interval = 10;
+    sleep_interval = 10;
+    work_batch = NULL;
+    quit = false;
+    nunsent = 0;
+    nresults_since_count = 0;
+    count_time = 0;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&job_ready, NULL);
+    pthread_cond_init(&job_staged, NULL);
+}
+
+WORK_GENERATOR::~WORK_GENERATOR() {
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&mutex);
+    for (unsigned int i=0; i<threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&job_staged);
+    pthread_cond_destroy(&job_ready);
+    pthread_mutex_destroy(&mutex);
+    delete work_batch;
+}
+
+int WORK_GENERATOR::init() {
+    if (!wu_template || !result_template) return ERR_NULL;
+    if (nthreads < 1) nthreads = 1;
+    if (batch_size < 1) batch_size = 1;
+
+    // staging writes path.md5 for each input file;
+    // this makes create_work() use it rather than read the file
+    //
+    config.cache_md5_info = true;
+
+    work_batch = new CREATE_WORK_BATCH(config, batch_size);
+    for (int i=0; i<nthreads; i++) {
+        pthread_t t;
+        int retval = pthread_create(&t, NULL, stage_thread, this);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't create staging thread: %s\n", strerror(retval)
+            );
+            return ERR_THREAD;
+        }
+        threads.push_back(t);
+    }
+    return 0;
+}
+
+// the number of unsent results: from the DB every count_interval seconds,
+// and in between, that count plus those of the jobs we've created
+//
+int WORK_GENERATOR::get_unsent(int& n) {
+    double now = dtime();
+    if (now - count_time >= count_interval) {
+        int retval = count_unsent_results(nunsent, app.id);
+        if (retval) return retval;
+        count_time = now;
+        nresults_since_count = 0;
+    }
+    n = nunsent + nresults_since_count;
+    return 0;
+}
+
+// create a job's input files, with their .md5 files.
+// This runs in a staging thread, so it doesn't log.
+//
+int WORK_GENERATOR::stage_job(WG_JOB& job) {
+    char path[MAXPATHLEN], md5_path[MAXPATHLEN], md5[64];
+    double nbytes;
+    int retval;
+
+    for (unsigned int i=0; i<job.infiles.size(); i++) {
+        WG_INPUT_FILE& f = job.infiles[i];
+        retval = config.download_path(f.name.c_str(), path);
+        if (retval) return retval;
+        retval = source.stage_file(job, f, path, md5, nbytes);
+        if (retval) return retval;
+
+        // write this after the file, so it's at least as new
+        //
+        snprintf(md5_path, sizeof(md5_path), "%s.md5", path);
+        FILE* out = fopen(md5_path, "w");
+        if (!out) return ERR_FOPEN;
+        fprintf(out, "%s %.15e\n", md5, nbytes);
+        if (fclose(out)) {
+            unlink(md5_path);
+            return ERR_FWRITE;
+        }
+    }
+    return 0;
+}
+
+void WORK_GENERATOR::stage_loop() {
+    while (1) {
+        pthread_mutex_lock(&mutex);
+        while (to_stage.empty() && !quit) {
+            pthread_cond_wait(&job_ready, &mutex);
+        }
+        if (quit) {
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+        WG_JOB* jp = to_stage.front();
+        to_stage.pop_front();
+        pthread_mutex_unlock(&mutex);
+
+        int retval = stage_job(*jp);
+
+        pthread_mutex_lock(&mutex);
+        jp->retval = retval;
+        jp->staged = true;
+        pthread_cond_broadcast(&job_staged);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+// add a staged job to the batch (which may insert the batch)
+//
+int WORK_GENERATOR::queue_job(WG_JOB& job) {
+    vector<const char*> infiles;
+    char path[MAXPATHLEN];
+
+    for (unsigned int i=0; i<job.infiles.size(); i++) {
+        infiles.push_back(job.infiles[i].name.c_str());
+    }
+    const char* wt = job.wu_template?job.wu_template:wu_template;
+    const char* rt = job.result_template?job.result_template:result_template;
+    safe_strcpy(path, config.project_path(rt));
+    return work_batch->add(
+        job.wu, wt, rt, path,
+        infiles.empty()?NULL:&infiles[0], (int)infiles.size(),
+        job.command_line.empty()?NULL:job.command_line.c_str()
+    );
+}
+
+// The source describes jobs, and the staging threads stage them,
+// up to "depth" jobs ahead of the oldest one.
+// Staged jobs are queued for insertion in the order described.
+//
+int WORK_GENERATOR::make_jobs(int nresults, int& njobs) {
+    std::deque<WG_JOB*> pending;
+        // jobs described but not yet queued, oldest first
+    int depth = 4*nthreads + batch_size;
+    int ndescribed = 0, nresults_described = 0;
+    int retval = 0, r;
+    bool more = true;
+
+    njobs = 0;
+    while (1) {
+        while (more && (int)pending.size() < depth
+            && nresults_described < nresults && ndescribed < max_jobs
+        ) {
+            WG_JOB* jp = new WG_JOB;
+            r = source.next_job(*jp);
+            if (r) {
+                delete jp;
+                more = false;
+                if (r != ERR_NOT_FOUND) {
+                    log_messages.printf(MSG_CRITICAL,
+                        "can't get next job: %s\n", boincerror(r)
+                    );
+                    retval = r;
+                }
+                break;
+            }
+            jp->wu.appid = app.id;
+            ndescribed++;
+            nresults_described += jp->wu.target_nresults;
+            pending.push_back(jp);
+            pthread_mutex_lock(&mutex);
+            to_stage.push_back(jp);
+            pthread_cond_signal(&job_ready);
+            pthread_mutex_unlock(&mutex);
+        }
+        if (pending.empty()) break;
+
+        WG_JOB* jp = pending.front();
+        pending.pop_front();
+        pthread_mutex_lock(&mutex);
+        while (!jp->staged) {
+            pthread_cond_wait(&job_staged, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+
+        if (jp->retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "can't stage input files of job %s: %s\n",
+                jp->wu.name, boincerror(jp->retval)
+            );
+        } else if (!retval) {
+            r = queue_job(*jp);
+            if (r) {
+                log_messages.printf(MSG_CRITICAL,
+                    "can't create job %s: %s\n", jp->wu.name, boincerror(r)
+                );
+                retval = r;
+                more = false;
+            } else {
+                njobs++;
+                nresults_since_count += jp->wu.target_nresults;
+            }
+        }
+        delete jp;
+    }
+    r = work_batch->flush();
+    if (r) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't insert jobs: %s\n", boincerror(r)
+        );
+        if (!retval) retval = r;
+    }
+    return retval;
+}
+
+void WORK_GENERATOR::run() {
+    int n, njobs, retval;
+
+    while (1) {
+        check_stop_daemons();
+        retval = get_unsent(n);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "count_unsent_results() failed: %s\n", boincerror(retval)
+            );
+            exit(retval);
+        }
+        if (n >= target_unsent) {
+            daemon_sleep(sleep_interval);
+            continue;
+        }
+        log_messages.printf(MSG_DEBUG,
+            "%d unsent results; making jobs for %d more\n",
+            n, target_unsent - n
+        );
+        retval = make_jobs(target_unsent - n, njobs);
+        if (retval) exit(retval);
+        log_messages.printf(MSG_DEBUG, "made %d jobs\n", njobs);
+        if (!njobs) daemon_sleep(sleep_interval);
+    }
+}
@@ -0,0 +1,151 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// A framework for work generators.
+//
+// The project supplies jobs through a JOB_SOURCE.
+// WORK_GENERATOR::run() keeps the number of unsent results
+// of an app near a target, and creates jobs in a pipeline:
+//
+// - the source describes each job (main thread)
+// - staging threads create the job's input files
+//   in the download hierarchy, and compute their MD5s
+// - the main thread queues staged jobs in a CREATE_WORK_BATCH,
+//   which inserts them with multi-row inserts
+//
+// The stages overlap: while jobs are being inserted,
+// later jobs are being staged.
+// See sample_work_generator.cpp for an example.
+
+#ifndef _WORK_GENERATOR_
+#define _WORK_GENERATOR_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "boinc_db.h"
+#include "backend_lib.h"
+#include "sched_config.h"
+
+struct WG_INPUT_FILE {
+    std::string name;
+        // physical name; the file goes in the download hierarchy
+    std::string contents;
+        // the contents, if the source supplies them here.
+        // Otherwise JOB_SOURCE::stage_file() creates the file.
+};
+
+struct WG_JOB {
+    DB_WORKUNIT wu;
+        // name and parameters; the generator fills in appid
+    std::vector<WG_INPUT_FILE> infiles;
+    std::string command_line;
+    const char* wu_template;
+    const char* result_template;
+        // e.g. "templates/x_out";
+        // NULL (the default) means the generator's templates
+    int retval;
+        // result of staging
+    bool staged;
+
+    WG_JOB() {
+        wu.clear();
+        wu_template = NULL;
+        result_template = NULL;
+        retval = 0;
+        staged = false;
+    }
+};
+
+class JOB_SOURCE {
+public:
+    virtual ~JOB_SOURCE() {}
+    virtual int next_job(WG_JOB&) = 0;
+        // describe the next job; called in the main thread.
+        // Return 0 if there is one, ERR_NOT_FOUND if there are none now;
+        // other values are errors and stop the generator.
+    virtual int stage_file(
+        WG_JOB&, WG_INPUT_FILE&, const char* path, char* md5, double& nbytes
+    );
+        // create an input file at the given path,
+        // and return its MD5 (hex) and size.
+        // Called by staging threads, possibly for several jobs at once,
+        // so this must be thread-safe and must not use the DB.
+        // The default writes the file's contents.
+};
+
+struct WORK_GENERATOR {
+    SCHED_CONFIG& config;
+    DB_APP& app;
+    JOB_SOURCE& source;
+    const char* wu_template;
+        // contents of the input template
+    const char* result_template;
+        // name of the output template, relative to the project dir
+    int target_unsent;
+        // keep at least this many unsent results
+    int max_jobs;
+        // create at most this many jobs per pass
+    int nthreads;
+        // number of staging threads
+    int batch_size;
+        // insert this many jobs at once
+    int count_interval;
+        // count unsent results in the DB at most this often (seconds).
+        // In between, the count is estimated
+        // from the jobs created since then.
+    int sleep_interval;
+        // sleep this long when there's enough work, or none to make
+
+    WORK_GENERATOR(SCHED_CONFIG&, DB_APP&, JOB_SOURCE&);
+    ~WORK_GENERATOR();
+    int init();
+        // start the staging threads; call after the DB is open
+    void run();
+        // the main loop; exits on a stop trigger or error
+    int make_jobs(int nresults, int& njobs);
+        // create jobs until they'll have nresults results in all,
+        // the source runs out, or max_jobs are made
+
+    // used by the staging threads
+    //
+    void stage_loop();
+
+private:
+    CREATE_WORK_BATCH* work_batch;
+    std::vector<pthread_t> threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;
+        // signalled when a job is queued for staging
+    pthread_cond_t job_staged;
+    std::deque<WG_JOB*> to_stage;
+    bool quit;
+
+    int nunsent;
+        // the last DB count of unsent results
+    int nresults_since_count;
+        // plus results of jobs created since then
+    double count_time;
+
+    int get_unsent(int& n);
+    int stage_job(WG_JOB&);
+    int queue_job(WG_JOB&);
+};
+
+#endif
@@ -18,6 +18,7 @@
 // wu_check
 // look for results with missing input files
 // --repair      change them to server_state OVER, outcome COULDNT_SEND
+// --nthreads N  check N fanout dirs at once
 //
 // NOTE 1: this assumes that jobs have a single input file.
 // NOTE 2: should rewrite to enumerate WUs, not results
@@ -27,7 +28,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <map>
 #include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "boinc_db.h"
 #include "svn_version.h"
@@ -35,8 +40,10 @@
 #include "error_numbers.h"
 #include "filesys.h"
 #include "parse.h"
+#include "str_replace.h"
 #include "util.h"
 
+#include "dir_walk.h"
 #include "sched_config.h"
 #include "sched_util.h"
 
@@ -56,50 +63,159 @@ int get_file_path(WORKUNIT& wu, char* path) {
     return 0;
 }
 
-int handle_result(DB_RESULT& result) {
+// Results are checked in batches.
+// Their files are grouped by fanout dir,
+// and --nthreads threads check the dirs (see dir_walk.h).
+//
+#define BATCH_SIZE  10000
+
+struct FILE_CHECK {
+    int resultid;
+    int server_state;
+    std::string name;
+    int dir;
+    bool missing;
+};
+
+struct CHECK_DIR {
+    std::string path;
+    std::vector<int> checks;
+};
+
+struct CHECK_BATCH {
+    std::vector<FILE_CHECK> checks;
+    std::vector<CHECK_DIR> dirs;
+    std::map<std::string, int> dir_index;
+
+    void clear() {
+        checks.clear();
+        dirs.clear();
+        dir_index.clear();
+    }
+};
+
+int nthreads = 1;
+
+// the paths of WUs' input files, by WU ID;
+// cleared with each batch to bound memory
+//
+std::map<int, std::string> wu_paths;
+
+int add_result(CHECK_BATCH& batch, DB_RESULT& result) {
     DB_WORKUNIT wu;
     int retval;
     char path[MAXPATHLEN];
-    char buf[256];
-    FILE* f;
 
-    retval = wu.lookup_id(result.workunitid);
-    if (retval) {
-        printf(
-            "ERROR: can't find WU %d for result %d\n",
-            result.workunitid, result.id
-        );
-        return 1;
+    std::map<int, std::string>::iterator i = wu_paths.find(result.workunitid);
+    if (i == wu_paths.end()) {
+        retval = wu.lookup_id(result.workunitid);
+        if (retval) {
+            printf(
+                "ERROR: can't find WU %d for result %d\n",
+                result.workunitid, result.id
+            );
+            return 1;
+        }
+        get_file_path(wu, path);
+        wu_paths[result.workunitid] = path;
+    } else {
+        safe_strcpy(path, i->second.c_str());
     }
-    get_file_path(wu, path);
-    f = fopen(path, "r");
-    if (f) {
-        fclose(f);
+    char* p = strrchr(path, '/');
+    if (!p) return 1;
+    *p = 0;
+
+    FILE_CHECK fc;
+    fc.resultid = result.id;
+    fc.server_state = result.server_state;
+    fc.name = p+1;
+    fc.missing = false;
+    std::map<std::string, int>::iterator j = batch.dir_index.find(path);
+    if (j == batch.dir_index.end()) {
+        fc.dir = (int)batch.dirs.size();
+        CHECK_DIR cd;
+        cd.path = path;
+        batch.dirs.push_back(cd);
+        batch.dir_index[path] = fc.dir;
     } else {
-        printf("no file %s for result %d\n",
-            path, result.id
+        fc.dir = j->second;
+    }
+    batch.dirs[fc.dir].checks.push_back((int)batch.checks.size());
+    batch.checks.push_back(fc);
+    return 0;
+}
+
+// see whether the files in a dir of the batch are there
+//
+void check_dir(int i, void* arg) {
+    CHECK_BATCH& batch = *(CHECK_BATCH*)arg;
+    CHECK_DIR& cd = batch.dirs[i];
+    int dirfd = open(cd.path.c_str(), O_RDONLY|O_DIRECTORY);
+    for (unsigned int j=0; j<cd.checks.size(); j++) {
+        FILE_CHECK& fc = batch.checks[cd.checks[j]];
+        if (dirfd < 0 || faccessat(dirfd, fc.name.c_str(), R_OK, 0)) {
+            fc.missing = true;
+        }
+    }
+    if (dirfd >= 0) close(dirfd);
+}
+
+// check a batch; report (and maybe repair) results with missing files.
+// Return the number of these
+//
+int check_batch(CHECK_BATCH& batch) {
+    DB_RESULT result;
+    char buf[256];
+    int retval, nerr = 0;
+
+    run_dir_workers((int)batch.dirs.size(), nthreads, check_dir, &batch);
+    for (unsigned int i=0; i<batch.checks.size(); i++) {
+        FILE_CHECK& fc = batch.checks[i];
+        if (!fc.missing) continue;
+        nerr++;
+        printf("no file %s/%s for result %d\n",
+            batch.dirs[fc.dir].path.c_str(), fc.name.c_str(), fc.resultid
         );
         if (repair) {
-            if (result.server_state == RESULT_SERVER_STATE_UNSENT) {
-                result.server_state = RESULT_SERVER_STATE_OVER;
-                result.outcome = RESULT_OUTCOME_COULDNT_SEND;
+            if (fc.server_state == RESULT_SERVER_STATE_UNSENT) {
+                result.id = fc.resultid;
                 sprintf(
                     buf,"server_state=%d, outcome=%d",
-                    result.server_state, result.outcome
+                    RESULT_SERVER_STATE_OVER, RESULT_OUTCOME_COULDNT_SEND
                 );
                 retval = result.update_field(buf);
                 if (retval) {
                     printf(
                         "ERROR: can't update result %d\n",
-                        result.id
+                        fc.resultid
                     );
-                    return 1;
                 }
             }
         }
-        return 1;
     }
-    return 0;
+    batch.clear();
+    wu_paths.clear();
+    return nerr;
+}
+
+// check the results with the given server state
+//
+void check_results(int server_state) {
+    DB_RESULT result;
+    CHECK_BATCH batch;
+    char clause[256];
+    int n = 0, nerr = 0;
+
+    sprintf(clause, "where server_state=%d", server_state);
+    while (!result.enumerate(clause)) {
+        n++;
+        if (add_result(batch, result)) nerr++;
+        if ((int)batch.checks.size() >= BATCH_SIZE) {
+            nerr += check_batch(batch);
+        }
+    }
+    nerr += check_batch(batch);
+    printf("%d out of %d errors\n", nerr, n);
 }
 
 void usage(char *name) {
@@ -109,6 +225,7 @@ void usage(char *name) {
         "Options:\n"
         "  [ --repair ]                   change them to server_state OVER,\n"
         "                                 outcome COULDNT_SEND\n"
+        "  [ --nthreads N ]               check N fanout directories at once\n"
         "  [ -h | --help ]                Shows this help text\n"
         "  [ -v | --version ]             Shows version information\n",
         name
@@ -116,9 +233,7 @@ void usage(char *name) {
 }
 
 int main(int argc, char** argv) {
-    DB_RESULT result;
-    char clause[256];
-    int retval, n, nerr;
+    int retval;
 
     for(int c = 1; c < argc; c++) {
         std::string option(argv[c]);
@@ -130,6 +245,13 @@ int main(int argc, char** argv) {
             exit(0);
         } else if (option == "--repair") {
             repair = true;
+        } else if (option == "--nthreads") {
+            if (++c >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[c]);
+            if (nthreads < 1) nthreads = 1;
         } else {
             fprintf(stderr, "unknown command line argument: %s\n\n", argv[c]);
             usage(argv[0]);
@@ -148,24 +270,10 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    n = nerr = 0;
     printf("Unsent results:\n");
-    sprintf(clause, "where server_state=%d", RESULT_SERVER_STATE_UNSENT);
-    while (!result.enumerate(clause)) {
-        retval = handle_result(result);
-        n++;
-        if (retval) nerr++;
-    }
-    printf("%d out of %d errors\n", nerr, n);
-    n = nerr = 0;
+    check_results(RESULT_SERVER_STATE_UNSENT);
     printf("In progress results:\n");
-    sprintf(clause, "where server_state=%d", RESULT_SERVER_STATE_IN_PROGRESS);
-    while (!result.enumerate(clause)) {
-        retval = handle_result(result);
-        n++;
-        if (retval) nerr++;
-    }
-    printf("%d out of %d errors\n", nerr, n);
+    check_results(RESULT_SERVER_STATE_IN_PROGRESS);
 }
 
 const char *BOINC_RCSID_8f4e399992 = "$Id$";
@@ -23,6 +23,7 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <map>
 #include <string>
 #include <vector>
 #include <ctime>
@@ -106,6 +107,48 @@ static void initialize_result(DB_RESULT& result, WORKUNIT& wu) {
     result.batch = wu.batch;
 }
 
+// fill in a new result for the given WU,
+// given the contents of its result template
+// (which is modified)
+//
+static int make_result(
+    DB_RESULT& result,
+    WORKUNIT& wu,
+    char* result_template,
+    char* result_name_suffix,
+    R_RSA_PRIVATE_KEY& key,
+    SCHED_CONFIG& config_loc,
+    int priority_increase
+) {
+    char base_outfile_name[256];
+    int retval;
+
+    initialize_result(result, wu);
+    result.priority += priority_increase;
+    sprintf(result.name, "%s_%s", wu.name, result_name_suffix);
+    sprintf(base_outfile_name, "%s_", result.name);
+
+    retval = process_result_template(
+        result_template, key, base_outfile_name, config_loc
+    );
+    if (retval) {
+        fprintf(stderr,
+            "process_result_template() error: %s\n", boincerror(retval)
+        );
+    }
+    if (strlen(result_template) > sizeof(result.xml_doc_in)-1) {
+        fprintf(stderr,
+            "result XML doc is too long: %d bytes, max is %d\n",
+            (int)strlen(result_template), (int)sizeof(result.xml_doc_in)-1
+        );
+        return ERR_BUFFER_OVERFLOW;
+    }
+    strlcpy(result.xml_doc_in, result_template, sizeof(result.xml_doc_in));
+
+    result.random = lrand48();
+    return 0;
+}
+
 int create_result_ti(
     TRANSITIONER_ITEM& ti,
     char* result_template_filename,
@@ -153,14 +196,9 @@ int create_result(
     int priority_increase
 ) {
     DB_RESULT result;
-    char base_outfile_name[256];
     char result_template[BLOB_SIZE];
     int retval;
 
-    initialize_result(result, wu);
-    result.priority += priority_increase;
-    sprintf(result.name, "%s_%s", wu.name, result_name_suffix);
-    sprintf(base_outfile_name, "%s_", result.name);
     retval = read_filename(
         result_template_filename, result_template, sizeof(result_template)
     );
@@ -171,25 +209,11 @@ int create_result(
         );
         return retval;
     }
-
-    retval = process_result_template(
-        result_template, key, base_outfile_name, config_loc
+    retval = make_result(
+        result, wu, result_template, result_name_suffix, key, config_loc,
+        priority_increase
     );
-    if (retval) {
-        fprintf(stderr,
-            "process_result_template() error: %s\n", boincerror(retval)
-        );
-    }
-    if (strlen(result_template) > sizeof(result.xml_doc_in)-1) {
-        fprintf(stderr,
-            "result XML doc is too long: %d bytes, max is %d\n",
-            (int)strlen(result_template), (int)sizeof(result.xml_doc_in)-1
-        );
-        return ERR_BUFFER_OVERFLOW;
-    }
-    strlcpy(result.xml_doc_in, result_template, sizeof(result.xml_doc_in));
-
-    result.random = lrand48();
+    if (retval) return retval;
 
     if (query_string) {
         result.db_print_values(query_string);
@@ -200,6 +224,7 @@ int create_result(
             return retval;
         }
     }
+    state_count_deltas.note(result.appid, 0, result.server_state);
 
     return 0;
 }
@@ -222,11 +247,13 @@ int check_files(char** infiles, int ninfiles, SCHED_CONFIG& config_loc) {
     return 0;
 }
 
-int create_work(
-    DB_WORKUNIT& wu,
+// the part of create_work() that doesn't involve the DB:
+// expand the input template and check the job parameters
+//
+static int prepare_work(
+    WORKUNIT& wu,
     const char* _wu_template,
     const char* result_template_filename,
-    const char* result_template_filepath,
     const char** infiles,
     int ninfiles,
     SCHED_CONFIG& config_loc,
@@ -234,7 +261,6 @@ int create_work(
     const char* additional_xml
 ) {
     int retval;
-    char _result_template[BLOB_SIZE];
     char wu_template[BLOB_SIZE];
 
 #if 0
@@ -255,17 +281,6 @@ int create_work(
         return retval;
     }
 
-    retval = read_filename(
-        result_template_filepath, _result_template, sizeof(_result_template)
-    );
-    if (retval) {
-        fprintf(stderr,
-            "create_work: can't read result template file %s\n",
-            result_template_filepath
-        );
-        return retval;
-    }
-
     if (strlen(result_template_filename) > sizeof(wu.result_template_file)-1) {
         fprintf(stderr,
             "result template filename is too big: %d bytes, max is %d\n",
@@ -321,6 +336,40 @@ int create_work(
     } else {
         wu.transition_time = time(0);
     }
+    return 0;
+}
+
+int create_work(
+    DB_WORKUNIT& wu,
+    const char* wu_template,
+    const char* result_template_filename,
+    const char* result_template_filepath,
+    const char** infiles,
+    int ninfiles,
+    SCHED_CONFIG& config_loc,
+    const char* command_line,
+    const char* additional_xml
+) {
+    int retval;
+    char _result_template[BLOB_SIZE];
+
+    retval = prepare_work(
+        wu, wu_template, result_template_filename, infiles, ninfiles,
+        config_loc, command_line, additional_xml
+    );
+    if (retval) return retval;
+
+    retval = read_filename(
+        result_template_filepath, _result_template, sizeof(_result_template)
+    );
+    if (retval) {
+        fprintf(stderr,
+            "create_work: can't read result template file %s\n",
+            result_template_filepath
+        );
+        return retval;
+    }
+
     if (wu.id) {
         retval = wu.update();
         if (retval) {
@@ -343,6 +392,250 @@ int create_work(
     return 0;
 }
 
+////////// batched job creation ///////////////
+
+#define BATCH_QUERY_MAX (1024*1024)
+    // start a new multi-row statement when one gets this long
+
+// append a value list to a multi-row insert,
+// first doing the insert if it's getting too long
+//
+static int add_value(DB_BASE& table, string& values, const char* value) {
+    int retval;
+
+    if (values.size() && values.size() + strlen(value) > BATCH_QUERY_MAX) {
+        retval = table.insert_batch(values);
+        values.clear();
+        if (retval) return retval;
+    }
+    if (values.size()) values += ",";
+    values += value;
+    return 0;
+}
+
+// look up the IDs of WUs given a list of quoted names
+//
+static int lookup_wu_ids(string& names, std::map<string, int>& ids) {
+    MYSQL_ROW row;
+    MYSQL_RES* rp;
+    int retval;
+
+    string query = "select id, name from workunit where name in (" + names + ")";
+    names.clear();
+    retval = boinc_db.do_query(query.c_str());
+    if (retval) return retval;
+    rp = mysql_store_result(boinc_db.mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    while ((row = mysql_fetch_row(rp))) {
+        ids[row[1]] = atoi(row[0]);
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
+CREATE_WORK_BATCH::CREATE_WORK_BATCH(SCHED_CONFIG& c, int n) : config(c) {
+    batch_size = n;
+    key = NULL;
+    skip_existing = false;
+    nskipped = 0;
+}
+
+// get the contents of a result template file, reading it only once
+//
+int CREATE_WORK_BATCH::get_result_template(const char* path, const char*& p) {
+    char buf[BLOB_SIZE];
+    int retval;
+
+    std::map<string, string>::iterator i = result_templates.find(path);
+    if (i == result_templates.end()) {
+        retval = read_filename(path, buf, sizeof(buf));
+        if (retval) {
+            fprintf(stderr,
+                "create_work: can't read result template file %s\n", path
+            );
+            return retval;
+        }
+        i = result_templates.insert(make_pair(string(path), string(buf))).first;
+    }
+    p = i->second.c_str();
+    return 0;
+}
+
+int CREATE_WORK_BATCH::add(
+    WORKUNIT& wu,
+    const char* wu_template,
+    const char* result_template_filename,
+    const char* result_template_filepath,
+    const char** infiles,
+    int ninfiles,
+    const char* command_line,
+    const char* additional_xml
+) {
+    const char* p;
+    int retval;
+
+    if (wu.id) {
+        fprintf(stderr, "CREATE_WORK_BATCH::add(): WU %s already exists\n",
+            wu.name
+        );
+        return ERR_INVALID_PARAM;
+    }
+    retval = prepare_work(
+        wu, wu_template, result_template_filename, infiles, ninfiles,
+        config, command_line, additional_xml
+    );
+    if (retval) return retval;
+    retval = get_result_template(result_template_filepath, p);
+    if (retval) return retval;
+
+    wus.push_back(wu);
+    result_template_paths.push_back(result_template_filepath);
+    if ((int)wus.size() >= batch_size) {
+        return flush();
+    }
+    return 0;
+}
+
+int CREATE_WORK_BATCH::flush() {
+    int retval = 0;
+    if (skip_existing) retval = remove_existing();
+    if (!retval) retval = insert_queued();
+    wus.clear();
+    result_template_paths.clear();
+    return retval;
+}
+
+// remove queued WUs that are already in the DB
+//
+int CREATE_WORK_BATCH::remove_existing() {
+    std::vector<WORKUNIT> new_wus;
+    std::vector<string> new_paths;
+    std::map<string, int> ids;
+    string names;
+    unsigned int i;
+    int retval;
+
+    if (wus.empty()) return 0;
+    for (i=0; i<wus.size(); i++) {
+        if (names.size() > BATCH_QUERY_MAX) {
+            retval = lookup_wu_ids(names, ids);
+            if (retval) return retval;
+        }
+        if (names.size()) names += ",";
+        names += "'" + string(wus[i].name) + "'";
+    }
+    retval = lookup_wu_ids(names, ids);
+    if (retval) return retval;
+    if (ids.empty()) return 0;
+
+    for (i=0; i<wus.size(); i++) {
+        if (ids.find(wus[i].name) != ids.end()) {
+            nskipped++;
+            continue;
+        }
+        new_wus.push_back(wus[i]);
+        new_paths.push_back(result_template_paths[i]);
+    }
+    wus.swap(new_wus);
+    result_template_paths.swap(new_paths);
+    return 0;
+}
+
+int CREATE_WORK_BATCH::insert_queued() {
+    DB_WORKUNIT dbwu;
+    DB_RESULT result;
+    string values, names;
+    std::map<string, int> ids;
+    std::map<string, int>::iterator it;
+    const char* p;
+    char suffix[256];
+    static char buf[MAX_QUERY_LEN];
+    static char result_template[BLOB_SIZE];
+    unsigned int i;
+    int j, retval;
+
+    if (wus.empty()) return 0;
+
+    // insert the WUs, then get their IDs
+    //
+    for (i=0; i<wus.size(); i++) {
+        dbwu = wus[i];
+        dbwu.db_print_values(buf);
+        retval = add_value(dbwu, values, buf);
+        if (retval) {
+            fprintf(stderr, "create_work: insert_batch(): %s\n",
+                boincerror(retval)
+            );
+            return retval;
+        }
+    }
+    retval = dbwu.insert_batch(values);
+    if (retval) {
+        fprintf(stderr, "create_work: insert_batch(): %s\n", boincerror(retval));
+        return retval;
+    }
+    values.clear();
+
+    for (i=0; i<wus.size(); i++) {
+        if (names.size() > BATCH_QUERY_MAX) {
+            retval = lookup_wu_ids(names, ids);
+            if (retval) return retval;
+        }
+        if (names.size()) names += ",";
+        names += "'" + string(wus[i].name) + "'";
+    }
+    retval = lookup_wu_ids(names, ids);
+    if (retval) return retval;
+
+    for (i=0; i<wus.size(); i++) {
+        it = ids.find(wus[i].name);
+        if (it == ids.end()) {
+            fprintf(stderr, "create_work: can't find ID of WU %s\n",
+                wus[i].name
+            );
+            return ERR_DB_NOT_FOUND;
+        }
+        wus[i].id = it->second;
+        wu_ids.push_back(wus[i].id);
+    }
+
+    if (!key) return 0;
+
+    // create the WUs' first instances
+    //
+    for (i=0; i<wus.size(); i++) {
+        WORKUNIT& wu = wus[i];
+        retval = get_result_template(result_template_paths[i].c_str(), p);
+        if (retval) return retval;
+        for (j=0; j<wu.target_nresults; j++) {
+            safe_strcpy(result_template, p);
+            sprintf(suffix, "%d", j);
+            retval = make_result(
+                result, wu, result_template, suffix, *key, config, 0
+            );
+            if (retval) return retval;
+            result.db_print_values(buf);
+            retval = add_value(result, values, buf);
+            if (retval) {
+                fprintf(stderr, "create_work: result insert_batch(): %s\n",
+                    boincerror(retval)
+                );
+                return retval;
+            }
+        }
+    }
+    if (values.size()) {
+        retval = result.insert_batch(values);
+        if (retval) {
+            fprintf(stderr, "create_work: result insert_batch(): %s\n",
+                boincerror(retval)
+            );
+            return retval;
+        }
+    }
+    return 0;
+}
+
 // STUFF RELATED TO FILE UPLOAD/DOWNLOAD
 
 int get_file_xml(
@@ -522,30 +815,70 @@ int create_delete_file_msg(int host_id, const char* file_name) {
     return 0;
 }
 
+#define CANCEL_CHUNK_SIZE   10000
+    // cancel this many WU IDs per pair of UPDATEs,
+    // so that no statement locks a huge range of rows
+
+// cancel the WUs with IDs in [min_id, max_id] (and in the given batch,
+// if batch_id is nonzero) and their unsent results.
+// The transitioner does the rest.
+//
+static int cancel_jobs_aux(int min_id, int max_id, int batch_id) {
+    DB_WORKUNIT wu;
+    DB_RESULT result;
+    char set_clause[256], where_clause[256], batch_clause[256];
+    int retval, start, end;
+
+    strcpy(batch_clause, "");
+    if (batch_id) {
+        sprintf(batch_clause, " and batch=%d", batch_id);
+    }
+    for (start=min_id; start<=max_id; start=end+1) {
+        end = start + CANCEL_CHUNK_SIZE - 1;
+        if (end > max_id || end < start) end = max_id;
+
+        sprintf(set_clause, "server_state=%d, outcome=%d",
+            RESULT_SERVER_STATE_OVER, RESULT_OUTCOME_DIDNT_NEED
+        );
+        sprintf(where_clause,
+            "server_state<=%d and workunitid>=%d and workunitid<=%d%s",
+            RESULT_SERVER_STATE_UNSENT, start, end, batch_clause
+        );
+        retval = result.update_fields_noid(set_clause, where_clause);
+        if (retval) return retval;
+
+        sprintf(set_clause, "error_mask=error_mask|%d, transition_time=%d",
+            WU_ERROR_CANCELLED, (int)(time(0))
+        );
+        sprintf(where_clause, "id>=%d and id<=%d%s", start, end, batch_clause);
+        retval = wu.update_fields_noid(set_clause, where_clause);
+        if (retval) return retval;
+    }
+    return 0;
+}
+
 // cancel jobs in a range of workunit IDs
 //
 int cancel_jobs(int min_id, int max_id) {
+    return cancel_jobs_aux(min_id, max_id, 0);
+}
+
+// cancel the jobs in a batch.
+// Use the batch's ID range, so that the updates go by primary key
+//
+int cancel_batch(int batch_id) {
     DB_WORKUNIT wu;
-    DB_RESULT result;
-    char set_clause[256], where_clause[256];
-    int retval;
+    char buf[256];
+    int retval, min_id, max_id;
 
-    sprintf(set_clause, "server_state=%d, outcome=%d",
-        RESULT_SERVER_STATE_OVER, RESULT_OUTCOME_DIDNT_NEED
-    );
-    sprintf(where_clause, "server_state<=%d and workunitid >=%d and workunitid<= %d",
-        RESULT_SERVER_STATE_UNSENT, min_id, max_id
-    );
-    retval = result.update_fields_noid(set_clause, where_clause);
+    sprintf(buf, "select min(id) from workunit where batch=%d", batch_id);
+    retval = wu.get_integer(buf, min_id);
+    if (retval == ERR_DB_NOT_FOUND) return 0;     // empty batch
     if (retval) return retval;
-
-    sprintf(set_clause, "error_mask=error_mask|%d, transition_time=%d",
-        WU_ERROR_CANCELLED, (int)(time(0))
-    );
-    sprintf(where_clause, "id>=%d and id<=%d", min_id, max_id);
-    retval = wu.update_fields_noid(set_clause, where_clause);
+    sprintf(buf, "where batch=%d", batch_id);
+    retval = wu.max_id(max_id, buf);
     if (retval) return retval;
-    return 0;
+    return cancel_jobs_aux(min_id, max_id, batch_id);
 }
 
 // cancel a particular job
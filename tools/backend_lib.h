@@ -19,6 +19,9 @@
 #define H_BACKEND_LIB
 
 #include <limits.h>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "crypt.h"
 #include "sched_config.h"
@@ -71,6 +74,47 @@ extern int create_work(
     const char* additional_xml = NULL
 );
 
+// Create jobs in batches.
+// add() expands and checks a job as create_work() does, and queues it.
+// flush() (called by add() every batch_size jobs,
+// and by the caller when done) inserts the queued WUs
+// with multi-row inserts and looks up their IDs,
+// which are appended to wu_ids.
+// If key is set, flush() also creates each WU's first
+// target_nresults instances, so the transitioner doesn't have to.
+// If skip_existing is set, flush() drops queued WUs whose name
+// is already in the DB, so that a submission can be repeated.
+// Result template files are read once.
+//
+struct CREATE_WORK_BATCH {
+    SCHED_CONFIG& config;
+    int batch_size;
+    R_RSA_PRIVATE_KEY* key;
+    bool skip_existing;
+    std::vector<int> wu_ids;
+    int nskipped;       // WUs dropped because they existed
+
+    CREATE_WORK_BATCH(SCHED_CONFIG&, int batch_size=100);
+    int add(
+        WORKUNIT& wu,
+        const char* wu_template,
+        const char* result_template_filename,
+        const char* result_template_filepath,
+        const char** infiles,
+        int ninfiles,
+        const char* command_line = NULL,
+        const char* additional_xml = NULL
+    );
+    int flush();
+private:
+    std::vector<WORKUNIT> wus;
+    std::vector<std::string> result_template_paths;
+    std::map<std::string, std::string> result_templates;
+    int get_result_template(const char* path, const char*& p);
+    int remove_existing();
+    int insert_queued();
+};
+
 extern int stage_file(const char*, bool);
 
 // the following functions return XML that can be put in
@@ -121,6 +165,10 @@ extern int create_delete_file_msg(
 //
 extern int cancel_jobs(int min_id, int max_id);
 
+// cancel the jobs in a batch
+//
+extern int cancel_batch(int batch_id);
+
 // cancel a particular job
 //
 extern int cancel_job(DB_WORKUNIT&);
@@ -19,6 +19,8 @@
 //    cancel jobs from min-ID to max-ID inclusive
 // cancel_jobs --name wuname
 //    cancel the job with the given name
+// cancel_jobs --batch ID
+//    cancel the jobs in the given batch
 
 #include <stdio.h>
 
@@ -28,6 +30,7 @@
 void usage() {
     fprintf(stderr, "Usage: cancel_jobs min-ID max-ID\n");
     fprintf(stderr, "or cancel_jobs --name wuname\n");
+    fprintf(stderr, "or cancel_jobs --batch ID\n");
     exit(1);
 }
 
@@ -54,6 +57,10 @@ int main(int argc, char** argv) {
             exit(1);
         }
         retval = cancel_job(wu);
+    } else if (!strcmp(argv[1], "--batch")) {
+        int batch_id = atoi(argv[2]);
+        if (!batch_id) usage();
+        retval = cancel_batch(batch_id);
     } else {
         int min_id = atoi(argv[1]);
         int max_id = atoi(argv[2]);
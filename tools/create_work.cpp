@@ -20,13 +20,28 @@
 // See the docs for a description of WU and result template files
 // This program must be run in the project's root directory
 //
+// With --stdin, create many jobs in one run:
+// each line of stdin describes a job, in the form
+//
+// [ --wu_name name ] [ --command_line "X" ] [ --rsc_fpops_est x ]
+//   [ --rsc_fpops_bound x ] [ --priority n ] [ --additional_xml x ]
+//   infile1 infile2 ...
+//
+// Other options given on the command line apply to all jobs.
+// The jobs are inserted in batches (see CREATE_WORK_BATCH),
+// jobs whose name is already in the DB are skipped,
+// and progress is written to stderr.
+//
 #include "config.h"
 
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <set>
 #include <string>
+#include <vector>
 #include <sys/param.h>
 #include <unistd.h>
 
@@ -66,6 +81,7 @@ void usage() {
         "   [ --rsc_fpops_bound x ]\n"
         "   [ --rsc_memory_bound x ]\n"
         "   [ --size_class n ]\n"
+        "   [ --stdin ]   read job descriptions from stdin, one per line\n"
         "   [ --target_host ID ]\n"
         "   [ --target_nresults n ]\n"
         "   [ --target_team ID ]\n"
@@ -86,6 +102,128 @@ bool arg(const char** argv, int i, const char* name) {
     return false;
 }
 
+#define STDIN_BATCH_SIZE    1000
+    // insert this many jobs at a time in --stdin mode
+#define PROGRESS_INTERVAL   10000
+    // report progress every this many jobs
+
+// split a job description line into words.
+// Double quotes group words; within them, \" and \\ are " and \
+//
+void split_line(char* line, std::vector<std::string>& words) {
+    char* p = line;
+    words.clear();
+    while (1) {
+        while (isspace(*p)) p++;
+        if (!*p) break;
+        std::string w;
+        bool quoted = false;
+        while (*p && (quoted || !isspace(*p))) {
+            if (*p == '"') {
+                quoted = !quoted;
+            } else if (quoted && *p == '\\' && (p[1] == '"' || p[1] == '\\')) {
+                w += *(++p);
+            } else {
+                w += *p;
+            }
+            p++;
+        }
+        words.push_back(w);
+    }
+}
+
+// create jobs described by lines of stdin.
+// wu has the defaults from the command line.
+//
+int create_work_stdin(
+    DB_WORKUNIT& wu,
+    const char* wu_template,
+    const char* result_template_file,
+    const char* result_template_path,
+    const char* command_line,
+    const char* additional_xml
+) {
+    CREATE_WORK_BATCH cwb(config, STDIN_BATCH_SIZE);
+    std::set<std::string> names;
+    std::vector<std::string> words;
+    std::vector<const char*> infiles;
+    char line[BLOB_SIZE];
+    int retval, njobs = 0, lineno = 0;
+
+    cwb.skip_existing = true;
+    while (fgets(line, sizeof(line), stdin)) {
+        lineno++;
+        split_line(line, words);
+        if (words.empty()) continue;
+
+        DB_WORKUNIT wu2 = wu;
+        const char* cmdline = command_line;
+        const char* axml = additional_xml;
+        strcpy(wu2.name, "");
+        infiles.clear();
+        for (unsigned int i=0; i<words.size(); i++) {
+            const char* w = words[i].c_str();
+            bool has_val = i+1 < words.size();
+            if (!strcmp(w, "--wu_name") && has_val) {
+                safe_strcpy(wu2.name, words[++i].c_str());
+            } else if (!strcmp(w, "--command_line") && has_val) {
+                cmdline = words[++i].c_str();
+            } else if (!strcmp(w, "--rsc_fpops_est") && has_val) {
+                wu2.rsc_fpops_est = atof(words[++i].c_str());
+            } else if (!strcmp(w, "--rsc_fpops_bound") && has_val) {
+                wu2.rsc_fpops_bound = atof(words[++i].c_str());
+            } else if (!strcmp(w, "--priority") && has_val) {
+                wu2.priority = atoi(words[++i].c_str());
+            } else if (!strcmp(w, "--additional_xml") && has_val) {
+                axml = words[++i].c_str();
+            } else if (!strncmp(w, "-", 1)) {
+                fprintf(stderr,
+                    "create_work: line %d: bad argument '%s'\n", lineno, w
+                );
+                return ERR_INVALID_PARAM;
+            } else {
+                infiles.push_back(w);
+            }
+        }
+        if (!strlen(wu2.name)) {
+            sprintf(wu2.name, "%s_%d_%d_%f",
+                wu.name, getpid(), lineno, dtime()
+            );
+        }
+        if (!names.insert(wu2.name).second) {
+            fprintf(stderr,
+                "create_work: line %d: duplicate job name %s\n",
+                lineno, wu2.name
+            );
+            return ERR_INVALID_PARAM;
+        }
+        retval = cwb.add(
+            wu2, wu_template, result_template_file, result_template_path,
+            infiles.empty()?NULL:&infiles[0], (int)infiles.size(),
+            cmdline, axml
+        );
+        if (retval) {
+            fprintf(stderr,
+                "create_work: line %d (%s): %s\n",
+                lineno, wu2.name, boincerror(retval)
+            );
+            return retval;
+        }
+        if (++njobs % PROGRESS_INTERVAL == 0) {
+            fprintf(stderr, "create_work: %d jobs processed\n", njobs);
+        }
+    }
+    retval = cwb.flush();
+    if (retval) {
+        fprintf(stderr, "create_work: %s\n", boincerror(retval));
+        return retval;
+    }
+    fprintf(stderr, "create_work: %d jobs created, %d already existed\n",
+        (int)cwb.wu_ids.size(), cwb.nskipped
+    );
+    return 0;
+}
+
 int main(int argc, const char** argv) {
     DB_APP app;
     DB_WORKUNIT wu;
@@ -100,6 +238,7 @@ int main(int argc, const char** argv) {
     char buf[256];
     char additional_xml[256];
     bool show_wu_name = true;
+    bool use_stdin = false;
     bool assign_flag = false;
     bool assign_multi = false;
     int assign_id = 0;
@@ -182,6 +321,8 @@ int main(int argc, const char** argv) {
             strcpy(additional_xml, argv[++i]);
         } else if (arg(argv, i, "wu_id")) {
             wu.id = atoi(argv[++i]);
+        } else if (arg(argv, i, "stdin")) {
+            use_stdin = true;
         } else if (arg(argv, i, "broadcast")) {
             assign_multi = true;
             assign_flag = true;
@@ -226,7 +367,17 @@ int main(int argc, const char** argv) {
     if (!strlen(app.name)) {
         usage();
     }
-    if (!strlen(wu.name)) {
+    if (use_stdin && (assign_flag || wu.id || ninfiles)) {
+        fprintf(stderr,
+            "create_work: --stdin can't be used with input files, --wu_id, or assignment options\n"
+        );
+        exit(1);
+    }
+    if (use_stdin && !strlen(wu.name)) {
+        // base for generated job names
+        //
+        safe_strcpy(wu.name, app.name);
+    } else if (!strlen(wu.name)) {
         sprintf(wu.name, "%s_%d_%f", app.name, getpid(), dtime());
     }
     if (!strlen(wu_template_file)) {
@@ -274,6 +425,14 @@ int main(int argc, const char** argv) {
 
     strcpy(result_template_path, "./");
     strcat(result_template_path, result_template_file);
+    if (use_stdin) {
+        retval = create_work_stdin(
+            wu, wu_template, result_template_file, result_template_path,
+            command_line, additional_xml
+        );
+        boinc_db.close();
+        exit(retval?1:0);
+    }
     retval = create_work(
         wu,
         wu_template,
@@ -23,6 +23,7 @@
 
 #include "config.h"
 #include "boinc_db.h"
+#include <ctime>
 #include <iostream>
 #include <string>
 #include "sched_config.h"
@@ -84,7 +85,7 @@ int main(int argc, char** argv){
         final= -1;
     } else {
         //the workunit state is set as deleted
-        sprintf(buf,"update workunit set error_mask=error_mask|16 where id='%d'",wu.id);
+        sprintf(buf,"update workunit set error_mask=error_mask|16, transition_time=%d where id='%d'",(int)time(0),wu.id);
         boinc_db.do_query(buf);
         // and the results are set as server state over and outcome state
         // result not needed if the result is unsent
@@ -16,7 +16,10 @@
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -134,20 +137,221 @@ static void write_md5_info(
     return;
 }
 
-static bool input_file_found[1024];
+// MD5s and sizes of input files, so that jobs sharing an input file
+// don't each read it (or stat its .md5 file).
+// An entry is used only if the file's inode, mod time and size
+// are as they were when it was made.
+//
+#define MD5_CACHE_SIZE  100000
+
+struct MD5_CACHE_ENTRY {
+    string path;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+    char md5[33];
+    double nbytes;
+};
+
+static std::list<MD5_CACHE_ENTRY> md5_lru;
+    // most recently used first
+static std::map<string, std::list<MD5_CACHE_ENTRY>::iterator> md5_cache;
+
+static bool md5_cache_lookup(
+    const char* path, struct stat& sbuf, char* md5, double& nbytes
+) {
+    std::map<string, std::list<MD5_CACHE_ENTRY>::iterator>::iterator i =
+        md5_cache.find(path);
+    if (i == md5_cache.end()) return false;
+    std::list<MD5_CACHE_ENTRY>::iterator j = i->second;
+    if (j->ino != sbuf.st_ino || j->mtime != sbuf.st_mtime
+        || j->size != sbuf.st_size
+    ) {
+        md5_lru.erase(j);
+        md5_cache.erase(i);
+        return false;
+    }
+    md5_lru.splice(md5_lru.begin(), md5_lru, j);
+    strcpy(md5, j->md5);
+    nbytes = j->nbytes;
+    return true;
+}
 
-static int process_file_info(
-    XML_PARSER& xp, string& out, int ninfiles, const char** infiles,
-    SCHED_CONFIG& config_loc
+static void md5_cache_insert(
+    const char* path, struct stat& sbuf, const char* md5, double nbytes
 ) {
+    MD5_CACHE_ENTRY e;
+    e.path = path;
+    e.ino = sbuf.st_ino;
+    e.mtime = sbuf.st_mtime;
+    e.size = sbuf.st_size;
+    safe_strcpy(e.md5, md5);
+    e.nbytes = nbytes;
+    md5_lru.push_front(e);
+    md5_cache[e.path] = md5_lru.begin();
+    if (md5_cache.size() > MD5_CACHE_SIZE) {
+        md5_cache.erase(md5_lru.back().path);
+        md5_lru.pop_back();
+    }
+}
+
+// Stage an input file in the download hierarchy
+// (copying it from the top level if needed)
+// and get its MD5 and size
+//
+static int stage_input_file(
+    const char* name, SCHED_CONFIG& config_loc, char* md5, double& nbytes
+) {
+    char path[MAXPATHLEN], top_download_path[MAXPATHLEN];
+    struct stat sbuf;
+    int retval;
+
+    dir_hier_path(
+        name, config_loc.download_dir, config_loc.uldl_dir_fanout, path, true
+    );
+
+    // if file isn't found in hierarchy,
+    // look for it at top level and copy
+    //
+    if (stat(path, &sbuf)) {
+        sprintf(top_download_path, "%s/%s", config_loc.download_dir, name);
+        boinc_copy(top_download_path, path);
+        if (stat(path, &sbuf)) {
+            fprintf(stderr,
+                "process_input_template: input file %s not found\n", path
+            );
+            return ERR_FILE_MISSING;
+        }
+    }
+    if (md5_cache_lookup(path, sbuf, md5, nbytes)) return 0;
+
+    if (!config_loc.cache_md5_info || !got_md5_info(path, md5, &nbytes)) {
+        retval = md5_file(path, md5, nbytes);
+        if (retval) {
+            fprintf(stderr,
+                "process_input_template: md5_file %s\n",
+                boincerror(retval)
+            );
+            return retval;
+        } else if (config_loc.cache_md5_info) {
+            write_md5_info(path, md5, nbytes);
+        }
+    }
+
+    // dedup only on a cache miss; on a hit, the file is the one
+    // we've already linked to the stored copy
+    //
+    if (config_loc.download_dedup) {
+        retval = dedup_download_file(
+            path, md5, nbytes, config_loc.download_dir,
+            config_loc.uldl_dir_fanout
+        );
+        if (retval) {
+            fprintf(stderr,
+                "process_input_template: dedup_download_file %s: %s\n",
+                path, boincerror(retval)
+            );
+        }
+        if (stat(path, &sbuf)) return 0;
+    }
+    md5_cache_insert(path, sbuf, md5, nbytes);
+    return 0;
+}
+
+// An input template is parsed once into a list of pieces:
+// literal XML, and slots that are filled in for each job.
+// Workunit parameters in the template are kept separately.
+//
+#define PIECE_TEXT          0
+#define PIECE_FILE_INFO     1
+    // the rest of a <file_info>, from <name> on
+#define PIECE_FILE_NAME     2
+    // <file_name> in a <file_ref>
+#define PIECE_COMMAND_LINE  3
+    // the command line passed to process_input_template(), if any
+#define PIECE_ADDITIONAL_XML    4
+
+struct TEMPLATE_PIECE {
+    int type;
+    string text;
+    int file_number;
+
+    // for PIECE_FILE_INFO
+    //
+    bool generated_locally;
+    bool remote;
+        // url, md5 and nbytes were given; the file isn't staged here
     vector<string> urls;
+    string md5str;
+    double nbytes;
+};
+
+struct COMPILED_TEMPLATE {
+    vector<TEMPLATE_PIECE> pieces;
+    int nfiles;
+        // number of <file_info>s
+    int max_file_ref;
+        // largest file number in a <file_ref>; -1 if none
+    bool has_command_line;
+    vector<std::pair<double WORKUNIT::*, double> > double_params;
+    vector<std::pair<int WORKUNIT::*, int> > int_params;
+
+    void add_text(const string& s) {
+        if (pieces.empty() || pieces.back().type != PIECE_TEXT) {
+            TEMPLATE_PIECE p;
+            p.type = PIECE_TEXT;
+            pieces.push_back(p);
+        }
+        pieces.back().text += s;
+    }
+    void add_slot(int type, int file_number=0) {
+        TEMPLATE_PIECE p;
+        p.type = type;
+        p.file_number = file_number;
+        p.generated_locally = false;
+        p.remote = false;
+        p.nbytes = 0;
+        pieces.push_back(p);
+    }
+};
+
+static const struct {
+    const char* tag;
+    double WORKUNIT::*field;
+} double_params[] = {
+    {"rsc_fpops_est", &WORKUNIT::rsc_fpops_est},
+    {"rsc_fpops_bound", &WORKUNIT::rsc_fpops_bound},
+    {"rsc_memory_bound", &WORKUNIT::rsc_memory_bound},
+    {"rsc_bandwidth_bound", &WORKUNIT::rsc_bandwidth_bound},
+    {"rsc_disk_bound", &WORKUNIT::rsc_disk_bound},
+};
+
+static const struct {
+    const char* tag;
+    int WORKUNIT::*field;
+} int_params[] = {
+    {"batch", &WORKUNIT::batch},
+    {"delay_bound", &WORKUNIT::delay_bound},
+    {"min_quorum", &WORKUNIT::min_quorum},
+    {"target_nresults", &WORKUNIT::target_nresults},
+    {"max_error_results", &WORKUNIT::max_error_results},
+    {"max_total_results", &WORKUNIT::max_total_results},
+    {"max_success_results", &WORKUNIT::max_success_results},
+    {"size_class", &WORKUNIT::size_class},
+};
+
+#define NELEMS(x) (sizeof(x)/sizeof(x[0]))
+
+static int compile_file_info(
+    XML_PARSER& xp, COMPILED_TEMPLATE& ct, vector<bool>& file_found
+) {
     bool generated_locally = false;
     int retval, file_number = -1;
-    double nbytes, nbytesdef = -1;
+    double nbytesdef = -1;
+    vector<string> urls;
     string md5str, urlstr, tmpstr;
-    char buf[BLOB_SIZE], path[MAXPATHLEN], top_download_path[MAXPATHLEN], md5[33], url[256];
 
-    out += "<file_info>\n";
+    ct.add_text("<file_info>\n");
     while (!xp.get_tag()) {
         if (xp.parse_int("number", file_number)) {
             continue;
@@ -173,146 +377,70 @@ static int process_file_info(
                 fprintf(stderr, "No file number found\n");
                 return ERR_XML_PARSE;
             }
-            if (file_number >= ninfiles) {
-                fprintf(stderr,
-                    "Too few input files given; need at least %d\n",
-                    file_number+1
-                );
-                return ERR_XML_PARSE;
+            if (file_number >= (int)file_found.size()) {
+                file_found.resize(file_number+1, false);
             }
-            if (input_file_found[file_number]) {
+            if (file_found[file_number]) {
                 fprintf(stderr,
                     "Input file %d listed twice\n", file_number
                 );
                 return ERR_XML_PARSE;
             }
-            input_file_found[file_number] = true;
-            if (generated_locally) {
-                sprintf(buf,
-                    "    <name>%s</name>\n"
-                    "    <generated_locally/>\n"
-                    "</file_info>\n",
-                    infiles[file_number]
-                );
-            } else if (nbytesdef == -1) {
-                // here if nybtes was not supplied; stage the file
-                //
-                dir_hier_path(
-                    infiles[file_number], config_loc.download_dir,
-                    config_loc.uldl_dir_fanout, path, true
-                );
-
-                // if file isn't found in hierarchy,
-                // look for it at top level and copy
-                //
-                if (!boinc_file_exists(path)) {
-                    sprintf(top_download_path,
-                        "%s/%s",config_loc.download_dir,
-                        infiles[file_number]
-                    );
-                    boinc_copy(top_download_path, path);
-                }
-
-                if (!config_loc.cache_md5_info || !got_md5_info(path, md5, &nbytes)) {
-                    retval = md5_file(path, md5, nbytes);
-                    if (retval) {
-                        fprintf(stderr,
-                            "process_input_template: md5_file %s\n",
-                            boincerror(retval)
-                        );
-                        return retval;
-                    } else if (config_loc.cache_md5_info) {
-                        write_md5_info(path, md5, nbytes);
-                    }
-                }
-
-                dir_hier_url(
-                    infiles[file_number], config_loc.download_url,
-                    config_loc.uldl_dir_fanout, url
-                );
-                sprintf(buf,
-                    "    <name>%s</name>\n"
-                    "    <url>%s</url>\n"
-                    "    <md5_cksum>%s</md5_cksum>\n"
-                    "    <nbytes>%.0f</nbytes>\n"
-                    "</file_info>\n",
-                    infiles[file_number],
-                    url,
-                    md5,
-                    nbytes
-                );
-            } else {
-                // here if nbytes etc. was supplied,
-                // i.e the file is already staged, possibly remotely
-                //
-                urlstr = "";
-                for (unsigned int i=0; i<urls.size(); i++) {
-                    urlstr += "    <url>" + urls.at(i) + string(infiles[file_number]) + "</url>\n";
-                }
-                sprintf(buf,
-                    "    <name>%s</name>\n"
-                    "%s"
-                    "    <md5_cksum>%s</md5_cksum>\n"
-                    "    <nbytes>%.0f</nbytes>\n"
-                    "</file_info>\n",
-                    infiles[file_number],
-                    urlstr.c_str(),
-                    md5str.c_str(),
-                    nbytesdef
-                );
+            file_found[file_number] = true;
+            ct.nfiles++;
+            ct.add_slot(PIECE_FILE_INFO, file_number);
+            TEMPLATE_PIECE& p = ct.pieces.back();
+            p.generated_locally = generated_locally;
+            if (!generated_locally && nbytesdef != -1) {
+                p.remote = true;
+                p.urls = urls;
+                p.md5str = md5str;
+                p.nbytes = nbytesdef;
             }
-            out += buf;
-            break;
+            return 0;
         } else {
             retval = xp.copy_element(tmpstr);
             if (retval) return retval;
-            out += tmpstr;
-            out += "\n";
+            ct.add_text(tmpstr + "\n");
         }
     }
     return 0;
 }
 
-static int process_workunit(
-    XML_PARSER& xp, WORKUNIT& wu, string& out,
-    const char** infiles,
-    const char* command_line,
-    const char* additional_xml
-) {
+static int compile_workunit(XML_PARSER& xp, COMPILED_TEMPLATE& ct) {
     char buf[256], open_name[256];
     int file_number;
     string tmpstr, cmdline;
     int retval;
+    double x;
+    int n;
+    unsigned int i;
 
-    out += "<workunit>\n";
-    if (command_line) {
-        //fprintf(stderr, "appending command line: %s\n", command_line);
-        out += "<command_line>\n";
-        out += command_line;
-        out += "\n</command_line>\n";
-    }
+    ct.add_text("<workunit>\n");
+    ct.add_slot(PIECE_COMMAND_LINE);
     while (!xp.get_tag()) {
         if (xp.match_tag("/workunit")) {
-            if (additional_xml && strlen(additional_xml)) {
-                out += additional_xml;
-                out += "\n";
-            }
-            out += "</workunit>";
+            ct.add_slot(PIECE_ADDITIONAL_XML);
+            ct.add_text("</workunit>");
             break;
         } else if (xp.match_tag("file_ref")) {
-            out += "<file_ref>\n";
+            ct.add_text("<file_ref>\n");
             bool found_file_number = false, found_open_name = false;
             while (!xp.get_tag()) {
                 if (xp.parse_int("file_number", file_number)) {
-                    sprintf(buf, "    <file_name>%s</file_name>\n",
-                        infiles[file_number]
-                    );
-                    out += buf;
+                    if (file_number < 0) {
+                        fprintf(stderr, "Bad file number %d\n", file_number);
+                        return ERR_XML_PARSE;
+                    }
+                    ct.add_slot(PIECE_FILE_NAME, file_number);
+                    if (file_number > ct.max_file_ref) {
+                        ct.max_file_ref = file_number;
+                    }
                     found_file_number = true;
                     continue;
                 } else if (xp.parse_str("open_name", open_name, sizeof(open_name))) {
                     sprintf(buf, "    <open_name>%s</open_name>\n", open_name);
-                    out += buf;
+                    ct.add_text(buf);
                     found_open_name = true;
                     continue;
                 } else if (xp.match_tag("/file_ref")) {
@@ -324,7 +452,7 @@ static int process_workunit(
                         fprintf(stderr, "No open name found\n");
                         return ERR_XML_PARSE;
                     }
-                    out += "</file_ref>\n";
+                    ct.add_text("</file_ref>\n");
                     break;
                 } else if (xp.parse_string("file_name", tmpstr)) {
                     fprintf(stderr, "<file_name> ignored in <file_ref> element.\n");
@@ -332,77 +460,48 @@ static int process_workunit(
                 } else {
                     retval = xp.copy_element(tmpstr);
                     if (retval) return retval;
-                    out += tmpstr;
-                    out += "\n";
+                    ct.add_text(tmpstr + "\n");
                 }
             }
         } else if (xp.parse_string("command_line", cmdline)) {
-            if (command_line) {
-                fprintf(stderr, "Can't specify command line twice");
-                return ERR_XML_PARSE;
-            }
-            out += "<command_line>\n";
-            out += cmdline;
-            out += "\n</command_line>\n";
-        } else if (xp.parse_double("rsc_fpops_est", wu.rsc_fpops_est)) {
-            continue;
-        } else if (xp.parse_double("rsc_fpops_bound", wu.rsc_fpops_bound)) {
-            continue;
-        } else if (xp.parse_double("rsc_memory_bound", wu.rsc_memory_bound)) {
-            continue;
-        } else if (xp.parse_double("rsc_bandwidth_bound", wu.rsc_bandwidth_bound)) {
-            continue;
-        } else if (xp.parse_double("rsc_disk_bound", wu.rsc_disk_bound)) {
-            continue;
-        } else if (xp.parse_int("batch", wu.batch)) {
-            continue;
-        } else if (xp.parse_int("delay_bound", wu.delay_bound)){
-            continue;
-        } else if (xp.parse_int("min_quorum", wu.min_quorum)) {
-            continue;
-        } else if (xp.parse_int("target_nresults", wu.target_nresults)) {
-            continue;
-        } else if (xp.parse_int("max_error_results", wu.max_error_results)) {
-            continue;
-        } else if (xp.parse_int("max_total_results", wu.max_total_results)) {
-            continue;
-        } else if (xp.parse_int("max_success_results", wu.max_success_results)) {
-            continue;
-        } else if (xp.parse_int("size_class", wu.size_class)) {
-            continue;
+            ct.has_command_line = true;
+            ct.add_text("<command_line>\n" + cmdline + "\n</command_line>\n");
         } else {
+            for (i=0; i<NELEMS(double_params); i++) {
+                if (xp.parse_double(double_params[i].tag, x)) {
+                    ct.double_params.push_back(
+                        std::make_pair(double_params[i].field, x)
+                    );
+                    break;
+                }
+            }
+            if (i < NELEMS(double_params)) continue;
+            for (i=0; i<NELEMS(int_params); i++) {
+                if (xp.parse_int(int_params[i].tag, n)) {
+                    ct.int_params.push_back(
+                        std::make_pair(int_params[i].field, n)
+                    );
+                    break;
+                }
+            }
+            if (i < NELEMS(int_params)) continue;
             retval = xp.copy_element(tmpstr);
             if (retval) return retval;
-            out += tmpstr;
-            out += "\n";
+            ct.add_text(tmpstr + "\n");
         }
     }
     return 0;
 }
 
-// fill in the workunit's XML document (wu.xml_doc)
-// by scanning the input template, macro-substituting the input files,
-// and putting in the command line element and additional XML
-//
-int process_input_template(
-    WORKUNIT& wu,
-    char* tmplate,
-    const char** infiles,
-    int ninfiles,
-    SCHED_CONFIG& config_loc,
-    const char* command_line,
-    const char* additional_xml
-) {
-    string out;
+static int compile_template(const char* tmplate, COMPILED_TEMPLATE& ct) {
+    bool found_workunit = false;
+    vector<bool> file_found;
     int retval;
-    bool found_workunit=false;
-    int nfiles_parsed = 0;
 
-    for (int i=0; i<1024; i++) {
-        input_file_found[i] = false;
-    }
+    ct.nfiles = 0;
+    ct.max_file_ref = -1;
+    ct.has_command_line = false;
 
-    out = "";
     MIOFILE mf;
     XML_PARSER xp(&mf);
     mf.init_buf_read(tmplate);
@@ -411,14 +510,11 @@ int process_input_template(
         if (xp.match_tag("input_template")) continue;
         if (xp.match_tag("/input_template")) continue;
         if (xp.match_tag("file_info")) {
-            retval = process_file_info(xp, out, ninfiles, infiles, config_loc);
+            retval = compile_file_info(xp, ct, file_found);
             if (retval) return retval;
-            nfiles_parsed++;
         } else if (xp.match_tag("workunit")) {
             found_workunit = true;
-            retval = process_workunit(
-                xp, wu, out, infiles, command_line, additional_xml
-            );
+            retval = compile_workunit(xp, ct);
             if (retval) return retval;
         }
     }
@@ -426,13 +522,173 @@ int process_input_template(
         fprintf(stderr, "process_input_template: bad WU template - no <workunit>\n");
         return ERR_XML_PARSE;
     }
-    if (nfiles_parsed != ninfiles) {
+    return 0;
+}
+
+// compiled templates, by text.
+// There are usually only a few; if there are many, start over.
+//
+#define MAX_COMPILED_TEMPLATES  100
+
+static std::map<string, COMPILED_TEMPLATE> compiled_templates;
+
+static int get_compiled_template(const char* tmplate, COMPILED_TEMPLATE*& ctp) {
+    std::map<string, COMPILED_TEMPLATE>::iterator i =
+        compiled_templates.find(tmplate);
+    if (i != compiled_templates.end()) {
+        ctp = &i->second;
+        return 0;
+    }
+    COMPILED_TEMPLATE ct;
+    int retval = compile_template(tmplate, ct);
+    if (retval) return retval;
+    if (compiled_templates.size() >= MAX_COMPILED_TEMPLATES) {
+        compiled_templates.clear();
+    }
+    ctp = &(compiled_templates[tmplate] = ct);
+    return 0;
+}
+
+static int expand_file_info(
+    TEMPLATE_PIECE& p, const char* name, SCHED_CONFIG& config_loc,
+    string& out
+) {
+    char buf[BLOB_SIZE], md5[33], url[256];
+    double nbytes;
+    int retval;
+
+    if (p.generated_locally) {
+        sprintf(buf,
+            "    <name>%s</name>\n"
+            "    <generated_locally/>\n"
+            "</file_info>\n",
+            name
+        );
+    } else if (!p.remote) {
+        // here if nybtes was not supplied; stage the file
+        //
+        retval = stage_input_file(name, config_loc, md5, nbytes);
+        if (retval) return retval;
+        dir_hier_url(
+            name, config_loc.download_url, config_loc.uldl_dir_fanout, url
+        );
+        sprintf(buf,
+            "    <name>%s</name>\n"
+            "    <url>%s</url>\n"
+            "    <md5_cksum>%s</md5_cksum>\n"
+            "    <nbytes>%.0f</nbytes>\n"
+            "</file_info>\n",
+            name,
+            url,
+            md5,
+            nbytes
+        );
+    } else {
+        // here if nbytes etc. was supplied,
+        // i.e the file is already staged, possibly remotely
+        //
+        string urlstr;
+        for (unsigned int i=0; i<p.urls.size(); i++) {
+            urlstr += "    <url>" + p.urls[i] + string(name) + "</url>\n";
+        }
+        sprintf(buf,
+            "    <name>%s</name>\n"
+            "%s"
+            "    <md5_cksum>%s</md5_cksum>\n"
+            "    <nbytes>%.0f</nbytes>\n"
+            "</file_info>\n",
+            name,
+            urlstr.c_str(),
+            p.md5str.c_str(),
+            p.nbytes
+        );
+    }
+    out += buf;
+    return 0;
+}
+
+// fill in the workunit's XML document (wu.xml_doc)
+// from the input template, macro-substituting the input files,
+// and putting in the command line element and additional XML.
+// The template is parsed only the first time it's seen.
+//
+int process_input_template(
+    WORKUNIT& wu,
+    char* tmplate,
+    const char** infiles,
+    int ninfiles,
+    SCHED_CONFIG& config_loc,
+    const char* command_line,
+    const char* additional_xml
+) {
+    COMPILED_TEMPLATE* ctp = NULL;
+    string out;
+    unsigned int i;
+    int retval;
+
+    retval = get_compiled_template(tmplate, ctp);
+    if (retval) return retval;
+    COMPILED_TEMPLATE& ct = *ctp;
+
+    if (command_line && ct.has_command_line) {
+        fprintf(stderr, "Can't specify command line twice");
+        return ERR_XML_PARSE;
+    }
+    if (ct.nfiles != ninfiles) {
         fprintf(stderr,
             "process_input_template: %d input files listed, but template has %d\n",
-            ninfiles, nfiles_parsed
+            ninfiles, ct.nfiles
         );
         return ERR_XML_PARSE;
     }
+    if (ct.max_file_ref >= ninfiles) {
+        fprintf(stderr,
+            "Too few input files given; need at least %d\n",
+            ct.max_file_ref+1
+        );
+        return ERR_XML_PARSE;
+    }
+
+    for (i=0; i<ct.double_params.size(); i++) {
+        wu.*(ct.double_params[i].first) = ct.double_params[i].second;
+    }
+    for (i=0; i<ct.int_params.size(); i++) {
+        wu.*(ct.int_params[i].first) = ct.int_params[i].second;
+    }
+
+    out.reserve(4096);
+    for (i=0; i<ct.pieces.size(); i++) {
+        TEMPLATE_PIECE& p = ct.pieces[i];
+        switch (p.type) {
+        case PIECE_TEXT:
+            out += p.text;
+            break;
+        case PIECE_FILE_INFO:
+            retval = expand_file_info(
+                p, infiles[p.file_number], config_loc, out
+            );
+            if (retval) return retval;
+            break;
+        case PIECE_FILE_NAME:
+            out += "    <file_name>";
+            out += infiles[p.file_number];
+            out += "</file_name>\n";
+            break;
+        case PIECE_COMMAND_LINE:
+            if (command_line) {
+                out += "<command_line>\n";
+                out += command_line;
+                out += "\n</command_line>\n";
+            }
+            break;
+        case PIECE_ADDITIONAL_XML:
+            if (additional_xml && strlen(additional_xml)) {
+                out += additional_xml;
+                out += "\n";
+            }
+            break;
+        }
+    }
     if (out.size() > sizeof(wu.xml_doc)-1) {
         fprintf(stderr,
             "create_work: WU XML field is too long (%d bytes; max is %d)\n",
@@ -0,0 +1,450 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// stage_files [options] file|dir ...
+//
+// Stage a batch of input files: move or copy each one into the
+// download hierarchy and compute its MD5, using several threads.
+// Run this in a project's root directory.
+//
+// For each file, write an MD5 cache file (FILE.md5, as used by
+// create_work with <cache_md5_info/>) and print a <file_info> element
+// with its number, URL, MD5 and size, for use in an input template
+// (create_work then doesn't read the file again).
+// Files are numbered in order of name;
+// --names writes the names in that order, to pass to create_work.
+//
+// Finished files are appended to a manifest;
+// if stage_files is interrupted, run it again with the same manifest
+// and it will skip the files already done.
+//
+// Copies use copy_file_range() where available,
+// so the kernel can copy (or reflink) without going through user space.
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "error_numbers.h"
+#include "filesys.h"
+#include "md5_file.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "svn_version.h"
+#include "util.h"
+
+#include "sched_config.h"
+#include "sched_util.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+#define COPY_BLOCK_SIZE (1024*1024)
+
+struct STAGE_ITEM {
+    string src;         // path of source file
+    string name;        // its name in the download hierarchy
+    char md5[MD5_LEN];
+    double nbytes;
+    int retval;
+    bool done;          // already in manifest
+};
+
+struct MANIFEST_ENTRY {
+    string md5;
+    double nbytes;
+};
+
+vector<STAGE_ITEM> items;
+int next_item = 0;
+bool copy_files = false;
+FILE* manifest = NULL;
+pthread_mutex_t manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void usage(char* name) {
+    fprintf(stderr,
+        "Stage input files into the download hierarchy.\n"
+        "Run this in a project's root directory.\n\n"
+        "Usage: %s [OPTION]... file|dir ...\n\n"
+        "Options:\n"
+        "  [ --copy ]             Copy files (default: move them)\n"
+        "  [ --nthreads N ]       Use N threads (default 4)\n"
+        "  [ --manifest F ]       Record finished files in F, and skip\n"
+        "                         files already recorded there\n"
+        "  [ --xml F ]            Write <file_info> elements to F\n"
+        "                         (default: standard output)\n"
+        "  [ --names F ]          Write the file names to F, in order\n"
+        "  [ -h | --help ]        Show this help text.\n"
+        "  [ -v | --version ]     Show version information.\n",
+        name
+    );
+}
+
+// copy src to dst with copy_file_range() if possible,
+// else read()/write()
+//
+int copy_file(const char* src, const char* dst) {
+    struct stat sbuf;
+    int retval = 0;
+
+    int in = open(src, O_RDONLY);
+    if (in < 0) return ERR_FOPEN;
+    if (fstat(in, &sbuf)) {
+        close(in);
+        return ERR_FOPEN;
+    }
+    int out = open(dst, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+    if (out < 0) {
+        close(in);
+        return ERR_FOPEN;
+    }
+    off_t left = sbuf.st_size;
+#ifdef HAVE_COPY_FILE_RANGE
+    while (left > 0) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, left, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        left -= n;
+    }
+#endif
+    if (left > 0) {
+        // not supported here (e.g. across file systems on older kernels),
+        // or not available
+        //
+        char* buf = (char*)malloc(COPY_BLOCK_SIZE);
+        while (left > 0) {
+            ssize_t n = read(in, buf, COPY_BLOCK_SIZE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                retval = ERR_READ;
+                break;
+            }
+            ssize_t m = 0;
+            while (m < n) {
+                ssize_t k = write(out, buf+m, n-m);
+                if (k < 0 && errno == EINTR) continue;
+                if (k <= 0) break;
+                m += k;
+            }
+            if (m < n) {
+                retval = ERR_WRITE;
+                break;
+            }
+            left -= n;
+        }
+        free(buf);
+    }
+    close(in);
+    if (close(out)) retval = ERR_WRITE;
+    if (retval) unlink(dst);
+    return retval;
+}
+
+// stage one file; return zero or an error code
+//
+int stage_file(STAGE_ITEM& item) {
+    char path[MAXPATHLEN], md5[MD5_LEN], md5_path[MAXPATHLEN];
+    double nbytes;
+    int retval;
+
+    retval = dir_hier_path(
+        item.name.c_str(), config.download_dir, config.uldl_dir_fanout,
+        path, true
+    );
+    if (retval) return retval;
+
+    if (boinc_file_exists(path)) {
+        // make sure it's the same; BOINC files are immutable
+        //
+        retval = md5_file(path, item.md5, item.nbytes);
+        if (retval) return retval;
+        retval = md5_file(item.src.c_str(), md5, nbytes);
+        if (retval) return retval;
+        if (strcmp(md5, item.md5)) {
+            fprintf(stderr,
+                "%s is already in the download directory, with different contents\n",
+                item.name.c_str()
+            );
+            return ERR_MD5_FAILED;
+        }
+        if (!copy_files) unlink(item.src.c_str());
+    } else {
+        if (copy_files || rename(item.src.c_str(), path)) {
+            if (!copy_files && errno != EXDEV) return ERR_RENAME;
+            retval = copy_file(item.src.c_str(), path);
+            if (retval) return retval;
+            if (!copy_files) unlink(item.src.c_str());
+        }
+        retval = md5_file(path, item.md5, item.nbytes);
+        if (retval) return retval;
+    }
+
+    sprintf(md5_path, "%s.md5", path);
+    FILE* f = fopen(md5_path, "w");
+    if (f) {
+        fprintf(f, "%s %.15e\n", item.md5, item.nbytes);
+        fclose(f);
+    }
+
+    if (config.download_dedup) {
+        retval = dedup_download_file(
+            path, item.md5, item.nbytes, config.download_dir,
+            config.uldl_dir_fanout
+        );
+        if (retval) {
+            fprintf(stderr, "can't deduplicate %s: %s\n",
+                path, boincerror(retval)
+            );
+        }
+    }
+
+    if (manifest) {
+        pthread_mutex_lock(&manifest_mutex);
+        fprintf(manifest, "%s %s %.0f\n",
+            item.name.c_str(), item.md5, item.nbytes
+        );
+        fflush(manifest);
+        pthread_mutex_unlock(&manifest_mutex);
+    }
+    return 0;
+}
+
+void* stage_thread(void*) {
+    int n = (int)items.size();
+    while (1) {
+        int i = __sync_fetch_and_add(&next_item, 1);
+        if (i >= n) break;
+        STAGE_ITEM& item = items[i];
+        if (item.done) continue;
+        item.retval = stage_file(item);
+    }
+    return 0;
+}
+
+void read_manifest(const char* path, map<string, MANIFEST_ENTRY>& entries) {
+    char name[256], md5[256];
+    double nbytes;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    while (fscanf(f, "%255s %255s %lf", name, md5, &nbytes) == 3) {
+        MANIFEST_ENTRY& e = entries[name];
+        e.md5 = md5;
+        e.nbytes = nbytes;
+    }
+    fclose(f);
+}
+
+bool item_less(const STAGE_ITEM& a, const STAGE_ITEM& b) {
+    return a.name < b.name;
+}
+
+void add_item(const string& src) {
+    STAGE_ITEM item;
+    const char* p = strrchr(src.c_str(), '/');
+    item.src = src;
+    item.name = p?p+1:src.c_str();
+    strcpy(item.md5, "");
+    item.nbytes = 0;
+    item.retval = 0;
+    item.done = false;
+    items.push_back(item);
+}
+
+int main(int argc, char** argv) {
+    int nthreads = 4, retval, nfailed = 0;
+    const char* manifest_path = NULL;
+    const char* xml_path = NULL;
+    const char* names_path = NULL;
+    map<string, MANIFEST_ENTRY> done;
+    vector<pthread_t> threads;
+    char path[MAXPATHLEN], url[256];
+    unsigned int i;
+
+    for (i=1; i<(unsigned int)argc; i++) {
+        if (is_arg(argv[i], "copy")) {
+            copy_files = true;
+        } else if (is_arg(argv[i], "nthreads")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
+            if (nthreads < 1) nthreads = 1;
+        } else if (is_arg(argv[i], "manifest")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            manifest_path = argv[i];
+        } else if (is_arg(argv[i], "xml")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            xml_path = argv[i];
+        } else if (is_arg(argv[i], "names")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            names_path = argv[i];
+        } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
+            usage(argv[0]);
+            exit(0);
+        } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
+            printf("%s\n", SVN_VERSION);
+            exit(0);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "unknown command line argument: %s\n\n", argv[i]);
+            usage(argv[0]);
+            exit(1);
+        } else if (is_dir(argv[i])) {
+            string name;
+            DirScanner scanner(argv[i]);
+            while (scanner.scan(name)) {
+                string s = string(argv[i]) + "/" + name;
+                if (is_file(s.c_str())) add_item(s);
+            }
+        } else {
+            add_item(argv[i]);
+        }
+    }
+    if (items.empty()) {
+        usage(argv[0]);
+        exit(1);
+    }
+    std::sort(items.begin(), items.end(), item_less);
+
+    retval = config.parse_file();
+    if (retval) {
+        fprintf(stderr, "Can't parse config.xml: %s\n", boincerror(retval));
+        exit(1);
+    }
+
+    // files in the manifest are done if they're still in place
+    //
+    if (manifest_path) {
+        read_manifest(manifest_path, done);
+        for (i=0; i<items.size(); i++) {
+            STAGE_ITEM& item = items[i];
+            map<string, MANIFEST_ENTRY>::iterator it = done.find(item.name);
+            if (it == done.end()) continue;
+            dir_hier_path(
+                item.name.c_str(), config.download_dir,
+                config.uldl_dir_fanout, path
+            );
+            double size;
+            if (file_size(path, size) || size != it->second.nbytes) continue;
+            strlcpy(item.md5, it->second.md5.c_str(), sizeof(item.md5));
+            item.nbytes = size;
+            item.done = true;
+        }
+        manifest = fopen(manifest_path, "a");
+        if (!manifest) {
+            fprintf(stderr, "can't open %s\n", manifest_path);
+            exit(1);
+        }
+    }
+
+    if (nthreads > (int)items.size()) nthreads = (int)items.size();
+    for (int j=0; j<nthreads; j++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, stage_thread, NULL)) break;
+        threads.push_back(t);
+    }
+    if (threads.empty()) {
+        stage_thread(NULL);
+    }
+    for (i=0; i<threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (manifest) fclose(manifest);
+
+    FILE* xml = stdout;
+    if (xml_path) {
+        xml = fopen(xml_path, "w");
+        if (!xml) {
+            fprintf(stderr, "can't open %s\n", xml_path);
+            exit(1);
+        }
+    }
+    FILE* names = NULL;
+    if (names_path) {
+        names = fopen(names_path, "w");
+        if (!names) {
+            fprintf(stderr, "can't open %s\n", names_path);
+            exit(1);
+        }
+    }
+    int number = 0;
+    for (i=0; i<items.size(); i++) {
+        STAGE_ITEM& item = items[i];
+        if (item.retval) {
+            fprintf(stderr, "can't stage %s: %s\n",
+                item.src.c_str(), boincerror(item.retval)
+            );
+            nfailed++;
+            continue;
+        }
+
+        // the URL of the file's directory;
+        // create_work appends the file name
+        //
+        dir_hier_url(
+            item.name.c_str(), config.download_url,
+            config.uldl_dir_fanout, url
+        );
+        char* p = strrchr(url, '/');
+        if (p) p[1] = 0;
+        fprintf(xml,
+            "<file_info>\n"
+            "    <number>%d</number>\n"
+            "    <url>%s</url>\n"
+            "    <md5_cksum>%s</md5_cksum>\n"
+            "    <nbytes>%.0f</nbytes>\n"
+            "</file_info>\n",
+            number++, url, item.md5, item.nbytes
+        );
+        if (names) fprintf(names, "%s\n", item.name.c_str());
+    }
+    if (xml != stdout) fclose(xml);
+    if (names) fclose(names);
+    if (nfailed) {
+        fprintf(stderr, "%d of %d files failed\n", nfailed, (int)items.size());
+        exit(1);
+    }
+}
+
+const char *BOINC_RCSID_4f0c8e13a7 = "$Id$";
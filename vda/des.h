@@ -16,13 +16,18 @@
 // along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
 
 // The world's smallest discrete event simulator.
-// Uses the STL "heap" data structure for efficient event storage.
+// Events are kept in a binary heap (earliest first).
+// Each event knows its position in the heap,
+// so removing an event is O(log n) rather than a search and re-heapify.
+//
+// All simulator state is in the SIMULATOR;
+// to sweep over many configurations, run separate processes
+// (see ssim.php).
 
 #ifndef _DES_
 #define _DES_
 
 #include <vector>
-#include <algorithm>
 
 using std::vector;
 
@@ -32,40 +37,48 @@ using std::vector;
 //
 struct EVENT {
     double t;
+    int heap_index;     // position in SIMULATOR::events, or -1
     virtual void handle(){}
+    EVENT() {
+        heap_index = -1;
+    }
 };
 
-inline bool compare(EVENT* e1, EVENT* e2) {
-    return (e1->t > e2->t);
-}
-
 struct SIMULATOR {
     vector<EVENT*> events;
     double now;
     bool done;
 
-    // add an event
+    SIMULATOR() {
+        now = 0;
+        done = false;
+    }
+
+    // add an event.
+    // If it's already pending, it's rescheduled at its (new) time.
     //
     void insert(EVENT* e) {
-        //printf("adding %x\n", e);
+        remove(e);
+        e->heap_index = (int)events.size();
         events.push_back(e);
-        push_heap(events.begin(), events.end(), compare);
+        sift_up(e->heap_index);
     }
 
-    // remove an event
+    // remove an event (if it's pending)
     //
     void remove(EVENT* e) {
-        vector<EVENT*>::iterator i;
-        //printf("removing %x\n", e);
-        for (i=events.begin(); i!=events.end(); i++) {
-            if (*i == e) {
-                events.erase(i);
-                make_heap(events.begin(), events.end(), compare);
-                //printf("removed %x\n", e);
-                return;
-            }
+        int i = e->heap_index;
+        if (i < 0 || i >= (int)events.size() || events[i] != e) return;
+        e->heap_index = -1;
+        EVENT* last = events.back();
+        events.pop_back();
+        if (last == e) return;
+        place(i, last);
+        if (i > 0 && events[(i-1)/2]->t > last->t) {
+            sift_up(i);
+        } else {
+            sift_down(i);
         }
-        //printf("%x not found\n", e);
     }
 
     // run the simulator for the given time period
@@ -74,14 +87,45 @@ struct SIMULATOR {
         done = false;
         while (events.size()) {
             EVENT* e = events.front();
-            pop_heap(events.begin(), events.end(), compare);
-            events.pop_back();
+            if (e->t > dur) {
+                now = e->t;
+                break;
+            }
+            remove(e);
             now = e->t;
-            if (now > dur) break;
             e->handle();
             if (done) break;
         }
     }
+
+private:
+    inline void place(int i, EVENT* e) {
+        events[i] = e;
+        e->heap_index = i;
+    }
+    void sift_up(int i) {
+        EVENT* e = events[i];
+        while (i > 0) {
+            int p = (i-1)/2;
+            if (events[p]->t <= e->t) break;
+            place(i, events[p]);
+            i = p;
+        }
+        place(i, e);
+    }
+    void sift_down(int i) {
+        int n = (int)events.size();
+        EVENT* e = events[i];
+        while (1) {
+            int c = 2*i+1;
+            if (c >= n) break;
+            if (c+1 < n && events[c+1]->t < events[c]->t) c++;
+            if (e->t <= events[c]->t) break;
+            place(i, events[c]);
+            i = c;
+        }
+        place(i, e);
+    }
 };
 
 extern SIMULATOR sim;
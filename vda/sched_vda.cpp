@@ -27,9 +27,12 @@
 #include <map>
 #include <string>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include "filesys.h"
+#include "md5_file.h"
+#include "str_util.h"
 
 #include "backend_lib.h"
 
@@ -77,6 +80,24 @@ static int mark_for_update(int vda_file_id) {
     return f.update_field("need_update=1");
 }
 
+// tell vdad that we created, changed or deleted a VDA_CHUNK_HOST record.
+// The line is written with a single append, so lines from
+// concurrent scheduler instances don't get mixed.
+//
+static void log_chunk_host_change(VDA_CHUNK_HOST& ch) {
+    FILE* f = boinc_fopen(config.project_path(VDA_CHANGELOG_FILENAME), "a");
+    if (!f) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't open %s\n", VDA_CHANGELOG_FILENAME
+        );
+        return;
+    }
+    fprintf(f, "%d %d %s\n",
+        ch.vda_file_id, ch.host_id, ch.physical_file_name
+    );
+    fclose(f);
+}
+
 typedef map<string, DB_VDA_CHUNK_HOST> CHUNK_LIST;
 
 // get the path to the chunk's directory
@@ -106,9 +127,36 @@ static void get_chunk_url(DB_VDA_FILE& vf, const char* chunk_name, char* url) {
     sprintf(url, "%s/%s/data.vda", buf, chunk_dirs);
 }
 
-// read the chunk's MD5 file into a buffer
+// chunk name -> MD5, from a file's manifest
+//
+typedef map<string, string> CHUNK_MD5S;
+
+// manifests we've read, by vda_file ID.
+// Under FCGI these persist across requests.
 //
-static int get_chunk_md5(char* chunk_dir, char* md5_buf) {
+static map<int, CHUNK_MD5S> manifests;
+
+static int read_manifest(DB_VDA_FILE& vf, CHUNK_MD5S& md5s) {
+    char path[1024], buf[1024], name[256], md5[64];
+    sprintf(path, "%s/%s", vf.dir, VDA_MANIFEST_FILENAME);
+#ifndef _USING_FCGI_
+    FILE* f = fopen(path, "r");
+#else
+    FCGI_FILE* f = FCGI::fopen(path, "r");
+#endif
+    if (!f) return ERR_FOPEN;
+    while (fgets(buf, sizeof(buf), f)) {
+        if (sscanf(buf, "%255s %63s", name, md5) == 2) {
+            md5s[string(name)] = string(md5);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// read a chunk's md5.txt (files encoded before there were manifests)
+//
+static int read_chunk_md5_file(char* chunk_dir, char* md5_buf) {
     char md5_path[1024];
     sprintf(md5_path, "%s/md5.txt", chunk_dir);
 #ifndef _USING_FCGI_
@@ -124,6 +172,50 @@ static int get_chunk_md5(char* chunk_dir, char* md5_buf) {
     return 0;
 }
 
+// get a chunk's MD5 from its file's manifest
+//
+static int get_chunk_md5(DB_VDA_FILE& vf, const char* chunk_name, char* md5_buf) {
+    map<int, CHUNK_MD5S>::iterator i = manifests.find(vf.id);
+    if (i == manifests.end()) {
+        CHUNK_MD5S md5s;
+        if (read_manifest(vf, md5s)) {
+            char chunk_dir[1024];
+            get_chunk_dir(vf, chunk_name, chunk_dir);
+            return read_chunk_md5_file(chunk_dir, md5_buf);
+        }
+        i = manifests.insert(make_pair(vf.id, md5s)).first;
+    }
+    CHUNK_MD5S::iterator j = i->second.find(string(chunk_name));
+    if (j == i->second.end()) return ERR_NOT_FOUND;
+    strlcpy(md5_buf, j->second.c_str(), 64);
+    return 0;
+}
+
+// get the MD5 of a completed upload.
+// file_upload_handler computes this as the data arrives;
+// if it didn't, read the file.
+//
+static int get_upload_md5(const char* path, char* md5_buf) {
+    char md5_path[1024];
+    double size;
+    sprintf(md5_path, "%s%s", path, VDA_UPLOAD_MD5_SUFFIX);
+#ifndef _USING_FCGI_
+    FILE* f = fopen(md5_path, "r");
+#else
+    FCGI_FILE* f = FCGI::fopen(md5_path, "r");
+#endif
+    if (f) {
+        char* p = fgets(md5_buf, 64, f);
+        fclose(f);
+        boinc_delete_file(md5_path);
+        if (p) {
+            strip_whitespace(md5_buf);
+            if (strlen(md5_buf) == 32) return 0;
+        }
+    }
+    return md5_file(path, md5_buf, size);
+}
+
 // process a completed upload:
 // if vda_chunk_host found
 //      verify md5 of upload
@@ -171,7 +263,6 @@ static int process_completed_upload(char* phys_filename, CHUNK_LIST& chunks) {
     char chunk_dir[1024];
     DB_VDA_CHUNK_HOST& ch = i2->second;
     DB_VDA_FILE vf;
-    double size;
 
     retval = vf.lookup_id(ch.vda_file_id);
     get_chunk_dir(vf, chunk_name, chunk_dir);
@@ -182,10 +273,12 @@ static int process_completed_upload(char* phys_filename, CHUNK_LIST& chunks) {
     sprintf(buf, "%s/data.vda", chunk_dir);
     if (boinc_file_exists(buf)) {
         boinc_delete_file(path);
+        sprintf(buf, "%s%s", path, VDA_UPLOAD_MD5_SUFFIX);
+        boinc_delete_file(buf);
     } else {
-        retval = get_chunk_md5(chunk_dir, server_md5);
+        retval = get_chunk_md5(vf, chunk_name, server_md5);
         if (retval) return retval;
-        retval = md5_file(path, client_md5, size);
+        retval = get_upload_md5(path, client_md5);
         if (retval) return retval;
         if (strcmp(client_md5, server_md5)) {
             if (config.debug_vda) {
@@ -204,16 +297,27 @@ static int process_completed_upload(char* phys_filename, CHUNK_LIST& chunks) {
                 );
             } else {
                 dst_path[n] = 0;
-                sprintf(buf, "mv %s %s; chmod g+rw %s", path, dst_path, dst_path);
-                retval = system(buf);
-                if (retval == -1 || WEXITSTATUS(retval)) {
+
+                // rename() if the upload and data dirs are
+                // on the same file system; otherwise copy
+                //
+                if (!rename(path, dst_path)) {
+                    chmod(dst_path, 0664);
                     log_messages.printf(MSG_NORMAL,
-                        "[vda] command failed: %s\n", buf
+                        "[vda] moved %s to %s\n", path, dst_path
                     );
                 } else {
-                    log_messages.printf(MSG_NORMAL,
-                        "[vda] file move succeeded: %s\n", buf
-                    );
+                    sprintf(buf, "mv %s %s; chmod g+rw %s", path, dst_path, dst_path);
+                    retval = system(buf);
+                    if (retval == -1 || WEXITSTATUS(retval)) {
+                        log_messages.printf(MSG_NORMAL,
+                            "[vda] command failed: %s\n", buf
+                        );
+                    } else {
+                        log_messages.printf(MSG_NORMAL,
+                            "[vda] file move succeeded: %s\n", buf
+                        );
+                    }
                 }
             }
             retval = vf.update_field("need_update=1");
@@ -226,6 +330,7 @@ static int process_completed_upload(char* phys_filename, CHUNK_LIST& chunks) {
     ch.transfer_in_progress = 0;
     retval = ch.update_fields_noid("transfer_in_progress=0", buf);
     if (retval) return retval;
+    log_chunk_host_change(ch);
     return 0;
 }
 
@@ -293,6 +398,7 @@ static void process_chunk_present_on_client(FILE_INFO& fi, CHUNK_LIST& chunks) {
             log_messages.printf(MSG_CRITICAL, "ch.insert() failed\n");
             return;
         }
+        log_chunk_host_change(ch);
         mark_for_update(vf.id);
     } else {
         // we already have a DB record.
@@ -304,8 +410,6 @@ static void process_chunk_present_on_client(FILE_INFO& fi, CHUNK_LIST& chunks) {
         // if file wasn't previously on host, update the main file
         //
         if (!chp->present_on_host) {
-            mark_for_update(vf.id);
-
             chp->transfer_in_progress = false;
             chp->transfer_wait = false;
             chp->present_on_host = true;
@@ -317,6 +421,8 @@ static void process_chunk_present_on_client(FILE_INFO& fi, CHUNK_LIST& chunks) {
                 "transfer_in_progress=0, transfer_wait=0, present_on_host=1",
                 buf
             );
+            log_chunk_host_change(*chp);
+            mark_for_update(vf.id);
         }
     }
 }
@@ -348,6 +454,7 @@ static int process_chunks_missing_on_client(CHUNK_LIST& chunks) {
                 );
             }
             ch.transfer_in_progress = false;
+            log_chunk_host_change(ch);
             mark_for_update(ch.vda_file_id);
         }
     }
@@ -458,7 +565,7 @@ static int issue_transfer_commands(CHUNK_LIST& chunks) {
                 }
                 continue;
             }
-            char md5[64], chunk_dir[1024];
+            char md5[64];
             int hostid;
             if (config.debug_vda) {
                 log_messages.printf(MSG_NORMAL,
@@ -475,8 +582,7 @@ static int issue_transfer_commands(CHUNK_LIST& chunks) {
 
             get_chunk_url(vf, chunk_name, url);
             urls.push_back(url);
-            get_chunk_dir(vf, chunk_name, chunk_dir);
-            retval = get_chunk_md5(chunk_dir, md5);
+            retval = get_chunk_md5(vf, chunk_name, md5);
             if (retval) return retval;
             retval = put_file_xml(
                 ch.physical_file_name,
@@ -38,6 +38,11 @@
 //  --sim_duration_years;
 //  --random
 //      srand to pid
+//  --seed n
+//      srand to n
+//  --dir path
+//      write output files in the given directory
+//      (lets several runs go at once; see ssim.php)
 //
 // outputs:
 //   stdout: log info
@@ -561,6 +566,7 @@ int main(int argc, char** argv) {
     bool log_fault_tolerance = false;
     bool log_download = false;
     bool log_upload = false;
+    const char* out_dir = NULL;
 
     // default policy
     //
@@ -613,11 +619,23 @@ int main(int argc, char** argv) {
             params.sim_duration = atof(argv[++i])*86400*365;
         } else if (!strcmp(argv[i], "--random")) {
             srand(getpid());
+        } else if (!strcmp(argv[i], "--seed")) {
+            srand(atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--dir")) {
+            out_dir = argv[++i];
         } else {
             printf("bad arg %s\n", argv[i]);
             exit(1);
         }
     }
+
+    // do this after parsing args, so that --policy is relative
+    // to the directory we were started in
+    //
+    if (out_dir && chdir(out_dir)) {
+        printf("can't chdir to %s\n", out_dir);
+        exit(1);
+    }
 #if 0
     HOST_ARRIVAL *h = new HOST_ARRIVAL;
     h->t = 0;
@@ -11,18 +11,24 @@
 // host_life_mean x1 ... xn
 // connect_interval x
 // mean_xfer_rate x
+// ncpus n
+//      run up to n simulations at once (default: # of CPUs)
 
 // output graphs:
 // infile_ft.png: fault tolerance level vs time
 // infile_du.png: disk usage vs time
 // infile_ub.png: upload BW vs time
 // infile_db.png: download BW vs time
+// infile_summary.txt: one line per (policy, host_life_mean)
+//
+// Each simulation runs in its own directory (infile_runs/i_j).
 
 function parse_input_file($filename) {
     $x = null;
     $x->name = $filename;
     $x->policy = array();
     $x->policy_name = array();
+    $x->ncpus = 0;
     $f = fopen($filename, "r");
     if (!$f) die("no file $filename\n");
     while (($buf = fgets($f)) !== false) {
@@ -51,6 +57,9 @@ function parse_input_file($filename) {
         case "file_size":
             $x->file_size = (double)($w[1]);
             break;
+        case "ncpus":
+            $x->ncpus = (int)($w[1]);
+            break;
         }
     }
     fclose($f);
@@ -95,26 +104,70 @@ function parse_output_file($fname) {
     return array($ft, $du, $ul, $dl);
 }
 
+function ncpus() {
+    $n = (int)shell_exec("getconf _NPROCESSORS_ONLN 2>/dev/null");
+    return $n>0?$n:1;
+}
+
+// run the commands, up to $n at a time
+//
+function run_all($cmds, $n) {
+    $running = array();
+    $null = array(1=>array("file", "/dev/null", "w"));
+    while (count($cmds) || count($running)) {
+        while (count($cmds) && count($running) < $n) {
+            $cmd = array_shift($cmds);
+            echo "$cmd\n";
+            $running[] = proc_open($cmd, $null, $pipes);
+        }
+        foreach ($running as $i => $p) {
+            $s = proc_get_status($p);
+            if (!$s["running"]) {
+                proc_close($p);
+                unset($running[$i]);
+            }
+        }
+        usleep(100000);
+    }
+}
+
 if ($argc != 2) {
     die("usage: ssim.php infile\n");
 }
 $input = parse_input_file($argv[1]);
-foreach ($input->policy as $p) {
-    $datafile = fopen($input->name."_$p.dat", "w");
+$ncpus = $input->ncpus?$input->ncpus:ncpus();
+$rundir = $input->name."_runs";
+@mkdir($rundir);
+
+$cmds = array();
+foreach ($input->policy as $i => $p) {
     if (!file_exists($p)) {
         die("no policy file '$p'\n");
     }
-    foreach ($input->host_life_mean as $hlm) {
-        $cmd = "ssim --policy $p --host_life_mean $hlm --connect_interval $input->connect_interval --mean_xfer_rate $input->mean_xfer_rate --file_size $input->file_size > /dev/null";
-        echo "$cmd\n";
-        system($cmd);
-        list($ft, $du, $ub, $db) = parse_output_file("summary.txt");
+    foreach ($input->host_life_mean as $j => $hlm) {
+        $dir = "$rundir/$i"."_$j";
+        @mkdir($dir);
+        @unlink("$dir/summary.txt");
+        $cmds[] = "ssim --policy $p --host_life_mean $hlm --connect_interval $input->connect_interval --mean_xfer_rate $input->mean_xfer_rate --file_size $input->file_size --dir $dir";
+    }
+}
+run_all($cmds, $ncpus);
+
+$summary = fopen($input->name."_summary.txt", "w");
+fprintf($summary, "# policy host_life_mean fault_tol disk_usage upload download\n");
+foreach ($input->policy as $i => $p) {
+    $datafile = fopen($input->name."_$p.dat", "w");
+    foreach ($input->host_life_mean as $j => $hlm) {
+        $dir = "$rundir/$i"."_$j";
+        list($ft, $du, $ub, $db) = parse_output_file("$dir/summary.txt");
         $hlmd = $hlm/86400;
         $du_rel = $du/$input->file_size;
         fprintf($datafile, "$hlmd $ft $du_rel $ub $db\n");
+        fprintf($summary, "$p $hlmd $ft $du_rel $ub $db\n");
     }
     fclose($datafile);
 }
+fclose($summary);
 
 make_graph($input, "ft", "Fault tolerance", 2);
 make_graph($input, "du", "Relative disk usage", 3);
@@ -0,0 +1,729 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// Cauchy Reed-Solomon erasure coding; see vda_erasure.h
+//
+// The generator matrix is the n x n identity (data chunks)
+// on top of a k x n Cauchy matrix C[i][j] = 1/(x_i + y_j),
+// x_i = n+i, y_j = j.
+// Every square submatrix of a Cauchy matrix is invertible,
+// so any n rows of the generator are.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GF_X86
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define GF_NEON
+#include <arm_neon.h>
+#endif
+
+#include "error_numbers.h"
+#include "md5_file.h"
+
+#include "vda_erasure.h"
+
+using std::string;
+using std::vector;
+
+typedef unsigned char u8;
+
+// bytes per chunk processed at a time by each thread
+//
+#define ERASURE_BLOCK_SIZE  (1024*1024)
+
+// chunk sizes are a multiple of this
+//
+#define ERASURE_ALIGN       64
+
+#define ERASURE_MAX_THREADS 16
+
+// return the name of a chunk file:
+//
+// Coding/fname_k01.ext (data chunks)
+// Coding/fname_m01.ext (coding chunks)
+//
+// (the names used by Jerasure's encoder, which we used to use)
+//
+void encoder_filename(
+    const char* base, const char* ext, CODING& c, int i, char* buf
+) {
+    int ndigits = 1;
+    if (c.m > 9) ndigits = 2;
+    else if (c.m > 99) ndigits = 3;
+    else if (c.m > 999) ndigits = 4;
+    int j;
+    char ch;
+    if (i >= c.n) {
+        j = i-c.n + 1;
+        ch = 'm';
+    } else {
+        j = i+1;
+        ch = 'k';
+    }
+    sprintf(buf, "%s_%c%0*d.%s", base, ch, ndigits, j, ext);
+}
+
+///////////////// GF(2^8) arithmetic ///////////////////////
+
+static u8 gf_exp[512];
+static int gf_log[256];
+static u8 gf_mul_table[256][256];
+
+static void (*gf_mul_add_region)(u8 c, const u8* src, u8* dst, size_t len);
+
+static u8 gf_mul(u8 a, u8 b) {
+    if (!a || !b) return 0;
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static u8 gf_inv(u8 a) {
+    return gf_exp[255 - gf_log[a]];
+}
+
+static void gf_mul_add_region_table(u8 c, const u8* src, u8* dst, size_t len) {
+    const u8* t = gf_mul_table[c];
+    for (size_t i=0; i<len; i++) {
+        dst[i] ^= t[src[i]];
+    }
+}
+
+// The SIMD versions multiply 16 (or 32) bytes at a time
+// by looking up the low and high nibbles in 16-entry tables
+// of c*x and c*(x<<4), and XORing the results.
+//
+static void gf_nibble_tables(u8 c, u8* lo, u8* hi) {
+    for (int x=0; x<16; x++) {
+        lo[x] = gf_mul_table[c][x];
+        hi[x] = gf_mul_table[c][x<<4];
+    }
+}
+
+#ifdef GF_X86
+__attribute__((target("ssse3")))
+static void gf_mul_add_region_ssse3(u8 c, const u8* src, u8* dst, size_t len) {
+    u8 lo[16], hi[16];
+    gf_nibble_tables(c, lo, hi);
+    __m128i tlo = _mm_loadu_si128((const __m128i*)lo);
+    __m128i thi = _mm_loadu_si128((const __m128i*)hi);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i;
+    for (i=0; i+16<=len; i+=16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+        __m128i l = _mm_shuffle_epi8(tlo, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(
+            thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)
+        );
+        d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+        _mm_storeu_si128((__m128i*)(dst+i), d);
+    }
+    gf_mul_add_region_table(c, src+i, dst+i, len-i);
+}
+
+__attribute__((target("avx2")))
+static void gf_mul_add_region_avx2(u8 c, const u8* src, u8* dst, size_t len) {
+    u8 lo[16], hi[16];
+    gf_nibble_tables(c, lo, hi);
+    __m256i tlo = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)lo)
+    );
+    __m256i thi = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)hi)
+    );
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i;
+    for (i=0; i+32<=len; i+=32) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst+i));
+        __m256i l = _mm256_shuffle_epi8(tlo, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(
+            thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)
+        );
+        d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+        _mm256_storeu_si256((__m256i*)(dst+i), d);
+    }
+    gf_mul_add_region_table(c, src+i, dst+i, len-i);
+}
+#endif
+
+#ifdef GF_NEON
+static void gf_mul_add_region_neon(u8 c, const u8* src, u8* dst, size_t len) {
+    u8 lo[16], hi[16];
+    gf_nibble_tables(c, lo, hi);
+    uint8x16_t tlo = vld1q_u8(lo);
+    uint8x16_t thi = vld1q_u8(hi);
+    uint8x16_t mask = vdupq_n_u8(0x0f);
+    size_t i;
+    for (i=0; i+16<=len; i+=16) {
+        uint8x16_t s = vld1q_u8(src+i);
+        uint8x16_t d = vld1q_u8(dst+i);
+        uint8x16_t l = vqtbl1q_u8(tlo, vandq_u8(s, mask));
+        uint8x16_t h = vqtbl1q_u8(thi, vshrq_n_u8(s, 4));
+        vst1q_u8(dst+i, veorq_u8(d, veorq_u8(l, h)));
+    }
+    gf_mul_add_region_table(c, src+i, dst+i, len-i);
+}
+#endif
+
+static void gf_xor_region(const u8* src, u8* dst, size_t len) {
+    size_t i = 0;
+    if (!(((size_t)src | (size_t)dst) & 7)) {
+        for (; i+8<=len; i+=8) {
+            *(unsigned long long*)(dst+i) ^= *(const unsigned long long*)(src+i);
+        }
+    }
+    for (; i<len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+// dst += c*src
+//
+static inline void gf_mul_add(u8 c, const u8* src, u8* dst, size_t len) {
+    if (!c) return;
+    if (c == 1) {
+        gf_xor_region(src, dst, len);
+        return;
+    }
+    gf_mul_add_region(c, src, dst, len);
+}
+
+static pthread_once_t gf_once = PTHREAD_ONCE_INIT;
+
+// polynomial x^8 + x^4 + x^3 + x^2 + 1
+//
+static void gf_init() {
+    int i, j, x = 1;
+    for (i=0; i<255; i++) {
+        gf_exp[i] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11d;
+    }
+    for (i=255; i<512; i++) {
+        gf_exp[i] = gf_exp[i-255];
+    }
+    gf_log[0] = 0;
+    for (i=0; i<256; i++) {
+        for (j=0; j<256; j++) {
+            gf_mul_table[i][j] = gf_mul(i, j);
+        }
+    }
+
+    gf_mul_add_region = gf_mul_add_region_table;
+#ifdef GF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        gf_mul_add_region = gf_mul_add_region_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        gf_mul_add_region = gf_mul_add_region_ssse3;
+    }
+#endif
+#ifdef GF_NEON
+    gf_mul_add_region = gf_mul_add_region_neon;
+#endif
+}
+
+// Cauchy coefficient for coding chunk i, data chunk j
+//
+static u8 cauchy_coef(int n, int i, int j) {
+    return gf_inv((u8)((n+i) ^ j));
+}
+
+// invert an n x n matrix (row-major) in place.
+// Return nonzero if singular.
+//
+static int gf_invert_matrix(vector<u8>& a, int n) {
+    vector<u8> inv(n*n, 0);
+    int i, j, r;
+    for (i=0; i<n; i++) inv[i*n+i] = 1;
+    for (i=0; i<n; i++) {
+        for (r=i; r<n; r++) {
+            if (a[r*n+i]) break;
+        }
+        if (r == n) return -1;
+        if (r != i) {
+            for (j=0; j<n; j++) {
+                u8 t = a[i*n+j]; a[i*n+j] = a[r*n+j]; a[r*n+j] = t;
+                t = inv[i*n+j]; inv[i*n+j] = inv[r*n+j]; inv[r*n+j] = t;
+            }
+        }
+        u8 c = gf_inv(a[i*n+i]);
+        for (j=0; j<n; j++) {
+            a[i*n+j] = gf_mul(a[i*n+j], c);
+            inv[i*n+j] = gf_mul(inv[i*n+j], c);
+        }
+        for (r=0; r<n; r++) {
+            if (r == i || !a[r*n+i]) continue;
+            c = a[r*n+i];
+            for (j=0; j<n; j++) {
+                a[r*n+j] ^= gf_mul(a[i*n+j], c);
+                inv[r*n+j] ^= gf_mul(inv[i*n+j], c);
+            }
+        }
+    }
+    a = inv;
+    return 0;
+}
+
+///////////////// file I/O ///////////////////////
+
+// read len bytes at offset; zero-fill past EOF
+//
+static int read_at(int fd, u8* buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t m = pread(fd, buf+done, len-done, offset+done);
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            return ERR_READ;
+        }
+        if (m == 0) break;
+        done += m;
+    }
+    if (done < len) memset(buf+done, 0, len-done);
+    return 0;
+}
+
+static int write_at(int fd, const u8* buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t m = pwrite(fd, buf+done, len-done, offset+done);
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            return ERR_WRITE;
+        }
+        done += m;
+    }
+    return 0;
+}
+
+static void chunk_path(const char* dir, int n, int k, int i, char* path) {
+    CODING c;
+    char name[256];
+    c.n = n;
+    c.k = k;
+    c.m = n+k;
+    encoder_filename("data", "vda", c, i, name);
+    sprintf(path, "%s/Coding/%s", dir, name);
+}
+
+static int num_threads(off_t chunk_size) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > ERASURE_MAX_THREADS) n = ERASURE_MAX_THREADS;
+
+    // not worth it for small chunks
+    //
+    long nblocks = (chunk_size + ERASURE_BLOCK_SIZE - 1)/ERASURE_BLOCK_SIZE;
+    if (n > nblocks) n = nblocks;
+    if (n < 1) n = 1;
+    return (int)n;
+}
+
+// Work is divided among threads by ranges of offsets within the chunks.
+// Each thread processes its range a block at a time:
+// "in" are the n chunks it reads, "out" the chunks it computes.
+//
+struct ERASURE_JOB {
+    int n;
+    int nin;
+    int nout;
+    off_t chunk_size;
+    vector<int> in_fds;
+    vector<off_t> in_offsets;   // where chunk i starts in in_fds[i]
+    vector<int> out_fds;
+    vector<off_t> out_offsets;
+    vector<off_t> out_limits;   // don't write past this in out_fds[i]
+    vector<u8> coefs;           // nout x nin
+    vector<int> copy_fds;       // if >=0, also write input i here
+    vector<off_t> copy_offsets;
+    vector<off_t> copy_limits;
+};
+
+struct ERASURE_THREAD {
+    ERASURE_JOB* job;
+    off_t start, end;
+    int retval;
+    pthread_t thread;
+};
+
+static int write_limited(
+    int fd, const u8* buf, size_t len, off_t base, off_t offset, off_t limit
+) {
+    if (base + offset >= limit) return 0;
+    if (base + offset + (off_t)len > limit) len = limit - base - offset;
+    return write_at(fd, buf, len, base + offset);
+}
+
+static void* erasure_thread(void* p) {
+    ERASURE_THREAD& t = *(ERASURE_THREAD*)p;
+    ERASURE_JOB& j = *t.job;
+    int i, l, retval;
+    vector<u8> inbuf(j.nin*(size_t)ERASURE_BLOCK_SIZE);
+    vector<u8> outbuf(j.nout*(size_t)ERASURE_BLOCK_SIZE);
+
+    t.retval = 0;
+    for (off_t off = t.start; off < t.end; off += ERASURE_BLOCK_SIZE) {
+        size_t len = ERASURE_BLOCK_SIZE;
+        if (off + (off_t)len > t.end) len = t.end - off;
+        for (i=0; i<j.nin; i++) {
+            u8* b = &inbuf[i*(size_t)ERASURE_BLOCK_SIZE];
+            retval = read_at(j.in_fds[i], b, len, j.in_offsets[i] + off);
+            if (!retval && j.copy_fds[i] >= 0) {
+                retval = write_limited(
+                    j.copy_fds[i], b, len, j.copy_offsets[i], off,
+                    j.copy_limits[i]
+                );
+            }
+            if (retval) {
+                t.retval = retval;
+                return 0;
+            }
+        }
+        for (l=0; l<j.nout; l++) {
+            u8* o = &outbuf[l*(size_t)ERASURE_BLOCK_SIZE];
+            memset(o, 0, len);
+            for (i=0; i<j.nin; i++) {
+                gf_mul_add(
+                    j.coefs[l*j.nin+i], &inbuf[i*(size_t)ERASURE_BLOCK_SIZE],
+                    o, len
+                );
+            }
+            retval = write_limited(
+                j.out_fds[l], o, len, j.out_offsets[l], off, j.out_limits[l]
+            );
+            if (retval) {
+                t.retval = retval;
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+static int run_job(ERASURE_JOB& job) {
+    int i, nthreads = num_threads(job.chunk_size);
+    vector<ERASURE_THREAD> threads(nthreads);
+
+    // split on block boundaries
+    //
+    off_t nblocks = (job.chunk_size + ERASURE_BLOCK_SIZE - 1)/ERASURE_BLOCK_SIZE;
+    for (i=0; i<nthreads; i++) {
+        ERASURE_THREAD& t = threads[i];
+        t.job = &job;
+        t.start = (nblocks*i/nthreads)*ERASURE_BLOCK_SIZE;
+        t.end = (nblocks*(i+1)/nthreads)*ERASURE_BLOCK_SIZE;
+        if (t.end > job.chunk_size) t.end = job.chunk_size;
+    }
+    for (i=1; i<nthreads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, erasure_thread, &threads[i])) {
+            // do it ourselves
+            //
+            threads[i].thread = pthread_self();
+            erasure_thread(&threads[i]);
+        }
+    }
+    erasure_thread(&threads[0]);
+    int retval = threads[0].retval;
+    for (i=1; i<nthreads; i++) {
+        if (!pthread_equal(threads[i].thread, pthread_self())) {
+            pthread_join(threads[i].thread, NULL);
+        }
+        if (threads[i].retval) retval = threads[i].retval;
+    }
+    return retval;
+}
+
+// compute the MD5s of the chunks in Coding/, one thread per chunk
+// (up to the # of CPUs).
+// We do this right after writing them, so they're read from the page cache.
+//
+struct MD5_THREAD {
+    const char* dir;
+    int n, k;
+    int first, stride;
+    vector<string>* md5s;
+    int retval;
+    pthread_t thread;
+};
+
+static void* md5_thread(void* p) {
+    MD5_THREAD& t = *(MD5_THREAD*)p;
+    char path[1024], md5[MD5_LEN];
+    double nbytes;
+
+    t.retval = 0;
+    for (int i=t.first; i<t.n+t.k; i+=t.stride) {
+        chunk_path(t.dir, t.n, t.k, i, path);
+        int retval = md5_file(path, md5, nbytes);
+        if (retval) {
+            t.retval = retval;
+            return 0;
+        }
+        (*t.md5s)[i] = md5;
+    }
+    return 0;
+}
+
+static int md5_chunks(const char* dir, int n, int k, vector<string>& md5s) {
+    int i;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > ERASURE_MAX_THREADS) nthreads = ERASURE_MAX_THREADS;
+    if (nthreads > n+k) nthreads = n+k;
+
+    md5s.clear();
+    md5s.resize(n+k);
+    vector<MD5_THREAD> threads(nthreads);
+    for (i=0; i<nthreads; i++) {
+        MD5_THREAD& t = threads[i];
+        t.dir = dir;
+        t.n = n;
+        t.k = k;
+        t.first = i;
+        t.stride = (int)nthreads;
+        t.md5s = &md5s;
+    }
+    for (i=1; i<nthreads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, md5_thread, &threads[i])) {
+            threads[i].thread = pthread_self();
+            md5_thread(&threads[i]);
+        }
+    }
+    md5_thread(&threads[0]);
+    int retval = threads[0].retval;
+    for (i=1; i<nthreads; i++) {
+        if (!pthread_equal(threads[i].thread, pthread_self())) {
+            pthread_join(threads[i].thread, NULL);
+        }
+        if (threads[i].retval) retval = threads[i].retval;
+    }
+    return retval;
+}
+
+static void close_fds(vector<int>& fds) {
+    for (unsigned int i=0; i<fds.size(); i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+///////////////// encode and decode ///////////////////////
+
+int erasure_encode(
+    const char* dir, const char* filename, int n, int k, double& chunk_size,
+    vector<string>* md5s
+) {
+    char path[1024];
+    struct stat sbuf;
+    int i, j, retval;
+
+    if (n < 1 || k < 0 || n+k > 256) return ERR_INVALID_PARAM;
+    pthread_once(&gf_once, gf_init);
+
+    sprintf(path, "%s/%s", dir, filename);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ERR_FOPEN;
+    if (fstat(fd, &sbuf)) {
+        close(fd);
+        return ERR_READ;
+    }
+    off_t size = sbuf.st_size;
+    off_t csize = (size + n - 1)/n;
+    csize = (csize + ERASURE_ALIGN - 1)/ERASURE_ALIGN*ERASURE_ALIGN;
+    if (!csize) csize = ERASURE_ALIGN;
+
+    sprintf(path, "%s/Coding", dir);
+    if (mkdir(path, 0775) && errno != EEXIST) {
+        close(fd);
+        return ERR_MKDIR;
+    }
+
+    ERASURE_JOB job;
+    job.n = n;
+    job.nin = n;
+    job.nout = k;
+    job.chunk_size = csize;
+    job.in_fds.resize(n, fd);
+    job.copy_fds.resize(n, -1);
+    job.out_fds.resize(k, -1);
+    for (i=0; i<n; i++) {
+        job.in_offsets.push_back(i*csize);
+        chunk_path(dir, n, k, i, path);
+        job.copy_fds[i] = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+        if (job.copy_fds[i] < 0) {
+            retval = ERR_FOPEN;
+            goto done;
+        }
+        job.copy_offsets.push_back(0);
+        job.copy_limits.push_back(csize);
+    }
+    for (i=0; i<k; i++) {
+        chunk_path(dir, n, k, n+i, path);
+        job.out_fds[i] = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+        if (job.out_fds[i] < 0) {
+            retval = ERR_FOPEN;
+            goto done;
+        }
+        job.out_offsets.push_back(0);
+        job.out_limits.push_back(csize);
+        for (j=0; j<n; j++) {
+            job.coefs.push_back(cauchy_coef(n, i, j));
+        }
+    }
+
+    retval = run_job(job);
+    if (retval) goto done;
+
+    sprintf(path, "%s/Coding/%s", dir, ERASURE_META_FILENAME);
+    {
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            retval = ERR_FOPEN;
+            goto done;
+        }
+        fprintf(f, "%.0f\n%.0f\n%d %d\n", (double)size, (double)csize, n, k);
+        if (fclose(f)) retval = ERR_WRITE;
+    }
+    chunk_size = (double)csize;
+
+done:
+    close(fd);
+    close_fds(job.copy_fds);
+    close_fds(job.out_fds);
+    if (!retval && md5s) {
+        retval = md5_chunks(dir, n, k, *md5s);
+    }
+    return retval;
+}
+
+int erasure_decode(const char* dir, int n, int k, const char* out_path) {
+    char path[1024];
+    double dsize, dcsize;
+    int i, j, fn, fk, retval;
+    struct stat sbuf;
+
+    if (n < 1 || k < 0 || n+k > 256) return ERR_INVALID_PARAM;
+    pthread_once(&gf_once, gf_init);
+
+    sprintf(path, "%s/Coding/%s", dir, ERASURE_META_FILENAME);
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    int nitems = fscanf(f, "%lf %lf %d %d", &dsize, &dcsize, &fn, &fk);
+    fclose(f);
+    if (nitems != 4 || fn != n || fk != k) return ERR_READ;
+    off_t size = (off_t)dsize;
+    off_t csize = (off_t)dcsize;
+
+    // pick n chunks to decode from, data chunks first
+    //
+    vector<int> rows, missing;
+    vector<int> in_fds;
+    for (i=0; i<n+k && (int)rows.size()<n; i++) {
+        chunk_path(dir, n, k, i, path);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            if (i < n) missing.push_back(i);
+            continue;
+        }
+        if (fstat(fd, &sbuf) || sbuf.st_size != csize) {
+            close(fd);
+            if (i < n) missing.push_back(i);
+            continue;
+        }
+        rows.push_back(i);
+        in_fds.push_back(fd);
+    }
+    if ((int)rows.size() < n) {
+        close_fds(in_fds);
+        return ERR_NOT_FOUND;
+    }
+
+    int out_fd = open(out_path, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+    if (out_fd < 0) {
+        close_fds(in_fds);
+        return ERR_FOPEN;
+    }
+
+    ERASURE_JOB job;
+    job.n = n;
+    job.nin = n;
+    job.nout = (int)missing.size();
+    job.chunk_size = csize;
+    job.in_fds = in_fds;
+    job.in_offsets.resize(n, 0);
+
+    // present data chunks are copied to the output as they're read
+    //
+    for (i=0; i<n; i++) {
+        if (rows[i] < n) {
+            job.copy_fds.push_back(out_fd);
+            job.copy_offsets.push_back(rows[i]*csize);
+        } else {
+            job.copy_fds.push_back(-1);
+            job.copy_offsets.push_back(0);
+        }
+        job.copy_limits.push_back(size);
+    }
+
+    // missing data chunk d = (row d of the inverse of the
+    // generator rows we have) . (the chunks we have)
+    //
+    if (!missing.empty()) {
+        vector<u8> a(n*n, 0);
+        for (i=0; i<n; i++) {
+            int r = rows[i];
+            for (j=0; j<n; j++) {
+                if (r < n) {
+                    a[i*n+j] = (r == j)?1:0;
+                } else {
+                    a[i*n+j] = cauchy_coef(n, r-n, j);
+                }
+            }
+        }
+        if (gf_invert_matrix(a, n)) {
+            close_fds(in_fds);
+            close(out_fd);
+            return ERR_INVALID_PARAM;
+        }
+        for (unsigned int l=0; l<missing.size(); l++) {
+            int d = missing[l];
+            for (j=0; j<n; j++) {
+                job.coefs.push_back(a[d*n+j]);
+            }
+            job.out_fds.push_back(out_fd);
+            job.out_offsets.push_back(d*csize);
+            job.out_limits.push_back(size);
+        }
+    }
+
+    retval = run_job(job);
+    close_fds(in_fds);
+    if (close(out_fd) && !retval) retval = ERR_WRITE;
+    return retval;
+}
@@ -0,0 +1,68 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2013 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// In-process erasure coding for VDA meta-chunks:
+// systematic Cauchy Reed-Solomon over GF(2^8).
+//
+// A file is split into n equal-size data chunks
+// (the last one zero-padded) and k coding chunks are computed;
+// any n of the n+k chunks are enough to recover the file.
+// n+k must be at most 256.
+//
+// The chunks are files in <dir>/Coding,
+// named as by encoder_filename() (data_k01.vda ... data_m01.vda ...),
+// plus data_meta.txt, which records the file size and chunk size.
+// erasure_encode() can also return the chunks' MD5s,
+// computed (in parallel) while the chunks are still in the page cache.
+//
+// The GF(2^8) multiply-accumulate loops use SSSE3 or AVX2
+// (if the CPU has them) or NEON, and a table lookup otherwise.
+// Encoding and decoding are split across threads by byte range.
+
+#ifndef _VDA_ERASURE_H_
+#define _VDA_ERASURE_H_
+
+#include <string>
+#include <vector>
+
+#include "vda_policy.h"
+
+#define ERASURE_META_FILENAME   "data_meta.txt"
+
+extern void encoder_filename(
+    const char* base, const char* ext, CODING& c, int i, char* buf
+);
+
+// read <dir>/<filename> and create its n+k chunks in <dir>/Coding.
+// Each chunk's size is returned in chunk_size.
+// If md5s is non-NULL, it's set to the MD5s of the n+k chunks.
+//
+extern int erasure_encode(
+    const char* dir, const char* filename, int n, int k,
+    double& chunk_size, std::vector<std::string>* md5s
+);
+
+// recreate the original file, writing it to out_path,
+// from the chunks present in <dir>/Coding.
+// Only missing data chunks are computed;
+// if all data chunks are present they're just concatenated.
+//
+extern int erasure_decode(
+    const char* dir, int n, int k, const char* out_path
+);
+
+#endif
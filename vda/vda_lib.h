@@ -21,6 +21,7 @@
 // and the VDA server software (vdad.cpp, sched_vda.cpp)
 
 #include <set>
+#include <string>
 #include <vector>
 #include <string.h>
 #include <stdlib.h>
@@ -38,6 +39,21 @@ extern bool debug_ft;
 //
 #define VDA_HOST_TIMEOUT (86400*4)
 
+// The scheduler appends a line "vda_file_id host_id physical_file_name"
+// to this file (in the project dir) whenever it creates, changes,
+// or deletes a VDA_CHUNK_HOST record.
+// vdad uses it to keep its in-memory chunk trees up to date
+// without re-reading all the records of a file.
+//
+#define VDA_CHANGELOG_FILENAME "vda_changelog.txt"
+
+// vda writes the MD5s of a file's chunks to this file
+// (in the file's directory) when it encodes the file,
+// one line "chunk_name md5" per chunk.
+// The scheduler reads it once per file, rather than a file per chunk.
+//
+#define VDA_MANIFEST_FILENAME "chunk_md5.txt"
+
 extern void show_msg(char*);
 extern char* time_str(double);
 extern const char* status_str(int status);
@@ -49,6 +65,7 @@ inline bool outdated_client(HOST& h) {
 }
 
 struct META_CHUNK;
+struct CHUNK;
 
 struct VDA_FILE_AUX : VDA_FILE {
     POLICY policy;
@@ -75,26 +92,56 @@ struct VDA_FILE_AUX : VDA_FILE {
 
     // the following for vdad
     //
-    DB_HOST enum_host;
-    char enum_query[256];
-    int max_chunks;
-    int last_id;
-    bool enum_active;
-    bool found_this_scan;
-    bool found_any_this_scan;
-    bool found_any_this_enum;
+    double state_time;
+        // when the chunk tree was read from the DB
+    std::vector<CHUNK*> pending_assign;
+        // chunks that need another replica;
+        // CHUNK::assign() adds to this, assign_chunks() places them
 
     int init();
     int get_state();
-    int choose_host();
+    int refresh_state();
+    void free_state();
+    CHUNK* find_chunk(VDA_CHUNK_HOST&);
+    int update_chunk_host(int host_id, const char* physical_file_name);
+    int assign_chunks();
 
     VDA_FILE_AUX(DB_VDA_FILE f) : VDA_FILE(f) {
-        max_chunks = 0;
-        enum_active = false;
-        last_id = 0;
+        meta_chunk = NULL;
+        state_time = 0;
+    }
+};
+
+// vdad: what we know about a live host, for placing chunks.
+// Kept in memory and refreshed every VDA_HOST_INDEX_PERIOD seconds,
+// so placing chunks doesn't require DB queries.
+//
+struct VDA_HOST_INFO {
+    int id;
+    double free;
+        // space we can still use on the host (project's share - used)
+    double availability;
+        // fraction of time the host is on and connected
+    unsigned int domain;
+        // failure domain: hosts likely to fail together
+        // (same /24 subnet) have the same value
+};
+
+#define VDA_HOST_INDEX_PERIOD   600
+
+struct VDA_HOST_INDEX {
+    std::vector<VDA_HOST_INFO> hosts;
+    double refresh_time;
+
+    int refresh();
+    int update(double now);
+    VDA_HOST_INDEX() {
+        refresh_time = 0;
     }
 };
 
+extern VDA_HOST_INDEX vda_host_index;
+
 #define PRESENT         0
     // this unit is present on the server
     // (in the case of meta-chunks, this means that enough chunks
@@ -107,6 +154,7 @@ struct VDA_FILE_AUX : VDA_FILE {
 // base class for chunks and meta-chunks
 //
 struct DATA_UNIT {
+    virtual ~DATA_UNIT(){}
     virtual void recovery_plan(){};
     virtual int recovery_action(double){return 0;};
     virtual int compute_min_failures(){return 0;};
@@ -151,6 +199,8 @@ struct META_CHUNK : DATA_UNIT {
     bool need_reconstruct;
     bool needed_by_parent;
     double child_size;
+    std::vector<std::string> chunk_md5s;
+        // if bottom level: MD5s of the chunks, computed by encode(true)
 
     // used by ssim
     META_CHUNK(
@@ -162,6 +212,7 @@ struct META_CHUNK : DATA_UNIT {
     META_CHUNK(VDA_FILE_AUX* d, META_CHUNK* p, int index);
     int init(const char* dir, POLICY&, int level);
     int get_state(const char* dir, POLICY&, int level);
+    void check_present();
 
     virtual void recovery_plan();
     virtual int recovery_action(double);
@@ -213,6 +264,7 @@ struct CHUNK : DATA_UNIT {
 
     // used by vdad
     int start_upload_from_host(VDA_CHUNK_HOST&);
+    void check_present();
 };
 
 // names
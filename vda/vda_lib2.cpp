@@ -18,58 +18,35 @@
 // The part of the implementation of vda_lib.h
 // that's NOT used by the simulator
 
+#include <map>
+#include <queue>
 #include <set>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <vector>
 #include <unistd.h>
 
 #include "error_numbers.h"
 #include "filesys.h"
-#include "md5_file.h"
 #include "str_replace.h"
 
 #include "sched_config.h"
 #include "sched_msgs.h"
 #include "sched_util.h"
 
+#include "vda_erasure.h"
 #include "vda_lib.h"
 
+using std::map;
+using std::priority_queue;
 using std::set;
+using std::string;
 using std::vector;
 
 #define DATA_FILENAME "data.vda"
 
 ///////////////// Utility funcs ///////////////////////
 
-// return the name of a file created by Jerasure's encoder
-//
-// encoder creates files with names of the form
-// Coding/fname_k01.ext
-// Coding/fname_m01.ext
-//
-// Assume there's no extension
-//
-void encoder_filename(
-    const char* base, const char* ext, CODING& c, int i, char* buf
-) {
-    int ndigits = 1;
-    if (c.m > 9) ndigits = 2;
-    else if (c.m > 99) ndigits = 3;
-    else if (c.m > 999) ndigits = 4;
-    int j;
-    char ch;
-    if (i >= c.n) {
-        j = i-c.n + 1;
-        ch = 'm';
-    } else {
-        j = i+1;
-        ch = 'k';
-    }
-    sprintf(buf, "%s_%c%0*d.%s", base, ch, ndigits, j, ext);
-}
-
 int get_chunk_numbers(VDA_CHUNK_HOST& vch, vector<int>& chunk_numbers) {
     char buf[256];
     safe_strcpy(buf, vch.physical_file_name);   // vda_hostid_chunknums_filename
@@ -127,16 +104,16 @@ META_CHUNK::META_CHUNK(VDA_FILE_AUX* d, META_CHUNK* p, int index) {
 // encode it, then recursively initialize its meta-chunk children
 //
 int META_CHUNK::init(const char* _dir, POLICY& p, int coding_level) {
-    double size;
     char child_dir[1024];
 
     safe_strcpy(dir, _dir);
     coding = p.codings[coding_level];
+    bottom_level = (coding_level == p.coding_levels - 1);
     int retval = encode(true);
     if (retval) return retval;
     p.chunk_sizes[coding_level] = child_size;
 
-    if (coding_level < p.coding_levels - 1) {
+    if (!bottom_level) {
         for (int i=0; i<coding.m; i++) {
             sprintf(child_dir, "%s/%d", dir, i);
             META_CHUNK* mc = new META_CHUNK(dfile, this, i);
@@ -144,28 +121,39 @@ int META_CHUNK::init(const char* _dir, POLICY& p, int coding_level) {
             if (retval) return retval;
             children.push_back(mc);
         }
-        bottom_level = false;
     } else {
         for (int i=0; i<coding.m; i++) {
             CHUNK* cp = new CHUNK(this, p.chunk_sizes[coding_level], i);
             children.push_back(cp);
-
-            // write the chunk's MD5 to a file
-            //
-            char file_path[1024], md5_file_path[1024];
-            sprintf(file_path, "%s/%d/%s", dir, i, DATA_FILENAME);
-            sprintf(md5_file_path, "%s/%d/md5.txt", dir, i);
-            char md5[64];
-            md5_file(file_path, md5, size);
-            FILE* f = fopen(md5_file_path, "w");
-            fprintf(f, "%s\n", md5);
-            fclose(f);
         }
-        bottom_level = true;
     }
     return 0;
 }
 
+// write the MD5s of the bottom-level chunks
+// (computed when they were encoded) to the manifest
+//
+static void write_manifest(FILE* f, META_CHUNK* mc) {
+    for (unsigned int i=0; i<mc->children.size(); i++) {
+        if (mc->bottom_level) {
+            CHUNK* c = (CHUNK*)mc->children[i];
+            fprintf(f, "%s %s\n", c->name, mc->chunk_md5s[i].c_str());
+        } else {
+            write_manifest(f, (META_CHUNK*)mc->children[i]);
+        }
+    }
+}
+
+void META_CHUNK::check_present() {
+    for (unsigned int i=0; i<children.size(); i++) {
+        if (bottom_level) {
+            ((CHUNK*)children[i])->check_present();
+        } else {
+            ((META_CHUNK*)children[i])->check_present();
+        }
+    }
+}
+
 int META_CHUNK::get_state(const char* _dir, POLICY& p, int coding_level) {
     int retval;
 
@@ -201,28 +189,28 @@ int META_CHUNK::get_state(const char* _dir, POLICY& p, int coding_level) {
 // The size of these chunks is returned in "size"
 //
 int META_CHUNK::encode(bool first) {
-    char cmd[1024];
+    char path[1024];
+    double size;
 
-    // "encoder" has a random exit code so check its stdout instead
+    // the first time, get the MD5s of the bottom-level chunks
+    // for the manifest
     //
-    sprintf(cmd,
-        "cd %s; /mydisks/b/users/boincadm/vda_test/encoder %s %d %d cauchy_good 32 1024 500000 | grep Encoding",
-        dir, DATA_FILENAME, coding.n, coding.k
+    int retval = erasure_encode(
+        dir, DATA_FILENAME, coding.n, coding.k, size,
+        (first && bottom_level)?&chunk_md5s:NULL
     );
-    printf("%s\n", cmd);
-    int s = system(cmd);
-    if (!WIFEXITED(s) || WEXITSTATUS(s)) {
-        printf("system(%s) failed\n", cmd);
-        return -1;
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "encode(): erasure_encode(%s) failed: %s\n",
+            dir, boincerror(retval)
+        );
+        return retval;
     }
 
     if (first) {
-        sprintf(cmd, "chmod g+wx %s/Coding", dir);
-        s = system(cmd);
-        if (!WIFEXITED(s) || WEXITSTATUS(s)) {
-            printf("system(%s) failed\n", cmd);
-            return -1;
-        }
+        sprintf(path, "%s/Coding", dir);
+        chmod(path, 0775);
+        child_size = size;
 
         // make symlinks
         //
@@ -232,7 +220,7 @@ int META_CHUNK::encode(bool first) {
             encoder_filename("data", "vda", coding, i, enc_filename);
             sprintf(target_path, "%s/Coding/%s", dir, enc_filename);
             sprintf(dir_name, "%s/%d", dir, i);
-            int retval = mkdir(dir_name, 0777);
+            retval = mkdir(dir_name, 0777);
             if (retval) {
                 perror("mkdir");
                 return retval;
@@ -245,74 +233,33 @@ int META_CHUNK::encode(bool first) {
                 );
                 return retval;
             }
-            if (i == 0) {
-                file_size(target_path, child_size);
-            }
         }
     }
     return 0;
 }
 
+// reconstruct the meta-chunk's file from the chunks in Coding/,
+// writing it where data.vda points
+//
 int META_CHUNK::decode() {
-    char cmd[1024], enc_filename[1024];
-    int retval;
-
-    // the Jerasure decoder infinite-loops if all chunks are present.
-    // So if this is the case, temporarily rename the first chunk
-    //
-    bool rename_child = false;
-    if (bottom_level) {
-        rename_child = true;
-        for (unsigned i=0; i<children.size(); i++) {
-            CHUNK* cp = (CHUNK*)children[i];
-            if (!cp->present_on_server) {
-                rename_child = false;
-                break;
-            }
-        }
-        if (rename_child) {
-            encoder_filename("data", "vda", coding, 0, enc_filename);
-            sprintf(cmd, "mv %s/Coding/%s %s/Coding/decode_temp",
-                dir, enc_filename, dir
-            );
-            retval = system(cmd);
-            if (retval) return retval;
-        }
-    }
-
-    sprintf(cmd,
-        "cd %s; /mydisks/b/users/boincadm/vda_test/decoder %s | grep Decoding",
-        dir, DATA_FILENAME
-    );
-    printf("%s\n", cmd);
-    int s = system(cmd);
-    if (!WIFEXITED(s) || WEXITSTATUS(s)) {
-        printf("system(%s) failed\n", cmd);
-        return -1;
-    }
-
-    if (rename_child) {
-        sprintf(cmd, "mv %s/Coding/decode_temp %s/Coding/%s",
-            dir, dir, enc_filename
-        );
-        retval = system(cmd);
-        if (retval) return retval;
-    }
-
-    // decoder puts its result in Coding/data_decoded.vda
-    // Move this to file.ext
-    //
     char linkpath[1024], filepath[1024];
-    sprintf(linkpath, "%s/data.vda", dir);
+
+    sprintf(linkpath, "%s/%s", dir, DATA_FILENAME);
     ssize_t n = readlink(linkpath, filepath, sizeof(filepath)-1);
     if (n < 0) {
         perror("readlink");
-        return -1;
+        return ERR_SYMLINK;
     }
     filepath[n] = 0;
-    sprintf(cmd, "mv %s/Coding/data_decoded.vda %s", dir, filepath);
-    retval = system(cmd);
-    if (retval) return retval;
+
+    int retval = erasure_decode(dir, coding.n, coding.k, filepath);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "decode(): erasure_decode(%s) failed: %s\n",
+            dir, boincerror(retval)
+        );
+        return retval;
+    }
     return 0;
 }
 
@@ -369,6 +316,13 @@ CHUNK::CHUNK(META_CHUNK* mc, double s, int index) {
         sprintf(name, "%d", index);
     }
     sprintf(dir, "%s/%d", mc->dir, index);
+    check_present();
+}
+
+// see if the chunk's file is on the server
+// (the scheduler puts it there when an upload completes)
+//
+void CHUNK::check_present() {
     char path[256];
     double fsize;
     sprintf(path, "%s/data.vda", dir);
@@ -380,34 +334,12 @@ CHUNK::CHUNK(META_CHUNK* mc, double s, int index) {
     }
 }
 
-// assign this chunk to a host
+// this chunk needs another replica.
+// Placement is done for all such chunks of the file at once,
+// in VDA_FILE_AUX::assign_chunks()
 //
 int CHUNK::assign() {
-    int host_id = parent->dfile->choose_host();
-    if (!host_id) {
-        log_messages.printf(MSG_CRITICAL, "CHUNK::assign: can't get host\n");
-        return ERR_NOT_FOUND;
-    }
-    DB_VDA_CHUNK_HOST ch;
-    ch.create_time = dtime();
-    ch.vda_file_id = parent->dfile->id;
-    ch.host_id = host_id;
-    physical_file_name(
-        host_id, name, parent->dfile->file_name, ch.physical_file_name
-    );
-    ch.present_on_host = 0;
-    ch.transfer_in_progress = true;
-    ch.transfer_wait = true;
-    ch.transfer_request_time = ch.create_time;
-    ch.transfer_send_time = 0;
-    int retval = ch.insert();
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL, "ch.insert() failed\n");
-        return retval;
-    }
-    log_messages.printf(MSG_NORMAL,
-        "   assigning chunk %s to host %d\n", name, host_id
-    );
+    parent->dfile->pending_assign.push_back(this);
     return 0;
 }
 
@@ -419,9 +351,12 @@ int CHUNK::start_upload_from_host(VDA_CHUNK_HOST& ch) {
         "   requesting upload of %s from host %d\n", name, ch.host_id
     );
 
+    ch.transfer_in_progress = true;
+    ch.transfer_wait = true;
+    ch.transfer_request_time = dtime();
     sprintf(set_clause,
         "transfer_in_progress=1, transfer_wait=1, transfer_request_time=%f",
-        dtime()
+        ch.transfer_request_time
     );
     sprintf(where_clause,
         "vda_file_id=%d and host_id=%d and physical_file_name='%s'",
@@ -483,6 +418,7 @@ int VDA_FILE_AUX::init() {
         return ERR_SYMLINK;
     }
 
+    state_time = dtime();
     meta_chunk = new META_CHUNK(this, NULL, 0);
     retval = meta_chunk->init(dir, policy, 0);
     if (retval) return retval;
@@ -493,6 +429,15 @@ int VDA_FILE_AUX::init() {
     }
     fclose(f);
 
+    sprintf(buf, "%s/%s", dir, VDA_MANIFEST_FILENAME);
+    f = fopen(buf, "w");
+    if (!f) {
+        log_messages.printf(MSG_CRITICAL, "can't create %s\n", buf);
+        return ERR_FOPEN;
+    }
+    write_manifest(f, meta_chunk);
+    if (fclose(f)) return ERR_FWRITE;
+
     // create symlink from download dir
     //
     dir_hier_path(file_name, config.download_dir, config.uldl_dir_fanout, buf);
@@ -524,6 +469,7 @@ int VDA_FILE_AUX::get_state() {
         }
     }
     fclose(f);
+    state_time = dtime();
     meta_chunk = new META_CHUNK(this, NULL, 0);
     int retval = meta_chunk->get_state(dir, policy, 0);
     if (retval) return retval;
@@ -536,134 +482,399 @@ int VDA_FILE_AUX::get_state() {
         retval = vch.enumerate(buf);
         if (retval == ERR_DB_NOT_FOUND) break;
         if (retval) return retval;
-        vector<int> chunk_numbers;
-        retval = get_chunk_numbers(vch, chunk_numbers);
-        if (retval) {
+        CHUNK* c = find_chunk(vch);
+        if (!c) return -1;
+        VDA_CHUNK_HOST* vchp = new VDA_CHUNK_HOST();
+        *vchp = vch;
+        c->hosts.insert(vchp);
+    }
+    return 0;
+}
+
+// find the bottom-level chunk that a VDA_CHUNK_HOST refers to
+//
+CHUNK* VDA_FILE_AUX::find_chunk(VDA_CHUNK_HOST& vch) {
+    vector<int> chunk_numbers;
+    int retval = get_chunk_numbers(vch, chunk_numbers);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "get_chunk_numbers(): %d\n", retval
+        );
+        return NULL;
+    }
+    if ((int)(chunk_numbers.size()) != policy.coding_levels) {
+        log_messages.printf(MSG_CRITICAL,
+            "wrong get_chunk_numbers: got %d, expected %d\n",
+            (int)(chunk_numbers.size()), policy.coding_levels
+        );
+        return NULL;
+    }
+    META_CHUNK* mc = meta_chunk;
+    for (int i=0; i<policy.coding_levels; i++) {
+        int j = chunk_numbers[i];
+        if (j < 0 || j >= (int)mc->children.size()) {
             log_messages.printf(MSG_CRITICAL,
-                "get_chunk_numbers(): %d\n", retval
+                "bad chunk number in %s\n", vch.physical_file_name
             );
-            return retval;
+            return NULL;
         }
-        if ((int)(chunk_numbers.size()) != policy.coding_levels) {
-            log_messages.printf(MSG_CRITICAL,
-                "wrong get_chunk_numbers: got %d, expected %d\n",
-                (int)(chunk_numbers.size()), policy.coding_levels
-            );
-            return -1;
+        if (i == policy.coding_levels-1) {
+            return (CHUNK*)(mc->children[j]);
         }
-        META_CHUNK* mc = meta_chunk;
-        for (int i=0; i<policy.coding_levels; i++) {
-            if (i == policy.coding_levels-1) {
-                CHUNK* c = (CHUNK*)(mc->children[chunk_numbers[i]]);
-                VDA_CHUNK_HOST* vchp = new VDA_CHUNK_HOST();
-                *vchp = vch;
-                c->hosts.insert(vchp);
-            } else {
-                mc = (META_CHUNK*)(mc->children[chunk_numbers[i]]);
+        mc = (META_CHUNK*)(mc->children[j]);
+    }
+    return NULL;
+}
+
+// vdad keeps the trees of files in memory between passes.
+// Before a pass over a file whose tree is already in memory,
+// update the parts that other programs may have changed
+// and that aren't in the changelog:
+// which chunks are present on the server.
+//
+int VDA_FILE_AUX::refresh_state() {
+    meta_chunk->check_present();
+    return 0;
+}
+
+static void free_meta_chunk(META_CHUNK* mc) {
+    for (unsigned int i=0; i<mc->children.size(); i++) {
+        if (mc->bottom_level) {
+            CHUNK* c = (CHUNK*)mc->children[i];
+            set<VDA_CHUNK_HOST*>::iterator j;
+            for (j=c->hosts.begin(); j!=c->hosts.end(); j++) {
+                delete *j;
             }
+            delete c;
+        } else {
+            free_meta_chunk((META_CHUNK*)mc->children[i]);
         }
+    }
+    delete mc;
+}
 
+// free the chunk tree
+//
+void VDA_FILE_AUX::free_state() {
+    if (meta_chunk) {
+        free_meta_chunk(meta_chunk);
+        meta_chunk = NULL;
     }
-    return 0;
 }
 
-// Pick a host to send a chunk of this file to.
-// We want to pick the host that has the fewest chunks
-// of this file already (preferably zero).
-// The policy is:
-// - maintain a threshold "max_chunks".
-// - enumerate all hosts that are alive
-// - if find a host H w/ at most max_chunks of this file,
-//   set max_chunks to nchunks(H) and return H
-// - if scan all hosts w/o finding one, increment max_chunks and start over
+// The VDA_CHUNK_HOST record (host_id, physical_file_name)
+// of this file was created, changed or deleted.
+// Update our copy of it from the DB.
 //
-int VDA_FILE_AUX::choose_host() {
+int VDA_FILE_AUX::update_chunk_host(
+    int host_id, const char* physical_file_name
+) {
+    DB_VDA_CHUNK_HOST vch;
+    char buf[1024], name[256];
     int retval;
-    char buf[256];
 
-    // terminology:
-    // "enum" is the result of one DB query (typically 100 hosts)
-    // "scan" is a set of enums covering the entire host table
-    //
-    while (1) {
-        if (!enum_active) {
-            sprintf(enum_query,
-                "where cpu_efficiency=0 and id > %d order by id limit 100",
-                last_id
-            );
-            enum_active = true;
-            found_any_this_enum = false;
-            if (last_id == 0) {
-                found_this_scan = false;
-                found_any_this_scan = false;
-            }
+    safe_strcpy(vch.physical_file_name, physical_file_name);
+    CHUNK* c = find_chunk(vch);
+    if (!c) return ERR_NOT_FOUND;
+
+    VDA_CHUNK_HOST* chp = NULL;
+    set<VDA_CHUNK_HOST*>::iterator i;
+    for (i=c->hosts.begin(); i!=c->hosts.end(); i++) {
+        if ((*i)->host_id == host_id
+            && !strcmp((*i)->physical_file_name, physical_file_name)
+        ) {
+            chp = *i;
+            break;
         }
-        retval = enum_host.enumerate(enum_query);
-        if (retval == ERR_DB_NOT_FOUND) {
-            // we've finished an enum
-            //
-            enum_active = false;
-            if (found_any_this_enum) {
-                // if we found anything in this enum, continue the scan
-                continue;
-            }
+    }
 
-            // we've finished a scan
-            //
-            last_id = 0;
-            if (!found_any_this_scan) {
-                log_messages.printf(MSG_CRITICAL,
-                    "choose_host(): no live hosts\n"
-                );
-                return 0;
-            }
-            if (!found_this_scan) {
-                max_chunks++;
-                log_messages.printf(MSG_NORMAL,
-                    "choose_host(): completed scan, new max_chunks %d\n",
-                    max_chunks
-                );
-                continue;
-            }
-            continue;
+    safe_strcpy(name, physical_file_name);
+    escape_string(name, sizeof(name));
+    sprintf(buf,
+        "where vda_file_id=%d and host_id=%d and physical_file_name='%s'",
+        id, host_id, name
+    );
+    retval = vch.lookup(buf);
+    if (retval == ERR_DB_NOT_FOUND) {
+        if (chp) {
+            c->hosts.erase(chp);
+            delete chp;
         }
+        return 0;
+    }
+    if (retval) return retval;
+    if (!chp) {
+        chp = new VDA_CHUNK_HOST();
+        c->hosts.insert(chp);
+    }
+    *chp = vch;
+    return 0;
+}
+
+///////////////// Chunk placement ///////////////////////
+
+VDA_HOST_INDEX vda_host_index;
+
+// failure domain of a host: its /24 subnet if we know its address,
+// otherwise a value of its own
+//
+static unsigned int host_domain(HOST& h) {
+    unsigned int a, b, c, d;
+    if (sscanf(h.external_ip_addr, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+        return (a<<16) | (b<<8) | c;
+    }
+    return 0x80000000 | (unsigned int)h.id;
+}
+
+// read the live hosts from the DB.
+// Hosts running old client software are classified as dead.
+//
+int VDA_HOST_INDEX::refresh() {
+    DB_HOST h;
+    VDA_HOST_INFO hi;
+    int retval;
+
+    hosts.clear();
+    while (1) {
+        retval = h.enumerate("where cpu_efficiency=0");
+        if (retval == ERR_DB_NOT_FOUND) break;
         if (retval) {
-            // a DB error occurred
             log_messages.printf(MSG_CRITICAL,
-                "choose_host(): DB error %d\n", retval
+                "VDA_HOST_INDEX::refresh(): DB error %d\n", retval
             );
-            enum_active = false;
-            return 0;
+            return retval;
         }
-
-        found_any_this_enum = true;
-        found_any_this_scan = true;
-        last_id = enum_host.id;
-
-        // if the host is running old client software, classify it as dead
-        //
-        if (outdated_client(enum_host)) {
-            enum_host.cpu_efficiency = 1;
-            enum_host.update();
+        if (outdated_client(h)) {
+            h.cpu_efficiency = 1;
+            h.update();
             continue;
         }
+        hi.id = h.id;
+        if (h.d_boinc_max > 0) {
+            hi.free = h.d_boinc_max - h.d_boinc_used_total;
+        } else {
+            hi.free = h.d_free;
+        }
+        if (hi.free <= 0) hi.free = 0;
+        hi.availability = h.on_frac;
+        if (h.connected_frac >= 0) hi.availability *= h.connected_frac;
+        hi.domain = host_domain(h);
+        hosts.push_back(hi);
+    }
+    log_messages.printf(MSG_NORMAL,
+        "host index: %d live hosts\n", (int)hosts.size()
+    );
+    return 0;
+}
 
-        // we have a live host.
-        // see whether it satisfies max_chunks
-        //
-        DB_VDA_CHUNK_HOST ch;
-        int count;
-        sprintf(buf, "where vda_file_id=%d and host_id=%d", id, enum_host.id);
-        retval = ch.count(count, buf);
-        if (retval) {
-            log_messages.printf(MSG_CRITICAL, "ch.count failed\n");
-            return 0;
+int VDA_HOST_INDEX::update(double now) {
+    if (refresh_time > now - VDA_HOST_INDEX_PERIOD) return 0;
+    int retval = refresh();
+    if (retval) return retval;
+    refresh_time = now;
+    return 0;
+}
+
+// a host in the placement heap.
+// Hosts with fewer chunks of the file come first,
+// and among those the more available ones.
+//
+struct HOST_SLOT {
+    int nchunks;
+    double availability;
+    int index;      // in vda_host_index.hosts
+
+    bool operator<(const HOST_SLOT& s) const {
+        if (nchunks != s.nchunks) return nchunks > s.nchunks;
+        return availability < s.availability;
+    }
+};
+
+// get the failure domains of the hosts
+// that have chunks of c's meta-chunk
+//
+static void sibling_domains(
+    CHUNK* c, map<int, unsigned int>& host_domains,
+    set<unsigned int>& domains
+) {
+    META_CHUNK* mc = c->parent;
+    for (unsigned int i=0; i<mc->children.size(); i++) {
+        CHUNK* sib = (CHUNK*)mc->children[i];
+        set<VDA_CHUNK_HOST*>::iterator j;
+        for (j=sib->hosts.begin(); j!=sib->hosts.end(); j++) {
+            map<int, unsigned int>::iterator k =
+                host_domains.find((*j)->host_id);
+            if (k != host_domains.end()) domains.insert(k->second);
         }
-        if (count <= max_chunks) {
-            found_this_scan = true;
-            max_chunks = count;
-            return enum_host.id;
+    }
+}
+
+static void count_chunks(
+    DATA_UNIT* du, bool is_chunk, map<int, int>& counts
+) {
+    if (is_chunk) {
+        CHUNK* c = (CHUNK*)du;
+        set<VDA_CHUNK_HOST*>::iterator i;
+        for (i=c->hosts.begin(); i!=c->hosts.end(); i++) {
+            counts[(*i)->host_id]++;
         }
+        return;
+    }
+    META_CHUNK* mc = (META_CHUNK*)du;
+    for (unsigned int i=0; i<mc->children.size(); i++) {
+        count_chunks(mc->children[i], mc->bottom_level, counts);
     }
 }
 
+static int insert_chunk_hosts(string& values) {
+    if (values.empty()) return 0;
+    DB_VDA_CHUNK_HOST ch;
+    int retval = ch.insert_batch(values);
+    values.clear();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "VDA_CHUNK_HOST insert_batch() failed: %d\n", retval
+        );
+    }
+    return retval;
+}
+
+// insert this many VDA_CHUNK_HOST records per query
+//
+#define ASSIGN_BATCH_SIZE   1000
+
+// Place the chunks in pending_assign on hosts,
+// creating their VDA_CHUNK_HOST records in a few multi-row inserts.
+// The hosts come from vda_host_index (no per-chunk DB queries).
+// A chunk goes to the live host
+// - that doesn't already have it, and has room for it;
+// - preferably in a failure domain (subnet) where no chunk
+//   of the same meta-chunk is stored;
+// - with the fewest chunks of this file, and then highest availability.
+//
+int VDA_FILE_AUX::assign_chunks() {
+    int retval;
+    char buf[1024];
+
+    if (pending_assign.empty()) return 0;
+    double now = dtime();
+    retval = vda_host_index.update(now);
+    if (retval) return retval;
+    vector<VDA_HOST_INFO>& hosts = vda_host_index.hosts;
+    if (hosts.empty()) {
+        log_messages.printf(MSG_CRITICAL, "assign_chunks(): no live hosts\n");
+        pending_assign.clear();
+        return ERR_NOT_FOUND;
+    }
+
+    map<int, int> counts;
+    count_chunks(meta_chunk, false, counts);
+
+    map<int, unsigned int> host_domains;
+    priority_queue<HOST_SLOT> heap;
+    for (unsigned int i=0; i<hosts.size(); i++) {
+        host_domains[hosts[i].id] = hosts[i].domain;
+        HOST_SLOT hs;
+        hs.nchunks = counts[hosts[i].id];
+        hs.availability = hosts[i].availability;
+        hs.index = i;
+        heap.push(hs);
+    }
+
+    string values;
+    int nbatch = 0, nassigned = 0;
+    vector<HOST_SLOT> skipped;
+    for (unsigned int i=0; i<pending_assign.size(); i++) {
+        CHUNK* c = pending_assign[i];
+        int nneeded = policy.replication - (int)c->hosts.size();
+        while (nneeded > 0) {
+            set<int> have;
+            set<VDA_CHUNK_HOST*>::iterator j;
+            for (j=c->hosts.begin(); j!=c->hosts.end(); j++) {
+                have.insert((*j)->host_id);
+            }
+            set<unsigned int> domains;
+            sibling_domains(c, host_domains, domains);
+
+            // take the best host in a new domain;
+            // failing that, the best host that can take the chunk at all
+            //
+            int found = -1;
+            int fallback = -1;
+            while (!heap.empty()) {
+                HOST_SLOT hs = heap.top();
+                heap.pop();
+                skipped.push_back(hs);
+                VDA_HOST_INFO& hi = hosts[hs.index];
+                if (have.count(hi.id)) continue;
+                if (hi.free < c->size) continue;
+                if (fallback < 0) fallback = (int)skipped.size()-1;
+                if (!domains.count(hi.domain)) {
+                    found = (int)skipped.size()-1;
+                    break;
+                }
+            }
+            if (found < 0) found = fallback;
+            if (found >= 0) {
+                HOST_SLOT& hs = skipped[found];
+                VDA_HOST_INFO& hi = hosts[hs.index];
+                hs.nchunks++;
+                hi.free -= c->size;
+
+                DB_VDA_CHUNK_HOST ch;
+                ch.create_time = now;
+                ch.vda_file_id = id;
+                ch.host_id = hi.id;
+                physical_file_name(hi.id, c->name, file_name, ch.physical_file_name);
+                ch.present_on_host = 0;
+                ch.transfer_in_progress = true;
+                ch.transfer_wait = true;
+                ch.transfer_request_time = now;
+                ch.transfer_send_time = 0;
+                ch.db_print_values(buf);
+                if (nbatch) values += ",";
+                values += buf;
+                nbatch++;
+
+                // vdad keeps the tree in memory, so record this there too
+                //
+                VDA_CHUNK_HOST* chp = new VDA_CHUNK_HOST();
+                *chp = ch;
+                c->hosts.insert(chp);
+                nassigned++;
+                log_messages.printf(MSG_NORMAL,
+                    "   assigning chunk %s to host %d\n", c->name, hi.id
+                );
+            }
+            for (unsigned int k=0; k<skipped.size(); k++) {
+                heap.push(skipped[k]);
+            }
+            skipped.clear();
+            if (found < 0) {
+                log_messages.printf(MSG_CRITICAL,
+                    "assign_chunks(): no host for chunk %s\n", c->name
+                );
+                break;
+            }
+            nneeded--;
+            if (nbatch == ASSIGN_BATCH_SIZE) {
+                retval = insert_chunk_hosts(values);
+                if (retval) {
+                    pending_assign.clear();
+                    return retval;
+                }
+                nbatch = 0;
+            }
+        }
+    }
+    pending_assign.clear();
+    retval = insert_chunk_hosts(values);
+    if (retval) return retval;
+    if (nassigned) {
+        log_messages.printf(MSG_NORMAL,
+            "assign_chunks(): %d replicas of %s assigned\n",
+            nassigned, file_name
+        );
+    }
+    return 0;
+}
@@ -22,7 +22,13 @@
 // and VDA_CHUNK_HOSTs.
 // Calls the recovery routines to initiate transfers,
 // update the DB, etc.
+//
+// The trees stay in memory, and are kept current by reading
+// the changelog of VDA_CHUNK_HOST changes written by the scheduler
+// (see vda_lib.h), so a file is read from the DB only the first time
+// it's processed, and then every FULL_REFRESH_PERIOD seconds.
 
+#include <map>
 #include <set>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -36,46 +42,150 @@
 #include "error_numbers.h"
 #include "util.h"
 #include "filesys.h"
+#include "str_replace.h"
 
 #include "vda_lib.h"
 
+using std::map;
 using std::vector;
 using std::set;
 
+#define FULL_REFRESH_PERIOD 86400
+    // rebuild in-memory trees from the DB this often,
+    // in case changelog entries were lost
+#define MAX_CHANGELOG_SIZE  (16*1024*1024)
+    // start a new changelog when it gets this big
+
+typedef map<int, VDA_FILE_AUX*> FILE_MAP;
+FILE_MAP files;
+    // files whose trees are in memory, keyed by ID
+long changelog_offset = 0;
+    // how much of the changelog we've applied
+
 void show_msg(char* msg) {
     printf("%s", msg);
 }
 
-int handle_file(VDA_FILE_AUX& vf, DB_VDA_FILE& dvf) {
+void forget_file(FILE_MAP::iterator i) {
+    i->second->free_state();
+    delete i->second;
+    files.erase(i);
+}
+
+void forget_files() {
+    while (!files.empty()) {
+        forget_file(files.begin());
+    }
+}
+
+// apply changelog lines from the given offset on to the in-memory trees.
+// Return the offset of the first incomplete line.
+//
+long apply_changelog(const char* path, long offset) {
+    char buf[1024], name[256];
+    int file_id, host_id, retval;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return offset;
+    if (fseek(f, offset, SEEK_SET)) {
+        fclose(f);
+        return offset;
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        size_t n = strlen(buf);
+        if (!n || buf[n-1] != '\n') break;
+        offset += n;
+        if (sscanf(buf, "%d %d %255s", &file_id, &host_id, name) != 3) {
+            log_messages.printf(MSG_CRITICAL, "bad changelog line: %s", buf);
+            continue;
+        }
+        FILE_MAP::iterator i = files.find(file_id);
+        if (i == files.end()) continue;
+        retval = i->second->update_chunk_host(host_id, name);
+        if (retval) {
+            // we'll read it from the DB next time
+            //
+            log_messages.printf(MSG_CRITICAL,
+                "update_chunk_host(%s) failed: %d\n", name, retval
+            );
+            forget_file(i);
+        }
+    }
+    fclose(f);
+    return offset;
+}
+
+// bring the in-memory trees up to date with the changelog
+//
+void read_changelog() {
+    char path[MAXPATHLEN], old_path[MAXPATHLEN];
+    double size;
+
+    safe_strcpy(path, config.project_path(VDA_CHANGELOG_FILENAME));
+    if (file_size(path, size)) return;
+    if (size < changelog_offset) {
+        // someone else truncated or replaced it;
+        // we may have missed changes, so start over
+        //
+        log_messages.printf(MSG_NORMAL, "changelog was truncated\n");
+        forget_files();
+        changelog_offset = 0;
+    }
+    changelog_offset = apply_changelog(path, changelog_offset);
+
+    // If it's gotten big, move it aside; the scheduler starts a new one.
+    // Give scheduler instances that opened it before the rename
+    // time to finish their writes, then read what they wrote.
+    //
+    if (changelog_offset > MAX_CHANGELOG_SIZE) {
+        sprintf(old_path, "%s.old", path);
+        if (boinc_rename(path, old_path)) return;
+        boinc_sleep(1.);
+        apply_changelog(old_path, changelog_offset);
+        boinc_delete_file(old_path);
+        changelog_offset = 0;
+    }
+}
+
+int handle_file(VDA_FILE_AUX& vf, DB_VDA_FILE& dvf, bool resident) {
     int retval;
     char buf[1024];
 
     log_messages.printf(MSG_NORMAL, "processing file %s\n", vf.file_name);
 
-    // read the policy file
-    //
-    sprintf(buf, "%s/boinc_meta.txt", vf.dir);
-    retval = vf.policy.parse(buf);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL, "Can't parse policy file %s\n", buf);
-        return retval;
-    }
-    if (vf.initialized) {
-        log_messages.printf(MSG_NORMAL, "Getting state\n");
-        retval = vf.get_state();
+    if (resident) {
+        log_messages.printf(MSG_NORMAL, "Refreshing state\n");
+        retval = vf.refresh_state();
         if (retval) {
-            log_messages.printf(MSG_CRITICAL, "vf.get_state failed %d\n", retval);
+            log_messages.printf(MSG_CRITICAL, "vf.refresh_state failed %d\n", retval);
             return retval;
         }
     } else {
-        log_messages.printf(MSG_NORMAL, "Initializing\n");
-        retval = vf.init();
+        // read the policy file
+        //
+        sprintf(buf, "%s/boinc_meta.txt", vf.dir);
+        retval = vf.policy.parse(buf);
         if (retval) {
-            log_messages.printf(MSG_CRITICAL, "vf.init failed %d\n", retval);
+            log_messages.printf(MSG_CRITICAL, "Can't parse policy file %s\n", buf);
             return retval;
         }
-        sprintf(buf, "initialized=1, chunk_size=%.0f", vf.policy.chunk_size());
-        dvf.update_field(buf);
+        if (vf.initialized) {
+            log_messages.printf(MSG_NORMAL, "Getting state\n");
+            retval = vf.get_state();
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL, "vf.get_state failed %d\n", retval);
+                return retval;
+            }
+        } else {
+            log_messages.printf(MSG_NORMAL, "Initializing\n");
+            retval = vf.init();
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL, "vf.init failed %d\n", retval);
+                return retval;
+            }
+            sprintf(buf, "initialized=1, chunk_size=%.0f", vf.policy.chunk_size());
+            dvf.update_field(buf);
+        }
     }
     log_messages.printf(MSG_NORMAL, "Recovery plan:\n");
     vf.meta_chunk->recovery_plan();
@@ -147,6 +257,15 @@ int handle_file(VDA_FILE_AUX& vf, DB_VDA_FILE& dvf) {
     retval = vf.meta_chunk->recovery_action(dtime());
     if (retval) {
         log_messages.printf(MSG_CRITICAL, "vf.recovery_action failed %d\n", retval);
+        vf.pending_assign.clear();
+        return retval;
+    }
+
+    // place the chunks that recovery_action() said need more replicas
+    //
+    retval = vf.assign_chunks();
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "vf.assign_chunks failed %d\n", retval);
         return retval;
     }
     vf.meta_chunk->compute_min_failures();
@@ -160,6 +279,7 @@ bool scan_files() {
     bool found = false;
     int retval;
 
+    read_changelog();
     while (1) {
         retval = vf.enumerate("where need_update<>0");
         if (retval == ERR_DB_NOT_FOUND) break;
@@ -167,22 +287,41 @@ bool scan_files() {
             log_messages.printf(MSG_CRITICAL, "VDA_FILE enumerate failed\n");
             exit(1);
         }
-        VDA_FILE_AUX vfa(vf);
         found = true;
-        retval = handle_file(vfa, vf);
+
+        // clear the flag first, so that changes made
+        // while we're processing the file cause another pass
+        //
+        retval = vf.update_field("need_update=0");
         if (retval) {
             log_messages.printf(
-                MSG_CRITICAL, "handle_file() failed: %d\n", retval
+                MSG_CRITICAL, "update_field() failed: %d\n", retval
             );
             exit(1);
+        }
+
+        VDA_FILE_AUX* vfa;
+        FILE_MAP::iterator i = files.find(vf.id);
+        if (i != files.end() && i->second->state_time < dtime() - FULL_REFRESH_PERIOD) {
+            forget_file(i);
+            i = files.end();
+        }
+        bool resident = (i != files.end());
+        if (resident) {
+            vfa = i->second;
+            *(VDA_FILE*)vfa = vf;
         } else {
-            retval = vf.update_field("need_update=0");
-            if (retval) {
-                log_messages.printf(
-                    MSG_CRITICAL, "update_field() failed: %d\n", retval
-                );
-                exit(1);
-            }
+            vfa = new VDA_FILE_AUX(vf);
+        }
+        retval = handle_file(*vfa, vf, resident);
+        if (retval) {
+            log_messages.printf(
+                MSG_CRITICAL, "handle_file() failed: %d\n", retval
+            );
+            exit(1);
+        }
+        if (!resident) {
+            files[vf.id] = vfa;
         }
     }
     return found;
@@ -289,6 +428,13 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
+    // changes before this are already in the DB
+    //
+    double size;
+    if (!file_size(config.project_path(VDA_CHANGELOG_FILENAME), size)) {
+        changelog_offset = (long)size;
+    }
+
 #if 0
     VDA_FILE_AUX vf;
     memset(&vf, 0, sizeof(vf));
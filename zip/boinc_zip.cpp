@@ -127,7 +127,7 @@ int boinc_zip(
     //if (options && strlen(options)) 
     //      strcpy(av[1], options);
 
-    if (bZipType == ZIP_IT) {
+    if (bZipType == ZIP_IT || bZipType == ZIP_ADD) {
         strcpy(av[0], "zip");
         // default zip options -- no dir names, no subdirs, highest compression, quiet mode
         if (strlen(av[1])==0) {
@@ -156,7 +156,9 @@ int boinc_zip(
     av[carg] = NULL;
     // printf("args: %s %s %s %s\n", av[0], av[1], av[2], av[3]);
 
-    if (bZipType == ZIP_IT) {
+    if (bZipType == ZIP_ADD) {
+        iRet = zipmain(carg, av);
+    } else if (bZipType == ZIP_IT) {
         if (access(szFileZip.c_str(), 0) == 0) {
             // old zip file exists so unlink
             // (otherwise zip will reuse, doesn't seem to be a flag to 
@@ -37,6 +37,8 @@
 
 #define ZIP_IT   1
 #define UNZIP_IT 0
+#define ZIP_ADD  2
+    // like ZIP_IT, but add files to (or replace them in) an existing archive
 
 // bitmasks for sort type on the ZipFileList 
 // optional but CPDN SmallExecs likes reverse date order